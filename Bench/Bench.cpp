@@ -0,0 +1,1067 @@
+/**
+ * @file Bench.cpp
+ * @brief Microbenchmarks for the framing, persistence and search hot paths
+ *
+ * PURPOSE:
+ * Regressions in the code every message and every lookup goes through
+ * should show up as numbers before they show up as complaints. Each case
+ * here drives one public entry point of the real stores against scratch
+ * files; nothing from the UI is linked.
+ *
+ * DESIGN:
+ * - A case is a function that performs `iterations` operations. The
+ *   runner raises the iteration count until one sample takes at least
+ *   --min-ms, then takes --samples samples and reports ns/op
+ * - Results are JSON lines on stdout (or --out), one object per case and
+ *   parameter, so runs can be diffed and plotted; progress goes to stderr
+ * - Stores are filled through their bulk paths (ImportXml, AddMessages)
+ *   so setup does not dominate; users carry no password, which keeps
+ *   PBKDF2 out of the setup
+ * - Everything is written under --dir, which is emptied before and after
+ * - concurrent.* cases split each sample's operations over `param`
+ *   threads; ns/op is wall time, so it falls as reads scale across cores
+ * - Global operator new is counted, so every case also reports heap
+ *   allocations per operation (allocs_per_op); for the per-message
+ *   paths this should stay at the one frame buffer the message needs
+ * - backend.echo.<kind> runs one connection through each event backend
+ *   this platform has (IOCP; epoll and io_uring on Linux) the way the
+ *   server's loop does: notification or delivered data, decode, posted
+ *   send, completion
+ * - validate.fuzz checks every validation kernel against the scalar loop
+ *   on random input before the validate.* timings; a mismatch makes the
+ *   run exit nonzero
+ * - outbound.slow_consumer checks that a send queue whose client stopped
+ *   reading starts dropping and is then cut off, and that one which
+ *   catches up is not; a failure makes the run exit nonzero
+ *
+ * USAGE:
+ *   Bench [--filter substring] [--samples 5] [--min-ms 200] [--quick]
+ *         [--out results.jsonl] [--dir bench_data]
+ */
+
+#include "NetProtocol.h"
+#include "FrameBuffer.h"
+#include "OutboundQueue.h"
+#include "IoBackend.h"
+#include "FrameCompression.h"
+#include "Protocol.h"
+#include "Models.h"
+#include "MessageService.h"
+#include "UserDatabase.h"
+#include "ServerManager.h"
+#include "ServerIdentity.h"
+#include "InviteToken.h"
+#include "SecureHandshake.h"
+#include "PersistenceWorker.h"
+#include "TextValidation.h"
+#include "pugixml.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+//=============================================================================
+// ALLOCATION COUNTING
+//=============================================================================
+
+namespace {
+std::atomic<uint64_t> g_allocations{ 0 };
+}
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return ::operator new(size, tag); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+
+namespace {
+
+//=============================================================================
+// RUNNER
+//=============================================================================
+
+struct Options {
+    std::string filter;
+    int samples = 5;
+    uint64_t minSampleMs = 200;
+    bool quick = false;             // Smaller data sets, for a quick sanity run
+    std::string outPath;
+    std::string dataDir = "bench_data";
+};
+
+Options g_options;
+FILE* g_out = stdout;
+
+// Results are folded in here so the optimizer cannot drop the work
+volatile uint64_t g_sink = 0;
+
+using BenchFunction = std::function<void(uint64_t iterations)>;
+
+uint64_t NowNs() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool Selected(const std::string& name) {
+    return g_options.filter.empty() || name.find(g_options.filter) != std::string::npos;
+}
+
+/** @brief True if any of a group's cases will run (to skip its setup otherwise) */
+bool AnySelected(std::initializer_list<const char*> names) {
+    return std::any_of(names.begin(), names.end(), [](const char* name) { return Selected(name); });
+}
+
+/**
+ * @brief Time one case and emit its JSON line
+ * @param param Size the case was run at (0 if it has none)
+ * @param maxIterations Cap for calibration, for operations that grow the data they touch
+ */
+void Run(const std::string& name, uint64_t param, const BenchFunction& body,
+         uint64_t maxIterations = UINT64_MAX) {
+    if (!Selected(name)) {
+        return;
+    }
+
+    // Calibrate: grow until one sample is long enough to time reliably
+    uint64_t iterations = 1;
+    uint64_t minNs = g_options.minSampleMs * 1000000;
+    for (;;) {
+        uint64_t start = NowNs();
+        body(iterations);
+        uint64_t elapsed = NowNs() - start;
+        if (elapsed >= minNs || iterations >= maxIterations) {
+            break;
+        }
+        // Jump close to the target instead of creeping up from 1
+        uint64_t scale = elapsed > 0 ? (minNs / elapsed) + 1 : 16;
+        iterations = (std::min)(maxIterations, iterations * (std::min)(scale, uint64_t(16)));
+    }
+
+    std::vector<double> nsPerOp;
+    uint64_t allocationsBefore = g_allocations.load(std::memory_order_relaxed);
+    for (int s = 0; s < g_options.samples; ++s) {
+        uint64_t start = NowNs();
+        body(iterations);
+        nsPerOp.push_back(static_cast<double>(NowNs() - start) / static_cast<double>(iterations));
+    }
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    double median = nsPerOp[nsPerOp.size() / 2];
+    double allocsPerOp = static_cast<double>(g_allocations.load(std::memory_order_relaxed) - allocationsBefore) /
+                         (static_cast<double>(iterations) * g_options.samples);
+
+    fprintf(g_out,
+            "{\"name\":\"%s\",\"param\":%llu,\"iterations\":%llu,\"samples\":%d,"
+            "\"ns_per_op_median\":%.1f,\"ns_per_op_min\":%.1f,\"ns_per_op_max\":%.1f,\"ops_per_sec\":%.1f,"
+            "\"allocs_per_op\":%.2f}\n",
+            name.c_str(), static_cast<unsigned long long>(param), static_cast<unsigned long long>(iterations),
+            g_options.samples, median, nsPerOp.front(), nsPerOp.back(), median > 0 ? 1e9 / median : 0.0,
+            allocsPerOp);
+    fflush(g_out);
+    fprintf(stderr, "[BENCH] %-32s %8llu  %12.1f ns/op  %8.2f allocs/op\n", name.c_str(),
+            static_cast<unsigned long long>(param), median, allocsPerOp);
+}
+
+std::string DataPath(const std::string& file) {
+    return g_options.dataDir + "/" + file;
+}
+
+std::vector<uint64_t> Sizes(std::vector<uint64_t> full) {
+    if (g_options.quick) {
+        full.resize(1);
+    }
+    return full;
+}
+
+//=============================================================================
+// FRAMING
+//=============================================================================
+
+/** @brief Connected TCP pair on the loopback interface (blocking) */
+struct LoopbackPair {
+    SOCKET client = INVALID_SOCKET;
+    SOCKET server = INVALID_SOCKET;
+
+    bool Open() {
+        SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener == INVALID_SOCKET) {
+            return false;
+        }
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = 0;
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        socklen_t length = sizeof(address);
+        bool ok = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+                  listen(listener, 1) == 0 &&
+                  getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) == 0;
+        if (ok) {
+            client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            ok = client != INVALID_SOCKET &&
+                 connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        }
+        if (ok) {
+            server = accept(listener, nullptr, nullptr);
+            ok = server != INVALID_SOCKET;
+        }
+        closesocket(listener);
+        if (ok) {
+            NetProtocol::ConfigureSocket(client);
+            NetProtocol::ConfigureSocket(server);
+        }
+        return ok;
+    }
+
+    ~LoopbackPair() {
+        if (client != INVALID_SOCKET) closesocket(client);
+        if (server != INVALID_SOCKET) closesocket(server);
+    }
+};
+
+void BenchFraming() {
+    LoopbackPair pair;
+    if (!pair.Open()) {
+        fprintf(stderr, "[BENCH] Loopback pair unavailable, skipping framing cases\n");
+        return;
+    }
+
+    for (uint64_t size : { 16, 1024, 16384, 65536 }) {
+        std::string payload(static_cast<size_t>(size), 'x');
+        std::string received;
+        // One op: a frame out through SendMessage and back in through ReceiveMessage
+        Run("netprotocol.send_receive", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                NetProtocol::SendMessage(pair.client, payload);
+                NetProtocol::ReceiveMessage(pair.server, received);
+                g_sink += received.size();
+            }
+        });
+    }
+
+    Run("netprotocol.hello_roundtrip", 0, [](uint64_t iterations) {
+        uint32_t version = 0;
+        std::string username;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            std::string hello = NetProtocol::BuildHello(NetProtocol::PROTOCOL_VERSION, "benchmark_user");
+            NetProtocol::ParseHello(hello, version, username);
+            std::string welcome = NetProtocol::BuildWelcome(NetProtocol::NegotiateVersion(version));
+            NetProtocol::ParseWelcome(welcome, version);
+            g_sink += version + username.size();
+        }
+    });
+
+    for (uint64_t size : { 1024, 16384, 65536 }) {
+        // Chat-like text, the shape of a history page
+        std::string payload;
+        for (uint64_t i = 0; payload.size() < size; ++i) {
+            payload += "[CH:" + std::to_string(1 + i % 8) + "] user" + std::to_string(i % 50) +
+                       ": benchmark message " + std::to_string(i) + " with some typical chat text\n";
+        }
+        payload.resize(static_cast<size_t>(size));
+
+        NetProtocol::Deflater deflater;
+        Run("framecompression.encode", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                g_sink += deflater.Encode(payload).size();
+            }
+        });
+
+        NetProtocol::FrameBuffer frame = deflater.Encode(payload);
+        NetProtocol::FrameDecoder decoder;
+        decoder.EnableCompression();
+        std::string received;
+        // One op: a compressed frame fed to a decoder and inflated
+        Run("framecompression.decode", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                decoder.Feed(frame.data(), frame.size());
+                decoder.NextFrame(received);
+                g_sink += received.size();
+            }
+        });
+    }
+}
+
+//=============================================================================
+// SEND QUEUE
+//=============================================================================
+
+/**
+ * @brief A client that never reads must be disconnected, not starved forever
+ *
+ * Broadcasts of every frame size are queued with no send ever completing,
+ * the way a stalled socket looks to the server. The queue has to drop
+ * first and report OverLimit within a bounded number of frames. A client
+ * that drains its queue between bursts must never be cut off.
+ * @return False (after printing why) if either expectation fails
+ */
+bool CheckSlowConsumer() {
+    if (!Selected("outbound.slow_consumer")) {
+        return true;
+    }
+    OutboundQueue::Limits limits;
+    const size_t sizes[] = { 64, 1024, 16384, NetProtocol::MAX_MESSAGE_SIZE };
+
+    for (size_t size : sizes) {
+        NetProtocol::FrameBuffer frame = NetProtocol::FrameBuffer::Encode(std::string(size, 'x'));
+        OutboundQueue stalled;
+        bool dropped = false;
+        bool cutOff = false;
+        // Queued plus dropped can only grow by one frame per call
+        size_t bound = limits.disconnectWatermark / frame.size() + 2;
+        for (size_t i = 0; i < bound && !cutOff; ++i) {
+            switch (stalled.Enqueue(frame)) {
+            case OutboundQueue::EnqueueResult::Queued:
+                break;
+            case OutboundQueue::EnqueueResult::Dropped:
+                dropped = true;
+                break;
+            case OutboundQueue::EnqueueResult::OverLimit:
+                cutOff = true;
+                break;
+            }
+        }
+        if (!dropped || !cutOff) {
+            fprintf(stderr, "[BENCH] Stalled consumer with %zu-byte frames was %s after %zu frames\n",
+                    frame.size(), dropped ? "never disconnected" : "never throttled", bound);
+            return false;
+        }
+
+        OutboundQueue draining;
+        std::vector<WSABUF> buffers;
+        std::vector<OutboundQueue::Buffer> keepAlive;
+        for (size_t burst = 0; burst < 64; ++burst) {
+            // Each burst overflows the drop mark, then the client reads it all
+            for (size_t i = 0; i * frame.size() <= limits.dropWatermark; ++i) {
+                if (draining.Enqueue(frame) == OutboundQueue::EnqueueResult::OverLimit) {
+                    fprintf(stderr, "[BENCH] Draining consumer with %zu-byte frames was disconnected\n",
+                            frame.size());
+                    return false;
+                }
+            }
+            while (size_t bytes = draining.PrepareBatch(buffers, keepAlive)) {
+                draining.OnSent(bytes);
+            }
+        }
+    }
+    fprintf(stderr, "[BENCH] Send queue cuts off stalled consumers and keeps draining ones\n");
+    return true;
+}
+
+//=============================================================================
+// EVENT BACKENDS
+//=============================================================================
+
+/**
+ * @brief One accepted connection served through an IoBackend
+ *
+ * The client end is an ordinary blocking socket; the server end is only
+ * touched the way ServerSocket touches it, so one Echo() is what a
+ * request costs the server's event loop.
+ */
+struct BackendConnection {
+    std::unique_ptr<NetProtocol::IoBackend> backend;
+    SOCKET listener = INVALID_SOCKET;
+    SOCKET client = INVALID_SOCKET;
+    SOCKET server = INVALID_SOCKET;
+    NetProtocol::FrameDecoder decoder;
+    std::vector<NetProtocol::IoBackend::Event> events;
+    std::string message;
+
+    bool Open(NetProtocol::IoBackend::Kind kind) {
+        listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener == INVALID_SOCKET) {
+            return false;
+        }
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        socklen_t length = sizeof(address);
+        if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listener, 1) != 0 ||
+            getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            return false;
+        }
+        try {
+            backend = NetProtocol::IoBackend::Create(listener, kind);
+        }
+        catch (const std::exception& e) {
+            fprintf(stderr, "[BENCH] %s backend unavailable: %s\n", NetProtocol::IoBackend::KindName(kind), e.what());
+            return false;
+        }
+
+        client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (client == INVALID_SOCKET ||
+            connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            return false;
+        }
+        NetProtocol::ConfigureSocket(client);
+        for (int attempt = 0; attempt < 50 && server == INVALID_SOCKET; ++attempt) {
+            backend->Poll(events, 100);
+            for (const auto& event : events) {
+                if (event.type == NetProtocol::IoBackend::EventType::Accepted) {
+                    server = event.socket;
+                }
+            }
+        }
+        if (server == INVALID_SOCKET) {
+            return false;
+        }
+        NetProtocol::ConfigureSocket(server);
+        NetProtocol::SetNonBlocking(server);
+        if (backend->DeliversData()) {
+            decoder.SetExternalInput();
+        }
+        return backend->Associate(server);
+    }
+
+    /** @brief Serve one frame already sent by the client until its echo is out */
+    bool Echo() {
+        for (;;) {
+            if (backend->Poll(events, 1000) == 0) {
+                return false;
+            }
+            for (const auto& event : events) {
+                switch (event.type) {
+                case NetProtocol::IoBackend::EventType::Received:
+                    if (event.bytes == 0 || decoder.Feed(event.data, event.bytes) != NetProtocol::Result::Success) {
+                        return false;
+                    }
+                    [[fallthrough]];
+                case NetProtocol::IoBackend::EventType::Readable:
+                    while (NetProtocol::ReceiveMessage(server, decoder, message) == NetProtocol::Result::Success) {
+                        NetProtocol::FrameBuffer frame = NetProtocol::FrameBuffer::Encode(message);
+                        std::vector<WSABUF> buffers(1);
+                        buffers[0].buf = const_cast<char*>(frame.data());
+                        buffers[0].len = static_cast<decltype(buffers[0].len)>(frame.size());
+                        std::vector<NetProtocol::FrameBuffer> keepAlive;
+                        keepAlive.push_back(std::move(frame));
+                        if (!backend->PostSend(server, buffers, std::move(keepAlive))) {
+                            return false;
+                        }
+                    }
+                    backend->Rearm(server);
+                    break;
+                case NetProtocol::IoBackend::EventType::SendComplete:
+                    return true;
+                case NetProtocol::IoBackend::EventType::Accepted:
+                    closesocket(event.socket);
+                    break;
+                case NetProtocol::IoBackend::EventType::Wakeup:
+                    break;
+                default:
+                    return false;
+                }
+            }
+        }
+    }
+
+    ~BackendConnection() {
+        if (server != INVALID_SOCKET) {
+            backend->Remove(server);
+            closesocket(server);
+        }
+        if (client != INVALID_SOCKET) closesocket(client);
+        backend.reset();
+        if (listener != INVALID_SOCKET) closesocket(listener);
+    }
+};
+
+void BenchBackends() {
+    using Kind = NetProtocol::IoBackend::Kind;
+#ifdef _WIN32
+    const Kind kinds[] = { Kind::Iocp };
+#else
+    const Kind kinds[] = { Kind::Epoll, Kind::IoUring };
+#endif
+    for (Kind kind : kinds) {
+        std::string name = std::string("backend.echo.") + NetProtocol::IoBackend::KindName(kind);
+        if (!Selected(name)) {
+            continue;
+        }
+        BackendConnection connection;
+        if (!connection.Open(kind)) {
+            fprintf(stderr, "[BENCH] Skipping %s\n", name.c_str());
+            continue;
+        }
+        for (uint64_t size : { 16, 1024, 16384 }) {
+            std::string payload(static_cast<size_t>(size), 'x');
+            std::string received;
+            bool ok = true;
+            // One op: a frame in through the backend and its echo back out
+            Run(name, size, [&](uint64_t iterations) {
+                for (uint64_t i = 0; i < iterations && ok; ++i) {
+                    NetProtocol::SendMessage(connection.client, payload);
+                    ok = connection.Echo() &&
+                         NetProtocol::ReceiveMessage(connection.client, received) == NetProtocol::Result::Success;
+                    g_sink += received.size();
+                }
+            });
+            if (!ok) {
+                fprintf(stderr, "[BENCH] %s lost the connection\n", name.c_str());
+                break;
+            }
+        }
+    }
+}
+
+//=============================================================================
+// MESSAGE HISTORY
+//=============================================================================
+
+constexpr uint64_t BENCH_CHANNELS = 8;
+
+std::unique_ptr<MessageService> OpenHistory(uint64_t messages) {
+    std::string path = DataPath("messages_" + std::to_string(messages) + ".xml");
+    auto service = std::make_unique<MessageService>(path);
+
+    std::vector<MessageService::NewMessage> batch;
+    batch.reserve(1000);
+    for (uint64_t i = 0; i < messages; ++i) {
+        batch.push_back({ 1 + i % BENCH_CHANNELS, 1 + i % 50, "user" + std::to_string(i % 50),
+                          "benchmark message " + std::to_string(i) + " with some typical chat text",
+                          Models::MessageType::Text });
+        if (batch.size() == 1000 || i + 1 == messages) {
+            service->AddMessages(batch);
+            batch.clear();
+        }
+    }
+    service->SaveToFile();
+    return service;
+}
+
+void BenchHistory() {
+    for (uint64_t size : Sizes({ 1000, 10000, 100000 })) {
+        if (!AnySelected({ "message.add", "message.add_and_save", "message.reload", "message.page_newest",
+                           "message.page_evicted", "message.search_rare", "message.search_common" })) {
+            return;
+        }
+        fprintf(stderr, "[BENCH] Building history of %llu messages\n", static_cast<unsigned long long>(size));
+        std::unique_ptr<MessageService> service = OpenHistory(size);
+
+        uint64_t sequence = 0;
+        Run("message.add", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                Models::Message message = service->AddMessage(1 + sequence % BENCH_CHANNELS, 1, "user0",
+                                                              "benchmark message " + std::to_string(sequence));
+                ++sequence;
+                g_sink += message.messageId;
+            }
+        }, size / 4);
+
+        // One op: a handful of new messages, then the compaction that folds them in
+        Run("message.add_and_save", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                for (int m = 0; m < 10; ++m) {
+                    service->AddMessage(1 + sequence % BENCH_CHANNELS, 1, "user0",
+                                        "benchmark message " + std::to_string(sequence));
+                    ++sequence;
+                }
+                service->SaveToFile();
+            }
+        }, 64);
+
+        Run("message.reload", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                service->ReloadFromFile();
+            }
+        }, 64);
+
+        Run("message.page_newest", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                g_sink += service->GetMessagesBefore(1 + i % BENCH_CHANNELS, 0, 50).size();
+            }
+        });
+
+        // Opening a channel whose index was released while idle
+        Run("message.page_evicted", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                service->EvictIdleChannels(std::chrono::seconds(0));
+                g_sink += service->GetMessagesBefore(1 + i % BENCH_CHANNELS, 0, 50).size();
+            }
+        }, 256);
+
+        // Every bench channel belongs to one server. A rare word intersects
+        // short lists; words in every message decode the longest ones
+        std::vector<uint64_t> channelIds;
+        for (uint64_t c = 1; c <= BENCH_CHANNELS; ++c) {
+            channelIds.push_back(c);
+        }
+        Run("message.search_rare", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                std::string query = "message " + std::to_string((i * 7919) % size);
+                g_sink += service->SearchMessages(channelIds, query, 20).size();
+            }
+        });
+
+        Run("message.search_common", size, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                g_sink += service->SearchMessages(channelIds, "typical chat text", 20).size();
+            }
+        });
+    }
+}
+
+//=============================================================================
+// USER AND SERVER SEARCH
+//=============================================================================
+
+/** @brief Write an importable user file with `count` password-less users */
+bool WriteUserXml(const std::string& path, uint64_t count) {
+    pugi::xml_document doc;
+    pugi::xml_node users = doc.append_child("UserDatabase").append_child("Users");
+    for (uint64_t i = 0; i < count; ++i) {
+        pugi::xml_node user = users.append_child("User");
+        user.append_attribute("id") = static_cast<unsigned long long>(i + 1);
+        user.append_attribute("username") = ("user" + std::to_string(i)).c_str();
+        user.append_attribute("createdAt") = 0LL;
+        user.append_attribute("lastLoginAt") = 0LL;
+    }
+    return doc.save_file(path.c_str());
+}
+
+void BenchSearch() {
+    for (uint64_t size : Sizes({ 1000, 10000, 100000 })) {
+        if (!AnySelected({ "users.search_prefix", "servers.search", "servers.user_servers" })) {
+            return;
+        }
+        fprintf(stderr, "[BENCH] Building %llu users and %llu servers\n",
+                static_cast<unsigned long long>(size), static_cast<unsigned long long>(size / 10));
+
+        std::string tag = std::to_string(size);
+        std::string importPath = DataPath("import_" + tag + ".xml");
+        if (!WriteUserXml(importPath, size)) {
+            fprintf(stderr, "[BENCH] Could not write %s\n", importPath.c_str());
+            return;
+        }
+        UserDatabase users(DataPath("users_" + tag + ".xml"));
+        users.ImportXml(importPath);
+
+        Run("users.search_prefix", size, [&](uint64_t iterations) {
+            static const char* prefixes[] = { "user1", "user42", "user999", "nobody" };
+            for (uint64_t i = 0; i < iterations; ++i) {
+                g_sink += users.SearchUsers(prefixes[i % 4]).size();
+            }
+        });
+
+        // One server per ten users; the first user joins as many as allowed
+        ServerManager servers(DataPath("servers_" + tag + ".xml"), users);
+        std::vector<uint64_t> serverIds;
+        for (uint64_t i = 0; i < size / 10; ++i) {
+            Models::ChatServer server;
+            if (servers.CreateServer("Server " + std::to_string(i), 2 + i, server) == Protocol::ErrorCode::None) {
+                serverIds.push_back(server.serverId);
+            }
+        }
+        for (size_t i = 0; i < serverIds.size() && i < Models::MAX_SERVERS_PER_USER; ++i) {
+            servers.JoinServer(serverIds[i], 1);
+        }
+
+        Run("servers.search", size / 10, [&](uint64_t iterations) {
+            static const char* terms[] = { "Server 1", "ver 42", "999", "missing" };
+            for (uint64_t i = 0; i < iterations; ++i) {
+                g_sink += servers.SearchServers(terms[i % 4]).size();
+            }
+        });
+
+        Run("servers.user_servers", size / 10, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                g_sink += servers.GetUserServers(1).size();
+            }
+        });
+    }
+}
+
+//=============================================================================
+// CONCURRENT READS
+//=============================================================================
+
+/** @brief Split `iterations` calls of op(i) over `threads` threads and wait */
+void RunOnThreads(uint64_t threads, uint64_t iterations, const std::function<void(uint64_t)>& op) {
+    std::vector<uint64_t> done(threads, 0);
+    std::vector<std::thread> workers;
+    for (uint64_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            for (uint64_t i = t; i < iterations; i += threads) {
+                op(i);
+                ++done[t];
+            }
+        });
+    }
+    for (uint64_t t = 0; t < threads; ++t) {
+        workers[t].join();
+        g_sink += done[t];
+    }
+}
+
+void BenchConcurrentReads() {
+    if (!AnySelected({ "concurrent.user_by_id", "concurrent.get_server", "concurrent.page_newest" })) {
+        return;
+    }
+    constexpr uint64_t USERS = 10000;
+    fprintf(stderr, "[BENCH] Building %llu users and %llu servers for concurrent reads\n",
+            static_cast<unsigned long long>(USERS), static_cast<unsigned long long>(USERS / 10));
+
+    std::string importPath = DataPath("import_concurrent.xml");
+    if (!WriteUserXml(importPath, USERS)) {
+        fprintf(stderr, "[BENCH] Could not write %s\n", importPath.c_str());
+        return;
+    }
+    UserDatabase users(DataPath("users_concurrent.xml"));
+    users.ImportXml(importPath);
+
+    ServerManager servers(DataPath("servers_concurrent.xml"), users);
+    std::vector<uint64_t> serverIds;
+    for (uint64_t i = 0; i < USERS / 10; ++i) {
+        Models::ChatServer server;
+        if (servers.CreateServer("Server " + std::to_string(i), 1 + i, server) == Protocol::ErrorCode::None) {
+            serverIds.push_back(server.serverId);
+        }
+    }
+    std::unique_ptr<MessageService> history = OpenHistory(10000);
+
+    for (uint64_t threads : Sizes({ 1, 2, 4, 8 })) {
+        Run("concurrent.user_by_id", threads, [&](uint64_t iterations) {
+            RunOnThreads(threads, iterations, [&](uint64_t i) {
+                Models::User user;
+                users.GetUserById(1 + i % USERS, user);
+            });
+        });
+
+        if (!serverIds.empty()) {
+            Run("concurrent.get_server", threads, [&](uint64_t iterations) {
+                RunOnThreads(threads, iterations, [&](uint64_t i) {
+                    Models::ChatServer server;
+                    servers.GetServer(serverIds[i % serverIds.size()], server);
+                });
+            });
+        }
+
+        Run("concurrent.page_newest", threads, [&](uint64_t iterations) {
+            RunOnThreads(threads, iterations, [&](uint64_t i) {
+                history->GetMessagesBefore(1 + i % BENCH_CHANNELS, 0, 50);
+            });
+        });
+    }
+}
+
+//=============================================================================
+// TEXT COMMANDS
+//=============================================================================
+
+void BenchTextCommands() {
+    if (!AnySelected({ "text.parse_command", "text.chat_frame" })) {
+        return;
+    }
+    // What v1 clients send most, in the shapes the server sees
+    const std::vector<std::string> lines = {
+        "[CH:1234567]benchmark message with some typical chat text",
+        "W/some_longer_username_than_sso_allows hello there, are you around?",
+        "/join_channel 1234567",
+        "an untagged line for the global channel",
+    };
+
+    Run("text.parse_command", 0, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            Protocol::TextCommand command = Protocol::ParseTextCommand(lines[i % lines.size()]);
+            g_sink += command.content.size() + command.target.size() + command.channelId;
+        }
+    });
+
+    // Parse a tagged line and build the frame broadcast for it, as
+    // ServerSocket::postChatMessage does; the frame is the one allocation
+    const std::string username = "benchmark_user";
+    Run("text.chat_frame", 0, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            Protocol::TextCommand command = Protocol::ParseTextCommand(lines[0]);
+            char idText[20];
+            std::to_chars_result id = std::to_chars(idText, idText + sizeof(idText), command.channelId);
+            NetProtocol::FrameBuffer frame = NetProtocol::FrameBuffer::EncodeParts(
+                { Protocol::CHANNEL_TAG_PREFIX, std::string_view(idText, id.ptr - idText), "]",
+                  username, ": ", command.content });
+            g_sink += frame.size();
+        }
+    });
+}
+
+//=============================================================================
+// VALIDATION
+//=============================================================================
+
+/**
+ * @brief Differential fuzz: every kernel must agree with the scalar loop
+ *
+ * Bytes are drawn mostly from next to the classes' range ends, where an
+ * off-by-one in a vector compare would show, and lengths cover the
+ * block sizes and the tails around them.
+ * @return False (after printing the first case) on any disagreement
+ */
+bool FuzzValidation() {
+    using namespace TextValidation;
+    const CharClass* classes[] = { &PRINTABLE_ASCII, &MESSAGE_TEXT, &ACCOUNT_NAME, &SERVER_NAME, &CHANNEL_NAME };
+    const Kernel kernels[] = { Kernel::Sse2, Kernel::Avx2 };
+
+    std::vector<uint8_t> edges;
+    for (const CharClass* allowed : classes) {
+        for (size_t r = 0; r < allowed->count; ++r) {
+            for (int delta = -1; delta <= 1; ++delta) {
+                edges.push_back(static_cast<uint8_t>(allowed->ranges[r].lo + delta));
+                edges.push_back(static_cast<uint8_t>(allowed->ranges[r].hi + delta));
+            }
+        }
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    auto next = [&state] {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    };
+
+    const int rounds = g_options.quick ? 2000 : 20000;
+    std::string text;
+    for (int round = 0; round < rounds; ++round) {
+        text.resize(next() % 301);
+        for (char& c : text) {
+            uint64_t pick = next();
+            c = static_cast<char>(pick % 4 == 0 ? static_cast<uint8_t>(pick >> 8)
+                                                : edges[(pick >> 8) % edges.size()]);
+        }
+        // Mostly valid input, so the kernels also have to run to the end
+        if (round % 2 == 0) {
+            for (char& c : text) {
+                c = static_cast<char>('a' + static_cast<uint8_t>(c) % 26);
+            }
+            if (!text.empty() && next() % 2 == 0) {
+                text[next() % text.size()] = static_cast<char>(edges[next() % edges.size()]);
+            }
+        }
+
+        for (size_t k = 0; k < std::size(classes); ++k) {
+            size_t expected = FindInvalidWith(Kernel::Scalar, text, *classes[k]);
+            for (Kernel kernel : kernels) {
+                size_t actual = FindInvalidWith(kernel, text, *classes[k]);
+                if (actual != expected) {
+                    fprintf(stderr, "[BENCH] Validation mismatch: %s class %zu length %zu: %lld, scalar %lld\n",
+                            KernelName(kernel), k, text.size(), static_cast<long long>(actual),
+                            static_cast<long long>(expected));
+                    return false;
+                }
+            }
+        }
+    }
+    fprintf(stderr, "[BENCH] Validation kernels agree on %d random inputs (best: %s)\n",
+            rounds, KernelName(BestKernel()));
+    return true;
+}
+
+bool BenchValidation() {
+    if (!AnySelected({ "validate.fuzz", "validate.message_text", "validate.username" })) {
+        return true;
+    }
+    if (Selected("validate.fuzz") && !FuzzValidation()) {
+        return false;
+    }
+
+    // Longest message the models accept, and what a client may frame
+    for (uint64_t size : Sizes({ 64, 4096, 65536 })) {
+        std::string text;
+        while (text.size() < size) {
+            text += "The quick brown fox jumps over the lazy dog.\n";
+        }
+        text.resize(size);
+        for (TextValidation::Kernel kernel : { TextValidation::Kernel::Scalar, TextValidation::Kernel::Sse2,
+                                               TextValidation::Kernel::Avx2 }) {
+            Run(std::string("validate.message_text.") + TextValidation::KernelName(kernel), size,
+                [&](uint64_t iterations) {
+                    for (uint64_t i = 0; i < iterations; ++i) {
+                        g_sink += TextValidation::FindInvalidWith(kernel, text, TextValidation::MESSAGE_TEXT);
+                    }
+                });
+        }
+    }
+
+    const std::string username = "some_longer_username_than_sso";
+    Run("validate.username", 0, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            g_sink += Models::User::IsValidUsername(username);
+        }
+    });
+    return true;
+}
+
+//=============================================================================
+// INVITES AND HANDSHAKE
+//=============================================================================
+
+void BenchSecurity() {
+    if (!AnySelected({ "invite.validate", "invite.parse_base64", "handshake.client_hello",
+                       "handshake.server_hello_create", "handshake.server_hello_verify",
+                       "handshake.join_request" })) {
+        return;
+    }
+    std::optional<Security::ServerIdentity> identity = Security::ServerIdentity::Generate();
+    if (!identity) {
+        fprintf(stderr, "[BENCH] Could not generate a server identity, skipping security cases\n");
+        return;
+    }
+    std::optional<Security::InviteToken> token = Security::InviteToken::Create(*identity, 1, 86400, 0);
+    if (!token) {
+        fprintf(stderr, "[BENCH] Could not create an invite, skipping security cases\n");
+        return;
+    }
+    std::string encoded = token->ToBase64();
+
+    Run("invite.validate", 0, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            g_sink += static_cast<uint64_t>(token->Validate(*identity));
+        }
+    });
+
+    Run("invite.parse_base64", 0, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            g_sink += Security::InviteToken::FromBase64(encoded).has_value();
+        }
+    });
+
+    Security::ClientHello clientHello;
+    clientHello.protocolVersion = 1;
+    clientHello.clientNonce.fill(7);
+
+    Run("handshake.client_hello", 0, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            std::vector<uint8_t> wire = Security::WrapMessage(Security::HandshakeMessageType::ClientHello,
+                                                              clientHello.Serialize());
+            auto unwrapped = Security::UnwrapMessage(wire);
+            g_sink += unwrapped && Security::ClientHello::Parse(unwrapped->second).has_value();
+        }
+    });
+
+    std::optional<Security::ServerHello> serverHello = Security::ServerHello::Create(*identity, clientHello.clientNonce);
+    if (serverHello) {
+        Run("handshake.server_hello_create", 0, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                g_sink += Security::ServerHello::Create(*identity, clientHello.clientNonce).has_value();
+            }
+        });
+
+        std::vector<uint8_t> serverHelloBytes = serverHello->Serialize();
+        Run("handshake.server_hello_verify", 0, [&](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                auto parsed = Security::ServerHello::Parse(serverHelloBytes);
+                g_sink += parsed && parsed->Verify(clientHello.clientNonce);
+            }
+        });
+    }
+
+    Security::JoinRequest join;
+    join.inviteToken = token->Serialize();
+    join.timestamp = 0;
+    join.usernameHint = "benchmark_user";
+    Run("handshake.join_request", 0, [&](uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; ++i) {
+            g_sink += Security::JoinRequest::Parse(join.Serialize()).has_value();
+        }
+    });
+}
+
+//=============================================================================
+// MAIN
+//=============================================================================
+
+void PrintUsage() {
+    fprintf(stderr, "Usage: Bench [--filter substring] [--samples n] [--min-ms n] [--quick]\n"
+                    "             [--out file] [--dir scratch directory]\n");
+}
+
+bool ParseOptions(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        if (key == "--quick") {
+            g_options.quick = true;
+            continue;
+        }
+        if (key == "--help" || key == "-h" || i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (key == "--filter")       g_options.filter = value;
+        else if (key == "--samples") g_options.samples = (std::max)(1, std::atoi(value));
+        else if (key == "--min-ms")  g_options.minSampleMs = std::strtoull(value, nullptr, 10);
+        else if (key == "--out")     g_options.outPath = value;
+        else if (key == "--dir")     g_options.dataDir = value;
+        else return false;
+    }
+    return !g_options.dataDir.empty();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!ParseOptions(argc, argv)) {
+        PrintUsage();
+        return 1;
+    }
+    if (!g_options.outPath.empty()) {
+        g_out = fopen(g_options.outPath.c_str(), "w");
+        if (!g_out) {
+            fprintf(stderr, "[BENCH] Cannot open %s\n", g_options.outPath.c_str());
+            return 1;
+        }
+    }
+
+    if (!NetProtocol::StartNetworking()) {
+        fprintf(stderr, "[BENCH] Socket library failed to start\n");
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::remove_all(g_options.dataDir, error);
+    std::filesystem::create_directories(g_options.dataDir, error);
+
+    BenchFraming();
+    BenchBackends();
+    BenchTextCommands();
+    bool kernelsAgree = BenchValidation();
+    bool queueChecked = CheckSlowConsumer();
+    BenchHistory();
+    BenchSearch();
+    BenchConcurrentReads();
+    BenchSecurity();
+
+    // Let the stores' background writers finish before their files go
+    PersistenceWorker::FlushAll();
+    std::filesystem::remove_all(g_options.dataDir, error);
+
+    NetProtocol::StopNetworking();
+    if (g_out != stdout) {
+        fclose(g_out);
+    }
+    return kernelsAgree && queueChecked ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file AddressResolver.cpp
+ * @brief Cached IPv4 host name resolution
+ */
+
+#include "AddressResolver.h"
+#include <ws2tcpip.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+struct CachedAnswer {
+    std::vector<in_addr> addresses;
+    ULONGLONG expiresMs = 0;
+};
+
+std::mutex cacheMutex;
+std::unordered_map<std::string, CachedAnswer> answers;
+
+/** Key under which LocalAddress() caches its answer; not a valid host name */
+const char* const LOCAL_HOST_KEY = "\x01local";
+
+bool Lookup(const std::string& key, std::vector<in_addr>& out) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto found = answers.find(key);
+    if (found == answers.end()) {
+        return false;
+    }
+    if (GetTickCount64() >= found->second.expiresMs) {
+        answers.erase(found);
+        return false;
+    }
+    out = found->second.addresses;
+    return true;
+}
+
+void Store(const std::string& key, const std::vector<in_addr>& addresses) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    CachedAnswer& answer = answers[key];
+    answer.addresses = addresses;
+    answer.expiresMs = GetTickCount64() + AddressResolver::CACHE_TTL_MS;
+}
+
+bool ResolveUncached(const char* host, std::vector<in_addr>& out) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0) {
+        return false;
+    }
+    for (addrinfo* entry = result; entry != nullptr; entry = entry->ai_next) {
+        in_addr address = reinterpret_cast<sockaddr_in*>(entry->ai_addr)->sin_addr;
+        bool duplicate = false;
+        for (const in_addr& seen : out) {
+            duplicate = duplicate || seen.s_addr == address.s_addr;
+        }
+        if (!duplicate) {
+            out.push_back(address);
+        }
+    }
+    freeaddrinfo(result);
+    return !out.empty();
+}
+
+} // namespace
+
+bool AddressResolver::Resolve(const std::string& host, std::vector<in_addr>& out) {
+    out.clear();
+    in_addr literal = {};
+    if (inet_pton(AF_INET, host.c_str(), &literal) == 1) {
+        out.push_back(literal);
+        return true;
+    }
+    if (host.empty() || Lookup(host, out)) {
+        return !out.empty();
+    }
+    if (!ResolveUncached(host.c_str(), out)) {
+        out.clear();
+        return false;
+    }
+    Store(host, out);
+    return true;
+}
+
+std::string AddressResolver::LocalAddress() {
+    std::vector<in_addr> addresses;
+    if (!Lookup(LOCAL_HOST_KEY, addresses)) {
+        char hostname[256];
+        if (gethostname(hostname, sizeof(hostname)) == SOCKET_ERROR ||
+            !ResolveUncached(hostname, addresses)) {
+            return "127.0.0.1";
+        }
+        Store(LOCAL_HOST_KEY, addresses);
+    }
+
+    for (const in_addr& address : addresses) {
+        char text[INET_ADDRSTRLEN];
+        // Skip loopback addresses
+        if ((ntohl(address.s_addr) >> 24) != 127 && inet_ntop(AF_INET, &address, text, sizeof(text))) {
+            return text;
+        }
+    }
+    return "127.0.0.1";
+}
+
+void AddressResolver::Clear() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    answers.clear();
+}
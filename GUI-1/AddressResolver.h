@@ -0,0 +1,52 @@
+#ifndef ADDRESS_RESOLVER_H
+#define ADDRESS_RESOLVER_H
+
+/**
+ * @file AddressResolver.h
+ * @brief Host name resolution with a short-lived cache
+ *
+ * PURPOSE:
+ * getaddrinfo() may go to the network and block for seconds. Joining a
+ * server, retrying a join and looking up this machine's own address for
+ * hosting all resolved the same names again each time. Answers are kept
+ * for CACHE_TTL_MS, long enough to cover a burst of attempts and short
+ * enough that a changed address is picked up on the next try.
+ *
+ * DESIGN:
+ * - IPv4 only, like every socket in this program
+ * - Dotted literals are parsed directly and never cached
+ * - Failures are not cached, so a retry after fixing DNS works at once
+ *
+ * THREADING:
+ * Thread-safe. Lookups run outside the lock, so a slow name never holds
+ * up the others; two threads missing on the same name both resolve it.
+ * The caller must have initialised Winsock.
+ */
+
+#include <winsock2.h>
+#include <string>
+#include <vector>
+
+class AddressResolver {
+public:
+    /** How long a resolved name is reused */
+    static constexpr ULONGLONG CACHE_TTL_MS = 30000;
+
+    /**
+     * @brief IPv4 addresses of a host, in resolver order
+     * @param host Name or dotted address
+     * @param out Replaced with the addresses
+     * @return False if the host does not resolve (out is then empty)
+     */
+    static bool Resolve(const std::string& host, std::vector<in_addr>& out);
+
+    /**
+     * @brief This machine's first non-loopback IPv4 address, or "127.0.0.1"
+     */
+    static std::string LocalAddress();
+
+    /** @brief Forget every cached answer */
+    static void Clear();
+};
+
+#endif // ADDRESS_RESOLVER_H
@@ -0,0 +1,425 @@
+/**
+ * @file AttachmentServer.cpp
+ * @brief Implementation of the attachment transfer port
+ */
+
+#include "AttachmentServer.h"
+#include "ServerIdentity.h"
+#include "Trace.h"
+#include "Log.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <ws2tcpip.h>
+
+namespace {
+
+/** Bytes read from a transfer connection per recv() */
+constexpr size_t RECEIVE_CHUNK_BYTES = 64 * 1024;
+
+/** Accepts kept outstanding; transfers are few and long */
+constexpr size_t PENDING_ACCEPTS = 4;
+
+/**
+ * Slowest download rate allowed before a connection is given up on; a
+ * download's deadline is the idle timeout plus its length at this rate
+ */
+constexpr uint64_t MIN_DOWNLOAD_BYTES_PER_SECOND = 64 * 1024;
+
+constexpr size_t HEADER_LENGTH = AttachmentServer::TRANSFER_MAGIC_LENGTH + AttachmentServer::TICKET_LENGTH;
+
+} // namespace
+
+AttachmentServer::AttachmentServer(int port, const std::string& directory)
+    : m_port(port)
+    , m_store(directory)
+    , m_socket(INVALID_SOCKET)
+    , m_running(false)
+    , m_buffer(RECEIVE_CHUNK_BYTES)
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        throw std::runtime_error("WSAStartup failed");
+    }
+
+    auto fail = [this](const char* what) {
+        if (m_socket != INVALID_SOCKET) {
+            closesocket(m_socket);
+        }
+        WSACleanup();
+        throw std::runtime_error(what);
+    };
+
+    addrinfo hints = { 0 };
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = NULL;
+    if (getaddrinfo(NULL, std::to_string(port).c_str(), &hints, &result) != 0) {
+        fail("Failed to resolve attachment port");
+    }
+
+    m_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    bool bound = m_socket != INVALID_SOCKET &&
+                 bind(m_socket, result->ai_addr, static_cast<int>(result->ai_addrlen)) != SOCKET_ERROR;
+    freeaddrinfo(result);
+    if (!bound || listen(m_socket, SOMAXCONN) == SOCKET_ERROR) {
+        fail("Failed to listen on attachment port");
+    }
+
+    try {
+        m_engine = std::make_unique<IocpEngine>(m_socket, PENDING_ACCEPTS);
+    }
+    catch (const std::exception& e) {
+        fail(e.what());
+    }
+
+    m_running = true;
+    m_thread = std::thread(&AttachmentServer::Run, this);
+    LOG_INFO("[ATTACH] Transfer port %d open", port);
+}
+
+AttachmentServer::~AttachmentServer() {
+    Stop();
+    // Engine must go before the listener so it can cancel pending AcceptEx calls
+    m_engine.reset();
+    closesocket(m_socket);
+    WSACleanup();
+}
+
+void AttachmentServer::Stop() {
+    if (!m_running.exchange(false)) {
+        return;
+    }
+    m_engine->Wake();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    // Thread has exited; partial uploads stay on disk for a later resume
+    std::vector<SOCKET> open;
+    for (const auto& entry : m_transfers) {
+        open.push_back(entry.first);
+    }
+    for (SOCKET socket : open) {
+        close(socket);
+    }
+}
+
+//=============================================================================
+// TICKETS (chat network thread)
+//=============================================================================
+
+Protocol::ErrorCode AttachmentServer::GrantUpload(const std::string& digest, uint64_t size,
+                                                  Protocol::Payloads::AttachmentTicket& out) {
+    if (!AttachmentStore::IsValidDigest(digest) || size == 0) {
+        return Protocol::ErrorCode::InvalidAttachment;
+    }
+    if (size > AttachmentStore::MAX_ATTACHMENT_BYTES) {
+        return Protocol::ErrorCode::AttachmentTooLarge;
+    }
+
+    out = Protocol::Payloads::AttachmentTicket();
+    out.port = static_cast<uint32_t>(m_port);
+    out.size = size;
+
+    // Same bytes already here: the upload is done before it starts
+    uint64_t stored = 0;
+    if (m_store.Find(digest, stored)) {
+        if (stored != size) {
+            return Protocol::ErrorCode::InvalidAttachment;
+        }
+        out.offset = size;
+        out.complete = true;
+        return Protocol::ErrorCode::None;
+    }
+
+    Ticket ticket;
+    ticket.upload = true;
+    ticket.digest = digest;
+    ticket.size = size;
+    ticket.offset = m_store.ResumeOffset(digest, size);
+    out.offset = ticket.offset;
+    return issue(ticket, out) ? Protocol::ErrorCode::None : Protocol::ErrorCode::ServerOverloaded;
+}
+
+Protocol::ErrorCode AttachmentServer::GrantDownload(const std::string& digest, uint64_t offset,
+                                                    Protocol::Payloads::AttachmentTicket& out) {
+    if (!AttachmentStore::IsValidDigest(digest)) {
+        return Protocol::ErrorCode::InvalidAttachment;
+    }
+    uint64_t size = 0;
+    if (!m_store.Find(digest, size)) {
+        return Protocol::ErrorCode::AttachmentNotFound;
+    }
+    if (offset > size) {
+        return Protocol::ErrorCode::InvalidAttachment;
+    }
+
+    out = Protocol::Payloads::AttachmentTicket();
+    out.port = static_cast<uint32_t>(m_port);
+    out.size = size;
+    out.offset = offset;
+    if (offset == size) {
+        out.complete = true;
+        return Protocol::ErrorCode::None;
+    }
+
+    Ticket ticket;
+    ticket.digest = digest;
+    ticket.size = size;
+    ticket.offset = offset;
+    return issue(ticket, out) ? Protocol::ErrorCode::None : Protocol::ErrorCode::ServerOverloaded;
+}
+
+bool AttachmentServer::issue(Ticket ticket, Protocol::Payloads::AttachmentTicket& out) {
+    uint8_t random[TICKET_LENGTH / 2];
+    if (Security::GenerateRandomBytes(random, sizeof(random)) != Security::CryptoResult::Success) {
+        return false;
+    }
+    std::string id = Security::BytesToHex(random, sizeof(random));
+
+    ULONGLONG now = GetTickCount64();
+    std::lock_guard<std::mutex> lock(m_ticketMutex);
+    if (m_tickets.size() >= MAX_TICKETS) {
+        for (auto it = m_tickets.begin(); it != m_tickets.end();) {
+            it = (now >= it->second.expiresMs) ? m_tickets.erase(it) : std::next(it);
+        }
+        if (m_tickets.size() >= MAX_TICKETS) {
+            LOG_WARNING("[ATTACH] Ticket table full");
+            return false;
+        }
+    }
+    ticket.expiresMs = now + TICKET_LIFETIME_MS;
+    m_tickets[id] = std::move(ticket);
+    out.ticket = id;
+    return true;
+}
+
+bool AttachmentServer::redeem(const std::string& id, Ticket& out) {
+    std::lock_guard<std::mutex> lock(m_ticketMutex);
+    auto found = m_tickets.find(id);
+    if (found == m_tickets.end()) {
+        return false;
+    }
+    out = std::move(found->second);
+    m_tickets.erase(found);
+    return GetTickCount64() < out.expiresMs;
+}
+
+//=============================================================================
+// TRANSFERS (transfer thread)
+//=============================================================================
+
+void AttachmentServer::Run() {
+    Trace::SetThreadName("attachments");
+    std::vector<IocpEngine::Event> events;
+    while (m_running.load()) {
+        m_engine->Poll(events, POLL_WAIT_MS);
+        for (const IocpEngine::Event& event : events) {
+            switch (event.type) {
+                case IocpEngine::EventType::Accepted:
+                    accept(event.socket);
+                    break;
+                case IocpEngine::EventType::Readable: {
+                    auto found = m_transfers.find(event.socket);
+                    if (found != m_transfers.end()) {
+                        onReadable(event.socket, found->second);
+                    }
+                    break;
+                }
+                case IocpEngine::EventType::SendComplete:
+                    // The download is with the transport; a graceful close delivers it
+                    LOG_DEBUG("[ATTACH] Download of %zu bytes sent", event.bytes);
+                    close(event.socket);
+                    break;
+                case IocpEngine::EventType::Closed:
+                case IocpEngine::EventType::SendFailed:
+                    close(event.socket);
+                    break;
+                case IocpEngine::EventType::Received:   // Not from IOCP
+                case IocpEngine::EventType::Wakeup:
+                    break;
+            }
+        }
+        expireIdle();
+    }
+}
+
+void AttachmentServer::accept(SOCKET socket) {
+    if (m_transfers.size() >= MAX_TRANSFERS) {
+        LOG_WARNING("[ATTACH] Too many transfers; refusing a connection");
+        closesocket(socket);
+        return;
+    }
+    u_long nonBlocking = 1;
+    if (ioctlsocket(socket, FIONBIO, &nonBlocking) == SOCKET_ERROR || !m_engine->Associate(socket)) {
+        closesocket(socket);
+        return;
+    }
+    m_transfers[socket].deadlineMs = GetTickCount64() + TRANSFER_IDLE_TIMEOUT_MS;
+}
+
+void AttachmentServer::onReadable(SOCKET socket, Transfer& transfer) {
+    size_t taken = 0;
+    while (taken < MAX_BYTES_PER_TURN) {
+        int received = recv(socket, m_buffer.data(), static_cast<int>(m_buffer.size()), 0);
+        if (received > 0) {
+            taken += static_cast<size_t>(received);
+            transfer.deadlineMs = GetTickCount64() + TRANSFER_IDLE_TIMEOUT_MS;
+            if (!consume(socket, transfer, m_buffer.data(), static_cast<size_t>(received))) {
+                close(socket);
+                return;
+            }
+            continue;
+        }
+        if (received == 0 || WSAGetLastError() != WSAEWOULDBLOCK) {
+            // Gone before the end; an upload keeps what it wrote for a resume
+            close(socket);
+            return;
+        }
+        break;
+    }
+
+    // A connection with more waiting completes its read at once and gets
+    // another turn after the others
+    if (!m_engine->Rearm(socket)) {
+        close(socket);
+    }
+}
+
+bool AttachmentServer::consume(SOCKET socket, Transfer& transfer, const char* data, size_t length) {
+    if (transfer.header.size() < HEADER_LENGTH) {
+        size_t take = (std::min)(length, HEADER_LENGTH - transfer.header.size());
+        transfer.header.append(data, take);
+        data += take;
+        length -= take;
+        if (transfer.header.size() < HEADER_LENGTH) {
+            return true;
+        }
+        if (!start(socket, transfer)) {
+            return false;
+        }
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    // Nothing may follow a download request, nor the end of an upload
+    if (!transfer.upload || length > transfer.remaining) {
+        LOG_SECURITY("[SECURITY] Unexpected bytes on attachment transfer %.12s...", transfer.digest.c_str());
+        return false;
+    }
+
+    DWORD written = 0;
+    if (!WriteFile(transfer.file, data, static_cast<DWORD>(length), &written, nullptr) || written != length) {
+        LOG_WARNING("[ATTACH] Write failed: %lu", GetLastError());
+        char status = static_cast<char>(UploadStatus::Failed);
+        send(socket, &status, 1, 0);
+        return false;
+    }
+    transfer.remaining -= length;
+    if (transfer.remaining == 0) {
+        finishUpload(socket, transfer);
+        return false;
+    }
+    return true;
+}
+
+bool AttachmentServer::start(SOCKET socket, Transfer& transfer) {
+    if (transfer.header.compare(0, TRANSFER_MAGIC_LENGTH, TRANSFER_MAGIC) != 0) {
+        LOG_SECURITY("[SECURITY] Transfer connection without the attachment header");
+        return false;
+    }
+    Ticket ticket;
+    if (!redeem(transfer.header.substr(TRANSFER_MAGIC_LENGTH), ticket)) {
+        LOG_SECURITY("[SECURITY] Unknown or expired attachment ticket");
+        return false;
+    }
+    transfer.upload = ticket.upload;
+    transfer.digest = ticket.digest;
+
+    if (ticket.upload) {
+        if (!m_activeUploads.insert(ticket.digest).second) {
+            LOG_WARNING("[ATTACH] %.12s... is already being uploaded", ticket.digest.c_str());
+            return false;
+        }
+        transfer.file = m_store.Begin(ticket.digest, ticket.offset);
+        if (transfer.file == INVALID_HANDLE_VALUE) {
+            m_activeUploads.erase(ticket.digest);
+            LOG_WARNING("[ATTACH] Cannot open upload %.12s...: %lu", ticket.digest.c_str(), GetLastError());
+            return false;
+        }
+        transfer.remaining = ticket.size - ticket.offset;
+        LOG_INFO("[ATTACH] Receiving %.12s... from byte %llu of %llu",
+                 ticket.digest.c_str(), ticket.offset, ticket.size);
+        return true;
+    }
+
+    uint64_t size = 0;
+    transfer.file = m_store.Open(ticket.digest, size);
+    if (transfer.file == INVALID_HANDLE_VALUE || ticket.offset >= size) {
+        return false;
+    }
+
+    // One TransmitFile for the header and the whole rest of the file
+    uint64_t length = size - ticket.offset;
+    std::string head(DOWNLOAD_HEADER_LENGTH, '\0');
+    for (size_t i = 0; i < DOWNLOAD_HEADER_LENGTH; ++i) {
+        head[i] = static_cast<char>(length >> (8 * (DOWNLOAD_HEADER_LENGTH - 1 - i)));
+    }
+    if (!m_engine->PostTransmitFile(socket, transfer.file, ticket.offset, static_cast<DWORD>(length), std::move(head))) {
+        LOG_WARNING("[ATTACH] TransmitFile failed: %d", WSAGetLastError());
+        return false;
+    }
+    // No reads mark progress while the kernel sends; allow for a slow reader instead
+    transfer.deadlineMs = GetTickCount64() + TRANSFER_IDLE_TIMEOUT_MS + length * 1000 / MIN_DOWNLOAD_BYTES_PER_SECOND;
+    LOG_INFO("[ATTACH] Sending %.12s... from byte %llu", ticket.digest.c_str(), ticket.offset);
+    return true;
+}
+
+void AttachmentServer::finishUpload(SOCKET socket, Transfer& transfer) {
+    CloseHandle(transfer.file);
+    transfer.file = INVALID_HANDLE_VALUE;
+    m_activeUploads.erase(transfer.digest);
+
+    bool stored = m_store.Commit(transfer.digest);
+    char status = static_cast<char>(stored ? UploadStatus::Stored : UploadStatus::Corrupt);
+    send(socket, &status, 1, 0);
+    if (stored) {
+        LOG_INFO("[ATTACH] Stored %.12s...", transfer.digest.c_str());
+    }
+}
+
+void AttachmentServer::close(SOCKET socket) {
+    auto found = m_transfers.find(socket);
+    if (found == m_transfers.end()) {
+        return;
+    }
+    Transfer& transfer = found->second;
+    if (transfer.file != INVALID_HANDLE_VALUE) {
+        CloseHandle(transfer.file);
+        if (transfer.upload) {
+            m_activeUploads.erase(transfer.digest);
+        }
+    }
+    m_engine->Remove(socket);
+    shutdown(socket, SD_SEND);
+    closesocket(socket);
+    m_transfers.erase(found);
+}
+
+void AttachmentServer::expireIdle() {
+    ULONGLONG now = GetTickCount64();
+    std::vector<SOCKET> expired;
+    for (const auto& entry : m_transfers) {
+        if (now > entry.second.deadlineMs) {
+            expired.push_back(entry.first);
+        }
+    }
+    for (SOCKET socket : expired) {
+        LOG_INFO("[ATTACH] Closing stalled transfer");
+        close(socket);
+    }
+}
@@ -0,0 +1,181 @@
+#ifndef ATTACHMENT_SERVER_H
+#define ATTACHMENT_SERVER_H
+
+/**
+ * @file AttachmentServer.h
+ * @brief Bulk transfer port for attachments, served apart from chat
+ *
+ * PURPOSE:
+ * Files must not travel in chat frames: a 50 MB upload queued on the chat
+ * connection would hold every later line behind it, on the client and in
+ * the server's per-client send queue. The chat connection only asks for a
+ * ticket (RequestAttachment); the bytes go over a separate connection to
+ * this port, handled by its own thread and completion port, so chat
+ * latency does not depend on how much is being transferred.
+ *
+ * TRANSFER CONNECTION:
+ *   client -> server   TRANSFER_MAGIC (4 bytes), then the ticket (TICKET_LENGTH hex chars)
+ *   Upload:   client sends bytes [offset, size) of the file; the server
+ *             answers one UploadStatus byte and closes
+ *   Download: server sends the remaining length as 8 bytes, big-endian,
+ *             then bytes [offset, size) of the file, and closes
+ * A ticket is good for one connection and TICKET_LIFETIME_MS.
+ *
+ * ZERO COPY:
+ * Downloads are one overlapped TransmitFile each (IocpEngine), so the
+ * kernel sends from the file cache and the bytes never enter this
+ * process. Uploads are written as they arrive; the store verifies the
+ * digest before the file becomes visible (AttachmentStore.h).
+ *
+ * RESUMING:
+ * A dropped upload keeps what it wrote. Asking for a new ticket returns
+ * that length as the offset, and the client sends only the rest. A
+ * download resumes the same way from the length the client already has.
+ *
+ * THREADING:
+ * Grant*() are called from the chat server's network thread; tickets are
+ * handed over under a mutex. Everything else runs on the transfer thread.
+ */
+
+#include <winsock2.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "AttachmentStore.h"
+#include "IocpEngine.h"
+#include "Protocol.h"
+
+class AttachmentServer {
+public:
+    /** The transfer port is the chat port plus this */
+    static constexpr int PORT_OFFSET = 1;
+
+    /** How long the transfer thread blocks in the engine per iteration */
+    static constexpr DWORD POLL_WAIT_MS = 250;
+
+    /** First bytes of every transfer connection */
+    static constexpr const char* TRANSFER_MAGIC = "CRXF";
+    static constexpr size_t TRANSFER_MAGIC_LENGTH = 4;
+
+    /** Hex characters in a ticket (16 random bytes) */
+    static constexpr size_t TICKET_LENGTH = 32;
+
+    /** A ticket not redeemed within this is forgotten */
+    static constexpr ULONGLONG TICKET_LIFETIME_MS = 60000;
+
+    /** Tickets outstanding at most; beyond it grants are refused */
+    static constexpr size_t MAX_TICKETS = 1024;
+
+    /** Transfer connections open at once at most */
+    static constexpr size_t MAX_TRANSFERS = 64;
+
+    /** A connection that receives nothing for this long is closed */
+    static constexpr ULONGLONG TRANSFER_IDLE_TIMEOUT_MS = 30000;
+
+    /** Upload bytes taken from one connection before serving the next */
+    static constexpr size_t MAX_BYTES_PER_TURN = 1024 * 1024;
+
+    /** Bytes before the file data of a download */
+    static constexpr size_t DOWNLOAD_HEADER_LENGTH = 8;
+
+    /** Last byte of an upload */
+    enum class UploadStatus : uint8_t {
+        Stored = 0,     ///< Verified and stored
+        Corrupt = 1,    ///< Bytes did not match the digest; start again from 0
+        Failed = 2      ///< Could not be written; retry later
+    };
+
+    /**
+     * @brief Listen on a port and start the transfer thread
+     * @param port Transfer port (usually the chat port + PORT_OFFSET)
+     * @param directory Attachment store directory
+     * @throws std::runtime_error if the port or the store cannot be opened
+     */
+    explicit AttachmentServer(int port, const std::string& directory = AttachmentStore::DEFAULT_DIRECTORY);
+
+    /** Stops the thread and closes every transfer */
+    ~AttachmentServer();
+
+    /** @brief Stop serving and join the thread (idempotent) */
+    void Stop();
+
+    int Port() const { return m_port; }
+
+    /**
+     * @brief Ticket for uploading a file, or complete = true if it is already stored
+     * @return None, or why the upload is refused
+     */
+    Protocol::ErrorCode GrantUpload(const std::string& digest, uint64_t size, Protocol::Payloads::AttachmentTicket& out);
+
+    /**
+     * @brief Ticket for downloading a file from offset, or complete = true if nothing is left
+     * @return None, or why the download is refused
+     */
+    Protocol::ErrorCode GrantDownload(const std::string& digest, uint64_t offset, Protocol::Payloads::AttachmentTicket& out);
+
+private:
+    struct Ticket {
+        bool upload = false;
+        std::string digest;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        ULONGLONG expiresMs = 0;
+    };
+
+    struct Transfer {
+        std::string header;             ///< Until magic and ticket have arrived
+        bool upload = false;
+        std::string digest;
+        HANDLE file = INVALID_HANDLE_VALUE;
+        uint64_t remaining = 0;         ///< Upload bytes still expected
+        ULONGLONG deadlineMs = 0;       ///< Closed if still open then
+    };
+
+    int m_port;
+    AttachmentStore m_store;
+    SOCKET m_socket;
+    std::unique_ptr<IocpEngine> m_engine;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+
+    std::mutex m_ticketMutex;
+    std::unordered_map<std::string, Ticket> m_tickets;
+
+    // Transfer thread only
+    std::unordered_map<SOCKET, Transfer> m_transfers;
+    std::unordered_set<std::string> m_activeUploads;    ///< One writer per partial file
+    std::vector<char> m_buffer;
+
+    void Run();
+
+    /** Store a ticket and fill out.ticket; false if the table is full */
+    bool issue(Ticket ticket, Protocol::Payloads::AttachmentTicket& out);
+
+    /** Take a ticket out of the table; false if unknown or expired */
+    bool redeem(const std::string& id, Ticket& out);
+
+    void accept(SOCKET socket);
+    void onReadable(SOCKET socket, Transfer& transfer);
+
+    /** Feed received bytes to a transfer; false if the connection must close */
+    bool consume(SOCKET socket, Transfer& transfer, const char* data, size_t length);
+
+    /** Act on a complete header; false if it is refused */
+    bool start(SOCKET socket, Transfer& transfer);
+
+    /** Verify and store a finished upload, then tell the client */
+    void finishUpload(SOCKET socket, Transfer& transfer);
+
+    void close(SOCKET socket);
+    void expireIdle();
+
+    AttachmentServer(const AttachmentServer&) = delete;
+    AttachmentServer& operator=(const AttachmentServer&) = delete;
+};
+
+#endif // ATTACHMENT_SERVER_H
@@ -0,0 +1,150 @@
+/**
+ * @file AttachmentStore.cpp
+ * @brief Implementation of the content-addressed attachment store
+ */
+
+#include "AttachmentStore.h"
+#include "ServerIdentity.h"
+#include "Log.h"
+#include <stdexcept>
+
+namespace {
+
+bool FileSize(const std::string& path, uint64_t& size) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes) ||
+        (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+        return false;
+    }
+    size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    return true;
+}
+
+bool EnsureDirectory(const std::string& path) {
+    return CreateDirectoryA(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+} // namespace
+
+AttachmentStore::AttachmentStore(const std::string& directory)
+    : m_directory(directory)
+{
+    if (!EnsureDirectory(m_directory) || !EnsureDirectory(m_directory + "\\partial")) {
+        throw std::runtime_error("Failed to create attachment directory " + m_directory);
+    }
+    purgeStalePartials();
+}
+
+bool AttachmentStore::IsValidDigest(std::string_view digest) {
+    if (digest.size() != DIGEST_LENGTH) {
+        return false;
+    }
+    for (char c : digest) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AttachmentStore::DigestOfFile(const std::string& path, std::string& digest) {
+    std::array<uint8_t, 32> hash;
+    if (Security::ComputeFileSHA256(path, hash) != Security::CryptoResult::Success) {
+        return false;
+    }
+    digest = Security::BytesToHex(hash.data(), hash.size());
+    return true;
+}
+
+bool AttachmentStore::Find(const std::string& digest, uint64_t& size) const {
+    return IsValidDigest(digest) && FileSize(objectPath(digest), size);
+}
+
+uint64_t AttachmentStore::ResumeOffset(const std::string& digest, uint64_t size) const {
+    uint64_t partial = 0;
+    if (!IsValidDigest(digest) || !FileSize(partialPath(digest), partial) || partial >= size) {
+        return 0;
+    }
+    return partial;
+}
+
+HANDLE AttachmentStore::Begin(const std::string& digest, uint64_t offset) {
+    if (!IsValidDigest(digest)) {
+        return INVALID_HANDLE_VALUE;
+    }
+    HANDLE file = CreateFileA(partialPath(digest).c_str(), GENERIC_WRITE, 0, nullptr,
+                              OPEN_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    // Anything past the agreed offset was never acknowledged; drop it
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(offset);
+    if (!SetFilePointerEx(file, position, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+        CloseHandle(file);
+        return INVALID_HANDLE_VALUE;
+    }
+    return file;
+}
+
+bool AttachmentStore::Commit(const std::string& digest) {
+    std::string partial = partialPath(digest);
+    std::string actual;
+    if (!DigestOfFile(partial, actual) || actual != digest) {
+        LOG_SECURITY("[ATTACH] Upload %.12s... does not match its digest; discarded", digest.c_str());
+        DeleteFileA(partial.c_str());
+        return false;
+    }
+
+    // Someone else may have finished the same bytes first; theirs is as good
+    if (!MoveFileExA(partial.c_str(), objectPath(digest).c_str(), MOVEFILE_WRITE_THROUGH)) {
+        uint64_t existing = 0;
+        DeleteFileA(partial.c_str());
+        return FileSize(objectPath(digest), existing);
+    }
+    return true;
+}
+
+HANDLE AttachmentStore::Open(const std::string& digest, uint64_t& size) const {
+    if (!Find(digest, size)) {
+        return INVALID_HANDLE_VALUE;
+    }
+    return CreateFileA(objectPath(digest).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+}
+
+std::string AttachmentStore::objectPath(const std::string& digest) const {
+    return m_directory + "\\" + digest;
+}
+
+std::string AttachmentStore::partialPath(const std::string& digest) const {
+    return m_directory + "\\partial\\" + digest + ".part";
+}
+
+void AttachmentStore::purgeStalePartials() {
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA((m_directory + "\\partial\\*.part").c_str(), &entry);
+    if (search == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    ULARGE_INTEGER nowTicks = { { now.dwLowDateTime, now.dwHighDateTime } };
+    size_t purged = 0;
+    do {
+        ULARGE_INTEGER written = { { entry.ftLastWriteTime.dwLowDateTime, entry.ftLastWriteTime.dwHighDateTime } };
+        // FILETIME counts 100 ns units
+        if (nowTicks.QuadPart > written.QuadPart &&
+            (nowTicks.QuadPart - written.QuadPart) / 10000 > PARTIAL_MAX_AGE_MS &&
+            DeleteFileA((m_directory + "\\partial\\" + entry.cFileName).c_str())) {
+            ++purged;
+        }
+    } while (FindNextFileA(search, &entry));
+    FindClose(search);
+
+    if (purged > 0) {
+        LOG_INFO("[ATTACH] Removed %zu abandoned upload(s)", purged);
+    }
+}
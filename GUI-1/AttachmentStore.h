@@ -0,0 +1,100 @@
+#ifndef ATTACHMENT_STORE_H
+#define ATTACHMENT_STORE_H
+
+/**
+ * @file AttachmentStore.h
+ * @brief Content-addressed files shared in channels
+ *
+ * PURPOSE:
+ * Attachments are named by the SHA-256 of their bytes, so the same file
+ * uploaded twice (or by two users) is stored once and the second upload
+ * finishes before it starts. A name can never point at different bytes.
+ *
+ * LAYOUT (under the store directory):
+ *   <digest>                  Complete, verified attachment
+ *   partial/<digest>.part     Upload in progress; its length is how far it got
+ *
+ * An interrupted upload keeps its partial file, so the client resumes at
+ * ResumeOffset() instead of starting over. Commit() hashes the finished
+ * partial file and only then renames it into place; a file whose bytes do
+ * not match its digest is deleted, never served. Partial files left
+ * untouched for PARTIAL_MAX_AGE_MS are removed when the store opens.
+ *
+ * THREADING:
+ * Only file-system calls, so any thread may query the store. Writing one
+ * digest's partial file is up to a single caller (AttachmentServer keeps
+ * at most one upload per digest).
+ */
+
+#include <winsock2.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class AttachmentStore {
+public:
+    /** Where the chat server keeps attachments, next to its data files */
+    static constexpr const char* DEFAULT_DIRECTORY = "attachments";
+
+    /** Largest attachment accepted */
+    static constexpr uint64_t MAX_ATTACHMENT_BYTES = 64ull * 1024 * 1024;
+
+    /** Hex characters in a digest (SHA-256) */
+    static constexpr size_t DIGEST_LENGTH = 64;
+
+    /** Abandoned uploads older than this are deleted at start-up */
+    static constexpr ULONGLONG PARTIAL_MAX_AGE_MS = 24ull * 60 * 60 * 1000;
+
+    /**
+     * @brief Open (and create if needed) a store directory
+     * @throws std::runtime_error if the directories cannot be created
+     */
+    explicit AttachmentStore(const std::string& directory = DEFAULT_DIRECTORY);
+
+    /** @brief True for 64 lowercase hex characters */
+    static bool IsValidDigest(std::string_view digest);
+
+    /**
+     * @brief Hash a file the way the store names it
+     * @return False if the file cannot be read
+     */
+    static bool DigestOfFile(const std::string& path, std::string& digest);
+
+    /** @brief Size of a complete attachment, or false if it is not stored */
+    bool Find(const std::string& digest, uint64_t& size) const;
+
+    /**
+     * @brief Bytes of an upload already on disk
+     *
+     * A partial file that is not shorter than size cannot belong to this
+     * upload and counts as nothing; Begin() truncates it.
+     */
+    uint64_t ResumeOffset(const std::string& digest, uint64_t size) const;
+
+    /**
+     * @brief Open an upload's partial file for appending at offset
+     * @return INVALID_HANDLE_VALUE if it cannot be opened; otherwise close with CloseHandle
+     */
+    HANDLE Begin(const std::string& digest, uint64_t offset);
+
+    /**
+     * @brief Verify a finished upload and move it into place
+     * @return False if the bytes did not match the digest (the partial file is gone either way)
+     */
+    bool Commit(const std::string& digest);
+
+    /**
+     * @brief Open a complete attachment for overlapped, sequential reads
+     * @return INVALID_HANDLE_VALUE if it is not stored
+     */
+    HANDLE Open(const std::string& digest, uint64_t& size) const;
+
+private:
+    std::string m_directory;
+
+    std::string objectPath(const std::string& digest) const;
+    std::string partialPath(const std::string& digest) const;
+    void purgeStalePartials();
+};
+
+#endif // ATTACHMENT_STORE_H
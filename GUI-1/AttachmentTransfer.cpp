@@ -0,0 +1,358 @@
+/**
+ * @file AttachmentTransfer.cpp
+ * @brief Implementation of client-side attachment hashing and transfers
+ */
+
+#include "AttachmentTransfer.h"
+#include "AttachmentServer.h"
+#include "AttachmentStore.h"
+#include "AddressResolver.h"
+#include "UiDispatcher.h"
+#include "Trace.h"
+#include "Log.h"
+#include <mswsock.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+/** Longest single wait while connecting, so a cancel is noticed promptly */
+constexpr ULONGLONG CONNECT_POLL_MS = 100;
+
+/** Bytes read per recv() while downloading */
+constexpr size_t RECEIVE_CHUNK_BYTES = 64 * 1024;
+
+bool FileSize(const std::string& path, uint64_t& size) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes) ||
+        (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+        return false;
+    }
+    size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    return true;
+}
+
+bool SendAll(SOCKET socket, const char* data, size_t length) {
+    while (length > 0) {
+        int sent = send(socket, data, static_cast<int>(length), 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool ReceiveAll(SOCKET socket, char* data, size_t length) {
+    while (length > 0) {
+        int received = recv(socket, data, static_cast<int>(length), 0);
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        length -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+bool SeekTo(HANDLE file, uint64_t offset) {
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(offset);
+    return SetFilePointerEx(file, position, nullptr, FILE_BEGIN) != FALSE;
+}
+
+/** Verify a complete partial download against its digest and move it into place */
+void FinishDownload(const std::string& partial, const std::string& path, const std::string& digest,
+                    AttachmentTransfer::Result& result) {
+    std::string actual;
+    if (!AttachmentStore::DigestOfFile(partial, actual) || actual != digest) {
+        DeleteFileA(partial.c_str());
+        result.error = "The downloaded file is corrupted";
+    }
+    else if (!MoveFileExA(partial.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        result.error = "Cannot write " + path;
+    }
+}
+
+} // namespace
+
+AttachmentTransfer::AttachmentTransfer(Job job, Completion done)
+    : m_state(std::make_shared<State>())
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        throw std::runtime_error("WSAStartup failed");
+    }
+
+    std::shared_ptr<State> state = m_state;
+    m_thread = std::thread([state, job = std::move(job), done = std::move(done)]() {
+        Trace::SetThreadName("attachment");
+        Result result = job(*state);
+        state->finished = true;
+        UiDispatcher::Post([state, done, result]() {
+            if (!state->cancelled) {
+                done(result);
+            }
+        });
+    });
+}
+
+AttachmentTransfer::~AttachmentTransfer() {
+    Cancel();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    WSACleanup();
+}
+
+void AttachmentTransfer::Cancel() {
+    m_state->cancelled = true;
+    std::lock_guard<std::mutex> lock(m_state->socketMutex);
+    if (m_state->socket != INVALID_SOCKET) {
+        // Wakes a worker blocked in send/recv; it closes the socket itself
+        shutdown(m_state->socket, SD_BOTH);
+    }
+}
+
+uint64_t AttachmentTransfer::PartialLength(const std::string& path) {
+    uint64_t size = 0;
+    return FileSize(path + ".part", size) ? size : 0;
+}
+
+//=============================================================================
+// JOBS (worker thread)
+//=============================================================================
+
+std::unique_ptr<AttachmentTransfer> AttachmentTransfer::Hash(const std::string& path, Completion done) {
+    Job job = [path](State&) {
+        Result result;
+        if (!FileSize(path, result.size)) {
+            result.error = "Cannot open " + path;
+        }
+        else if (result.size == 0) {
+            result.error = "The file is empty";
+        }
+        else if (result.size > AttachmentStore::MAX_ATTACHMENT_BYTES) {
+            result.error = "The file is larger than " +
+                std::to_string(AttachmentStore::MAX_ATTACHMENT_BYTES / (1024 * 1024)) + " MB";
+        }
+        else if (!AttachmentStore::DigestOfFile(path, result.digest)) {
+            result.error = "Cannot read " + path;
+        }
+        return result;
+    };
+    return std::unique_ptr<AttachmentTransfer>(new AttachmentTransfer(std::move(job), std::move(done)));
+}
+
+std::unique_ptr<AttachmentTransfer> AttachmentTransfer::Upload(const std::string& path, const std::string& host,
+                                                               const Protocol::Payloads::AttachmentTicket& ticket,
+                                                               Completion done) {
+    Job job = [path, host, ticket](State& state) {
+        Result result;
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            result.error = "Cannot open " + path;
+            return result;
+        }
+        SOCKET socket = openTransfer(state, host, ticket, result.error);
+        if (socket == INVALID_SOCKET) {
+            CloseHandle(file);
+            return result;
+        }
+
+        // Loaded through the provider, like AcceptEx in IocpEngine
+        LPFN_TRANSMITFILE transmitFile = nullptr;
+        GUID transmitFileGuid = WSAID_TRANSMITFILE;
+        DWORD bytes = 0;
+        if (WSAIoctl(socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &transmitFileGuid, sizeof(transmitFileGuid),
+                     &transmitFile, sizeof(transmitFile), &bytes, NULL, NULL) == SOCKET_ERROR) {
+            result.error = "TransmitFile unavailable";
+        }
+
+        // The file pointer is set before each call; a synchronous
+        // TransmitFile sends from wherever it points
+        uint64_t position = ticket.offset;
+        while (result.error.empty() && position < ticket.size && !state.cancelled) {
+            DWORD chunk = static_cast<DWORD>((std::min)(ticket.size - position, static_cast<uint64_t>(SEND_CHUNK_BYTES)));
+            if (!SeekTo(file, position) || !transmitFile(socket, file, chunk, 0, nullptr, nullptr, 0)) {
+                result.error = "Upload failed (error " + std::to_string(WSAGetLastError()) + ")";
+                break;
+            }
+            position += chunk;
+        }
+        CloseHandle(file);
+        result.size = position - ticket.offset;
+
+        char status = 0;
+        if (state.cancelled) {
+            result.error = "Cancelled";
+        }
+        else if (result.error.empty() && !ReceiveAll(socket, &status, 1)) {
+            result.error = "The server did not confirm the upload";
+        }
+        else if (result.error.empty() && status == static_cast<char>(AttachmentServer::UploadStatus::Corrupt)) {
+            result.error = "The server received a different file than was hashed; try again";
+        }
+        else if (result.error.empty() && status != static_cast<char>(AttachmentServer::UploadStatus::Stored)) {
+            result.error = "The server could not store the file";
+        }
+        closeTransfer(state, socket);
+        return result;
+    };
+    return std::unique_ptr<AttachmentTransfer>(new AttachmentTransfer(std::move(job), std::move(done)));
+}
+
+std::unique_ptr<AttachmentTransfer> AttachmentTransfer::Download(const std::string& path, const std::string& digest,
+                                                                 const std::string& host,
+                                                                 const Protocol::Payloads::AttachmentTicket& ticket,
+                                                                 Completion done) {
+    Job job = [path, digest, host, ticket](State& state) {
+        Result result;
+        std::string partial = path + ".part";
+        if (ticket.complete) {
+            // Every byte arrived last time, but the check or rename did not
+            FinishDownload(partial, path, digest, result);
+            return result;
+        }
+        HANDLE file = CreateFileA(partial.c_str(), GENERIC_WRITE, 0, nullptr,
+                                  OPEN_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE || !SeekTo(file, ticket.offset) || !SetEndOfFile(file)) {
+            if (file != INVALID_HANDLE_VALUE) {
+                CloseHandle(file);
+            }
+            result.error = "Cannot write " + partial;
+            return result;
+        }
+        SOCKET socket = openTransfer(state, host, ticket, result.error);
+        if (socket == INVALID_SOCKET) {
+            CloseHandle(file);
+            return result;
+        }
+
+        unsigned char head[AttachmentServer::DOWNLOAD_HEADER_LENGTH];
+        uint64_t remaining = 0;
+        if (!ReceiveAll(socket, reinterpret_cast<char*>(head), sizeof(head))) {
+            result.error = "The server did not start the download";
+        }
+        else {
+            for (unsigned char byte : head) {
+                remaining = (remaining << 8) | byte;
+            }
+            if (remaining != ticket.size - ticket.offset) {
+                result.error = "The server offered the wrong length";
+            }
+        }
+
+        std::vector<char> buffer(RECEIVE_CHUNK_BYTES);
+        while (result.error.empty() && remaining > 0 && !state.cancelled) {
+            int received = recv(socket, buffer.data(),
+                                static_cast<int>((std::min)(remaining, static_cast<uint64_t>(buffer.size()))), 0);
+            DWORD written = 0;
+            if (received <= 0) {
+                result.error = "Download interrupted; run it again to resume";
+            }
+            else if (!WriteFile(file, buffer.data(), static_cast<DWORD>(received), &written, nullptr) ||
+                     written != static_cast<DWORD>(received)) {
+                result.error = "Cannot write " + partial;
+            }
+            else {
+                remaining -= static_cast<uint64_t>(received);
+                result.size += static_cast<uint64_t>(received);
+            }
+        }
+        CloseHandle(file);
+        closeTransfer(state, socket);
+        if (state.cancelled) {
+            result.error = "Cancelled";
+        }
+        if (!result.error.empty()) {
+            return result;
+        }
+
+        FinishDownload(partial, path, digest, result);
+        return result;
+    };
+    return std::unique_ptr<AttachmentTransfer>(new AttachmentTransfer(std::move(job), std::move(done)));
+}
+
+//=============================================================================
+// TRANSFER CONNECTION
+//=============================================================================
+
+SOCKET AttachmentTransfer::openTransfer(State& state, const std::string& host,
+                                        const Protocol::Payloads::AttachmentTicket& ticket, std::string& error) {
+    std::vector<in_addr> addresses;
+    if (ticket.ticket.size() != AttachmentServer::TICKET_LENGTH) {
+        error = "The server sent a malformed ticket";
+        return INVALID_SOCKET;
+    }
+    if (!AddressResolver::Resolve(host, addresses)) {
+        error = "Could not resolve " + host;
+        return INVALID_SOCKET;
+    }
+
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET) {
+        error = "Cannot create a socket";
+        return INVALID_SOCKET;
+    }
+    {
+        std::lock_guard<std::mutex> lock(state.socketMutex);
+        state.socket = s;
+    }
+
+    // Non-blocking connect, so an unreachable port fails within IO_TIMEOUT_MS
+    u_long nonBlocking = 1;
+    ioctlsocket(s, FIONBIO, &nonBlocking);
+    sockaddr_in target = {};
+    target.sin_family = AF_INET;
+    target.sin_port = htons(static_cast<u_short>(ticket.port));
+    target.sin_addr = addresses.front();
+    bool connected = connect(s, reinterpret_cast<sockaddr*>(&target), sizeof(target)) == 0;
+    bool pending = !connected && WSAGetLastError() == WSAEWOULDBLOCK;
+
+    uint64_t deadline = GetTickCount64() + IO_TIMEOUT_MS;
+    while (pending && !connected && !state.cancelled && GetTickCount64() < deadline) {
+        fd_set writable;
+        fd_set failed;
+        FD_ZERO(&writable);
+        FD_ZERO(&failed);
+        FD_SET(s, &writable);
+        FD_SET(s, &failed);
+        timeval timeout = { 0, static_cast<long>(CONNECT_POLL_MS * 1000) };
+        if (select(0, nullptr, &writable, &failed, &timeout) == SOCKET_ERROR || FD_ISSET(s, &failed)) {
+            pending = false;
+        }
+        connected = FD_ISSET(s, &writable) != 0;
+    }
+    if (!connected) {
+        error = state.cancelled ? "Cancelled" : "Cannot reach the transfer port " + std::to_string(ticket.port);
+        closeTransfer(state, s);
+        return INVALID_SOCKET;
+    }
+
+    u_long blocking = 0;
+    ioctlsocket(s, FIONBIO, &blocking);
+    DWORD timeoutMs = IO_TIMEOUT_MS;
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeoutMs), sizeof(timeoutMs));
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeoutMs), sizeof(timeoutMs));
+
+    std::string header = std::string(AttachmentServer::TRANSFER_MAGIC, AttachmentServer::TRANSFER_MAGIC_LENGTH) + ticket.ticket;
+    if (!SendAll(s, header.data(), header.size())) {
+        error = "The transfer port closed the connection";
+        closeTransfer(state, s);
+        return INVALID_SOCKET;
+    }
+    return s;
+}
+
+void AttachmentTransfer::closeTransfer(State& state, SOCKET socket) {
+    {
+        std::lock_guard<std::mutex> lock(state.socketMutex);
+        state.socket = INVALID_SOCKET;
+    }
+    closesocket(socket);
+}
@@ -0,0 +1,109 @@
+#ifndef ATTACHMENT_TRANSFER_H
+#define ATTACHMENT_TRANSFER_H
+
+/**
+ * @file AttachmentTransfer.h
+ * @brief Client side of an attachment: hash, upload or download off the UI thread
+ *
+ * PURPOSE:
+ * Hashing a large file and moving it over the transfer port both take
+ * seconds. Each step runs on its own thread and reports back through
+ * UiDispatcher, the way Connector does for connects, so the chat stays
+ * live while a file moves on its separate connection.
+ *
+ * STEPS (driven by LobbyPage):
+ *   Hash      digest and size of a local file
+ *   ClientSocket::requestAttachment() on the chat connection -> ticket
+ *   Upload    bytes [ticket.offset, size) with TransmitFile, so the client
+ *             also sends from the file cache without copying
+ *   Download  into "<path>.part", verified against the digest, then
+ *             renamed to path; a later download resumes from the partial file
+ *
+ * THREADING:
+ * Create, cancel and destroy on the UI thread; the completion runs there
+ * too and is dropped if the transfer is cancelled first. Cancelling shuts
+ * the connection down, so the worker stops at once.
+ */
+
+#include "NetPlatform.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "Protocol.h"
+
+class AttachmentTransfer {
+public:
+    /** Longest wait for the transfer port to accept or make progress */
+    static constexpr uint32_t IO_TIMEOUT_MS = 10000;
+
+    /** Bytes handed to one TransmitFile call; cancel is checked between calls */
+    static constexpr uint32_t SEND_CHUNK_BYTES = 256 * 1024;
+
+    struct Result {
+        std::string error;      ///< Empty on success
+        std::string digest;     ///< Hash: the file's digest
+        uint64_t size = 0;      ///< Hash: the file's size; Upload/Download: bytes moved
+    };
+
+    using Completion = std::function<void(const Result& result)>;
+
+    /** @brief Digest and size of a local file */
+    static std::unique_ptr<AttachmentTransfer> Hash(const std::string& path, Completion done);
+
+    /** @brief Send the part of path the ticket asks for to host:ticket.port */
+    static std::unique_ptr<AttachmentTransfer> Upload(const std::string& path, const std::string& host,
+                                                      const Protocol::Payloads::AttachmentTicket& ticket,
+                                                      Completion done);
+
+    /**
+     * @brief Receive an attachment into path, resuming from PartialLength(path)
+     *
+     * A complete ticket only verifies and renames a partial file that
+     * already holds every byte.
+     */
+    static std::unique_ptr<AttachmentTransfer> Download(const std::string& path, const std::string& digest,
+                                                        const std::string& host,
+                                                        const Protocol::Payloads::AttachmentTicket& ticket,
+                                                        Completion done);
+
+    /** @brief Bytes of an earlier, interrupted download of path; ask for a ticket from here */
+    static uint64_t PartialLength(const std::string& path);
+
+    /** Cancels and waits for the worker */
+    ~AttachmentTransfer();
+
+    /** @brief Abandon the transfer; the completion will not run */
+    void Cancel();
+
+    /** @brief True once the worker is done (its completion may still be pending) */
+    bool Finished() const { return m_state->finished; }
+
+private:
+    // Shared with the worker and the posted completion, which may outlive this
+    struct State {
+        std::atomic<bool> cancelled{ false };
+        std::atomic<bool> finished{ false };
+        std::mutex socketMutex;
+        SOCKET socket = INVALID_SOCKET;     ///< Open transfer connection, shut down by Cancel()
+    };
+
+    using Job = std::function<Result(State& state)>;
+
+    std::shared_ptr<State> m_state;
+    std::thread m_thread;
+
+    AttachmentTransfer(Job job, Completion done);
+
+    static SOCKET openTransfer(State& state, const std::string& host,
+                               const Protocol::Payloads::AttachmentTicket& ticket, std::string& error);
+    static void closeTransfer(State& state, SOCKET socket);
+
+    AttachmentTransfer(const AttachmentTransfer&) = delete;
+    AttachmentTransfer& operator=(const AttachmentTransfer&) = delete;
+};
+
+#endif // ATTACHMENT_TRANSFER_H
@@ -0,0 +1,265 @@
+/**
+ * @file AuditLog.cpp
+ * @brief Implementation of the rotating binary audit trail
+ */
+
+#include "AuditLog.h"
+#include "MessageLog.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const char AUDIT_MAGIC[8] = { 'C', 'H', 'A', 'U', 'D', '0', '0', '1' };
+
+/** Magic + segment start time */
+constexpr size_t AUDIT_HEADER_SIZE = 16;
+
+/** [u32 bodyLength][u32 crc32] */
+constexpr size_t RECORD_HEADER_SIZE = 8;
+
+/** Fixed part of a body: timestamp, userId and both length prefixes */
+constexpr size_t MIN_BODY_SIZE = 8 + 8 + 2 + 2;
+
+constexpr size_t MAX_FIELD_LENGTH = 0xFFFF;
+
+void PutU16(std::string& out, uint16_t value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+void PutU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void PutU64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t ReadLE(const char* data, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+std::string EncodeEntry(const AuditLog::Entry& entry) {
+    size_t subjectLength = (std::min)(entry.subject.size(), MAX_FIELD_LENGTH);
+    size_t actionLength = (std::min)(entry.action.size(), MAX_FIELD_LENGTH);
+
+    std::string body;
+    body.reserve(MIN_BODY_SIZE + subjectLength + actionLength);
+    PutU64(body, static_cast<uint64_t>(static_cast<int64_t>(entry.timestamp)));
+    PutU64(body, entry.userId);
+    PutU16(body, static_cast<uint16_t>(subjectLength));
+    body.append(entry.subject, 0, subjectLength);
+    PutU16(body, static_cast<uint16_t>(actionLength));
+    body.append(entry.action, 0, actionLength);
+
+    std::string record;
+    record.reserve(RECORD_HEADER_SIZE + body.size());
+    PutU32(record, static_cast<uint32_t>(body.size()));
+    PutU32(record, MessageLog::Checksum(body.data(), body.size()));
+    record += body;
+    return record;
+}
+
+/**
+ * @return Bytes consumed, or 0 if the record is short or corrupt
+ */
+size_t DecodeEntry(const char* data, size_t available, AuditLog::Entry& out) {
+    if (available < RECORD_HEADER_SIZE) {
+        return 0;
+    }
+
+    size_t bodyLength = static_cast<size_t>(ReadLE(data, 4));
+    uint32_t checksum = static_cast<uint32_t>(ReadLE(data + 4, 4));
+    if (bodyLength < MIN_BODY_SIZE || available - RECORD_HEADER_SIZE < bodyLength) {
+        return 0;
+    }
+
+    const char* body = data + RECORD_HEADER_SIZE;
+    if (MessageLog::Checksum(body, bodyLength) != checksum) {
+        return 0;
+    }
+
+    out.timestamp = static_cast<std::time_t>(static_cast<int64_t>(ReadLE(body, 8)));
+    out.userId = ReadLE(body + 8, 8);
+    size_t pos = 16;
+
+    size_t subjectLength = static_cast<size_t>(ReadLE(body + pos, 2));
+    pos += 2;
+    if (bodyLength - pos < subjectLength + 2) {
+        return 0;
+    }
+    out.subject.assign(body + pos, subjectLength);
+    pos += subjectLength;
+
+    size_t actionLength = static_cast<size_t>(ReadLE(body + pos, 2));
+    pos += 2;
+    if (bodyLength - pos != actionLength) {
+        return 0;
+    }
+    out.action.assign(body + pos, actionLength);
+
+    return RECORD_HEADER_SIZE + bodyLength;
+}
+
+} // namespace
+
+//=============================================================================
+// AUDIT LOG
+//=============================================================================
+
+AuditLog::AuditLog(const std::string& path)
+    : m_path(path)
+    , m_file(nullptr)
+    , m_segmentStart(0)
+    , m_segmentBytes(0) {
+    if (!loadActiveSegment()) {
+        // Keep the damaged segment for inspection; appends start a new one
+        printf("[AUDIT] Audit log %s is damaged; rotating it out\n", m_path.c_str());
+        rotate();
+    }
+}
+
+AuditLog::~AuditLog() {
+    if (m_file) {
+        std::fflush(m_file);
+        std::fclose(m_file);
+    }
+}
+
+bool AuditLog::Append(const Entry& entry) {
+    remember(entry);
+
+    std::time_t now = std::time(nullptr);
+    if (m_segmentStart != 0 &&
+        (m_segmentBytes >= MAX_SEGMENT_BYTES || now - m_segmentStart >= MAX_SEGMENT_AGE_SECONDS)) {
+        rotate();
+    }
+
+    if (!m_file && !openSegment(now)) {
+        return false;
+    }
+
+    std::string record = EncodeEntry(entry);
+    if (std::fwrite(record.data(), 1, record.size(), m_file) != record.size()) {
+        return false;
+    }
+
+    m_segmentBytes += record.size();
+    return true;
+}
+
+bool AuditLog::Flush() {
+    if (!m_file) {
+        return true;
+    }
+    return std::fflush(m_file) == 0;
+}
+
+std::vector<AuditLog::Entry> AuditLog::GetRecent(size_t maxCount) const {
+    size_t count = (std::min)(maxCount, m_recent.Size());
+
+    std::vector<Entry> result;
+    result.reserve(count);
+    for (size_t i = m_recent.Size() - count; i < m_recent.Size(); ++i) {
+        result.push_back(m_recent[i]);
+    }
+    return result;
+}
+
+void AuditLog::remember(const Entry& entry) {
+    if (m_recent.Full()) {
+        m_recent.PopFront();
+    }
+    m_recent.PushBack(entry);
+}
+
+bool AuditLog::loadActiveSegment() {
+    std::ifstream file(m_path, std::ios::binary);
+    if (!file) {
+        return true;    // No segment yet
+    }
+
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.empty()) {
+        return true;
+    }
+
+    if (data.size() < AUDIT_HEADER_SIZE ||
+        std::memcmp(data.data(), AUDIT_MAGIC, sizeof(AUDIT_MAGIC)) != 0) {
+        return false;
+    }
+
+    size_t offset = AUDIT_HEADER_SIZE;
+    while (offset < data.size()) {
+        Entry entry;
+        size_t consumed = DecodeEntry(data.data() + offset, data.size() - offset, entry);
+        if (consumed == 0) {
+            return false;   // Torn tail; what was read stays in memory
+        }
+        remember(entry);
+        offset += consumed;
+    }
+
+    m_segmentStart = static_cast<std::time_t>(static_cast<int64_t>(ReadLE(data.data() + 8, 8)));
+    m_segmentBytes = data.size();
+
+    // A zero start would never rotate by age
+    if (m_segmentStart == 0) {
+        m_segmentStart = 1;
+    }
+    return true;
+}
+
+bool AuditLog::openSegment(std::time_t now) {
+    if (fopen_s(&m_file, m_path.c_str(), "ab") != 0 || !m_file) {
+        m_file = nullptr;
+        return false;
+    }
+
+    std::fseek(m_file, 0, SEEK_END);
+    if (std::ftell(m_file) == 0) {
+        std::string header(AUDIT_MAGIC, sizeof(AUDIT_MAGIC));
+        PutU64(header, static_cast<uint64_t>(static_cast<int64_t>(now)));
+        if (std::fwrite(header.data(), 1, header.size(), m_file) != header.size()) {
+            std::fclose(m_file);
+            m_file = nullptr;
+            return false;
+        }
+        m_segmentStart = now;
+        m_segmentBytes = header.size();
+    }
+    return true;
+}
+
+void AuditLog::rotate() {
+    if (m_file) {
+        std::fflush(m_file);
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+
+    // rename() does not replace an existing file on Windows, so free each slot first
+    std::remove(segmentPath(MAX_OLD_SEGMENTS).c_str());
+    for (int i = MAX_OLD_SEGMENTS - 1; i >= 1; --i) {
+        std::rename(segmentPath(i).c_str(), segmentPath(i + 1).c_str());
+    }
+    std::rename(m_path.c_str(), segmentPath(1).c_str());
+
+    m_segmentStart = 0;
+    m_segmentBytes = 0;
+}
+
+std::string AuditLog::segmentPath(int index) const {
+    return m_path + "." + std::to_string(index);
+}
@@ -0,0 +1,107 @@
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+/**
+ * @file AuditLog.h
+ * @brief Append-only, rotating binary audit trail
+ *
+ * PURPOSE:
+ * InviteManager kept every audit entry in a vector and rewrote them all
+ * as XML whenever a token was created, used or revoked, so each join cost
+ * O(uptime) in memory and I/O. Entries now go to this log as one small
+ * record each; only the newest RECENT_ENTRIES stay in memory.
+ *
+ * FILES:
+ * Records are appended to "<path>". Once it holds more than MAX_SEGMENT_BYTES
+ * or its first record is older than MAX_SEGMENT_AGE_SECONDS, it is renamed
+ * to "<path>.1" (older segments shift to .2, .3, ...) and a new segment is
+ * started. At most MAX_OLD_SEGMENTS old segments are kept.
+ *
+ * FILE LAYOUT:
+ *   [8-byte magic "CHAUD001"][i64 segment start time]
+ *   [record]*
+ *
+ * RECORD LAYOUT (little-endian, framed like MessageLog records):
+ *   [u32 bodyLength][u32 crc32(body)][body]
+ *   body = [i64 timestamp][u64 userId][u16 len][subject][u16 len][action]
+ *
+ * CRASH SAFETY:
+ * Append() writes into the stdio buffer; Flush() hands it to the OS. A
+ * record torn by a crash fails its CRC when the segment is reopened; that
+ * segment is then rotated out as-is and a new one started.
+ *
+ * THREADING:
+ * Not thread-safe; the owner serializes access with its own mutex.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "RingBuffer.h"
+
+class AuditLog {
+public:
+    struct Entry {
+        std::time_t timestamp = 0;
+        std::string subject;        ///< What the action was on (e.g. a token ID)
+        uint64_t userId = 0;
+        std::string action;
+    };
+
+    /** Entries kept in memory for GetRecent() */
+    static constexpr size_t RECENT_ENTRIES = 1000;
+
+    /** Segment size that triggers a rotation */
+    static constexpr uint64_t MAX_SEGMENT_BYTES = 1024 * 1024;
+
+    /** Segment age that triggers a rotation */
+    static constexpr std::time_t MAX_SEGMENT_AGE_SECONDS = 24 * 60 * 60;
+
+    /** Rotated segments kept on disk (.1 is the newest) */
+    static constexpr int MAX_OLD_SEGMENTS = 8;
+
+    /**
+     * @param path Active segment; created on first append if missing
+     *
+     * Loads the newest entries of the active segment into memory.
+     */
+    explicit AuditLog(const std::string& path);
+    ~AuditLog();
+
+    /**
+     * @brief Record one entry (O(1); buffered until Flush())
+     * @return False if the write failed (the entry is still kept in memory)
+     */
+    bool Append(const Entry& entry);
+
+    /**
+     * @brief Write buffered entries to the file
+     */
+    bool Flush();
+
+    /**
+     * @brief Newest entries, oldest first
+     * @param maxCount At most this many (capped at RECENT_ENTRIES)
+     */
+    std::vector<Entry> GetRecent(size_t maxCount = RECENT_ENTRIES) const;
+
+private:
+    std::string m_path;
+    std::FILE* m_file;
+    std::time_t m_segmentStart;     // 0 until the active segment has a header
+    uint64_t m_segmentBytes;
+    RingBuffer<Entry> m_recent{ RECENT_ENTRIES };
+
+    void remember(const Entry& entry);
+    bool loadActiveSegment();
+    bool openSegment(std::time_t now);
+    void rotate();
+    std::string segmentPath(int index) const;
+
+    AuditLog(const AuditLog&) = delete;
+    AuditLog& operator=(const AuditLog&) = delete;
+};
+
+#endif // AUDIT_LOG_H
@@ -0,0 +1,233 @@
+/**
+ * @file BinarySnapshot.cpp
+ * @brief Implementation of the binary snapshot reader and writer
+ */
+
+#include "BinarySnapshot.h"
+#include "MessageLog.h"
+#define NOMINMAX
+#include <Windows.h>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+constexpr size_t MAGIC_SIZE = 8;
+constexpr size_t HEADER_SIZE = 24;
+
+void PutLE(std::string& out, uint64_t value, size_t width) {
+    for (size_t i = 0; i < width; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t GetLE(const char* data, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+std::string SnapshotPathFor(const std::string& xmlPath) {
+    const std::string extension = ".xml";
+    if (xmlPath.size() > extension.size() &&
+        xmlPath.compare(xmlPath.size() - extension.size(), extension.size(), extension) == 0) {
+        return xmlPath.substr(0, xmlPath.size() - extension.size()) + ".bin";
+    }
+    return xmlPath + ".bin";
+}
+
+//=============================================================================
+// WRITER
+//=============================================================================
+
+void SnapshotWriter::PutU8(uint8_t value) {
+    m_payload.push_back(static_cast<char>(value));
+}
+
+void SnapshotWriter::PutU16(uint16_t value) {
+    PutLE(m_payload, value, 2);
+}
+
+void SnapshotWriter::PutU32(uint32_t value) {
+    PutLE(m_payload, value, 4);
+}
+
+void SnapshotWriter::PutU64(uint64_t value) {
+    PutLE(m_payload, value, 8);
+}
+
+void SnapshotWriter::PutI64(int64_t value) {
+    PutLE(m_payload, static_cast<uint64_t>(value), 8);
+}
+
+void SnapshotWriter::PutString(const std::string& value) {
+    PutLE(m_payload, value.size(), 4);
+    m_payload.append(value);
+}
+
+bool SnapshotWriter::Commit(const std::string& path, const char* magic, uint32_t version) const {
+    std::string header(magic, MAGIC_SIZE);
+    PutLE(header, version, 4);
+    PutLE(header, MessageLog::Checksum(m_payload.data(), m_payload.size()), 4);
+    PutLE(header, m_payload.size(), 8);
+
+    std::string tempPath = path + ".tmp";
+    std::FILE* file = nullptr;
+    if (fopen_s(&file, tempPath.c_str(), "wb") != 0 || !file) {
+        printf("[DB] Failed to create snapshot %s\n", tempPath.c_str());
+        return false;
+    }
+
+    bool written = std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+                   std::fwrite(m_payload.data(), 1, m_payload.size(), file) == m_payload.size();
+    written = (std::fclose(file) == 0) && written;
+    if (!written) {
+        printf("[DB] Failed to write snapshot %s\n", tempPath.c_str());
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    if (!MoveFileExA(tempPath.c_str(), path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        printf("[DB] Failed to replace snapshot %s\n", path.c_str());
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+//=============================================================================
+// READER
+//=============================================================================
+
+SnapshotReader::~SnapshotReader() {
+    Close();
+}
+
+bool SnapshotReader::Open(const std::string& path, const char* magic, uint32_t maxVersion) {
+    Close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    m_file = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(HEADER_SIZE)) {
+        Close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        Close();
+        return false;
+    }
+    m_view = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_view) {
+        Close();
+        return false;
+    }
+
+    uint64_t payloadLength = GetLE(m_view + MAGIC_SIZE + 8, 8);
+    if (std::memcmp(m_view, magic, MAGIC_SIZE) != 0 ||
+        payloadLength != static_cast<uint64_t>(fileSize.QuadPart) - HEADER_SIZE) {
+        printf("[DB] Snapshot %s is damaged\n", path.c_str());
+        Close();
+        return false;
+    }
+
+    uint32_t version = static_cast<uint32_t>(GetLE(m_view + MAGIC_SIZE, 4));
+    if (version == 0 || version > maxVersion) {
+        printf("[DB] Snapshot %s has unsupported version %u\n", path.c_str(), version);
+        Close();
+        return false;
+    }
+
+    m_data = m_view + HEADER_SIZE;
+    m_size = static_cast<size_t>(payloadLength);
+    uint32_t crc = static_cast<uint32_t>(GetLE(m_view + MAGIC_SIZE + 4, 4));
+    if (MessageLog::Checksum(m_data, m_size) != crc) {
+        printf("[DB] Snapshot %s fails its checksum\n", path.c_str());
+        Close();
+        return false;
+    }
+
+    m_version = version;
+    m_pos = 0;
+    m_failed = false;
+    return true;
+}
+
+void SnapshotReader::Close() {
+    if (m_view) {
+        UnmapViewOfFile(m_view);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+    m_file = nullptr;
+    m_mapping = nullptr;
+    m_view = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+    m_pos = 0;
+}
+
+const char* SnapshotReader::take(size_t length) {
+    if (m_failed || m_size - m_pos < length) {
+        m_failed = true;
+        return nullptr;
+    }
+    const char* field = m_data + m_pos;
+    m_pos += length;
+    return field;
+}
+
+uint8_t SnapshotReader::ReadU8() {
+    const char* field = take(1);
+    return field ? static_cast<uint8_t>(*field) : 0;
+}
+
+uint16_t SnapshotReader::ReadU16() {
+    const char* field = take(2);
+    return field ? static_cast<uint16_t>(GetLE(field, 2)) : 0;
+}
+
+uint32_t SnapshotReader::ReadU32() {
+    const char* field = take(4);
+    return field ? static_cast<uint32_t>(GetLE(field, 4)) : 0;
+}
+
+uint64_t SnapshotReader::ReadU64() {
+    const char* field = take(8);
+    return field ? GetLE(field, 8) : 0;
+}
+
+int64_t SnapshotReader::ReadI64() {
+    return static_cast<int64_t>(ReadU64());
+}
+
+std::string SnapshotReader::ReadString() {
+    uint32_t length = ReadU32();
+    const char* field = take(length);
+    return field ? std::string(field, length) : std::string();
+}
+
+uint32_t SnapshotReader::ReadCount(size_t minItemSize) {
+    uint32_t count = ReadU32();
+    if (!m_failed && minItemSize > 0 && (m_size - m_pos) / minItemSize < count) {
+        m_failed = true;
+        return 0;
+    }
+    return count;
+}
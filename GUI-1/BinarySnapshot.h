@@ -0,0 +1,120 @@
+#ifndef BINARY_SNAPSHOT_H
+#define BINARY_SNAPSHOT_H
+
+/**
+ * @file BinarySnapshot.h
+ * @brief Versioned binary snapshot files for fast database startup
+ *
+ * PURPOSE:
+ * Loading a database from XML builds a full pugixml DOM and then converts
+ * every attribute back from text. A snapshot stores the same fields as
+ * fixed-width little-endian integers and length-prefixed strings, so
+ * loading is one sequential pass over a memory-mapped file.
+ *
+ * FILE LAYOUT (little-endian):
+ *   [8-byte magic][u32 version][u32 crc32(payload)][u64 payloadLength]
+ *   [payload]
+ *
+ * The payload layout belongs to the owning service; strings are
+ * [u32 length][bytes] and counts are u32.
+ *
+ * CRASH SAFETY:
+ * SnapshotWriter writes "<path>.tmp" and renames it over the old file, and
+ * the reader rejects a file whose length or checksum does not match.
+ *
+ * SHARING:
+ * The reader keeps the file mapped only until Close(), so other instances
+ * can replace it; load, copy out, then close.
+ */
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief "user_data.xml" -> "user_data.bin"
+ */
+std::string SnapshotPathFor(const std::string& xmlPath);
+
+/**
+ * @brief Builds a snapshot payload in memory and commits it to disk
+ */
+class SnapshotWriter {
+public:
+    void PutU8(uint8_t value);
+    void PutU16(uint16_t value);
+    void PutU32(uint32_t value);
+    void PutU64(uint64_t value);
+    void PutI64(int64_t value);
+    void PutString(const std::string& value);
+
+    /**
+     * @brief Write header and payload via a temp file and an atomic rename
+     * @param magic Exactly 8 characters identifying the file type
+     */
+    bool Commit(const std::string& path, const char* magic, uint32_t version) const;
+
+private:
+    std::string m_payload;
+};
+
+/**
+ * @brief Sequential, bounds-checked reader over a memory-mapped snapshot
+ *
+ * A read past the end of the payload returns zero/empty and marks the
+ * reader failed; check Ok() once after parsing instead of after every field.
+ */
+class SnapshotReader {
+public:
+    SnapshotReader() = default;
+    ~SnapshotReader();
+
+    /**
+     * @brief Map a snapshot and validate its header and checksum
+     * @param magic Expected 8-character file type
+     * @param maxVersion Newest payload version the caller understands
+     * @return False if the file is missing, damaged or too new
+     */
+    bool Open(const std::string& path, const char* magic, uint32_t maxVersion);
+
+    /** @brief Unmap the file */
+    void Close();
+
+    /** @brief Payload version of the open snapshot */
+    uint32_t Version() const { return m_version; }
+
+    uint8_t ReadU8();
+    uint16_t ReadU16();
+    uint32_t ReadU32();
+    uint64_t ReadU64();
+    int64_t ReadI64();
+    std::string ReadString();
+
+    /**
+     * @brief Read an item count, rejecting counts the payload cannot hold
+     * @param minItemSize Smallest encoded size of one item
+     */
+    uint32_t ReadCount(size_t minItemSize);
+
+    /** @brief True if every read so far stayed inside the payload */
+    bool Ok() const { return !m_failed; }
+
+    /** @brief True if the whole payload has been consumed */
+    bool AtEnd() const { return m_pos == m_size; }
+
+private:
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+    const char* m_view = nullptr;
+    const char* m_data = nullptr;   // Start of the payload
+    size_t m_size = 0;
+    size_t m_pos = 0;
+    uint32_t m_version = 0;
+    bool m_failed = false;
+
+    const char* take(size_t length);
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+};
+
+#endif // BINARY_SNAPSHOT_H
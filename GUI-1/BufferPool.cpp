@@ -0,0 +1,197 @@
+/**
+ * @file BufferPool.cpp
+ * @brief Implementation of the per-thread frame block pool
+ */
+
+#include "BufferPool.h"
+#include <cstring>
+#include <new>
+
+namespace NetProtocol {
+
+namespace {
+
+// Sits in front of every block so Release() knows where it belongs;
+// aligned so the bytes after it keep the heap's alignment
+struct alignas(std::max_align_t) BlockHeader {
+    uint32_t sizeClass;
+};
+
+constexpr uint32_t OVERSIZE = UINT32_MAX;
+
+// A cached block's first bytes link it into its class's free list
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct ThreadCache {
+    FreeBlock* free[BufferPool::CLASS_COUNT] = {};
+    size_t count[BufferPool::CLASS_COUNT] = {};
+    BufferPool::Stats stats;
+
+    void trim() noexcept;
+    ~ThreadCache();
+};
+
+// Trivially destructible, so it can still be read while t_cache is being
+// destroyed (and after): blocks released that late go straight to the heap
+thread_local bool t_cacheGone = false;
+thread_local ThreadCache t_cache;
+
+void FreeToHeap(BlockHeader* header) noexcept {
+    header->~BlockHeader();
+    ::operator delete(header);
+}
+
+void ThreadCache::trim() noexcept {
+    for (size_t sizeClass = 0; sizeClass < BufferPool::CLASS_COUNT; ++sizeClass) {
+        while (FreeBlock* block = free[sizeClass]) {
+            free[sizeClass] = block->next;
+            FreeToHeap(reinterpret_cast<BlockHeader*>(block) - 1);
+        }
+        count[sizeClass] = 0;
+    }
+}
+
+ThreadCache::~ThreadCache() {
+    t_cacheGone = true;
+    trim();
+}
+
+uint32_t ClassFor(size_t bytes) {
+    for (uint32_t sizeClass = 0; sizeClass < BufferPool::CLASS_COUNT; ++sizeClass) {
+        if (bytes <= BufferPool::CLASS_SIZES[sizeClass]) {
+            return sizeClass;
+        }
+    }
+    return OVERSIZE;
+}
+
+} // namespace
+
+void* BufferPool::Acquire(size_t bytes, size_t* capacity) noexcept {
+    uint32_t sizeClass = ClassFor(bytes);
+    size_t usable = (sizeClass == OVERSIZE) ? bytes : CLASS_SIZES[sizeClass];
+
+    if (sizeClass != OVERSIZE && !t_cacheGone) {
+        ThreadCache& cache = t_cache;
+        if (FreeBlock* block = cache.free[sizeClass]) {
+            cache.free[sizeClass] = block->next;
+            --cache.count[sizeClass];
+            ++cache.stats.hits;
+            if (capacity) {
+                *capacity = usable;
+            }
+            return block;
+        }
+    }
+
+    if (usable > SIZE_MAX - sizeof(BlockHeader)) {
+        return nullptr;
+    }
+    void* memory = ::operator new(sizeof(BlockHeader) + usable, std::nothrow);
+    if (!memory) {
+        return nullptr;
+    }
+    if (!t_cacheGone) {
+        ++t_cache.stats.misses;
+    }
+
+    BlockHeader* header = new (memory) BlockHeader;
+    header->sizeClass = sizeClass;
+    if (capacity) {
+        *capacity = usable;
+    }
+    return header + 1;
+}
+
+void BufferPool::Release(void* block) noexcept {
+    if (!block) {
+        return;
+    }
+    BlockHeader* header = static_cast<BlockHeader*>(block) - 1;
+    uint32_t sizeClass = header->sizeClass;
+
+    if (!t_cacheGone) {
+        ThreadCache& cache = t_cache;
+        if (sizeClass != OVERSIZE && cache.count[sizeClass] < MAX_CACHED[sizeClass]) {
+            FreeBlock* freeBlock = new (block) FreeBlock;
+            freeBlock->next = cache.free[sizeClass];
+            cache.free[sizeClass] = freeBlock;
+            ++cache.count[sizeClass];
+            ++cache.stats.released;
+            return;
+        }
+        ++cache.stats.freed;
+    }
+    FreeToHeap(header);
+}
+
+BufferPool::Stats BufferPool::ThreadStats() noexcept {
+    return t_cacheGone ? Stats() : t_cache.stats;
+}
+
+void BufferPool::Trim() noexcept {
+    if (!t_cacheGone) {
+        t_cache.trim();
+    }
+}
+
+//=============================================================================
+// POOLED FRAME
+//=============================================================================
+
+PooledFrame::PooledFrame(PooledFrame&& other) noexcept
+    : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity) {
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_capacity = 0;
+}
+
+PooledFrame& PooledFrame::operator=(PooledFrame&& other) noexcept {
+    if (this != &other) {
+        reset();
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_capacity = other.m_capacity;
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_capacity = 0;
+    }
+    return *this;
+}
+
+char* PooledFrame::prepare(size_t length) noexcept {
+    if (!m_data || length > m_capacity) {
+        reset();
+        size_t capacity = 0;
+        void* block = BufferPool::Acquire(length, &capacity);
+        if (!block) {
+            return nullptr;
+        }
+        m_data = static_cast<char*>(block);
+        m_capacity = capacity;
+    }
+    m_size = length;
+    return m_data;
+}
+
+bool PooledFrame::assign(std::string_view bytes) noexcept {
+    char* out = prepare(bytes.size());
+    if (!out) {
+        return false;
+    }
+    if (!bytes.empty()) {
+        std::memcpy(out, bytes.data(), bytes.size());
+    }
+    return true;
+}
+
+void PooledFrame::reset() noexcept {
+    BufferPool::Release(m_data);
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+}
+
+} // namespace NetProtocol
@@ -0,0 +1,116 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+/**
+ * @file BufferPool.h
+ * @brief Per-thread, size-classed pool for frame-sized blocks
+ *
+ * PURPOSE:
+ * Every received frame needed a buffer and every broadcast a FrameBuffer
+ * block, each a trip through the general-purpose heap. Frames come in a
+ * handful of sizes - short chat lines, history pages, attachment chunks up
+ * to MAX_MESSAGE_SIZE - so a few size classes with a free list each turn
+ * almost all of those trips into a pointer pop and push.
+ *
+ * SIZE CLASSES:
+ *   256 B, 1 KB, 4 KB, 16 KB, and one that holds a maximum-size frame
+ *   with its header and a FrameBuffer block header. Requests beyond the
+ *   largest class go straight to the heap and back.
+ *
+ * THREADING:
+ * Each thread caches its own free blocks, so Acquire() and Release() never
+ * lock. A block may be released on a different thread from the one that
+ * acquired it (a FrameBuffer outliving its broadcast, say); it joins the
+ * releasing thread's cache. Each class caches at most MAX_CACHED[class]
+ * blocks per thread and frees the rest, which bounds a thread's idle
+ * memory at about 1.2 MB. A thread's cache is freed when it exits.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace NetProtocol {
+
+class BufferPool {
+public:
+    static constexpr size_t CLASS_COUNT = 5;
+
+    /** Usable bytes per class; the largest fits header + MAX_MESSAGE_SIZE + a block header */
+    static constexpr size_t CLASS_SIZES[CLASS_COUNT] = { 256, 1024, 4096, 16384, 65536 + 256 };
+
+    /** Free blocks each thread keeps per class */
+    static constexpr size_t MAX_CACHED[CLASS_COUNT] = { 256, 128, 64, 16, 8 };
+
+    /** Per-thread counters (diagnostics and Bench) */
+    struct Stats {
+        uint64_t hits = 0;        // Served from the cache
+        uint64_t misses = 0;      // Went to the heap
+        uint64_t released = 0;    // Returned to the cache
+        uint64_t freed = 0;       // Returned to the heap (cache full or oversize)
+    };
+
+    /**
+     * @brief Get a block of at least bytes usable bytes
+     * @param capacity Optional output: usable bytes actually provided
+     * @return nullptr if the heap is exhausted
+     */
+    static void* Acquire(size_t bytes, size_t* capacity = nullptr) noexcept;
+
+    /** @brief Return a block from Acquire(); nullptr is ignored */
+    static void Release(void* block) noexcept;
+
+    /** @brief Counters for the calling thread */
+    static Stats ThreadStats() noexcept;
+
+    /** @brief Free the calling thread's cached blocks */
+    static void Trim() noexcept;
+};
+
+/**
+ * @brief One received frame held in a pooled block
+ *
+ * Move-only. The block goes back to the pool when the handle is destroyed
+ * or reset(); clear() keeps it for the next frame. Views handed out by
+ * view() are valid until the handle is next written, cleared or destroyed.
+ */
+class PooledFrame {
+public:
+    PooledFrame() noexcept = default;
+    PooledFrame(PooledFrame&& other) noexcept;
+    PooledFrame& operator=(PooledFrame&& other) noexcept;
+    ~PooledFrame() { reset(); }
+
+    /**
+     * @brief Size the frame to length bytes, keeping the block if it is big enough
+     * @return Where to write them, or nullptr if no block could be had
+     *         (the frame is then empty)
+     */
+    char* prepare(size_t length) noexcept;
+
+    /** @brief Copy bytes in; false if no block could be had */
+    bool assign(std::string_view bytes) noexcept;
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    std::string_view view() const { return std::string_view(m_data, m_size); }
+
+    /** @brief Forget the contents; the block stays attached */
+    void clear() noexcept { m_size = 0; }
+
+    /** @brief Give the block back to the pool */
+    void reset() noexcept;
+
+private:
+    char* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+
+    PooledFrame(const PooledFrame&) = delete;
+    PooledFrame& operator=(const PooledFrame&) = delete;
+};
+
+} // namespace NetProtocol
+
+#endif // BUFFER_POOL_H
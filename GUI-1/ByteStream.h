@@ -0,0 +1,238 @@
+#ifndef BYTE_STREAM_H
+#define BYTE_STREAM_H
+
+/**
+ * @file ByteStream.h
+ * @brief Bounds-checked little-endian reads and writes over caller buffers
+ *
+ * PURPOSE:
+ * The handshake and invite codecs grew their output one push_back at a
+ * time, shifting integers out byte by byte, and their parsers copied the
+ * payload into a fresh vector before copying fields out of it again. A
+ * message is now sized up front, written once into its final buffer, and
+ * parsed in place.
+ *
+ * DESIGN:
+ * - ByteView is a non-owning (pointer, size) pair; std::span is C++20
+ * - ByteWriter never allocates: the caller sizes the buffer (usually from
+ *   the *Size() helpers below) and the writer fills it. An overflow marks
+ *   the writer failed instead of writing past the end.
+ * - ByteReader returns views into the input for variable-length fields,
+ *   so a field is copied at most once, into wherever it finally lives.
+ *   Every read checks the remaining length; a short read fails and
+ *   leaves the output untouched.
+ * - Length-prefixed strings use a u16 prefix and are truncated at 65535
+ *   bytes, matching the wire formats that already existed
+ *
+ * THREADING:
+ * Plain values; use one reader or writer per thread.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Read-only view of contiguous bytes
+ */
+struct ByteView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    ByteView() = default;
+    ByteView(const uint8_t* data, size_t size) : data(data), size(size) {}
+    ByteView(const std::vector<uint8_t>& bytes) : data(bytes.data()), size(bytes.size()) {}
+
+    template <size_t N>
+    ByteView(const std::array<uint8_t, N>& bytes) : data(bytes.data()), size(N) {}
+
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+    bool empty() const { return size == 0; }
+
+    std::vector<uint8_t> ToVector() const { return std::vector<uint8_t>(begin(), end()); }
+    std::string ToString() const { return std::string(reinterpret_cast<const char*>(data), size); }
+};
+
+/**
+ * @brief Writes into a fixed buffer supplied by the caller
+ */
+class ByteWriter {
+public:
+    /** @brief Longest string a u16 length prefix can describe */
+    static constexpr size_t MAX_STRING_SIZE = 0xFFFF;
+
+    /** @brief Bytes String() will write for a value */
+    static size_t StringSize(const std::string& value) {
+        return 2 + (std::min)(value.size(), MAX_STRING_SIZE);
+    }
+
+    ByteWriter(uint8_t* buffer, size_t capacity)
+        : m_buffer(buffer), m_capacity(capacity), m_size(0), m_ok(true) {}
+
+    /** @brief Write over the whole of an already-sized vector */
+    explicit ByteWriter(std::vector<uint8_t>& buffer)
+        : ByteWriter(buffer.data(), buffer.size()) {}
+
+    template <size_t N>
+    explicit ByteWriter(std::array<uint8_t, N>& buffer)
+        : ByteWriter(buffer.data(), N) {}
+
+    void U8(uint8_t value) { LE(value, 1); }
+    void U16(uint16_t value) { LE(value, 2); }
+    void U32(uint32_t value) { LE(value, 4); }
+    void U64(uint64_t value) { LE(value, 8); }
+    void I64(int64_t value) { LE(static_cast<uint64_t>(value), 8); }
+
+    /** @brief Low `width` bytes of value, least significant first */
+    void LE(uint64_t value, size_t width) {
+        uint8_t* out = reserve(width);
+        if (!out) {
+            return;
+        }
+        for (size_t i = 0; i < width; ++i) {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    void Bytes(const uint8_t* data, size_t size) {
+        uint8_t* out = reserve(size);
+        if (out && size > 0) {
+            std::memcpy(out, data, size);
+        }
+    }
+
+    void Bytes(ByteView bytes) { Bytes(bytes.data, bytes.size); }
+
+    /** @brief u16 length prefix, then the (possibly truncated) bytes */
+    void String(const std::string& value) {
+        size_t length = (std::min)(value.size(), MAX_STRING_SIZE);
+        U16(static_cast<uint16_t>(length));
+        Bytes(reinterpret_cast<const uint8_t*>(value.data()), length);
+    }
+
+    /** @brief False once any write did not fit */
+    bool Ok() const { return m_ok; }
+
+    /** @brief Bytes written so far */
+    size_t Size() const { return m_size; }
+
+    /** @brief True if every write fit and the buffer is exactly full */
+    bool Complete() const { return m_ok && m_size == m_capacity; }
+
+private:
+    uint8_t* m_buffer;
+    size_t m_capacity;
+    size_t m_size;
+    bool m_ok;
+
+    uint8_t* reserve(size_t size) {
+        if (!m_ok || m_capacity - m_size < size) {
+            m_ok = false;
+            return nullptr;
+        }
+        uint8_t* out = m_buffer + m_size;
+        m_size += size;
+        return out;
+    }
+};
+
+/**
+ * @brief Reads from a byte view without copying it
+ */
+class ByteReader {
+public:
+    explicit ByteReader(ByteView input) : m_input(input), m_offset(0) {}
+
+    bool U8(uint8_t& out) { return LE(out, 1); }
+    bool U16(uint16_t& out) { return LE(out, 2); }
+    bool U32(uint32_t& out) { return LE(out, 4); }
+    bool U64(uint64_t& out) { return LE(out, 8); }
+
+    bool I64(int64_t& out) {
+        uint64_t value;
+        if (!LE(value, 8)) {
+            return false;
+        }
+        out = static_cast<int64_t>(value);
+        return true;
+    }
+
+    /** @brief Unsigned little-endian integer of `width` bytes */
+    template <typename T>
+    bool LE(T& out, size_t width) {
+        if (Remaining() < width) {
+            return false;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < width; ++i) {
+            value |= static_cast<uint64_t>(m_input.data[m_offset + i]) << (8 * i);
+        }
+        m_offset += width;
+        out = static_cast<T>(value);
+        return true;
+    }
+
+    /** @brief View of the next `size` bytes */
+    bool Bytes(size_t size, ByteView& out) {
+        if (Remaining() < size) {
+            return false;
+        }
+        out = ByteView(m_input.data + m_offset, size);
+        m_offset += size;
+        return true;
+    }
+
+    /** @brief Copy exactly N bytes into a fixed-size field */
+    template <size_t N>
+    bool Bytes(std::array<uint8_t, N>& out) {
+        ByteView view;
+        if (!Bytes(N, view)) {
+            return false;
+        }
+        std::memcpy(out.data(), view.data, N);
+        return true;
+    }
+
+    /** @brief View of a field with a length prefix of `prefixWidth` bytes */
+    bool Prefixed(size_t prefixWidth, ByteView& out) {
+        size_t start = m_offset;
+        size_t length = 0;
+        if (!LE(length, prefixWidth) || !Bytes(length, out)) {
+            m_offset = start;
+            return false;
+        }
+        return true;
+    }
+
+    /** @brief u16 length-prefixed string */
+    bool String(std::string& out) {
+        ByteView view;
+        if (!Prefixed(2, view)) {
+            return false;
+        }
+        out.assign(reinterpret_cast<const char*>(view.data), view.size);
+        return true;
+    }
+
+    bool Skip(size_t size) {
+        ByteView ignored;
+        return Bytes(size, ignored);
+    }
+
+    size_t Remaining() const { return m_input.size - m_offset; }
+    size_t Offset() const { return m_offset; }
+
+    /** @brief Everything not read yet */
+    ByteView Rest() const { return ByteView(m_input.data + m_offset, Remaining()); }
+
+private:
+    ByteView m_input;
+    size_t m_offset;
+};
+
+#endif // BYTE_STREAM_H
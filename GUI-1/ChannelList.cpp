@@ -6,7 +6,10 @@
 #include "ChannelList.h"
 #include "ServerManager.h"
 #include "UserDatabase.h"
+#include "FlatHashMap.h"
+#include <FL/Fl.H>
 #include <FL/fl_ask.H>
+#include <algorithm>
 
 // Color constants
 namespace {
@@ -30,7 +33,6 @@ ChannelList::ChannelList(int x, int y, int width, int height,
     , currentServerId(0)
     , currentUserId(0)
     , isOwner(false)
-    , selectedChannelId(0)
     , backButton(nullptr)
     , serverNameLabel(nullptr)
     , serverOptionsButton(nullptr)
@@ -38,14 +40,17 @@ ChannelList::ChannelList(int x, int y, int width, int height,
     , channelList(nullptr)
     , addChannelButton(nullptr)
     , membersHeader(nullptr)
-    , memberList(nullptr) {
+    , memberList(nullptr)
+    , selectedChannelId(0)
+    , loadScheduled(false) {
     
     setupLayout();
     end();
 }
 
 ChannelList::~ChannelList() {
-    // FLTK handles cleanup
+    // FLTK handles the widgets; a pending load must not run on a dead page
+    Fl::remove_timeout(loadServerCallback, this);
 }
 
 void ChannelList::setupLayout() {
@@ -122,10 +127,33 @@ void ChannelList::setServer(uint64_t serverId, uint64_t userId) {
     currentUserId = userId;
     selectedChannelId = 0;
     
+    // Nothing cached applies to another server
+    cachedChannels.clear();
+    cachedMembers.clear();
+    channelList->clear();
+    memberList->clear();
+    serverNameLabel->label("Loading...");
+    channelList->add("@i@- Loading channels -");
+    memberList->add("@i@- Loading members -");
+    
+    if (!loadScheduled) {
+        loadScheduled = true;
+        Fl::add_timeout(0.0, loadServerCallback, this);
+    }
+}
+
+void ChannelList::loadServerCallback(void* userdata) {
+    ChannelList* list = static_cast<ChannelList*>(userdata);
+    list->loadScheduled = false;
+    
+    // The placeholders are not rows of the caches
+    list->channelList->clear();
+    list->memberList->clear();
+    
     // Check if user is owner
-    isOwner = serverManager->IsServerOwner(serverId, userId);
+    list->isOwner = list->serverManager->IsServerOwner(list->currentServerId, list->currentUserId);
     
-    refresh();
+    list->refresh();
 }
 
 void ChannelList::refresh() {
@@ -134,25 +162,40 @@ void ChannelList::refresh() {
     }
     
     // Get server info
-    Models::ChatServer server;
-    if (!serverManager->GetServer(currentServerId, server)) {
+    ServerManager::ServerSummary server;
+    if (!serverManager->GetServerSummary(currentServerId, server)) {
         return;
     }
     
     serverNameLabel->copy_label(server.serverName.c_str());
     
     updateChannelList();
-    updateMemberList();
+    updateMemberList(server.ownerId);
     updateOwnerControls();
 }
 
 void ChannelList::updateChannelList() {
-    channelList->clear();
-    cachedChannels = serverManager->GetServerChannels(currentServerId);
-    
-    for (const Models::Channel& channel : cachedChannels) {
-        std::string displayName = "# " + channel.channelName;
-        channelList->add(displayName.c_str());
+    // Compare in place; the list is copied only when it changed
+    bool unchanged = true;
+    size_t position = 0;
+    serverManager->ForEachServerChannel(currentServerId, [&](const Models::Channel& channel) {
+        if (position >= cachedChannels.size() || cachedChannels[position].channelId != channel.channelId ||
+            cachedChannels[position].channelName != channel.channelName) {
+            unchanged = false;
+        }
+        ++position;
+    });
+    unchanged = unchanged && position == cachedChannels.size();
+    if (!unchanged) {
+        channelList->clear();
+        cachedChannels = serverManager->GetServerChannels(currentServerId);
+        for (size_t i = 0; i < cachedChannels.size(); ++i) {
+            std::string displayName = "# " + cachedChannels[i].channelName;
+            channelList->add(displayName.c_str());
+            if (cachedChannels[i].channelId == selectedChannelId) {
+                channelList->value(static_cast<int>(i) + 1);
+            }
+        }
     }
     
     // Auto-select first channel if none selected
@@ -166,31 +209,55 @@ void ChannelList::updateChannelList() {
     }
 }
 
-void ChannelList::updateMemberList() {
-    memberList->clear();
-    cachedMemberIds = serverManager->GetServerMembers(currentServerId);
+void ChannelList::updateMemberList(uint64_t ownerId) {
+    std::vector<uint64_t> memberIds = serverManager->GetServerMembers(currentServerId);
+    std::vector<UserDatabase::UserSummary> members = userDatabase->GetUsersByIds(memberIds);
     
-    // Get server to check owner
-    Models::ChatServer server;
-    serverManager->GetServer(currentServerId, server);
+    std::vector<MemberRow> rows;
+    rows.reserve(members.size());
+    FlatHashMap<uint64_t, size_t> wanted;
+    wanted.reserve(members.size());
+    for (const UserDatabase::UserSummary& member : members) {
+        std::string displayName = member.username;
+        
+        // Mark owner
+        if (member.userId == ownerId) {
+            displayName += " (Owner)";
+        }
+        
+        // Mark online status
+        if (member.isOnline) {
+            displayName = "@C2@." + displayName;  // Green dot prefix
+        }
+        
+        wanted.emplace(member.userId, rows.size());
+        rows.push_back({ member.userId, std::move(displayName) });
+    }
     
-    for (uint64_t memberId : cachedMemberIds) {
-        Models::User user;
-        if (userDatabase->GetUserById(memberId, user)) {
-            std::string displayName = user.username;
-            
-            // Mark owner
-            if (memberId == server.ownerId) {
-                displayName = user.username + " (Owner)";
-            }
-            
-            // Mark online status
-            if (user.isOnline) {
-                displayName = "@C2@." + displayName;  // Green dot prefix
+    // Walk the shown lines alongside the new list. Membership keeps join
+    // order, so a join or leave touches only its own line.
+    size_t line = 0;
+    for (const MemberRow& row : rows) {
+        while (line < cachedMembers.size() && cachedMembers[line].userId != row.userId &&
+               wanted.count(cachedMembers[line].userId) == 0) {
+            memberList->remove(static_cast<int>(line) + 1);
+            cachedMembers.erase(cachedMembers.begin() + line);
+        }
+        
+        if (line < cachedMembers.size() && cachedMembers[line].userId == row.userId) {
+            if (cachedMembers[line].text != row.text) {
+                memberList->text(static_cast<int>(line) + 1, row.text.c_str());
+                cachedMembers[line].text = row.text;
             }
-            
-            memberList->add(displayName.c_str());
+        } else {
+            memberList->insert(static_cast<int>(line) + 1, row.text.c_str());
+            cachedMembers.insert(cachedMembers.begin() + line, row);
         }
+        ++line;
+    }
+    while (cachedMembers.size() > line) {
+        memberList->remove(static_cast<int>(cachedMembers.size()));
+        cachedMembers.pop_back();
     }
 }
 
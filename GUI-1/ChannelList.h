@@ -18,6 +18,7 @@
 #include <FL/Fl_Hold_Browser.H>
 #include <FL/Fl_Scroll.H>
 #include <functional>
+#include <string>
 #include <vector>
 #include "Models.h"
 
@@ -44,6 +45,9 @@ public:
     
     /**
      * @brief Set the current server to display
+     * 
+     * Shows placeholders at once; the channels and members are read on
+     * the next turn of the event loop, after the page has been drawn.
      */
     void setServer(uint64_t serverId, uint64_t currentUserId);
     
@@ -93,17 +97,22 @@ private:
     Fl_Box* membersHeader;
     Fl_Hold_Browser* memberList;
     
-    // Cached data
+    // Cached data; refresh() only touches browser lines that changed
+    struct MemberRow {
+        uint64_t userId;
+        std::string text;
+    };
     std::vector<Models::Channel> cachedChannels;
-    std::vector<uint64_t> cachedMemberIds;
+    std::vector<MemberRow> cachedMembers;     // One per memberList line
     uint64_t selectedChannelId;
+    bool loadScheduled;
     
     // Layout
     void setupLayout();
     
     // Update UI
     void updateChannelList();
-    void updateMemberList();
+    void updateMemberList(uint64_t ownerId);
     void updateOwnerControls();
     
     // Callbacks
@@ -111,6 +120,7 @@ private:
     static void onChannelListSelected(Fl_Widget* widget, void* userdata);
     static void onAddChannelClicked(Fl_Widget* widget, void* userdata);
     static void onServerOptionsClicked(Fl_Widget* widget, void* userdata);
+    static void loadServerCallback(void* userdata);
 };
 
 #endif // CHANNEL_LIST_H
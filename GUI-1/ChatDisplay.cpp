@@ -0,0 +1,537 @@
+#include "ChatDisplay.hpp"
+#include "Trace.h"
+#include <FL/Fl.H>
+#include <FL/fl_draw.H>
+#include <FL/fl_utf8.h>
+#include <algorithm>
+
+ChatDisplay::ChatDisplay(int X, int Y, int W, int H)
+    : Fl_Group(X, Y, W, H)
+    , totalRows(0)
+    , followingTail(true)
+    , topLine(0)
+    , topRow(0)
+    , rowsAbove(0)
+    , tailDetached(false)
+    , selectionAnchor(-1)
+    , selectionEnd(-1)
+    , scrollbar(nullptr)
+    , scrollbarWidth(Fl::scrollbar_size())
+    , textColor(FL_FOREGROUND_COLOR)
+    , textFont(FL_HELVETICA)
+    , textSize(FL_NORMAL_SIZE)
+    , wrapWidth(0)
+    , topNotifyScheduled(false)
+    , bottomNotifyScheduled(false)
+{
+    scrollbar = new Fl_Scrollbar(X + W - scrollbarWidth, Y, scrollbarWidth, H);
+    scrollbar->callback(scrollbarCallback, this);
+    scrollbar->linesize(WHEEL_ROWS);
+    end();
+
+    selection_color(FL_SELECTION_COLOR);
+    layoutScrollbar();
+}
+
+ChatDisplay::~ChatDisplay() {
+    Fl::remove_timeout(topNotifyCallback, this);
+    Fl::remove_timeout(bottomNotifyCallback, this);
+}
+
+//=============================================================================
+// CONTENT
+//=============================================================================
+
+void ChatDisplay::append(const std::string& text, uint64_t messageId) {
+    if (tailDetached) {
+        return;     // Shown again when the owner reloads the newest history
+    }
+
+    bool trimmed = pushLine(text, messageId);
+    redraw();
+    if (trimmed && onTopTrimmed) {
+        onTopTrimmed();
+    }
+}
+
+void ChatDisplay::append(const std::vector<Entry>& block) {
+    if (tailDetached || block.empty()) {
+        return;
+    }
+
+    // Lines that would be trimmed again before the next draw are not wrapped
+    size_t first = block.size() > MAX_SCROLLBACK_LINES ? block.size() - MAX_SCROLLBACK_LINES : 0;
+    bool trimmed = first > 0;
+    for (size_t i = first; i < block.size(); ++i) {
+        trimmed |= pushLine(block[i].text, block[i].messageId);
+    }
+
+    redraw();
+    if (trimmed && onTopTrimmed) {
+        onTopTrimmed();
+    }
+}
+
+bool ChatDisplay::pushLine(const std::string& text, uint64_t messageId) {
+    Line line{ text, messageId, {} };
+    while (!line.text.empty() && line.text.back() == '\n') {
+        line.text.pop_back();
+    }
+    wrapLine(line);
+    totalRows += line.rowStarts.size();
+    lines.push_back(std::move(line));
+
+    bool trimmed = false;
+    while (lines.size() > MAX_SCROLLBACK_LINES) {
+        size_t rows = lines.front().rowStarts.size();
+        lines.pop_front();
+        totalRows -= rows;
+        trimmed = true;
+
+        if (!followingTail) {
+            if (topLine > 0) {
+                --topLine;
+                rowsAbove -= rows;
+            } else {
+                topRow = 0;     // The line at the top of the view went away
+                rowsAbove = 0;
+            }
+        }
+        if (selectionAnchor >= 0) {
+            selectionAnchor = (std::max)(selectionAnchor - 1, 0L);
+            selectionEnd = (std::max)(selectionEnd - 1, 0L);
+        }
+    }
+    return trimmed;
+}
+
+void ChatDisplay::prepend(const std::string& text, uint64_t messageId) {
+    Line line{ text, messageId, {} };
+    while (!line.text.empty() && line.text.back() == '\n') {
+        line.text.pop_back();
+    }
+    wrapLine(line);
+    size_t rows = line.rowStarts.size();
+    totalRows += rows;
+    lines.push_front(std::move(line));
+
+    // Keep the same rows on screen
+    if (!followingTail) {
+        ++topLine;
+        rowsAbove += rows;
+    }
+    if (selectionAnchor >= 0) {
+        ++selectionAnchor;
+        ++selectionEnd;
+    }
+
+    while (lines.size() > MAX_SCROLLBACK_LINES) {
+        totalRows -= lines.back().rowStarts.size();
+        lines.pop_back();
+        tailDetached = true;
+    }
+    if (!followingTail && topLine >= lines.size()) {
+        followingTail = true;
+    }
+    long lastLine = static_cast<long>(lines.size()) - 1;
+    selectionAnchor = (std::min)(selectionAnchor, lastLine);
+    selectionEnd = (std::min)(selectionEnd, lastLine);
+
+    redraw();
+}
+
+void ChatDisplay::clear() {
+    lines.clear();
+    totalRows = 0;
+    followingTail = true;
+    topLine = 0;
+    topRow = 0;
+    rowsAbove = 0;
+    tailDetached = false;
+    selectionAnchor = -1;
+    selectionEnd = -1;
+    redraw();
+}
+
+void ChatDisplay::scrollToBottom() {
+    followingTail = true;
+    redraw();
+}
+
+uint64_t ChatDisplay::oldestMessageId() const {
+    for (const Line& line : lines) {
+        if (line.messageId != 0) {
+            return line.messageId;
+        }
+    }
+    return 0;
+}
+
+//=============================================================================
+// LAYOUT
+//=============================================================================
+
+void ChatDisplay::textfont(Fl_Font font) {
+    textFont = font;
+    rewrapAll();
+    redraw();
+}
+
+void ChatDisplay::textsize(Fl_Fontsize size) {
+    textSize = size;
+    rewrapAll();
+    redraw();
+}
+
+void ChatDisplay::scrollbar_width(int width) {
+    scrollbarWidth = width;
+    layoutScrollbar();
+    redraw();
+}
+
+void ChatDisplay::resize(int X, int Y, int W, int H) {
+    // Not Fl_Group::resize: the scrollbar is placed by hand
+    Fl_Widget::resize(X, Y, W, H);
+    layoutScrollbar();
+}
+
+void ChatDisplay::layoutScrollbar() {
+    scrollbar->resize(x() + w() - scrollbarWidth, y(), scrollbarWidth, h());
+
+    int width = (std::max)(1, w() - scrollbarWidth - 2 * MARGIN);
+    if (width != wrapWidth) {
+        wrapWidth = width;
+        rewrapAll();
+    }
+}
+
+int ChatDisplay::rowHeight() const {
+    fl_font(textFont, textSize);
+    return (std::max)(1, fl_height());
+}
+
+int ChatDisplay::visibleRows() const {
+    return (std::max)(1, (h() - 2 * MARGIN) / rowHeight());
+}
+
+void ChatDisplay::wrapLine(Line& line) const {
+    fl_font(textFont, textSize);
+    line.rowStarts.assign(1, 0);
+
+    const std::string& text = line.text;
+    size_t rowStart = 0;
+    size_t lastBreak = std::string::npos;   // Just after the last space in this row
+    double rowWidth = 0;
+
+    for (size_t i = 0; i < text.size();) {
+        if (text[i] == '\n') {
+            rowStart = i + 1;
+            line.rowStarts.push_back(static_cast<uint32_t>(rowStart));
+            lastBreak = std::string::npos;
+            rowWidth = 0;
+            ++i;
+            continue;
+        }
+
+        int length = fl_utf8len1(text[i]);
+        length = (std::max)(1, (std::min)(length, static_cast<int>(text.size() - i)));
+        double charWidth = fl_width(text.data() + i, length);
+
+        if (rowWidth + charWidth > wrapWidth && i > rowStart) {
+            // Break after the last space if there is one, else mid-word
+            size_t next = (lastBreak != std::string::npos && lastBreak > rowStart) ? lastBreak : i;
+            line.rowStarts.push_back(static_cast<uint32_t>(next));
+            rowWidth = fl_width(text.data() + next, static_cast<int>(i - next));
+            rowStart = next;
+            lastBreak = std::string::npos;
+        }
+
+        if (text[i] == ' ') {
+            lastBreak = i + 1;
+        }
+        rowWidth += charWidth;
+        i += length;
+    }
+}
+
+void ChatDisplay::rewrapAll() {
+    totalRows = 0;
+    size_t rowsBeforeTop = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        wrapLine(lines[i]);
+        if (i < topLine) {
+            rowsBeforeTop += lines[i].rowStarts.size();
+        }
+        totalRows += lines[i].rowStarts.size();
+    }
+
+    if (!followingTail && topLine < lines.size()) {
+        topRow = (std::min)(topRow, lines[topLine].rowStarts.size() - 1);
+        rowsAbove = rowsBeforeTop + topRow;
+        clampToBottom();
+    }
+}
+
+//=============================================================================
+// SCROLLING
+//=============================================================================
+
+void ChatDisplay::anchorFromTail() {
+    size_t visible = static_cast<size_t>(visibleRows());
+    topLine = 0;
+    topRow = 0;
+    rowsAbove = 0;
+    if (totalRows <= visible) {
+        return;
+    }
+
+    // Walk up from the last line: O(screen), not O(transcript)
+    rowsAbove = totalRows - visible;
+    size_t remaining = visible;
+    size_t line = lines.size();
+    while (line > 0) {
+        --line;
+        size_t rows = lines[line].rowStarts.size();
+        if (rows >= remaining) {
+            topLine = line;
+            topRow = rows - remaining;
+            return;
+        }
+        remaining -= rows;
+    }
+}
+
+void ChatDisplay::scrollTo(size_t absoluteRow) {
+    size_t visible = static_cast<size_t>(visibleRows());
+    if (totalRows <= visible || absoluteRow + visible >= totalRows) {
+        followingTail = true;
+        return;
+    }
+
+    followingTail = false;
+    rowsAbove = absoluteRow;
+    size_t remaining = absoluteRow;
+    for (size_t line = 0; line < lines.size(); ++line) {
+        size_t rows = lines[line].rowStarts.size();
+        if (remaining < rows) {
+            topLine = line;
+            topRow = remaining;
+            return;
+        }
+        remaining -= rows;
+    }
+}
+
+void ChatDisplay::scrollRows(long delta) {
+    if (followingTail) {
+        anchorFromTail();
+    }
+    long target = static_cast<long>(rowsAbove) + delta;
+    scrollTo(static_cast<size_t>((std::max)(target, 0L)));
+}
+
+void ChatDisplay::clampToBottom() {
+    if (rowsAbove + static_cast<size_t>(visibleRows()) >= totalRows) {
+        followingTail = true;
+    }
+}
+
+void ChatDisplay::updateScrollbar() {
+    int visible = visibleRows();
+    int total = (std::max)(static_cast<int>(totalRows), visible);
+    scrollbar->value(static_cast<int>(rowsAbove), visible, 0, total);
+}
+
+void ChatDisplay::scrollbarCallback(Fl_Widget* widget, void* userdata) {
+    ChatDisplay* display = static_cast<ChatDisplay*>(userdata);
+    Fl_Scrollbar* bar = static_cast<Fl_Scrollbar*>(widget);
+    display->scrollTo(static_cast<size_t>((std::max)(bar->value(), 0)));
+    display->redraw();
+}
+
+//=============================================================================
+// DRAWING
+//=============================================================================
+
+void ChatDisplay::draw() {
+    TRACE_ZONE("ChatDisplay::draw");
+    draw_box(box(), x(), y(), w(), h(), color());
+
+    if (followingTail) {
+        anchorFromTail();
+    }
+
+    int textX = x() + MARGIN;
+    int textTop = y() + MARGIN;
+    int textBottom = y() + h() - MARGIN;
+    int textAreaWidth = w() - scrollbarWidth;
+
+    fl_push_clip(x(), y(), textAreaWidth, h());
+    int lineHeight = rowHeight();
+    int descent = fl_descent();
+    long selectionLo = (std::min)(selectionAnchor, selectionEnd);
+    long selectionHi = (std::max)(selectionAnchor, selectionEnd);
+
+    // Only the rows that fit on screen are drawn
+    size_t lineIndex = topLine;
+    size_t row = topRow;
+    for (int rowY = textTop; lineIndex < lines.size() && rowY < textBottom; rowY += lineHeight) {
+        const Line& line = lines[lineIndex];
+        bool selected = selectionAnchor >= 0 &&
+                        static_cast<long>(lineIndex) >= selectionLo &&
+                        static_cast<long>(lineIndex) <= selectionHi;
+        if (selected) {
+            fl_color(selection_color());
+            fl_rectf(x(), rowY, textAreaWidth, lineHeight);
+        }
+
+        size_t begin = line.rowStarts[row];
+        size_t end = (row + 1 < line.rowStarts.size()) ? line.rowStarts[row + 1] : line.text.size();
+        while (end > begin && (line.text[end - 1] == '\n' || line.text[end - 1] == ' ')) {
+            --end;
+        }
+
+        fl_color(selected ? fl_contrast(textColor, selection_color()) : textColor);
+        fl_draw(line.text.data() + begin, static_cast<int>(end - begin), textX, rowY + lineHeight - descent);
+
+        if (++row == line.rowStarts.size()) {
+            row = 0;
+            ++lineIndex;
+        }
+    }
+    fl_pop_clip();
+
+    updateScrollbar();
+    draw_child(*scrollbar);
+
+    if (onScrolledToTop && rowsAbove == 0 && !topNotifyScheduled) {
+        topNotifyScheduled = true;
+        Fl::add_timeout(0.0, topNotifyCallback, this);
+    }
+    if (onScrolledToBottom && tailDetached && followingTail && !bottomNotifyScheduled) {
+        bottomNotifyScheduled = true;
+        Fl::add_timeout(0.0, bottomNotifyCallback, this);
+    }
+}
+
+void ChatDisplay::topNotifyCallback(void* userdata) {
+    ChatDisplay* display = static_cast<ChatDisplay*>(userdata);
+    display->topNotifyScheduled = false;
+    if (display->onScrolledToTop) {
+        display->onScrolledToTop();
+    }
+}
+
+void ChatDisplay::bottomNotifyCallback(void* userdata) {
+    ChatDisplay* display = static_cast<ChatDisplay*>(userdata);
+    display->bottomNotifyScheduled = false;
+    if (display->onScrolledToBottom) {
+        display->onScrolledToBottom();
+    }
+}
+
+//=============================================================================
+// INPUT
+//=============================================================================
+
+long ChatDisplay::lineAt(int eventY) {
+    if (lines.empty()) {
+        return -1;
+    }
+    if (followingTail) {
+        anchorFromTail();
+    }
+
+    long rowOffset = (std::max)(0, eventY - (y() + MARGIN)) / rowHeight();
+    size_t lineIndex = topLine;
+    long rowsLeft = rowOffset + static_cast<long>(topRow);
+    while (lineIndex + 1 < lines.size() &&
+           rowsLeft >= static_cast<long>(lines[lineIndex].rowStarts.size())) {
+        rowsLeft -= static_cast<long>(lines[lineIndex].rowStarts.size());
+        ++lineIndex;
+    }
+    return static_cast<long>(lineIndex);
+}
+
+void ChatDisplay::copySelection() const {
+    if (selectionAnchor < 0) {
+        return;
+    }
+    long lo = (std::min)(selectionAnchor, selectionEnd);
+    long hi = (std::max)(selectionAnchor, selectionEnd);
+
+    std::string text;
+    for (long i = lo; i <= hi && i < static_cast<long>(lines.size()); ++i) {
+        text += lines[static_cast<size_t>(i)].text;
+        text += '\n';
+    }
+    Fl::copy(text.c_str(), static_cast<int>(text.size()), 1);
+}
+
+int ChatDisplay::handle(int event) {
+    switch (event) {
+    case FL_MOUSEWHEEL:
+        if (Fl::event_inside(this) && Fl::event_dy() != 0) {
+            scrollRows(static_cast<long>(Fl::event_dy()) * WHEEL_ROWS);
+            redraw();
+            return 1;
+        }
+        break;
+
+    case FL_PUSH:
+        if (Fl::event_inside(scrollbar)) {
+            break;
+        }
+        take_focus();
+        selectionAnchor = lineAt(Fl::event_y());
+        selectionEnd = selectionAnchor;
+        redraw();
+        return 1;
+
+    case FL_DRAG:
+        if (selectionAnchor >= 0) {
+            // Dragging past an edge scrolls the selection along
+            if (Fl::event_y() < y()) {
+                scrollRows(-1);
+            } else if (Fl::event_y() > y() + h()) {
+                scrollRows(1);
+            }
+            selectionEnd = lineAt(Fl::event_y());
+            redraw();
+        }
+        return 1;
+
+    case FL_RELEASE:
+        return 1;
+
+    case FL_FOCUS:
+    case FL_UNFOCUS:
+        return 1;
+
+    case FL_KEYBOARD: {
+        int key = Fl::event_key();
+        if ((Fl::event_state() & FL_COMMAND) && key == 'c') {
+            copySelection();
+            return 1;
+        }
+        long page = (std::max)(1, visibleRows() - 1);
+        if (key == FL_Page_Up) {
+            scrollRows(-page);
+        } else if (key == FL_Page_Down) {
+            scrollRows(page);
+        } else if (key == FL_Home) {
+            scrollTo(0);
+        } else if (key == FL_End) {
+            scrollToBottom();
+        } else {
+            break;
+        }
+        redraw();
+        return 1;
+    }
+
+    default:
+        break;
+    }
+    return Fl_Group::handle(event);
+}
@@ -0,0 +1,164 @@
+#ifndef CHAT_DISPLAY_HPP
+#define CHAT_DISPLAY_HPP
+
+/**
+ * @file ChatDisplay.hpp
+ * @brief Virtualized chat transcript with bounded scrollback
+ *
+ * PURPOSE:
+ * Fl_Text_Display keeps the transcript as one text buffer, and finding the
+ * last line means counting lines over the whole buffer, so every new
+ * message cost O(transcript). This widget keeps one entry per line and
+ * draws only the rows that are on screen.
+ *
+ * DESIGN:
+ * - Lines are wrapped once, when added or when the width changes; each
+ *   line remembers where its rows start
+ * - The view is either "following the tail" (drawn upward from the last
+ *   line, so scrolling to the bottom is O(1)) or anchored at a line and row
+ * - At most MAX_SCROLLBACK_LINES are kept. Appending drops the oldest
+ *   lines, prepending older history drops the newest; the owner pages
+ *   them back in from MessageService through the callbacks below
+ *
+ * Reaching either end is reported from an idle timeout, so the owner can
+ * safely add or clear lines from the callback.
+ */
+
+#include <FL/Fl_Group.H>
+#include <FL/Fl_Scrollbar.H>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+class ChatDisplay : public Fl_Group {
+public:
+    /** Lines kept in memory; older history is paged in again on demand */
+    static constexpr size_t MAX_SCROLLBACK_LINES = 1000;
+
+    ChatDisplay(int X, int Y, int W, int H);
+    ~ChatDisplay();
+
+    /**
+     * @brief Called when the first line of the transcript becomes visible
+     */
+    void setOnScrolledToTop(std::function<void()> callback) { onScrolledToTop = callback; }
+
+    /**
+     * @brief Called when the view reaches the bottom after newer lines were dropped
+     *
+     * Appends are ignored until the owner reloads the newest history.
+     */
+    void setOnScrolledToBottom(std::function<void()> callback) { onScrolledToBottom = callback; }
+
+    /**
+     * @brief Called when appending dropped lines from the top
+     */
+    void setOnTopTrimmed(std::function<void()> callback) { onTopTrimmed = callback; }
+
+    /**
+     * @brief Add a line at the bottom
+     * @param messageId History message the line shows (0 = not from history)
+     */
+    void append(const std::string& text, uint64_t messageId = 0);
+
+    struct Entry {
+        std::string text;
+        uint64_t messageId;
+    };
+
+    /**
+     * @brief Add several lines at the bottom with a single redraw
+     *
+     * Used for everything that arrived since the last frame; at most
+     * MAX_SCROLLBACK_LINES of the block are kept.
+     */
+    void append(const std::vector<Entry>& block);
+
+    /**
+     * @brief Add a line at the top without moving the view
+     */
+    void prepend(const std::string& text, uint64_t messageId = 0);
+
+    /** @brief Remove every line and follow the tail again */
+    void clear();
+
+    /** @brief Scroll so the last line is visible, and keep it there */
+    void scrollToBottom();
+
+    /** @brief ID of the oldest history line shown (0 = none) */
+    uint64_t oldestMessageId() const;
+
+    size_t lineCount() const { return lines.size(); }
+
+    void textcolor(Fl_Color color) { textColor = color; redraw(); }
+    Fl_Color textcolor() const { return textColor; }
+    void textfont(Fl_Font font);
+    void textsize(Fl_Fontsize size);
+    void scrollbar_width(int width);
+
+    void resize(int X, int Y, int W, int H) override;
+    int handle(int event) override;
+
+protected:
+    void draw() override;
+
+private:
+    struct Line {
+        std::string text;
+        uint64_t messageId;
+        std::vector<uint32_t> rowStarts;    // Byte offset of each wrapped row
+    };
+
+    std::deque<Line> lines;
+    size_t totalRows;
+
+    // View position; ignored while followingTail
+    bool followingTail;
+    size_t topLine;
+    size_t topRow;              // Row within topLine
+    size_t rowsAbove;           // Rows before (topLine, topRow)
+
+    bool tailDetached;          // Newest lines were dropped by prepend()
+
+    // Line selection for copying, as line indices (-1 = none)
+    long selectionAnchor;
+    long selectionEnd;
+
+    Fl_Scrollbar* scrollbar;
+    int scrollbarWidth;
+    Fl_Color textColor;
+    Fl_Font textFont;
+    Fl_Fontsize textSize;
+    int wrapWidth;
+
+    std::function<void()> onScrolledToTop;
+    std::function<void()> onScrolledToBottom;
+    std::function<void()> onTopTrimmed;
+    bool topNotifyScheduled;
+    bool bottomNotifyScheduled;
+
+    static constexpr int MARGIN = 4;
+    static constexpr int WHEEL_ROWS = 3;
+
+    int rowHeight() const;
+    int visibleRows() const;
+    void wrapLine(Line& line) const;
+    bool pushLine(const std::string& text, uint64_t messageId);
+    void rewrapAll();
+    void anchorFromTail();
+    void scrollTo(size_t absoluteRow);
+    void scrollRows(long delta);
+    void clampToBottom();
+    long lineAt(int eventY);
+    void copySelection() const;
+    void layoutScrollbar();
+    void updateScrollbar();
+
+    static void scrollbarCallback(Fl_Widget* widget, void* userdata);
+    static void topNotifyCallback(void* userdata);
+    static void bottomNotifyCallback(void* userdata);
+};
+
+#endif // CHAT_DISPLAY_HPP
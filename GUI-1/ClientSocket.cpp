@@ -4,10 +4,9 @@
 #include <FL/fl_draw.H>
 #include <iostream>
 #include <stdexcept>
-#include <winsock2.h>
-#include <ws2tcpip.h>
 #include "MainWindow.h"
 #include "NetProtocol.h"
+#include "Log.h"
 
 /**
  * @brief Constructor for ClientSocket with an existing socket.
@@ -15,8 +14,9 @@
  * SECURITY: Configures socket with appropriate timeouts and options
  * to prevent slowloris-style attacks and ensure clean error handling.
  */
-ClientSocket::ClientSocket(SOCKET socket, PlayerDisplay* playerDisplay, const std::string& settings)
-    : m_socket(socket), m_closed(false), playerDisplay(playerDisplay), m_settings(settings), mainWindow(nullptr) {
+ClientSocket::ClientSocket(SOCKET socket, PlayerDisplay* playerDisplay, std::shared_ptr<const ServerConfig> config)
+    : playerDisplay(playerDisplay), m_socket(socket), m_closed(false), m_protocolVersion(0),
+    m_requests(GetTickCount64()), mainWindow(nullptr), m_serverConfig(std::move(config)) {
     if (socket == INVALID_SOCKET) {
         throw std::runtime_error("Invalid socket");
     }
@@ -25,8 +25,7 @@ ClientSocket::ClientSocket(SOCKET socket, PlayerDisplay* playerDisplay, const st
     NetProtocol::ConfigureSocket(m_socket);
     
     // Set non-blocking mode - REQUIRED for GUI event loop
-    u_long mode = 1;
-    if (ioctlsocket(m_socket, FIONBIO, &mode) == SOCKET_ERROR) {
+    if (!NetProtocol::SetNonBlocking(m_socket)) {
         closesocket(m_socket);
         throw std::runtime_error("Failed to set non-blocking mode");
     }
@@ -38,12 +37,12 @@ ClientSocket::ClientSocket(SOCKET socket, PlayerDisplay* playerDisplay, const st
  * SECURITY NOTES:
  * - Validates IP address format before connecting
  * - Configures socket with security settings after connection
- * - Sends username using secure length-prefixed protocol
+ * - Sends username in a framed HELLO and waits for the server's WELCOME
  */
 ClientSocket::ClientSocket(const std::string& ipAddress, int port, const std::string& username,
     PlayerDisplay* playerDisplay, const std::string& settings, MainWindow* mainWindow)
-    : m_socket(INVALID_SOCKET), m_closed(false), m_username(username),
-    playerDisplay(playerDisplay), m_settings(settings), mainWindow(mainWindow) {
+    : playerDisplay(playerDisplay), m_socket(INVALID_SOCKET), m_closed(false), m_protocolVersion(0),
+    m_requests(GetTickCount64()), m_username(username), mainWindow(mainWindow), m_settings(std::make_unique<Settings>(settings)) {
 
     // SECURITY: Validate username length before proceeding
     // This prevents sending oversized usernames that could cause issues
@@ -51,14 +50,13 @@ ClientSocket::ClientSocket(const std::string& ipAddress, int port, const std::st
         throw std::runtime_error("Username too long (max 64 characters)");
     }
 
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+    if (!NetProtocol::StartNetworking()) {
         throw std::runtime_error("WSAStartup failed");
     }
 
     m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (m_socket == INVALID_SOCKET) {
-        WSACleanup();
+        NetProtocol::StopNetworking();
         throw std::runtime_error("Failed to create socket");
     }
 
@@ -68,31 +66,76 @@ ClientSocket::ClientSocket(const std::string& ipAddress, int port, const std::st
 
     if (inet_pton(AF_INET, ipAddress.c_str(), &serverAddress.sin_addr) <= 0) {
         closesocket(m_socket);
-        WSACleanup();
+        NetProtocol::StopNetworking();
         throw std::runtime_error("Invalid address / Address not supported");
     }
 
     if (connect(m_socket, reinterpret_cast<sockaddr*>(&serverAddress), sizeof(serverAddress)) == SOCKET_ERROR) {
         closesocket(m_socket);
-        WSACleanup();
+        NetProtocol::StopNetworking();
         throw std::runtime_error("Failed to connect to server");
     }
 
+    finishConnect();
+}
+
+/**
+ * @brief Constructor for ClientSocket over a socket connected by a Connector.
+ * 
+ * Only the handshake remains, bounded by HANDSHAKE_TIMEOUT_MS; the
+ * unbounded part (resolving and connecting) already ran off the UI thread.
+ */
+ClientSocket::ClientSocket(SOCKET connected, const std::string& username,
+    PlayerDisplay* playerDisplay, const std::string& settings, MainWindow* mainWindow)
+    : playerDisplay(playerDisplay), m_socket(connected), m_closed(false), m_protocolVersion(0),
+    m_requests(GetTickCount64()), m_username(username), mainWindow(mainWindow), m_settings(std::make_unique<Settings>(settings)) {
+
+    if (connected == INVALID_SOCKET) {
+        throw std::runtime_error("Invalid socket");
+    }
+    if (username.size() > 64) {
+        closesocket(m_socket);
+        throw std::runtime_error("Username too long (max 64 characters)");
+    }
+
+    // Balances the Connector's reference, which goes away with it
+    if (!NetProtocol::StartNetworking()) {
+        closesocket(m_socket);
+        throw std::runtime_error("WSAStartup failed");
+    }
+
+    finishConnect();
+}
+
+void ClientSocket::finishConnect() {
     // Configure socket options (TCP_NODELAY for low latency)
     NetProtocol::ConfigureSocket(m_socket);
 
     // Set non-blocking mode - REQUIRED for GUI event loop
     // The FLTK event loop polls sockets periodically; blocking would freeze the UI
-    u_long mode = 1;
-    if (ioctlsocket(m_socket, FIONBIO, &mode) == SOCKET_ERROR) {
+    if (!NetProtocol::SetNonBlocking(m_socket)) {
         closesocket(m_socket);
-        WSACleanup();
+        NetProtocol::StopNetworking();
         throw std::runtime_error("Failed to set non-blocking mode");
     }
 
-    // Send username using legacy method (works with non-blocking)
-    // TODO: Migrate to secure protocol once we have proper async support
-    send(m_username);
+    // Negotiate the protocol version; the server admits us only after this
+    try {
+        performHandshake();
+    }
+    catch (...) {
+        closesocket(m_socket);
+        m_socket = INVALID_SOCKET;
+        NetProtocol::StopNetworking();
+        throw;
+    }
+    
+    // From here on the UI thread only queues; flushSends() does the writing
+    OutboundQueue::Limits limits;
+    limits.dropWatermark = MAX_QUEUED_SEND_BYTES;
+    limits.disconnectWatermark = MAX_QUEUED_SEND_BYTES;
+    m_outbound.SetLimits(limits);
+    m_queueSends = true;
     
     applyUserSettings();
 }
@@ -104,6 +147,9 @@ ClientSocket::ClientSocket(const std::string& ipAddress, int port, const std::st
  */
 ClientSocket::~ClientSocket() {
     if (m_socket != INVALID_SOCKET) {
+        if (m_queueSends) {
+            flushSends();   // Best effort: whatever the socket takes without waiting
+        }
         closesocket(m_socket);
     }
 }
@@ -112,10 +158,13 @@ ClientSocket::~ClientSocket() {
  * @brief Apply user-specific settings from the Settings class.
  */
 void ClientSocket::applyUserSettings() {
-    pugi::xml_node user = m_settings.findOrCreateClient(m_username);
+    if (!m_settings) {
+        return;     // Accepted connection: no local UI to configure
+    }
+    pugi::xml_node user = m_settings->findOrCreateClient(m_username);
 
     // Apply resolution from settings
-    std::tuple<int, int> resolution = m_settings.getRes(user);
+    std::tuple<int, int> resolution = m_settings->getRes(user);
     int width = std::get<0>(resolution);
     int height = std::get<1>(resolution);
 
@@ -125,7 +174,7 @@ void ClientSocket::applyUserSettings() {
     }
 
     // Apply dark mode
-    std::string mode = m_settings.getMode(user);
+    std::string mode = m_settings->getMode(user);
     if (mode == "true") {
         // Enable dark mode
         Fl::background(45, 45, 45);  // Dark background for main window
@@ -170,6 +219,8 @@ const std::string& ClientSocket::getUsername() const {
  * - Length prefix prevents message boundary confusion
  * - Maximum message size enforced
  * - Handles partial sends correctly
+ * - Deflated on v5 connections when large enough (FrameCompression.h)
+ * - Client connections queue rather than wait for a full socket buffer
  * 
  * @param message The message to send (max 64KB)
  * @return Result code indicating success or specific failure
@@ -179,7 +230,30 @@ NetProtocol::Result ClientSocket::sendSecure(const std::string& message) {
         return NetProtocol::Result::Disconnected;
     }
     
-    NetProtocol::Result result = NetProtocol::SendMessage(m_socket, message);
+    if (m_queueSends) {
+        if (message.size() > NetProtocol::MAX_MESSAGE_SIZE) {
+            return NetProtocol::Result::MessageTooLarge;
+        }
+        if (supportsCompression() && message.size() >= NetProtocol::COMPRESSION_THRESHOLD) {
+            if (!m_deflater) {
+                m_deflater = std::make_unique<NetProtocol::Deflater>();
+            }
+            return queueSend(m_deflater->Encode(message));
+        }
+        return queueSend(NetProtocol::FrameBuffer::Encode(message));
+    }
+    
+    NetProtocol::Result result;
+    if (supportsCompression() && message.size() >= NetProtocol::COMPRESSION_THRESHOLD &&
+        message.size() <= NetProtocol::MAX_MESSAGE_SIZE) {
+        if (!m_deflater) {
+            m_deflater = std::make_unique<NetProtocol::Deflater>();
+        }
+        result = NetProtocol::SendFrame(m_socket, m_deflater->Encode(message));
+    }
+    else {
+        result = NetProtocol::SendMessage(m_socket, message);
+    }
     
     if (result == NetProtocol::Result::Disconnected || 
         result == NetProtocol::Result::NetworkError) {
@@ -189,13 +263,59 @@ NetProtocol::Result ClientSocket::sendSecure(const std::string& message) {
     return result;
 }
 
+NetProtocol::Result ClientSocket::queueSend(NetProtocol::FrameBuffer frame) {
+    if (m_outbound.Enqueue(std::move(frame)) != OutboundQueue::EnqueueResult::Queued) {
+        LOG_WARNING("[NET] Send queue full (%zu bytes); frame refused", m_outbound.PendingBytes());
+        return NetProtocol::Result::WouldBlock;
+    }
+    if (m_batchDepth > 0) {
+        return NetProtocol::Result::Success;
+    }
+    
+    NetProtocol::Result result = flushSends();
+    return result == NetProtocol::Result::WouldBlock ? NetProtocol::Result::Success : result;
+}
+
+/**
+ * @brief Write queued frames without waiting
+ * 
+ * Each pass hands the kernel up to OutboundQueue::MAX_BATCH_BUFFERS
+ * frames in one gather send. A send that would block arms FD_WRITE, which
+ * brings the socket watcher back here once there is room.
+ */
+NetProtocol::Result ClientSocket::flushSends() {
+    if (m_closed) {
+        return NetProtocol::Result::Disconnected;
+    }
+    
+    NetProtocol::Result result = NetProtocol::Result::Success;
+    while (m_outbound.PrepareBatch(m_sendBuffers, m_sendKeepAlive) > 0) {
+        size_t sent = 0;
+        if (!NetProtocol::SendBuffers(m_socket, m_sendBuffers.data(), m_sendBuffers.size(), sent)) {
+            m_outbound.AbortInFlight();
+            if (NetProtocol::IsWouldBlock(NetProtocol::LastSocketError())) {
+                result = NetProtocol::Result::WouldBlock;
+            }
+            else {
+                m_closed = true;
+                m_outbound.Clear();
+                result = NetProtocol::Result::NetworkError;
+            }
+            break;
+        }
+        m_outbound.OnSent(sent);
+    }
+    m_sendKeepAlive.clear();
+    return result;
+}
+
 /**
  * @brief Receive a message using secure length-prefixed protocol
  * 
  * SECURITY FEATURES:
  * - Validates message length before allocation (prevents memory exhaustion)
  * - Handles partial reads correctly (prevents message corruption)
- * - Times out on slow/stalled connections
+ * - Never waits on a partial frame (slowloris-safe on non-blocking sockets)
  * 
  * WARNING: The returned message is ATTACKER-CONTROLLED.
  * You MUST validate the content before using it for:
@@ -214,16 +334,99 @@ NetProtocol::Result ClientSocket::receiveSecure(std::string& message) {
         return NetProtocol::Result::Disconnected;
     }
     
-    NetProtocol::Result result = NetProtocol::ReceiveMessage(m_socket, message);
+    return noteReceive(NetProtocol::ReceiveMessage(m_socket, m_decoder, message));
+}
+
+/**
+ * @brief receiveSecure() into a pooled block; see NetProtocol::PooledFrame
+ * 
+ * @param frame Output: the received message (empty on error)
+ * @return Result code indicating success or specific failure
+ */
+NetProtocol::Result ClientSocket::receiveSecure(NetProtocol::PooledFrame& frame) {
+    frame.clear();
+    
+    if (m_closed) {
+        return NetProtocol::Result::Disconnected;
+    }
     
+    return noteReceive(NetProtocol::ReceiveMessage(m_socket, m_decoder, frame));
+}
+
+NetProtocol::Result ClientSocket::noteReceive(NetProtocol::Result result) {
+    // A hostile length header poisons the stream; nothing after it can be trusted
     if (result == NetProtocol::Result::Disconnected || 
-        result == NetProtocol::Result::NetworkError) {
+        result == NetProtocol::Result::NetworkError ||
+        result == NetProtocol::Result::MessageTooLarge ||
+        result == NetProtocol::Result::InvalidLength) {
         m_closed = true;
+        m_closeReason = result;
     }
     
     return result;
 }
 
+/**
+ * @brief Opens the connection with a framed HELLO and waits for WELCOME
+ * 
+ * The socket is already non-blocking, so the reply is awaited with
+ * select() against a fixed deadline rather than a blocking recv.
+ * 
+ * @throws std::runtime_error on rejection, timeout or version mismatch
+ */
+void ClientSocket::performHandshake() {
+    NetProtocol::Result result = sendSecure(NetProtocol::BuildHello(NetProtocol::PROTOCOL_VERSION, m_username));
+    if (result != NetProtocol::Result::Success) {
+        throw std::runtime_error(std::string("Failed to send handshake: ") + NetProtocol::ResultToString(result));
+    }
+    
+    ULONGLONG deadline = GetTickCount64() + NetProtocol::HANDSHAKE_TIMEOUT_MS;
+    std::string reply;
+    
+    for (;;) {
+        result = receiveSecure(reply);
+        if (result == NetProtocol::Result::Success) {
+            break;
+        }
+        if (result != NetProtocol::Result::WouldBlock) {
+            throw std::runtime_error(std::string("Handshake failed: ") + NetProtocol::ResultToString(result));
+        }
+        
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline) {
+            throw std::runtime_error("Timed out waiting for server handshake");
+        }
+        
+        ULONGLONG remaining = deadline - now;
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(m_socket, &readable);
+        timeval timeout;
+        timeout.tv_sec = static_cast<long>(remaining / 1000);
+        timeout.tv_usec = static_cast<long>((remaining % 1000) * 1000);
+        select(0, &readable, nullptr, nullptr, &timeout);
+    }
+    
+    uint32_t version = 0;
+    if (!NetProtocol::ParseWelcome(reply, version)) {
+        // Rejections (name taken, bad version) arrive as [SERVER]: notices
+        if (reply.rfind("[SERVER]:", 0) == 0) {
+            throw std::runtime_error(reply);
+        }
+        throw std::runtime_error("Unexpected handshake reply from server");
+    }
+    
+    if (version < NetProtocol::MIN_PROTOCOL_VERSION || version > NetProtocol::PROTOCOL_VERSION) {
+        throw std::runtime_error("Server selected unsupported protocol version " + std::to_string(version));
+    }
+    
+    m_protocolVersion = version;
+    if (supportsCompression()) {
+        m_decoder.EnableCompression();
+    }
+    LOG_INFO("[NET] Connected using protocol version %u", m_protocolVersion);
+}
+
 //=============================================================================
 // LEGACY MESSAGE I/O (DEPRECATED - For backward compatibility only)
 //=============================================================================
@@ -241,6 +444,14 @@ NetProtocol::Result ClientSocket::receiveSecure(std::string& message) {
 void ClientSocket::send(const std::string& message) {
     // SECURITY NOTE: This legacy method is kept for backward compatibility
     // New code should use sendSecure() instead
+    if (m_queueSends) {
+        NetProtocol::Result result = m_closed ? NetProtocol::Result::Disconnected
+                                              : queueSend(NetProtocol::FrameBuffer::Raw(message));
+        if (result != NetProtocol::Result::Success) {
+            throw std::runtime_error(std::string("Failed to send data: ") + NetProtocol::ResultToString(result));
+        }
+        return;
+    }
     int bytes = ::send(m_socket, message.c_str(), static_cast<int>(message.length()), 0);
     if (bytes <= 0) {
         m_closed = true;
@@ -266,8 +477,8 @@ bool ClientSocket::receive(std::string& message) {
     int bytes = ::recv(m_socket, buffer, sizeof(buffer) - 1, 0);
 
     if (bytes == SOCKET_ERROR) {
-        int error = WSAGetLastError();
-        if (error != WSAEWOULDBLOCK && error != WSAETIMEDOUT) {
+        int error = NetProtocol::LastSocketError();
+        if (!NetProtocol::IsWouldBlock(error) && !NetProtocol::IsTimeout(error)) {
             m_closed = true;
         }
         return false;
@@ -282,27 +493,129 @@ bool ClientSocket::receive(std::string& message) {
 }
 
 /**
- * @brief Sends a username change request to the server and updates the local display.
- * @param newUsername The new username to set.
+ * @brief Sends a request with no payload and returns without waiting.
  */
-void ClientSocket::changeUsername(const std::string& newUsername) {
-    std::string command = "/change_username " + newUsername;
-    send(command);  // Send the command to the server
+uint32_t ClientSocket::sendRequestAsync(Protocol::RequestType type, ResponseHandler done) {
+    uint32_t requestId = m_requests.Register(std::move(done), GetTickCount64());
+    return finishAsyncSend(requestId, Protocol::Wire::EncodeRequest(type, requestId));
+}
 
-    // Update the local username immediately
-    setUsername(newUsername);
+uint32_t ClientSocket::finishAsyncSend(uint32_t requestId, const std::string& frame) {
+    NetProtocol::Result result = sendSecure(frame);
+    if (result != NetProtocol::Result::Success) {
+        LOG_WARNING("[NET] Request %u not sent: %s", requestId, NetProtocol::ResultToString(result));
+        m_requests.Cancel(requestId);
+        return 0;
+    }
+    return requestId;
+}
+
+uint32_t ClientSocket::requestMessageHistory(uint64_t channelId, uint64_t beforeMessageId, uint32_t limit,
+                                             ChunkHandler<Protocol::Payloads::MessageInfo> done) {
+    Protocol::Payloads::GetMessageHistoryRequest request;
+    request.channelId = channelId;
+    request.beforeMessageId = beforeMessageId;
+    request.limit = limit;
+    return sendRequestAsync(Protocol::RequestType::GetMessageHistory, request,
+                            decodeChunks(Protocol::ResponseType::MessageHistory, std::move(done)));
+}
+
+uint32_t ClientSocket::requestHistorySync(uint64_t channelId, uint64_t afterMessageId, uint32_t limit,
+                                         ChunkHandler<Protocol::Payloads::MessageInfo> done) {
+    Protocol::Payloads::SyncHistoryRequest request;
+    request.channelId = channelId;
+    request.afterMessageId = afterMessageId;
+    request.limit = limit;
+    return sendRequestAsync(Protocol::RequestType::SyncHistory, request,
+                            decodeChunks(Protocol::ResponseType::MessageHistory, std::move(done)));
+}
 
-    // Optionally, you can listen for a confirmation from the server to update the UI
-    std::string response;
-    if (receive(response)) {
-        if (response == "USERNAME_CHANGED") {
-            fl_alert("Your username has been successfully changed to '%s'.", newUsername.c_str());
+uint32_t ClientSocket::requestServerMetrics(MetricsHandler done) {
+    return sendRequestAsync(Protocol::RequestType::GetServerMetrics,
+        [done = std::move(done)](Protocol::ErrorCode error, const Protocol::Wire::EnvelopeView& response) {
+            std::string_view json;
+            if (error == Protocol::ErrorCode::None) {
+                Protocol::Wire::Reader reader(response.payload);
+                if (response.type != static_cast<uint8_t>(Protocol::ResponseType::ServerMetrics) ||
+                    !reader.GetString(json) || !reader.Finished()) {
+                    error = Protocol::ErrorCode::InternalError;
+                    json = std::string_view();
+                }
+            }
+            done(error, std::string(json));
+        });
+}
+
+uint32_t ClientSocket::requestServerLocation(uint64_t serverId, LocationHandler done) {
+    Protocol::Payloads::LocateServerRequest request;
+    request.serverId = serverId;
+    return sendRequestAsync(Protocol::RequestType::LocateServer, request,
+        [done = std::move(done)](Protocol::ErrorCode error, const Protocol::Wire::EnvelopeView& response) {
+            Protocol::Payloads::ServerLocation location{};
+            if (error == Protocol::ErrorCode::None &&
+                (response.type != static_cast<uint8_t>(Protocol::ResponseType::ServerLocation) ||
+                 !Protocol::Wire::ReadPayload(response.payload, location))) {
+                error = Protocol::ErrorCode::InternalError;
+            }
+            done(error, location);
+        });
+}
+
+uint32_t ClientSocket::requestAttachment(const Protocol::Payloads::AttachmentRequest& request, AttachmentHandler done) {
+    return sendRequestAsync(Protocol::RequestType::RequestAttachment, request,
+        [done = std::move(done)](Protocol::ErrorCode error, const Protocol::Wire::EnvelopeView& response) {
+            Protocol::Payloads::AttachmentTicket ticket{};
+            if (error == Protocol::ErrorCode::None &&
+                (response.type != static_cast<uint8_t>(Protocol::ResponseType::AttachmentTicket) ||
+                 !Protocol::Wire::ReadPayload(response.payload, ticket))) {
+                error = Protocol::ErrorCode::InternalError;
+            }
+            done(error, ticket);
+        });
+}
+
+bool ClientSocket::handleResponse(const std::string& frame) {
+    // Pushes carry requestId 0, which the pipeline never hands out
+    Protocol::Wire::EnvelopeView push;
+    if (supportsPresence() && !frame.empty() &&
+        static_cast<uint8_t>(frame[0]) == Protocol::Wire::RESPONSE_MARKER &&
+        Protocol::Wire::DecodeEnvelope(frame, push) && push.requestId == 0 &&
+        (push.type == static_cast<uint8_t>(Protocol::ResponseType::UserOnline) ||
+         push.type == static_cast<uint8_t>(Protocol::ResponseType::UserOffline))) {
+        Protocol::Payloads::PresenceUpdate update;
+        if (!Protocol::Wire::ReadPayload(push.payload, update)) {
+            LOG_WARNING("[NET] Dropping malformed presence push");
         }
-        else if (response == "USERNAME_TAKEN") {
-            // Handle failure case (username already taken, invalid, etc.)
-            fl_alert("Failed to change username. The username '%s' is already taken. Please try again.", newUsername.c_str());
+        else if (m_presenceHandler) {
+            m_presenceHandler(update.username, push.type == static_cast<uint8_t>(Protocol::ResponseType::UserOnline));
         }
+        return true;
+    }
+    return m_requests.Complete(frame, GetTickCount64());
+}
+
+/**
+ * @brief Sends a username change request to the server and updates the local display.
+ * @param newUsername The new username to set.
+ */
+void ClientSocket::changeUsername(const std::string& newUsername) {
+    NetProtocol::Result result;
+    if (supportsEnvelopes()) {
+        Protocol::Payloads::UpdateProfileRequest request;
+        request.username = newUsername;
+        result = sendRequest(Protocol::RequestType::UpdateProfile, request);
+    }
+    else {
+        result = sendSecure("/change_username " + newUsername);  // Version 1 text command
     }
+    if (result != NetProtocol::Result::Success) {
+        throw std::runtime_error(std::string("Failed to send data: ") + NetProtocol::ResultToString(result));
+    }
+
+    // Update the local username immediately. The outcome arrives as a
+    // [SERVER]: notice on the normal message stream; reading it here would
+    // steal whatever frame happens to be next.
+    setUsername(newUsername);
 }
 
 /**
@@ -330,7 +643,10 @@ void ClientSocket::removingPlayer(const std::string& username) {
  * @brief Update the user's resolution settings.
  */
 void ClientSocket::updateResolution(int width, int height) {
-    m_settings.setRes(m_username, width, height);
+    if (!m_settings) {
+        return;
+    }
+    m_settings->setRes(m_username, width, height);
     fl_message("Resolution updated to: %dx%d", width, height);
 }
 
@@ -338,10 +654,13 @@ void ClientSocket::updateResolution(int width, int height) {
  * @brief Toggle the user's dark mode setting.
  */
 void ClientSocket::toggleDarkMode() {
-    pugi::xml_node user = m_settings.findOrCreateClient(m_username);
-    std::string currentMode = m_settings.getMode(user);
+    if (!m_settings) {
+        return;
+    }
+    pugi::xml_node user = m_settings->findOrCreateClient(m_username);
+    std::string currentMode = m_settings->getMode(user);
     std::string newMode = (currentMode == "true") ? "false" : "true";
-    m_settings.setMode(m_username, newMode);
+    m_settings->setMode(m_username, newMode);
     fl_message("Dark mode toggled to: %s", newMode.c_str());
 }
 
@@ -392,8 +711,8 @@ bool ClientSocket::receive(std::string& sender, std::string& message) {
     int bytes = ::recv(m_socket, buffer, sizeof(buffer) - 1, 0);
     
     if (bytes == SOCKET_ERROR) {
-        int error = WSAGetLastError();
-        if (error != WSAEWOULDBLOCK && error != WSAETIMEDOUT) {
+        int error = NetProtocol::LastSocketError();
+        if (!NetProtocol::IsWouldBlock(error) && !NetProtocol::IsTimeout(error)) {
             m_closed = true;
         }
         return false;
@@ -7,21 +7,38 @@
  * 
  * SECURITY NOTES:
  * - All network I/O now uses NetProtocol for length-prefixed framing
+ * - Connections open with a HELLO/WELCOME version handshake
  * - Maximum message sizes are enforced
  * - Partial reads/writes are handled correctly
  * 
+ * CLIENT SENDS:
+ * Once connected, sendSecure() only queues the frame (OutboundQueue) and
+ * writes what the socket takes without waiting; the rest goes out from
+ * flushSends() when the socket becomes writable. A congested uplink
+ * therefore never stalls the UI thread. The queue is bounded by
+ * MAX_QUEUED_SEND_BYTES, beyond which sends are refused with WouldBlock.
+ * 
  * TRUST BOUNDARY:
  * Data received via receive() is ATTACKER-CONTROLLED.
  * Always validate before use.
  */
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <stdexcept>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include <vector>
+#include "NetPlatform.h"
 #include "PlayerDisplay.hpp"
 #include "Settings.h"
+#include "ServerConfig.h"
 #include "NetProtocol.h"
+#include "FrameCompression.h"
+#include "OutboundQueue.h"
+#include "TokenBucket.h"
+#include "RequestPipeline.h"
+#include "SlotMap.h"
+#include "ProtocolCodec.h"
 #include <tuple>
 
 class MainWindow;
@@ -29,9 +46,13 @@ class MainWindow;
 class ClientSocket {
 public:
     // Constructors
-    explicit ClientSocket(SOCKET socket, PlayerDisplay* playerDisplay, const std::string& settings);
+    // Server side: an accepted connection shares the server's parsed config
+    ClientSocket(SOCKET socket, PlayerDisplay* playerDisplay, std::shared_ptr<const ServerConfig> config);
     ClientSocket(const std::string& ipAddress, int port, const std::string& username,
         PlayerDisplay* playerDisplay, const std::string& settings, MainWindow* mainWindow);
+    // Client side, over a socket a Connector already connected (owned from here, even on throw)
+    ClientSocket(SOCKET connected, const std::string& username,
+        PlayerDisplay* playerDisplay, const std::string& settings, MainWindow* mainWindow);
 
     // Destructor
     ~ClientSocket();
@@ -48,8 +69,53 @@ public:
      */
     NetProtocol::Result sendSecure(const std::string& message);
     
+    // =========================================================================
+    // QUEUED SENDS (client side, after the handshake)
+    // =========================================================================
+    
+    /** Unsent bytes a client queues before refusing more */
+    static constexpr size_t MAX_QUEUED_SEND_BYTES = 1024 * 1024;
+    
+    /**
+     * @brief Write queued frames until the socket would block
+     * 
+     * Call when the socket is writable. Frames queued together leave in
+     * one scatter/gather write.
+     * 
+     * @return Success once the queue is empty, WouldBlock if bytes remain
+     */
+    NetProtocol::Result flushSends();
+    
+    /** @brief True while queued frames are waiting for the socket */
+    bool sending() const { return m_outbound.HasPending(); }
+    
+    size_t pendingSendBytes() const { return m_outbound.PendingBytes(); }
+    
+    /**
+     * @brief Hold back writes while several frames are queued, then send
+     *        them together (nests; the outermost batch flushes)
+     */
+    class SendBatch {
+    public:
+        explicit SendBatch(ClientSocket& socket) : m_socket(socket) { ++m_socket.m_batchDepth; }
+        ~SendBatch() {
+            if (--m_socket.m_batchDepth == 0) {
+                m_socket.flushSends();
+            }
+        }
+    private:
+        ClientSocket& m_socket;
+        SendBatch(const SendBatch&) = delete;
+        SendBatch& operator=(const SendBatch&) = delete;
+    };
+    
     /**
      * @brief Receive a message using secure length-prefixed protocol
+     * 
+     * Runs on this connection's FrameDecoder: partially received frames
+     * stay buffered and yield WouldBlock, so the call never stalls.
+     * Call repeatedly until WouldBlock to drain every buffered frame.
+     * 
      * @param message Output: the received message
      * @return NetProtocol::Result indicating success or failure type
      * 
@@ -57,6 +123,148 @@ public:
      * Validate all content before use.
      */
     NetProtocol::Result receiveSecure(std::string& message);
+    
+    /**
+     * @brief receiveSecure() into a pooled block, so a steady stream of
+     *        frames does not allocate (the server's receive path)
+     */
+    NetProtocol::Result receiveSecure(NetProtocol::PooledFrame& frame);
+    
+    /**
+     * @brief True if the negotiated protocol carries binary request envelopes
+     */
+    bool supportsEnvelopes() const { return m_protocolVersion >= NetProtocol::ENVELOPE_PROTOCOL_VERSION; }
+
+    /**
+     * @brief True if both ends expect Heartbeat requests on an idle connection
+     */
+    bool sendsHeartbeats() const { return m_protocolVersion >= NetProtocol::HEARTBEAT_PROTOCOL_VERSION; }
+
+    /**
+     * @brief True if frames in either direction may be deflated
+     */
+    bool supportsCompression() const { return m_protocolVersion >= NetProtocol::COMPRESSION_PROTOCOL_VERSION; }
+
+    /**
+     * @brief Send a request as a binary envelope (requires supportsEnvelopes())
+     * @param type Request type
+     * @param payload One of the Protocol::Payloads request structs
+     */
+    template <typename Payload>
+    NetProtocol::Result sendRequest(Protocol::RequestType type, const Payload& payload) {
+        return sendSecure(Protocol::Wire::EncodeRequest(type, Protocol::GenerateRequestId(), payload));
+    }
+    
+    /** @brief sendRequest() for requests without a payload */
+    NetProtocol::Result sendRequest(Protocol::RequestType type) {
+        return sendSecure(Protocol::Wire::EncodeRequest(type, Protocol::GenerateRequestId()));
+    }
+
+    // =========================================================================
+    // PIPELINED REQUESTS (protocol v4)
+    // Any number may be in flight; each completes when the response with
+    // its requestId arrives. Completions run on the thread that calls
+    // handleResponse()/expireRequests(), never inside the send call, and
+    // are dropped uncalled if the socket is destroyed first.
+    // =========================================================================
+    
+    /**
+     * @brief True if the server answers data requests with response envelopes
+     */
+    bool supportsPipelining() const { return m_protocolVersion >= NetProtocol::PIPELINE_PROTOCOL_VERSION; }
+    
+    /**
+     * @brief True if the server streams long lists in chunks
+     */
+    bool supportsStreaming() const { return m_protocolVersion >= NetProtocol::STREAMING_PROTOCOL_VERSION; }
+    
+    /**
+     * @brief True if the server sends only the history after a cursor
+     */
+    bool supportsHistorySync() const { return m_protocolVersion >= NetProtocol::HISTORY_SYNC_PROTOCOL_VERSION; }
+    
+    /**
+     * @brief True if the server answers LocateServer
+     */
+    bool supportsSharding() const { return m_protocolVersion >= NetProtocol::SHARDING_PROTOCOL_VERSION; }
+    
+    /**
+     * @brief True if presence arrives as UserOnline/UserOffline pushes rather than text lines
+     */
+    bool supportsPresence() const { return m_protocolVersion >= NetProtocol::PRESENCE_PROTOCOL_VERSION; }
+    
+    /**
+     * @brief True if the server hands out attachment tickets
+     */
+    bool supportsAttachments() const { return m_protocolVersion >= NetProtocol::ATTACHMENT_PROTOCOL_VERSION; }
+    
+    using ResponseHandler = RequestPipeline::Completion;
+    
+    /**
+     * Completion for a streamed list, run once per chunk as it arrives;
+     * last is true on the final call (always, after an error). A server
+     * older than v6 answers with the whole list as one final chunk.
+     */
+    template <typename Item>
+    using ChunkHandler = std::function<void(Protocol::ErrorCode error, std::vector<Item>& items, bool last)>;
+    
+    /**
+     * @brief Send a request without waiting for its response
+     * @return The requestId, or 0 if the send failed (done is then never called)
+     */
+    template <typename Payload>
+    uint32_t sendRequestAsync(Protocol::RequestType type, const Payload& payload, ResponseHandler done) {
+        uint32_t requestId = m_requests.Register(std::move(done), GetTickCount64());
+        return finishAsyncSend(requestId, Protocol::Wire::EncodeRequest(type, requestId, payload));
+    }
+    
+    /** @brief sendRequestAsync() for requests without a payload */
+    uint32_t sendRequestAsync(Protocol::RequestType type, ResponseHandler done);
+    
+    /** Streamed from v6: the newest messages come first, each chunk oldest-first within itself */
+    uint32_t requestMessageHistory(uint64_t channelId, uint64_t beforeMessageId, uint32_t limit,
+                                   ChunkHandler<Protocol::Payloads::MessageInfo> done);
+    
+    /** v7: the oldest messages after afterMessageId, streamed oldest first; empty once caught up */
+    uint32_t requestHistorySync(uint64_t channelId, uint64_t afterMessageId, uint32_t limit,
+                                ChunkHandler<Protocol::Payloads::MessageInfo> done);
+    
+    /** Completion for GetServerMetrics; json is empty unless error is None */
+    using MetricsHandler = std::function<void(Protocol::ErrorCode error, const std::string& json)>;
+    
+    /** @brief Fetch the server's metrics snapshot (answered for loopback connections only) */
+    uint32_t requestServerMetrics(MetricsHandler done);
+    
+    /** Completion for LocateServer; location is only meaningful if error is None */
+    using LocationHandler = std::function<void(Protocol::ErrorCode error, const Protocol::Payloads::ServerLocation& location)>;
+    
+    /** @brief v8: ask which node serves a server (empty nodeId = the server's own recorded host) */
+    uint32_t requestServerLocation(uint64_t serverId, LocationHandler done);
+    
+    /** Completion for RequestAttachment; ticket is only meaningful if error is None */
+    using AttachmentHandler = std::function<void(Protocol::ErrorCode error, const Protocol::Payloads::AttachmentTicket& ticket)>;
+    
+    /** @brief v10: ticket to move an attachment over the transfer port (see AttachmentTransfer) */
+    uint32_t requestAttachment(const Protocol::Payloads::AttachmentRequest& request, AttachmentHandler done);
+    
+    /** Called for each presence push: online is false for UserOffline */
+    using PresenceHandler = std::function<void(const std::string& username, bool online)>;
+    
+    /** @brief v9: receive presence pushes (they are dropped while no handler is set) */
+    void setPresenceHandler(PresenceHandler handler) { m_presenceHandler = std::move(handler); }
+    
+    /**
+     * @brief Complete the request a received frame answers, or deliver a presence push
+     * @return True if the frame was a response envelope (the caller should not display it)
+     */
+    bool handleResponse(const std::string& frame);
+    
+    /**
+     * @brief Time out requests whose response is overdue
+     */
+    size_t expireRequests() { return m_requests.Expire(GetTickCount64()); }
+    
+    size_t requestsInFlight() const { return m_requests.InFlight(); }
 
     // =========================================================================
     // LEGACY METHODS (deprecated - use sendSecure/receiveSecure)
@@ -84,21 +292,118 @@ public:
     void toggleDarkMode();
     bool closed() const;
     
+    /**
+     * @brief Protocol version agreed in the handshake (0 = not negotiated yet)
+     */
+    uint32_t protocolVersion() const { return m_protocolVersion; }
+    
     /**
      * @brief Get the underlying socket (use with caution)
      * @return The raw SOCKET handle
      */
     SOCKET getSocket() const { return m_socket; }
 
-    Settings m_settings;
     PlayerDisplay* playerDisplay;
 
 private:
     friend struct ServerSocket;
     SOCKET m_socket;
     bool m_closed;
+    uint32_t m_protocolVersion;
+    NetProtocol::FrameDecoder m_decoder;   // Partial-frame state for receiveSecure()
+    std::unique_ptr<NetProtocol::Deflater> m_deflater;   // Client side: created by the first large send
+    OutboundQueue m_outbound;              // Pending sends for this connection
+    
+    // Client side: sends go through m_outbound once the handshake is done
+    bool m_queueSends = false;
+    unsigned m_batchDepth = 0;             // Open SendBatch scopes
+    std::vector<WSABUF> m_sendBuffers;     // Reused by flushSends()
+    std::vector<OutboundQueue::Buffer> m_sendKeepAlive;
+    
+    // Server side: inbound rate limits, checked before a frame is parsed.
+    // Bytes are per connection; the message budget belongs to the user and
+    // is saved by the server across reconnects.
+    TokenBucket m_byteBudget;
+    TokenBucket m_messageBudget;
+    uint32_t m_rejectedFrames = 0;         // Consecutive frames refused by a limit
+    
+    // Server side: this connection's entry in ServerSocket's table
+    SlotHandle m_slot;
+    
+    // Server side: the admitted user's ID (0 = not registered, or no user database)
+    uint64_t m_userId = 0;
+    
+    // Server side: m_userId was proven by a login rather than claimed in
+    // HELLO. No login exists on this protocol yet, so it stays false
+    bool m_authenticated = false;
+    
+    // Server side: a ShardBus link from another node rather than a user
+    bool m_isPeer = false;
+    std::string m_peerNode;                // Its node id; cleared once a newer link replaces it
+    std::vector<uint8_t> m_peerChallenge;  // Nonce sent to a claimed node, until it proves the secret
+    
+    // Server side: why the connection was closed (Success = by server policy)
+    NetProtocol::Result m_closeReason = NetProtocol::Result::Success;
+    
+    // Client side: requests sent with sendRequestAsync() awaiting responses
+    RequestPipeline m_requests;
+    PresenceHandler m_presenceHandler;
     std::string m_username;
     MainWindow* mainWindow;
+    
+    // Client side only: this user's UI settings. Accepted connections
+    // never touch settings files; they only see the shared server config.
+    std::unique_ptr<Settings> m_settings;
+    std::shared_ptr<const ServerConfig> m_serverConfig;
+    
+    /**
+     * @brief Send HELLO and wait (bounded) for the server's WELCOME
+     * @throws std::runtime_error on rejection, timeout or version mismatch
+     */
+    void performHandshake();
+    
+    /** @brief Close on any receive result that leaves the stream unusable */
+    NetProtocol::Result noteReceive(NetProtocol::Result result);
+    
+    /**
+     * @brief Configure the connected socket, handshake and apply settings
+     * @throws std::runtime_error after closing the socket and releasing Winsock
+     */
+    void finishConnect();
+    
+    /**
+     * @brief Queue a frame on a client connection and write what the socket takes
+     * @return Success once queued, WouldBlock if the queue is full
+     */
+    NetProtocol::Result queueSend(NetProtocol::FrameBuffer frame);
+    
+    /**
+     * @brief Send a registered request's frame; unregister it if the send fails
+     */
+    uint32_t finishAsyncSend(uint32_t requestId, const std::string& frame);
+    
+    /**
+     * @brief Adapt a ChunkHandler to a ResponseHandler that decodes each chunk
+     *        as the expected list type; a chunk that fails to decode ends the
+     *        stream for the handler
+     */
+    template <typename Item>
+    static ResponseHandler decodeChunks(Protocol::ResponseType expected, ChunkHandler<Item> done) {
+        return [expected, done = std::move(done), failed = false](Protocol::ErrorCode error,
+                                                                  const Protocol::Wire::EnvelopeView& response) mutable {
+            if (failed) {
+                return;
+            }
+            std::vector<Item> items;
+            if (error == Protocol::ErrorCode::None &&
+                (response.type != static_cast<uint8_t>(expected) ||
+                 !Protocol::Wire::ReadPayload(response.payload, items))) {
+                error = Protocol::ErrorCode::InternalError;
+            }
+            failed = error != Protocol::ErrorCode::None;
+            done(error, items, failed || !response.more);
+        };
+    }
 };
 
 #endif // CLIENTSOCKET_H
@@ -0,0 +1,174 @@
+/**
+ * @file Connector.cpp
+ * @brief Implementation of the off-thread connect with a deadline
+ */
+
+#include "Connector.h"
+#include "AddressResolver.h"
+#include "UiDispatcher.h"
+#include "Trace.h"
+#include "Log.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+/** Longest single wait, so a cancel is noticed promptly */
+constexpr ULONGLONG CONNECT_POLL_MS = 100;
+
+} // namespace
+
+Connector::Connector(const std::string& host, int port, Completion done, DWORD timeoutMs)
+    : m_state(std::make_shared<State>())
+    , m_done(std::move(done))
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        throw std::runtime_error("WSAStartup failed");
+    }
+    m_thread = std::thread(&Connector::Run, this, host, port, timeoutMs);
+}
+
+Connector::~Connector() {
+    Cancel();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    WSACleanup();
+}
+
+void Connector::Cancel() {
+    m_state->cancelled = true;
+}
+
+void Connector::Run(std::string host, int port, DWORD timeoutMs) {
+    Trace::SetThreadName("connector");
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+
+    SOCKET connected = INVALID_SOCKET;
+    std::string error;
+    std::vector<in_addr> addresses;
+    if (!AddressResolver::Resolve(host, addresses)) {
+        error = "Could not resolve " + host;
+    }
+    else if (GetTickCount64() >= deadline) {
+        error = "Timed out resolving " + host;
+    }
+    else {
+        connected = connectAny(addresses, port, deadline, error);
+    }
+
+    // The completion owns the socket from here; if the attempt was
+    // abandoned meanwhile, it closes the socket instead
+    std::shared_ptr<State> state = m_state;
+    Completion done = m_done;
+    UiDispatcher::Post([state, done, connected, error]() {
+        if (state->cancelled) {
+            if (connected != INVALID_SOCKET) {
+                closesocket(connected);
+            }
+            return;
+        }
+        done(connected, error);
+    });
+}
+
+SOCKET Connector::connectAny(const std::vector<in_addr>& addresses, int port, ULONGLONG deadline, std::string& error) {
+    struct Attempt {
+        SOCKET socket;
+        in_addr address;
+    };
+    std::vector<Attempt> attempts;
+    int lastError = 0;
+
+    for (const in_addr& address : addresses) {
+        if (attempts.size() == MAX_PARALLEL_ATTEMPTS) {
+            break;
+        }
+        SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == INVALID_SOCKET) {
+            lastError = WSAGetLastError();
+            continue;
+        }
+        u_long nonBlocking = 1;
+        ioctlsocket(s, FIONBIO, &nonBlocking);
+
+        sockaddr_in target = {};
+        target.sin_family = AF_INET;
+        target.sin_port = htons(static_cast<u_short>(port));
+        target.sin_addr = address;
+        if (connect(s, reinterpret_cast<sockaddr*>(&target), sizeof(target)) == 0 ||
+            WSAGetLastError() == WSAEWOULDBLOCK) {
+            attempts.push_back({ s, address });
+        }
+        else {
+            lastError = WSAGetLastError();
+            closesocket(s);
+        }
+    }
+
+    SOCKET winner = INVALID_SOCKET;
+    while (winner == INVALID_SOCKET && !attempts.empty() && !m_state->cancelled) {
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline) {
+            break;
+        }
+        ULONGLONG slice = (std::min)(deadline - now, CONNECT_POLL_MS);
+
+        // Windows reports a finished connect as writable, a failed one in
+        // the exception set
+        fd_set writable;
+        fd_set failed;
+        FD_ZERO(&writable);
+        FD_ZERO(&failed);
+        for (const Attempt& attempt : attempts) {
+            FD_SET(attempt.socket, &writable);
+            FD_SET(attempt.socket, &failed);
+        }
+        timeval timeout = { static_cast<long>(slice / 1000), static_cast<long>((slice % 1000) * 1000) };
+        if (select(0, nullptr, &writable, &failed, &timeout) == SOCKET_ERROR) {
+            lastError = WSAGetLastError();
+            break;
+        }
+
+        for (auto it = attempts.begin(); it != attempts.end();) {
+            if (winner == INVALID_SOCKET && FD_ISSET(it->socket, &writable)) {
+                winner = it->socket;
+                it = attempts.erase(it);
+            }
+            else if (FD_ISSET(it->socket, &failed)) {
+                int socketError = 0;
+                int length = sizeof(socketError);
+                getsockopt(it->socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&socketError), &length);
+                lastError = socketError;
+                closesocket(it->socket);
+                it = attempts.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    // Losers and attempts still pending at the deadline
+    for (const Attempt& attempt : attempts) {
+        closesocket(attempt.socket);
+    }
+
+    if (winner != INVALID_SOCKET) {
+        u_long blocking = 0;
+        ioctlsocket(winner, FIONBIO, &blocking);
+        return winner;
+    }
+    if (m_state->cancelled) {
+        error = "Cancelled";
+    }
+    else if (GetTickCount64() >= deadline) {
+        error = "Timed out connecting";
+    }
+    else {
+        error = "Failed to connect to server (error " + std::to_string(lastError) + ")";
+    }
+    LOG_WARNING("[NET] Connect failed: %s", error.c_str());
+    return INVALID_SOCKET;
+}
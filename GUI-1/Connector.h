@@ -0,0 +1,89 @@
+#ifndef CONNECTOR_H
+#define CONNECTOR_H
+
+/**
+ * @file Connector.h
+ * @brief Outbound TCP connection made off the UI thread, with a deadline
+ *
+ * PURPOSE:
+ * ClientSocket used to call a blocking connect() on the UI thread, so an
+ * unreachable host froze the window for the whole SYN timeout (about 21
+ * seconds on Windows). A Connector resolves and connects on its own
+ * thread and hands the connected socket back through UiDispatcher; the
+ * UI keeps running and can show progress or cancel meanwhile.
+ *
+ * DESIGN:
+ * - The host is resolved through AddressResolver (cached)
+ * - Up to MAX_PARALLEL_ATTEMPTS addresses are tried at once with
+ *   non-blocking connects; the first to complete wins and the others are
+ *   closed, so one dead address costs nothing when another one answers
+ * - The whole attempt, resolution included, is bounded by the timeout
+ * - Cancelling (or destroying the Connector) drops the completion; a
+ *   socket that connected anyway is closed rather than leaked
+ *
+ * THREADING:
+ * Create, cancel and destroy on the UI thread; the completion runs there
+ * too. Fl::lock() must be enabled (see UiDispatcher.h).
+ */
+
+#include <winsock2.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Connector {
+public:
+    /** Default bound on resolving and connecting together */
+    static constexpr DWORD DEFAULT_TIMEOUT_MS = 5000;
+
+    /** Addresses of one host tried at the same time */
+    static constexpr size_t MAX_PARALLEL_ATTEMPTS = 4;
+
+    /**
+     * Run on the UI thread once the attempt ends. On success socket is a
+     * connected, blocking socket the callee now owns; on failure it is
+     * INVALID_SOCKET and error says why.
+     */
+    using Completion = std::function<void(SOCKET socket, const std::string& error)>;
+
+    /**
+     * @brief Start connecting at once
+     * @param host Name or dotted IPv4 address
+     * @param port TCP port
+     * @param done Completion, run exactly once unless cancelled first
+     * @param timeoutMs Bound on the whole attempt
+     */
+    Connector(const std::string& host, int port, Completion done, DWORD timeoutMs = DEFAULT_TIMEOUT_MS);
+
+    /** Cancels and waits for the worker (at most one select slice) */
+    ~Connector();
+
+    /** @brief Abandon the attempt; the completion will not run */
+    void Cancel();
+
+private:
+    // Shared with posted completions, which may outlive the Connector
+    struct State {
+        std::atomic<bool> cancelled{ false };
+    };
+
+    std::shared_ptr<State> m_state;
+    Completion m_done;
+    std::thread m_thread;
+
+    void Run(std::string host, int port, DWORD timeoutMs);
+
+    /**
+     * @brief Race non-blocking connects to the addresses until one completes
+     * @return The winner, or INVALID_SOCKET with error set
+     */
+    SOCKET connectAny(const std::vector<in_addr>& addresses, int port, ULONGLONG deadline, std::string& error);
+
+    Connector(const Connector&) = delete;
+    Connector& operator=(const Connector&) = delete;
+};
+
+#endif // CONNECTOR_H
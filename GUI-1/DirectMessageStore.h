@@ -0,0 +1,86 @@
+#ifndef DIRECT_MESSAGE_STORE_H
+#define DIRECT_MESSAGE_STORE_H
+
+/**
+ * @file DirectMessageStore.h
+ * @brief Persistent direct messages, kept apart from channel history
+ *
+ * PURPOSE:
+ * Whispers used to exist only on the wire: a recipient who was offline
+ * got "not found" and the message was gone. Direct messages are now kept
+ * apart from channel history (MessageService), so sending one never
+ * touches a channel's ring, spill or compaction.
+ *
+ * STORAGE:
+ * One MessageLog of its own. Every direct message is one record whose
+ * channelId is ConversationId(sender, recipient), so a conversation is
+ * the set of records with that id whichever side sent them; recipientId
+ * is UserKey(recipient).
+ *
+ * NO OFFLINE QUEUE:
+ * Only delivered messages are stored. Connections are not logged in (a
+ * HELLO name is a claim), so a message held for an offline user could
+ * only be handed to whoever next claimed the name. Queued records that
+ * older builds wrote are replayed as plain messages and never delivered.
+ *
+ * COST:
+ * Sending costs one buffered append; the persistence worker flushes the
+ * log once per commit window. Nothing is ever rewritten except after a
+ * torn tail, when the intact records are written to a fresh generation.
+ *
+ * NAMES:
+ * Callers pass usernames already case-folded (as ServerSocket indexes
+ * them), so "Alice" and "alice" share one conversation.
+ *
+ * THREADING:
+ * All public methods are thread-safe (one mutex, shared with the
+ * persistence worker's flush).
+ */
+
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "MessageLog.h"
+#include "PersistenceWorker.h"
+
+class DirectMessageStore {
+public:
+    static constexpr const char* DEFAULT_PATH = "direct_messages.log";
+
+    explicit DirectMessageStore(const std::string& path = DEFAULT_PATH);
+
+    /** Flushes the log */
+    ~DirectMessageStore();
+
+    /** @brief Id of the conversation between two folded names, whichever of them sends */
+    static uint64_t ConversationId(std::string_view a, std::string_view b);
+
+    /** @brief Stable 64-bit id of a folded username */
+    static uint64_t UserKey(std::string_view foldedName);
+
+    /**
+     * @brief Record a message that was delivered live
+     * @return The message id
+     */
+    uint64_t Record(const std::string& senderName, std::string_view senderKey,
+                    std::string_view recipientKey, std::string_view content);
+
+private:
+    mutable std::mutex m_mutex;
+    MessageLog m_log;
+    uint64_t m_nextMessageId;
+    PersistenceWorker::Handle m_persistence;
+
+    /** Build and append one message record; returns its id (0 if the write failed) */
+    uint64_t appendLocked(MessageLog::RecordType type, const std::string& senderName, std::string_view senderKey,
+                          std::string_view recipientKey, std::string_view content, std::time_t timestamp);
+
+    void load();
+
+    DirectMessageStore(const DirectMessageStore&) = delete;
+    DirectMessageStore& operator=(const DirectMessageStore&) = delete;
+};
+
+#endif // DIRECT_MESSAGE_STORE_H
@@ -0,0 +1,229 @@
+/**
+ * @file EpollBackend.cpp
+ * @brief Implementation of the epoll event backend
+ */
+
+#ifdef __linux__
+
+#include "EpollBackend.h"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+EpollBackend::EpollBackend(SOCKET listenSocket)
+    : m_epoll(epoll_create1(EPOLL_CLOEXEC))
+    , m_wakeEvent(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , m_listenSocket(listenSocket)
+{
+    bool ok = m_epoll != -1 && m_wakeEvent != -1 && NetProtocol::SetNonBlocking(listenSocket);
+    if (ok) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = m_wakeEvent;
+        ok = epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeEvent, &event) == 0;
+    }
+    if (ok) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = listenSocket;
+        ok = epoll_ctl(m_epoll, EPOLL_CTL_ADD, listenSocket, &event) == 0;
+    }
+    if (!ok) {
+        int error = errno;
+        if (m_epoll != -1) {
+            close(m_epoll);
+        }
+        if (m_wakeEvent != -1) {
+            close(m_wakeEvent);
+        }
+        throw std::runtime_error("Failed to set up epoll: " + std::to_string(error));
+    }
+}
+
+EpollBackend::~EpollBackend() {
+    close(m_wakeEvent);
+    close(m_epoll);
+}
+
+bool EpollBackend::Associate(SOCKET clientSocket) {
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.fd = clientSocket;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, clientSocket, &event) != 0) {
+        return false;
+    }
+    m_connections[clientSocket] = Connection();
+    return true;
+}
+
+bool EpollBackend::Rearm(SOCKET clientSocket) {
+    auto found = m_connections.find(clientSocket);
+    if (found == m_connections.end()) {
+        return false;
+    }
+    found->second.readArmed = true;
+    return updateInterest(clientSocket, found->second);
+}
+
+/**
+ * Renew the one-shot registration with whatever the connection still
+ * waits for; with nothing to wait for it stays disabled.
+ */
+bool EpollBackend::updateInterest(SOCKET socket, Connection& connection) {
+    uint32_t interest = (connection.readArmed ? EPOLLIN : 0u) | (connection.sending ? EPOLLOUT : 0u);
+    if (interest == 0) {
+        return true;
+    }
+    epoll_event event = {};
+    event.events = interest | EPOLLONESHOT;
+    event.data.fd = socket;
+    return epoll_ctl(m_epoll, EPOLL_CTL_MOD, socket, &event) == 0;
+}
+
+bool EpollBackend::PostSend(SOCKET clientSocket, const std::vector<WSABUF>& buffers,
+                            std::vector<SendBuffer> keepAlive) {
+    auto found = m_connections.find(clientSocket);
+    if (found == m_connections.end() || found->second.sending || buffers.empty()) {
+        return false;
+    }
+    Connection& connection = found->second;
+
+    connection.unsent.clear();
+    for (const WSABUF& buffer : buffers) {
+        connection.unsent.push_back({ buffer.buf, static_cast<size_t>(buffer.len) });
+    }
+    connection.unsentIndex = 0;
+    connection.sentBytes = 0;
+
+    switch (continueSend(clientSocket, connection)) {
+    case SendProgress::Done:
+        m_deferred.push_back({ EventType::SendComplete, clientSocket, connection.sentBytes });
+        return true;
+    case SendProgress::Blocked:
+        connection.keepAlive = std::move(keepAlive);
+        connection.sending = true;
+        if (!updateInterest(clientSocket, connection)) {
+            connection.sending = false;
+            connection.keepAlive.clear();
+            return false;
+        }
+        return true;
+    case SendProgress::Failed:
+    default:
+        return false;
+    }
+}
+
+EpollBackend::SendProgress EpollBackend::continueSend(SOCKET socket, Connection& connection) {
+    while (connection.unsentIndex < connection.unsent.size()) {
+        int count = static_cast<int>((std::min)(connection.unsent.size() - connection.unsentIndex,
+                                                static_cast<size_t>(IOV_MAX)));
+        ssize_t written = writev(socket, connection.unsent.data() + connection.unsentIndex, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NetProtocol::IsWouldBlock(errno) ? SendProgress::Blocked : SendProgress::Failed;
+        }
+        connection.sentBytes += static_cast<size_t>(written);
+
+        // Skip what went out; a short write leaves an offset into one buffer
+        size_t remaining = static_cast<size_t>(written);
+        while (remaining > 0 && connection.unsentIndex < connection.unsent.size()) {
+            iovec& head = connection.unsent[connection.unsentIndex];
+            if (remaining >= head.iov_len) {
+                remaining -= head.iov_len;
+                ++connection.unsentIndex;
+            } else {
+                head.iov_base = static_cast<char*>(head.iov_base) + remaining;
+                head.iov_len -= remaining;
+                remaining = 0;
+            }
+        }
+    }
+    return SendProgress::Done;
+}
+
+void EpollBackend::Remove(SOCKET clientSocket) {
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, clientSocket, nullptr);
+    m_connections.erase(clientSocket);
+
+    // The descriptor number is free for the next accept; nothing stale may reach it
+    m_deferred.erase(std::remove_if(m_deferred.begin(), m_deferred.end(),
+                                    [clientSocket](const Event& event) { return event.socket == clientSocket; }),
+                     m_deferred.end());
+}
+
+void EpollBackend::acceptPending(std::vector<Event>& outEvents) {
+    for (size_t accepted = 0; accepted < MAX_ACCEPTS_PER_POLL; ++accepted) {
+        SOCKET socket = accept4(m_listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket == INVALID_SOCKET) {
+            return;     // Drained, or out of descriptors until some close
+        }
+        outEvents.push_back({ EventType::Accepted, socket, 0 });
+    }
+}
+
+size_t EpollBackend::Poll(std::vector<Event>& outEvents, uint32_t timeoutMs) {
+    outEvents.clear();
+    outEvents.swap(m_deferred);
+
+    epoll_event ready[MAX_EVENTS_PER_POLL];
+    int timeout = outEvents.empty() ? static_cast<int>((std::min)(timeoutMs, static_cast<uint32_t>(INT_MAX))) : 0;
+    int count = epoll_wait(m_epoll, ready, MAX_EVENTS_PER_POLL, timeout);
+
+    for (int i = 0; i < count; ++i) {
+        int fd = ready[i].data.fd;
+        uint32_t flags = ready[i].events;
+
+        if (fd == m_listenSocket) {
+            acceptPending(outEvents);
+            continue;
+        }
+        if (fd == m_wakeEvent) {
+            uint64_t value = 0;
+            ssize_t drained = read(m_wakeEvent, &value, sizeof(value));
+            (void)drained;
+            outEvents.push_back({ EventType::Wakeup, INVALID_SOCKET, 0 });
+            continue;
+        }
+
+        auto found = m_connections.find(fd);
+        if (found == m_connections.end()) {
+            continue;
+        }
+        Connection& connection = found->second;     // Disabled (one-shot) until renewed below
+
+        if (connection.sending && (flags & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            SendProgress progress = continueSend(fd, connection);
+            if (progress != SendProgress::Blocked) {
+                connection.sending = false;
+                connection.keepAlive.clear();
+                outEvents.push_back({ progress == SendProgress::Done ? EventType::SendComplete : EventType::SendFailed,
+                                      fd, connection.sentBytes });
+            }
+        }
+
+        // Errors and hang-ups surface as input: the drain's recv() reports them
+        if (connection.readArmed && (flags & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))) {
+            connection.readArmed = false;
+            outEvents.push_back({ EventType::Readable, fd, 0 });
+        }
+
+        if (!updateInterest(fd, connection)) {
+            outEvents.push_back({ connection.sending ? EventType::SendFailed : EventType::Closed, fd, 0 });
+        }
+    }
+    return outEvents.size();
+}
+
+void EpollBackend::Wake() {
+    uint64_t one = 1;
+    ssize_t written = write(m_wakeEvent, &one, sizeof(one));
+    (void)written;
+}
+
+#endif // __linux__
@@ -0,0 +1,81 @@
+#ifndef EPOLL_BACKEND_H
+#define EPOLL_BACKEND_H
+
+/**
+ * @file EpollBackend.h
+ * @brief IoBackend on Linux epoll: readiness, emulated as completions
+ *
+ * DESIGN:
+ * - Every socket is registered EPOLLONESHOT, so it reports once and stays
+ *   quiet until its interest is renewed: by Rearm() for reads, or while a
+ *   send is blocked. An idle connection costs one epoll entry
+ * - The listener is level-triggered; each Poll() accepts up to
+ *   MAX_ACCEPTS_PER_POLL connections with accept4()
+ * - PostSend() writes with writev() at once. What the socket does not
+ *   take is finished on EPOLLOUT, and SendComplete is reported only once
+ *   every byte is out, from the next Poll() even when nothing blocked
+ * - Wake() writes to an eventfd in the same epoll set
+ *
+ * THREADING:
+ * See IoBackend.h.
+ */
+
+#ifdef __linux__
+
+#include "IoBackend.h"
+#include <sys/uio.h>
+#include <unordered_map>
+
+class EpollBackend : public NetProtocol::IoBackend {
+public:
+    /** epoll_wait() batch size */
+    static constexpr int MAX_EVENTS_PER_POLL = 64;
+
+    /** Connections accepted per Poll() before the rest wait for the next one */
+    static constexpr size_t MAX_ACCEPTS_PER_POLL = 64;
+
+    /**
+     * @param listenSocket A bound, listening TCP socket (not owned)
+     * @throws std::runtime_error if epoll or the eventfd cannot be set up
+     */
+    explicit EpollBackend(SOCKET listenSocket);
+    ~EpollBackend() override;
+
+    Kind GetKind() const override { return Kind::Epoll; }
+    bool Associate(SOCKET clientSocket) override;
+    bool Rearm(SOCKET clientSocket) override;
+    bool PostSend(SOCKET clientSocket, const std::vector<WSABUF>& buffers,
+                  std::vector<SendBuffer> keepAlive) override;
+    void Remove(SOCKET clientSocket) override;
+    size_t Poll(std::vector<Event>& outEvents, uint32_t timeoutMs) override;
+    void Wake() override;
+
+private:
+    struct Connection {
+        bool readArmed = true;          // Waiting for input until Readable is reported
+        bool sending = false;           // A send is blocked, waiting for EPOLLOUT
+        std::vector<iovec> unsent;      // What is left of it
+        size_t unsentIndex = 0;
+        size_t sentBytes = 0;
+        std::vector<SendBuffer> keepAlive;
+    };
+
+    enum class SendProgress { Done, Blocked, Failed };
+
+    int m_epoll;
+    int m_wakeEvent;
+    SOCKET m_listenSocket;
+    std::unordered_map<SOCKET, Connection> m_connections;
+    std::vector<Event> m_deferred;      // Sends finished inside PostSend()
+
+    bool updateInterest(SOCKET socket, Connection& connection);
+    SendProgress continueSend(SOCKET socket, Connection& connection);
+    void acceptPending(std::vector<Event>& outEvents);
+
+    EpollBackend(const EpollBackend&) = delete;
+    EpollBackend& operator=(const EpollBackend&) = delete;
+};
+
+#endif // __linux__
+
+#endif // EPOLL_BACKEND_H
@@ -0,0 +1,328 @@
+#ifndef FLAT_HASH_MAP_H
+#define FLAT_HASH_MAP_H
+
+/**
+ * @file FlatHashMap.h
+ * @brief Open-addressing hash map stored in two flat arrays
+ *
+ * PURPOSE:
+ * The model services look entries up by ID or token on every request.
+ * std::map costs one heap node per entry and a pointer chase per tree
+ * level; this map keeps entries in one contiguous array, so a lookup is
+ * usually a hash, one control-byte compare and one key compare.
+ *
+ * DESIGN:
+ * - Linear probing over a power-of-two table, at most 7/8 full
+ * - A parallel control array holds one byte per slot: empty, deleted, or
+ *   "full" plus 7 bits of the hash, so probes rarely touch a slot whose
+ *   key does not match
+ * - Erase leaves a tombstone rather than moving entries, so erasing never
+ *   disturbs iteration or references to other entries
+ *
+ * DIFFERENCES FROM std::map:
+ * - Iteration order is unspecified; sort results where order is visible
+ * - Inserting may rehash, which invalidates every iterator and reference
+ * - Keys are stored mutable (std::pair<K, V>); never modify one in place
+ * - std::string keys can also be looked up by std::string_view, which
+ *   saves building a string just to search
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Default hashes: IDs are often sequential, so integers get mixed
+ */
+template <typename K>
+struct FlatHash;
+
+template <>
+struct FlatHash<uint64_t> {
+    size_t operator()(uint64_t value) const {
+        // splitmix64 finalizer
+        value ^= value >> 30;
+        value *= 0xBF58476D1CE4E5B9ULL;
+        value ^= value >> 27;
+        value *= 0x94D049BB133111EBULL;
+        value ^= value >> 31;
+        return static_cast<size_t>(value);
+    }
+};
+
+template <>
+struct FlatHash<std::string> {
+    size_t operator()(const std::string& value) const {
+        return (*this)(std::string_view(value));
+    }
+
+    size_t operator()(std::string_view value) const {
+        // FNV-1a, then mixed so the low bits used for the slot are well spread
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (unsigned char c : value) {
+            hash ^= c;
+            hash *= 0x100000001B3ULL;
+        }
+        return FlatHash<uint64_t>()(hash);
+    }
+};
+
+template <>
+struct FlatHash<std::pair<uint64_t, uint64_t>> {
+    size_t operator()(const std::pair<uint64_t, uint64_t>& value) const {
+        // Mix each half so (a, b) and (b, a) land apart
+        return FlatHash<uint64_t>()(FlatHash<uint64_t>()(value.first) ^ (value.second + 0x9E3779B97F4A7C15ULL));
+    }
+};
+
+template <typename K, typename V, typename Hash = FlatHash<K>>
+class FlatHashMap {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+
+    template <bool Const>
+    class Iterator {
+    public:
+        using Map = typename std::conditional<Const, const FlatHashMap, FlatHashMap>::type;
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = typename FlatHashMap::value_type;
+        using reference = typename std::conditional<Const, const value_type&, value_type&>::type;
+        using pointer = typename std::conditional<Const, const value_type*, value_type*>::type;
+
+        Iterator() = default;
+        Iterator(Map* map, size_t index) : m_map(map), m_index(index) { skipEmpty(); }
+
+        // iterator -> const_iterator
+        template <bool WasConst, typename = typename std::enable_if<Const && !WasConst>::type>
+        Iterator(const Iterator<WasConst>& other) : m_map(other.m_map), m_index(other.m_index) {}
+
+        reference operator*() const { return m_map->m_slots[m_index]; }
+        pointer operator->() const { return &m_map->m_slots[m_index]; }
+
+        Iterator& operator++() {
+            ++m_index;
+            skipEmpty();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        friend class FlatHashMap;
+        template <bool> friend class Iterator;
+
+        Map* m_map = nullptr;
+        size_t m_index = 0;
+
+        void skipEmpty() {
+            while (m_index < m_map->m_ctrl.size() && !IsFull(m_map->m_ctrl[m_index])) {
+                ++m_index;
+            }
+        }
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashMap() = default;
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_ctrl.size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_ctrl.size()); }
+
+    void clear() {
+        m_ctrl.clear();
+        m_slots.clear();
+        m_size = 0;
+        m_tombstones = 0;
+    }
+
+    /**
+     * @brief Size the table so count entries fit without rehashing
+     */
+    void reserve(size_t count) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity - capacity / 8 < count) {
+            capacity *= 2;
+        }
+        if (capacity > m_ctrl.size()) {
+            rehash(capacity);
+        }
+    }
+
+    iterator find(const K& key) {
+        return iterator(this, findIndex(key));
+    }
+
+    const_iterator find(const K& key) const {
+        return const_iterator(this, findIndex(key));
+    }
+
+    size_t count(const K& key) const {
+        return findIndex(key) != m_ctrl.size() ? 1 : 0;
+    }
+
+    // Lookups of std::string keys by std::string_view
+    template <typename Q, typename = typename std::enable_if<std::is_same<Q, std::string_view>::value>::type>
+    iterator find(const Q& key) {
+        return iterator(this, findIndex(key));
+    }
+
+    template <typename Q, typename = typename std::enable_if<std::is_same<Q, std::string_view>::value>::type>
+    const_iterator find(const Q& key) const {
+        return const_iterator(this, findIndex(key));
+    }
+
+    template <typename Q, typename = typename std::enable_if<std::is_same<Q, std::string_view>::value>::type>
+    size_t count(const Q& key) const {
+        return findIndex(key) != m_ctrl.size() ? 1 : 0;
+    }
+
+    V& operator[](const K& key) {
+        return m_slots[insertIndex(key).first].second;
+    }
+
+    /**
+     * @brief Insert key -> V(args...) unless key is already present
+     * @return Iterator to the entry and whether it was inserted
+     */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(const K& key, Args&&... args) {
+        auto [index, inserted] = insertIndex(key);
+        if (inserted) {
+            m_slots[index].second = V(std::forward<Args>(args)...);
+        }
+        return { iterator(this, index), inserted };
+    }
+
+    /**
+     * @brief Remove the entry at it
+     * @return Iterator to the next entry
+     */
+    iterator erase(iterator it) {
+        eraseIndex(it.m_index);
+        ++it;
+        return it;
+    }
+
+    size_t erase(const K& key) {
+        size_t index = findIndex(key);
+        if (index == m_ctrl.size()) {
+            return 0;
+        }
+        eraseIndex(index);
+        return 1;
+    }
+
+private:
+    static constexpr uint8_t CTRL_EMPTY = 0x00;
+    static constexpr uint8_t CTRL_DELETED = 0x01;
+    static constexpr uint8_t CTRL_FULL = 0x80;     // | low 7 bits of the hash
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    std::vector<uint8_t> m_ctrl;
+    std::vector<value_type> m_slots;
+    size_t m_size = 0;
+    size_t m_tombstones = 0;
+
+    static bool IsFull(uint8_t ctrl) { return (ctrl & CTRL_FULL) != 0; }
+    static uint8_t FullCtrl(size_t hash) { return static_cast<uint8_t>(CTRL_FULL | (hash & 0x7F)); }
+
+    // The control byte uses the low hash bits, so the slot uses the high ones
+    size_t homeSlot(size_t hash) const { return (hash >> 7) & (m_ctrl.size() - 1); }
+
+    template <typename Q>
+    size_t findIndex(const Q& key) const {
+        if (m_ctrl.empty()) {
+            return 0;   // == end() of an empty table
+        }
+
+        size_t hash = Hash()(key);
+        uint8_t tag = FullCtrl(hash);
+        size_t mask = m_ctrl.size() - 1;
+        for (size_t i = homeSlot(hash);; i = (i + 1) & mask) {
+            uint8_t ctrl = m_ctrl[i];
+            if (ctrl == CTRL_EMPTY) {
+                return m_ctrl.size();
+            }
+            if (ctrl == tag && m_slots[i].first == key) {
+                return i;
+            }
+        }
+    }
+
+    std::pair<size_t, bool> insertIndex(const K& key) {
+        size_t existing = findIndex(key);
+        if (existing != m_ctrl.size()) {
+            return { existing, false };
+        }
+
+        // Keep at least 1/8 of the table truly empty so probes terminate
+        if (m_ctrl.empty() || (m_size + m_tombstones + 1) > m_ctrl.size() - m_ctrl.size() / 8) {
+            size_t capacity = m_ctrl.empty() ? MIN_CAPACITY : m_ctrl.size();
+            if (m_size + 1 > capacity / 2) {
+                capacity *= 2;      // Mostly live entries: grow
+            }                       // Mostly tombstones: rebuild at the same size
+            rehash(capacity);
+        }
+
+        size_t hash = Hash()(key);
+        size_t mask = m_ctrl.size() - 1;
+        size_t i = homeSlot(hash);
+        while (IsFull(m_ctrl[i])) {
+            i = (i + 1) & mask;
+        }
+
+        if (m_ctrl[i] == CTRL_DELETED) {
+            --m_tombstones;
+        }
+        m_ctrl[i] = FullCtrl(hash);
+        m_slots[i].first = key;
+        ++m_size;
+        return { i, true };
+    }
+
+    void eraseIndex(size_t index) {
+        m_ctrl[index] = CTRL_DELETED;
+        m_slots[index] = value_type();     // Release what the value owns now
+        --m_size;
+        ++m_tombstones;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<uint8_t> oldCtrl(capacity, CTRL_EMPTY);
+        std::vector<value_type> oldSlots(capacity);
+        oldCtrl.swap(m_ctrl);
+        oldSlots.swap(m_slots);
+        m_tombstones = 0;
+
+        size_t mask = capacity - 1;
+        for (size_t j = 0; j < oldCtrl.size(); ++j) {
+            if (!IsFull(oldCtrl[j])) {
+                continue;
+            }
+            size_t hash = Hash()(oldSlots[j].first);
+            size_t i = homeSlot(hash);
+            while (m_ctrl[i] != CTRL_EMPTY) {
+                i = (i + 1) & mask;
+            }
+            m_ctrl[i] = FullCtrl(hash);
+            m_slots[i] = std::move(oldSlots[j]);
+        }
+    }
+};
+
+#endif // FLAT_HASH_MAP_H
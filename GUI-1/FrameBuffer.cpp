@@ -0,0 +1,149 @@
+/**
+ * @file FrameBuffer.cpp
+ * @brief Implementation of the shared immutable wire buffer
+ */
+
+// MUST define NOMINMAX before Windows headers to prevent min/max macro conflicts
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "FrameBuffer.h"
+#include "BufferPool.h"
+#include "NetProtocol.h"
+#include <cstring>
+#include <new>
+
+namespace NetProtocol {
+
+FrameBuffer FrameBuffer::build(std::initializer_list<std::string_view> parts, bool framed, bool compressed) {
+    size_t payloadSize = 0;
+    for (const auto& part : parts) {
+        payloadSize += part.size();
+    }
+
+    // SECURITY: Never produce a frame the receiver is required to reject
+    if (framed && payloadSize > MAX_MESSAGE_SIZE) {
+        return FrameBuffer();
+    }
+    if (payloadSize > UINT32_MAX - HEADER_SIZE) {
+        return FrameBuffer();
+    }
+
+    uint32_t headerSize = framed ? static_cast<uint32_t>(HEADER_SIZE) : 0;
+    uint32_t total = headerSize + static_cast<uint32_t>(payloadSize);
+
+    void* memory = BufferPool::Acquire(sizeof(Block) + total);
+    if (!memory) {
+        return FrameBuffer();
+    }
+
+    Block* block = new (memory) Block;
+    block->refs.store(1, std::memory_order_relaxed);
+    block->size = total;
+    block->headerSize = headerSize;
+    block->compressed = compressed;
+
+    char* out = reinterpret_cast<char*>(block + 1);
+    if (framed) {
+        uint32_t header = static_cast<uint32_t>(payloadSize) | (compressed ? COMPRESSED_FLAG : 0);
+        uint32_t networkLength = htonl(header);
+        std::memcpy(out, &networkLength, HEADER_SIZE);
+        out += HEADER_SIZE;
+    }
+    for (const auto& part : parts) {
+        if (!part.empty()) {
+            std::memcpy(out, part.data(), part.size());
+            out += part.size();
+        }
+    }
+
+    return FrameBuffer(block);
+}
+
+FrameBuffer FrameBuffer::Encode(std::string_view payload) {
+    return build({ payload }, true);
+}
+
+FrameBuffer FrameBuffer::EncodeParts(std::initializer_list<std::string_view> parts) {
+    return build(parts, true);
+}
+
+FrameBuffer FrameBuffer::EncodeCompressed(std::string_view deflated) {
+    return build({ deflated }, true, true);
+}
+
+FrameBuffer FrameBuffer::Raw(std::string_view bytes) {
+    return build({ bytes }, false);
+}
+
+FrameBuffer FrameBuffer::RawParts(std::initializer_list<std::string_view> parts) {
+    return build(parts, false);
+}
+
+FrameBuffer::FrameBuffer(const FrameBuffer& other) noexcept : m_block(other.m_block) {
+    if (m_block) {
+        m_block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameBuffer::FrameBuffer(FrameBuffer&& other) noexcept : m_block(other.m_block) {
+    other.m_block = nullptr;
+}
+
+FrameBuffer& FrameBuffer::operator=(const FrameBuffer& other) noexcept {
+    if (this != &other) {
+        if (other.m_block) {
+            other.m_block->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        release();
+        m_block = other.m_block;
+    }
+    return *this;
+}
+
+FrameBuffer& FrameBuffer::operator=(FrameBuffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_block = other.m_block;
+        other.m_block = nullptr;
+    }
+    return *this;
+}
+
+FrameBuffer::~FrameBuffer() {
+    release();
+}
+
+void FrameBuffer::release() noexcept {
+    if (m_block && m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_block->~Block();
+        BufferPool::Release(m_block);
+    }
+    m_block = nullptr;
+}
+
+char* FrameBuffer::bytes() const {
+    return reinterpret_cast<char*>(m_block + 1);
+}
+
+const char* FrameBuffer::data() const {
+    return m_block ? bytes() : nullptr;
+}
+
+size_t FrameBuffer::size() const {
+    return m_block ? m_block->size : 0;
+}
+
+std::string_view FrameBuffer::payload() const {
+    if (!m_block) {
+        return std::string_view();
+    }
+    return std::string_view(bytes() + m_block->headerSize, m_block->size - m_block->headerSize);
+}
+
+uint32_t FrameBuffer::useCount() const {
+    return m_block ? m_block->refs.load(std::memory_order_relaxed) : 0;
+}
+
+} // namespace NetProtocol
@@ -0,0 +1,112 @@
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+/**
+ * @file FrameBuffer.h
+ * @brief Reference-counted, immutable wire buffer for encode-once broadcasts
+ *
+ * PURPOSE:
+ * A broadcast used to build a fresh std::string per message and then copy
+ * it again for every recipient's send. With N members per channel that is
+ * N allocations and N memcpys per chat line. A FrameBuffer is serialized
+ * exactly once - length prefix and payload in a single allocation - and
+ * every recipient's OutboundQueue holds a reference to the same bytes.
+ *
+ * LAYOUT (one BufferPool block, so a broadcast does not touch the heap):
+ *   [ refcount | size | headerSize ][ 4-byte length prefix ][ payload ]
+ *   The prefix is absent for Raw() buffers (legacy unframed stream), and
+ *   carries COMPRESSED_FLAG for EncodeCompressed() buffers.
+ *
+ * THREADING:
+ * The reference count is atomic, so buffers may be shared across threads.
+ * Contents are never modified after construction.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+namespace NetProtocol {
+
+class FrameBuffer {
+public:
+    /** Empty buffer (evaluates to false) */
+    FrameBuffer() noexcept : m_block(nullptr) {}
+
+    /**
+     * @brief Serialize a payload with its 4-byte network-order length prefix
+     * @return Empty buffer if the payload exceeds MAX_MESSAGE_SIZE
+     */
+    static FrameBuffer Encode(std::string_view payload);
+
+    /**
+     * @brief Serialize a payload assembled from parts, without building
+     *        the concatenated string first
+     * @return Empty buffer if the total exceeds MAX_MESSAGE_SIZE
+     */
+    static FrameBuffer EncodeParts(std::initializer_list<std::string_view> parts);
+
+    /**
+     * @brief Frame an already-deflated payload, flagging the length prefix
+     *        with COMPRESSED_FLAG (see FrameCompression.h)
+     * @return Empty buffer if the deflated bytes exceed MAX_MESSAGE_SIZE
+     */
+    static FrameBuffer EncodeCompressed(std::string_view deflated);
+
+    /**
+     * @brief Wrap bytes for the legacy unframed stream (no length prefix)
+     */
+    static FrameBuffer Raw(std::string_view bytes);
+
+    /**
+     * @brief Raw() counterpart of EncodeParts()
+     */
+    static FrameBuffer RawParts(std::initializer_list<std::string_view> parts);
+
+    FrameBuffer(const FrameBuffer& other) noexcept;
+    FrameBuffer(FrameBuffer&& other) noexcept;
+    FrameBuffer& operator=(const FrameBuffer& other) noexcept;
+    FrameBuffer& operator=(FrameBuffer&& other) noexcept;
+    ~FrameBuffer();
+
+    /** @brief Bytes to put on the wire (prefix included when framed) */
+    const char* data() const;
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    explicit operator bool() const { return m_block != nullptr; }
+
+    /** @brief The payload without the length prefix (deflated if compressed()) */
+    std::string_view payload() const;
+
+    /** @brief False for Raw() buffers */
+    bool framed() const { return m_block && m_block->headerSize != 0; }
+
+    /** @brief True for EncodeCompressed() buffers */
+    bool compressed() const { return m_block && m_block->compressed; }
+
+    /** @brief Number of holders sharing these bytes (diagnostics) */
+    uint32_t useCount() const;
+
+private:
+    struct Block {
+        std::atomic<uint32_t> refs;
+        uint32_t size;          // Total bytes after the block header
+        uint32_t headerSize;    // 0 (raw) or HEADER_SIZE (framed)
+        bool compressed;        // Length prefix carries COMPRESSED_FLAG
+    };
+
+    Block* m_block;
+
+    explicit FrameBuffer(Block* block) noexcept : m_block(block) {}
+
+    static FrameBuffer build(std::initializer_list<std::string_view> parts, bool framed, bool compressed = false);
+    char* bytes() const;
+    void release() noexcept;
+};
+
+} // namespace NetProtocol
+
+#endif // FRAME_BUFFER_H
@@ -0,0 +1,268 @@
+/**
+ * @file FrameCompression.cpp
+ * @brief Implementation of per-frame deflate on the zlib bundled with FLTK
+ *
+ * FLTK ships zlib 1.3.1 as fltk_z.lib with every symbol prefixed fltk_z_,
+ * but no zlib.h. The few entry points used here are declared below with
+ * the z_stream layout of that release; deflateInit2_/inflateInit2_ check
+ * the version and sizeof(z_stream) they are given, so a mismatched
+ * library fails at initialisation (compression is then simply not used)
+ * rather than corrupting memory.
+ */
+
+// MUST define NOMINMAX before Windows headers to prevent min/max macro conflicts
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "FrameCompression.h"
+#include "NetProtocol.h"
+#include <algorithm>
+#include <new>
+
+//=============================================================================
+// ZLIB 1.3.1 ABI (fltk_z.lib)
+//=============================================================================
+
+extern "C" {
+
+struct fltk_z_stream {
+    const unsigned char* next_in;
+    unsigned int avail_in;
+    unsigned long total_in;
+    unsigned char* next_out;
+    unsigned int avail_out;
+    unsigned long total_out;
+    const char* msg;
+    void* state;
+    void* (*zalloc)(void* opaque, unsigned int items, unsigned int size);
+    void (*zfree)(void* opaque, void* address);
+    void* opaque;
+    int data_type;
+    unsigned long adler;
+    unsigned long reserved;
+};
+
+int fltk_z_deflateInit2_(fltk_z_stream* strm, int level, int method, int windowBits, int memLevel,
+                         int strategy, const char* version, int streamSize);
+int fltk_z_deflateSetDictionary(fltk_z_stream* strm, const unsigned char* dictionary, unsigned int length);
+int fltk_z_deflateReset(fltk_z_stream* strm);
+int fltk_z_deflate(fltk_z_stream* strm, int flush);
+int fltk_z_deflateEnd(fltk_z_stream* strm);
+
+int fltk_z_inflateInit2_(fltk_z_stream* strm, int windowBits, const char* version, int streamSize);
+int fltk_z_inflateSetDictionary(fltk_z_stream* strm, const unsigned char* dictionary, unsigned int length);
+int fltk_z_inflateReset(fltk_z_stream* strm);
+int fltk_z_inflate(fltk_z_stream* strm, int flush);
+int fltk_z_inflateEnd(fltk_z_stream* strm);
+
+} // extern "C"
+
+namespace {
+
+const char ZLIB_VERSION_STRING[] = "1.3.1";
+
+constexpr int Z_OK = 0;
+constexpr int Z_STREAM_END = 1;
+constexpr int Z_BUF_ERROR = -5;
+constexpr int Z_NO_FLUSH = 0;
+constexpr int Z_FINISH = 4;
+constexpr int Z_DEFLATED = 8;
+constexpr int Z_DEFAULT_STRATEGY = 0;
+
+// Raw deflate (no zlib header or checksum: the frame length already
+// delimits the stream and TCP already checks the bytes), 32 KB window
+constexpr int WINDOW_BITS = -15;
+constexpr int MEM_LEVEL = 8;
+
+// The network thread compresses inline; past the fast levels text
+// barely shrinks further for a lot more time
+constexpr int COMPRESSION_LEVEL = 3;
+
+// Strings that recur in chat traffic. zlib reaches the end of the
+// dictionary with the shortest distances, so the most frequent go last.
+const char DICTIONARY[] =
+    "[Whisper to [Whisper from ]: User ' not found."
+    "Too many channels joined.Invalid channel id.Malformed request."
+    " has disconnected. has joined the server.[CH:[SERVER]: ";
+
+constexpr unsigned int DICTIONARY_LENGTH = sizeof(DICTIONARY) - 1;
+
+const unsigned char* Bytes(const char* text) {
+    return reinterpret_cast<const unsigned char*>(text);
+}
+
+} // namespace
+
+namespace NetProtocol {
+
+//=============================================================================
+// DEFLATER
+//=============================================================================
+
+struct Deflater::Stream {
+    fltk_z_stream z{};
+};
+
+Deflater::Deflater() {
+    std::unique_ptr<Stream> stream(new (std::nothrow) Stream);
+    if (stream && fltk_z_deflateInit2_(&stream->z, COMPRESSION_LEVEL, Z_DEFLATED, WINDOW_BITS, MEM_LEVEL,
+                                       Z_DEFAULT_STRATEGY, ZLIB_VERSION_STRING,
+                                       static_cast<int>(sizeof(fltk_z_stream))) == Z_OK) {
+        m_stream = std::move(stream);
+    }
+}
+
+Deflater::~Deflater() {
+    if (m_stream) {
+        fltk_z_deflateEnd(&m_stream->z);
+    }
+}
+
+/**
+ * Deflate into m_output, which only has room for a result strictly
+ * smaller than the input: anything that does not fit is not worth sending.
+ */
+bool Deflater::deflate(std::string_view payload, size_t& outputLength) {
+    if (!m_stream || payload.size() < COMPRESSION_THRESHOLD || payload.size() > MAX_MESSAGE_SIZE) {
+        return false;
+    }
+
+    fltk_z_stream& z = m_stream->z;
+    if (fltk_z_deflateReset(&z) != Z_OK ||
+        fltk_z_deflateSetDictionary(&z, Bytes(DICTIONARY), DICTIONARY_LENGTH) != Z_OK) {
+        return false;
+    }
+
+    if (m_output.size() < payload.size()) {
+        m_output.resize(payload.size());
+    }
+    z.next_in = Bytes(payload.data());
+    z.avail_in = static_cast<unsigned int>(payload.size());
+    z.next_out = reinterpret_cast<unsigned char*>(m_output.data());
+    z.avail_out = static_cast<unsigned int>(payload.size() - 1);
+
+    if (fltk_z_deflate(&z, Z_FINISH) != Z_STREAM_END) {
+        return false;
+    }
+    outputLength = payload.size() - 1 - z.avail_out;
+    return true;
+}
+
+FrameBuffer Deflater::Encode(std::string_view payload) {
+    size_t length = 0;
+    if (deflate(payload, length)) {
+        FrameBuffer compressed = FrameBuffer::EncodeCompressed(std::string_view(m_output.data(), length));
+        if (compressed) {
+            return compressed;
+        }
+    }
+    return FrameBuffer::Encode(payload);
+}
+
+FrameBuffer Deflater::Compress(const FrameBuffer& frame) {
+    if (!frame.framed() || frame.compressed()) {
+        return frame;   // Empty, legacy unframed bytes, or already compressed
+    }
+    size_t length = 0;
+    if (deflate(frame.payload(), length)) {
+        FrameBuffer compressed = FrameBuffer::EncodeCompressed(std::string_view(m_output.data(), length));
+        if (compressed) {
+            return compressed;
+        }
+    }
+    return frame;
+}
+
+std::string_view Deflater::CompressRaw(std::string_view payload) {
+    size_t length = 0;
+    if (deflate(payload, length)) {
+        return std::string_view(m_output.data(), length);
+    }
+    return std::string_view();
+}
+
+//=============================================================================
+// INFLATER
+//=============================================================================
+
+struct Inflater::Stream {
+    fltk_z_stream z{};
+};
+
+Inflater::Inflater() {
+    std::unique_ptr<Stream> stream(new (std::nothrow) Stream);
+    if (stream && fltk_z_inflateInit2_(&stream->z, WINDOW_BITS, ZLIB_VERSION_STRING,
+                                       static_cast<int>(sizeof(fltk_z_stream))) == Z_OK) {
+        m_stream = std::move(stream);
+    }
+}
+
+Inflater::~Inflater() {
+    if (m_stream) {
+        fltk_z_inflateEnd(&m_stream->z);
+    }
+}
+
+bool Inflater::Decompress(std::string_view compressed, std::string& message) {
+    message.clear();
+    if (!m_stream || compressed.empty() || compressed.size() > MAX_MESSAGE_SIZE) {
+        return false;
+    }
+
+    fltk_z_stream& z = m_stream->z;
+    if (fltk_z_inflateReset(&z) != Z_OK ||
+        fltk_z_inflateSetDictionary(&z, Bytes(DICTIONARY), DICTIONARY_LENGTH) != Z_OK) {
+        return false;
+    }
+
+    // One byte of room past the limit tells "exactly full" from "too big"
+    const size_t limit = static_cast<size_t>(MAX_MESSAGE_SIZE) + 1;
+    size_t capacity = (std::min)(limit, (std::max)(static_cast<size_t>(256), compressed.size() * 4));
+    try {
+        message.resize(capacity);
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+
+    z.next_in = Bytes(compressed.data());
+    z.avail_in = static_cast<unsigned int>(compressed.size());
+    z.next_out = reinterpret_cast<unsigned char*>(&message[0]);
+    z.avail_out = static_cast<unsigned int>(capacity);
+
+    for (;;) {
+        int status = fltk_z_inflate(&z, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+            break;
+        }
+        if (status != Z_OK && status != Z_BUF_ERROR) {
+            message.clear();
+            return false;   // Corrupt stream
+        }
+        if (z.avail_out != 0 || capacity == limit) {
+            message.clear();
+            return false;   // Truncated, or inflating past MAX_MESSAGE_SIZE
+        }
+
+        size_t produced = capacity;
+        capacity = (std::min)(limit, capacity * 2);
+        try {
+            message.resize(capacity);
+        } catch (const std::bad_alloc&) {
+            message.clear();
+            return false;
+        }
+        z.next_out = reinterpret_cast<unsigned char*>(&message[0] + produced);
+        z.avail_out = static_cast<unsigned int>(capacity - produced);
+    }
+
+    size_t produced = capacity - z.avail_out;
+    if (z.avail_in != 0 || produced > MAX_MESSAGE_SIZE) {
+        message.clear();
+        return false;   // Bytes after the end of the stream, or oversized
+    }
+    message.resize(produced);
+    return true;
+}
+
+} // namespace NetProtocol
@@ -0,0 +1,108 @@
+#ifndef FRAME_COMPRESSION_H
+#define FRAME_COMPRESSION_H
+
+/**
+ * @file FrameCompression.h
+ * @brief Per-frame deflate for protocol v5 connections, on the bundled zlib
+ *
+ * PURPOSE:
+ * History fetches, member lists and server lists are repetitive text and
+ * binary records and went out uncompressed. From COMPRESSION_PROTOCOL_VERSION
+ * on, a frame whose length header has COMPRESSED_FLAG set carries a raw
+ * deflate stream instead of the payload itself.
+ *
+ * DESIGN:
+ * - Every frame is compressed on its own, primed with a fixed dictionary
+ *   of the strings chat traffic repeats ("[SERVER]: ", " has joined the
+ *   server.", "[Whisper from " ...). That gives short lines most of what
+ *   a per-connection stream would, while a broadcast is still compressed
+ *   once and the same bytes are shared by every v5 recipient
+ * - Payloads below COMPRESSION_THRESHOLD, and payloads deflate does not
+ *   shrink, are sent as they are
+ * - The zlib streams are kept and reset between frames, so compressing a
+ *   frame does not allocate the zlib state again
+ *
+ * SECURITY:
+ * The inflated size of a frame is bounded by MAX_MESSAGE_SIZE like any
+ * other payload; a stream that would inflate past it is rejected without
+ * producing the excess bytes (no zip bombs).
+ *
+ * THREADING:
+ * A Deflater or Inflater belongs to one thread at a time.
+ */
+
+#include "FrameBuffer.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NetProtocol {
+
+/**
+ * @brief Reusable compressor producing framed buffers
+ */
+class Deflater {
+public:
+    Deflater();
+    ~Deflater();
+
+    /**
+     * @brief Encode a payload, compressed when that makes the frame smaller
+     * @return The framed bytes (flagged when compressed); empty if the
+     *         payload exceeds MAX_MESSAGE_SIZE
+     */
+    FrameBuffer Encode(std::string_view payload);
+
+    /**
+     * @brief Compress an already-encoded plain frame
+     * @return A compressed copy, or the frame itself if compression is not
+     *         worth it (or zlib is unavailable)
+     */
+    FrameBuffer Compress(const FrameBuffer& frame);
+
+    /**
+     * @brief Compress bytes that are stored rather than sent (no frame header)
+     * @return The compressed bytes, valid until the next call; empty if
+     *         compression is not worth it. Inflater::Decompress() reverses it.
+     */
+    std::string_view CompressRaw(std::string_view payload);
+
+private:
+    struct Stream;
+    std::unique_ptr<Stream> m_stream;   // Null if zlib failed to initialise
+    std::vector<char> m_output;
+
+    bool deflate(std::string_view payload, size_t& outputLength);
+
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+};
+
+/**
+ * @brief Reusable decompressor with a bounded output
+ */
+class Inflater {
+public:
+    Inflater();
+    ~Inflater();
+
+    /**
+     * @brief Inflate one compressed frame payload
+     * @param message Output: the original payload (cleared on failure)
+     * @return False if the stream is corrupt, truncated, followed by extra
+     *         bytes, or would inflate past MAX_MESSAGE_SIZE
+     */
+    bool Decompress(std::string_view compressed, std::string& message);
+
+private:
+    struct Stream;
+    std::unique_ptr<Stream> m_stream;
+
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+};
+
+} // namespace NetProtocol
+
+#endif // FRAME_COMPRESSION_H
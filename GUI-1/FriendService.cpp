@@ -6,19 +6,23 @@
 #include "FriendService.h"
 #include "UserDatabase.h"
 #include <algorithm>
+#include <initializer_list>
 
 //=============================================================================
 // CONSTRUCTOR / DESTRUCTOR
 //=============================================================================
 
-FriendService::FriendService(const std::string& databasePath, UserDatabase& userDb)
+FriendService::FriendService(const std::string& databasePath, UserDatabase& userDb, bool loadNow)
     : databaseFilePath(databasePath)
-    , userDatabase(userDb) {
-    LoadFromFile();
+    , userDatabase(userDb)
+    , persistence("friend database", [this] { return SaveToFile(); }) {
+    if (loadNow) {
+        LoadFromFile();
+    }
 }
 
 FriendService::~FriendService() {
-    SaveToFile();
+    persistence.Close();
 }
 
 //=============================================================================
@@ -54,34 +58,31 @@ Protocol::ErrorCode FriendService::SendFriendRequest(
         return Protocol::ErrorCode::AlreadyFriends;
     }
     
-    // Check for existing pending request (either direction)
-    if (HasPendingRequest(senderId, receiverId)) {
+    // Check for existing pending request
+    if (findPendingRequest(senderId, receiverId)) {
         return Protocol::ErrorCode::RequestAlreadySent;
     }
     
     // Check if there's an incoming request from receiver to sender
     // If so, auto-accept it instead of creating a new one
-    Models::FriendRequest existingRequest;
-    if (GetPendingRequestBetween(receiverId, senderId, existingRequest)) {
+    if (Models::FriendRequest* existingRequest = findPendingRequest(receiverId, senderId)) {
         // The receiver already sent us a request, auto-accept
-        existingRequest.status = Models::FriendRequest::Status::Accepted;
-        requestsById[existingRequest.requestId] = existingRequest;
+        outRequest = *existingRequest;
+        outRequest.status = Models::FriendRequest::Status::Accepted;
+        resolveRequest(outRequest.requestId, Models::FriendRequest::Status::Accepted);
         
         // Create friendship
         userDatabase.AddFriendship(senderId, receiverId);
         
-        outRequest = existingRequest;
-        
         printf("[FRIEND] Auto-accepted mutual friend request between %llu and %llu\n",
                senderId, receiverId);
         
-        SaveToFile();
+        persistence.MarkDirty();
         return Protocol::ErrorCode::None;
     }
     
     // Check friend limit for sender
-    std::vector<Models::User> senderFriends = userDatabase.GetFriends(senderId);
-    if (senderFriends.size() >= Models::MAX_FRIENDS_PER_USER) {
+    if (userDatabase.GetFriendCount(senderId) >= Models::MAX_FRIENDS_PER_USER) {
         return Protocol::ErrorCode::TooManyFriends;
     }
     
@@ -90,9 +91,10 @@ Protocol::ErrorCode FriendService::SendFriendRequest(
     Models::FriendRequest request(requestId, senderId, receiverId);
     
     requestsById[requestId] = request;
+    indexRequest(request);
     outRequest = request;
     
-    SaveToFile();
+    persistence.MarkDirty();
     
     printf("[FRIEND] User %llu sent friend request to user %llu\n", senderId, receiverId);
     
@@ -120,24 +122,22 @@ Protocol::ErrorCode FriendService::AcceptFriendRequest(uint64_t requestId, uint6
     }
     
     // Check friend limits
-    std::vector<Models::User> senderFriends = userDatabase.GetFriends(request.senderId);
-    std::vector<Models::User> receiverFriends = userDatabase.GetFriends(request.receiverId);
-    
-    if (senderFriends.size() >= Models::MAX_FRIENDS_PER_USER ||
-        receiverFriends.size() >= Models::MAX_FRIENDS_PER_USER) {
+    if (userDatabase.GetFriendCount(request.senderId) >= Models::MAX_FRIENDS_PER_USER ||
+        userDatabase.GetFriendCount(request.receiverId) >= Models::MAX_FRIENDS_PER_USER) {
         return Protocol::ErrorCode::TooManyFriends;
     }
     
     // Accept the request
-    request.status = Models::FriendRequest::Status::Accepted;
+    uint64_t senderId = request.senderId;
+    resolveRequest(requestId, Models::FriendRequest::Status::Accepted);
     
     // Create friendship
-    userDatabase.AddFriendship(request.senderId, request.receiverId);
+    userDatabase.AddFriendship(senderId, accepterId);
     
-    SaveToFile();
+    persistence.MarkDirty();
     
     printf("[FRIEND] User %llu accepted friend request from user %llu\n",
-           accepterId, request.senderId);
+           accepterId, senderId);
     
     return Protocol::ErrorCode::None;
 }
@@ -163,12 +163,13 @@ Protocol::ErrorCode FriendService::DeclineFriendRequest(uint64_t requestId, uint
     }
     
     // Decline the request
-    request.status = Models::FriendRequest::Status::Declined;
+    uint64_t senderId = request.senderId;
+    resolveRequest(requestId, Models::FriendRequest::Status::Declined);
     
-    SaveToFile();
+    persistence.MarkDirty();
     
     printf("[FRIEND] User %llu declined friend request from user %llu\n",
-           declinerId, request.senderId);
+           declinerId, senderId);
     
     return Protocol::ErrorCode::None;
 }
@@ -194,12 +195,14 @@ Protocol::ErrorCode FriendService::CancelFriendRequest(uint64_t requestId, uint6
     }
     
     // Remove the request
+    uint64_t receiverId = request.receiverId;
+    unindexRequest(request);
     requestsById.erase(it);
     
-    SaveToFile();
+    persistence.MarkDirty();
     
     printf("[FRIEND] User %llu cancelled friend request to user %llu\n",
-           cancelerId, request.receiverId);
+           cancelerId, receiverId);
     
     return Protocol::ErrorCode::None;
 }
@@ -209,20 +212,20 @@ std::vector<Models::FriendRequest> FriendService::GetPendingRequests(uint64_t us
     
     std::vector<Models::FriendRequest> results;
     
-    for (const auto& pair : requestsById) {
-        const Models::FriendRequest& request = pair.second;
-        
-        if (request.status != Models::FriendRequest::Status::Pending) {
-            continue;
-        }
-        
-        if (incoming && request.receiverId == userId) {
-            results.push_back(request);
-        } else if (!incoming && request.senderId == userId) {
-            results.push_back(request);
-        }
+    const FlatHashMap<uint64_t, std::vector<uint64_t>>& index = incoming ? incomingByUser : outgoingByUser;
+    auto indexIt = index.find(userId);
+    if (indexIt == index.end()) {
+        return results;
     }
     
+    // The index is already oldest first
+    results.reserve(indexIt->second.size());
+    for (uint64_t requestId : indexIt->second) {
+        auto it = requestsById.find(requestId);
+        if (it != requestsById.end()) {
+            results.push_back(it->second);
+        }
+    }
     return results;
 }
 
@@ -230,12 +233,17 @@ bool FriendService::GetFriendRequest(uint64_t requestId, Models::FriendRequest&
     std::lock_guard<std::mutex> lock(serviceMutex);
     
     auto it = requestsById.find(requestId);
-    if (it == requestsById.end()) {
-        return false;
+    if (it != requestsById.end()) {
+        outRequest = it->second;
+        return true;
     }
     
-    outRequest = it->second;
-    return true;
+    auto resolvedIt = resolvedById.find(requestId);
+    if (resolvedIt != resolvedById.end()) {
+        outRequest = resolvedIt->second;
+        return true;
+    }
+    return false;
 }
 
 //=============================================================================
@@ -263,70 +271,68 @@ bool FriendService::AreFriends(uint64_t userId1, uint64_t userId2) {
 }
 
 std::vector<uint64_t> FriendService::GetFriendIds(uint64_t userId) {
-    std::vector<Models::User> friends = userDatabase.GetFriends(userId);
-    std::vector<uint64_t> ids;
-    ids.reserve(friends.size());
-    
-    for (const Models::User& friendUser : friends) {
-        ids.push_back(friendUser.userId);
-    }
-    
-    return ids;
+    return userDatabase.GetFriendIds(userId);
 }
 
 size_t FriendService::GetPendingRequestCount(uint64_t userId) {
     std::lock_guard<std::mutex> lock(serviceMutex);
     
-    size_t count = 0;
-    for (const auto& pair : requestsById) {
-        if (pair.second.status == Models::FriendRequest::Status::Pending &&
-            pair.second.receiverId == userId) {
-            count++;
-        }
-    }
-    
-    return count;
+    auto it = incomingByUser.find(userId);
+    return it != incomingByUser.end() ? it->second.size() : 0;
 }
 
 //=============================================================================
 // HELPER METHODS
 //=============================================================================
 
-bool FriendService::HasPendingRequest(uint64_t senderId, uint64_t receiverId) {
-    for (const auto& pair : requestsById) {
-        const Models::FriendRequest& request = pair.second;
-        
-        if (request.status != Models::FriendRequest::Status::Pending) {
-            continue;
-        }
-        
-        if (request.senderId == senderId && request.receiverId == receiverId) {
-            return true;
-        }
+Models::FriendRequest* FriendService::findPendingRequest(uint64_t senderId, uint64_t receiverId) {
+    auto indexIt = outgoingByUser.find(senderId);
+    if (indexIt == outgoingByUser.end()) {
+        return nullptr;
     }
     
-    return false;
+    for (uint64_t requestId : indexIt->second) {
+        auto it = requestsById.find(requestId);
+        if (it != requestsById.end() && it->second.receiverId == receiverId) {
+            return &it->second;
+        }
+    }
+    return nullptr;
 }
 
-bool FriendService::GetPendingRequestBetween(
-    uint64_t user1Id, 
-    uint64_t user2Id, 
-    Models::FriendRequest& outRequest
-) {
-    for (auto& pair : requestsById) {
-        Models::FriendRequest& request = pair.second;
-        
-        if (request.status != Models::FriendRequest::Status::Pending) {
-            continue;
+void FriendService::indexRequest(const Models::FriendRequest& request) {
+    outgoingByUser[request.senderId].push_back(request.requestId);
+    incomingByUser[request.receiverId].push_back(request.requestId);
+}
+
+void FriendService::unindexRequest(const Models::FriendRequest& request) {
+    auto unlist = [&request](FlatHashMap<uint64_t, std::vector<uint64_t>>& index, uint64_t userId) {
+        auto it = index.find(userId);
+        if (it == index.end()) {
+            return;
         }
-        
-        if (request.senderId == user1Id && request.receiverId == user2Id) {
-            outRequest = request;
-            return true;
+        std::vector<uint64_t>& ids = it->second;
+        ids.erase(std::remove(ids.begin(), ids.end(), request.requestId), ids.end());
+        if (ids.empty()) {
+            index.erase(it);
         }
+    };
+    unlist(outgoingByUser, request.senderId);
+    unlist(incomingByUser, request.receiverId);
+}
+
+void FriendService::resolveRequest(uint64_t requestId, Models::FriendRequest::Status status) {
+    auto it = requestsById.find(requestId);
+    if (it == requestsById.end()) {
+        return;
     }
     
-    return false;
+    Models::FriendRequest request = it->second;
+    unindexRequest(request);
+    requestsById.erase(it);
+    
+    request.status = status;
+    resolvedById[requestId] = request;
 }
 
 //=============================================================================
@@ -334,22 +340,28 @@ bool FriendService::GetPendingRequestBetween(
 //=============================================================================
 
 bool FriendService::SaveToFile() {
+    std::unique_lock<std::mutex> lock(serviceMutex);
+    
     pugi::xml_document doc;
     pugi::xml_node root = doc.append_child("FriendDatabase");
     
     pugi::xml_node requestsNode = root.append_child("Requests");
-    for (const auto& pair : requestsById) {
-        const Models::FriendRequest& request = pair.second;
-        pugi::xml_node requestNode = requestsNode.append_child("Request");
-        
-        requestNode.append_attribute("id") = request.requestId;
-        requestNode.append_attribute("senderId") = request.senderId;
-        requestNode.append_attribute("receiverId") = request.receiverId;
-        requestNode.append_attribute("status") = static_cast<int>(request.status);
-        requestNode.append_attribute("createdAt") = static_cast<long long>(request.createdAt);
+    for (const FlatHashMap<uint64_t, Models::FriendRequest>* requests : { &requestsById, &resolvedById }) {
+        for (const auto& pair : *requests) {
+            const Models::FriendRequest& request = pair.second;
+            pugi::xml_node requestNode = requestsNode.append_child("Request");
+            
+            requestNode.append_attribute("id") = request.requestId;
+            requestNode.append_attribute("senderId") = request.senderId;
+            requestNode.append_attribute("receiverId") = request.receiverId;
+            requestNode.append_attribute("status") = static_cast<int>(request.status);
+            requestNode.append_attribute("createdAt") = static_cast<long long>(request.createdAt);
+        }
     }
     
-    return doc.save_file(databaseFilePath.c_str());
+    lock.unlock();
+    
+    return PersistenceWorker::WriteXmlAtomically(doc, databaseFilePath);
 }
 
 bool FriendService::LoadFromFile() {
@@ -375,10 +387,29 @@ bool FriendService::LoadFromFile() {
         );
         request.createdAt = requestNode.attribute("createdAt").as_llong();
         
-        requestsById[request.requestId] = request;
+        if (request.status == Models::FriendRequest::Status::Pending) {
+            requestsById[request.requestId] = request;
+        } else {
+            resolvedById[request.requestId] = request;
+        }
+    }
+    
+    // Index oldest first; IDs lead with their creation time
+    std::vector<const Models::FriendRequest*> pending;
+    pending.reserve(requestsById.size());
+    for (const auto& pair : requestsById) {
+        pending.push_back(&pair.second);
+    }
+    std::sort(pending.begin(), pending.end(),
+              [](const Models::FriendRequest* a, const Models::FriendRequest* b) {
+                  return a->requestId < b->requestId;
+              });
+    for (const Models::FriendRequest* request : pending) {
+        indexRequest(*request);
     }
     
-    printf("[DB] Loaded %zu friend requests\n", requestsById.size());
+    printf("[DB] Loaded %zu pending and %zu resolved friend requests\n",
+           requestsById.size(), resolvedById.size());
     
     return true;
 }
@@ -11,6 +11,13 @@
  * - Mutual friendship (both users must agree)
  * - Limits on max friends to prevent abuse
  * 
+ * STORAGE:
+ * - Only pending requests stay in the hot map, indexed per user in both
+ *   directions, so badge counts and request lists cost O(that user's
+ *   pending requests) however much history has built up
+ * - Accepted and declined requests move to an archive that only
+ *   GetFriendRequest() and persistence read
+ * 
  * SECURITY:
  * - Cannot friend yourself
  * - Cannot send duplicate requests
@@ -19,11 +26,12 @@
  */
 
 #include <string>
-#include <map>
 #include <vector>
 #include <mutex>
 #include "Models.h"
 #include "Protocol.h"
+#include "PersistenceWorker.h"
+#include "FlatHashMap.h"
 #include "pugixml.hpp"
 
 // Forward declaration
@@ -35,8 +43,11 @@ public:
      * @brief Initialize with database path and user database reference
      * @param databasePath Path to XML storage file
      * @param userDb Reference to user database
+     * @param loadNow False to leave loading to a LoadFromFile() call, which
+     *        must finish before any other method is used; the load itself
+     *        does not touch userDb
      */
-    FriendService(const std::string& databasePath, UserDatabase& userDb);
+    FriendService(const std::string& databasePath, UserDatabase& userDb, bool loadNow = true);
     
     ~FriendService();
     
@@ -154,6 +165,11 @@ public:
     // PERSISTENCE
     // =========================================================================
     
+    /**
+     * @brief Write the database now (the persistence worker calls this)
+     *
+     * Takes serviceMutex, so never call it while holding it.
+     */
     bool SaveToFile();
     bool LoadFromFile();
     
@@ -161,21 +177,30 @@ private:
     std::string databaseFilePath;
     UserDatabase& userDatabase;
     
-    // In-memory storage
-    std::map<uint64_t, Models::FriendRequest> requestsById;
+    // Pending requests, and the pending request IDs per user, oldest first
+    FlatHashMap<uint64_t, Models::FriendRequest> requestsById;
+    FlatHashMap<uint64_t, std::vector<uint64_t>> incomingByUser;
+    FlatHashMap<uint64_t, std::vector<uint64_t>> outgoingByUser;
+    
+    // Accepted and declined requests
+    FlatHashMap<uint64_t, Models::FriendRequest> resolvedById;
     
     // Thread safety
     mutable std::mutex serviceMutex;
     
-    // Helper to check for existing pending request
-    bool HasPendingRequest(uint64_t senderId, uint64_t receiverId);
+    // Batches writes off the calling thread (declared last: its save reads the state above)
+    PersistenceWorker::Handle persistence;
     
-    // Helper to get request between two users
-    bool GetPendingRequestBetween(
-        uint64_t user1Id, 
-        uint64_t user2Id, 
-        Models::FriendRequest& outRequest
-    );
+    // Helpers below expect serviceMutex to be held (or the constructor to be running)
+    
+    // Pending request from sender to receiver, or nullptr
+    Models::FriendRequest* findPendingRequest(uint64_t senderId, uint64_t receiverId);
+    
+    void indexRequest(const Models::FriendRequest& request);
+    void unindexRequest(const Models::FriendRequest& request);
+    
+    // Move a pending request to the archive with its final status
+    void resolveRequest(uint64_t requestId, Models::FriendRequest::Status status);
 };
 
 #endif // FRIEND_SERVICE_H
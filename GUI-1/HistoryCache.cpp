@@ -0,0 +1,187 @@
+/**
+ * @file HistoryCache.cpp
+ * @brief Implementation of the client-side history cache
+ */
+
+#include "HistoryCache.h"
+#include "MessageLog.h"
+#include "Log.h"
+#define NOMINMAX
+#include <Windows.h>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char CACHE_MAGIC[8] = { 'C', 'H', 'H', 'C', 'A', 'C', 'H', 'E' };
+
+std::string EncodeEntry(uint64_t channelId, const HistoryCache::Entry& entry) {
+    MessageLog::Record record;
+    record.type = MessageLog::RecordType::Message;
+    record.message.messageId = entry.messageId;
+    record.message.channelId = channelId;
+    record.message.timestamp = entry.timestamp;
+    record.message.content = entry.content;
+    return MessageLog::EncodeRecord(record);
+}
+
+} // namespace
+
+HistoryCache::HistoryCache(const std::string& directory)
+    : m_directory(directory) {
+}
+
+std::string HistoryCache::pathFor(uint64_t channelId) const {
+    return m_directory + "\\" + std::to_string(channelId) + ".hc";
+}
+
+bool HistoryCache::ensureDirectory() {
+    if (CreateDirectoryA(m_directory.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS) {
+        return true;
+    }
+    LOG_WARNING("[CACHE] Cannot create history cache folder %s", m_directory.c_str());
+    return false;
+}
+
+HistoryCache::Channel& HistoryCache::load(uint64_t channelId) {
+    auto found = m_channels.find(channelId);
+    if (found != m_channels.end()) {
+        return found->second;
+    }
+    Channel& channel = m_channels[channelId];
+
+    std::FILE* file = nullptr;
+    if (fopen_s(&file, pathFor(channelId).c_str(), "rb") != 0 || !file) {
+        return channel;     // Nothing cached yet
+    }
+    std::string bytes;
+    char buffer[64 * 1024];
+    size_t read = 0;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.append(buffer, read);
+    }
+    std::fclose(file);
+
+    bool intact = bytes.size() >= sizeof(CACHE_MAGIC) &&
+                  std::memcmp(bytes.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0;
+    size_t pos = intact ? sizeof(CACHE_MAGIC) : bytes.size();
+    while (pos < bytes.size()) {
+        MessageLog::Record record;
+        size_t used = MessageLog::DecodeRecord(bytes.data() + pos, bytes.size() - pos, record);
+        if (used == 0 || record.type != MessageLog::RecordType::Message ||
+            record.message.channelId != channelId) {
+            intact = false;
+            break;
+        }
+        pos += used;
+        ++channel.fileRecords;
+
+        Entry entry;
+        entry.messageId = record.message.messageId;
+        entry.timestamp = record.message.timestamp;
+        entry.content = std::move(record.message.content);
+        channel.entries.push_back(std::move(entry));
+        if (channel.entries.size() > MAX_CACHED_MESSAGES) {
+            channel.entries.pop_front();
+        }
+    }
+
+    if (!intact) {
+        LOG_WARNING("[CACHE] History cache for channel %llu is damaged; keeping %zu message(s)",
+                    channelId, channel.entries.size());
+        rewrite(channelId, channel);
+    }
+    return channel;
+}
+
+const std::deque<HistoryCache::Entry>& HistoryCache::Messages(uint64_t channelId) {
+    return load(channelId).entries;
+}
+
+uint64_t HistoryCache::Cursor(uint64_t channelId) {
+    const Channel& channel = load(channelId);
+    return channel.entries.empty() ? 0 : channel.entries.back().messageId;
+}
+
+size_t HistoryCache::Append(uint64_t channelId, const std::vector<Protocol::Payloads::MessageInfo>& messages) {
+    Channel& channel = load(channelId);
+
+    std::string records;
+    size_t added = 0;
+    for (const Protocol::Payloads::MessageInfo& message : messages) {
+        // A repeated or reordered batch must not duplicate what is cached
+        if (!channel.entries.empty() && message.messageId <= channel.entries.back().messageId) {
+            continue;
+        }
+        Entry entry;
+        entry.messageId = message.messageId;
+        entry.timestamp = static_cast<std::time_t>(message.timestamp);
+        entry.content = message.content;
+        std::string encoded = EncodeEntry(channelId, entry);
+        if (encoded.empty()) {
+            continue;
+        }
+        records += encoded;
+        channel.entries.push_back(std::move(entry));
+        if (channel.entries.size() > MAX_CACHED_MESSAGES) {
+            channel.entries.pop_front();
+        }
+        ++added;
+    }
+    if (added == 0) {
+        return 0;
+    }
+
+    // Trimmed records pile up in the file until it is worth rewriting
+    if (channel.fileRecords + added > 2 * MAX_CACHED_MESSAGES || channel.fileRecords == 0) {
+        rewrite(channelId, channel);
+        return added;
+    }
+
+    std::FILE* file = nullptr;
+    if (fopen_s(&file, pathFor(channelId).c_str(), "ab") != 0 || !file) {
+        rewrite(channelId, channel);
+        return added;
+    }
+    bool written = std::fwrite(records.data(), 1, records.size(), file) == records.size();
+    written = (std::fclose(file) == 0) && written;
+    if (!written) {
+        rewrite(channelId, channel);
+        return added;
+    }
+    channel.fileRecords += added;
+    return added;
+}
+
+void HistoryCache::Clear(uint64_t channelId) {
+    m_channels.erase(channelId);
+    std::remove(pathFor(channelId).c_str());
+}
+
+bool HistoryCache::rewrite(uint64_t channelId, Channel& channel) {
+    if (!ensureDirectory()) {
+        return false;
+    }
+
+    std::string bytes(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    for (const Entry& entry : channel.entries) {
+        bytes += EncodeEntry(channelId, entry);
+    }
+
+    std::string path = pathFor(channelId);
+    std::string tempPath = path + ".tmp";
+    std::FILE* file = nullptr;
+    if (fopen_s(&file, tempPath.c_str(), "wb") != 0 || !file) {
+        LOG_WARNING("[CACHE] Failed to create %s", tempPath.c_str());
+        return false;
+    }
+    bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    written = (std::fclose(file) == 0) && written;
+    if (!written || !MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        LOG_WARNING("[CACHE] Failed to write %s", path.c_str());
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    channel.fileRecords = channel.entries.size();
+    return true;
+}
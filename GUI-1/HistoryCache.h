@@ -0,0 +1,102 @@
+#ifndef HISTORY_CACHE_H
+#define HISTORY_CACHE_H
+
+/**
+ * @file HistoryCache.h
+ * @brief Client-side on-disk cache of server history, one file per channel
+ *
+ * PURPOSE:
+ * Opening a channel used to stream its whole scrollback from the server
+ * on every connection. The client now keeps what it received, keyed by
+ * channelId, and asks a v7 server only for the messages after the newest
+ * cached one (SyncHistory). Reopening a busy channel costs the messages
+ * missed while away instead of megabytes of history.
+ *
+ * FILE LAYOUT ("<directory>/<channelId>.hc"):
+ *   [8-byte magic "CHHCACHE"]
+ *   [MessageLog record]*          oldest first
+ *
+ * Records use the MessageLog format, so every one is CRC-checked. Only
+ * server-assigned message IDs are stored; they double as the sync cursor.
+ *
+ * BOUNDS:
+ * A channel keeps its newest MAX_CACHED_MESSAGES in memory. New messages
+ * are appended to the file; once it holds twice that many records it is
+ * rewritten (temp file + rename) with just the kept ones.
+ *
+ * CRASH SAFETY:
+ * A torn or corrupt tail is dropped on load and the file rewritten. The
+ * cache is never authoritative: anything lost is fetched again by the
+ * next sync.
+ *
+ * THREADING:
+ * Not thread-safe; the lobby uses it from the UI thread only.
+ */
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <vector>
+#include "FlatHashMap.h"
+#include "Protocol.h"
+
+class HistoryCache {
+public:
+    /** One cached message, as the server sent it */
+    struct Entry {
+        uint64_t messageId = 0;
+        std::time_t timestamp = 0;
+        std::string content;        ///< As displayed, "name: text"
+    };
+
+    /** Messages kept per channel; matches what the transcript can show */
+    static constexpr size_t MAX_CACHED_MESSAGES = 1000;
+
+    /**
+     * @param directory Folder for the cache files; created on first write
+     */
+    explicit HistoryCache(const std::string& directory);
+
+    /**
+     * @brief Cached messages of a channel, oldest first
+     *
+     * Reads the channel's file the first time it is asked for.
+     */
+    const std::deque<Entry>& Messages(uint64_t channelId);
+
+    /**
+     * @brief Newest cached message ID, the cursor for SyncHistory (0 = nothing cached)
+     */
+    uint64_t Cursor(uint64_t channelId);
+
+    /**
+     * @brief Add messages a sync returned; ones at or before the cursor are ignored
+     * @return Number of messages actually added
+     */
+    size_t Append(uint64_t channelId, const std::vector<Protocol::Payloads::MessageInfo>& messages);
+
+    /**
+     * @brief Forget a channel and delete its file
+     */
+    void Clear(uint64_t channelId);
+
+private:
+    struct Channel {
+        std::deque<Entry> entries;
+        size_t fileRecords = 0;     ///< Records in the file, kept or trimmed
+    };
+
+    std::string m_directory;
+    FlatHashMap<uint64_t, Channel> m_channels;
+
+    std::string pathFor(uint64_t channelId) const;
+    Channel& load(uint64_t channelId);
+    bool rewrite(uint64_t channelId, Channel& channel);
+    bool ensureDirectory();
+
+    HistoryCache(const HistoryCache&) = delete;
+    HistoryCache& operator=(const HistoryCache&) = delete;
+};
+
+#endif // HISTORY_CACHE_H
@@ -16,36 +16,65 @@ namespace Security {
 // BASE64 ENCODING
 //=============================================================================
 
+// Invite links are decoded on every paste, join and share preview, so both
+// directions work a whole 3-byte group at a time with table lookups into a
+// presized output. Inputs are a few hundred bytes; wider SIMD paths would
+// not pay for their setup here.
+
 static const char BASE64_CHARS[] = 
     "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-std::string Base64Encode(const std::vector<uint8_t>& data) {
-    std::string result;
-    result.reserve(((data.size() + 2) / 3) * 4);
+static constexpr uint8_t BASE64_INVALID = 0xFF;
+
+struct Base64DecodeTable {
+    uint8_t values[256];
     
-    for (size_t i = 0; i < data.size(); i += 3) {
-        uint32_t n = static_cast<uint32_t>(data[i]) << 16;
-        
-        if (i + 1 < data.size()) {
-            n |= static_cast<uint32_t>(data[i + 1]) << 8;
+    constexpr Base64DecodeTable() : values() {
+        for (int i = 0; i < 256; ++i) {
+            values[i] = BASE64_INVALID;
         }
-        if (i + 2 < data.size()) {
-            n |= static_cast<uint32_t>(data[i + 2]);
+        for (int i = 0; i < 26; ++i) {
+            values['A' + i] = static_cast<uint8_t>(i);
+            values['a' + i] = static_cast<uint8_t>(26 + i);
         }
-        
-        result.push_back(BASE64_CHARS[(n >> 18) & 0x3F]);
-        result.push_back(BASE64_CHARS[(n >> 12) & 0x3F]);
-        
-        if (i + 1 < data.size()) {
-            result.push_back(BASE64_CHARS[(n >> 6) & 0x3F]);
-        } else {
-            result.push_back('=');
+        for (int i = 0; i < 10; ++i) {
+            values['0' + i] = static_cast<uint8_t>(52 + i);
         }
-        
-        if (i + 2 < data.size()) {
-            result.push_back(BASE64_CHARS[n & 0x3F]);
-        } else {
-            result.push_back('=');
+        values['+'] = 62;
+        values['/'] = 63;
+    }
+};
+
+static constexpr Base64DecodeTable BASE64_DECODE;
+
+std::string Base64Encode(ByteView data) {
+    std::string result(((data.size + 2) / 3) * 4, '=');
+    
+    const uint8_t* in = data.data;
+    char* out = &result[0];
+    size_t whole = data.size / 3 * 3;
+    
+    for (size_t i = 0; i < whole; i += 3, out += 4) {
+        uint32_t n = (static_cast<uint32_t>(in[i]) << 16) |
+                     (static_cast<uint32_t>(in[i + 1]) << 8) |
+                     static_cast<uint32_t>(in[i + 2]);
+        out[0] = BASE64_CHARS[(n >> 18) & 0x3F];
+        out[1] = BASE64_CHARS[(n >> 12) & 0x3F];
+        out[2] = BASE64_CHARS[(n >> 6) & 0x3F];
+        out[3] = BASE64_CHARS[n & 0x3F];
+    }
+    
+    // One or two trailing bytes; the rest of the quad is already '='
+    size_t tail = data.size - whole;
+    if (tail > 0) {
+        uint32_t n = static_cast<uint32_t>(in[whole]) << 16;
+        if (tail == 2) {
+            n |= static_cast<uint32_t>(in[whole + 1]) << 8;
+        }
+        out[0] = BASE64_CHARS[(n >> 18) & 0x3F];
+        out[1] = BASE64_CHARS[(n >> 12) & 0x3F];
+        if (tail == 2) {
+            out[2] = BASE64_CHARS[(n >> 6) & 0x3F];
         }
     }
     
@@ -53,43 +82,51 @@ std::string Base64Encode(const std::vector<uint8_t>& data) {
 }
 
 std::vector<uint8_t> Base64Decode(const std::string& encoded) {
-    std::vector<uint8_t> result;
-    
     if (encoded.empty() || encoded.size() % 4 != 0) {
-        return result;
+        return std::vector<uint8_t>();
     }
     
-    // Build reverse lookup
-    int lookup[256] = {-1};
-    for (int i = 0; i < 64; ++i) {
-        lookup[static_cast<unsigned char>(BASE64_CHARS[i])] = i;
+    // Padding may only end the last quad: "xx==" or "xxx="
+    size_t padding = 0;
+    if (encoded[encoded.size() - 1] == '=') {
+        padding = (encoded[encoded.size() - 2] == '=') ? 2 : 1;
     }
     
-    size_t outSize = encoded.size() / 4 * 3;
-    if (encoded[encoded.size() - 1] == '=') outSize--;
-    if (encoded[encoded.size() - 2] == '=') outSize--;
+    std::vector<uint8_t> result(encoded.size() / 4 * 3 - padding);
     
-    result.reserve(outSize);
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(encoded.data());
+    uint8_t* out = result.data();
+    size_t whole = encoded.size() - (padding > 0 ? 4 : 0);
     
-    for (size_t i = 0; i < encoded.size(); i += 4) {
-        int n = 0;
-        for (int j = 0; j < 4; ++j) {
-            char c = encoded[i + j];
-            if (c == '=') {
-                n <<= 6;
-            } else {
-                int v = lookup[static_cast<unsigned char>(c)];
-                if (v < 0) return std::vector<uint8_t>(); // Invalid character
-                n = (n << 6) | v;
-            }
+    for (size_t i = 0; i < whole; i += 4, out += 3) {
+        uint32_t a = BASE64_DECODE.values[in[i]];
+        uint32_t b = BASE64_DECODE.values[in[i + 1]];
+        uint32_t c = BASE64_DECODE.values[in[i + 2]];
+        uint32_t d = BASE64_DECODE.values[in[i + 3]];
+        
+        // Any invalid character (including '=') has the top bits set
+        if ((a | b | c | d) & 0xC0) {
+            return std::vector<uint8_t>();
         }
         
-        result.push_back(static_cast<uint8_t>((n >> 16) & 0xFF));
-        if (encoded[i + 2] != '=') {
-            result.push_back(static_cast<uint8_t>((n >> 8) & 0xFF));
+        uint32_t n = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = static_cast<uint8_t>(n >> 16);
+        out[1] = static_cast<uint8_t>(n >> 8);
+        out[2] = static_cast<uint8_t>(n);
+    }
+    
+    if (padding > 0) {
+        uint32_t a = BASE64_DECODE.values[in[whole]];
+        uint32_t b = BASE64_DECODE.values[in[whole + 1]];
+        uint32_t c = (padding == 1) ? BASE64_DECODE.values[in[whole + 2]] : 0;
+        if ((a | b | c) & 0xC0) {
+            return std::vector<uint8_t>();
         }
-        if (encoded[i + 3] != '=') {
-            result.push_back(static_cast<uint8_t>(n & 0xFF));
+        
+        uint32_t n = (a << 18) | (b << 12) | (c << 6);
+        out[0] = static_cast<uint8_t>(n >> 16);
+        if (padding == 1) {
+            out[1] = static_cast<uint8_t>(n >> 8);
         }
     }
     
@@ -117,46 +154,20 @@ const char* TokenStatusToString(TokenStatus status) {
 // INVITE TOKEN IMPLEMENTATION
 //=============================================================================
 
-std::vector<uint8_t> InviteToken::GetSignableData() const {
-    std::vector<uint8_t> data;
-    
-    // Reserve space for efficiency
-    data.reserve(TOKEN_ID_SIZE + SERVER_ID_SIZE + 8 + 8 + 8 + 4 + 8);
-    
-    // Token ID
-    data.insert(data.end(), tokenId.begin(), tokenId.end());
-    
-    // Server ID
-    data.insert(data.end(), serverId.begin(), serverId.end());
-    
-    // Created by (uint64_t, little endian)
-    for (int i = 0; i < 8; ++i) {
-        data.push_back(static_cast<uint8_t>((createdBy >> (i * 8)) & 0xFF));
-    }
-    
-    // Created at (time_t as int64_t)
-    int64_t createdAtInt = static_cast<int64_t>(createdAt);
-    for (int i = 0; i < 8; ++i) {
-        data.push_back(static_cast<uint8_t>((createdAtInt >> (i * 8)) & 0xFF));
-    }
-    
-    // Expires at (time_t as int64_t)
-    int64_t expiresAtInt = static_cast<int64_t>(expiresAt);
-    for (int i = 0; i < 8; ++i) {
-        data.push_back(static_cast<uint8_t>((expiresAtInt >> (i * 8)) & 0xFF));
-    }
-    
-    // Max uses (uint32_t)
-    for (int i = 0; i < 4; ++i) {
-        data.push_back(static_cast<uint8_t>((maxUses >> (i * 8)) & 0xFF));
-    }
-    
-    // Permissions (uint64_t)
-    uint64_t perms = static_cast<uint64_t>(permissions);
-    for (int i = 0; i < 8; ++i) {
-        data.push_back(static_cast<uint8_t>((perms >> (i * 8)) & 0xFF));
-    }
-    
+void InviteToken::writeSignableData(ByteWriter& writer) const {
+    writer.Bytes(tokenId);
+    writer.Bytes(serverId);
+    writer.U64(createdBy);
+    writer.I64(static_cast<int64_t>(createdAt));
+    writer.I64(static_cast<int64_t>(expiresAt));
+    writer.U32(maxUses);
+    writer.U64(static_cast<uint64_t>(permissions));
+}
+
+std::array<uint8_t, InviteToken::SIGNABLE_SIZE> InviteToken::GetSignableData() const {
+    std::array<uint8_t, SIGNABLE_SIZE> data;
+    ByteWriter writer(data);
+    writeSignableData(writer);
     return data;
 }
 
@@ -192,8 +203,7 @@ std::optional<InviteToken> InviteToken::Create(
     token.permissions = permissions;
     
     // Sign the token
-    std::vector<uint8_t> signableData = token.GetSignableData();
-    result = serverIdentity.Sign(signableData, token.signature);
+    result = serverIdentity.Sign(token.GetSignableData(), token.signature);
     
     if (result != CryptoResult::Success) {
         printf("[INVITE] Failed to sign token: %s\n", CryptoResultToString(result));
@@ -208,66 +218,32 @@ std::optional<InviteToken> InviteToken::Create(
     return token;
 }
 
-std::optional<InviteToken> InviteToken::Parse(const std::vector<uint8_t>& data) {
-    // Minimum size: tokenId + serverId + metadata + signature
-    constexpr size_t MIN_SIZE = TOKEN_ID_SIZE + SERVER_ID_SIZE + 8 + 8 + 8 + 4 + 8 + SIGNATURE_SIZE;
-    
-    if (data.size() < MIN_SIZE) {
-        printf("[INVITE] Token data too small: %zu bytes (need %zu)\n", data.size(), MIN_SIZE);
+std::optional<InviteToken> InviteToken::Parse(ByteView data) {
+    if (data.size < SERIALIZED_SIZE) {
+        printf("[INVITE] Token data too small: %zu bytes (need %zu)\n", data.size, SERIALIZED_SIZE);
         return std::nullopt;
     }
     
     InviteToken token;
-    size_t offset = 0;
-    
-    // Read token ID
-    std::copy_n(data.begin() + offset, TOKEN_ID_SIZE, token.tokenId.begin());
-    offset += TOKEN_ID_SIZE;
-    
-    // Read server ID
-    std::copy_n(data.begin() + offset, SERVER_ID_SIZE, token.serverId.begin());
-    offset += SERVER_ID_SIZE;
-    
-    // Read created by
-    token.createdBy = 0;
-    for (int i = 0; i < 8; ++i) {
-        token.createdBy |= static_cast<uint64_t>(data[offset + i]) << (i * 8);
-    }
-    offset += 8;
+    ByteReader reader(data);
     
-    // Read created at
     int64_t createdAtInt = 0;
-    for (int i = 0; i < 8; ++i) {
-        createdAtInt |= static_cast<int64_t>(data[offset + i]) << (i * 8);
-    }
-    token.createdAt = static_cast<std::time_t>(createdAtInt);
-    offset += 8;
-    
-    // Read expires at
     int64_t expiresAtInt = 0;
-    for (int i = 0; i < 8; ++i) {
-        expiresAtInt |= static_cast<int64_t>(data[offset + i]) << (i * 8);
-    }
-    token.expiresAt = static_cast<std::time_t>(expiresAtInt);
-    offset += 8;
+    uint64_t perms = 0;
     
-    // Read max uses
-    token.maxUses = 0;
-    for (int i = 0; i < 4; ++i) {
-        token.maxUses |= static_cast<uint32_t>(data[offset + i]) << (i * 8);
-    }
-    offset += 4;
+    // Length was checked above, so every read succeeds
+    reader.Bytes(token.tokenId);
+    reader.Bytes(token.serverId);
+    reader.U64(token.createdBy);
+    reader.I64(createdAtInt);
+    reader.I64(expiresAtInt);
+    reader.U32(token.maxUses);
+    reader.U64(perms);
+    reader.Bytes(token.signature);
     
-    // Read permissions
-    uint64_t perms = 0;
-    for (int i = 0; i < 8; ++i) {
-        perms |= static_cast<uint64_t>(data[offset + i]) << (i * 8);
-    }
+    token.createdAt = static_cast<std::time_t>(createdAtInt);
+    token.expiresAt = static_cast<std::time_t>(expiresAtInt);
     token.permissions = static_cast<InvitePermission>(perms);
-    offset += 8;
-    
-    // Read signature
-    std::copy_n(data.begin() + offset, SIGNATURE_SIZE, token.signature.begin());
     
     return token;
 }
@@ -281,6 +257,15 @@ std::optional<InviteToken> InviteToken::FromBase64(const std::string& encoded) {
 }
 
 TokenStatus InviteToken::Validate(const ServerIdentity& serverIdentity) const {
+    TokenStatus status = CheckConstraints(serverIdentity);
+    if (status != TokenStatus::Valid) {
+        return status;
+    }
+    
+    return VerifySignature(serverIdentity) ? TokenStatus::Valid : TokenStatus::InvalidSignature;
+}
+
+TokenStatus InviteToken::CheckConstraints(const ServerIdentity& serverIdentity) const {
     // Check server ID matches
     if (serverId != serverIdentity.GetServerId()) {
         return TokenStatus::WrongServer;
@@ -291,20 +276,31 @@ TokenStatus InviteToken::Validate(const ServerIdentity& serverIdentity) const {
         return TokenStatus::Expired;
     }
     
-    // Verify signature
-    std::vector<uint8_t> signableData = GetSignableData();
-    CryptoResult result = serverIdentity.Verify(signableData, signature);
+    return TokenStatus::Valid;
+}
+
+bool InviteToken::VerifySignature(const ServerIdentity& serverIdentity) const {
+    return serverIdentity.Verify(GetSignableData(), signature) == CryptoResult::Success;
+}
+
+std::string InviteToken::GetDigest() const {
+    std::array<uint8_t, SERIALIZED_SIZE> data;
+    ByteWriter writer(data);
+    writeSignableData(writer);
+    writer.Bytes(signature);
     
-    if (result != CryptoResult::Success) {
-        return TokenStatus::InvalidSignature;
+    std::array<uint8_t, 32> digest;
+    if (ComputeSHA256(data, digest) != CryptoResult::Success) {
+        return std::string();
     }
-    
-    return TokenStatus::Valid;
+    return std::string(reinterpret_cast<const char*>(digest.data()), digest.size());
 }
 
 std::vector<uint8_t> InviteToken::Serialize() const {
-    std::vector<uint8_t> data = GetSignableData();
-    data.insert(data.end(), signature.begin(), signature.end());
+    std::vector<uint8_t> data(SERIALIZED_SIZE);
+    ByteWriter writer(data);
+    writeSignableData(writer);
+    writer.Bytes(signature);
     return data;
 }
 
@@ -335,27 +331,114 @@ bool InviteToken::IsForServer(const std::array<uint8_t, SERVER_ID_SIZE>& sid) co
     return serverId == sid;
 }
 
+//=============================================================================
+// REVOCATION FILTER
+//=============================================================================
+
+uint64_t InviteManager::RevocationFilter::HashOf(const std::string& tokenIdHex) {
+    // FNV-1a, then a final mix so both 32-bit halves are usable probes
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : tokenIdHex) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void InviteManager::RevocationFilter::Rebuild(const FlatHashMap<std::string, std::time_t>& revoked) {
+    size_t bits = MIN_BITS;
+    while (bits < revoked.size() * BITS_PER_ENTRY * 2) {
+        bits *= 2;
+    }
+    words.assign(bits / 64, 0);
+    
+    for (const auto& pair : revoked) {
+        Add(pair.first);
+    }
+}
+
+void InviteManager::RevocationFilter::Add(const std::string& tokenIdHex) {
+    if (words.empty()) {
+        words.assign(MIN_BITS / 64, 0);
+    }
+    
+    uint64_t hash = HashOf(tokenIdHex);
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    size_t mask = words.size() * 64 - 1;
+    
+    for (int i = 0; i < HASH_COUNT; ++i) {
+        size_t bit = (h1 + static_cast<uint32_t>(i) * h2) & mask;
+        words[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+bool InviteManager::RevocationFilter::MightContain(const std::string& tokenIdHex) const {
+    if (words.empty()) {
+        return false;
+    }
+    
+    uint64_t hash = HashOf(tokenIdHex);
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    size_t mask = words.size() * 64 - 1;
+    
+    for (int i = 0; i < HASH_COUNT; ++i) {
+        size_t bit = (h1 + static_cast<uint32_t>(i) * h2) & mask;
+        if ((words[bit / 64] & (1ULL << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InviteManager::RevocationFilter::NeedsRebuild(size_t revokedCount) const {
+    return revokedCount * BITS_PER_ENTRY > words.size() * 64;
+}
+
 //=============================================================================
 // INVITE MANAGER IMPLEMENTATION
 //=============================================================================
 
+/**
+ * @brief "<name>.xml" -> "<name>.audit"
+ */
+static std::string AuditPathFor(const std::string& dataFilePath) {
+    std::string base = dataFilePath;
+    if (base.size() > 4 && base.compare(base.size() - 4, 4, ".xml") == 0) {
+        base.resize(base.size() - 4);
+    }
+    return base + ".audit";
+}
+
 InviteManager::InviteManager(const std::string& dataFilePath)
-    : dataFilePath(dataFilePath) {
+    : dataFilePath(dataFilePath)
+    , auditLog(AuditPathFor(dataFilePath))
+    , persistence("invite tokens", [this] { return SaveToFile(); })
+    , auditPersistence("invite audit log", [this] {
+          std::lock_guard<std::mutex> lock(managerMutex);
+          return auditLog.Flush();
+      }) {
     LoadFromFile();
 }
 
 InviteManager::~InviteManager() {
-    SaveToFile();
+    auditPersistence.Close();
+    persistence.Close();
 }
 
 void InviteManager::LogAudit(const std::string& tokenIdHex, uint64_t userId, 
                              const std::string& action) {
-    AuditEntry entry;
+    AuditLog::Entry entry;
     entry.timestamp = std::time(nullptr);
-    entry.tokenIdHex = tokenIdHex;
+    entry.subject = tokenIdHex;
     entry.userId = userId;
     entry.action = action;
-    auditLog.push_back(entry);
+    auditLog.Append(entry);
+    auditPersistence.MarkDirty();
     
     printf("[AUDIT] Token %s: %s by user %llu\n", 
            tokenIdHex.c_str(), action.c_str(), userId);
@@ -368,6 +451,8 @@ std::optional<InviteToken> InviteManager::CreateInvite(
     uint32_t maxUses,
     InvitePermission permissions) {
     
+    std::lock_guard<std::mutex> lock(managerMutex);
+    
     auto token = InviteToken::Create(serverIdentity, createdBy, 
                                      expiresInSeconds, maxUses, permissions);
     
@@ -375,10 +460,10 @@ std::optional<InviteToken> InviteManager::CreateInvite(
         // Track usage if limited
         if (maxUses > 0) {
             tokenUsage[token->GetTokenIdHex()] = maxUses;
+            persistence.MarkDirty();
         }
         
         LogAudit(token->GetTokenIdHex(), createdBy, "created");
-        SaveToFile();
     }
     
     return token;
@@ -389,10 +474,12 @@ TokenStatus InviteManager::ValidateAndConsume(
     const ServerIdentity& serverIdentity,
     uint64_t newUserId) {
     
+    std::lock_guard<std::mutex> lock(managerMutex);
+    
     std::string tokenIdHex = token.GetTokenIdHex();
     
     // Check if revoked
-    if (IsRevoked(token.GetTokenId())) {
+    if (isRevokedLocked(tokenIdHex)) {
         LogAudit(tokenIdHex, newUserId, "rejected (revoked)");
         return TokenStatus::Revoked;
     }
@@ -406,8 +493,8 @@ TokenStatus InviteManager::ValidateAndConsume(
         }
     }
     
-    // Validate token cryptographically
-    TokenStatus status = token.Validate(serverIdentity);
+    // Validate token cryptographically (skipped for tokens verified before)
+    TokenStatus status = validateCached(token, serverIdentity);
     if (status != TokenStatus::Valid) {
         LogAudit(tokenIdHex, newUserId, "rejected (" + std::string(TokenStatusToString(status)) + ")");
         return status;
@@ -418,37 +505,84 @@ TokenStatus InviteManager::ValidateAndConsume(
         auto it = tokenUsage.find(tokenIdHex);
         if (it != tokenUsage.end() && it->second > 0) {
             it->second--;
+            persistence.MarkDirty();
         }
     }
     
     LogAudit(tokenIdHex, newUserId, "used");
-    SaveToFile();
+    
+    return TokenStatus::Valid;
+}
+
+bool InviteManager::isRevokedLocked(const std::string& tokenIdHex) const {
+    if (!revocationFilter.MightContain(tokenIdHex)) {
+        return false;
+    }
+    return revokedTokens.find(tokenIdHex) != revokedTokens.end();
+}
+
+TokenStatus InviteManager::validateCached(const InviteToken& token, const ServerIdentity& serverIdentity) {
+    TokenStatus status = token.CheckConstraints(serverIdentity);
+    if (status != TokenStatus::Valid) {
+        return status;
+    }
+    
+    std::string digest = token.GetDigest();
+    if (!digest.empty()) {
+        auto cached = verifiedTokens.find(digest);
+        if (cached != verifiedTokens.end()) {
+            verifiedOrder.splice(verifiedOrder.begin(), verifiedOrder, cached->second);
+            return TokenStatus::Valid;
+        }
+    }
+    
+    if (!token.VerifySignature(serverIdentity)) {
+        return TokenStatus::InvalidSignature;
+    }
+    
+    if (!digest.empty()) {
+        if (verifiedOrder.size() >= VERIFIED_CACHE_SIZE) {
+            verifiedTokens.erase(verifiedOrder.back());
+            verifiedOrder.pop_back();
+        }
+        verifiedOrder.push_front(digest);
+        verifiedTokens.emplace(digest, verifiedOrder.begin());
+    }
     
     return TokenStatus::Valid;
 }
 
 bool InviteManager::RevokeInvite(const std::array<uint8_t, TOKEN_ID_SIZE>& tokenId,
                                   uint64_t revokedBy) {
+    std::lock_guard<std::mutex> lock(managerMutex);
+    
     std::string tokenIdHex = BytesToHex(tokenId.data(), TOKEN_ID_SIZE);
     
     // Check if already revoked
-    if (revokedTokens.find(tokenIdHex) != revokedTokens.end()) {
+    if (isRevokedLocked(tokenIdHex)) {
         return false;
     }
     
     revokedTokens[tokenIdHex] = std::time(nullptr);
+    if (revocationFilter.NeedsRebuild(revokedTokens.size())) {
+        revocationFilter.Rebuild(revokedTokens);
+    } else {
+        revocationFilter.Add(tokenIdHex);
+    }
     LogAudit(tokenIdHex, revokedBy, "revoked");
-    SaveToFile();
+    persistence.MarkDirty();
     
     return true;
 }
 
 bool InviteManager::IsRevoked(const std::array<uint8_t, TOKEN_ID_SIZE>& tokenId) const {
+    std::lock_guard<std::mutex> lock(managerMutex);
     std::string tokenIdHex = BytesToHex(tokenId.data(), TOKEN_ID_SIZE);
-    return revokedTokens.find(tokenIdHex) != revokedTokens.end();
+    return isRevokedLocked(tokenIdHex);
 }
 
 int InviteManager::GetRemainingUses(const std::array<uint8_t, TOKEN_ID_SIZE>& tokenId) const {
+    std::lock_guard<std::mutex> lock(managerMutex);
     std::string tokenIdHex = BytesToHex(tokenId.data(), TOKEN_ID_SIZE);
     auto it = tokenUsage.find(tokenIdHex);
     if (it == tokenUsage.end()) {
@@ -457,7 +591,14 @@ int InviteManager::GetRemainingUses(const std::array<uint8_t, TOKEN_ID_SIZE>& to
     return static_cast<int>(it->second);
 }
 
-void InviteManager::SaveToFile() {
+std::vector<AuditLog::Entry> InviteManager::GetRecentAudit(size_t maxCount) const {
+    std::lock_guard<std::mutex> lock(managerMutex);
+    return auditLog.GetRecent(maxCount);
+}
+
+bool InviteManager::SaveToFile() {
+    std::unique_lock<std::mutex> lock(managerMutex);
+    
     pugi::xml_document doc;
     auto root = doc.append_child("InviteManager");
     
@@ -477,22 +618,14 @@ void InviteManager::SaveToFile() {
         entry.append_attribute("revokedAt") = static_cast<long long>(pair.second);
     }
     
-    // Save audit log (last 1000 entries)
-    auto auditNode = root.append_child("AuditLog");
-    size_t startIdx = auditLog.size() > 1000 ? auditLog.size() - 1000 : 0;
-    for (size_t i = startIdx; i < auditLog.size(); ++i) {
-        const auto& entry = auditLog[i];
-        auto entryNode = auditNode.append_child("Entry");
-        entryNode.append_attribute("timestamp") = static_cast<long long>(entry.timestamp);
-        entryNode.append_attribute("tokenId") = entry.tokenIdHex.c_str();
-        entryNode.append_attribute("userId") = entry.userId;
-        entryNode.append_attribute("action") = entry.action.c_str();
-    }
+    lock.unlock();
     
-    doc.save_file(dataFilePath.c_str());
+    return PersistenceWorker::WriteXmlAtomically(doc, dataFilePath);
 }
 
 void InviteManager::LoadFromFile() {
+    std::lock_guard<std::mutex> lock(managerMutex);
+    
     pugi::xml_document doc;
     if (!doc.load_file(dataFilePath.c_str())) {
         return; // File doesn't exist yet
@@ -516,20 +649,26 @@ void InviteManager::LoadFromFile() {
         std::time_t revokedAt = entry.attribute("revokedAt").as_llong();
         revokedTokens[id] = revokedAt;
     }
+    revocationFilter.Rebuild(revokedTokens);
     
-    // Load audit log
-    auditLog.clear();
+    // Older files kept the audit log in the XML; move it to the audit log
+    size_t imported = 0;
     for (auto entry : root.child("AuditLog").children("Entry")) {
-        AuditEntry ae;
+        AuditLog::Entry ae;
         ae.timestamp = entry.attribute("timestamp").as_llong();
-        ae.tokenIdHex = entry.attribute("tokenId").as_string();
+        ae.subject = entry.attribute("tokenId").as_string();
         ae.userId = entry.attribute("userId").as_ullong();
         ae.action = entry.attribute("action").as_string();
-        auditLog.push_back(ae);
+        auditLog.Append(ae);
+        ++imported;
+    }
+    if (imported > 0) {
+        auditPersistence.MarkDirty();
+        persistence.MarkDirty();    // Rewrite the XML without them
     }
     
-    printf("[INVITE] Loaded %zu tokens, %zu revoked, %zu audit entries\n",
-           tokenUsage.size(), revokedTokens.size(), auditLog.size());
+    printf("[INVITE] Loaded %zu tokens, %zu revoked, %zu legacy audit entries\n",
+           tokenUsage.size(), revokedTokens.size(), imported);
 }
 
 } // namespace Security
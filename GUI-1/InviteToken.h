@@ -37,10 +37,14 @@
 #define INVITE_TOKEN_H
 
 #include "ServerIdentity.h"
+#include "PersistenceWorker.h"
+#include "FlatHashMap.h"
+#include "AuditLog.h"
 #include <string>
 #include <vector>
 #include <array>
-#include <map>
+#include <list>
+#include <mutex>
 #include <cstdint>
 #include <ctime>
 #include <optional>
@@ -119,6 +123,12 @@ const char* TokenStatusToString(TokenStatus status);
  */
 class InviteToken {
 public:
+    /** @brief Bytes covered by the signature */
+    static constexpr size_t SIGNABLE_SIZE = TOKEN_ID_SIZE + SERVER_ID_SIZE + 8 + 8 + 8 + 4 + 8;
+    
+    /** @brief Bytes of Serialize() output */
+    static constexpr size_t SERIALIZED_SIZE = SIGNABLE_SIZE + SIGNATURE_SIZE;
+    
     /**
      * @brief Create a new invite token
      * @param serverIdentity Server's identity (needs private key for signing)
@@ -141,7 +151,7 @@ public:
      * @param data Serialized token bytes
      * @return Parsed token (not yet validated)
      */
-    static std::optional<InviteToken> Parse(const std::vector<uint8_t>& data);
+    static std::optional<InviteToken> Parse(ByteView data);
     
     /**
      * @brief Parse a token from base64 string
@@ -165,6 +175,24 @@ public:
      */
     TokenStatus Validate(const ServerIdentity& serverIdentity) const;
     
+    /**
+     * @brief The cheap half of Validate(): server ID and expiry only
+     */
+    TokenStatus CheckConstraints(const ServerIdentity& serverIdentity) const;
+    
+    /**
+     * @brief The expensive half of Validate(): the ECDSA signature check
+     */
+    bool VerifySignature(const ServerIdentity& serverIdentity) const;
+    
+    /**
+     * @brief SHA-256 of the serialized token (signed fields + signature)
+     *
+     * Identifies this exact token, so a verified signature can be
+     * remembered by digest.
+     */
+    std::string GetDigest() const;
+    
     /**
      * @brief Serialize token to bytes
      */
@@ -224,7 +252,9 @@ private:
     /**
      * @brief Get the data that should be signed
      */
-    std::vector<uint8_t> GetSignableData() const;
+    std::array<uint8_t, SIGNABLE_SIZE> GetSignableData() const;
+    
+    void writeSignableData(ByteWriter& writer) const;
 };
 
 /**
@@ -235,6 +265,21 @@ private:
  * - Usage counts
  * - Revoked tokens
  * - Audit log
+ * 
+ * REPEAT REDEMPTIONS:
+ * One invite link is often redeemed by many users. The digests of tokens
+ * whose signature verified are kept in an LRU of VERIFIED_CACHE_SIZE, so
+ * later redemptions of the same token only hash it instead of running
+ * ECDSA again. Expiry and server ID are still checked on every call.
+ * 
+ * AUDIT:
+ * Audit entries go to an AuditLog next to the data file (one O(1) append
+ * each), not to the XML, so the XML only holds usage counts and
+ * revocations. Entries found in an old XML file are moved to the log.
+ * 
+ * Revocation is checked through a Bloom filter first. Almost every token
+ * presented was never revoked, and the filter proves that with a few bit
+ * tests; only a filter hit looks the token up in revokedTokens.
  */
 class InviteManager {
 public:
@@ -294,9 +339,16 @@ public:
     int GetRemainingUses(const std::array<uint8_t, TOKEN_ID_SIZE>& tokenId) const;
     
     /**
-     * @brief Save state to file
+     * @brief Newest audit entries (created, used, rejected, revoked), oldest first
      */
-    void SaveToFile();
+    std::vector<AuditLog::Entry> GetRecentAudit(size_t maxCount = 100) const;
+    
+    /**
+     * @brief Save state to file now (the persistence worker calls this)
+     *
+     * Takes managerMutex, so never call it while holding it.
+     */
+    bool SaveToFile();
     
     /**
      * @brief Load state from file
@@ -307,27 +359,66 @@ private:
     std::string dataFilePath;
     
     // Token usage tracking: tokenId -> remaining uses
-    std::map<std::string, uint32_t> tokenUsage;
+    FlatHashMap<std::string, uint32_t> tokenUsage;
     
     // Revoked tokens: tokenId hex -> revocation time
-    std::map<std::string, std::time_t> revokedTokens;
-    
-    // Audit log entry
-    struct AuditEntry {
-        std::time_t timestamp;
-        std::string tokenIdHex;
-        uint64_t userId;
-        std::string action;  // "created", "used", "revoked"
+    FlatHashMap<std::string, std::time_t> revokedTokens;
+    
+    /**
+     * @brief Bloom filter over the revoked token IDs
+     *
+     * No false negatives, so MightContain() == false means "not revoked".
+     * Rebuilt at twice BITS_PER_ENTRY bits per revoked token, and again
+     * once NeedsRebuild() says it is down to BITS_PER_ENTRY; with
+     * HASH_COUNT probes that keeps false positives under about 2.5%.
+     */
+    class RevocationFilter {
+    public:
+        void Rebuild(const FlatHashMap<std::string, std::time_t>& revoked);
+        void Add(const std::string& tokenIdHex);
+        bool MightContain(const std::string& tokenIdHex) const;
+        bool NeedsRebuild(size_t revokedCount) const;
+        
+    private:
+        static constexpr size_t BITS_PER_ENTRY = 8;
+        static constexpr size_t MIN_BITS = 1024;
+        static constexpr int HASH_COUNT = 4;
+        
+        std::vector<uint64_t> words;    // Bit count is words.size() * 64, a power of two
+        
+        static uint64_t HashOf(const std::string& tokenIdHex);
     };
-    std::vector<AuditEntry> auditLog;
+    RevocationFilter revocationFilter;
+    
+    // Digests of tokens whose signature verified, most recently used first
+    static constexpr size_t VERIFIED_CACHE_SIZE = 1024;
+    std::list<std::string> verifiedOrder;
+    FlatHashMap<std::string, std::list<std::string>::iterator> verifiedTokens;
+    
+    // Rotating audit trail; appended under managerMutex
+    AuditLog auditLog;
+    
+    // Guards the state above; the persistence worker reads it off-thread
+    mutable std::mutex managerMutex;
+    
+    // Batch writes off the calling thread (declared last: their saves read the state above)
+    PersistenceWorker::Handle persistence;
+    PersistenceWorker::Handle auditPersistence;
     
     void LogAudit(const std::string& tokenIdHex, uint64_t userId, const std::string& action);
+    
+    // Helpers below expect managerMutex to be held
+    bool isRevokedLocked(const std::string& tokenIdHex) const;
+    TokenStatus validateCached(const InviteToken& token, const ServerIdentity& serverIdentity);
 };
 
 /**
- * @brief Base64 encoding utilities
+ * @brief Base64 encoding utilities (standard alphabet, '=' padded)
+ *
+ * Base64Decode returns an empty vector if the input has a character
+ * outside the alphabet, misplaced padding, or a length not divisible by 4.
  */
-std::string Base64Encode(const std::vector<uint8_t>& data);
+std::string Base64Encode(ByteView data);
 std::vector<uint8_t> Base64Decode(const std::string& encoded);
 
 } // namespace Security
@@ -0,0 +1,49 @@
+/**
+ * @file IoBackend.cpp
+ * @brief Picks the event backend for this platform
+ */
+
+#include "IoBackend.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#include "IocpEngine.h"
+#endif
+#ifdef __linux__
+#include "EpollBackend.h"
+#include "IoUringBackend.h"
+#endif
+
+namespace NetProtocol {
+
+std::unique_ptr<IoBackend> IoBackend::Create(SOCKET listenSocket, Kind kind, size_t pendingAccepts) {
+#ifdef _WIN32
+    if (kind == Kind::Default || kind == Kind::Iocp) {
+        return std::make_unique<IocpEngine>(listenSocket, pendingAccepts);
+    }
+#elif defined(__linux__)
+    (void)pendingAccepts;   // Both Linux backends keep accepting without a pool
+    if (kind == Kind::IoUring || (kind == Kind::Default && IoUringBackend::Supported())) {
+        return std::make_unique<IoUringBackend>(listenSocket);
+    }
+    if (kind == Kind::Default || kind == Kind::Epoll) {
+        return std::make_unique<EpollBackend>(listenSocket);
+    }
+#else
+    (void)listenSocket;
+    (void)pendingAccepts;
+#endif
+    throw std::runtime_error(std::string("No ") + KindName(kind) + " event backend on this platform");
+}
+
+const char* IoBackend::KindName(Kind kind) {
+    switch (kind) {
+    case Kind::Iocp:    return "IOCP";
+    case Kind::Epoll:   return "epoll";
+    case Kind::IoUring: return "io_uring";
+    case Kind::Default:
+    default:            return "default";
+    }
+}
+
+} // namespace NetProtocol
@@ -0,0 +1,138 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+/**
+ * @file IoBackend.h
+ * @brief The event engine interface the server core is written against
+ *
+ * PURPOSE:
+ * ServerSocket used to drive an IocpEngine directly, which tied the
+ * server to Windows. It now sees only this interface, with one
+ * implementation per platform mechanism:
+ * - IocpEngine: completion port, AcceptEx, zero-byte reads (Windows)
+ * - EpollBackend: readiness notification and non-blocking writev (Linux)
+ * - IoUringBackend: multishot accept and receive into a ring of
+ *   registered (provided) buffers, sendmsg completions (Linux 6.0+)
+ *
+ * EVENT MODEL (the IOCP one; the others emulate it):
+ * - Accepted: a new connection; the socket now belongs to the caller
+ * - Readable: input is waiting. Drain the socket with non-blocking reads,
+ *   then Rearm() it for the next notification
+ * - Received: DeliversData() backends only. The kernel has already read
+ *   into a buffer, passed as data/bytes; bytes == 0 is end of stream.
+ *   The data stays valid until the next Poll(). Such a backend owns the
+ *   socket's reads: the caller must not recv() itself (see
+ *   FrameDecoder::SetExternalInput()), and Rearm() is a no-op
+ * - SendComplete / SendFailed: the one PostSend() in flight finished
+ * - Closed: the connection failed while nothing was being sent
+ * - Wakeup: Wake() was called
+ *
+ * OWNERSHIP:
+ * Backends never close client sockets. Remove() a socket before closing
+ * it; events already dequeued for it may still be reported once.
+ *
+ * THREADING:
+ * Poll() and everything else from one thread; Wake() from any thread.
+ */
+
+#include "NetPlatform.h"
+#include "FrameBuffer.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace NetProtocol {
+
+class IoBackend {
+public:
+    enum class Kind {
+        Default,    ///< Best available: IOCP on Windows, io_uring (else epoll) on Linux
+        Iocp,
+        Epoll,
+        IoUring
+    };
+
+    enum class EventType {
+        Accepted,     ///< A new connection is ready; socket ownership moves to caller
+        Readable,     ///< Data (or EOF) is waiting on a registered client socket
+        Received,     ///< Data (or EOF, bytes == 0) was read for the caller
+        Closed,       ///< The pending read failed; the connection is gone
+        SendComplete, ///< A posted send finished; bytes holds the count
+        SendFailed,   ///< A posted send failed; the connection is gone
+        Wakeup        ///< Wake() was called
+    };
+
+    struct Event {
+        EventType type;
+        SOCKET socket;
+        size_t bytes;                   ///< Bytes transferred (SendComplete, Received)
+        const char* data = nullptr;     ///< Received only; valid until the next Poll()
+    };
+
+    /** Bytes pinned for the lifetime of a posted send */
+    using SendBuffer = FrameBuffer;
+
+    /** Accepts kept outstanding on the listener, where the mechanism has such a thing */
+    static constexpr size_t DEFAULT_PENDING_ACCEPTS = 16;
+
+    /**
+     * @brief Create a backend for a bound, listening socket (not owned)
+     * @param kind Default picks the best one this machine supports
+     * @throws std::runtime_error if the backend is unavailable or fails to start
+     */
+    static std::unique_ptr<IoBackend> Create(SOCKET listenSocket, Kind kind = Kind::Default,
+                                             size_t pendingAccepts = DEFAULT_PENDING_ACCEPTS);
+
+    static const char* KindName(Kind kind);
+
+    virtual ~IoBackend() = default;
+
+    virtual Kind GetKind() const = 0;
+
+    /** @brief True if input arrives as Received events rather than Readable */
+    virtual bool DeliversData() const { return false; }
+
+    /**
+     * @brief Register a client socket and arm its first read notification
+     * @return True if the socket was registered
+     */
+    virtual bool Associate(SOCKET clientSocket) = 0;
+
+    /**
+     * @brief Re-arm the read notification after a Readable event was handled
+     * @return False if the connection is gone
+     */
+    virtual bool Rearm(SOCKET clientSocket) = 0;
+
+    /**
+     * @brief Start a scatter/gather send
+     *
+     * Only one send per socket may be in flight; wait for SendComplete
+     * before posting the next batch. A backend may finish the send
+     * immediately, but reports it from the next Poll() all the same.
+     *
+     * @param buffers Descriptors of the data (copied)
+     * @param keepAlive Owners of the memory behind buffers; held until completion
+     * @return False if the send could not be started
+     */
+    virtual bool PostSend(SOCKET clientSocket, const std::vector<WSABUF>& buffers,
+                          std::vector<SendBuffer> keepAlive) = 0;
+
+    /** @brief Stop reporting events for a socket (call before closing it) */
+    virtual void Remove(SOCKET clientSocket) = 0;
+
+    /**
+     * @brief Wait for work and translate it into events
+     * @param outEvents Cleared, then filled
+     * @param timeoutMs How long to block if nothing is ready (0 = don't block)
+     * @return Number of events produced
+     */
+    virtual size_t Poll(std::vector<Event>& outEvents, uint32_t timeoutMs) = 0;
+
+    /** @brief Interrupt a Poll() that is blocked on another thread */
+    virtual void Wake() = 0;
+};
+
+} // namespace NetProtocol
+
+#endif // IO_BACKEND_H
@@ -0,0 +1,557 @@
+/**
+ * @file IoUringBackend.cpp
+ * @brief Implementation of the io_uring event backend
+ */
+
+#ifdef __linux__
+
+#include "IoUringBackend.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+namespace {
+
+    constexpr uint16_t BUFFER_GROUP = 0;
+    constexpr int OPERATION_SHIFT = 56;
+
+    int SetupRing(unsigned entries, io_uring_params& params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+
+    int EnterRing(int ring, unsigned toSubmit, unsigned minComplete, unsigned flags,
+                  const void* argument, size_t argumentSize) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags,
+                                        argument, argumentSize));
+    }
+
+    int RegisterRing(int ring, unsigned opcode, const void* argument, unsigned count) {
+        return static_cast<int>(syscall(__NR_io_uring_register, ring, opcode, argument, count));
+    }
+
+    bool KernelAtLeast(int major, int minor) {
+        utsname name = {};
+        if (uname(&name) != 0) {
+            return false;
+        }
+        char* rest = nullptr;
+        long runningMajor = std::strtol(name.release, &rest, 10);
+        long runningMinor = (rest && *rest == '.') ? std::strtol(rest + 1, nullptr, 10) : 0;
+        return runningMajor > major || (runningMajor == major && runningMinor >= minor);
+    }
+
+    uint64_t Tag(uint8_t operation, uint32_t id) {
+        return (static_cast<uint64_t>(operation) << OPERATION_SHIFT) | id;
+    }
+
+} // anonymous namespace
+
+bool IoUringBackend::Supported() {
+    static const bool supported = [] {
+        // Multishot receive is 6.0; seccomp profiles often refuse the ring altogether
+        if (!KernelAtLeast(6, 0)) {
+            return false;
+        }
+        io_uring_params params = {};
+        int ring = SetupRing(4, params);
+        if (ring < 0) {
+            return false;
+        }
+        close(ring);
+        const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+        return (params.features & needed) == needed;
+    }();
+    return supported;
+}
+
+IoUringBackend::IoUringBackend(SOCKET listenSocket)
+    : m_listenSocket(listenSocket)
+{
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = QUEUE_DEPTH * 4;
+    m_ring = SetupRing(QUEUE_DEPTH, params);
+    if (m_ring < 0) {
+        throw std::runtime_error("Failed to set up io_uring: " + std::to_string(errno));
+    }
+
+    std::string failure;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        failure = "kernel lacks required io_uring features";
+    }
+
+    // Submission and completion rings share one mapping
+    if (failure.empty()) {
+        m_ringsSize = (std::max)(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                                 params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        m_rings = mmap(nullptr, m_ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       m_ring, IORING_OFF_SQ_RING);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          m_ring, IORING_OFF_SQES);
+        if (m_rings == MAP_FAILED || sqes == MAP_FAILED) {
+            if (m_rings == MAP_FAILED) {
+                m_rings = nullptr;
+            }
+            if (sqes != MAP_FAILED) {
+                m_sqes = static_cast<io_uring_sqe*>(sqes);
+            }
+            failure = "failed to map the rings: " + std::to_string(errno);
+        } else {
+            char* base = static_cast<char*>(m_rings);
+            m_sqes = static_cast<io_uring_sqe*>(sqes);
+            m_sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+            m_sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+            m_sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+            m_sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+            m_sqEntries = params.sq_entries;
+            m_sqLocalTail = *m_sqTail;
+            m_cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+            m_cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+            m_cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+        }
+    }
+
+    // Receive buffers: the descriptor ring must be page aligned, hence mmap
+    if (failure.empty()) {
+        m_bufferRingSize = BUFFER_COUNT * sizeof(io_uring_buf);
+        void* ring = mmap(nullptr, m_bufferRingSize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void* buffers = mmap(nullptr, BUFFER_COUNT * BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        m_bufferRing = ring == MAP_FAILED ? nullptr : static_cast<io_uring_buf_ring*>(ring);
+        m_buffers = buffers == MAP_FAILED ? nullptr : static_cast<char*>(buffers);
+        if (!m_bufferRing || !m_buffers) {
+            failure = "failed to allocate receive buffers";
+        } else {
+            io_uring_buf_reg registration = {};
+            registration.ring_addr = reinterpret_cast<uint64_t>(m_bufferRing);
+            registration.ring_entries = BUFFER_COUNT;
+            registration.bgid = BUFFER_GROUP;
+            if (RegisterRing(m_ring, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+                failure = "failed to register receive buffers: " + std::to_string(errno);
+            } else {
+                for (unsigned i = 0; i < BUFFER_COUNT; ++i) {
+                    returnBuffer(static_cast<uint16_t>(i));
+                }
+                publishBuffers();
+            }
+        }
+    }
+
+    if (failure.empty()) {
+        m_wakeEvent = eventfd(0, EFD_CLOEXEC);
+        if (m_wakeEvent == -1) {
+            failure = "failed to create the wake event: " + std::to_string(errno);
+        }
+    }
+
+    if (failure.empty()) {
+        postWakeRead();
+        postAccept();
+        if (submit(0, 0) < 0) {
+            failure = "failed to start accepting: " + std::to_string(errno);
+        }
+    }
+
+    if (!failure.empty()) {
+        release();
+        throw std::runtime_error("io_uring backend: " + failure);
+    }
+}
+
+IoUringBackend::~IoUringBackend() {
+    release();
+}
+
+/**
+ * Closing the ring cancels everything still in flight; only then may the
+ * memory those operations point at go away.
+ */
+void IoUringBackend::release() {
+    if (m_ring != -1) {
+        close(m_ring);
+        m_ring = -1;
+    }
+    if (m_wakeEvent != -1) {
+        close(m_wakeEvent);
+        m_wakeEvent = -1;
+    }
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+    if (m_rings) {
+        munmap(m_rings, m_ringsSize);
+        m_rings = nullptr;
+    }
+    if (m_bufferRing) {
+        munmap(m_bufferRing, m_bufferRingSize);
+        m_bufferRing = nullptr;
+    }
+    if (m_buffers) {
+        munmap(m_buffers, BUFFER_COUNT * BUFFER_SIZE);
+        m_buffers = nullptr;
+    }
+}
+
+/**
+ * Claim the next submission slot, cleared. The kernel sees it once
+ * submit() publishes the tail; if the queue is full, what is queued is
+ * submitted first to make room.
+ */
+io_uring_sqe* IoUringBackend::nextSqe() {
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqLocalTail - head >= m_sqEntries) {
+        submit(0, 0);
+        head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_sqLocalTail - head >= m_sqEntries) {
+            return nullptr;
+        }
+    }
+    unsigned index = m_sqLocalTail & m_sqMask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+    ++m_sqLocalTail;
+    return sqe;
+}
+
+/**
+ * Hand prepared entries to the kernel and, with waitFor > 0, wait up to
+ * timeoutMs for that many completions.
+ *
+ * @return The io_uring_enter() result; timeouts and interruptions count as 0
+ */
+int IoUringBackend::submit(unsigned waitFor, uint32_t timeoutMs) {
+    unsigned tail = *m_sqTail;
+    unsigned toSubmit = m_sqLocalTail - tail;
+    if (toSubmit == 0 && waitFor == 0) {
+        return 0;
+    }
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    __kernel_timespec timeout = {};
+    io_uring_getevents_arg argument = {};
+    if (waitFor > 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+        argument.ts = reinterpret_cast<uint64_t>(&timeout);
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    int result;
+    do {
+        result = EnterRing(m_ring, toSubmit, waitFor, flags, waitFor > 0 ? &argument : nullptr,
+                           waitFor > 0 ? sizeof(argument) : 0);
+    } while (result < 0 && errno == EINTR && waitFor == 0);
+
+    if (result < 0 && (errno == ETIME || errno == EINTR || errno == EBUSY)) {
+        return 0;   // EBUSY: completions are backed up; reaping them makes room
+    }
+    return result;
+}
+
+void IoUringBackend::postAccept() {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe) {
+        return;     // Retried on the next Poll()
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = Tag(static_cast<uint8_t>(Operation::Accept), 0);
+    m_accepting = true;
+}
+
+void IoUringBackend::postReceive(SOCKET socket, Connection& connection) {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe) {
+        m_starved.push_back(socket);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = Tag(static_cast<uint8_t>(Operation::Receive), connection.id);
+    connection.receiving = true;
+}
+
+void IoUringBackend::postSend(SOCKET socket, uint32_t id, SendState& state, bool waitWritable) {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe) {
+        submit(0, 0);
+        sqe = nextSqe();
+    }
+    if (!sqe) {
+        return;     // Cannot happen with the queue just flushed; the send would stall
+    }
+    state.message = {};
+    state.message.msg_iov = state.iov.data() + state.index;
+    state.message.msg_iovlen = (std::min)(state.iov.size() - state.index, static_cast<size_t>(IOV_MAX));
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&state.message);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->ioprio = waitWritable ? IORING_RECVSEND_POLL_FIRST : 0;
+    sqe->user_data = Tag(static_cast<uint8_t>(Operation::Send), id);
+}
+
+void IoUringBackend::postWakeRead() {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_wakeEvent;
+    sqe->addr = reinterpret_cast<uint64_t>(&m_wakeValue);
+    sqe->len = sizeof(m_wakeValue);
+    sqe->user_data = Tag(static_cast<uint8_t>(Operation::Wake), 0);
+}
+
+void IoUringBackend::postCancel(Operation operation, uint32_t id) {
+    io_uring_sqe* sqe = nextSqe();
+    if (!sqe) {
+        return;     // The operation then ends when the socket closes
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = Tag(static_cast<uint8_t>(operation), id);
+    sqe->user_data = Tag(static_cast<uint8_t>(Operation::Cancel), id);
+}
+
+void IoUringBackend::returnBuffer(uint16_t bufferId) {
+    // Not m_bufferRing->bufs: compiled as C++, the header's flexible array
+    // sits behind a one-byte empty struct and lands 8 bytes off. The ring
+    // is a plain array of io_uring_buf whose first entry overlays the tail
+    io_uring_buf* slots = reinterpret_cast<io_uring_buf*>(m_bufferRing);
+    io_uring_buf& slot = slots[m_bufferTail & (BUFFER_COUNT - 1)];
+    slot.addr = reinterpret_cast<uint64_t>(m_buffers + static_cast<size_t>(bufferId) * BUFFER_SIZE);
+    slot.len = static_cast<uint32_t>(BUFFER_SIZE);
+    slot.bid = bufferId;
+    ++m_bufferTail;
+}
+
+void IoUringBackend::publishBuffers() {
+    __atomic_store_n(&m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE);
+}
+
+bool IoUringBackend::Associate(SOCKET clientSocket) {
+    if (m_connections.count(clientSocket)) {
+        return false;
+    }
+    uint32_t id = m_nextId++;
+    if (m_nextId == 0) {
+        m_nextId = 1;
+    }
+    Connection& connection = m_connections[clientSocket];
+    connection.id = id;
+    m_sockets[id] = clientSocket;
+    postReceive(clientSocket, connection);
+    return true;
+}
+
+bool IoUringBackend::Rearm(SOCKET clientSocket) {
+    return m_connections.count(clientSocket) > 0;   // Multishot receives stay armed
+}
+
+bool IoUringBackend::PostSend(SOCKET clientSocket, const std::vector<WSABUF>& buffers,
+                              std::vector<SendBuffer> keepAlive) {
+    auto found = m_connections.find(clientSocket);
+    if (found == m_connections.end() || found->second.send || buffers.empty()) {
+        return false;
+    }
+    auto state = std::make_unique<SendState>();
+    state->iov.reserve(buffers.size());
+    for (const WSABUF& buffer : buffers) {
+        state->iov.push_back({ buffer.buf, static_cast<size_t>(buffer.len) });
+    }
+    state->keepAlive = std::move(keepAlive);
+    postSend(clientSocket, found->second.id, *state);
+    found->second.send = std::move(state);
+    return true;
+}
+
+void IoUringBackend::Remove(SOCKET clientSocket) {
+    auto found = m_connections.find(clientSocket);
+    if (found == m_connections.end()) {
+        return;
+    }
+    Connection& connection = found->second;
+    if (connection.receiving) {
+        postCancel(Operation::Receive, connection.id);
+    }
+    if (connection.send) {
+        // The kernel still points into it; keep it until the completion arrives
+        postCancel(Operation::Send, connection.id);
+        m_retiredSends[connection.id] = std::move(connection.send);
+    }
+    m_sockets.erase(connection.id);
+    m_starved.erase(std::remove(m_starved.begin(), m_starved.end(), clientSocket), m_starved.end());
+    m_connections.erase(found);
+}
+
+size_t IoUringBackend::Poll(std::vector<Event>& outEvents, uint32_t timeoutMs) {
+    outEvents.clear();
+
+    // The caller is done with the previous Poll()'s data
+    if (!m_lent.empty()) {
+        for (uint16_t bufferId : m_lent) {
+            returnBuffer(bufferId);
+        }
+        m_lent.clear();
+        publishBuffers();
+    }
+
+    std::vector<SOCKET> starved;
+    starved.swap(m_starved);
+    for (SOCKET socket : starved) {
+        auto found = m_connections.find(socket);
+        if (found != m_connections.end() && !found->second.receiving) {
+            postReceive(socket, found->second);
+        }
+    }
+    if (!m_accepting) {
+        postAccept();
+    }
+
+    // Only block when nothing is waiting already
+    bool ready = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) != *m_cqHead;
+    submit(ready || timeoutMs == 0 ? 0 : 1, timeoutMs);
+
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        handleCompletion(m_cqes[head & m_cqMask], outEvents);
+        ++head;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+    // Buffers from completions nobody will see go straight back
+    publishBuffers();
+    submit(0, 0);
+    return outEvents.size();
+}
+
+void IoUringBackend::handleCompletion(const io_uring_cqe& cqe, std::vector<Event>& outEvents) {
+    Operation operation = static_cast<Operation>(cqe.user_data >> OPERATION_SHIFT);
+    uint32_t id = static_cast<uint32_t>(cqe.user_data);
+    bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t bufferId = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+    switch (operation) {
+    case Operation::Accept:
+        if (cqe.res >= 0) {
+            outEvents.push_back({ EventType::Accepted, cqe.res, 0 });
+        }
+        if (!more) {
+            m_accepting = false;    // Out of descriptors, or the kernel ended it; posted again next Poll()
+        }
+        return;
+
+    case Operation::Wake:
+        outEvents.push_back({ EventType::Wakeup, INVALID_SOCKET, 0 });
+        postWakeRead();
+        return;
+
+    case Operation::Cancel:
+        return;
+
+    case Operation::Receive: {
+        auto socket = m_sockets.find(id);
+        if (socket == m_sockets.end()) {
+            if (hasBuffer) {
+                returnBuffer(bufferId);
+            }
+            return;
+        }
+        Connection& connection = m_connections[socket->second];
+        if (!more) {
+            connection.receiving = false;
+        }
+        if (cqe.res > 0 && hasBuffer) {
+            m_lent.push_back(bufferId);
+            Event event = { EventType::Received, socket->second, static_cast<size_t>(cqe.res) };
+            event.data = m_buffers + static_cast<size_t>(bufferId) * BUFFER_SIZE;
+            outEvents.push_back(event);
+            if (!more) {
+                postReceive(socket->second, connection);
+            }
+        } else if (cqe.res == 0) {
+            outEvents.push_back({ EventType::Received, socket->second, 0 });
+        } else if (cqe.res == -ENOBUFS) {
+            m_starved.push_back(socket->second);
+        } else {
+            outEvents.push_back({ EventType::Closed, socket->second, 0 });
+        }
+        return;
+    }
+
+    case Operation::Send: {
+        auto socket = m_sockets.find(id);
+        if (socket == m_sockets.end()) {
+            m_retiredSends.erase(id);
+            return;
+        }
+        Connection& connection = m_connections[socket->second];
+        SendState* state = connection.send.get();
+        if (!state) {
+            return;
+        }
+        if (cqe.res == -EAGAIN) {
+            postSend(socket->second, id, *state, true);     // Non-blocking socket was full
+            return;
+        }
+        if (cqe.res <= 0) {
+            outEvents.push_back({ EventType::SendFailed, socket->second, state->sentBytes });
+            connection.send.reset();
+            return;
+        }
+
+        // Skip what went out; a short send leaves an offset into one buffer
+        state->sentBytes += static_cast<size_t>(cqe.res);
+        size_t remaining = static_cast<size_t>(cqe.res);
+        while (remaining > 0 && state->index < state->iov.size()) {
+            iovec& head = state->iov[state->index];
+            if (remaining >= head.iov_len) {
+                remaining -= head.iov_len;
+                ++state->index;
+            } else {
+                head.iov_base = static_cast<char*>(head.iov_base) + remaining;
+                head.iov_len -= remaining;
+                remaining = 0;
+            }
+        }
+        if (state->index < state->iov.size()) {
+            postSend(socket->second, id, *state);
+            return;
+        }
+        outEvents.push_back({ EventType::SendComplete, socket->second, state->sentBytes });
+        connection.send.reset();
+        return;
+    }
+    }
+}
+
+void IoUringBackend::Wake() {
+    uint64_t one = 1;
+    ssize_t written = write(m_wakeEvent, &one, sizeof(one));
+    (void)written;
+}
+
+#endif // __linux__
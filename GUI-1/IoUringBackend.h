@@ -0,0 +1,149 @@
+#ifndef IO_URING_BACKEND_H
+#define IO_URING_BACKEND_H
+
+/**
+ * @file IoUringBackend.h
+ * @brief IoBackend on Linux io_uring: the kernel reads for us
+ *
+ * DESIGN:
+ * - One multishot accept on the listener and one multishot receive per
+ *   connection stay armed for as long as they last. Each completion is
+ *   an accepted socket or a chunk of data, with no system call per event
+ * - Receives pick their memory from a ring of BUFFER_COUNT buffers
+ *   registered with the kernel up front (IORING_REGISTER_PBUF_RING), so
+ *   idle connections pin no memory. A buffer handed out as a Received
+ *   event goes back to the ring at the start of the next Poll()
+ * - When the ring runs dry a receive ends with ENOBUFS; it is posted
+ *   again once buffers have been returned
+ * - Sends are IORING_OP_SENDMSG over the caller's buffers; a short send
+ *   is continued before SendComplete is reported
+ * - Completions carry an operation tag and a per-registration id, so
+ *   completions for a removed socket are recognised (and their buffers
+ *   returned) even after the descriptor number has been reused
+ * - No liburing: the rings are mapped and driven with the raw system
+ *   calls, as <linux/io_uring.h> describes them
+ *
+ * REQUIREMENTS:
+ * Linux 6.0 (multishot receive). Supported() checks, and
+ * IoBackend::Create() falls back to epoll without it (or where io_uring
+ * is disabled, as in many containers).
+ *
+ * THREADING:
+ * See IoBackend.h.
+ */
+
+#ifdef __linux__
+
+#include "IoBackend.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unordered_map>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+class IoUringBackend : public NetProtocol::IoBackend {
+public:
+    /** Submission queue entries (the completion queue gets four times as many) */
+    static constexpr unsigned QUEUE_DEPTH = 256;
+
+    /** Receive buffers registered with the kernel (a power of two) */
+    static constexpr unsigned BUFFER_COUNT = 256;
+
+    /** Bytes per receive buffer: the most one Received event carries */
+    static constexpr size_t BUFFER_SIZE = 16 * 1024;
+
+    /** @brief True if this kernel has everything the backend uses */
+    static bool Supported();
+
+    /**
+     * @param listenSocket A bound, listening TCP socket (not owned)
+     * @throws std::runtime_error if the ring cannot be set up
+     */
+    explicit IoUringBackend(SOCKET listenSocket);
+    ~IoUringBackend() override;
+
+    Kind GetKind() const override { return Kind::IoUring; }
+    bool DeliversData() const override { return true; }
+    bool Associate(SOCKET clientSocket) override;
+    bool Rearm(SOCKET clientSocket) override;
+    bool PostSend(SOCKET clientSocket, const std::vector<WSABUF>& buffers,
+                  std::vector<SendBuffer> keepAlive) override;
+    void Remove(SOCKET clientSocket) override;
+    size_t Poll(std::vector<Event>& outEvents, uint32_t timeoutMs) override;
+    void Wake() override;
+
+private:
+    enum class Operation : uint8_t { Accept = 1, Receive, Send, Wake, Cancel };
+
+    // Everything a sendmsg in flight points at
+    struct SendState {
+        msghdr message = {};
+        std::vector<iovec> iov;
+        size_t index = 0;               // First iovec not fully sent
+        size_t sentBytes = 0;
+        std::vector<SendBuffer> keepAlive;
+    };
+
+    struct Connection {
+        uint32_t id = 0;
+        bool receiving = false;         // Multishot receive armed
+        std::unique_ptr<SendState> send;
+    };
+
+    int m_ring = -1;
+
+    // Shared ring memory (IORING_FEAT_SINGLE_MMAP) and the SQE array
+    void* m_rings = nullptr;
+    size_t m_ringsSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned m_sqLocalTail = 0;         // Entries prepared; published by submit()
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+
+    // Provided receive buffers
+    io_uring_buf_ring* m_bufferRing = nullptr;
+    size_t m_bufferRingSize = 0;
+    char* m_buffers = nullptr;
+    uint16_t m_bufferTail = 0;
+    std::vector<uint16_t> m_lent;       // Handed out by the last Poll()
+
+    SOCKET m_listenSocket;
+    bool m_accepting = false;
+    int m_wakeEvent = -1;
+    uint64_t m_wakeValue = 0;
+
+    uint32_t m_nextId = 1;
+    std::unordered_map<SOCKET, Connection> m_connections;
+    std::unordered_map<uint32_t, SOCKET> m_sockets;             // Live id -> socket
+    std::unordered_map<uint32_t, std::unique_ptr<SendState>> m_retiredSends;
+    std::vector<SOCKET> m_starved;      // Receives ended by ENOBUFS
+
+    io_uring_sqe* nextSqe();
+    int submit(unsigned waitFor, uint32_t timeoutMs);
+    void postAccept();
+    void postReceive(SOCKET socket, Connection& connection);
+    void postSend(SOCKET socket, uint32_t id, SendState& state, bool waitWritable = false);
+    void postWakeRead();
+    void postCancel(Operation operation, uint32_t id);
+    void returnBuffer(uint16_t bufferId);
+    void publishBuffers();
+    void handleCompletion(const io_uring_cqe& cqe, std::vector<Event>& outEvents);
+    void release();
+
+    IoUringBackend(const IoUringBackend&) = delete;
+    IoUringBackend& operator=(const IoUringBackend&) = delete;
+};
+
+#endif // __linux__
+
+#endif // IO_URING_BACKEND_H
@@ -0,0 +1,419 @@
+/**
+ * @file IocpEngine.cpp
+ * @brief Implementation of the I/O completion port event engine
+ */
+
+#include "IocpEngine.h"
+#include "Log.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+//=============================================================================
+// INTERNAL CONSTANTS
+//=============================================================================
+
+/** Completion key used by Wake(); real I/O is identified by its OVERLAPPED */
+constexpr ULONG_PTR WAKE_COMPLETION_KEY = 1;
+
+/** How long the destructor waits for cancelled operations to drain */
+constexpr DWORD SHUTDOWN_DRAIN_TIMEOUT_MS = 100;
+constexpr int SHUTDOWN_DRAIN_ATTEMPTS = 20;
+
+/** Size of one address slot in the AcceptEx buffer */
+constexpr DWORD ACCEPT_ADDRESS_LENGTH = sizeof(sockaddr_storage) + 16;
+
+//=============================================================================
+// CONSTRUCTION / DESTRUCTION
+//=============================================================================
+
+IocpEngine::IocpEngine(SOCKET listenSocket, size_t pendingAccepts)
+    : m_port(NULL), m_listenSocket(listenSocket), m_acceptEx(nullptr), m_transmitFile(nullptr), m_outstanding(0)
+{
+    if (listenSocket == INVALID_SOCKET) {
+        throw std::runtime_error("Invalid listen socket");
+    }
+
+    m_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+    if (m_port == NULL) {
+        throw std::runtime_error("Failed to create I/O completion port");
+    }
+
+    if (CreateIoCompletionPort(reinterpret_cast<HANDLE>(listenSocket), m_port, 0, 0) == NULL) {
+        CloseHandle(m_port);
+        throw std::runtime_error("Failed to associate listen socket with completion port");
+    }
+
+    // AcceptEx lives in mswsock; load it through the provider so we do not
+    // need an extra import library.
+    GUID acceptExGuid = WSAID_ACCEPTEX;
+    DWORD bytes = 0;
+    if (WSAIoctl(listenSocket, SIO_GET_EXTENSION_FUNCTION_POINTER,
+                 &acceptExGuid, sizeof(acceptExGuid),
+                 &m_acceptEx, sizeof(m_acceptEx),
+                 &bytes, NULL, NULL) == SOCKET_ERROR) {
+        CloseHandle(m_port);
+        throw std::runtime_error("Failed to load AcceptEx");
+    }
+
+    // TransmitFile is optional: without it PostTransmitFile() just fails
+    GUID transmitFileGuid = WSAID_TRANSMITFILE;
+    if (WSAIoctl(listenSocket, SIO_GET_EXTENSION_FUNCTION_POINTER,
+                 &transmitFileGuid, sizeof(transmitFileGuid),
+                 &m_transmitFile, sizeof(m_transmitFile),
+                 &bytes, NULL, NULL) == SOCKET_ERROR) {
+        m_transmitFile = nullptr;
+        LOG_WARNING("[NET] TransmitFile unavailable: %d", WSAGetLastError());
+    }
+
+    for (size_t i = 0; i < pendingAccepts; ++i) {
+        auto context = std::make_unique<IoContext>();
+        context->operation = Operation::Accept;
+
+        if (postAccept(context.get())) {
+            m_acceptContexts.push_back(std::move(context));
+        }
+    }
+
+    if (m_acceptContexts.empty()) {
+        CloseHandle(m_port);
+        throw std::runtime_error("Failed to post any AcceptEx operations");
+    }
+
+    LOG_INFO("[NET] IOCP engine started with %zu pending accepts", m_acceptContexts.size());
+}
+
+IocpEngine::~IocpEngine()
+{
+    // Abort everything still in flight. Closing an accept socket completes
+    // its AcceptEx; cancelling a client read completes its WSARecv.
+    CancelIoEx(reinterpret_cast<HANDLE>(m_listenSocket), NULL);
+    for (auto& context : m_acceptContexts) {
+        if (context->socket != INVALID_SOCKET) {
+            closesocket(context->socket);
+            context->socket = INVALID_SOCKET;
+        }
+    }
+    for (auto& entry : m_readContexts) {
+        if (entry.second->pending) {
+            CancelIoEx(reinterpret_cast<HANDLE>(entry.first), &entry.second->overlapped);
+        }
+    }
+    for (auto& entry : m_sendContexts) {
+        if (entry.second->pending) {
+            CancelIoEx(reinterpret_cast<HANDLE>(entry.first), &entry.second->overlapped);
+        }
+    }
+    for (auto& entry : m_retiredContexts) {
+        CancelIoEx(reinterpret_cast<HANDLE>(entry.second->socket), &entry.second->overlapped);
+    }
+
+    // The kernel still owns every pending OVERLAPPED; wait for them to
+    // come back before freeing the memory they point at.
+    OVERLAPPED_ENTRY entries[MAX_COMPLETIONS_PER_POLL];
+    for (int attempt = 0; attempt < SHUTDOWN_DRAIN_ATTEMPTS && m_outstanding > 0; ++attempt) {
+        ULONG count = 0;
+        if (!GetQueuedCompletionStatusEx(m_port, entries, MAX_COMPLETIONS_PER_POLL,
+                                         &count, SHUTDOWN_DRAIN_TIMEOUT_MS, FALSE)) {
+            continue;
+        }
+        for (ULONG i = 0; i < count; ++i) {
+            if (entries[i].lpOverlapped != NULL && m_outstanding > 0) {
+                --m_outstanding;
+            }
+        }
+    }
+
+    if (m_outstanding > 0) {
+        // Leaking is the only safe option if the kernel has not released
+        // the contexts yet - freeing them would be a use-after-free.
+        LOG_WARNING("[WARNING] IOCP shutdown left %zu operations outstanding", m_outstanding);
+        for (auto& context : m_acceptContexts) context.release();
+        for (auto& entry : m_readContexts) entry.second.release();
+        for (auto& entry : m_sendContexts) entry.second.release();
+        for (auto& entry : m_retiredContexts) entry.second.release();
+    }
+
+    CloseHandle(m_port);
+}
+
+//=============================================================================
+// REGISTRATION
+//=============================================================================
+
+bool IocpEngine::Associate(SOCKET clientSocket)
+{
+    if (clientSocket == INVALID_SOCKET || m_readContexts.count(clientSocket) != 0) {
+        return false;
+    }
+
+    // Sockets obtained from AcceptEx are already tied to this port when
+    // they were created by postAccept(); associating twice fails with
+    // ERROR_INVALID_PARAMETER, which is harmless here.
+    if (CreateIoCompletionPort(reinterpret_cast<HANDLE>(clientSocket), m_port, 0, 0) == NULL &&
+        GetLastError() != ERROR_INVALID_PARAMETER) {
+        LOG_WARNING("[NET] Failed to associate socket with completion port: %lu", GetLastError());
+        return false;
+    }
+
+    auto context = std::make_unique<IoContext>();
+    context->operation = Operation::Read;
+    context->socket = clientSocket;
+
+    IoContext* raw = context.get();
+    m_readContexts[clientSocket] = std::move(context);
+    return postRead(raw);
+}
+
+bool IocpEngine::Rearm(SOCKET clientSocket)
+{
+    auto it = m_readContexts.find(clientSocket);
+    if (it == m_readContexts.end()) {
+        return false;
+    }
+    if (it->second->pending) {
+        return true;
+    }
+    return postRead(it->second.get());
+}
+
+bool IocpEngine::PostSend(SOCKET clientSocket, const std::vector<WSABUF>& buffers,
+                          std::vector<SendBuffer> keepAlive)
+{
+    if (buffers.empty() || m_readContexts.count(clientSocket) == 0) {
+        return false;
+    }
+
+    IoContext* context = sendContext(clientSocket);
+    if (context->pending) {
+        return false;
+    }
+
+    std::memset(&context->overlapped, 0, sizeof(context->overlapped));
+    context->keepAlive = std::move(keepAlive);
+
+    if (WSASend(clientSocket, const_cast<WSABUF*>(buffers.data()), static_cast<DWORD>(buffers.size()),
+                NULL, 0, &context->overlapped, NULL) == SOCKET_ERROR &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        context->keepAlive.clear();
+        return false;
+    }
+
+    context->pending = true;
+    ++m_outstanding;
+    return true;
+}
+
+bool IocpEngine::PostTransmitFile(SOCKET clientSocket, HANDLE file, uint64_t offset, DWORD length,
+                                  std::string head)
+{
+    if (!m_transmitFile || file == INVALID_HANDLE_VALUE || length == 0 || length > MAX_TRANSMIT_BYTES ||
+        m_readContexts.count(clientSocket) == 0) {
+        return false;
+    }
+
+    IoContext* context = sendContext(clientSocket);
+    if (context->pending) {
+        return false;
+    }
+
+    // The file offset rides in the OVERLAPPED, as for ReadFile
+    std::memset(&context->overlapped, 0, sizeof(context->overlapped));
+    context->overlapped.Offset = static_cast<DWORD>(offset);
+    context->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    context->transmitHead = std::move(head);
+    context->transmitBuffers = {};
+    context->transmitBuffers.Head = context->transmitHead.empty() ? nullptr : &context->transmitHead[0];
+    context->transmitBuffers.HeadLength = static_cast<DWORD>(context->transmitHead.size());
+
+    if (!m_transmitFile(clientSocket, file, length, 0, &context->overlapped,
+                        context->transmitHead.empty() ? nullptr : &context->transmitBuffers, 0) &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        context->transmitHead.clear();
+        return false;
+    }
+
+    context->pending = true;
+    ++m_outstanding;
+    return true;
+}
+
+void IocpEngine::Remove(SOCKET clientSocket)
+{
+    retire(m_readContexts, clientSocket);
+    retire(m_sendContexts, clientSocket);
+}
+
+void IocpEngine::retire(std::map<SOCKET, std::unique_ptr<IoContext>>& contexts, SOCKET clientSocket)
+{
+    auto it = contexts.find(clientSocket);
+    if (it == contexts.end()) {
+        return;
+    }
+
+    if (it->second->pending) {
+        // The operation will complete (with an error) once the socket is
+        // closed; park the context - and any pinned buffers - until then.
+        IoContext* raw = it->second.get();
+        m_retiredContexts[raw] = std::move(it->second);
+    }
+    contexts.erase(it);
+}
+
+//=============================================================================
+// POLLING
+//=============================================================================
+
+size_t IocpEngine::Poll(std::vector<Event>& outEvents, uint32_t timeoutMs)
+{
+    outEvents.clear();
+
+    OVERLAPPED_ENTRY entries[MAX_COMPLETIONS_PER_POLL];
+    ULONG count = 0;
+
+    if (!GetQueuedCompletionStatusEx(m_port, entries, MAX_COMPLETIONS_PER_POLL,
+                                     &count, timeoutMs, FALSE)) {
+        DWORD error = GetLastError();
+        if (error != WAIT_TIMEOUT) {
+            LOG_WARNING("[NET] GetQueuedCompletionStatusEx failed: %lu", error);
+        }
+        return 0;
+    }
+
+    for (ULONG i = 0; i < count; ++i) {
+        if (entries[i].lpOverlapped == NULL) {
+            if (entries[i].lpCompletionKey == WAKE_COMPLETION_KEY) {
+                outEvents.push_back({ EventType::Wakeup, INVALID_SOCKET, 0 });
+            }
+            continue;
+        }
+
+        if (m_outstanding > 0) {
+            --m_outstanding;
+        }
+
+        IoContext* context = CONTAINING_RECORD(entries[i].lpOverlapped, IoContext, overlapped);
+        // Internal holds the NTSTATUS of the operation; zero is STATUS_SUCCESS
+        bool succeeded = entries[i].lpOverlapped->Internal == 0;
+        handleCompletion(context, succeeded, entries[i].dwNumberOfBytesTransferred, outEvents);
+    }
+
+    return outEvents.size();
+}
+
+void IocpEngine::Wake()
+{
+    PostQueuedCompletionStatus(m_port, 0, WAKE_COMPLETION_KEY, NULL);
+}
+
+//=============================================================================
+// INTERNAL HELPERS
+//=============================================================================
+
+bool IocpEngine::postAccept(IoContext* context)
+{
+    SOCKET acceptSocket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    if (acceptSocket == INVALID_SOCKET) {
+        LOG_WARNING("[NET] Failed to create accept socket: %d", WSAGetLastError());
+        return false;
+    }
+
+    if (CreateIoCompletionPort(reinterpret_cast<HANDLE>(acceptSocket), m_port, 0, 0) == NULL) {
+        LOG_WARNING("[NET] Failed to associate accept socket: %lu", GetLastError());
+        closesocket(acceptSocket);
+        return false;
+    }
+
+    std::memset(&context->overlapped, 0, sizeof(context->overlapped));
+    context->socket = acceptSocket;
+
+    // Receive no data with the accept: a client that connects and then
+    // stays silent must not tie up an accept slot.
+    DWORD bytes = 0;
+    BOOL ok = m_acceptEx(m_listenSocket, acceptSocket, context->addressBuffer, 0,
+                         ACCEPT_ADDRESS_LENGTH, ACCEPT_ADDRESS_LENGTH,
+                         &bytes, &context->overlapped);
+    if (!ok && WSAGetLastError() != ERROR_IO_PENDING) {
+        LOG_WARNING("[NET] AcceptEx failed: %d", WSAGetLastError());
+        closesocket(acceptSocket);
+        context->socket = INVALID_SOCKET;
+        return false;
+    }
+
+    context->pending = true;
+    ++m_outstanding;
+    return true;
+}
+
+IocpEngine::IoContext* IocpEngine::sendContext(SOCKET clientSocket)
+{
+    std::unique_ptr<IoContext>& slot = m_sendContexts[clientSocket];
+    if (!slot) {
+        slot = std::make_unique<IoContext>();
+        slot->operation = Operation::Send;
+        slot->socket = clientSocket;
+    }
+    return slot.get();
+}
+
+bool IocpEngine::postRead(IoContext* context)
+{
+    std::memset(&context->overlapped, 0, sizeof(context->overlapped));
+
+    // Zero-byte read: completes when data (or FIN) arrives, without
+    // committing a receive buffer for the lifetime of an idle connection.
+    WSABUF buffer;
+    buffer.buf = nullptr;
+    buffer.len = 0;
+    DWORD flags = 0;
+
+    if (WSARecv(context->socket, &buffer, 1, NULL, &flags, &context->overlapped, NULL) == SOCKET_ERROR &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        return false;
+    }
+
+    context->pending = true;
+    ++m_outstanding;
+    return true;
+}
+
+void IocpEngine::handleCompletion(IoContext* context, bool succeeded, DWORD bytes, std::vector<Event>& outEvents)
+{
+    context->pending = false;
+
+    if (context->operation == Operation::Accept) {
+        SOCKET accepted = context->socket;
+        context->socket = INVALID_SOCKET;
+
+        if (succeeded) {
+            // Required so getpeername/shutdown behave on AcceptEx sockets
+            setsockopt(accepted, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT,
+                       reinterpret_cast<const char*>(&m_listenSocket), sizeof(m_listenSocket));
+            outEvents.push_back({ EventType::Accepted, accepted, 0 });
+        }
+        else if (accepted != INVALID_SOCKET) {
+            closesocket(accepted);
+        }
+
+        // Keep the accept pool full
+        postAccept(context);
+        return;
+    }
+
+    // Completion for a context that was removed - just free it
+    auto retired = m_retiredContexts.find(context);
+    if (retired != m_retiredContexts.end()) {
+        m_retiredContexts.erase(retired);
+        return;
+    }
+
+    if (context->operation == Operation::Send) {
+        context->keepAlive.clear();
+        context->transmitHead.clear();
+        outEvents.push_back({ succeeded ? EventType::SendComplete : EventType::SendFailed,
+                              context->socket, static_cast<size_t>(bytes) });
+        return;
+    }
+
+    outEvents.push_back({ succeeded ? EventType::Readable : EventType::Closed, context->socket, 0 });
+}
@@ -0,0 +1,184 @@
+#ifndef IOCPENGINE_H
+#define IOCPENGINE_H
+
+// Prevent Windows min/max macros from conflicting with std::min/std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+/**
+ * @file IocpEngine.h
+ * @brief I/O completion port event engine for the chat server
+ *
+ * PURPOSE:
+ * The server used to sweep every client with a non-blocking recv() on each
+ * UI tick. Cost grew linearly with idle connections and only one accept()
+ * happened per tick. This engine lets the kernel tell us which sockets are
+ * ready, so each poll only touches connections that actually have work.
+ *
+ * ARCHITECTURE:
+ * - The listening socket keeps a small pool of overlapped AcceptEx calls
+ *   outstanding, so bursts of connections are accepted in a single poll
+ * - Each registered client has exactly one zero-byte WSARecv outstanding.
+ *   A zero-byte read pins no receive buffer, so thousands of idle
+ *   connections cost one OVERLAPPED each and nothing else
+ * - When a read completes the socket is reported Readable and the caller
+ *   drains it with its normal non-blocking recv path, then calls Rearm()
+ * - Each client may also have one overlapped scatter/gather WSASend in
+ *   flight; its completion is reported as SendComplete with the byte count
+ * - Instead of a WSASend, that one send may be a TransmitFile: the kernel
+ *   sends straight from the file cache and the bytes never pass through
+ *   user space. It completes as SendComplete the same way
+ * - The event model is the one IoBackend defines; the Linux backends
+ *   emulate it. TransmitFile is the IOCP-only extra
+ *
+ * OWNERSHIP:
+ * - The engine owns accept sockets until they are reported as Accepted;
+ *   from then on the caller owns (and eventually closes) them
+ * - Client sockets are never closed by the engine
+ * - OVERLAPPED contexts stay alive until the kernel reports their completion,
+ *   even after Remove(), because closing a socket completes its pending read
+ * - Send contexts pin the buffers they reference until completion, so a
+ *   client can be dropped while a send is still in flight
+ *
+ * THREADING:
+ * Poll() is intended to be called from a single thread. Wake() may be
+ * called from any thread to interrupt a blocking Poll().
+ */
+
+#include "IoBackend.h"
+#include <mswsock.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class IocpEngine : public NetProtocol::IoBackend {
+public:
+    /** Maximum completions dequeued per GetQueuedCompletionStatusEx call */
+    static constexpr ULONG MAX_COMPLETIONS_PER_POLL = 64;
+
+    /**
+     * @brief Create a completion port and start accepting on a listening socket
+     * @param listenSocket A bound, listening TCP socket (not owned)
+     * @param pendingAccepts Number of AcceptEx calls to keep in flight
+     * @throws std::runtime_error if the port or AcceptEx cannot be set up
+     */
+    explicit IocpEngine(SOCKET listenSocket, size_t pendingAccepts = DEFAULT_PENDING_ACCEPTS);
+
+    /**
+     * @brief Cancel outstanding operations and release the completion port
+     *
+     * NOTE: Client sockets should be closed before the engine is destroyed so
+     * their pending reads complete and their contexts can be freed.
+     */
+    ~IocpEngine() override;
+
+    Kind GetKind() const override { return Kind::Iocp; }
+
+    /**
+     * @brief Register a client socket and arm its first read notification
+     * @return True if the socket was associated and armed
+     */
+    bool Associate(SOCKET clientSocket) override;
+
+    /**
+     * @brief Re-arm the read notification after a Readable event was handled
+     * @return False if the read could not be posted (connection is gone)
+     */
+    bool Rearm(SOCKET clientSocket) override;
+
+    /**
+     * @brief Start an overlapped scatter/gather send
+     * 
+     * Only one send per socket may be in flight; wait for SendComplete
+     * before posting the next batch.
+     * 
+     * @param clientSocket A socket previously passed to Associate()
+     * @param buffers WSABUFs describing the data (array copied by the kernel)
+     * @param keepAlive Owners of the memory behind buffers; held until completion
+     * @return False if the send could not be started
+     */
+    bool PostSend(SOCKET clientSocket, const std::vector<WSABUF>& buffers,
+                  std::vector<SendBuffer> keepAlive) override;
+
+    /**
+     * @brief Start an overlapped TransmitFile, optionally preceded by a header
+     * 
+     * Takes the socket's one send slot, like PostSend(). The file must have
+     * been opened with FILE_FLAG_OVERLAPPED; the caller keeps it open until
+     * SendComplete or SendFailed (closing it early is safe, the kernel holds
+     * its own reference).
+     * 
+     * @param clientSocket A socket previously passed to Associate()
+     * @param file File to send from
+     * @param offset First byte of the file to send
+     * @param length Bytes of the file to send (1 to MAX_TRANSMIT_BYTES)
+     * @param head Sent before the file data; empty for none
+     * @return False if the send could not be started
+     */
+    bool PostTransmitFile(SOCKET clientSocket, HANDLE file, uint64_t offset, DWORD length,
+                          std::string head = std::string());
+
+    /** TransmitFile sends at most 2^31 - 2 bytes per call */
+    static constexpr DWORD MAX_TRANSMIT_BYTES = 0x7FFFFFFE;
+
+    /**
+     * @brief Stop reporting events for a socket (call before closing it)
+     */
+    void Remove(SOCKET clientSocket) override;
+
+    /**
+     * @brief Wait for completions and translate them into events
+     * @param outEvents Cleared, then filled with ready sockets
+     * @param timeoutMs How long to block if nothing is ready (0 = don't block)
+     * @return Number of events produced
+     */
+    size_t Poll(std::vector<Event>& outEvents, uint32_t timeoutMs) override;
+
+    /**
+     * @brief Interrupt a Poll() that is blocked on another thread
+     */
+    void Wake() override;
+
+private:
+    enum class Operation { Accept, Read, Send };
+
+    struct IoContext {
+        OVERLAPPED overlapped = {};
+        Operation operation = Operation::Read;
+        SOCKET socket = INVALID_SOCKET;
+        bool pending = false;
+        // AcceptEx needs room for both addresses plus 16 bytes each
+        char addressBuffer[2 * (sizeof(sockaddr_storage) + 16)] = {};
+        // Send only: memory referenced by the in-flight WSABUFs
+        std::vector<SendBuffer> keepAlive;
+        // TransmitFile only: the head buffer and its descriptor
+        std::string transmitHead;
+        TRANSMIT_FILE_BUFFERS transmitBuffers = {};
+    };
+
+    HANDLE m_port;
+    SOCKET m_listenSocket;
+    LPFN_ACCEPTEX m_acceptEx;
+    LPFN_TRANSMITFILE m_transmitFile;
+
+    std::vector<std::unique_ptr<IoContext>> m_acceptContexts;
+    std::map<SOCKET, std::unique_ptr<IoContext>> m_readContexts;
+    std::map<SOCKET, std::unique_ptr<IoContext>> m_sendContexts;
+    std::map<IoContext*, std::unique_ptr<IoContext>> m_retiredContexts;
+    size_t m_outstanding;
+
+    bool postAccept(IoContext* context);
+    bool postRead(IoContext* context);
+    IoContext* sendContext(SOCKET clientSocket);
+    void handleCompletion(IoContext* context, bool succeeded, DWORD bytes, std::vector<Event>& outEvents);
+    void retire(std::map<SOCKET, std::unique_ptr<IoContext>>& contexts, SOCKET clientSocket);
+
+    // Disable copying and assignment
+    IocpEngine(const IocpEngine&) = delete;
+    IocpEngine& operator=(const IocpEngine&) = delete;
+};
+
+#endif // IOCPENGINE_H
@@ -0,0 +1,109 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+/**
+ * @file LatencyHistogram.h
+ * @brief Fixed-size log-bucketed histogram for latencies and sizes
+ *
+ * PURPOSE:
+ * Percentiles of an unbounded stream of samples in constant memory, for
+ * the server's live metrics and the LoadGen/Bench tools.
+ *
+ * DESIGN:
+ * - Values below 128 are exact; above that each power of two is split
+ *   into 64 buckets, so a percentile is reported within 1/64 of its true
+ *   value (the HDR histogram layout at two significant digits)
+ * - Record() is a couple of relaxed atomic adds: no lock, no allocation
+ *
+ * THREADING:
+ * Record() may be called from any number of threads. Readers see every
+ * completed Record() eventually; a percentile taken while samples are
+ * arriving may mix counts from slightly different moments, which is
+ * fine for monitoring.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() {
+        for (auto& count : m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Record(uint64_t value) {
+        m_counts[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+        m_total.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t seen = m_max.load(std::memory_order_relaxed);
+        while (value > seen && !m_max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t Count() const { return m_total.load(std::memory_order_relaxed); }
+    uint64_t Max() const { return m_max.load(std::memory_order_relaxed); }
+
+    double Mean() const {
+        uint64_t total = Count();
+        return total == 0 ? 0.0 : static_cast<double>(m_sum.load(std::memory_order_relaxed)) / total;
+    }
+
+    /** @brief Upper edge of the bucket holding the given quantile (0..1) */
+    uint64_t Percentile(double quantile) const {
+        uint64_t total = Count();
+        uint64_t max = Max();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += m_counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return (std::min)(upperEdge(i), max);
+            }
+        }
+        return max;
+    }
+
+private:
+    static constexpr size_t EXACT = 128;
+    static constexpr size_t SUB_BUCKETS = 64;
+    static constexpr size_t BUCKETS = EXACT + 58 * SUB_BUCKETS;   // Up to 2^64
+
+    std::atomic<uint64_t> m_counts[BUCKETS];
+    std::atomic<uint64_t> m_total{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+
+    static size_t indexOf(uint64_t value) {
+        if (value < EXACT) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 7;
+        while (msb < 63 && (value >> (msb + 1)) != 0) {
+            ++msb;
+        }
+        int shift = msb - 6;
+        size_t top = static_cast<size_t>(value >> shift);     // 64..127
+        return EXACT + (shift - 1) * SUB_BUCKETS + (top - SUB_BUCKETS);
+    }
+
+    static uint64_t upperEdge(size_t index) {
+        if (index < EXACT) {
+            return index;
+        }
+        int shift = static_cast<int>((index - EXACT) / SUB_BUCKETS) + 1;
+        uint64_t top = (index - EXACT) % SUB_BUCKETS + SUB_BUCKETS;
+        return ((top + 1) << shift) - 1;
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+};
+
+#endif // LATENCY_HISTOGRAM_H
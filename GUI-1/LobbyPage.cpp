@@ -1,10 +1,21 @@
 #include "LobbyPage.hpp"
+#include <FL/Fl.H>
 #include <FL/Fl_Ask.H>
 #include <FL/fl_draw.H>
 #include "HomePage.hpp"
 #include "MainWindow.h"
 #include "SettingsWindow.hpp"
+#include "Settings.h"
 #include "AboutWindow.h"
+#include "Protocol.h"
+#include "AttachmentStore.h"
+#include "Trace.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
 
 // Layout constants
 static const int HEADER_HEIGHT = 50;
@@ -20,6 +31,7 @@ LobbyPage::LobbyPage(int X, int Y, int W, int H)
     : Fl_Group(X, Y, W, H)
     , client(nullptr)
     , server(nullptr)
+    , connector(nullptr)
     , settings(nullptr)
     , about(nullptr)
     , ipInput(nullptr)
@@ -28,8 +40,18 @@ LobbyPage::LobbyPage(int X, int Y, int W, int H)
     , darkMode(false)
     , currentServerName("Server")
     , currentChannelName("general")
+    , currentServerId(0)
     , currentChannelId(0)
+    , subscribedChannelId(0)
+    , drainScheduled(false)
     , messageService(nullptr)
+    , historyExhausted(true)
+    , initialStateRequested(false)
+    , historyCache("history_cache")
+    , historySyncedChannelId(0)
+    , socketWatcher(nullptr)
+    , traceWindowMs(0)
+    , dropPending(false)
 {
     begin();
     
@@ -100,16 +122,21 @@ LobbyPage::LobbyPage(int X, int Y, int W, int H)
     chatArea->begin();
     
     // Chat display with scroll
-    chatDisplay = new Fl_Text_Display(X + PADDING, mainY + PADDING, 
-                                       chatW - 2 * PADDING, mainH - 2 * PADDING);
-    chatBuffer = new Fl_Text_Buffer();
-    chatDisplay->buffer(chatBuffer);
-    chatDisplay->wrap_mode(Fl_Text_Display::WRAP_AT_BOUNDS, 0);
+    chatDisplay = new ChatDisplay(X + PADDING, mainY + PADDING, 
+                                  chatW - 2 * PADDING, mainH - 2 * PADDING);
     chatDisplay->box(FL_FLAT_BOX);
     chatDisplay->color(fl_rgb_color(54, 57, 63));
     chatDisplay->textcolor(fl_rgb_color(220, 221, 222));  // Light text
     chatDisplay->textsize(14);
     chatDisplay->scrollbar_width(12);
+    chatDisplay->setOnScrolledToTop([this]() { loadOlderHistory(); });
+    chatDisplay->setOnScrolledToBottom([this]() {
+        // Newer lines were dropped while paging up; show the newest page again
+        if (messageService && currentChannelId != 0) {
+            loadChannelHistory(currentChannelId, messageService);
+        }
+    });
+    chatDisplay->setOnTopTrimmed([this]() { historyExhausted = false; });
     
     chatArea->end();
     chatArea->resizable(chatDisplay);
@@ -193,6 +220,11 @@ LobbyPage::LobbyPage(int X, int Y, int W, int H)
  * @brief Destructor - cleanup network resources
  */
 LobbyPage::~LobbyPage() {
+    Fl::remove_timeout(drainCallback, this);
+    Fl::remove_timeout(traceDumpCallback, this);
+    cancelTransfers();
+    cancelConnect();
+    unwatchClient();
     delete client;
     delete server;
 }
@@ -377,21 +409,23 @@ void LobbyPage::setMemberPanelVisible(bool visible) {
 void LobbyPage::hostServer(const std::string& ip, const std::string& username) {
     cleanupSession();
     this->username = username;
-    server = new ServerSocket(12345, playerDisplay, "config.xml");
-    chatBuffer->append("Server has been created\n");
+    server = new ServerHost(12345, playerDisplay, "config.xml", hostServices);
+    chatDisplay->append("Server has been created");
 
     try {
         client = new ClientSocket(ip, 12345, username, playerDisplay, "config.xml", nullptr);
+        connectedHost = ip;
+        watchClient();
     }
     catch (const std::exception& e) {
-        chatBuffer->append(("[ERROR]: Failed to initialize client: " + std::string(e.what()) + "\n").c_str());
+        chatDisplay->append("[ERROR]: Failed to initialize client: " + std::string(e.what()));
     }
 }
 
 void LobbyPage::joinServer(const std::string& ip, const std::string& username) {
     cleanupSession();
     this->username = username;
-    client = new ClientSocket(ip, 12345, username, playerDisplay, "config.xml", nullptr);
+    connectClient(ip, 12345);
 }
 
 void LobbyPage::hostServer() {
@@ -406,23 +440,28 @@ void LobbyPage::hostServer() {
     }
     currentPort = static_cast<uint16_t>(port);
     
-    server = new ServerSocket(port, playerDisplay, "config.xml");
-    chatBuffer->append("Server has been created\n");
+    server = new ServerHost(port, playerDisplay, "config.xml", hostServices);
+    chatDisplay->append("Server has been created");
     
     try {
         std::string ip = "127.0.0.1";
         client = new ClientSocket(ip, port, username, playerDisplay, "config.xml", nullptr);
-        printf("[LOBBY] Hosting on port %d as '%s'\n", port, username.c_str());
+        connectedHost = ip;
+        subscribedChannelId = 0;
+        watchClient();
+        LOG_INFO("[LOBBY] Hosting on port %d as '%s'", port, username.c_str());
     }
     catch (const std::exception& e) {
-        chatBuffer->append(("[ERROR]: Failed to initialize client: " + std::string(e.what()) + "\n").c_str());
+        chatDisplay->append("[ERROR]: Failed to initialize client: " + std::string(e.what()));
     }
 }
 
 void LobbyPage::joinServer() {
     // Don't call cleanupSession here - it clears channelId which we need
     // Just clean up network resources
+    cancelConnect();
     if (client) {
+        unwatchClient();
         delete client;
         client = nullptr;
     }
@@ -445,23 +484,72 @@ void LobbyPage::joinServer() {
     }
     currentPort = static_cast<uint16_t>(port);
     
-    printf("[LOBBY] Attempting to join %s:%d as '%s'\n", ip.c_str(), port, username.c_str());
+    LOG_INFO("[LOBBY] Attempting to join %s:%d as '%s'", ip.c_str(), port, username.c_str());
+    connectClient(ip, port);
+}
+
+void LobbyPage::connectClient(const std::string& host, int port) {
+    cancelConnect();
+    
+    Settings config("config.xml");
+    int timeoutMs = config.getConnectTimeout(config.findClient(username));
+    if (timeoutMs <= 0) {
+        timeoutMs = static_cast<int>(Connector::DEFAULT_TIMEOUT_MS);
+    }
     
+    std::string target = host + ":" + std::to_string(port);
+    connectedHost = host;
+    chatDisplay->append("Connecting to " + target + "...");
     try {
-        client = new ClientSocket(ip, port, username, playerDisplay, "config.xml", nullptr);
-        if (client) {
-            chatBuffer->append("Connected to server!\n");
-            printf("[LOBBY] Successfully connected to %s:%d\n", ip.c_str(), port);
-        }
+        connector = new Connector(host, port,
+            [this, target](SOCKET socket, const std::string& error) {
+                onClientConnected(socket, error, target);
+            },
+            static_cast<DWORD>(timeoutMs));
+    }
+    catch (const std::exception& e) {
+        chatDisplay->append("[ERROR]: Failed to connect: " + std::string(e.what()));
+        LOG_WARNING("[LOBBY] Connection failed: %s", e.what());
+    }
+}
+
+void LobbyPage::onClientConnected(SOCKET socket, const std::string& error, const std::string& target) {
+    // The worker has finished; deleting the Connector only joins it
+    cancelConnect();
+    
+    if (socket == INVALID_SOCKET) {
+        chatDisplay->append("[ERROR]: Failed to connect: " + error);
+        LOG_WARNING("[LOBBY] Connection to %s failed: %s", target.c_str(), error.c_str());
+        return;
+    }
+    
+    try {
+        client = new ClientSocket(socket, username, playerDisplay, "config.xml", nullptr);
+        subscribedChannelId = 0;
+        watchClient();
+        chatDisplay->append("Connected to server!");
+        LOG_INFO("[LOBBY] Successfully connected to %s", target.c_str());
+        
+        // The channel was opened while the connect was in flight
+        syncChannelSubscription();
+        requestInitialState();
     }
     catch (const std::exception& e) {
-        chatBuffer->append(("[ERROR]: Failed to connect: " + std::string(e.what()) + "\n").c_str());
-        printf("[LOBBY] Connection failed: %s\n", e.what());
+        chatDisplay->append("[ERROR]: Failed to connect: " + std::string(e.what()));
+        LOG_WARNING("[LOBBY] Connection failed: %s", e.what());
     }
 }
 
+void LobbyPage::cancelConnect() {
+    delete connector;
+    connector = nullptr;
+}
+
 void LobbyPage::disconnectAndReset() {
+    cancelTransfers();
+    cancelConnect();
     if (client) {
+        unwatchClient();
         delete client;
         client = nullptr;
     }
@@ -469,61 +557,91 @@ void LobbyPage::disconnectAndReset() {
         delete server;
         server = nullptr;
     }
+    subscribedChannelId = 0;
     cleanupSession();
-    printf("[LOBBY] Disconnected and reset\n");
+    LOG_INFO("[LOBBY] Disconnected and reset");
 }
 
 void LobbyPage::clientLeft(const std::string& clientUsername) {
-    chatBuffer->append(("[SERVER]: " + clientUsername + " has left the server\n").c_str());
+    chatDisplay->append("[SERVER]: " + clientUsername + " has left the server");
 }
 
 void LobbyPage::cleanupSession() {
-    if (chatBuffer) {
-        chatBuffer->text("");
+    if (chatDisplay) {
+        chatDisplay->clear();
     }
+    resetHistoryPaging();
     if (playerDisplay) {
         playerDisplay->clearPlayers();
     }
-    if (chatDisplay) {
-        chatDisplay->redraw();
-    }
     currentChannelId = 0;
 }
 
 /**
  * @brief Load message history for a specific channel
+ *
+ * Only the newest page is read; older pages follow as the user scrolls up.
  */
 void LobbyPage::loadChannelHistory(uint64_t channelId, MessageService* service) {
-    if (!chatBuffer || !service) {
+    if (!chatDisplay || !service) {
         return;
     }
     
     // Store references
     messageService = service;
     currentChannelId = channelId;
+    syncChannelSubscription();
+    requestInitialState();
     
-    // Reload from file to get latest messages from other users
-    service->ReloadFromFile();
+    // Pick up messages other instances logged since the last switch
+    service->PollChanges();
     
     // Clear current chat display
-    chatBuffer->text("");
+    chatDisplay->clear();
+    resetHistoryPaging();
     
-    // Load messages for this channel
-    auto messages = service->GetChannelMessages(channelId);
+    auto messages = service->GetMessagesBefore(channelId, 0, HISTORY_PAGE_SIZE);
     
-    printf("[LOBBY] Loading %zu messages for channel %llu\n", messages.size(), channelId);
+    LOG_DEBUG("[LOBBY] Loading %zu messages for channel %llu", messages.size(), channelId);
     
     for (const auto& msg : messages) {
         // Messages are stored as they were received from the server
         // Just display them directly
-        chatBuffer->append((msg.content + "\n").c_str());
+        chatDisplay->append(msg.content, msg.messageId);
     }
+    historyExhausted = messages.size() < HISTORY_PAGE_SIZE;
     
-    // Scroll to bottom
-    if (chatDisplay) {
-        chatDisplay->scroll(chatBuffer->count_lines(0, chatBuffer->length()), 0);
-        chatDisplay->redraw();
+    chatDisplay->scrollToBottom();
+    
+    // After the local lines, so a cache shown on an empty channel is not cleared
+    historySyncedChannelId = 0;
+    syncChannelHistory();
+}
+
+/**
+ * @brief Prepend the page of history just above what is displayed
+ */
+void LobbyPage::loadOlderHistory() {
+    if (!messageService || !chatDisplay || historyExhausted || currentChannelId == 0) {
+        return;
     }
+    uint64_t oldestShownMessageId = chatDisplay->oldestMessageId();
+    if (oldestShownMessageId == 0) {
+        return;
+    }
+    
+    auto messages = messageService->GetMessagesBefore(currentChannelId, oldestShownMessageId,
+                                                      HISTORY_PAGE_SIZE);
+    historyExhausted = messages.size() < HISTORY_PAGE_SIZE;
+    
+    // Newest first, so each line lands above the one after it
+    for (auto it = messages.rbegin(); it != messages.rend(); ++it) {
+        chatDisplay->prepend(it->content, it->messageId);
+    }
+}
+
+void LobbyPage::resetHistoryPaging() {
+    historyExhausted = true;
 }
 
 /**
@@ -555,78 +673,514 @@ void LobbyPage::sendMessage(const std::string& message) {
         return;
     }
     
+    // A pasted block goes out as one message per line, queued together
+    // and written at once
+    if (message.find('\n') != std::string::npos) {
+        std::optional<ClientSocket::SendBatch> batch;
+        if (client) {
+            batch.emplace(*client);
+        }
+        size_t begin = 0;
+        while (begin <= message.size()) {
+            size_t end = message.find('\n', begin);
+            if (end == std::string::npos) {
+                end = message.size();
+            }
+            size_t length = end - begin;
+            if (length > 0 && message[end - 1] == '\r') {
+                --length;
+            }
+            sendMessage(message.substr(begin, length));
+            begin = end + 1;
+        }
+        batch.reset();
+        updateSendState();
+        return;
+    }
+    
+    // Local diagnostics; works with or without a connection
+    if (message.rfind("/trace", 0) == 0) {
+        startTraceCapture(message.substr(6));
+        return;
+    }
+    if (message.rfind("/capture", 0) == 0) {
+        toggleTrafficCapture(message.substr(8));
+        return;
+    }
+    
+    if (message.rfind("/attach ", 0) == 0) {
+        size_t start = message.find_first_not_of(' ', 8);
+        if (start == std::string::npos) {
+            chatDisplay->append("[ERROR]: Usage: /attach <path>");
+            return;
+        }
+        attachFile(message.substr(start));
+        return;
+    }
+    if (message.rfind("/fetch ", 0) == 0) {
+        fetchAttachment(message.substr(7));
+        return;
+    }
+    
     if (!client) {
-        chatBuffer->append("[ERROR]: Not connected to server\n");
-        printf("[LOBBY] Cannot send message - not connected\n");
+        chatDisplay->append("[ERROR]: Not connected to server");
+        LOG_WARNING("[LOBBY] Cannot send message - not connected");
         return;
     }
     
-    // Prefix message with channel ID for routing
-    // Format: [CH:channelId]message
-    std::string channelMessage = "[CH:" + std::to_string(currentChannelId) + "]" + message;
-    client->send(channelMessage);
-    printf("[LOBBY] Sent to channel %llu: %s\n", currentChannelId, message.c_str());
+    NetProtocol::Result result;
+    if (client->supportsEnvelopes()) {
+        result = sendRequestForInput(message);
+    }
+    else {
+        // Version 1: prefix message with channel ID for routing
+        // Format: [CH:channelId]message
+        std::string channelMessage = "[CH:" + std::to_string(currentChannelId) + "]" + message;
+        result = client->sendSecure(channelMessage);
+    }
+    if (result == NetProtocol::Result::WouldBlock) {
+        chatDisplay->append("[ERROR]: Still sending earlier messages; this one was not sent");
+        return;
+    }
+    if (result != NetProtocol::Result::Success) {
+        chatDisplay->append("[ERROR]: Failed to send message: " + std::string(NetProtocol::ResultToString(result)));
+        LOG_WARNING("[LOBBY] Send failed: %s", NetProtocol::ResultToString(result));
+        return;
+    }
+    LOG_DEBUG("[LOBBY] Queued for channel %llu: %s", currentChannelId, message.c_str());
+    updateSendState();
+}
+
+/**
+ * @brief Show on the Send button whether typed messages are still queued
+ */
+void LobbyPage::updateSendState() {
+    if (!sendButton) {
+        return;
+    }
+    const char* label = client && !client->closed() && client->sending() ? "Sending..." : "Send";
+    if (std::strcmp(sendButton->label(), label) != 0) {
+        sendButton->label(label);
+        sendButton->redraw();
+    }
+}
+
+/**
+ * @brief Translate typed input into a binary request
+ *
+ * Chat commands keep their familiar text syntax in the input box; only
+ * the wire form changes.
+ */
+NetProtocol::Result LobbyPage::sendRequestForInput(const std::string& message) {
+    using Protocol::RequestType;
+    
+    // Whisper: W/targetUser message
+    if (message.rfind("W/", 0) == 0) {
+        size_t spacePos = message.find(' ', 2);
+        if (spacePos == std::string::npos || spacePos == 2) {
+            chatDisplay->append("[ERROR]: Invalid whisper format. Usage: W/username message");
+            return NetProtocol::Result::Success;
+        }
+        Protocol::Payloads::SendDirectMessageRequest request;
+        request.recipientId = 0;
+        request.recipientName = message.substr(2, spacePos - 2);
+        request.content = message.substr(spacePos + 1);
+        return client->sendRequest(RequestType::SendDirectMessage, request);
+    }
+    
+    if (message.rfind("SV/", 0) == 0) {
+        return client->sendRequest(RequestType::GetServerVersion);
+    }
+    
+    if (message.rfind("SM/", 0) == 0) {
+        if (!client->supportsPipelining()) {
+            chatDisplay->append("[ERROR]: Server metrics need a newer server");
+            return NetProtocol::Result::Success;
+        }
+        uint32_t requestId = client->requestServerMetrics([this](Protocol::ErrorCode error, const std::string& json) {
+            chatDisplay->append(error == Protocol::ErrorCode::None
+                ? "[SERVER METRICS]: " + json
+                : std::string("[ERROR]: ") + Protocol::ErrorCodeToMessage(error));
+        });
+        return requestId != 0 ? NetProtocol::Result::Success : NetProtocol::Result::NetworkError;
+    }
+    
+    if (message.rfind("/change_username ", 0) == 0) {
+        changeUsername(message.substr(17));
+        return NetProtocol::Result::Success;
+    }
+    
+    Protocol::Payloads::SendMessageRequest request;
+    request.channelId = currentChannelId;
+    request.content = message;
+    return client->sendRequest(RequestType::SendMessage, request);
 }
 
 void LobbyPage::receiveMessages() {
+    TRACE_ZONE("LobbyPage::receiveMessages");
+    if (!client) {
+        return;
+    }
+    
+    // Frames are length-prefixed, so one read may hold several. Take a
+    // bounded slice so a burst cannot hold up input handling and redraws.
     std::string message;
-    if (client && client->receive(message)) {
-        printf("[LOBBY] Received raw: %s\n", message.c_str());
-        
-        // Check if message has channel prefix [CH:id]
-        uint64_t messageChannelId = 0;
-        std::string displayMessage = message;
-        
-        if (message.rfind("[CH:", 0) == 0) {
-            // Parse channel ID from prefix
-            size_t endBracket = message.find(']');
-            if (endBracket != std::string::npos && endBracket > 4) {
-                std::string channelIdStr = message.substr(4, endBracket - 4);
-                try {
-                    messageChannelId = std::stoull(channelIdStr);
-                    displayMessage = message.substr(endBracket + 1);
-                } catch (...) {
-                    // Failed to parse, treat as channel 0 (global)
-                    messageChannelId = 0;
+    size_t frames = 0;
+    while (frames < MAX_FRAMES_PER_UPDATE &&
+           client->receiveSecure(message) == NetProtocol::Result::Success) {
+        if (!client->handleResponse(message)) {
+            handleIncomingMessage(message);
+        }
+        ++frames;
+    }
+    flushIncomingLines();
+    
+    // Budget spent: carry on as soon as FLTK is idle rather than on the
+    // next 100 ms tick, so a burst drains at network speed
+    if (frames == MAX_FRAMES_PER_UPDATE && !drainScheduled) {
+        drainScheduled = true;
+        Fl::add_timeout(0.0, drainCallback, this);
+    }
+}
+
+void LobbyPage::drainCallback(void* userdata) {
+    LobbyPage* page = static_cast<LobbyPage*>(userdata);
+    page->drainScheduled = false;
+    page->receiveMessages();
+}
+
+/**
+ * @brief Record trace zones on every thread for the given window, then dump them
+ *
+ * The argument is the window in milliseconds (default 5000, at most a
+ * minute). A capture already running is restarted with the new window.
+ */
+void LobbyPage::startTraceCapture(const std::string& argument) {
+    uint64_t windowMs = 5000;
+    size_t start = argument.find_first_not_of(' ');
+    if (start != std::string::npos) {
+        windowMs = std::strtoull(argument.c_str() + start, nullptr, 10);
+    }
+    if (windowMs == 0 || windowMs > 60000) {
+        chatDisplay->append("[ERROR]: Usage: /trace <milliseconds, 1-60000>");
+        return;
+    }
+    
+    traceWindowMs = windowMs;
+    Trace::SetEnabled(true);
+    Fl::remove_timeout(traceDumpCallback, this);
+    Fl::add_timeout(windowMs / 1000.0, traceDumpCallback, this);
+    chatDisplay->append("[TRACE]: Recording for " + std::to_string(windowMs) + " ms");
+}
+
+/**
+ * @brief Record the hosted server's inbound traffic, for LoadGen --replay
+ *
+ * "/capture [path]" starts (default "capture_<ticks>.cap"); "/capture stop"
+ * finishes the file.
+ */
+void LobbyPage::toggleTrafficCapture(const std::string& argument) {
+    if (!server) {
+        chatDisplay->append("[ERROR]: /capture records the server you host");
+        return;
+    }
+    
+    size_t start = argument.find_first_not_of(' ');
+    std::string path = start == std::string::npos ? std::string() : argument.substr(start);
+    if (path == "stop") {
+        uint64_t records = server->StopCapture();
+        chatDisplay->append("[CAPTURE]: Stopped after " + std::to_string(records) + " records");
+        return;
+    }
+    
+    if (path.empty()) {
+        path = "capture_" + std::to_string(GetTickCount64()) + ".cap";
+    }
+    if (server->StartCapture(path)) {
+        chatDisplay->append("[CAPTURE]: Recording inbound traffic to " + path + " (/capture stop to finish)");
+    }
+    else {
+        chatDisplay->append("[ERROR]: Could not create " + path);
+    }
+}
+
+// =============================================================================
+// ATTACHMENTS
+// =============================================================================
+
+namespace {
+
+std::string FormatSize(uint64_t bytes) {
+    char text[32];
+    if (bytes < 1024) {
+        std::snprintf(text, sizeof(text), "%llu B", static_cast<unsigned long long>(bytes));
+    }
+    else if (bytes < 1024 * 1024) {
+        std::snprintf(text, sizeof(text), "%.1f KB", bytes / 1024.0);
+    }
+    else {
+        std::snprintf(text, sizeof(text), "%.1f MB", bytes / (1024.0 * 1024.0));
+    }
+    return text;
+}
+
+} // namespace
+
+int LobbyPage::handle(int event) {
+    switch (event) {
+    case FL_DND_ENTER:
+    case FL_DND_DRAG:
+    case FL_DND_LEAVE:
+        return 1;
+    case FL_DND_RELEASE:
+        dropPending = true;
+        return 1;
+    case FL_PASTE:
+        if (dropPending) {
+            // One path per line; some platforms send file:// URLs
+            dropPending = false;
+            std::string text(Fl::event_text(), Fl::event_length());
+            size_t begin = 0;
+            while (begin < text.size()) {
+                size_t end = text.find('\n', begin);
+                std::string path = text.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+                begin = end == std::string::npos ? text.size() : end + 1;
+                while (!path.empty() && (path.back() == '\r' || path.back() == ' ')) {
+                    path.pop_back();
+                }
+                if (path.rfind("file://", 0) == 0) {
+                    path.erase(0, 7);
+                }
+                if (!path.empty()) {
+                    attachFile(path);
                 }
             }
+            return 1;
         }
-        
-        // System messages (join/leave) go to all channels
-        bool isSystemMessage = (displayMessage.find("[SERVER]:") != std::string::npos);
-        
-        // Only display if it's for current channel or is a system message
-        bool shouldDisplay = isSystemMessage || 
-                            (messageChannelId == 0) || 
-                            (messageChannelId == currentChannelId);
-        
-        if (shouldDisplay) {
-            chatBuffer->append((displayMessage + "\n").c_str());
-            
-            // Auto-scroll to bottom
-            if (chatDisplay) {
-                chatDisplay->scroll(chatBuffer->count_lines(0, chatBuffer->length()), 0);
-                chatDisplay->redraw();
-            }
+        break;
+    default:
+        break;
+    }
+    return Fl_Group::handle(event);
+}
+
+/**
+ * @brief Hash a file, upload whatever the server lacks, then announce it
+ *
+ * A file the server already stores (same digest) is announced at once; a
+ * partly uploaded one continues from where it stopped.
+ */
+void LobbyPage::attachFile(const std::string& path) {
+    if (!client || !client->supportsAttachments()) {
+        chatDisplay->append("[ERROR]: Attachments need a connection to a newer server");
+        return;
+    }
+    
+    size_t slash = path.find_last_of("\\/");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    chatDisplay->append("[FILE]: Preparing " + name + "...");
+    
+    startTransfer(AttachmentTransfer::Hash(path, [this, path, name](const AttachmentTransfer::Result& hashed) {
+        if (!hashed.error.empty()) {
+            chatDisplay->append("[ERROR]: " + hashed.error);
+            return;
+        }
+        if (!client) {
+            return;
         }
         
-        // Save to channel history (use message's channel or current if not specified)
-        if (messageService) {
-            uint64_t saveChannelId = (messageChannelId != 0) ? messageChannelId : currentChannelId;
-            if (saveChannelId != 0) {
-                if (isSystemMessage) {
-                    messageService->AddSystemMessage(saveChannelId, displayMessage);
-                } else {
-                    messageService->AddMessage(saveChannelId, 0, username, displayMessage, Models::MessageType::Text);
+        Protocol::Payloads::AttachmentRequest request;
+        request.direction = static_cast<uint32_t>(Protocol::Payloads::AttachmentDirection::Upload);
+        request.digest = hashed.digest;
+        request.size = hashed.size;
+        request.offset = 0;
+        std::string announcement = "[FILE] " + name + " (" + FormatSize(hashed.size) + ") " + hashed.digest;
+        uint32_t requestId = client->requestAttachment(request,
+            [this, path, name, announcement](Protocol::ErrorCode error, const Protocol::Payloads::AttachmentTicket& ticket) {
+                if (error != Protocol::ErrorCode::None) {
+                    chatDisplay->append(std::string("[ERROR]: ") + Protocol::ErrorCodeToMessage(error));
+                    return;
+                }
+                if (ticket.complete) {
+                    sendMessage(announcement);
+                    return;
                 }
+                if (ticket.offset > 0) {
+                    chatDisplay->append("[FILE]: Resuming " + name + " at " + FormatSize(ticket.offset));
+                }
+                startTransfer(AttachmentTransfer::Upload(path, connectedHost, ticket,
+                    [this, announcement](const AttachmentTransfer::Result& uploaded) {
+                        if (!uploaded.error.empty()) {
+                            chatDisplay->append("[ERROR]: Upload failed: " + uploaded.error);
+                            return;
+                        }
+                        if (client) {
+                            sendMessage(announcement);
+                        }
+                    }));
+            });
+        if (requestId == 0) {
+            chatDisplay->append("[ERROR]: Failed to request an upload");
+        }
+    }));
+}
+
+/**
+ * @brief "/fetch <digest> <path>": download an attachment, resuming a partial one
+ */
+void LobbyPage::fetchAttachment(const std::string& argument) {
+    size_t start = argument.find_first_not_of(' ');
+    size_t split = start == std::string::npos ? std::string::npos : argument.find(' ', start);
+    size_t pathStart = split == std::string::npos ? std::string::npos : argument.find_first_not_of(' ', split);
+    if (pathStart == std::string::npos ||
+        !AttachmentStore::IsValidDigest(std::string_view(argument).substr(start, split - start))) {
+        chatDisplay->append("[ERROR]: Usage: /fetch <digest from a [FILE] line> <path>");
+        return;
+    }
+    if (!client || !client->supportsAttachments()) {
+        chatDisplay->append("[ERROR]: Attachments need a connection to a newer server");
+        return;
+    }
+    
+    std::string digest = argument.substr(start, split - start);
+    std::string path = argument.substr(pathStart);
+    Protocol::Payloads::AttachmentRequest request;
+    request.direction = static_cast<uint32_t>(Protocol::Payloads::AttachmentDirection::Download);
+    request.digest = digest;
+    request.size = 0;
+    request.offset = AttachmentTransfer::PartialLength(path);
+    uint32_t requestId = client->requestAttachment(request,
+        [this, digest, path](Protocol::ErrorCode error, const Protocol::Payloads::AttachmentTicket& ticket) {
+            if (error != Protocol::ErrorCode::None) {
+                chatDisplay->append(std::string("[ERROR]: ") + Protocol::ErrorCodeToMessage(error));
+                return;
+            }
+            chatDisplay->append("[FILE]: Downloading " + FormatSize(ticket.size - ticket.offset) + " to " + path);
+            startTransfer(AttachmentTransfer::Download(path, digest, connectedHost, ticket,
+                [this, path](const AttachmentTransfer::Result& downloaded) {
+                    chatDisplay->append(downloaded.error.empty()
+                        ? "[FILE]: Saved " + path
+                        : "[ERROR]: Download failed: " + downloaded.error);
+                }));
+        });
+    if (requestId == 0) {
+        chatDisplay->append("[ERROR]: Failed to request a download");
+    }
+}
+
+void LobbyPage::startTransfer(std::unique_ptr<AttachmentTransfer> transfer) {
+    // Finished transfers are only joined here; their completions were
+    // already posted and do not need the object
+    transfers.erase(std::remove_if(transfers.begin(), transfers.end(),
+        [](const std::unique_ptr<AttachmentTransfer>& t) { return t->Finished(); }),
+        transfers.end());
+    transfers.push_back(std::move(transfer));
+}
+
+void LobbyPage::cancelTransfers() {
+    // Cancel all first so the joins in the destructors do not queue up
+    for (auto& transfer : transfers) {
+        transfer->Cancel();
+    }
+    transfers.clear();
+}
+
+void LobbyPage::traceDumpCallback(void* userdata) {
+    LobbyPage* page = static_cast<LobbyPage*>(userdata);
+    Trace::SetEnabled(false);
+    
+    std::string path = "trace_" + std::to_string(GetTickCount64()) + ".json";
+    if (Trace::WriteChromeJson(path, page->traceWindowMs)) {
+        page->chatDisplay->append("[TRACE]: Wrote " + path + " (open in ui.perfetto.dev or chrome://tracing)");
+    }
+    else {
+        page->chatDisplay->append("[ERROR]: Could not write " + path);
+    }
+}
+
+void LobbyPage::handleIncomingMessage(const std::string& message) {
+    LOG_DEBUG("[LOBBY] Received raw: %s", message.c_str());
+    
+    // Check if message has channel prefix [CH:id]
+    uint64_t messageChannelId = 0;
+    std::string displayMessage = message;
+    
+    if (message.rfind("[CH:", 0) == 0) {
+        // Parse channel ID from prefix
+        size_t endBracket = message.find(']');
+        if (endBracket != std::string::npos && endBracket > 4) {
+            std::string channelIdStr = message.substr(4, endBracket - 4);
+            try {
+                messageChannelId = std::stoull(channelIdStr);
+                displayMessage = message.substr(endBracket + 1);
+            } catch (...) {
+                // Failed to parse, treat as channel 0 (global)
+                messageChannelId = 0;
             }
         }
     }
-    if (server) {
-        server->handleClientConnections();
+    
+    // System messages (join/leave) go to all channels
+    bool isSystemMessage = (displayMessage.find("[SERVER]:") != std::string::npos);
+    
+    // Only display if it's for current channel or is a system message
+    bool shouldDisplay = isSystemMessage || 
+                        (messageChannelId == 0) || 
+                        (messageChannelId == currentChannelId);
+    
+    // Save to channel history (use message's channel or current if not specified)
+    uint64_t saveChannelId = (messageChannelId != 0) ? messageChannelId : currentChannelId;
+    if (!messageService) {
+        saveChannelId = 0;
+    }
+    
+    if (saveChannelId != 0 || shouldDisplay) {
+        incomingLines.push_back({ std::move(displayMessage), saveChannelId, isSystemMessage, shouldDisplay });
     }
 }
 
+void LobbyPage::flushIncomingLines() {
+    if (incomingLines.empty()) {
+        return;
+    }
+    
+    std::vector<MessageService::NewMessage> batch;
+    std::vector<size_t> batchLine;      // incomingLines index of each batch entry
+    for (size_t i = 0; i < incomingLines.size(); ++i) {
+        const IncomingLine& line = incomingLines[i];
+        if (line.saveChannelId == 0) {
+            continue;
+        }
+        if (line.isSystemMessage) {
+            batch.push_back({ line.saveChannelId, 0, "[SERVER]", line.text, Models::MessageType::System });
+        } else {
+            batch.push_back({ line.saveChannelId, 0, username, line.text, Models::MessageType::Text });
+        }
+        batchLine.push_back(i);
+    }
+    
+    std::vector<uint64_t> savedMessageIds(incomingLines.size(), 0);
+    if (!batch.empty()) {
+        std::vector<Models::Message> saved = messageService->AddMessages(batch);
+        for (size_t i = 0; i < saved.size(); ++i) {
+            if (saved[i].channelId == currentChannelId) {
+                savedMessageIds[batchLine[i]] = saved[i].messageId;     // Lets paging continue from this line
+            }
+        }
+    }
+    
+    // Following the tail keeps the new lines in view; no rescan needed
+    std::vector<ChatDisplay::Entry> block;
+    for (size_t i = 0; i < incomingLines.size(); ++i) {
+        if (incomingLines[i].shouldDisplay) {
+            block.push_back({ std::move(incomingLines[i].text), savedMessageIds[i] });
+        }
+    }
+    chatDisplay->append(block);
+    
+    incomingLines.clear();
+}
+
 void LobbyPage::changeUsername(const std::string& newUsername) {
     try {
         if (client) {
@@ -634,14 +1188,308 @@ void LobbyPage::changeUsername(const std::string& newUsername) {
         }
     }
     catch (const std::exception& e) {
-        if (chatBuffer) {
-            chatBuffer->append(("[ERROR]: Failed to change username: " + std::string(e.what()) + "\n").c_str());
+        if (chatDisplay) {
+            chatDisplay->append("[ERROR]: Failed to change username: " + std::string(e.what()));
         }
     }
 }
 
+/**
+ * @brief Keep the server's channel subscription in step with the open channel
+ *
+ * The server only forwards [CH:id] lines to subscribers, so switching
+ * channels must leave the old one and join the new one.
+ */
+void LobbyPage::syncChannelSubscription() {
+    if (!client || client->closed() || subscribedChannelId == currentChannelId) {
+        return;
+    }
+    
+    auto sendSubscription = [this](Protocol::RequestType type, const char* command, uint64_t channelId) {
+        if (client->supportsEnvelopes()) {
+            Protocol::Payloads::ChannelSubscriptionRequest request;
+            request.channelId = channelId;
+            return client->sendRequest(type, request);
+        }
+        return client->sendSecure(command + std::to_string(channelId));
+    };
+    
+    NetProtocol::Result result = NetProtocol::Result::Success;
+    if (subscribedChannelId != 0) {
+        result = sendSubscription(Protocol::RequestType::LeaveChannel, Protocol::LEAVE_CHANNEL_COMMAND, subscribedChannelId);
+    }
+    if (result == NetProtocol::Result::Success && currentChannelId != 0) {
+        result = sendSubscription(Protocol::RequestType::JoinChannel, Protocol::JOIN_CHANNEL_COMMAND, currentChannelId);
+    }
+    
+    if (result != NetProtocol::Result::Success) {
+        LOG_WARNING("[LOBBY] Failed to update channel subscription: %s", NetProtocol::ResultToString(result));
+        return;
+    }
+    
+    subscribedChannelId = currentChannelId;
+    LOG_DEBUG("[LOBBY] Subscribed to channel %llu", currentChannelId);
+}
+
 void LobbyPage::Update() {
+    TRACE_ZONE("LobbyPage::Update");
+    if (client) {
+        client->flushSends();   // The socket may have woken us because it has room again
+    }
+    syncChannelSubscription();
+    requestInitialState();
+    syncChannelHistory();
     receiveMessages();
+    if (client) {
+        client->expireRequests();
+    }
+    updateSendState();
+}
+
+/**
+ * @brief Fill a freshly opened channel from the server's history, once per connection
+ *
+ * Local history is already on screen when there is any, so the server's
+ * page is only used to fill an empty channel. Nothing else is fetched up
+ * front: the channel list comes from the local stores, the member panel
+ * from presence, and the friend list needs a login this connection
+ * never makes (the server answers NotAuthenticated).
+ */
+void LobbyPage::requestInitialState() {
+    if (initialStateRequested || !client || client->closed() ||
+        !client->supportsPipelining() || currentChannelId == 0) {
+        return;
+    }
+    initialStateRequested = true;
+    
+    // v7 servers are synced per channel against the history cache instead
+    if (!client->supportsHistorySync()) {
+        seedChannelHistory(currentChannelId, true);
+    }
+}
+
+/**
+ * @brief Fetch the newest history of a channel, filling the display if it is empty
+ *
+ * v6 servers stream a full scrollback: the newest chunk is shown as it
+ * arrives and each later (older) chunk is prepended above it. On a v7
+ * server the result also becomes the channel's history cache, the
+ * starting point for later syncs.
+ */
+void LobbyPage::seedChannelHistory(uint64_t channelId, bool display) {
+    using Protocol::Payloads::MessageInfo;
+    bool cache = client->supportsHistorySync();
+    uint32_t historyLimit = client->supportsStreaming() ? static_cast<uint32_t>(ChatDisplay::MAX_SCROLLBACK_LINES)
+                                                        : static_cast<uint32_t>(HISTORY_PAGE_SIZE);
+    client->requestMessageHistory(channelId, 0, historyLimit,
+        [this, channelId, display, cache, started = false, oldestShown = uint64_t(0),
+         chunks = std::vector<std::vector<MessageInfo>>()](
+            Protocol::ErrorCode error, std::vector<MessageInfo>& messages, bool last) mutable {
+            if (error != Protocol::ErrorCode::None) {
+                LOG_WARNING("[LOBBY] History request failed: %s", Protocol::ErrorCodeToMessage(error));
+                return;
+            }
+            LOG_DEBUG("[LOBBY] Server history: %zu message(s) for channel %llu%s", messages.size(), channelId,
+                      last ? "" : " (more to come)");
+            if (cache) {
+                // Chunks arrive newest first; the cache wants the list oldest first
+                chunks.push_back(messages);
+                if (last) {
+                    std::vector<MessageInfo> ordered;
+                    for (auto chunk = chunks.rbegin(); chunk != chunks.rend(); ++chunk) {
+                        ordered.insert(ordered.end(), chunk->begin(), chunk->end());
+                    }
+                    historyCache.Clear(channelId);
+                    historyCache.Append(channelId, ordered);
+                }
+            }
+            if (!display || !chatDisplay || channelId != currentChannelId || messages.empty()) {
+                return;
+            }
+            if (!started) {
+                // Local history already on screen wins over the server's
+                started = true;
+                if (chatDisplay->oldestMessageId() != 0) {
+                    oldestShown = 0;
+                    return;
+                }
+                for (const MessageInfo& message : messages) {
+                    chatDisplay->append(message.content, message.messageId);
+                }
+                chatDisplay->scrollToBottom();
+            }
+            else {
+                // Only continue a block this stream started and nothing else touched
+                if (oldestShown == 0 || chatDisplay->oldestMessageId() != oldestShown) {
+                    oldestShown = 0;
+                    return;
+                }
+                for (auto it = messages.rbegin(); it != messages.rend(); ++it) {
+                    chatDisplay->prepend(it->content, it->messageId);
+                }
+            }
+            oldestShown = chatDisplay->oldestMessageId();
+        });
+}
+
+/**
+ * @brief Bring the open channel's history cache up to date (v7 servers)
+ *
+ * A channel with nothing on screen shows its cache at once. Only the
+ * messages after the cache's newest one are then requested, so
+ * reconnecting to a busy channel costs what was missed rather than the
+ * whole scrollback. An empty cache is seeded with the newest history.
+ */
+void LobbyPage::syncChannelHistory() {
+    if (!client || client->closed() || !client->supportsHistorySync() ||
+        currentChannelId == 0 || historySyncedChannelId == currentChannelId) {
+        return;
+    }
+    historySyncedChannelId = currentChannelId;
+    
+    uint64_t channelId = currentChannelId;
+    bool display = chatDisplay && chatDisplay->oldestMessageId() == 0;
+    uint64_t cursor = historyCache.Cursor(channelId);
+    if (cursor == 0) {
+        seedChannelHistory(channelId, display);
+        return;
+    }
+    
+    if (display) {
+        std::vector<ChatDisplay::Entry> block;
+        for (const HistoryCache::Entry& entry : historyCache.Messages(channelId)) {
+            block.push_back({ entry.content, entry.messageId });
+        }
+        chatDisplay->append(block);
+        chatDisplay->scrollToBottom();
+    }
+    syncHistoryAfter(channelId, cursor, display, 0);
+}
+
+/**
+ * @brief Request one batch after the cursor, then the next until caught up
+ *
+ * Batches come oldest first, so each one can be appended to the cache and
+ * the display as it arrives. More than MAX_SYNC_ROUNDS full batches means
+ * the gap is larger than the cache keeps; the cache is reseeded instead.
+ */
+void LobbyPage::syncHistoryAfter(uint64_t channelId, uint64_t afterMessageId, bool display, uint32_t round) {
+    using Protocol::Payloads::MessageInfo;
+    client->requestHistorySync(channelId, afterMessageId, SYNC_BATCH_SIZE,
+        [this, channelId, display, round, newest = afterMessageId, received = size_t(0)](
+            Protocol::ErrorCode error, std::vector<MessageInfo>& messages, bool last) mutable {
+            if (error != Protocol::ErrorCode::None) {
+                LOG_WARNING("[LOBBY] History sync failed: %s", Protocol::ErrorCodeToMessage(error));
+                return;
+            }
+            historyCache.Append(channelId, messages);
+            if (!messages.empty()) {
+                newest = messages.back().messageId;
+                received += messages.size();
+            }
+            bool showing = display && chatDisplay && channelId == currentChannelId;
+            if (showing && !messages.empty()) {
+                std::vector<ChatDisplay::Entry> block;
+                for (MessageInfo& message : messages) {
+                    block.push_back({ std::move(message.content), message.messageId });
+                }
+                chatDisplay->append(block);
+            }
+            if (!last || received == 0 || !client || client->closed()) {
+                if (last) {
+                    LOG_DEBUG("[LOBBY] History sync: channel %llu is up to date", channelId);
+                }
+                return;
+            }
+            if (round + 1 < MAX_SYNC_ROUNDS) {
+                syncHistoryAfter(channelId, newest, showing, round + 1);
+            }
+            else {
+                LOG_DEBUG("[LOBBY] History sync: channel %llu fell too far behind; reseeding", channelId);
+                seedChannelHistory(channelId, false);
+            }
+        });
+}
+
+/**
+ * @brief Start waking up on data from the current client
+ *
+ * Replaces the old 100 ms UI timer, so nothing runs while idle and a
+ * message is handled as soon as it arrives.
+ */
+void LobbyPage::watchClient() {
+    unwatchClient();
+    if (!client) {
+        return;
+    }
+    initialStateRequested = false;
+    historySyncedChannelId = 0;
+    
+    // v9 servers push presence instead of sending it as chat lines
+    client->setPresenceHandler([this](const std::string& name, bool online) {
+        chatDisplay->append("[SERVER]: " + name + (online ? " is online." : " went offline."));
+    });
+    
+    try {
+        socketWatcher = new SocketWatcher(client->getSocket(), [this]() { onClientReadable(); });
+    }
+    catch (const std::exception& e) {
+        LOG_WARNING("[LOBBY] %s; polling instead", e.what());
+        Fl::add_timeout(FALLBACK_POLL_SECONDS, pollCallback, this);
+    }
+    
+    if (client->sendsHeartbeats()) {
+        Fl::add_timeout(NetProtocol::HEARTBEAT_INTERVAL_MS / 1000.0, heartbeatCallback, this);
+    }
+    
+    // Data may have arrived with the handshake, before the watcher existed
+    Update();
+}
+
+void LobbyPage::unwatchClient() {
+    delete socketWatcher;
+    socketWatcher = nullptr;
+    Fl::remove_timeout(pollCallback, this);
+    Fl::remove_timeout(heartbeatCallback, this);
+    if (sendButton) {
+        sendButton->label("Send");
+    }
+}
+
+void LobbyPage::onClientReadable() {
+    Update();
+    
+    if (client && client->closed()) {
+        LOG_INFO("[LOBBY] Connection closed by server");
+        unwatchClient();
+    }
+}
+
+void LobbyPage::pollCallback(void* userdata) {
+    LobbyPage* page = static_cast<LobbyPage*>(userdata);
+    page->Update();
+    if (page->client && !page->client->closed()) {
+        Fl::repeat_timeout(FALLBACK_POLL_SECONDS, pollCallback, userdata);
+    }
+}
+
+void LobbyPage::heartbeatCallback(void* userdata) {
+    LobbyPage* page = static_cast<LobbyPage*>(userdata);
+    if (!page->client || page->client->closed()) {
+        return;
+    }
+    
+    page->client->expireRequests();
+    
+    // Keeps the server's idle cutoff from firing while nobody is typing
+    NetProtocol::Result result = page->client->sendRequest(Protocol::RequestType::Heartbeat);
+    if (result != NetProtocol::Result::Success) {
+        LOG_WARNING("[LOBBY] Heartbeat failed: %s", NetProtocol::ResultToString(result));
+        if (result != NetProtocol::Result::WouldBlock) {
+            return;     // A full send queue is congestion, not a dead connection
+        }
+    }
+    Fl::repeat_timeout(NetProtocol::HEARTBEAT_INTERVAL_MS / 1000.0, heartbeatCallback, userdata);
 }
 
 // =============================================================================
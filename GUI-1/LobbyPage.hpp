@@ -4,19 +4,24 @@
 #include <FL/Fl_Group.H>
 #include <FL/Fl_Input.H>
 #include <FL/Fl_Button.H>
-#include <FL/Fl_Text_Display.H>
-#include <FL/Fl_Text_Buffer.H>
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Scroll.H>
 
 #include <string>
+#include <vector>
 #include <functional>
+#include <memory>
+#include "AttachmentTransfer.h"
 #include "ClientSocket.h"
-#include "ServerSocket.h"
+#include "Connector.h"
+#include "ServerHost.h"
 #include "PlayerDisplay.hpp"
 #include "SettingsWindow.hpp"
 #include "AboutWindow.h"
 #include "MessageService.h"
+#include "ChatDisplay.hpp"
+#include "SocketWatcher.h"
+#include "HistoryCache.h"
 
 // Forward declarations
 class SettingsWindow;
@@ -26,6 +31,9 @@ class LobbyPage : public Fl_Group {
 public:
     LobbyPage(int X, int Y, int W, int H);
     ~LobbyPage();
+    
+    // Accepts files dropped onto the page as attachments
+    int handle(int event) override;
 
     // Original methods with parameters (legacy)
     void hostServer(const std::string& ip, const std::string& username);
@@ -40,7 +48,7 @@ public:
     Fl_Input* getIpInput() { return ipInput; }
     Fl_Input* getPortInput() { return portInput; }
     
-    void Update();  // Network update
+    void Update();  // Network update, run whenever the connection is readable or writable
     void sendMessage(const std::string& message);
     void receiveMessages();
     void setUsername(const std::string& user) { username = user; }
@@ -48,6 +56,7 @@ public:
     void setServerName(const std::string& name);
     void setChannelName(const std::string& name);
     void setCurrentChannel(uint64_t channelId) { currentChannelId = channelId; }
+    void setServerId(uint64_t serverId) { currentServerId = serverId; }
     uint64_t getCurrentChannel() const { return currentChannelId; }
     void clientLeft(const std::string& username);
     void resizeWidgets(int X, int Y, int W, int H);
@@ -56,6 +65,9 @@ public:
     
     // Channel-based message history
     void setMessageService(MessageService* service) { messageService = service; }
+    
+    // Stores the hosted server answers data requests from (set before hostServer())
+    void setHostServices(const ServerSocket::DataServices& services) { hostServices = services; }
     void loadChannelHistory(uint64_t channelId, MessageService* service);
     void saveMessageToHistory(const std::string& senderName, const std::string& content);
     void saveSystemMessageToHistory(const std::string& content);
@@ -82,8 +94,7 @@ public:
     // UI Components - Main Area
     Fl_Group* mainArea;
     Fl_Group* chatArea;
-    Fl_Text_Display* chatDisplay;
-    Fl_Text_Buffer* chatBuffer;
+    ChatDisplay* chatDisplay;
     Fl_Scroll* scrollArea;
     
     // UI Components - Member List
@@ -102,7 +113,8 @@ public:
 
     // Network components
     ClientSocket* client;
-    ServerSocket* server;
+    ServerHost* server;     // Hosted server, runs on its own network thread
+    Connector* connector;   // Join in progress; becomes client once connected
     
     // Windows
     SettingsWindow* settings;
@@ -116,12 +128,32 @@ private:
     std::string username;
     std::string currentServerName;
     std::string currentChannelName;
+    uint64_t currentServerId;
     uint64_t currentChannelId;
+    uint64_t subscribedChannelId;   // Channel the server is currently sending us (0 = none)
+    bool drainScheduled;            // A follow-up receiveMessages() is queued with FLTK
     uint16_t currentPort;
     bool darkMode;
     
     // Message service for persistent history
     MessageService* messageService;
+    bool historyExhausted;          // No older history left to page in
+    ServerSocket::DataServices hostServices;
+    
+    // Seed the open channel from the server's history, once per connection
+    // (protocol v4 servers)
+    bool initialStateRequested;
+    void requestInitialState();
+    
+    // Server history kept on disk per channel; a v7 server then sends only
+    // what is newer than the cache (SyncHistory) instead of the scrollback
+    HistoryCache historyCache;
+    uint64_t historySyncedChannelId;    // Channel synced on this connection (0 = none)
+    static constexpr uint32_t SYNC_BATCH_SIZE = 500;
+    static constexpr uint32_t MAX_SYNC_ROUNDS = 2;     // Batches per sync before reseeding instead
+    void syncChannelHistory();
+    void syncHistoryAfter(uint64_t channelId, uint64_t afterMessageId, bool display, uint32_t round);
+    void seedChannelHistory(uint64_t channelId, bool display);
     
     std::function<void()> onBackClicked;
     std::function<void()> onSettingsClicked;
@@ -133,6 +165,79 @@ private:
     static void sendButtonCallback(Fl_Widget* widget, void* userdata);
     static void messageInputCallback(Fl_Widget* widget, void* userdata);
     
+    // Tell the server which channel to deliver (JoinChannel/LeaveChannel)
+    void syncChannelSubscription();
+    
+    // Send typed input as a binary request (protocol v2 servers)
+    NetProtocol::Result sendRequestForInput(const std::string& message);
+    
+    // Send button reads "Sending..." while the client's send queue is not empty
+    void updateSendState();
+    
+    // One received line, held until the end of the current frame
+    struct IncomingLine {
+        std::string text;
+        uint64_t saveChannelId;     // Channel history it goes to (0 = not saved)
+        bool isSystemMessage;
+        bool shouldDisplay;
+    };
+    std::vector<IncomingLine> incomingLines;
+    
+    // Parse one frame received from the server into incomingLines
+    void handleIncomingMessage(const std::string& message);
+    
+    // Persist and display incomingLines as one batch: one history write,
+    // one append to the transcript and one redraw
+    void flushIncomingLines();
+    
+    // Connection wake-ups: a SocketWatcher while connected, nothing otherwise.
+    // If the socket cannot be watched, fall back to polling.
+    SocketWatcher* socketWatcher;
+    static constexpr double FALLBACK_POLL_SECONDS = 0.1;
+    void watchClient();
+    void unwatchClient();
+    
+    // Joins connect on a Connector thread so an unreachable host never
+    // blocks the UI; the handshake runs here once the socket is connected
+    void connectClient(const std::string& host, int port);
+    void onClientConnected(SOCKET socket, const std::string& error, const std::string& target);
+    void cancelConnect();
+    void onClientReadable();
+    static void pollCallback(void* userdata);
+    
+    // Heartbeat requests while connected, so the server can tell an idle
+    // client from a dead one (protocol v3 servers)
+    static void heartbeatCallback(void* userdata);
+    
+    // Frames handled per receiveMessages() call before yielding to the UI
+    static constexpr size_t MAX_FRAMES_PER_UPDATE = 64;
+    static void drainCallback(void* userdata);
+    
+    // "/trace <ms>": record trace zones for that long, then write a Chrome trace
+    uint64_t traceWindowMs;
+    void startTraceCapture(const std::string& argument);
+    static void traceDumpCallback(void* userdata);
+    
+    // "/capture [path]" / "/capture stop": record the hosted server's traffic
+    void toggleTrafficCapture(const std::string& argument);
+    
+    // Attachments (protocol v10): "/attach <path>" or a dropped file is hashed,
+    // uploaded over the server's transfer port and announced as a [FILE] line;
+    // "/fetch <digest> <path>" downloads one. Transfers run on their own
+    // threads and connections, so chat keeps flowing meanwhile.
+    std::string connectedHost;      // Host the client connected to; transfers go there too
+    std::vector<std::unique_ptr<AttachmentTransfer>> transfers;
+    bool dropPending;               // The next FL_PASTE carries dropped file paths
+    void attachFile(const std::string& path);
+    void fetchAttachment(const std::string& argument);
+    void startTransfer(std::unique_ptr<AttachmentTransfer> transfer);
+    void cancelTransfers();
+    
+    // History paging: the newest page on channel switch, older pages on scroll-up
+    static constexpr size_t HISTORY_PAGE_SIZE = 50;
+    void loadOlderHistory();
+    void resetHistoryPaging();
+    
     // Theme colors
     void updateColors();
 };
@@ -0,0 +1,224 @@
+/**
+ * @file Log.cpp
+ * @brief Implementation of the log queue and its writer thread
+ */
+
+#include "Log.h"
+#include <Windows.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace {
+
+static_assert((Log::QUEUE_SLOTS & (Log::QUEUE_SLOTS - 1)) == 0, "QUEUE_SLOTS must be a power of two");
+
+// A slot is free for the producer that claims position p when its
+// sequence equals p, and ready for the writer when it equals p + 1
+struct Slot {
+    std::atomic<size_t> sequence;
+    size_t length;
+    char text[Log::LINE_BYTES];
+};
+
+Slot slots[Log::QUEUE_SLOTS];
+std::atomic<size_t> enqueuePos{ 0 };
+size_t dequeuePos = 0;                      // Writer thread only
+std::atomic<uint64_t> droppedLines{ 0 };
+std::atomic<int> minLevel{ static_cast<int>(Log::Level::Info) };
+
+enum class State { Idle, Running, Stopped };
+std::atomic<State> state{ State::Idle };
+std::once_flag startOnce;
+std::thread* writer = nullptr;              // Joined by Shutdown(), never freed
+HANDLE wakeEvent = nullptr;
+std::atomic<bool> writerSleeping{ false };
+std::atomic<bool> stopRequested{ false };
+std::mutex shutdownMutex;
+
+// Format one line, newline included, into a buffer of LINE_BYTES
+size_t FormatLine(char* out, uint32_t suppressed, const char* format, va_list args) {
+    char note[64] = "";
+    if (suppressed > 0) {
+        snprintf(note, sizeof(note), " (%u similar lines suppressed)", suppressed);
+    }
+    size_t noteLength = strlen(note);
+
+    // Room for the note, the newline and the terminator
+    size_t room = Log::LINE_BYTES - noteLength - 2;
+    int written = vsnprintf(out, room + 1, format, args);
+    size_t length = written < 0 ? 0 : static_cast<size_t>(written);
+    if (length > room) {
+        length = room;
+        memcpy(out + room - 3, "...", 3);
+    }
+    memcpy(out + length, note, noteLength);
+    length += noteLength;
+    out[length++] = '\n';
+    out[length] = '\0';
+    return length;
+}
+
+void WriteDirect(const char* text, size_t length) {
+    fwrite(text, 1, length, stdout);
+    fflush(stdout);
+}
+
+// Writes every ready slot; returns the number of lines written
+size_t DrainQueue() {
+    size_t lines = 0;
+    for (;;) {
+        Slot& slot = slots[dequeuePos & (Log::QUEUE_SLOTS - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+            break;
+        }
+        fwrite(slot.text, 1, slot.length, stdout);
+        slot.sequence.store(dequeuePos + Log::QUEUE_SLOTS, std::memory_order_release);
+        ++dequeuePos;
+        ++lines;
+    }
+
+    uint64_t dropped = droppedLines.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        fprintf(stdout, "[LOG] %llu lines dropped: log queue full\n", static_cast<unsigned long long>(dropped));
+    }
+    if (lines > 0 || dropped > 0) {
+        fflush(stdout);
+    }
+    return lines;
+}
+
+void RunWriter() {
+    for (;;) {
+        if (DrainQueue() > 0) {
+            continue;
+        }
+        if (stopRequested.load(std::memory_order_acquire)) {
+            DrainQueue();
+            return;
+        }
+
+        // Announce the sleep, then look once more: a producer that
+        // published after the drain above either sees the flag or its
+        // line is found here
+        writerSleeping.store(true, std::memory_order_seq_cst);
+        if (DrainQueue() == 0) {
+            WaitForSingleObject(wakeEvent, 100);
+        }
+        writerSleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void StartWriter() {
+    wakeEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    if (!wakeEvent) {
+        state.store(State::Stopped, std::memory_order_release);
+        return;
+    }
+    for (size_t i = 0; i < Log::QUEUE_SLOTS; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writer = new std::thread(RunWriter);
+    state.store(State::Running, std::memory_order_release);
+    std::atexit(Log::Shutdown);
+}
+
+void Enqueue(uint32_t suppressed, const char* format, va_list args) {
+    std::call_once(startOnce, StartWriter);
+    if (state.load(std::memory_order_acquire) != State::Running) {
+        char line[Log::LINE_BYTES];
+        size_t length = FormatLine(line, suppressed, format, args);
+        WriteDirect(line, length);
+        return;
+    }
+
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+        slot = &slots[pos & (Log::QUEUE_SLOTS - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (difference == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (difference < 0) {
+            droppedLines.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->length = FormatLine(slot->text, suppressed, format, args);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writerSleeping.load(std::memory_order_relaxed)) {
+        SetEvent(wakeEvent);
+    }
+}
+
+} // namespace
+
+namespace Log {
+
+void SetLevel(Level level) {
+    minLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+void Write(Level level, const char* format, ...) {
+    if (static_cast<int>(level) < minLevel.load(std::memory_order_relaxed)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    Enqueue(0, format, args);
+    va_end(args);
+}
+
+void WriteSuppressed(Level level, uint32_t suppressed, const char* format, ...) {
+    if (static_cast<int>(level) < minLevel.load(std::memory_order_relaxed)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    Enqueue(suppressed, format, args);
+    va_end(args);
+}
+
+void Shutdown() {
+    std::lock_guard<std::mutex> lock(shutdownMutex);
+    State expected = State::Running;
+    if (!state.compare_exchange_strong(expected, State::Stopped, std::memory_order_acq_rel)) {
+        return;
+    }
+    // Producers that saw Running may still be filling slots; the writer
+    // drains until it finds the queue empty after the stop request
+    stopRequested.store(true, std::memory_order_release);
+    SetEvent(wakeEvent);
+    writer->join();
+}
+
+bool SiteLimiter::Allow(uint32_t& suppressed) {
+    uint64_t now = GetTickCount64();
+    uint64_t windowStart = m_windowStartMs.load(std::memory_order_relaxed);
+    if (now - windowStart >= 1000 &&
+        m_windowStartMs.compare_exchange_strong(windowStart, now, std::memory_order_relaxed)) {
+        m_linesInWindow.store(0, std::memory_order_relaxed);
+    }
+    if (m_linesInWindow.fetch_add(1, std::memory_order_relaxed) < SECURITY_LINES_PER_SECOND) {
+        suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+} // namespace Log
@@ -0,0 +1,118 @@
+#ifndef LOG_H
+#define LOG_H
+
+/**
+ * @file Log.h
+ * @brief Leveled logger with a lock-free queue and a background writer
+ *
+ * PURPOSE:
+ * Hot paths used to printf once per event: every received frame, every
+ * history save, every roster change. A Windows console write costs far
+ * more than handling the message that caused it. LOG_* calls now format
+ * into a queue slot and return; one background thread writes the lines
+ * to stdout in batches.
+ *
+ * DESIGN:
+ * - Levels Debug < Info < Warning < Error. LOG_DEBUG compiles to nothing
+ *   unless LOG_COMPILED_LEVEL is 0 (the default only in _DEBUG builds),
+ *   so its arguments are not even evaluated in release builds
+ * - Lines below the runtime level (SetLevel) return before formatting
+ * - The queue is a bounded multi-producer ring (sequence-numbered slots).
+ *   A producer never waits: when the ring is full the line is counted as
+ *   dropped and the writer reports the count
+ * - LOG_SECURITY is a Warning limited to SECURITY_LINES_PER_SECOND per
+ *   call site; the next line that gets through says how many were held
+ *   back, so a flood of bad input cannot turn into a flood of output
+ * - Messages carry their own "[TAG] " prefix, as the printf lines did;
+ *   the logger appends the newline
+ *
+ * THREADING:
+ * Write() may be called from any thread. The writer starts with the first
+ * line and Shutdown() (also run at exit) drains and stops it; lines
+ * logged after that are written directly.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef LOG_COMPILED_LEVEL
+#ifdef _DEBUG
+#define LOG_COMPILED_LEVEL 0
+#else
+#define LOG_COMPILED_LEVEL 1
+#endif
+#endif
+
+namespace Log {
+
+enum class Level { Debug, Info, Warning, Error };
+
+/** Longest line kept; longer lines are cut and end in "..." */
+constexpr size_t LINE_BYTES = 512;
+
+/** Lines that may wait for the writer */
+constexpr size_t QUEUE_SLOTS = 1024;
+
+/** Lines one LOG_SECURITY call site may print per second */
+constexpr uint32_t SECURITY_LINES_PER_SECOND = 5;
+
+/** @brief Lines below this level are discarded (default Info) */
+void SetLevel(Level level);
+
+/**
+ * @brief Queue one printf-style line
+ */
+void Write(Level level, const char* format, ...);
+
+/**
+ * @brief Write() with a note that this many similar lines were held back
+ */
+void WriteSuppressed(Level level, uint32_t suppressed, const char* format, ...);
+
+/**
+ * @brief Write every queued line and stop the writer thread (idempotent)
+ */
+void Shutdown();
+
+/**
+ * @brief Per-call-site budget behind LOG_SECURITY
+ */
+class SiteLimiter {
+public:
+    constexpr SiteLimiter() : m_windowStartMs(0), m_linesInWindow(0), m_suppressed(0) {}
+
+    /**
+     * @brief Take one line from this second's budget
+     * @param suppressed Output: lines held back since the last one allowed
+     */
+    bool Allow(uint32_t& suppressed);
+
+private:
+    std::atomic<uint64_t> m_windowStartMs;
+    std::atomic<uint32_t> m_linesInWindow;
+    std::atomic<uint32_t> m_suppressed;
+};
+
+} // namespace Log
+
+#if LOG_COMPILED_LEVEL <= 0
+#define LOG_DEBUG(...) ::Log::Write(::Log::Level::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#define LOG_INFO(...) ::Log::Write(::Log::Level::Info, __VA_ARGS__)
+#define LOG_WARNING(...) ::Log::Write(::Log::Level::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) ::Log::Write(::Log::Level::Error, __VA_ARGS__)
+
+#define LOG_SECURITY(...)                                                               \
+    do {                                                                                \
+        static ::Log::SiteLimiter logSiteLimiter_;                                      \
+        uint32_t logSuppressed_ = 0;                                                    \
+        if (logSiteLimiter_.Allow(logSuppressed_)) {                                    \
+            ::Log::WriteSuppressed(::Log::Level::Warning, logSuppressed_, __VA_ARGS__); \
+        }                                                                               \
+    } while (0)
+
+#endif // LOG_H
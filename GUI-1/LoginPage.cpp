@@ -4,6 +4,7 @@
  */
 
 #include "LoginPage.h"
+#include "UiDispatcher.h"
 #include <FL/fl_ask.H>
 
 // Color constants
@@ -30,13 +31,16 @@ LoginPage::LoginPage(int x, int y, int width, int height, UserDatabase* userDb)
     , confirmPasswordInput(nullptr)
     , actionButton(nullptr)
     , switchModeButton(nullptr)
-    , statusLabel(nullptr) {
+    , statusLabel(nullptr)
+    , alive(std::make_shared<bool>(true)) {
     
     setupLayout();
     end();
 }
 
 LoginPage::~LoginPage() {
+    // Hashing jobs still in flight must not touch this page
+    *alive = false;
     // FLTK handles widget cleanup
 }
 
@@ -198,6 +202,10 @@ void LoginPage::setMode(bool isRegisterMode) {
     redraw();
 }
 
+void LoginPage::setLoading(bool loading) {
+    setBusy(loading, loading ? "Loading..." : "");
+}
+
 void LoginPage::updateButtonLabels() {
     // Already handled in setMode
 }
@@ -225,8 +233,21 @@ void LoginPage::performLogin() {
     std::string username = usernameInput->value();
     std::string password = passwordInput->value();
     
-    Models::Session session;
-    Protocol::ErrorCode result = userDatabase->AuthenticateUser(username, password, session);
+    setBusy(true, "Signing in...");
+    std::shared_ptr<bool> token = alive;
+    userDatabase->AuthenticateUserAsync(username, password,
+        [this, token, username](Protocol::ErrorCode result, const Models::Session& session) {
+            UiDispatcher::Post([this, token, username, result, session]() {
+                if (*token) {
+                    finishLogin(result, username, session);
+                }
+            });
+        });
+}
+
+void LoginPage::finishLogin(Protocol::ErrorCode result, const std::string& username,
+                            const Models::Session& session) {
+    setBusy(false, "");
     
     if (result == Protocol::ErrorCode::None) {
         showSuccess("Login successful!");
@@ -234,6 +255,8 @@ void LoginPage::performLogin() {
         if (onAuthenticatedCallback) {
             onAuthenticatedCallback(session.userId, username, session.sessionToken);
         }
+    } else if (result == Protocol::ErrorCode::RateLimited) {
+        showError("Server busy. Please try again.");
     } else {
         // Don't reveal whether username or password was wrong
         showError("Invalid username or password");
@@ -248,13 +271,25 @@ void LoginPage::performRegister() {
     std::string username = usernameInput->value();
     std::string password = passwordInput->value();
     
-    uint64_t userId = 0;
-    Protocol::ErrorCode result = userDatabase->RegisterUser(username, password, userId);
+    setBusy(true, "Creating account...");
+    std::shared_ptr<bool> token = alive;
+    userDatabase->RegisterUserAsync(username, password,
+        [this, token](Protocol::ErrorCode result, uint64_t) {
+            UiDispatcher::Post([this, token, result]() {
+                if (*token) {
+                    finishRegister(result);
+                }
+            });
+        });
+}
+
+void LoginPage::finishRegister(Protocol::ErrorCode result) {
+    setBusy(false, "");
     
     switch (result) {
         case Protocol::ErrorCode::None:
-            showSuccess("Account created! You can now login.");
             setMode(false);  // Switch to login mode
+            showSuccess("Account created! You can now login.");
             break;
             
         case Protocol::ErrorCode::UsernameAlreadyExists:
@@ -269,12 +304,29 @@ void LoginPage::performRegister() {
             showError("Password does not meet requirements");
             break;
             
+        case Protocol::ErrorCode::RateLimited:
+            showError("Server busy. Please try again.");
+            break;
+            
         default:
             showError("Registration failed. Please try again.");
             break;
     }
 }
 
+void LoginPage::setBusy(bool busy, const char* message) {
+    if (busy) {
+        actionButton->deactivate();
+        switchModeButton->deactivate();
+    } else {
+        actionButton->activate();
+        switchModeButton->activate();
+    }
+    statusLabel->labelcolor(subtitleLabel->labelcolor());
+    statusLabel->copy_label(message);
+    redraw();
+}
+
 bool LoginPage::validateLoginInput() {
     std::string username = usernameInput->value();
     std::string password = passwordInput->value();
@@ -18,6 +18,7 @@
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Choice.H>
 #include <functional>
+#include <memory>
 #include <string>
 #include "UserDatabase.h"
 #include "Models.h"
@@ -68,6 +69,11 @@ public:
      */
     void setMode(bool isRegisterMode);
     
+    /**
+     * @brief Hold off logins and registrations while the user database loads
+     */
+    void setLoading(bool loading);
+    
 private:
     UserDatabase* userDatabase;
     AuthCallback onAuthenticatedCallback;
@@ -83,6 +89,10 @@ private:
     Fl_Button* switchModeButton;            // Toggle between modes
     Fl_Box* statusLabel;                    // Error/success messages
     
+    // Password hashing runs on UserDatabase's worker pool; results come back
+    // through UiDispatcher and are dropped once this page is gone
+    std::shared_ptr<bool> alive;
+    
     // Layout helpers
     void setupLayout();
     void updateButtonLabels();
@@ -94,6 +104,10 @@ private:
     // Action handlers
     void performLogin();
     void performRegister();
+    void finishLogin(Protocol::ErrorCode result, const std::string& username,
+                     const Models::Session& session);
+    void finishRegister(Protocol::ErrorCode result);
+    void setBusy(bool busy, const char* message);
     
     // Validation
     bool validateLoginInput();
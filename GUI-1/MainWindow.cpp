@@ -2,8 +2,13 @@
 #include "HomePage.hpp"
 #include "LobbyPage.hpp"
 #include <FL/fl_ask.H>
+#include <future>
 #include <memory>
 #include "Settings.h"
+#include "PersistenceWorker.h"
+#include "UiDispatcher.h"
+#include "Trace.h"
+#include "AddressResolver.h"
 
 // For getting local IP
 #include <winsock2.h>
@@ -23,11 +28,14 @@ MainWindow::MainWindow(int width, int height)
     , loginPage(nullptr)
     , serverBrowser(nullptr)
     , channelList(nullptr)
+    , servicesReady(false)
     , currentUserId(0)
     , currentServerId(0)
     , currentChannelId(0)
     , isHostingServer(false)
-    , timer(0.1) {
+    , darkMode(false)
+    , themeApplied(false)
+    , alive(std::make_shared<bool>(true)) {
 
     // Load resolution from settings XML
     Settings settings("config.xml");
@@ -41,7 +49,7 @@ MainWindow::MainWindow(int width, int height)
     // Make the window resizable
     resizable(this);
 
-    // Initialize services first
+    // Start loading the services; the pages only keep pointers until then
     initializeServices();
 
     // Initialize LoginPage (shown first for new Discord-like flow)
@@ -53,74 +61,41 @@ MainWindow::MainWindow(int width, int height)
     add(loginPage);
     loginPage->hide();  // Will be shown after setup
 
-    // Initialize homePage (legacy - for direct IP connection)
-    homePage = new HomePage(0, 0, savedWidth, savedHeight, this);
-    if (!homePage) {
-        fl_alert("Failed to create HomePage!");
-        return;
-    }
-    add(homePage);
-    homePage->hide();
-
-    // Initialize ServerBrowser
-    serverBrowser = new ServerBrowser(0, 0, 250, savedHeight,
-                                       serverManager.get(),
-                                       userDatabase.get(),
-                                       friendService.get());
-    if (!serverBrowser) {
-        fl_alert("Failed to create ServerBrowser!");
-        return;
-    }
-    add(serverBrowser);
-    serverBrowser->hide();
-
-    // Initialize ChannelList
-    channelList = new ChannelList(0, 0, 200, savedHeight,
-                                   serverManager.get(),
-                                   userDatabase.get());
-    if (!channelList) {
-        fl_alert("Failed to create ChannelList!");
-        return;
-    }
-    add(channelList);
-    channelList->hide();
-
-    // Initialize lobbyPage (chat area)
-    lobbyPage = new LobbyPage(0, 0, savedWidth, savedHeight);
-    if (!lobbyPage) {
-        fl_alert("Failed to create LobbyPage!");
-        return;
-    }
-    add(lobbyPage);
-    lobbyPage->hide();
-
-    // Setup callbacks between pages
-    setupPageCallbacks();
+    // LoginPage callback - when user successfully logs in
+    loginPage->setOnAuthenticated([this](uint64_t userId, const std::string& username, const std::string& token) {
+        currentUserId = userId;
+        currentUsername = username;
+        currentSessionToken = token;
+        
+        printf("[APP] User authenticated: %s\n", username.c_str());
+        
+        switchToServerBrowser();
+    });
 
-    // End adding widgets to this window
+    // The other pages are built on first navigation (see ensureHomePage()
+    // and its siblings), so a user who never opens one never pays for it
     end();
 
-    // Start with the new Discord-like login flow
+    // Start with the new Discord-like login flow, usable once the users load
+    loginPage->setLoading(!servicesReady);
     loginPage->show();
 
-    // Timer for periodic updates
-    timer.setCallback([](void* userdata) {
-        auto* window = static_cast<MainWindow*>(userdata);
-        if (window) {
-            window->onTick(userdata);
-        }
-    });
-    timer.setUserData(this);
-    timer.start();
-
     // Set the minimum window size
     size_range(800, 600, 10000, 10000);
 }
 
 MainWindow::~MainWindow() {
+    *alive = false;
+    if (serviceLoader.joinable()) {
+        serviceLoader.join();
+    }
+    
     // Disconnect from any active server
     disconnectFromCurrentServer();
     
+    // Write out changes still waiting for their commit window
+    PersistenceWorker::FlushAll();
+    
     delete homePage;
     delete lobbyPage;
     delete loginPage;
@@ -130,72 +105,145 @@ MainWindow::~MainWindow() {
 }
 
 void MainWindow::initializeServices() {
-    // Create database directory if needed
-    userDatabase = std::make_unique<UserDatabase>("user_data.xml");
-    serverManager = std::make_unique<ServerManager>("server_data.xml", *userDatabase);
-    friendService = std::make_unique<FriendService>("friend_data.xml", *userDatabase);
-    messageService = std::make_unique<MessageService>("message_history.xml");
+    // Every instance on these data files needs its own ID node, or two can
+    // mint the same message or server ID in the same millisecond
+    if (!Models::ClaimUniqueIdNode(".")) {
+        printf("[APP] Every ID node is held by another instance; IDs may collide\n");
+    }
+    
+    userDatabase = std::make_unique<UserDatabase>("user_data.xml", false);
+    serverManager = std::make_unique<ServerManager>("server_data.xml", *userDatabase, false);
+    friendService = std::make_unique<FriendService>("friend_data.xml", *userDatabase, false);
+    
+    // The three files load side by side, so startup waits for the largest
+    // of them rather than their sum; only the membership sync needs all
+    // of the users first
+    std::shared_ptr<bool> token = alive;
+    serviceLoader = std::thread([this, token]() {
+        Trace::SetThreadName("service-loader");
+        auto servers = std::async(std::launch::async, [this]() { serverManager->LoadFromFile(); });
+        auto friends = std::async(std::launch::async, [this]() { friendService->LoadFromFile(); });
+        userDatabase->LoadFromFile();
+        servers.wait();
+        friends.wait();
+        serverManager->SyncMemberships();
+        
+        UiDispatcher::Post([this, token]() {
+            if (*token) {
+                onServicesLoaded();
+            }
+        });
+    });
 }
 
-void MainWindow::setupPageCallbacks() {
-    // LoginPage callback - when user successfully logs in
+void MainWindow::onServicesLoaded() {
+    serviceLoader.join();
+    servicesReady = true;
     if (loginPage) {
-        loginPage->setOnAuthenticated([this](uint64_t userId, const std::string& username, const std::string& token) {
-            currentUserId = userId;
-            currentUsername = username;
-            currentSessionToken = token;
-            
-            printf("[APP] User authenticated: %s\n", username.c_str());
-            
-            switchToServerBrowser();
-        });
+        loginPage->setLoading(false);
+    }
+}
+
+MessageService* MainWindow::getMessageService() {
+    // Nothing reads history before a channel is opened, so the largest
+    // file stays off the startup path
+    if (!messageService) {
+        messageService = std::make_unique<MessageService>("message_history.xml");
+        
+        Settings settings("config.xml");
+        int idleSeconds = settings.getHistoryIdleSeconds(settings.findClient(settings.getUsername()));
+        if (idleSeconds > 0) {
+            messageService->SetIdleEviction(std::chrono::seconds(idleSeconds));
+        }
+    }
+    return messageService.get();
+}
+
+template <typename Page>
+Page* MainWindow::adoptPage(Page* page) {
+    add(page);
+    page->hide();
+    if (themeApplied) {
+        page->applyTheme(darkMode);
+    }
+    return page;
+}
+
+HomePage* MainWindow::ensureHomePage() {
+    if (!homePage) {
+        // Legacy - for direct IP connection
+        homePage = adoptPage(new HomePage(0, 0, w(), h(), this));
     }
+    return homePage;
+}
+
+ServerBrowser* MainWindow::ensureServerBrowser() {
+    if (serverBrowser) {
+        return serverBrowser;
+    }
+    serverBrowser = adoptPage(new ServerBrowser(0, 0, 250, h(),
+                                                serverManager.get(),
+                                                userDatabase.get(),
+                                                friendService.get()));
     
     // ServerBrowser callback - when user selects a server
-    if (serverBrowser) {
-        serverBrowser->setOnServerSelected([this](uint64_t serverId, const std::string& serverName) {
-            printf("[APP] Server selected: %s\n", serverName.c_str());
-            switchToChat(serverId, serverName);
-        });
-        
-        serverBrowser->setOnFriendsClicked([this]() {
-            fl_message("Friends panel coming soon!");
-        });
+    serverBrowser->setOnServerSelected([this](uint64_t serverId, const std::string& serverName) {
+        printf("[APP] Server selected: %s\n", serverName.c_str());
+        switchToChat(serverId, serverName);
+    });
+    
+    serverBrowser->setOnFriendsClicked([this]() {
+        fl_message("Friends panel coming soon!");
+    });
+    return serverBrowser;
+}
+
+ChannelList* MainWindow::ensureChannelList() {
+    if (channelList) {
+        return channelList;
     }
+    channelList = adoptPage(new ChannelList(0, 0, 200, h(),
+                                            serverManager.get(),
+                                            userDatabase.get()));
     
     // ChannelList callback - when user goes back to server list
-    if (channelList) {
-        channelList->setOnBackClicked([this]() {
-            // Disconnect from current server before going back
-            disconnectFromCurrentServer();
-            switchToServerBrowser();
-        });
+    channelList->setOnBackClicked([this]() {
+        // Disconnect from current server before going back
+        disconnectFromCurrentServer();
+        switchToServerBrowser();
+    });
+    
+    channelList->setOnChannelSelected([this](uint64_t channelId, const std::string& channelName) {
+        printf("[APP] Channel selected: #%s (ID: %llu)\n", channelName.c_str(), channelId);
         
-        channelList->setOnChannelSelected([this](uint64_t channelId, const std::string& channelName) {
-            printf("[APP] Channel selected: #%s (ID: %llu)\n", channelName.c_str(), channelId);
+        // Load channel history
+        if (lobbyPage) {
+            // Update channel name in UI
+            lobbyPage->setChannelName(channelName);
             
-            // Load channel history
-            if (lobbyPage && messageService) {
-                // Update channel name in UI
-                lobbyPage->setChannelName(channelName);
-                
-                // Store current channel ID
-                currentChannelId = channelId;
-                
-                // Load this channel's message history
-                lobbyPage->loadChannelHistory(channelId, messageService.get());
-            }
-        });
+            // Store current channel ID
+            currentChannelId = channelId;
+            
+            // Load this channel's message history
+            lobbyPage->loadChannelHistory(channelId, getMessageService());
+        }
+    });
+    return channelList;
+}
+
+LobbyPage* MainWindow::getLobbyPage() {
+    if (lobbyPage) {
+        return lobbyPage;
     }
+    lobbyPage = adoptPage(new LobbyPage(0, 0, w(), h()));
     
     // LobbyPage callback - when user clicks back button
-    if (lobbyPage) {
-        lobbyPage->setOnBackClicked([this]() {
-            // Disconnect and go back to server browser
-            disconnectFromCurrentServer();
-            switchToServerBrowser();
-        });
-    }
+    lobbyPage->setOnBackClicked([this]() {
+        // Disconnect and go back to server browser
+        disconnectFromCurrentServer();
+        switchToServerBrowser();
+    });
+    return lobbyPage;
 }
 
 void MainWindow::switchToLogin() {
@@ -227,12 +275,11 @@ void MainWindow::switchToServerBrowser() {
         lobbyPage->cleanupSession();
     }
     
-    if (serverBrowser) {
-        serverBrowser->setCurrentUser(currentUserId, currentUsername);
-        serverBrowser->refreshServerList();
-        serverBrowser->resize(0, 0, 250, h());
-        serverBrowser->show();
-    }
+    // The list fills in once the page has been drawn
+    ServerBrowser* browser = ensureServerBrowser();
+    browser->setCurrentUser(currentUserId, currentUsername);
+    browser->resize(0, 0, 250, h());
+    browser->show();
     
     redraw();
 }
@@ -244,21 +291,18 @@ void MainWindow::switchToChat(uint64_t serverId, const std::string& serverName)
     currentServerId = serverId;
     
     // Get server info to determine if we're the owner
-    Models::ChatServer server;
-    if (!serverManager->GetServer(serverId, server)) {
+    ServerManager::ServerSummary server;
+    if (!serverManager->GetServerSummary(serverId, server)) {
         fl_alert("Failed to get server information!");
         return;
     }
     
-    // Clean up any previous session
-    if (lobbyPage) {
-        lobbyPage->cleanupSession();
-    }
+    // Clean up any previous session (building the page on first use)
+    getLobbyPage()->cleanupSession();
     
     // Set the username for chat
-    if (lobbyPage) {
-        lobbyPage->setUsername(currentUsername);
-    }
+    lobbyPage->setUsername(currentUsername);
+    lobbyPage->setServerId(serverId);
     
     // Determine if we're owner (host) or member (client)
     bool isOwner = serverManager->IsServerOwner(serverId, currentUserId);
@@ -279,15 +323,14 @@ void MainWindow::switchToChat(uint64_t serverId, const std::string& serverName)
     // Hide server browser, show channel list
     if (serverBrowser) serverBrowser->hide();
     
-    if (channelList) {
-        channelList->setServer(serverId, currentUserId);
-        channelList->resize(0, 0, sidebarWidth, h());
-        channelList->show();
-    }
+    // Channels and members fill in once the page has been drawn
+    ensureChannelList()->setServer(serverId, currentUserId);
+    channelList->resize(0, 0, sidebarWidth, h());
+    channelList->show();
     
     if (lobbyPage) {
         lobbyPage->setServerName(serverName);
-        lobbyPage->setMessageService(messageService.get());
+        lobbyPage->setMessageService(getMessageService());
         
         // Hide LobbyPage's header and member panel (ChannelList has these)
         lobbyPage->setHeaderVisible(false);
@@ -304,7 +347,7 @@ void MainWindow::switchToChat(uint64_t serverId, const std::string& serverName)
             lobbyPage->setCurrentChannel(defaultChannelId);
             
             // Load channel history
-            lobbyPage->loadChannelHistory(defaultChannelId, messageService.get());
+            lobbyPage->loadChannelHistory(defaultChannelId, getMessageService());
             
             printf("[APP] Default channel: #%s (ID: %llu)\n", defaultChannelName.c_str(), defaultChannelId);
         } else {
@@ -352,29 +395,11 @@ void MainWindow::resize(int X, int Y, int W, int H) {
     }
 }
 
-void MainWindow::onTick(void* userdata) {
-    if (lobbyPage && lobbyPage->visible()) {
-        lobbyPage->Update();
-    }
-
-    // Repeat the timer callback (0.1 second for more responsive chat)
-    Fl::repeat_timeout(0.1, [](void* userdata) {
-        auto* window = static_cast<MainWindow*>(userdata);
-        if (window) {
-            window->onTick(userdata);
-        }
-    }, userdata);
-}
-
 void MainWindow::setResolution(int width, int height) {
     this->size(width, height);
     this->redraw();
 }
 
-LobbyPage* MainWindow::getLobbyPage() const {
-    return lobbyPage;
-}
-
 void MainWindow::switch_to_home(Fl_Widget* widget, void* userdata) {
     auto* window = static_cast<MainWindow*>(userdata);
     if (!window) {
@@ -394,10 +419,9 @@ void MainWindow::switch_to_home(Fl_Widget* widget, void* userdata) {
     if (window->loginPage) {
         window->loginPage->hide();
     }
-    if (window->homePage) {
-        window->homePage->resize(0, 0, window->w(), window->h());
-        window->homePage->show();
-    }
+    HomePage* home = window->ensureHomePage();
+    home->resize(0, 0, window->w(), window->h());
+    home->show();
     window->redraw();
 }
 
@@ -420,13 +444,10 @@ void MainWindow::switch_to_lobby(Fl_Widget* widget, void* userdata) {
     if (window->channelList) {
         window->channelList->hide();
     }
-    if (window->lobbyPage) {
-        window->lobbyPage->resize(0, 0, window->w(), window->h());
-        window->lobbyPage->resizeWidgets(0, 0, window->w(), window->h());
-        window->lobbyPage->show();
-    } else {
-        fl_alert("LobbyPage is not initialized!");
-    }
+    LobbyPage* lobby = window->getLobbyPage();
+    lobby->resize(0, 0, window->w(), window->h());
+    lobby->resizeWidgets(0, 0, window->w(), window->h());
+    lobby->show();
     window->redraw();
 }
 
@@ -442,6 +463,8 @@ void MainWindow::close() {
 }
 
 void MainWindow::applyThemeToAll(bool isDarkMode) {
+    darkMode = isDarkMode;
+    themeApplied = true;
     if (homePage) {
         homePage->applyTheme(isDarkMode);
     }
@@ -465,44 +488,16 @@ void MainWindow::applyThemeToAll(bool isDarkMode) {
 //=============================================================================
 
 std::string MainWindow::getLocalIPAddress() {
-    // Get the local IP address for hosting
-    char hostname[256];
-    if (gethostname(hostname, sizeof(hostname)) == SOCKET_ERROR) {
-        return "127.0.0.1";
-    }
-    
-    struct addrinfo hints = {};
-    hints.ai_family = AF_INET;  // IPv4
-    hints.ai_socktype = SOCK_STREAM;
-    
-    struct addrinfo* result = nullptr;
-    if (getaddrinfo(hostname, nullptr, &hints, &result) != 0) {
-        return "127.0.0.1";
-    }
-    
-    std::string ipAddress = "127.0.0.1";
-    for (struct addrinfo* ptr = result; ptr != nullptr; ptr = ptr->ai_next) {
-        struct sockaddr_in* sockaddr_ipv4 = (struct sockaddr_in*)ptr->ai_addr;
-        char ipStr[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &(sockaddr_ipv4->sin_addr), ipStr, INET_ADDRSTRLEN);
-        
-        // Skip loopback addresses
-        if (strncmp(ipStr, "127.", 4) != 0) {
-            ipAddress = ipStr;
-            break;
-        }
-    }
-    
-    freeaddrinfo(result);
-    return ipAddress;
+    // Get the local IP address for hosting; cached, so re-hosting is instant
+    return AddressResolver::LocalAddress();
 }
 
 void MainWindow::startHostingServer(uint64_t serverId) {
     printf("[NET] Starting to host server (ID: %llu)\n", serverId);
     
     // Get server info
-    Models::ChatServer server;
-    if (!serverManager->GetServer(serverId, server)) {
+    ServerManager::ServerSummary server;
+    if (!serverManager->GetServerSummary(serverId, server)) {
         fl_alert("Failed to get server information!");
         return;
     }
@@ -521,6 +516,14 @@ void MainWindow::startHostingServer(uint64_t serverId) {
         std::string portStr = std::to_string(port);
         lobbyPage->getPortInput()->value(portStr.c_str());
         
+        // Let the hosted server answer list and history requests from our stores
+        ServerSocket::DataServices services;
+        services.hostedServerId = serverId;
+        services.servers = serverManager.get();
+        services.messages = getMessageService();
+        services.users = userDatabase.get();
+        lobbyPage->setHostServices(services);
+        
         // Trigger host action
         lobbyPage->hostServer();
         
@@ -538,8 +541,8 @@ void MainWindow::connectToServer(uint64_t serverId) {
     serverManager->RefreshFromFile();
     
     // Get server info
-    Models::ChatServer server;
-    if (!serverManager->GetServer(serverId, server)) {
+    ServerManager::ServerSummary server;
+    if (!serverManager->GetServerSummary(serverId, server)) {
         fl_alert("Failed to get server information!");
         return;
     }
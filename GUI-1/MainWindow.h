@@ -5,7 +5,7 @@
 #include <functional>
 #include <vector>
 #include <memory>
-#include "Timer.h"
+#include <thread>
 #include "HomePage.hpp"
 #include "LobbyPage.hpp"
 #include "LoginPage.h"
@@ -38,7 +38,9 @@ public:
     ~MainWindow();
 
     void setResolution(int width, int height);
-    LobbyPage* getLobbyPage() const;
+    
+    /** The chat page, built on first use */
+    LobbyPage* getLobbyPage();
     
     // Page switching
     static void switch_to_home(Fl_Widget* widget, void* userdata);
@@ -50,23 +52,30 @@ public:
     void on_close(const std::function<void()>& callback);
     void close();
     void resize(int X, int Y, int W, int H);
-    void onTick(void* userdata);
     
     // Apply theme to all pages
     void applyThemeToAll(bool isDarkMode);
 
-    // Pages
+    // Pages; all but loginPage stay null until first navigated to
     HomePage* homePage;
     LobbyPage* lobbyPage;
     LoginPage* loginPage;
     ServerBrowser* serverBrowser;
     ChannelList* channelList;
     
-    // Services (owned by MainWindow)
+    // Services (owned by MainWindow). The first three load on worker
+    // threads at startup and may be used once servicesReady is set; the
+    // message store is opened by getMessageService() when first needed.
     std::unique_ptr<UserDatabase> userDatabase;
     std::unique_ptr<ServerManager> serverManager;
     std::unique_ptr<FriendService> friendService;
     std::unique_ptr<MessageService> messageService;
+    bool servicesReady;
+    
+    /**
+     * @brief The message store, loaded on the first call
+     */
+    MessageService* getMessageService();
     
     // Current user session
     uint64_t currentUserId;
@@ -87,10 +96,26 @@ public:
     std::string getLocalIPAddress();
 
 private:
-    Timer timer;
-    
     void initializeServices();
-    void setupPageCallbacks();
+    void onServicesLoaded();
+    
+    // Build a page (and wire its callbacks) on first use
+    HomePage* ensureHomePage();
+    ServerBrowser* ensureServerBrowser();
+    ChannelList* ensureChannelList();
+    
+    /** Add a newly built page, hidden and in the current theme */
+    template <typename Page>
+    Page* adoptPage(Page* page);
+    
+    // Last theme applied through applyThemeToAll(), for pages built later
+    bool darkMode;
+    bool themeApplied;
+    
+    std::thread serviceLoader;
+    
+    // Cleared on destruction so a late load notification is dropped
+    std::shared_ptr<bool> alive;
 };
 
 #endif // MAINWINDOW_H
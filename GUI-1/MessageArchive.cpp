@@ -0,0 +1,405 @@
+/**
+ * @file MessageArchive.cpp
+ * @brief Implementation of the compressed cold history tier
+ */
+
+#include "MessageArchive.h"
+#include "MessageLog.h"
+#include "Log.h"
+#define NOMINMAX
+#include <Windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <set>
+
+namespace {
+
+const char MANIFEST_MAGIC[8] = { 'C', 'H', 'A', 'R', 'C', '0', '0', '1' };
+constexpr size_t BLOCK_ENTRY_SIZE = 44;
+
+void PutLE(std::string& out, uint64_t value, size_t width) {
+    for (size_t i = 0; i < width; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t GetLE(const char* data, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+bool MoveIntoPlace(const std::string& from, const std::string& to) {
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+} // namespace
+
+//=============================================================================
+// READER
+//=============================================================================
+
+MessageArchive::MessageArchive(const std::string& basePath)
+    : m_basePath(basePath)
+    , m_manifestPath(basePath + ".archive") {
+}
+
+std::string MessageArchive::filePath(uint64_t fileId) const {
+    return m_basePath + "." + std::to_string(fileId) + ".arc";
+}
+
+bool MessageArchive::Load() {
+    m_channels.clear();
+    m_released.clear();
+    m_dirty = false;
+    m_cachedOffset = UINT64_MAX;
+    m_cached.clear();
+
+    std::ifstream in(m_manifestPath, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(MANIFEST_MAGIC) + 8 ||
+        std::memcmp(data.data(), MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0) {
+        LOG_WARNING("[MSG] Message archive manifest %s is damaged", m_manifestPath.c_str());
+        return false;
+    }
+
+    size_t bodyLength = data.size() - sizeof(MANIFEST_MAGIC) - 4;
+    const char* body = data.data() + sizeof(MANIFEST_MAGIC);
+    if (MessageLog::Checksum(body, bodyLength) != static_cast<uint32_t>(GetLE(body + bodyLength, 4))) {
+        LOG_WARNING("[MSG] Message archive manifest %s is damaged", m_manifestPath.c_str());
+        return false;
+    }
+
+    // The CRC already matched, so lengths only need checking against the buffer
+    uint32_t channelCount = static_cast<uint32_t>(GetLE(body, 4));
+    size_t pos = 4;
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        if (bodyLength - pos < 12) {
+            m_channels.clear();
+            return false;
+        }
+        uint64_t channelId = GetLE(body + pos, 8);
+        uint32_t blockCount = static_cast<uint32_t>(GetLE(body + pos + 8, 4));
+        pos += 12;
+        if ((bodyLength - pos) / BLOCK_ENTRY_SIZE < blockCount) {
+            m_channels.clear();
+            return false;
+        }
+        std::vector<Block>& blocks = m_channels[channelId];
+        blocks.reserve(blockCount);
+        for (uint32_t b = 0; b < blockCount; ++b, pos += BLOCK_ENTRY_SIZE) {
+            Block block;
+            block.fileId = GetLE(body + pos, 8);
+            block.offset = GetLE(body + pos + 8, 8);
+            block.storedLength = static_cast<uint32_t>(GetLE(body + pos + 16, 4));
+            block.rawLength = static_cast<uint32_t>(GetLE(body + pos + 20, 4));
+            block.count = static_cast<uint32_t>(GetLE(body + pos + 24, 4));
+            block.minMessageId = GetLE(body + pos + 28, 8);
+            block.maxMessageId = GetLE(body + pos + 36, 8);
+            blocks.push_back(block);
+        }
+    }
+    return true;
+}
+
+uint64_t MessageArchive::Count(uint64_t channelId) const {
+    auto it = m_channels.find(channelId);
+    if (it == m_channels.end()) {
+        return 0;
+    }
+    uint64_t count = 0;
+    for (const Block& block : it->second) {
+        count += block.count;
+    }
+    return count;
+}
+
+bool MessageArchive::readBlock(const Block& block) {
+    if (m_cachedFile == block.fileId && m_cachedOffset == block.offset) {
+        return true;
+    }
+    m_cachedOffset = UINT64_MAX;
+    m_cached.clear();
+
+    std::ifstream in(filePath(block.fileId), std::ios::binary);
+    std::string stored(block.storedLength, '\0');
+    in.seekg(static_cast<std::streamoff>(block.offset));
+    in.read(&stored[0], static_cast<std::streamsize>(stored.size()));
+    if (!in) {
+        LOG_WARNING("[MSG] Archive file %s is missing or short", filePath(block.fileId).c_str());
+        return false;
+    }
+
+    std::string raw;
+    if (block.storedLength == block.rawLength) {
+        raw.swap(stored);
+    } else if (!m_inflater.Decompress(stored, raw) || raw.size() != block.rawLength) {
+        LOG_WARNING("[MSG] Archive block in %s is damaged", filePath(block.fileId).c_str());
+        return false;
+    }
+
+    m_cached.reserve(block.count);
+    size_t pos = 0;
+    while (pos < raw.size()) {
+        MessageLog::Record record;
+        size_t consumed = MessageLog::DecodeRecord(raw.data() + pos, raw.size() - pos, record);
+        if (consumed == 0 || record.type != MessageLog::RecordType::Message) {
+            m_cached.clear();
+            return false;
+        }
+        m_cached.push_back(std::move(record.message));
+        pos += consumed;
+    }
+    if (m_cached.size() != block.count) {
+        m_cached.clear();
+        return false;
+    }
+    m_cachedFile = block.fileId;
+    m_cachedOffset = block.offset;
+    return true;
+}
+
+std::vector<Models::Message> MessageArchive::ReadBefore(uint64_t channelId, uint64_t beforeMessageId,
+                                                        size_t limit) {
+    std::vector<Models::Message> page;
+    auto it = m_channels.find(channelId);
+    if (it == m_channels.end() || it->second.empty() || limit == 0) {
+        return page;
+    }
+    const std::vector<Block>& blocks = it->second;
+
+    // Start just before beforeMessageId if it is archived, else at the newest end
+    size_t blockIndex = blocks.size() - 1;
+    size_t end = blocks.back().count;
+    if (beforeMessageId != 0) {
+        for (size_t b = blocks.size(); b-- > 0;) {
+            if (beforeMessageId < blocks[b].minMessageId || beforeMessageId > blocks[b].maxMessageId ||
+                !readBlock(blocks[b])) {
+                continue;
+            }
+            auto found = std::find_if(m_cached.begin(), m_cached.end(), [beforeMessageId](const Models::Message& msg) {
+                return msg.messageId == beforeMessageId;
+            });
+            if (found != m_cached.end()) {
+                blockIndex = b;
+                end = static_cast<size_t>(found - m_cached.begin());
+                break;
+            }
+        }
+    }
+
+    // Collected newest first, returned oldest first
+    for (;;) {
+        if (!readBlock(blocks[blockIndex])) {
+            break;
+        }
+        while (end > 0 && page.size() < limit) {
+            page.push_back(m_cached[--end]);
+        }
+        if (page.size() == limit || blockIndex == 0) {
+            break;
+        }
+        --blockIndex;
+        end = blocks[blockIndex].count;
+    }
+    std::reverse(page.begin(), page.end());
+    return page;
+}
+
+void MessageArchive::DropChannel(uint64_t channelId) {
+    auto it = m_channels.find(channelId);
+    if (it != m_channels.end()) {
+        for (const Block& block : it->second) {
+            m_released.insert(block.fileId);
+        }
+        m_channels.erase(it);
+        m_dirty = true;
+        m_cachedOffset = UINT64_MAX;
+        m_cached.clear();
+    }
+}
+
+//=============================================================================
+// WRITER
+//=============================================================================
+
+MessageArchive::Writer::Writer(MessageArchive& archive)
+    : m_archive(archive)
+    , m_fileId(Models::GenerateUniqueId()) {
+    m_tempPath = archive.filePath(m_fileId) + ".tmp";
+}
+
+MessageArchive::Writer::~Writer() {
+    if (m_out.is_open()) {
+        m_out.close();
+    }
+    if (m_created) {
+        std::remove(m_tempPath.c_str());    // Gone already if it was committed
+    }
+}
+
+bool MessageArchive::Writer::Append(const Models::Message& msg, const std::string& senderName) {
+    if (m_failed) {
+        return false;
+    }
+    if (!m_pending.empty() && msg.channelId != m_channelId && !flushBlock()) {
+        return false;
+    }
+    m_channelId = msg.channelId;
+
+    MessageLog::Record record;
+    record.type = MessageLog::RecordType::Message;
+    record.message = msg;
+    record.senderName = senderName;
+    std::string bytes = MessageLog::EncodeRecord(record);
+    if (bytes.empty()) {
+        return false;   // Unreadable record; skip it like the segment does
+    }
+
+    m_pending += bytes;
+    ++m_pendingCount;
+    m_pendingMin = (std::min)(m_pendingMin, msg.messageId);
+    m_pendingMax = (std::max)(m_pendingMax, msg.messageId);
+    return m_pending.size() < BLOCK_SIZE || flushBlock();
+}
+
+bool MessageArchive::Writer::flushBlock() {
+    if (m_pending.empty()) {
+        return true;
+    }
+    if (!m_created) {
+        m_out.open(m_tempPath, std::ios::binary | std::ios::trunc);
+        m_created = true;
+    }
+
+    std::string_view compressed = m_archive.m_deflater.CompressRaw(m_pending);
+    std::string_view stored = compressed.empty() ? std::string_view(m_pending) : compressed;
+    m_out.write(stored.data(), static_cast<std::streamsize>(stored.size()));
+    if (!m_out) {
+        m_failed = true;
+        return false;
+    }
+
+    Block block;
+    block.fileId = m_fileId;
+    block.offset = m_offset;
+    block.storedLength = static_cast<uint32_t>(stored.size());
+    block.rawLength = static_cast<uint32_t>(m_pending.size());
+    block.count = m_pendingCount;
+    block.minMessageId = m_pendingMin;
+    block.maxMessageId = m_pendingMax;
+    m_blocks[m_channelId].push_back(block);
+
+    m_offset += stored.size();
+    m_pending.clear();
+    m_pendingCount = 0;
+    m_pendingMin = UINT64_MAX;
+    m_pendingMax = 0;
+    return true;
+}
+
+bool MessageArchive::Writer::finish() {
+    if (!flushBlock()) {
+        return false;
+    }
+    if (m_out.is_open()) {
+        m_out.flush();
+        m_failed = m_failed || !m_out;
+        m_out.close();
+    }
+    return !m_failed;
+}
+
+bool MessageArchive::Commit(Writer& writer) {
+    if (!writer.finish()) {
+        LOG_WARNING("[MSG] Failed to write message archive file %s", writer.m_tempPath.c_str());
+        return false;
+    }
+    bool added = !writer.m_blocks.empty();
+    if (!added && !m_dirty) {
+        return true;
+    }
+
+    std::string newFile = filePath(writer.m_fileId);
+    if (added && !MoveIntoPlace(writer.m_tempPath, newFile)) {
+        LOG_WARNING("[MSG] Failed to create message archive file %s", newFile.c_str());
+        return false;
+    }
+
+    std::map<uint64_t, std::vector<Block>> previous = m_channels;
+    for (const auto& [channelId, blocks] : writer.m_blocks) {
+        std::vector<Block>& live = m_channels[channelId];
+        live.insert(live.end(), blocks.begin(), blocks.end());
+    }
+    if (!writeManifest()) {
+        m_channels.swap(previous);
+        if (added) {
+            std::remove(newFile.c_str());
+        }
+        return false;
+    }
+    m_dirty = false;
+
+    // Files only cleared channels pointed into
+    std::set<uint64_t> referenced;
+    for (const auto& [channelId, blocks] : m_channels) {
+        for (const Block& block : blocks) {
+            referenced.insert(block.fileId);
+        }
+    }
+    for (uint64_t fileId : m_released) {
+        if (referenced.count(fileId) == 0) {
+            std::remove(filePath(fileId).c_str());
+        }
+    }
+    m_released.clear();
+    return true;
+}
+
+bool MessageArchive::writeManifest() {
+    std::string body;
+    PutLE(body, m_channels.size(), 4);
+    for (const auto& [channelId, blocks] : m_channels) {
+        PutLE(body, channelId, 8);
+        PutLE(body, blocks.size(), 4);
+        for (const Block& block : blocks) {
+            PutLE(body, block.fileId, 8);
+            PutLE(body, block.offset, 8);
+            PutLE(body, block.storedLength, 4);
+            PutLE(body, block.rawLength, 4);
+            PutLE(body, block.count, 4);
+            PutLE(body, block.minMessageId, 8);
+            PutLE(body, block.maxMessageId, 8);
+        }
+    }
+
+    std::string tempPath = m_manifestPath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+        out.write(body.data(), static_cast<std::streamsize>(body.size()));
+        std::string crc;
+        PutLE(crc, MessageLog::Checksum(body.data(), body.size()), 4);
+        out.write(crc.data(), static_cast<std::streamsize>(crc.size()));
+        out.flush();
+        if (!out) {
+            out.close();
+            std::remove(tempPath.c_str());
+            LOG_WARNING("[MSG] Failed to write message archive manifest");
+            return false;
+        }
+    }
+    if (!MoveIntoPlace(tempPath, m_manifestPath)) {
+        std::remove(tempPath.c_str());
+        LOG_WARNING("[MSG] Failed to replace message archive manifest");
+        return false;
+    }
+    return true;
+}
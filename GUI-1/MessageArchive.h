@@ -0,0 +1,165 @@
+#ifndef MESSAGE_ARCHIVE_H
+#define MESSAGE_ARCHIVE_H
+
+/**
+ * @file MessageArchive.h
+ * @brief Cold tier of message history: compressed, immutable archive files
+ *
+ * PURPOSE:
+ * Compaction used to keep the newest MAX_HISTORY_PER_CHANNEL messages of
+ * a channel and delete the rest. Those messages now move here instead,
+ * and paging back past the segment's oldest message continues into them.
+ *
+ * DESIGN:
+ * - Each compaction that archives anything writes one new file,
+ *   "<name>.<id>.arc", and never touches it again
+ * - A file holds blocks of one channel's messages (MessageLog record
+ *   format, oldest first) of about BLOCK_SIZE bytes, each deflated on
+ *   its own, so reading a page inflates one or two blocks, not the file
+ * - The manifest ("<name>.archive") lists every live block with its
+ *   message count and range of message IDs; only the manifest is
+ *   held in memory. It is replaced with one rename, after the new file
+ *   is complete and before the segment that no longer holds those
+ *   messages is committed
+ * - Clearing a channel drops its blocks from the manifest; a file no
+ *   live block points into is deleted when the manifest is next written
+ * - The last inflated block is kept, so paging back through a channel
+ *   inflates each block once
+ *
+ * CRASH SAFETY:
+ * A crash after the manifest is written but before the segment commit
+ * leaves the newest archived messages in both tiers. ReadBefore() starts
+ * at the segment's oldest message when the archive also has it, so pages
+ * do not repeat it.
+ *
+ * THREADING:
+ * Not thread-safe; MessageService serializes access with its own mutexes.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "FrameCompression.h"
+#include "Models.h"
+
+class MessageArchive {
+public:
+    /** Uncompressed bytes per block, at most (a single large message gets its own) */
+    static constexpr size_t BLOCK_SIZE = 32 * 1024;
+
+    /**
+     * @param basePath Store path without extension; files are named from it
+     */
+    explicit MessageArchive(const std::string& basePath);
+
+    /**
+     * @brief Read the manifest, replacing what is in memory
+     * @return False if there is none or it is damaged (the archive is then empty)
+     */
+    bool Load();
+
+    /** @brief Archived messages of a channel */
+    uint64_t Count(uint64_t channelId) const;
+
+    /**
+     * @brief Archived messages older than a given one
+     * @param beforeMessageId A message in the archive, or 0 / one it does
+     *        not hold to start from the newest archived message
+     * @return Up to limit messages, oldest first
+     */
+    std::vector<Models::Message> ReadBefore(uint64_t channelId, uint64_t beforeMessageId, size_t limit);
+
+    /** @brief Forget a cleared channel's blocks (written out by the next Commit()) */
+    void DropChannel(uint64_t channelId);
+
+private:
+    /** One compressed run of a channel's messages */
+    struct Block {
+        uint64_t fileId;
+        uint64_t offset;
+        uint32_t storedLength;
+        uint32_t rawLength;         // Equal to storedLength when stored uncompressed
+        uint32_t count;
+        uint64_t minMessageId;      // IDs are only roughly ordered, so a range
+        uint64_t maxMessageId;      // rather than first and last
+    };
+
+public:
+    /**
+     * @brief Streams one compaction's archived messages into a new file
+     */
+    class Writer {
+    public:
+        explicit Writer(MessageArchive& archive);
+        ~Writer();
+
+        /** @brief Add a message; a channel's messages must arrive together, oldest first */
+        bool Append(const Models::Message& msg, const std::string& senderName);
+
+        /** @brief True until a message is appended */
+        bool Empty() const { return m_blocks.empty() && m_pending.empty(); }
+
+    private:
+        friend class MessageArchive;
+
+        MessageArchive& m_archive;
+        uint64_t m_fileId;
+        std::string m_tempPath;
+        std::ofstream m_out;
+        uint64_t m_offset = 0;
+        bool m_failed = false;
+
+        uint64_t m_channelId = 0;
+        std::string m_pending;          // Records of the block being filled
+        uint32_t m_pendingCount = 0;
+        uint64_t m_pendingMin = UINT64_MAX;
+        uint64_t m_pendingMax = 0;
+        bool m_created = false;
+
+        // Channel -> blocks written, in order
+        std::map<uint64_t, std::vector<Block>> m_blocks;
+
+        bool flushBlock();
+        bool finish();
+    };
+
+    /**
+     * @brief Make a writer's file live and rewrite the manifest
+     *
+     * Also writes the manifest (and deletes unreferenced files) when only
+     * DropChannel() changed it. Nothing changes on disk otherwise.
+     * @return False if the file or the manifest could not be written; the
+     *         previous manifest then stays live
+     */
+    bool Commit(Writer& writer);
+
+private:
+    std::string m_basePath;
+    std::string m_manifestPath;
+
+    // Channel -> blocks, oldest first
+    std::map<uint64_t, std::vector<Block>> m_channels;
+    bool m_dirty = false;           // Changed since the manifest was written
+    std::set<uint64_t> m_released;  // Files of dropped blocks, deleted once unreferenced
+
+    NetProtocol::Deflater m_deflater;
+    NetProtocol::Inflater m_inflater;
+
+    // Last inflated block, by (file, offset)
+    uint64_t m_cachedFile = 0;
+    uint64_t m_cachedOffset = UINT64_MAX;
+    std::vector<Models::Message> m_cached;
+
+    std::string filePath(uint64_t fileId) const;
+    bool readBlock(const Block& block);
+    bool writeManifest();
+
+    MessageArchive(const MessageArchive&) = delete;
+    MessageArchive& operator=(const MessageArchive&) = delete;
+};
+
+#endif // MESSAGE_ARCHIVE_H
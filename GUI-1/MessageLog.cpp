@@ -0,0 +1,472 @@
+/**
+ * @file MessageLog.cpp
+ * @brief Implementation of the append-only message history log
+ */
+
+#include "MessageLog.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const char LOG_MAGIC[8] = { 'C', 'H', 'L', 'O', 'G', '0', '0', '2' };
+
+/** Magic + generation */
+constexpr size_t LOG_HEADER_SIZE = 16;
+
+const std::array<uint32_t, 256>& CrcTable() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    return table;
+}
+
+//=============================================================================
+// LITTLE-ENDIAN FIELD HELPERS
+//=============================================================================
+
+void PutU16(std::string& out, uint16_t value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+void PutU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void PutU64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t ReadLE(const char* data, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief Bounds-checked reader over one record body
+ */
+class BodyReader {
+public:
+    BodyReader(const char* data, size_t size) : m_data(data), m_size(size), m_pos(0), m_ok(true) {}
+
+    uint64_t Get(size_t width) {
+        if (!m_ok || m_size - m_pos < width) {
+            m_ok = false;
+            return 0;
+        }
+        uint64_t value = ReadLE(m_data + m_pos, width);
+        m_pos += width;
+        return value;
+    }
+
+    std::string GetBytes(size_t length) {
+        if (!m_ok || m_size - m_pos < length) {
+            m_ok = false;
+            return {};
+        }
+        std::string value(m_data + m_pos, length);
+        m_pos += length;
+        return value;
+    }
+
+    bool Finished() const { return m_ok && m_pos == m_size; }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_pos;
+    bool m_ok;
+};
+
+bool DecodeBody(const char* data, size_t size, MessageLog::Record& out) {
+    BodyReader reader(data, size);
+    MessageLog::Record record;
+
+    record.type = static_cast<MessageLog::RecordType>(reader.Get(1));
+    record.writerId = reader.Get(8);
+
+    switch (record.type) {
+        case MessageLog::RecordType::Message:
+        case MessageLog::RecordType::Queued: {
+            Models::Message& msg = record.message;
+            msg.messageId = reader.Get(8);
+            msg.channelId = reader.Get(8);
+            msg.senderId = reader.Get(8);
+            msg.recipientId = reader.Get(8);
+            msg.timestamp = static_cast<std::time_t>(static_cast<int64_t>(reader.Get(8)));
+            msg.type = static_cast<Models::MessageType>(reader.Get(1));
+            msg.isEdited = reader.Get(1) != 0;
+            size_t nameLength = static_cast<size_t>(reader.Get(2));
+            record.senderName = reader.GetBytes(nameLength);
+            size_t contentLength = static_cast<size_t>(reader.Get(4));
+            msg.content = reader.GetBytes(contentLength);
+            break;
+        }
+        case MessageLog::RecordType::ClearChannel:
+            record.message.channelId = reader.Get(8);
+            break;
+        case MessageLog::RecordType::Delivered:
+            record.message.recipientId = reader.Get(8);
+            break;
+        default:
+            return false;
+    }
+
+    if (!reader.Finished()) {
+        return false;
+    }
+    out = std::move(record);
+    return true;
+}
+
+} // namespace
+
+//=============================================================================
+// RECORD ENCODING
+//=============================================================================
+
+uint32_t MessageLog::Checksum(const char* data, size_t length) {
+    const auto& table = CrcTable();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+std::string MessageLog::EncodeRecord(const Record& record) {
+    const Models::Message& msg = record.message;
+
+    // Both lengths are bounded on replay; refuse records that could not be read back
+    if (record.senderName.size() > UINT16_MAX || msg.content.size() > MAX_RECORD_SIZE - 128) {
+        return {};
+    }
+
+    // Body is built after a placeholder header, then the header is filled in
+    std::string out(RECORD_HEADER_SIZE, '\0');
+    out.reserve(RECORD_HEADER_SIZE + 64 + record.senderName.size() + msg.content.size());
+    out.push_back(static_cast<char>(record.type));
+    PutU64(out, record.writerId);
+
+    if (record.type == RecordType::Message || record.type == RecordType::Queued) {
+        PutU64(out, msg.messageId);
+        PutU64(out, msg.channelId);
+        PutU64(out, msg.senderId);
+        PutU64(out, msg.recipientId);
+        PutU64(out, static_cast<uint64_t>(static_cast<int64_t>(msg.timestamp)));
+        out.push_back(static_cast<char>(msg.type));
+        out.push_back(msg.isEdited ? 1 : 0);
+        PutU16(out, static_cast<uint16_t>(record.senderName.size()));
+        out.append(record.senderName);
+        PutU32(out, static_cast<uint32_t>(msg.content.size()));
+        out.append(msg.content);
+    } else if (record.type == RecordType::Delivered) {
+        PutU64(out, msg.recipientId);
+    } else {
+        PutU64(out, msg.channelId);
+    }
+
+    size_t bodyLength = out.size() - RECORD_HEADER_SIZE;
+    std::string header;
+    PutU32(header, static_cast<uint32_t>(bodyLength));
+    PutU32(header, Checksum(out.data() + RECORD_HEADER_SIZE, bodyLength));
+    out.replace(0, RECORD_HEADER_SIZE, header);
+    return out;
+}
+
+size_t MessageLog::DecodeRecord(const char* data, size_t available, Record& out) {
+    if (available < RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t length = static_cast<uint32_t>(ReadLE(data, 4));
+    uint32_t crc = static_cast<uint32_t>(ReadLE(data + 4, 4));
+    const char* body = data + RECORD_HEADER_SIZE;
+
+    if (length > MAX_RECORD_SIZE || available - RECORD_HEADER_SIZE < length ||
+        Checksum(body, length) != crc) {
+        return 0;
+    }
+    if (!DecodeBody(body, length, out)) {
+        return 0;
+    }
+    return RECORD_HEADER_SIZE + length;
+}
+
+//=============================================================================
+// MESSAGE LOG
+//=============================================================================
+
+MessageLog::MessageLog(const std::string& path, uint64_t writerId)
+    : m_path(path)
+    , m_writerId(writerId)
+    , m_file(nullptr)
+    , m_generation(0)
+    , m_readOffset(0)
+    , m_records(0)
+    , m_bytes(0) {
+}
+
+MessageLog::~MessageLog() {
+    if (m_file) {
+        std::fclose(m_file);
+    }
+}
+
+size_t MessageLog::Replay(const std::function<void(const Record&)>& apply, bool& tornTail) {
+    tornTail = false;
+    m_generation = 0;
+    m_readOffset = 0;
+    m_records = 0;
+    m_bytes = 0;
+
+    if (m_file) {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+
+    std::ifstream in(m_path, std::ios::binary);
+    if (!in) {
+        return 0;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    if (data.empty()) {
+        return 0;
+    }
+    if (data.size() < LOG_HEADER_SIZE || std::memcmp(data.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+        printf("[MSG] Message log %s has an unknown header, ignoring it\n", m_path.c_str());
+        tornTail = true;
+        return 0;
+    }
+    m_generation = ReadLE(data.data() + sizeof(LOG_MAGIC), 8);
+
+    size_t pos = LOG_HEADER_SIZE;
+    while (pos < data.size()) {
+        Record record;
+        size_t used = DecodeRecord(data.data() + pos, data.size() - pos, record);
+        if (used == 0) {
+            tornTail = true;
+            break;
+        }
+
+        apply(record);
+        ++m_records;
+        pos += used;
+    }
+
+    m_readOffset = pos;
+    m_bytes = pos - LOG_HEADER_SIZE;
+
+    if (tornTail) {
+        printf("[MSG] Message log %s has a damaged tail after %zu records\n",
+               m_path.c_str(), m_records);
+    }
+    return m_records;
+}
+
+size_t MessageLog::ReadNew(const std::function<void(const Record&)>& apply, bool& compacted) {
+    compacted = false;
+
+    std::ifstream in(m_path, std::ios::binary);
+    if (!in) {
+        compacted = m_readOffset != 0;   // Deleted under us
+        return 0;
+    }
+
+    char header[LOG_HEADER_SIZE];
+    in.read(header, sizeof(header));
+    if (!in) {
+        // Empty (not created yet, or mid-reset): nothing new unless we had read before
+        compacted = m_readOffset != 0;
+        return 0;
+    }
+    if (std::memcmp(header, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 ||
+        ReadLE(header + sizeof(LOG_MAGIC), 8) != m_generation) {
+        compacted = true;
+        return 0;
+    }
+
+    in.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+    uint64_t start = (std::max)(m_readOffset, static_cast<uint64_t>(LOG_HEADER_SIZE));
+    if (fileSize < start) {
+        compacted = true;
+        return 0;
+    }
+    if (fileSize == start) {
+        return 0;
+    }
+
+    std::string data(static_cast<size_t>(fileSize - start), '\0');
+    in.seekg(static_cast<std::streamoff>(start));
+    in.read(&data[0], static_cast<std::streamsize>(data.size()));
+    data.resize(static_cast<size_t>(in.gcount()));
+
+    size_t pos = 0;
+    size_t applied = 0;
+    while (pos < data.size()) {
+        Record record;
+        size_t used = DecodeRecord(data.data() + pos, data.size() - pos, record);
+        if (used == 0) {
+            break;      // Possibly still being written; retry next time
+        }
+        pos += used;
+
+        if (record.writerId == m_writerId) {
+            continue;   // Already applied when we appended it
+        }
+        apply(record);
+        ++applied;
+        ++m_records;
+        m_bytes += used;
+    }
+
+    m_readOffset = start + pos;
+    return applied;
+}
+
+bool MessageLog::AppendMessage(const Models::Message& msg, const std::string& senderName) {
+    Record record;
+    record.type = RecordType::Message;
+    record.writerId = m_writerId;
+    record.message = msg;
+    record.senderName = senderName;
+    return appendRecord(EncodeRecord(record));
+}
+
+bool MessageLog::AppendMessages(const std::vector<Models::Message>& msgs,
+                                const std::vector<std::string>& senderNames) {
+    std::string records;
+    Record record;
+    record.type = RecordType::Message;
+    record.writerId = m_writerId;
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        record.message = msgs[i];
+        record.senderName = senderNames[i];
+        std::string encoded = EncodeRecord(record);
+        if (encoded.empty()) {
+            return false;
+        }
+        records.append(encoded);
+    }
+    return appendRecord(records, msgs.size());
+}
+
+bool MessageLog::AppendClearChannel(uint64_t channelId) {
+    Record record;
+    record.type = RecordType::ClearChannel;
+    record.writerId = m_writerId;
+    record.message.channelId = channelId;
+    return appendRecord(EncodeRecord(record));
+}
+
+bool MessageLog::Append(Record record) {
+    record.writerId = m_writerId;
+    return appendRecord(EncodeRecord(record));
+}
+
+bool MessageLog::Flush() {
+    if (!m_file) {
+        return true;
+    }
+    if (std::fflush(m_file) != 0) {
+        printf("[MSG] Failed to flush message log %s\n", m_path.c_str());
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool MessageLog::Reset(uint64_t generation) {
+    if (m_file) {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+
+    // Truncate and rewrite the header; appends continue on this handle
+    if (fopen_s(&m_file, m_path.c_str(), "wb") != 0 || !m_file) {
+        m_file = nullptr;
+        printf("[MSG] Failed to reset message log %s\n", m_path.c_str());
+        return false;
+    }
+    m_generation = generation;
+    m_readOffset = LOG_HEADER_SIZE;
+    m_records = 0;
+    m_bytes = 0;
+
+    if (!writeHeader(m_file, generation) || std::fflush(m_file) != 0) {
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool MessageLog::writeHeader(std::FILE* file, uint64_t generation) {
+    std::string header(LOG_MAGIC, sizeof(LOG_MAGIC));
+    PutU64(header, generation);
+    return std::fwrite(header.data(), 1, header.size(), file) == header.size();
+}
+
+bool MessageLog::openForAppend() {
+    if (m_file) {
+        return true;
+    }
+
+    if (fopen_s(&m_file, m_path.c_str(), "ab") != 0 || !m_file) {
+        m_file = nullptr;
+        printf("[MSG] Failed to open message log %s\n", m_path.c_str());
+        return false;
+    }
+
+    // A brand new file needs its header before the first record
+    std::fseek(m_file, 0, SEEK_END);
+    if (std::ftell(m_file) == 0) {
+        if (!writeHeader(m_file, m_generation)) {
+            std::fclose(m_file);
+            m_file = nullptr;
+            return false;
+        }
+        m_readOffset = LOG_HEADER_SIZE;
+    }
+    return true;
+}
+
+bool MessageLog::appendRecord(const std::string& record, size_t count) {
+    if (record.empty() || !openForAppend()) {
+        return false;
+    }
+
+    // Header and body go out in one write so a crash can only tear the tail
+    if (std::fwrite(record.data(), 1, record.size(), m_file) != record.size()) {
+        printf("[MSG] Failed to append to message log %s\n", m_path.c_str());
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    m_records += count;
+    m_bytes += record.size();
+    return true;
+}
@@ -0,0 +1,189 @@
+#ifndef MESSAGE_LOG_H
+#define MESSAGE_LOG_H
+
+/**
+ * @file MessageLog.h
+ * @brief Append-only binary log of message history changes
+ *
+ * PURPOSE:
+ * MessageService used to rewrite the whole XML history for every chat
+ * line, so one message cost O(total history) in I/O. Changes now go to
+ * this log as one small record each; older history is only rewritten
+ * when the log is compacted into a MessageSegment, which stores its
+ * messages in this same record format.
+ *
+ * The log doubles as the change feed between instances sharing one
+ * history: ReadNew() returns only the records appended since the last
+ * call, so picking up other instances' messages costs O(new records).
+ *
+ * FILE LAYOUT:
+ *   [8-byte magic "CHLOG002"][u64 generation]
+ *   [record]*
+ *
+ * RECORD LAYOUT (little-endian):
+ *   [u32 bodyLength][u32 crc32(body)][body]
+ *   body = [u8 type][u64 writerId][type-specific fields]
+ *
+ * GENERATIONS:
+ * Every Reset() starts a new generation. A reader that sees a different
+ * generation than it last read knows the log was compacted under it and
+ * must reload from the segment. The segment records which generation
+ * comes after it, so a crash between writing the segment and resetting
+ * the log never replays records twice.
+ *
+ * CRASH SAFETY:
+ * A record is written with one fwrite into the stdio buffer; Flush() hands
+ * everything buffered to the OS, once per commit window rather than once
+ * per record. If the process dies mid-write, the last record is short or
+ * fails its CRC. Replay stops there and reports a torn tail, and the
+ * caller compacts to drop it.
+ *
+ * THREADING:
+ * Not thread-safe; MessageService serializes access with its own mutex.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Models.h"
+
+class MessageLog {
+public:
+    enum class RecordType : uint8_t {
+        Message = 1,        ///< A message was added
+        ClearChannel = 2,   ///< Every message in a channel was removed
+        Queued = 3,         ///< DirectMessageStore, older builds: a message held for an offline recipient
+        Delivered = 4       ///< DirectMessageStore, older builds: everything queued for recipientId was delivered
+    };
+
+    /**
+     * @brief One decoded log record
+     */
+    struct Record {
+        RecordType type = RecordType::Message;
+        uint64_t writerId = 0;      ///< Instance that appended the record
+        Models::Message message;    ///< For ClearChannel only channelId is set, for Delivered only recipientId
+        std::string senderName;
+    };
+
+    /** Largest record body accepted on replay (guards against garbage lengths) */
+    static constexpr uint32_t MAX_RECORD_SIZE = 1024 * 1024;
+
+    /** Bytes in front of every record body: [u32 bodyLength][u32 crc32] */
+    static constexpr size_t RECORD_HEADER_SIZE = 8;
+
+    /**
+     * @brief Serialize a record, header included
+     * @return Empty if a field is too large to read back
+     */
+    static std::string EncodeRecord(const Record& record);
+
+    /**
+     * @brief Parse one record from the front of a buffer
+     * @param data Bytes starting at a record header
+     * @param available Bytes readable from data
+     * @param out Decoded record
+     * @return Bytes consumed, or 0 if the record is short or corrupt
+     */
+    static size_t DecodeRecord(const char* data, size_t available, Record& out);
+
+    /**
+     * @brief CRC-32 (IEEE 802.3, the zlib polynomial)
+     */
+    static uint32_t Checksum(const char* data, size_t length);
+
+    /**
+     * @param path Log file; created on first append if missing
+     * @param writerId Tags this instance's records so ReadNew() skips them
+     */
+    MessageLog(const std::string& path, uint64_t writerId);
+    ~MessageLog();
+
+    /**
+     * @brief Read every intact record in order
+     *
+     * Also positions the log for appending and for ReadNew() after the
+     * last intact record.
+     *
+     * @param apply Called once per record
+     * @param tornTail Set to true if trailing bytes were damaged
+     * @return Number of records replayed
+     */
+    size_t Replay(const std::function<void(const Record&)>& apply, bool& tornTail);
+
+    /**
+     * @brief Read the records other instances appended since Replay() or
+     * the last ReadNew()
+     *
+     * Our own records are skipped. A record still being written by another
+     * instance is left for the next call.
+     *
+     * @param apply Called once per new record
+     * @param compacted Set to true if the log was reset under us; the
+     *        caller must reload from the segment and Replay()
+     * @return Number of new records
+     */
+    size_t ReadNew(const std::function<void(const Record&)>& apply, bool& compacted);
+
+    /**
+     * @brief Append a message record (buffered until Flush())
+     * @return False if the write failed (the record may be lost)
+     */
+    bool AppendMessage(const Models::Message& msg, const std::string& senderName);
+
+    /**
+     * @brief Append one message record per entry in a single write
+     * @param senderNames Parallel to msgs
+     */
+    bool AppendMessages(const std::vector<Models::Message>& msgs, const std::vector<std::string>& senderNames);
+
+    /**
+     * @brief Append a channel-clear record
+     */
+    bool AppendClearChannel(uint64_t channelId);
+
+    /**
+     * @brief Append a record of any type (writerId is set to this instance's)
+     */
+    bool Append(Record record);
+
+    /**
+     * @brief Write buffered records to the file so other instances see them
+     * @return False if the write failed (buffered records may be lost)
+     */
+    bool Flush();
+
+    /**
+     * @brief Discard every record and start a new generation
+     */
+    bool Reset(uint64_t generation);
+
+    /** @brief Generation read by the last Replay() or set by Reset() */
+    uint64_t Generation() const { return m_generation; }
+
+    /** @brief Records appended, replayed or read since the last Reset() */
+    size_t RecordCount() const { return m_records; }
+
+    /** @brief Bytes of record data in the file */
+    uint64_t SizeBytes() const { return m_bytes; }
+
+private:
+    std::string m_path;
+    uint64_t m_writerId;
+    std::FILE* m_file;
+    uint64_t m_generation;
+    uint64_t m_readOffset;      // End of the last record consumed by Replay/ReadNew
+    size_t m_records;
+    uint64_t m_bytes;
+
+    bool openForAppend();
+    bool appendRecord(const std::string& record, size_t count = 1);
+    bool writeHeader(std::FILE* file, uint64_t generation);
+
+    MessageLog(const MessageLog&) = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+};
+
+#endif // MESSAGE_LOG_H
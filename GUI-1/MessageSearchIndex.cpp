@@ -0,0 +1,373 @@
+/**
+ * @file MessageSearchIndex.cpp
+ * @brief Implementation of the per-channel word index
+ */
+
+#include "MessageSearchIndex.h"
+#include "MessageLog.h"
+#include "Log.h"
+#define NOMINMAX
+#include <Windows.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char INDEX_MAGIC[8] = { 'C', 'H', 'I', 'D', 'X', '0', '0', '1' };
+constexpr uint32_t TRAILER_MAGIC = 0x58444E49;     // "INDX"
+constexpr size_t TRAILER_SIZE = 24;
+constexpr size_t DICTIONARY_ENTRY_SIZE = 32;
+
+void PutLE(std::string& out, uint64_t value, size_t width) {
+    for (size_t i = 0; i < width; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t GetLE(const char* data, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+void PutVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/** @brief Decode count varint deltas, appending absolute positions */
+bool DecodePositions(const char* data, size_t length, uint32_t count, std::vector<uint64_t>& positions) {
+    size_t pos = 0;
+    uint64_t position = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t delta = 0;
+        for (int shift = 0;; shift += 7) {
+            if (pos >= length || shift > 63) {
+                return false;
+            }
+            uint8_t byte = static_cast<uint8_t>(data[pos++]);
+            delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        position = (i == 0) ? delta : position + delta;
+        positions.push_back(position);
+    }
+    return true;
+}
+
+bool IsWordByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+/**
+ * @brief Call emit(key) for each word of text, in order, repeats included
+ */
+template <typename Emit>
+void ForEachWord(std::string_view text, Emit emit) {
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && !IsWordByte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+        }
+        size_t start = i;
+        // FNV-1a over the folded bytes, cut at MAX_TOKEN_LENGTH
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        while (i < text.size() && IsWordByte(static_cast<unsigned char>(text[i]))) {
+            if (i - start < MessageSearchIndex::MAX_TOKEN_LENGTH) {
+                unsigned char c = static_cast<unsigned char>(text[i]);
+                hash ^= (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+                hash *= 0x100000001B3ULL;
+            }
+            ++i;
+        }
+        if (i - start >= MessageSearchIndex::MIN_TOKEN_LENGTH) {
+            emit(hash);
+        }
+    }
+}
+
+} // namespace
+
+//=============================================================================
+// TOKENS
+//=============================================================================
+
+void MessageSearchIndex::Tokenize(std::string_view text, std::vector<uint64_t>& terms) {
+    terms.clear();
+    ForEachWord(text, [&terms](uint64_t term) { terms.push_back(term); });
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+}
+
+bool MessageSearchIndex::ContainsAll(std::string_view text, const std::vector<uint64_t>& terms) {
+    // Few query words, so a bitmask of the ones seen is enough
+    uint32_t seen = 0;
+    size_t wanted = (std::min)(terms.size(), size_t(32));
+    ForEachWord(text, [&](uint64_t term) {
+        auto it = std::lower_bound(terms.begin(), terms.begin() + wanted, term);
+        if (it != terms.begin() + wanted && *it == term) {
+            seen |= 1u << (it - terms.begin());
+        }
+    });
+    return wanted > 0 && seen == (wanted == 32 ? ~0u : (1u << wanted) - 1);
+}
+
+void MessageSearchIndex::PostingList::Append(uint64_t position) {
+    PutVarint(bytes, count == 0 ? position : position - lastPosition);
+    lastPosition = position;
+    ++count;
+}
+
+//=============================================================================
+// READER
+//=============================================================================
+
+MessageSearchIndex::MessageSearchIndex(const std::string& path)
+    : m_path(path) {
+}
+
+bool MessageSearchIndex::Open(uint64_t generation) {
+    Clear();
+
+    std::ifstream in(m_path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+    if (fileSize < sizeof(INDEX_MAGIC) + TRAILER_SIZE) {
+        return false;
+    }
+
+    char magic[sizeof(INDEX_MAGIC)];
+    char trailer[TRAILER_SIZE];
+    in.seekg(0);
+    in.read(magic, sizeof(magic));
+    in.seekg(static_cast<std::streamoff>(fileSize - TRAILER_SIZE));
+    in.read(trailer, sizeof(trailer));
+    if (!in || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+        GetLE(trailer + 20, 4) != TRAILER_MAGIC) {
+        LOG_WARNING("[MSG] Search index %s is damaged", m_path.c_str());
+        return false;
+    }
+
+    uint64_t dictionaryOffset = GetLE(trailer, 8);
+    if (GetLE(trailer + 8, 8) != generation) {
+        return false;   // Built for another segment
+    }
+    uint32_t dictionaryCrc = static_cast<uint32_t>(GetLE(trailer + 16, 4));
+    if (dictionaryOffset < sizeof(INDEX_MAGIC) || dictionaryOffset > fileSize - TRAILER_SIZE) {
+        return false;
+    }
+
+    std::string data(static_cast<size_t>(fileSize - TRAILER_SIZE - dictionaryOffset), '\0');
+    in.seekg(static_cast<std::streamoff>(dictionaryOffset));
+    in.read(&data[0], static_cast<std::streamsize>(data.size()));
+    if (!in || data.size() < 4 || MessageLog::Checksum(data.data(), data.size()) != dictionaryCrc) {
+        LOG_WARNING("[MSG] Search index %s has a damaged dictionary", m_path.c_str());
+        return false;
+    }
+
+    uint32_t count = static_cast<uint32_t>(GetLE(data.data(), 4));
+    if ((data.size() - 4) / DICTIONARY_ENTRY_SIZE < count) {
+        return false;
+    }
+    m_dictionary.reserve(count);
+    const char* entry = data.data() + 4;
+    for (uint32_t i = 0; i < count; ++i, entry += DICTIONARY_ENTRY_SIZE) {
+        Extent extent;
+        extent.offset = GetLE(entry + 16, 8);
+        extent.length = static_cast<uint32_t>(GetLE(entry + 24, 4));
+        extent.count = static_cast<uint32_t>(GetLE(entry + 28, 4));
+        if (extent.offset + extent.length > dictionaryOffset) {
+            m_dictionary.clear();
+            return false;
+        }
+        m_dictionary.emplace({ GetLE(entry, 8), GetLE(entry + 8, 8) }, extent);
+    }
+    return true;
+}
+
+void MessageSearchIndex::Close() {
+    if (m_in.is_open()) {
+        m_in.close();
+    }
+    m_in.clear();
+}
+
+void MessageSearchIndex::Clear() {
+    Close();
+    m_dictionary.clear();
+    m_delta.clear();
+    m_droppedChannels.clear();
+}
+
+void MessageSearchIndex::Add(uint64_t channelId, uint64_t position, std::string_view content) {
+    Tokenize(content, m_terms);
+    for (uint64_t term : m_terms) {
+        m_delta[{ term, channelId }].Append(position);
+    }
+}
+
+void MessageSearchIndex::DropChannel(uint64_t channelId) {
+    for (auto it = m_delta.begin(); it != m_delta.end();) {
+        it = (it->first.second == channelId) ? m_delta.erase(it) : std::next(it);
+    }
+    m_droppedChannels[channelId] = true;
+}
+
+bool MessageSearchIndex::readPositions(uint64_t channelId, uint64_t term, std::vector<uint64_t>& positions) {
+    positions.clear();
+    std::pair<uint64_t, uint64_t> key(term, channelId);
+
+    auto archived = m_dictionary.find(key);
+    if (archived != m_dictionary.end() && m_droppedChannels.count(channelId) == 0) {
+        const Extent& extent = archived->second;
+        if (!m_in.is_open()) {
+            m_in.open(m_path, std::ios::binary);
+        }
+        std::string bytes(extent.length, '\0');
+        m_in.clear();
+        m_in.seekg(static_cast<std::streamoff>(extent.offset));
+        m_in.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+        positions.reserve(extent.count);
+        if (!m_in || !DecodePositions(bytes.data(), bytes.size(), extent.count, positions)) {
+            positions.clear();
+            return false;
+        }
+    }
+
+    auto recent = m_delta.find(key);
+    if (recent != m_delta.end()) {
+        const PostingList& list = recent->second;
+        return DecodePositions(list.bytes.data(), list.bytes.size(), list.count, positions);
+    }
+    return true;
+}
+
+std::vector<uint64_t> MessageSearchIndex::Match(uint64_t channelId, const std::vector<uint64_t>& terms) {
+    std::vector<uint64_t> result;
+    if (terms.empty()) {
+        return result;
+    }
+
+    // Rarest word first, so the running intersection starts small
+    std::vector<std::pair<uint64_t, uint64_t>> bySize;
+    for (size_t i = 0; i < terms.size() && i < MAX_QUERY_TERMS; ++i) {
+        std::pair<uint64_t, uint64_t> key(terms[i], channelId);
+        uint64_t size = 0;
+        auto archived = m_dictionary.find(key);
+        if (archived != m_dictionary.end()) {
+            size += archived->second.count;
+        }
+        auto recent = m_delta.find(key);
+        if (recent != m_delta.end()) {
+            size += recent->second.count;
+        }
+        if (size == 0) {
+            return result;      // A word nobody used in this channel
+        }
+        bySize.emplace_back(size, terms[i]);
+    }
+    std::sort(bySize.begin(), bySize.end());
+
+    std::vector<uint64_t> positions;
+    for (size_t i = 0; i < bySize.size(); ++i) {
+        if (!readPositions(channelId, bySize[i].second, positions)) {
+            LOG_WARNING("[MSG] Search index %s has a damaged posting list", m_path.c_str());
+        }
+        if (i == 0) {
+            result.swap(positions);
+        } else {
+            auto end = std::set_intersection(result.begin(), result.end(),
+                                             positions.begin(), positions.end(), result.begin());
+            result.erase(end, result.end());
+        }
+        if (result.empty()) {
+            break;
+        }
+    }
+    return result;
+}
+
+//=============================================================================
+// WRITER
+//=============================================================================
+
+MessageSearchIndex::Writer::Writer(const std::string& path)
+    : m_path(path)
+    , m_tempPath(path + ".tmp")
+    , m_finished(false) {
+}
+
+MessageSearchIndex::Writer::~Writer() {
+    if (m_finished) {
+        std::remove(m_tempPath.c_str());    // Finished but never committed
+    }
+}
+
+void MessageSearchIndex::Writer::Add(uint64_t channelId, uint64_t position, std::string_view content) {
+    Tokenize(content, m_terms);
+    for (uint64_t term : m_terms) {
+        m_postings[{ term, channelId }].Append(position);
+    }
+}
+
+bool MessageSearchIndex::Writer::Finish(uint64_t generation) {
+    std::ofstream out(m_tempPath, std::ios::binary | std::ios::trunc);
+    out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    uint64_t offset = sizeof(INDEX_MAGIC);
+
+    std::string dictionary;
+    dictionary.reserve(4 + m_postings.size() * DICTIONARY_ENTRY_SIZE);
+    PutLE(dictionary, m_postings.size(), 4);
+    for (const auto& [key, list] : m_postings) {
+        out.write(list.bytes.data(), static_cast<std::streamsize>(list.bytes.size()));
+        PutLE(dictionary, key.first, 8);
+        PutLE(dictionary, key.second, 8);
+        PutLE(dictionary, offset, 8);
+        PutLE(dictionary, list.bytes.size(), 4);
+        PutLE(dictionary, list.count, 4);
+        offset += list.bytes.size();
+    }
+
+    std::string trailer;
+    PutLE(trailer, offset, 8);
+    PutLE(trailer, generation, 8);
+    PutLE(trailer, MessageLog::Checksum(dictionary.data(), dictionary.size()), 4);
+    PutLE(trailer, TRAILER_MAGIC, 4);
+
+    out.write(dictionary.data(), static_cast<std::streamsize>(dictionary.size()));
+    out.write(trailer.data(), static_cast<std::streamsize>(trailer.size()));
+    out.flush();
+    bool ok = static_cast<bool>(out);
+    out.close();
+
+    if (!ok) {
+        std::remove(m_tempPath.c_str());
+        return false;
+    }
+    m_finished = true;
+    return true;
+}
+
+bool MessageSearchIndex::Writer::Commit() {
+    if (!m_finished) {
+        return false;
+    }
+    m_finished = false;
+    if (!MoveFileExA(m_tempPath.c_str(), m_path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        LOG_WARNING("[MSG] Failed to replace search index %s", m_path.c_str());
+        std::remove(m_tempPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,182 @@
+#ifndef MESSAGE_SEARCH_INDEX_H
+#define MESSAGE_SEARCH_INDEX_H
+
+/**
+ * @file MessageSearchIndex.h
+ * @brief Inverted word index over message history, per channel
+ *
+ * PURPOSE:
+ * Searching messages used to mean reading a channel's whole history and
+ * scanning every body. Here each body is split into words; a query only
+ * decodes the posting lists of its own words and intersects them.
+ *
+ * TOKENS:
+ * A word is a run of ASCII letters and digits or of non-ASCII bytes (so
+ * UTF-8 words stay whole), ASCII-folded, at least MIN_TOKEN_LENGTH bytes
+ * and cut to MAX_TOKEN_LENGTH. Words are keyed by a 64-bit hash; callers
+ * confirm hits against the body, so a collision cannot return a message
+ * that lacks the words.
+ *
+ * POSTINGS:
+ * One list per (word, channel). Entries are the message's position in
+ * its channel's history (MessageService's archived + spilled + recent
+ * order), not its ID: positions only grow, so each entry is a small
+ * varint delta (usually one byte), and a hit maps straight to a message.
+ *
+ * SEGMENTS:
+ * - The segment ("<name>.idx") indexes the archived messages of the
+ *   MessageSegment it was built with; only its dictionary is held in
+ *   memory and lists are read from disk per query
+ * - Messages added since live in an in-memory delta with the same layout
+ * - Compaction (on the persistence worker, off the caller's thread)
+ *   writes a new message segment; a Writer fed the same messages builds
+ *   the matching index segment, which replaces both old lists at once
+ *
+ * FILE LAYOUT (little-endian):
+ *   [8-byte magic "CHIDX001"]
+ *   [postings]*                    varint position deltas
+ *   [dictionary]                   [u32 count] then count x
+ *                                  [u64 term][u64 channelId][u64 offset]
+ *                                  [u32 length][u32 postingCount]
+ *   [trailer]                      [u64 dictionaryOffset][u64 generation]
+ *                                  [u32 crc32(dictionary)][u32 TRAILER_MAGIC]
+ *
+ * generation is the MessageSegment's nextGeneration; a segment whose
+ * generation does not match was built for other history and is ignored.
+ *
+ * SHARING:
+ * Like MessageSegment, the file is only held open while reading; call
+ * Close() after each query so other instances can replace it.
+ *
+ * THREADING:
+ * Not thread-safe; MessageService serializes access with its own mutexes.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "FlatHashMap.h"
+
+class MessageSearchIndex {
+public:
+    /** Shorter words ("a", "I") are not indexed */
+    static constexpr size_t MIN_TOKEN_LENGTH = 2;
+
+    /** Longer words are indexed by their first MAX_TOKEN_LENGTH bytes */
+    static constexpr size_t MAX_TOKEN_LENGTH = 32;
+
+    /** Query words past this many are ignored */
+    static constexpr size_t MAX_QUERY_TERMS = 8;
+
+    explicit MessageSearchIndex(const std::string& path);
+
+    /**
+     * @brief Distinct word keys of a text, ascending
+     * @param terms Cleared and filled (reused to avoid allocating per message)
+     */
+    static void Tokenize(std::string_view text, std::vector<uint64_t>& terms);
+
+    /**
+     * @brief True if text contains every word key in terms (terms ascending)
+     */
+    static bool ContainsAll(std::string_view text, const std::vector<uint64_t>& terms);
+
+    /**
+     * @brief Load the segment's dictionary
+     * @param generation The live MessageSegment's nextGeneration
+     * @return False if there is no segment, it is damaged or it is stale;
+     *         the index then covers only what is added to the delta
+     */
+    bool Open(uint64_t generation);
+
+    /** @brief Release the file so it can be replaced */
+    void Close();
+
+    /** @brief Drop the segment dictionary and the delta */
+    void Clear();
+
+    /**
+     * @brief Index a message added after the segment
+     * @param position Its position in the channel; must exceed every earlier one
+     */
+    void Add(uint64_t channelId, uint64_t position, std::string_view content);
+
+    /** @brief Forget a cleared channel (its positions start again from 0) */
+    void DropChannel(uint64_t channelId);
+
+    /**
+     * @brief Positions in a channel whose message has every word
+     * @param terms From Tokenize() on the query
+     * @return Ascending positions; candidates only, confirm with ContainsAll()
+     */
+    std::vector<uint64_t> Match(uint64_t channelId, const std::vector<uint64_t>& terms);
+
+    const std::string& Path() const { return m_path; }
+
+private:
+    /** Varint deltas of one (word, channel) list, oldest first */
+    struct PostingList {
+        std::string bytes;
+        uint64_t lastPosition = 0;
+        uint32_t count = 0;
+
+        void Append(uint64_t position);
+    };
+
+public:
+    /**
+     * @brief Builds a replacement segment next to the live one
+     */
+    class Writer {
+    public:
+        explicit Writer(const std::string& path);
+        ~Writer();
+
+        /** @brief Index a message written to the new MessageSegment */
+        void Add(uint64_t channelId, uint64_t position, std::string_view content);
+
+        /**
+         * @brief Write the postings and dictionary to the temp file
+         * @param generation nextGeneration of the MessageSegment written alongside
+         */
+        bool Finish(uint64_t generation);
+
+        /** @brief Atomically replace the live segment (close it first) */
+        bool Commit();
+
+    private:
+        std::string m_path;
+        std::string m_tempPath;
+        std::vector<uint64_t> m_terms;
+        FlatHashMap<std::pair<uint64_t, uint64_t>, PostingList> m_postings;
+        bool m_finished;
+    };
+
+private:
+    /** Where one (word, channel) list lives in the segment */
+    struct Extent {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t count;
+    };
+
+    std::string m_path;
+    std::ifstream m_in;
+
+    // (word, channel) -> list in the segment / added since
+    FlatHashMap<std::pair<uint64_t, uint64_t>, Extent> m_dictionary;
+    FlatHashMap<std::pair<uint64_t, uint64_t>, PostingList> m_delta;
+
+    // Cleared since the segment was built; its lists for them are stale
+    FlatHashMap<uint64_t, bool> m_droppedChannels;
+
+    // Reused by Add()
+    std::vector<uint64_t> m_terms;
+
+    /** @brief Decode one word's list in a channel (segment, then delta) */
+    bool readPositions(uint64_t channelId, uint64_t term, std::vector<uint64_t>& positions);
+};
+
+#endif // MESSAGE_SEARCH_INDEX_H
@@ -0,0 +1,308 @@
+/**
+ * @file MessageSegment.cpp
+ * @brief Implementation of the indexed message history segment
+ */
+
+#include "MessageSegment.h"
+#define NOMINMAX
+#include <Windows.h>
+#include <cstring>
+
+namespace {
+
+const char SEGMENT_MAGIC[8] = { 'C', 'H', 'S', 'E', 'G', '0', '0', '1' };
+constexpr uint32_t TRAILER_MAGIC = 0x444E4553;     // "SEND" (segment end)
+constexpr size_t TRAILER_SIZE = 24;
+constexpr size_t INDEX_ENTRY_SIZE = 16;
+
+void PutLE(std::string& out, uint64_t value, size_t width) {
+    for (size_t i = 0; i < width; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t GetLE(const char* data, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+//=============================================================================
+// READER
+//=============================================================================
+
+MessageSegment::MessageSegment(const std::string& path)
+    : m_path(path) {
+}
+
+bool MessageSegment::Open(ChannelIndex& index, uint64_t& nextGeneration) {
+    Close();
+    index.clear();
+    nextGeneration = 0;
+    m_ranges.clear();
+
+    m_in.open(m_path, std::ios::binary);
+    if (!m_in) {
+        m_in.clear();
+        return false;
+    }
+
+    m_in.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(m_in.tellg());
+    if (fileSize < sizeof(SEGMENT_MAGIC) + TRAILER_SIZE) {
+        Close();
+        return false;
+    }
+
+    char magic[sizeof(SEGMENT_MAGIC)];
+    char trailer[TRAILER_SIZE];
+    m_in.seekg(0);
+    m_in.read(magic, sizeof(magic));
+    m_in.seekg(static_cast<std::streamoff>(fileSize - TRAILER_SIZE));
+    m_in.read(trailer, sizeof(trailer));
+    if (!m_in || std::memcmp(magic, SEGMENT_MAGIC, sizeof(magic)) != 0 ||
+        GetLE(trailer + 20, 4) != TRAILER_MAGIC) {
+        printf("[MSG] Message segment %s is damaged\n", m_path.c_str());
+        Close();
+        return false;
+    }
+
+    uint64_t indexOffset = GetLE(trailer, 8);
+    uint64_t generation = GetLE(trailer + 8, 8);
+    uint32_t indexCrc = static_cast<uint32_t>(GetLE(trailer + 16, 4));
+    if (indexOffset < sizeof(SEGMENT_MAGIC) || indexOffset > fileSize - TRAILER_SIZE) {
+        Close();
+        return false;
+    }
+
+    std::string data(static_cast<size_t>(fileSize - TRAILER_SIZE - indexOffset), '\0');
+    m_in.seekg(static_cast<std::streamoff>(indexOffset));
+    m_in.read(&data[0], static_cast<std::streamsize>(data.size()));
+    if (!m_in || MessageLog::Checksum(data.data(), data.size()) != indexCrc) {
+        printf("[MSG] Message segment %s has a damaged index\n", m_path.c_str());
+        Close();
+        return false;
+    }
+
+    // The CRC already matched, so lengths only need checking against the buffer
+    if (data.size() < 4) {
+        Close();
+        return false;
+    }
+    uint32_t channelCount = static_cast<uint32_t>(GetLE(data.data(), 4));
+    size_t pos = 4;
+    for (uint32_t c = 0; c < channelCount; ++c) {
+        if (data.size() - pos < 12) {
+            index.clear();
+            Close();
+            return false;
+        }
+        uint64_t channelId = GetLE(data.data() + pos, 8);
+        uint32_t count = static_cast<uint32_t>(GetLE(data.data() + pos + 8, 4));
+        pos += 12;
+        if ((data.size() - pos) / INDEX_ENTRY_SIZE < count) {
+            index.clear();
+            Close();
+            return false;
+        }
+
+        m_ranges[channelId] = { indexOffset + pos, count };
+        auto& entries = index[channelId];
+        entries.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            Entry entry;
+            entry.messageId = GetLE(data.data() + pos, 8);
+            entry.offset = GetLE(data.data() + pos + 8, 8);
+            entries.push_back(entry);
+            pos += INDEX_ENTRY_SIZE;
+        }
+    }
+
+    nextGeneration = generation;
+    m_indexOffset = indexOffset;
+    m_generation = generation;
+    Close();
+    return true;
+}
+
+bool MessageSegment::ReadEntries(uint64_t channelId, std::vector<Entry>& entries) {
+    entries.clear();
+    auto range = m_ranges.find(channelId);
+    if (range == m_ranges.end() || !openForRead()) {
+        return false;
+    }
+
+    // Another instance may have compacted since Open(); its index is elsewhere
+    char trailer[TRAILER_SIZE];
+    m_in.clear();
+    m_in.seekg(-static_cast<std::streamoff>(TRAILER_SIZE), std::ios::end);
+    m_in.read(trailer, sizeof(trailer));
+    if (!m_in || GetLE(trailer, 8) != m_indexOffset || GetLE(trailer + 8, 8) != m_generation) {
+        return false;
+    }
+
+    std::string data(static_cast<size_t>(range->second.count) * INDEX_ENTRY_SIZE, '\0');
+    m_in.seekg(static_cast<std::streamoff>(range->second.offset));
+    m_in.read(&data[0], static_cast<std::streamsize>(data.size()));
+    if (!m_in) {
+        return false;
+    }
+    entries.reserve(range->second.count);
+    for (size_t pos = 0; pos < data.size(); pos += INDEX_ENTRY_SIZE) {
+        entries.push_back({ GetLE(data.data() + pos, 8), GetLE(data.data() + pos + 8, 8) });
+    }
+    return true;
+}
+
+void MessageSegment::Close() {
+    if (m_in.is_open()) {
+        m_in.close();
+    }
+    m_in.clear();
+}
+
+bool MessageSegment::openForRead() {
+    if (!m_in.is_open()) {
+        m_in.open(m_path, std::ios::binary);
+        if (!m_in) {
+            m_in.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MessageSegment::Read(uint64_t offset, Models::Message& msg, std::string& senderName) {
+    if (!openForRead()) {
+        return false;
+    }
+
+    char header[MessageLog::RECORD_HEADER_SIZE];
+    m_in.clear();
+    m_in.seekg(static_cast<std::streamoff>(offset));
+    m_in.read(header, sizeof(header));
+    if (!m_in) {
+        return false;
+    }
+
+    uint32_t length = static_cast<uint32_t>(GetLE(header, 4));
+    if (length > MessageLog::MAX_RECORD_SIZE) {
+        return false;
+    }
+
+    std::string record(header, sizeof(header));
+    record.resize(sizeof(header) + length);
+    m_in.read(&record[sizeof(header)], length);
+    if (!m_in) {
+        return false;
+    }
+
+    MessageLog::Record decoded;
+    if (MessageLog::DecodeRecord(record.data(), record.size(), decoded) == 0 ||
+        decoded.type != MessageLog::RecordType::Message) {
+        return false;
+    }
+
+    msg = std::move(decoded.message);
+    senderName = std::move(decoded.senderName);
+    return true;
+}
+
+//=============================================================================
+// WRITER
+//=============================================================================
+
+MessageSegment::Writer::Writer(const std::string& path)
+    : m_path(path)
+    , m_tempPath(path + ".tmp")
+    , m_out(m_tempPath, std::ios::binary | std::ios::trunc)
+    , m_offset(0)
+    , m_failed(false) {
+    m_out.write(SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    m_offset = sizeof(SEGMENT_MAGIC);
+    m_failed = !m_out;
+}
+
+MessageSegment::Writer::~Writer() {
+    if (m_out.is_open()) {
+        m_out.close();
+        std::remove(m_tempPath.c_str());
+    }
+}
+
+bool MessageSegment::Writer::Append(const Models::Message& msg, const std::string& senderName) {
+    if (m_failed) {
+        return false;
+    }
+
+    MessageLog::Record record;
+    record.type = MessageLog::RecordType::Message;
+    record.message = msg;
+    record.senderName = senderName;
+
+    std::string bytes = MessageLog::EncodeRecord(record);
+    if (bytes.empty()) {
+        return false;   // Unreadable record; skip it rather than fail the segment
+    }
+
+    m_out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!m_out) {
+        m_failed = true;
+        return false;
+    }
+
+    m_index[msg.channelId].push_back({ msg.messageId, m_offset });
+    m_offset += bytes.size();
+    return true;
+}
+
+bool MessageSegment::Writer::Finish(uint64_t nextGeneration) {
+    if (m_failed || !m_out.is_open()) {
+        return false;
+    }
+
+    std::string index;
+    PutLE(index, m_index.size(), 4);
+    for (const auto& [channelId, entries] : m_index) {
+        PutLE(index, channelId, 8);
+        PutLE(index, entries.size(), 4);
+        for (const Entry& entry : entries) {
+            PutLE(index, entry.messageId, 8);
+            PutLE(index, entry.offset, 8);
+        }
+    }
+
+    std::string trailer;
+    PutLE(trailer, m_offset, 8);
+    PutLE(trailer, nextGeneration, 8);
+    PutLE(trailer, MessageLog::Checksum(index.data(), index.size()), 4);
+    PutLE(trailer, TRAILER_MAGIC, 4);
+
+    m_out.write(index.data(), static_cast<std::streamsize>(index.size()));
+    m_out.write(trailer.data(), static_cast<std::streamsize>(trailer.size()));
+    m_out.flush();
+    m_failed = !m_out;
+    m_out.close();
+
+    if (m_failed) {
+        std::remove(m_tempPath.c_str());
+    }
+    return !m_failed;
+}
+
+bool MessageSegment::Writer::Commit() {
+    if (m_failed || m_out.is_open()) {
+        return false;
+    }
+    if (!MoveFileExA(m_tempPath.c_str(), m_path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        printf("[MSG] Failed to replace message segment %s\n", m_path.c_str());
+        std::remove(m_tempPath.c_str());
+        return false;
+    }
+    return true;
+}
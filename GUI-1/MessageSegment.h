@@ -0,0 +1,141 @@
+#ifndef MESSAGE_SEGMENT_H
+#define MESSAGE_SEGMENT_H
+
+/**
+ * @file MessageSegment.h
+ * @brief Compacted message history with a per-channel offset index
+ *
+ * PURPOSE:
+ * Holds every message older than the current MessageLog. Only the index is
+ * kept in memory; message bodies are read from disk one page at a time,
+ * so opening a channel no longer costs a parse of every channel's history.
+ *
+ * FILE LAYOUT (little-endian):
+ *   [8-byte magic "CHSEG001"]
+ *   [record]*                      MessageLog record format, type Message
+ *   [index]                        [u32 channelCount] then per channel:
+ *                                  [u64 channelId][u32 count]
+ *                                  count x [u64 messageId][u64 offset]
+ *   [trailer]                      [u64 indexOffset][u64 nextGeneration]
+ *                                  [u32 crc32(index)][u32 TRAILER_MAGIC]
+ *
+ * Within a channel, index entries are oldest first. nextGeneration is the
+ * MessageLog generation started right after this segment was written;
+ * logs of older generations are already folded in.
+ *
+ * CRASH SAFETY:
+ * Writer streams into "<path>.tmp" and Commit() swaps it in with one
+ * rename, so readers only ever see a complete segment.
+ *
+ * SHARING:
+ * Windows cannot rename over a file another process holds open, so the
+ * file is only opened while reading. Call Close() after each batch of
+ * Read() calls so other instances can compact.
+ *
+ * THREADING:
+ * Not thread-safe; MessageService serializes access with its own mutex.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "MessageLog.h"
+
+class MessageSegment {
+public:
+    /**
+     * @brief Where one message lives in the segment
+     */
+    struct Entry {
+        uint64_t messageId;
+        uint64_t offset;
+    };
+
+    /** Channel ID -> entries, oldest first */
+    using ChannelIndex = std::map<uint64_t, std::vector<Entry>>;
+
+    explicit MessageSegment(const std::string& path);
+
+    /**
+     * @brief Load the segment's index (the file is closed again afterwards)
+     * @param index Receives the per-channel index
+     * @param nextGeneration Receives the first log generation not folded in
+     * @return False if there is no segment or it is damaged
+     */
+    bool Open(ChannelIndex& index, uint64_t& nextGeneration);
+
+    /**
+     * @brief Read one channel's index entries again (for a channel whose
+     *        entries were released while it sat idle)
+     * @return False if the channel has none or the segment was replaced
+     *         since Open()
+     */
+    bool ReadEntries(uint64_t channelId, std::vector<Entry>& entries);
+
+    /**
+     * @brief Release the file so it can be replaced
+     */
+    void Close();
+
+    /**
+     * @brief Read the message stored at an index offset (opens the file if needed)
+     */
+    bool Read(uint64_t offset, Models::Message& msg, std::string& senderName);
+
+    const std::string& Path() const { return m_path; }
+
+    /**
+     * @brief Builds a replacement segment next to the live one
+     */
+    class Writer {
+    public:
+        explicit Writer(const std::string& path);
+        ~Writer();
+
+        /** @brief Append a message; channels may be written in any order */
+        bool Append(const Models::Message& msg, const std::string& senderName);
+
+        /**
+         * @brief Write the index and close the temp file
+         * @param nextGeneration Log generation that will follow this segment
+         */
+        bool Finish(uint64_t nextGeneration);
+
+        /**
+         * @brief Atomically replace the live segment with the finished one
+         *
+         * The live segment must be closed first (Windows refuses to rename
+         * over an open file).
+         */
+        bool Commit();
+
+    private:
+        std::string m_path;
+        std::string m_tempPath;
+        std::ofstream m_out;
+        uint64_t m_offset;
+        ChannelIndex m_index;
+        bool m_failed;
+    };
+
+private:
+    /** Where a channel's entries sit in the index */
+    struct EntryRange {
+        uint64_t offset;
+        uint32_t count;
+    };
+
+    std::string m_path;
+    std::ifstream m_in;
+
+    // Recorded by Open() for ReadEntries()
+    uint64_t m_indexOffset = 0;
+    uint64_t m_generation = 0;
+    std::map<uint64_t, EntryRange> m_ranges;
+
+    bool openForRead();
+};
+
+#endif // MESSAGE_SEGMENT_H
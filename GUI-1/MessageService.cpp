@@ -1,15 +1,43 @@
 #include "MessageService.h"
+#include "Trace.h"
+#include "Log.h"
 #include <algorithm>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
 
+namespace {
+
+/**
+ * @brief "message_history.xml" -> "message_history"
+ */
+std::string StoreBasePath(const std::string& dataFilePath) {
+    const std::string extension = ".xml";
+    if (dataFilePath.size() > extension.size() &&
+        dataFilePath.compare(dataFilePath.size() - extension.size(), extension.size(), extension) == 0) {
+        return dataFilePath.substr(0, dataFilePath.size() - extension.size());
+    }
+    return dataFilePath;
+}
+
+} // namespace
+
 MessageService::MessageService(const std::string& dataFilePath)
-    : dataFilePath(dataFilePath) {
+    : dataFilePath(dataFilePath)
+    , senderNameTable(1)
+    , segment(StoreBasePath(dataFilePath) + ".dat")
+    , messageLog(StoreBasePath(dataFilePath) + ".log", Models::GenerateUniqueId())
+    , spill(StoreBasePath(dataFilePath) + "." + std::to_string(Models::GenerateUniqueId()) + ".spill")
+    , searchIndex(StoreBasePath(dataFilePath) + ".idx")
+    , archive(StoreBasePath(dataFilePath))
+    , idleEvictionSeconds(DEFAULT_IDLE_EVICTION.count())
+    , lastIdleSweep(AccessTime::Now())
+    , persistence("message history", [this] { return flushPending(); }) {
     LoadFromFile();
 }
 
 MessageService::~MessageService() {
+    persistence.Close();
     SaveToFile();
 }
 
@@ -17,7 +45,7 @@ Models::Message MessageService::AddMessage(uint64_t channelId, uint64_t senderId
                                            const std::string& senderName,
                                            const std::string& content,
                                            Models::MessageType type) {
-    std::lock_guard<std::mutex> lock(serviceMutex);
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
     
     Models::Message msg;
     msg.messageId = Models::GenerateUniqueId();
@@ -29,27 +57,52 @@ Models::Message MessageService::AddMessage(uint64_t channelId, uint64_t senderId
     msg.isEdited = false;
     msg.recipientId = 0;
     
-    // Store sender name for display
-    senderNames[msg.messageId] = senderName;
+    storeMessage(msg, senderName);
     
-    // Add to channel
-    auto& messages = channelMessages[channelId];
-    messages.push_back(msg);
+    // Buffered; the worker flushes it within one commit window
+    if (!messageLog.AppendMessage(msg, senderName)) {
+        // Fall back to a full compaction so the message is not lost
+        compactRequested = true;
+    }
+    persistence.MarkDirty();
     
-    // Trim if too many messages
-    if (messages.size() > MAX_MESSAGES_PER_CHANNEL) {
-        // Remove oldest messages
-        size_t toRemove = messages.size() - MAX_MESSAGES_PER_CHANNEL;
-        for (size_t i = 0; i < toRemove; ++i) {
-            senderNames.erase(messages[i].messageId);
-        }
-        messages.erase(messages.begin(), messages.begin() + toRemove);
+    return msg;
+}
+
+std::vector<Models::Message> MessageService::AddMessages(const std::vector<NewMessage>& batch) {
+    std::vector<Models::Message> created;
+    if (batch.empty()) {
+        return created;
     }
+    created.reserve(batch.size());
+    std::vector<std::string> senderNames;
+    senderNames.reserve(batch.size());
     
-    // Save immediately so other users can see messages
-    SaveToFile();
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
     
-    return msg;
+    std::time_t now = std::time(nullptr);
+    for (const NewMessage& incoming : batch) {
+        Models::Message msg;
+        msg.messageId = Models::GenerateUniqueId();
+        msg.channelId = incoming.channelId;
+        msg.senderId = incoming.senderId;
+        msg.content = incoming.content;
+        msg.type = incoming.type;
+        msg.timestamp = now;
+        msg.isEdited = false;
+        msg.recipientId = 0;
+        
+        storeMessage(msg, incoming.senderName);
+        created.push_back(std::move(msg));
+        senderNames.push_back(incoming.senderName);
+    }
+    
+    if (!messageLog.AppendMessages(created, senderNames)) {
+        compactRequested = true;
+    }
+    persistence.MarkDirty();
+    
+    return created;
 }
 
 Models::Message MessageService::AddSystemMessage(uint64_t channelId, const std::string& content) {
@@ -57,45 +110,144 @@ Models::Message MessageService::AddSystemMessage(uint64_t channelId, const std::
 }
 
 std::vector<Models::Message> MessageService::GetChannelMessages(uint64_t channelId) {
-    std::lock_guard<std::mutex> lock(serviceMutex);
+    touchChannel(channelId);
+    std::shared_lock<std::shared_mutex> lock(serviceMutex);
+    
+    auto it = channels.find(channelId);
+    if (it == channels.end() || it->second.evicted) {
+        return {};
+    }
+    const ChannelHistory& history = it->second;
+    return readRange(channelId, history, 0, history.Size());
+}
+
+size_t MessageService::ForEachChannelMessage(uint64_t channelId, const MessageVisitor& visitor) {
+    touchChannel(channelId);
+    std::shared_lock<std::shared_mutex> lock(serviceMutex);
     
-    auto it = channelMessages.find(channelId);
-    if (it != channelMessages.end()) {
-        return it->second;
+    auto it = channels.find(channelId);
+    if (it == channels.end() || it->second.evicted) {
+        return 0;
     }
-    return {};
+    const ChannelHistory& history = it->second;
+    size_t visited = 0;
+    
+    size_t onDisk = history.archivedCount + history.spilled.size();
+    if (onDisk > 0) {
+        std::lock_guard<std::mutex> diskLock(diskMutex);
+        Models::Message msg;
+        std::string senderName;
+        for (size_t i = 0; i < onDisk; ++i) {
+            if (readMessage(channelId, history, i, msg, senderName)) {
+                visitor({ msg.messageId, channelId, msg.senderId, senderName, msg.content,
+                          msg.timestamp, msg.type, msg.isEdited });
+                ++visited;
+            }
+        }
+        segment.Close();
+    }
+    
+    for (size_t i = 0; i < history.recent.Size(); ++i) {
+        const StoredMessage& stored = history.recent[i];
+        visitor({ stored.messageId, channelId, stored.senderId, senderNameTable[stored.senderHandle],
+                  history.bodies.View(stored.bodyPage, stored.bodyOffset, stored.bodyLength),
+                  static_cast<std::time_t>(stored.timestamp), static_cast<Models::MessageType>(stored.type),
+                  stored.isEdited });
+        ++visited;
+    }
+    
+    return visited;
 }
 
 std::vector<Models::Message> MessageService::GetRecentMessages(uint64_t channelId, size_t limit) {
-    std::lock_guard<std::mutex> lock(serviceMutex);
+    return GetMessagesBefore(channelId, 0, limit);
+}
+
+std::vector<Models::Message> MessageService::GetMessagesBefore(uint64_t channelId, uint64_t beforeMessageId,
+                                                               size_t limit) {
+    touchChannel(channelId);
+    std::shared_lock<std::shared_mutex> lock(serviceMutex);
     
-    auto it = channelMessages.find(channelId);
-    if (it == channelMessages.end()) {
+    auto it = channels.find(channelId);
+    if (it == channels.end() || it->second.evicted || limit == 0) {
         return {};
     }
+    const ChannelHistory& history = it->second;
     
-    const auto& messages = it->second;
-    if (messages.size() <= limit) {
-        return messages;
+    // Position of beforeMessageId in the whole history; pages are usually
+    // requested near the newest end, so search backwards
+    size_t end = history.Size();
+    if (beforeMessageId != 0) {
+        size_t pos = end;
+        while (pos > 0) {
+            if (history.MessageIdAt(pos - 1) == beforeMessageId) {
+                break;
+            }
+            pos--;
+        }
+        if (pos == 0) {
+            // Older than anything held here: the archive may have it
+            std::lock_guard<std::mutex> diskLock(diskMutex);
+            return archive.ReadBefore(channelId, beforeMessageId, limit);
+        }
+        end = pos - 1;
     }
     
-    // Return the last 'limit' messages
-    return std::vector<Models::Message>(messages.end() - limit, messages.end());
+    size_t begin = end - (std::min)(limit, end);
+    std::vector<Models::Message> page = readRange(channelId, history, begin, end);
+    if (begin == 0 && page.size() < limit) {
+        // The page reached the oldest message held here; top it up from the archive
+        uint64_t oldestId = history.Size() > 0 ? history.MessageIdAt(0) : 0;
+        std::lock_guard<std::mutex> diskLock(diskMutex);
+        std::vector<Models::Message> older = archive.ReadBefore(channelId, oldestId, limit - page.size());
+        page.insert(page.begin(), std::make_move_iterator(older.begin()), std::make_move_iterator(older.end()));
+    }
+    return page;
 }
 
-void MessageService::ClearChannel(uint64_t channelId) {
-    std::lock_guard<std::mutex> lock(serviceMutex);
+std::vector<Models::Message> MessageService::GetMessagesAfter(uint64_t channelId, uint64_t afterMessageId,
+                                                              size_t limit) {
+    touchChannel(channelId);
+    std::shared_lock<std::shared_mutex> lock(serviceMutex);
     
-    auto it = channelMessages.find(channelId);
-    if (it != channelMessages.end()) {
-        // Remove sender names for these messages
-        for (const auto& msg : it->second) {
-            senderNames.erase(msg.messageId);
+    auto it = channels.find(channelId);
+    if (it == channels.end() || it->second.evicted || limit == 0) {
+        return {};
+    }
+    const ChannelHistory& history = it->second;
+    
+    // A caught-up client's cursor is at or near the newest end, so the
+    // search costs O(messages it missed)
+    size_t size = history.Size();
+    size_t begin = size;
+    if (afterMessageId == 0) {
+        begin = 0;
+    } else {
+        while (begin > 0 && history.MessageIdAt(begin - 1) != afterMessageId) {
+            begin--;
+        }
+        if (begin == 0) {
+            // Cursor not stored: fall back to ID order
+            begin = size;
+            while (begin > 0 && history.MessageIdAt(begin - 1) > afterMessageId) {
+                begin--;
+            }
         }
-        channelMessages.erase(it);
     }
     
-    SaveToFile();
+    size_t end = begin + (std::min)(limit, size - begin);
+    return readRange(channelId, history, begin, end);
+}
+
+void MessageService::ClearChannel(uint64_t channelId) {
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    
+    eraseChannel(channelId);
+    
+    if (!messageLog.AppendClearChannel(channelId)) {
+        compactRequested = true;
+    }
+    persistence.MarkDirty();
 }
 
 void MessageService::ClearServerMessages(uint64_t serverId, const std::vector<uint64_t>& channelIds) {
@@ -104,101 +256,478 @@ void MessageService::ClearServerMessages(uint64_t serverId, const std::vector<ui
     }
 }
 
-void MessageService::SaveToFile() {
-    // Note: Caller should NOT hold the lock when calling this from destructor
-    // For internal calls, lock is already held
+std::vector<Models::Message> MessageService::SearchMessages(const std::vector<uint64_t>& channelIds,
+                                                            const std::string& query, size_t limit) {
+    TRACE_ZONE("MessageService::SearchMessages");
+    std::vector<Models::Message> results;
+    std::vector<uint64_t> terms;
+    MessageSearchIndex::Tokenize(query, terms);
+    if (terms.empty() || limit == 0) {
+        return results;
+    }
+    terms.resize((std::min)(terms.size(), MessageSearchIndex::MAX_QUERY_TERMS));
+    for (uint64_t channelId : channelIds) {
+        touchChannel(channelId);
+    }
     
-    pugi::xml_document doc;
-    auto root = doc.append_child("MessageHistory");
+    std::shared_lock<std::shared_mutex> lock(serviceMutex);
+    std::lock_guard<std::mutex> diskLock(diskMutex);
     
-    for (const auto& [channelId, messages] : channelMessages) {
-        auto channelNode = root.append_child("Channel");
-        channelNode.append_attribute("id") = channelId;
-        
-        for (const auto& msg : messages) {
-            auto msgNode = channelNode.append_child("Message");
-            msgNode.append_attribute("id") = msg.messageId;
-            msgNode.append_attribute("senderId") = msg.senderId;
-            msgNode.append_attribute("timestamp") = static_cast<long long>(msg.timestamp);
-            msgNode.append_attribute("type") = static_cast<int>(msg.type);
-            msgNode.append_attribute("edited") = msg.isEdited;
-            
-            // Store sender name
-            auto nameIt = senderNames.find(msg.messageId);
-            if (nameIt != senderNames.end()) {
-                msgNode.append_attribute("senderName") = nameIt->second.c_str();
+    // Each channel's newest hits are candidates; IDs are time-ordered, so
+    // sorting them by ID gives the newest across the server
+    struct Candidate {
+        uint64_t messageId;
+        uint64_t channelId;
+        const ChannelHistory* history;
+        size_t position;
+    };
+    std::vector<Candidate> candidates;
+    for (uint64_t channelId : channelIds) {
+        auto it = channels.find(channelId);
+        if (it == channels.end() || it->second.evicted) {
+            continue;
+        }
+        const ChannelHistory& history = it->second;
+        std::vector<uint64_t> positions = searchIndex.Match(channelId, terms);
+        size_t taken = 0;
+        for (auto pos = positions.rbegin(); pos != positions.rend() && taken < limit; ++pos) {
+            if (*pos < history.Size()) {
+                candidates.push_back({ history.MessageIdAt(*pos), channelId, &history, *pos });
+                ++taken;
             }
-            
-            msgNode.text().set(msg.content.c_str());
         }
     }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) { return a.messageId > b.messageId; });
     
-    if (!doc.save_file(dataFilePath.c_str())) {
-        printf("[MSG] Failed to save message history to %s\n", dataFilePath.c_str());
-    } else {
-        printf("[MSG] Saved message history\n");
+    // Word keys are hashes, so confirm each hit against its body
+    for (const Candidate& candidate : candidates) {
+        Models::Message msg;
+        std::string senderName;
+        if (readMessage(candidate.channelId, *candidate.history, candidate.position, msg, senderName) &&
+            MessageSearchIndex::ContainsAll(msg.content, terms)) {
+            results.push_back(std::move(msg));
+            if (results.size() == limit) {
+                break;
+            }
+        }
     }
+    searchIndex.Close();
+    segment.Close();
+    return results;
 }
 
-void MessageService::LoadFromFile() {
-    std::lock_guard<std::mutex> lock(serviceMutex);
+void MessageService::SetIdleEviction(std::chrono::seconds idleFor) {
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    idleEvictionSeconds = idleFor.count() <= 0 ? 0 : (std::max)(idleFor, MIN_IDLE_EVICTION).count();
+}
+
+size_t MessageService::EvictIdleChannels(std::chrono::seconds idleFor) {
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    return evictIdleLocked(idleFor.count());
+}
+
+//=============================================================================
+// IN-MEMORY STATE (serviceMutex held)
+//=============================================================================
+
+void MessageService::storeMessage(const Models::Message& msg, const std::string& senderName) {
+    // An evicted channel keeps its index released: new messages only touch the ring
+    ChannelHistory& history = channels[msg.channelId];
+    history.lastAccess.Touch();
     
-    pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_file(dataFilePath.c_str());
+    // A full ring hands its oldest message to the spill file: O(1), nothing shifts
+    if (history.recent.Full()) {
+        const StoredMessage& oldest = history.recent.Front();
+        uint64_t offset = 0;
+        if (spill.Append(expandMessage(msg.channelId, history, oldest),
+                         senderNameTable[oldest.senderHandle], offset)) {
+            history.spilled.push_back({ oldest.messageId, offset });
+        }
+        history.recent.PopFront();
+    }
     
-    if (!result) {
-        printf("[MSG] No existing message history found, starting fresh\n");
-        return;
+    StoredMessage stored;
+    stored.messageId = msg.messageId;
+    stored.senderId = msg.senderId;
+    stored.timestamp = static_cast<int64_t>(msg.timestamp);
+    stored.bodyLength = static_cast<uint32_t>(msg.content.size());
+    stored.senderHandle = internSenderName(senderName);
+    stored.type = static_cast<uint8_t>(msg.type);
+    stored.isEdited = msg.isEdited;
+    history.bodies.Append(msg.content, stored.bodyPage, stored.bodyOffset);
+    history.recent.PushBack(stored);
+    history.bodies.DropBefore(history.recent.Front().bodyPage);
+    
+    searchIndex.Add(msg.channelId, history.Size() - 1, msg.content);
+}
+
+int64_t MessageService::AccessTime::Now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t MessageService::ChannelHistory::MessageIdAt(size_t index) const {
+    if (index < archivedCount) {
+        return archived[index].messageId;
     }
+    index -= archivedCount;
+    if (index < spilled.size()) {
+        return spilled[index].messageId;
+    }
+    return recent[index - spilled.size()].messageId;
+}
+
+bool MessageService::readMessage(uint64_t channelId, const ChannelHistory& history, size_t index,
+                                 Models::Message& msg, std::string& senderName) {
+    // The ID checks catch a segment replaced by another instance
+    if (index < history.archivedCount) {
+        const MessageSegment::Entry& entry = history.archived[index];
+        return segment.Read(entry.offset, msg, senderName) && msg.messageId == entry.messageId;
+    }
+    index -= history.archivedCount;
+    if (index < history.spilled.size()) {
+        const MessageSegment::Entry& entry = history.spilled[index];
+        return spill.Read(entry.offset, msg, senderName) && msg.messageId == entry.messageId;
+    }
+    const StoredMessage& stored = history.recent[index - history.spilled.size()];
+    msg = expandMessage(channelId, history, stored);
+    senderName = senderNameTable[stored.senderHandle];
+    return true;
+}
+
+Models::Message MessageService::expandMessage(uint64_t channelId, const ChannelHistory& history,
+                                              const StoredMessage& stored) const {
+    Models::Message msg;
+    msg.messageId = stored.messageId;
+    msg.channelId = channelId;
+    msg.senderId = stored.senderId;
+    msg.recipientId = 0;
+    msg.type = static_cast<Models::MessageType>(stored.type);
+    msg.content = history.bodies.Read(stored.bodyPage, stored.bodyOffset, stored.bodyLength);
+    msg.timestamp = static_cast<std::time_t>(stored.timestamp);
+    msg.isEdited = stored.isEdited;
+    return msg;
+}
+
+uint32_t MessageService::internSenderName(const std::string& senderName) {
+    if (senderName.empty()) {
+        return 0;
+    }
+    auto [it, inserted] = senderHandles.emplace(senderName,
+                                                static_cast<uint32_t>(senderNameTable.size()));
+    if (inserted) {
+        senderNameTable.push_back(senderName);
+    }
+    return it->second;
+}
+
+void MessageService::clearHistory() {
+    channels.clear();
+    spill.Clear();
+    searchIndex.Clear();
+    senderNameTable.assign(1, std::string());
+    senderHandles.clear();
+}
+
+void MessageService::BodyArena::Append(const std::string& body, uint32_t& page, uint32_t& offset) {
+    // Pages grow like any string until full; nothing keeps pointers into them
+    if (pages.empty() ||
+        (!pages.back().empty() && pages.back().size() + body.size() > BODY_PAGE_SIZE)) {
+        pages.emplace_back();
+    }
+    page = firstPage + static_cast<uint32_t>(pages.size() - 1);
+    offset = static_cast<uint32_t>(pages.back().size());
+    pages.back().append(body);
+}
+
+std::string MessageService::BodyArena::Read(uint32_t page, uint32_t offset, uint32_t length) const {
+    const std::string& bytes = pages[page - firstPage];
+    return bytes.substr(offset, length);
+}
+
+std::string_view MessageService::BodyArena::View(uint32_t page, uint32_t offset, uint32_t length) const {
+    return std::string_view(pages[page - firstPage]).substr(offset, length);
+}
+
+void MessageService::BodyArena::DropBefore(uint32_t page) {
+    while (firstPage < page && !pages.empty()) {
+        pages.pop_front();
+        ++firstPage;
+    }
+}
+
+void MessageService::applyRecord(const MessageLog::Record& record) {
+    if (record.type == MessageLog::RecordType::Message) {
+        storeMessage(record.message, record.senderName);
+    } else if (record.type == MessageLog::RecordType::ClearChannel) {
+        eraseChannel(record.message.channelId);
+    }
+}
+
+void MessageService::eraseChannel(uint64_t channelId) {
+    // Interned names stay until the next reload; there are few of them
+    channels.erase(channelId);
+    searchIndex.DropChannel(channelId);
+    archive.DropChannel(channelId);
+}
+
+std::vector<Models::Message> MessageService::readRange(uint64_t channelId,
+                                                       const ChannelHistory& history,
+                                                       size_t begin, size_t end) {
+    std::vector<Models::Message> page;
+    page.reserve(end - begin);
     
-    auto root = doc.child("MessageHistory");
+    // Readers share serviceMutex, but not the segment and spill file handles
+    bool onDisk = begin < history.archivedCount + history.spilled.size();
+    std::unique_lock<std::mutex> diskLock(diskMutex, std::defer_lock);
+    if (onDisk) {
+        diskLock.lock();
+    }
     
-    for (auto channelNode : root.children("Channel")) {
-        uint64_t channelId = channelNode.attribute("id").as_ullong();
-        
-        for (auto msgNode : channelNode.children("Message")) {
-            Models::Message msg;
-            msg.messageId = msgNode.attribute("id").as_ullong();
-            msg.channelId = channelId;
-            msg.senderId = msgNode.attribute("senderId").as_ullong();
-            msg.timestamp = static_cast<std::time_t>(msgNode.attribute("timestamp").as_llong());
-            msg.type = static_cast<Models::MessageType>(msgNode.attribute("type").as_int());
-            msg.isEdited = msgNode.attribute("edited").as_bool();
-            msg.content = msgNode.text().as_string();
-            msg.recipientId = 0;
-            
-            // Load sender name
-            std::string senderName = msgNode.attribute("senderName").as_string();
-            if (!senderName.empty()) {
-                senderNames[msg.messageId] = senderName;
-            }
-            
-            channelMessages[channelId].push_back(msg);
+    for (size_t i = begin; i < end; ++i) {
+        Models::Message msg;
+        std::string senderName;
+        if (readMessage(channelId, history, i, msg, senderName)) {
+            page.push_back(std::move(msg));
+        }
+    }
+    if (onDisk) {
+        segment.Close();
+    }
+    return page;
+}
+
+bool MessageService::evictLocked(uint64_t channelId, ChannelHistory& history) {
+    // The spill file already pages between the index and the ring, so the
+    // ring moves there whole and positions stay as they were
+    while (!history.recent.Empty()) {
+        const StoredMessage& oldest = history.recent.Front();
+        uint64_t offset = 0;
+        if (!spill.Append(expandMessage(channelId, history, oldest),
+                          senderNameTable[oldest.senderHandle], offset)) {
+            return false;   // The rest stays in memory; retried next sweep
         }
+        history.spilled.push_back({ oldest.messageId, offset });
+        history.recent.PopFront();
     }
+    history.recent.Clear();
+    history.bodies = BodyArena();
     
-    printf("[MSG] Loaded message history for %zu channels\n", channelMessages.size());
+    if (history.archivedCount > 0) {
+        std::vector<MessageSegment::Entry>().swap(history.archived);
+        history.evicted = true;
+    }
+    return true;
 }
 
-void MessageService::ReloadFromFile() {
-    // Clear current data and reload from file
-    // This is used to get updates from other instances
+bool MessageService::restoreLocked(uint64_t channelId, ChannelHistory& history) {
+    if (!history.evicted) {
+        return true;
+    }
+    bool restored = segment.ReadEntries(channelId, history.archived) &&
+        history.archived.size() == history.archivedCount;
+    segment.Close();
+    if (!restored) {
+        history.archived.clear();
+        return false;
+    }
+    history.evicted = false;
+    return true;
+}
+
+size_t MessageService::evictIdleLocked(int64_t idleSeconds) {
+    int64_t now = AccessTime::Now();
+    size_t evicted = 0;
+    for (auto& [channelId, history] : channels) {
+        bool holdsMemory = !history.recent.Empty() || !history.archived.empty();
+        if (holdsMemory && now - history.lastAccess.Get() >= idleSeconds && evictLocked(channelId, history)) {
+            ++evicted;
+        }
+    }
+    if (evicted > 0) {
+        LOG_DEBUG("[MSG] Evicted %zu idle channels", evicted);
+    }
+    return evicted;
+}
+
+void MessageService::touchChannel(uint64_t channelId) {
     {
-        std::lock_guard<std::mutex> lock(serviceMutex);
-        channelMessages.clear();
-        senderNames.clear();
+        std::shared_lock<std::shared_mutex> lock(serviceMutex);
+        auto it = channels.find(channelId);
+        if (it == channels.end()) {
+            return;
+        }
+        it->second.lastAccess.Touch();
+        if (!it->second.evicted) {
+            return;
+        }
+    }
+    
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    auto it = channels.find(channelId);
+    if (it != channels.end() && !restoreLocked(channelId, it->second)) {
+        // Another instance replaced the segment since we indexed it
+        LOG_INFO("[MSG] Message segment changed; reloading history");
+        loadLocked();
+    }
+}
+
+//=============================================================================
+// PERSISTENCE
+//=============================================================================
+
+void MessageService::SaveToFile() {
+    TRACE_ZONE("MessageService::SaveToFile");
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    
+    bool nothingLogged = messageLog.RecordCount() == 0 &&
+        std::all_of(channels.begin(), channels.end(),
+                    [](const auto& entry) {
+                        return entry.second.recent.Empty() && entry.second.spilled.empty();
+                    });
+    if (nothingLogged) {
+        return;     // Segment already holds everything
+    }
+    compactLocked();
+}
+
+bool MessageService::flushPending() {
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    
+    bool compact = compactRequested ||
+        messageLog.RecordCount() >= COMPACT_AFTER_RECORDS ||
+        messageLog.SizeBytes() >= COMPACT_AFTER_BYTES;
+    if (!compact && !messageLog.Flush()) {
+        compact = true;     // Buffered records are gone; memory still has them
+    }
+    if (compact) {
+        compactRequested = false;
+        compactLocked();
+    }
+    
+    int64_t now = AccessTime::Now();
+    if (idleEvictionSeconds > 0 && now - lastIdleSweep >= IDLE_SWEEP_INTERVAL) {
+        lastIdleSweep = now;
+        evictIdleLocked(idleEvictionSeconds);
+    }
+    return true;
+}
+
+void MessageService::compactLocked(bool catchUp) {
+    // Fold in what other instances logged first, or the new segment would drop it
+    if (catchUp) {
+        bool compacted = false;
+        messageLog.ReadNew([this](const MessageLog::Record& record) { applyRecord(record); }, compacted);
+        if (compacted) {
+            // Another instance just compacted; its segment already has our records
+            loadLocked();
+            return;
+        }
     }
     
-    // LoadFromFile acquires its own lock
+    // Evicted channels are rewritten too, so their index comes back for it
+    std::vector<std::pair<uint64_t, int64_t>> lastAccess;
+    std::vector<uint64_t> wasEvicted;
+    lastAccess.reserve(channels.size());
+    for (auto& [channelId, history] : channels) {
+        lastAccess.emplace_back(channelId, history.lastAccess.Get());
+        if (history.evicted) {
+            if (!restoreLocked(channelId, history)) {
+                LOG_WARNING("[MSG] Failed to read the message index; history not saved");
+                return;
+            }
+            wasEvicted.push_back(channelId);
+        }
+    }
+    
+    // Copy each channel's newest messages into a new segment, indexing each
+    // at the position it will have there. A channel ARCHIVE_BATCH past the
+    // limit moves its oldest messages to the archive, down to the limit
+    MessageSegment::Writer writer(segment.Path());
+    MessageSearchIndex::Writer indexWriter(searchIndex.Path());
+    MessageArchive::Writer archiveWriter(archive);
+    for (const auto& [channelId, history] : channels) {
+        size_t total = history.Size();
+        size_t archiveEnd = total > MAX_HISTORY_PER_CHANNEL + ARCHIVE_BATCH ? total - MAX_HISTORY_PER_CHANNEL : 0;
+        uint64_t position = 0;
+        for (size_t i = 0; i < total; ++i) {
+            Models::Message msg;
+            std::string senderName;
+            if (!readMessage(channelId, history, i, msg, senderName)) {
+                continue;
+            }
+            if (i < archiveEnd) {
+                archiveWriter.Append(msg, senderName);
+            } else if (writer.Append(msg, senderName)) {
+                indexWriter.Add(channelId, position++, msg.content);
+            }
+        }
+    }
+    
+    uint64_t nextGeneration = messageLog.Generation() + 1;
+    if (!writer.Finish(nextGeneration)) {
+        segment.Close();
+        LOG_WARNING("[MSG] Failed to save message history");
+        return;
+    }
+    bool indexWritten = indexWriter.Finish(nextGeneration);
+    
+    // Archived messages must be on disk before a segment without them is live
+    segment.Close();
+    if (!archive.Commit(archiveWriter)) {
+        LOG_WARNING("[MSG] Failed to archive old messages; history not saved");
+        return;
+    }
+    
+    // The live segment must be closed before it can be replaced
+    if (!writer.Commit()) {
+        return;     // Old segment stays live and still matches the archived entries
+    }
+    searchIndex.Close();
+    if (!indexWritten || !indexWriter.Commit()) {
+        LOG_WARNING("[MSG] Failed to save the search index; older messages are not searchable until the next save");
+    }
+    
+    MessageSegment::ChannelIndex index;
+    uint64_t segmentGeneration = 0;
+    segment.Open(index, segmentGeneration);
+    
+    // Everything is archived now; channels keep their idle clocks
+    clearHistory();
+    for (auto& [channelId, entries] : index) {
+        ChannelHistory& history = channels[channelId];
+        history.archived = std::move(entries);
+        history.archivedCount = history.archived.size();
+    }
+    for (const auto& [channelId, accessed] : lastAccess) {
+        auto it = channels.find(channelId);
+        if (it != channels.end()) {
+            it->second.lastAccess.seconds.store(accessed, std::memory_order_relaxed);
+        }
+    }
+    for (uint64_t channelId : wasEvicted) {
+        auto it = channels.find(channelId);
+        if (it != channels.end()) {
+            evictLocked(channelId, it->second);
+        }
+    }
+    searchIndex.Open(segmentGeneration);
+    
+    // A crash before this point leaves the old generation behind, which the
+    // next load recognises as already folded in
+    messageLog.Reset(nextGeneration);
+    LOG_DEBUG("[MSG] Saved message history");
+}
+
+bool MessageService::importLegacyXml() {
     pugi::xml_document doc;
     pugi::xml_parse_result result = doc.load_file(dataFilePath.c_str());
     
     if (!result) {
-        printf("[MSG] Failed to reload message history\n");
-        return;
+        return false;
     }
     
-    std::lock_guard<std::mutex> lock(serviceMutex);
     auto root = doc.child("MessageHistory");
     
     for (auto channelNode : root.children("Channel")) {
@@ -215,16 +744,93 @@ void MessageService::ReloadFromFile() {
             msg.content = msgNode.text().as_string();
             msg.recipientId = 0;
             
-            std::string senderName = msgNode.attribute("senderName").as_string();
-            if (!senderName.empty()) {
-                senderNames[msg.messageId] = senderName;
-            }
-            
-            channelMessages[channelId].push_back(msg);
+            storeMessage(msg, msgNode.attribute("senderName").as_string());
         }
     }
     
-    printf("[MSG] Reloaded message history for %zu channels\n", channelMessages.size());
+    LOG_INFO("[MSG] Importing legacy message history from %s", dataFilePath.c_str());
+    return true;
+}
+
+void MessageService::loadLocked() {
+    // Our buffered records must reach the file before it is replayed
+    messageLog.Flush();
+    
+    clearHistory();
+    
+    MessageSegment::ChannelIndex index;
+    uint64_t nextGeneration = 0;
+    bool migrated = false;
+    archive.Load();
+    if (segment.Open(index, nextGeneration)) {
+        bool archived = !index.empty();
+        for (auto& [channelId, entries] : index) {
+            ChannelHistory& history = channels[channelId];
+            history.archived = std::move(entries);
+            history.archivedCount = history.archived.size();
+        }
+        if (!searchIndex.Open(nextGeneration) && archived) {
+            // Built by an older version or lost; the next compaction writes one
+            LOG_INFO("[MSG] Search index missing or stale; rebuilding it in the background");
+            compactRequested = true;
+            persistence.MarkDirty();
+        }
+    } else {
+        migrated = importLegacyXml();
+    }
+    
+    // Replay changes made after the segment; an older generation means the
+    // log was already folded in but not reset (crash mid-compaction)
+    bool tornTail = false;
+    size_t replayed = messageLog.Replay([&](const MessageLog::Record& record) {
+        if (messageLog.Generation() >= nextGeneration) {
+            applyRecord(record);
+        }
+    }, tornTail);
+    
+    if (messageLog.Generation() < nextGeneration) {
+        replayed = 0;
+        messageLog.Reset(nextGeneration);
+    }
+    
+    if (channels.empty() && !migrated && replayed == 0) {
+        LOG_INFO("[MSG] No existing message history found, starting fresh");
+    } else {
+        LOG_INFO("[MSG] Loaded message history for %zu channels (%zu log records)",
+               channels.size(), replayed);
+    }
+    
+    // Appending after damaged bytes would hide the new records on the next
+    // replay, so fold the intact part into a segment and start a clean log
+    if (tornTail || migrated) {
+        compactLocked(false);
+    }
+}
+
+void MessageService::LoadFromFile() {
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    loadLocked();
+}
+
+void MessageService::ReloadFromFile() {
+    TRACE_ZONE("MessageService::ReloadFromFile");
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    loadLocked();
+}
+
+bool MessageService::PollChanges() {
+    std::lock_guard<std::shared_mutex> lock(serviceMutex);
+    
+    bool compacted = false;
+    size_t applied = messageLog.ReadNew(
+        [this](const MessageLog::Record& record) { applyRecord(record); }, compacted);
+    
+    if (compacted) {
+        // Rare: another instance rewrote the segment, so our offsets are stale
+        loadLocked();
+        return true;
+    }
+    return applied > 0;
 }
 
 std::string MessageService::FormatMessageForDisplay(const Models::Message& msg,
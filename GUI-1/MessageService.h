@@ -9,14 +9,84 @@
  * - Storing messages per channel
  * - Persisting messages to XML file
  * - Loading channel history on demand
+ *
+ * PERSISTENCE:
+ * History lives in a MessageSegment ("<name>.dat") plus a MessageLog
+ * ("<name>.log") of changes made after it, where <name> is dataFilePath
+ * without its .xml extension. Adding a message costs one small buffered log
+ * append; the persistence worker flushes the log once per commit window.
+ * Once the log grows past COMPACT_AFTER_RECORDS / COMPACT_AFTER_BYTES, the
+ * worker writes a new segment (temp file + rename) and resets the log.
+ *
+ * PAGING:
+ * Only the segment's per-channel offset index is held in memory for older
+ * messages. GetMessagesBefore() reads one page of bodies from disk, so
+ * opening a channel costs O(page size), not O(all history).
+ *
+ * Messages logged since the segment sit in a per-channel ring of
+ * MAX_MESSAGES_PER_CHANNEL. Once a ring is full, each new message pushes
+ * the oldest one into a MessageSpill file, from which it still pages in
+ * until compaction archives it.
+ *
+ * TIERS:
+ * - Hot: channels read or written within the idle limit (SetIdleEviction,
+ *   DEFAULT_IDLE_EVICTION) keep their recent ring and offset index in memory
+ * - Warm: an idle channel's ring is moved to the spill file and its
+ *   offset index released; the first read loads the index back from the
+ *   segment (one contiguous read), so memory follows active channels
+ *   rather than every channel ever used. The persistence worker sweeps
+ *   for idle channels every IDLE_SWEEP_INTERVAL
+ * - Cold: once a channel holds ARCHIVE_BATCH messages past
+ *   MAX_HISTORY_PER_CHANNEL, compaction moves its oldest messages into a
+ *   compressed MessageArchive instead of the new segment.
+ *   GetMessagesBefore() pages on into the archive past the segment's
+ *   oldest message; whole-history reads and search stop at the segment
+ *
+ * MEMORY:
+ * Recent messages are kept as fixed-size StoredMessage records: bodies are
+ * packed into per-channel arena pages and sender names are interned into
+ * one table shared by every channel. Models::Message is only built when a
+ * caller asks for history.
+ *
+ * SEARCH:
+ * A MessageSearchIndex ("<name>.idx") maps each word to the positions of
+ * the messages using it, per channel. Storing a message adds it to the
+ * index's in-memory delta; compaction writes a fresh index segment next
+ * to the new message segment. SearchMessages() decodes only the query's
+ * lists and reads only the messages it returns. An index segment that
+ * is missing or stale at load is rebuilt by a compaction on the
+ * persistence worker; until then only messages logged since are found.
+ *
+ * CHANGES FROM OTHER INSTANCES:
+ * Instances sharing one history all append to the same log. PollChanges()
+ * applies only the records others appended since the last poll; a full
+ * index reload happens only when another instance has compacted.
+ *
+ * MIGRATION:
+ * If no segment exists yet, the legacy XML history at dataFilePath is
+ * imported once and compacted into a segment. The XML file is not
+ * written any more.
  */
 
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <deque>
 #include <mutex>
+#include <shared_mutex>
 #include <cstdint>
+#include <atomic>
+#include <chrono>
 #include "Models.h"
+#include "MessageLog.h"
+#include "MessageSegment.h"
+#include "MessageSpill.h"
+#include "MessageSearchIndex.h"
+#include "MessageArchive.h"
+#include "RingBuffer.h"
+#include "PersistenceWorker.h"
+#include "FlatHashMap.h"
 #include "pugixml.hpp"
 
 class MessageService {
@@ -28,7 +98,7 @@ public:
     explicit MessageService(const std::string& dataFilePath);
     
     /**
-     * @brief Destructor - saves messages to file
+     * @brief Destructor - flushes the log and compacts it into the segment
      */
     ~MessageService();
     
@@ -50,6 +120,25 @@ public:
                                const std::string& content,
                                Models::MessageType type = Models::MessageType::Text);
     
+    /** @brief One message of an AddMessages() batch */
+    struct NewMessage {
+        uint64_t channelId;
+        uint64_t senderId;
+        std::string senderName;
+        std::string content;
+        Models::MessageType type;
+    };
+    
+    /**
+     * @brief Add several messages under one lock and one log write
+     *
+     * The UI hands over everything received since its last frame, so a
+     * burst costs one append to the log instead of one per message.
+     *
+     * @return The created messages, in the same order
+     */
+    std::vector<Models::Message> AddMessages(const std::vector<NewMessage>& batch);
+    
     /**
      * @brief Add a system message (join/leave notifications)
      * @param channelId The channel to add the message to
@@ -65,6 +154,38 @@ public:
      */
     std::vector<Models::Message> GetChannelMessages(uint64_t channelId);
     
+    /**
+     * @brief A stored message as a visitor sees it
+     *
+     * The views point into MessageService's own storage and are valid only
+     * for the duration of the visitor call.
+     */
+    struct MessageView {
+        uint64_t messageId;
+        uint64_t channelId;
+        uint64_t senderId;
+        std::string_view senderName;
+        std::string_view content;
+        std::time_t timestamp;
+        Models::MessageType type;
+        bool isEdited;
+    };
+    
+    using MessageVisitor = std::function<void(const MessageView&)>;
+    
+    /**
+     * @brief Visit a channel's whole history without copying it
+     *
+     * Recent bodies are viewed in place; archived and spilled ones go
+     * through one reused buffer. Runs under the shared lock, so the
+     * visitor must not call back into MessageService.
+     *
+     * @param channelId The channel ID
+     * @param visitor Called once per message, oldest first
+     * @return Number of messages visited
+     */
+    size_t ForEachChannelMessage(uint64_t channelId, const MessageVisitor& visitor);
+    
     /**
      * @brief Get recent messages for a channel (limited count)
      * @param channelId The channel ID
@@ -73,6 +194,31 @@ public:
      */
     std::vector<Models::Message> GetRecentMessages(uint64_t channelId, size_t limit = 100);
     
+    /**
+     * @brief Get one page of history older than a given message
+     * @param channelId The channel ID
+     * @param beforeMessageId The page ends just before this message (0 = newest page)
+     * @param limit Maximum number of messages to return
+     * @return Messages oldest first; empty if nothing older is stored
+     */
+    std::vector<Models::Message> GetMessagesBefore(uint64_t channelId, uint64_t beforeMessageId,
+                                                   size_t limit);
+    
+    /**
+     * @brief Get the messages that follow a sync cursor
+     *
+     * If the cursor is no longer stored (trimmed, or the channel was
+     * cleared), every message with a larger ID follows it: IDs are
+     * time-ordered.
+     *
+     * @param channelId The channel ID
+     * @param afterMessageId Newest message the caller already has (0 = none)
+     * @param limit Maximum number of messages to return
+     * @return The oldest messages after the cursor, oldest first
+     */
+    std::vector<Models::Message> GetMessagesAfter(uint64_t channelId, uint64_t afterMessageId,
+                                                  size_t limit);
+    
     /**
      * @brief Clear all messages in a channel
      * @param channelId The channel to clear
@@ -86,25 +232,65 @@ public:
      */
     void ClearServerMessages(uint64_t serverId, const std::vector<uint64_t>& channelIds);
     
+    // =========================================================================
+    // SEARCH
+    // =========================================================================
+    
+    /**
+     * @brief Find messages in a server's channels that contain every word of a query
+     *
+     * Words are runs of letters and digits, matched whole and ignoring
+     * ASCII case; words shorter than two characters are ignored.
+     *
+     * @param channelIds The server's channels; only these are searched
+     * @param query Words to look for
+     * @param limit Maximum number of messages to return
+     * @return Matching messages, newest first
+     */
+    std::vector<Models::Message> SearchMessages(const std::vector<uint64_t>& channelIds, const std::string& query,
+                                                size_t limit = 50);
+    
+    // =========================================================================
+    // MEMORY
+    // =========================================================================
+    
+    /**
+     * @brief Set how long a channel may go unread and unwritten before it is evicted
+     * @param idleFor Zero disables eviction; shorter than MIN_IDLE_EVICTION is raised to it
+     */
+    void SetIdleEviction(std::chrono::seconds idleFor);
+    
+    /**
+     * @brief Evict every channel idle for at least idleFor now
+     * @return Number of channels evicted
+     */
+    size_t EvictIdleChannels(std::chrono::seconds idleFor);
+    
     // =========================================================================
     // PERSISTENCE
     // =========================================================================
     
     /**
-     * @brief Save all messages to file
+     * @brief Compact: write a new segment and reset the message log
      */
     void SaveToFile();
     
     /**
-     * @brief Load messages from file
+     * @brief Load the segment index and replay the message log on top of it
      */
     void LoadFromFile();
     
     /**
-     * @brief Reload messages from file (to get updates from other instances)
+     * @brief Discard everything in memory and reload from disk
      */
     void ReloadFromFile();
     
+    /**
+     * @brief Apply messages other instances logged since the last call
+     * @return True if any channel changed
+     */
+    bool PollChanges();
+    
     /**
      * @brief Get the formatted display string for a message
      * @param msg The message to format
@@ -115,19 +301,165 @@ public:
                                                 const std::string& senderName);
 
 private:
+    /**
+     * @brief A recent message, minus what its channel and the name table hold
+     *
+     * The channel ID is the map key, the body lives in the channel's arena
+     * and the sender name in senderNameTable, so each message costs one
+     * fixed-size record plus its body bytes.
+     */
+    struct StoredMessage {
+        uint64_t messageId;
+        uint64_t senderId;
+        int64_t timestamp;
+        uint32_t bodyPage;          // Absolute page number in the channel's arena
+        uint32_t bodyOffset;
+        uint32_t bodyLength;
+        uint32_t senderHandle;      // Index into senderNameTable (0 = no name)
+        uint8_t type;               // Models::MessageType
+        bool isEdited;
+    };
+    
+    /**
+     * @brief Append-only pages holding one channel's recent message bodies
+     *
+     * Bodies are packed back to back, so a channel holds a few large
+     * allocations instead of one per message. Pages only ever go away from
+     * the front, once no stored message points into them.
+     */
+    struct BodyArena {
+        std::deque<std::string> pages;
+        uint32_t firstPage = 0;     // Absolute number of pages.front()
+        
+        void Append(const std::string& body, uint32_t& page, uint32_t& offset);
+        std::string Read(uint32_t page, uint32_t offset, uint32_t length) const;
+        std::string_view View(uint32_t page, uint32_t offset, uint32_t length) const;
+        void DropBefore(uint32_t page);
+    };
+    
+    /**
+     * @brief Steady-clock seconds of a channel's last use
+     *
+     * Readers holding serviceMutex shared update it, hence atomic; copying
+     * is only needed while the map rehashes under the exclusive lock.
+     */
+    struct AccessTime {
+        std::atomic<int64_t> seconds{ Now() };
+        
+        AccessTime() = default;
+        AccessTime(const AccessTime& other) : seconds(other.seconds.load(std::memory_order_relaxed)) {}
+        AccessTime& operator=(const AccessTime& other) {
+            seconds.store(other.seconds.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+        
+        void Touch() { seconds.store(Now(), std::memory_order_relaxed); }
+        int64_t Get() const { return seconds.load(std::memory_order_relaxed); }
+        static int64_t Now();
+    };
+    
+    /**
+     * @brief One channel's history, oldest first: archived, spilled, recent
+     */
+    struct ChannelHistory {
+        std::vector<MessageSegment::Entry> archived;    // Bodies in the segment (released while evicted)
+        size_t archivedCount = 0;                        // archived.size(), kept while evicted
+        std::vector<MessageSegment::Entry> spilled;     // Logged, pushed out to the spill file
+        RingBuffer<StoredMessage> recent{ MAX_MESSAGES_PER_CHANNEL };  // Logged, in memory
+        BodyArena bodies;                                // Bodies of recent
+        bool evicted = false;                            // archived must be read back before use
+        AccessTime lastAccess;
+        
+        size_t Size() const { return archivedCount + spilled.size() + recent.Size(); }
+        uint64_t MessageIdAt(size_t index) const;
+    };
+    
     std::string dataFilePath;
     
-    // Channel ID -> Vector of messages
-    std::map<uint64_t, std::vector<Models::Message>> channelMessages;
+    // Channel ID -> history
+    FlatHashMap<uint64_t, ChannelHistory> channels;
+    
+    // Interned sender names of recent messages (archived ones keep theirs in
+    // the segment). Handle 0 is the empty name; reset when history reloads
+    std::vector<std::string> senderNameTable;
+    FlatHashMap<std::string, uint32_t> senderHandles;
+    
+    // Compacted history and the changes made since
+    MessageSegment segment;
+    MessageLog messageLog;
+    
+    // Logged messages that no longer fit in their channel's ring
+    MessageSpill spill;
+    
+    // Word -> positions, for the segment's messages and everything stored since
+    MessageSearchIndex searchIndex;
+    
+    // Messages compaction moved out of the segment, compressed
+    MessageArchive archive;
+    
+    // Thread safety: history reads share the lock, anything that writes takes it alone
+    mutable std::shared_mutex serviceMutex;
+    
+    // Serializes segment, spill and search index reads between readers sharing serviceMutex
+    std::mutex diskMutex;
+    
+    // Set when an append failed; the next flush compacts so nothing is lost
+    bool compactRequested = false;
     
-    // Message ID -> Sender name (for display purposes)
-    std::map<uint64_t, std::string> senderNames;
+    // Idle limit in seconds (0 = never evict) and when the worker last swept
+    int64_t idleEvictionSeconds;
+    int64_t lastIdleSweep;
     
-    // Thread safety
-    mutable std::mutex serviceMutex;
+    // Flushes the log off the calling thread (declared last: its save reads the state above)
+    PersistenceWorker::Handle persistence;
     
-    // Maximum messages to store per channel (to prevent memory issues)
+    // Logged messages kept in memory per channel; older ones spill to disk
     static constexpr size_t MAX_MESSAGES_PER_CHANNEL = 1000;
+    
+    // Messages per channel that survive a compaction in the segment
+    static constexpr size_t MAX_HISTORY_PER_CHANNEL = 50000;
+    
+    // Extra messages a channel may hold before compaction archives down to
+    // MAX_HISTORY_PER_CHANNEL, so each archive run moves at least this many
+    static constexpr size_t ARCHIVE_BATCH = 10000;
+    
+    // Channels unused for this long are evicted
+    static constexpr std::chrono::seconds DEFAULT_IDLE_EVICTION{ 10 * 60 };
+    static constexpr std::chrono::seconds MIN_IDLE_EVICTION{ 60 };
+    static constexpr int64_t IDLE_SWEEP_INTERVAL = 30;     // Seconds
+    
+    // Bodies are packed into pages of about this size (longer ones get their own)
+    static constexpr size_t BODY_PAGE_SIZE = 16 * 1024;
+    
+    // Log size that triggers a compaction
+    static constexpr size_t COMPACT_AFTER_RECORDS = 2000;
+    static constexpr uint64_t COMPACT_AFTER_BYTES = 4 * 1024 * 1024;
+    
+    // Helpers below expect serviceMutex to be held (readRange and
+    // readMessage only shared; readRange takes diskMutex itself)
+    void storeMessage(const Models::Message& msg, const std::string& senderName);
+    Models::Message expandMessage(uint64_t channelId, const ChannelHistory& history,
+                                  const StoredMessage& stored) const;
+    bool readMessage(uint64_t channelId, const ChannelHistory& history, size_t index,
+                     Models::Message& msg, std::string& senderName);
+    uint32_t internSenderName(const std::string& senderName);
+    void clearHistory();
+    void eraseChannel(uint64_t channelId);
+    void applyRecord(const MessageLog::Record& record);
+    std::vector<Models::Message> readRange(uint64_t channelId, const ChannelHistory& history,
+                                           size_t begin, size_t end);
+    bool evictLocked(uint64_t channelId, ChannelHistory& history);
+    bool restoreLocked(uint64_t channelId, ChannelHistory& history);
+    size_t evictIdleLocked(int64_t idleSeconds);
+    
+    // Marks a channel used and, if evicted, reads its index back; takes serviceMutex
+    void touchChannel(uint64_t channelId);
+    bool importLegacyXml();
+    void loadLocked();
+    void compactLocked(bool catchUp = true);
+    
+    // Persistence worker callback; takes serviceMutex
+    bool flushPending();
 };
 
 #endif // MESSAGE_SERVICE_H
@@ -0,0 +1,139 @@
+/**
+ * @file MessageSpill.cpp
+ * @brief Implementation of the message spill file
+ */
+
+#include "MessageSpill.h"
+#include "MessageLog.h"
+#define NOMINMAX
+#include <Windows.h>
+#include <cstdio>
+
+namespace {
+
+OVERLAPPED OverlappedAt(uint64_t offset) {
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    return overlapped;
+}
+
+uint32_t GetU32(const char* data) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(data[0])) |
+           static_cast<uint32_t>(static_cast<uint8_t>(data[1])) << 8 |
+           static_cast<uint32_t>(static_cast<uint8_t>(data[2])) << 16 |
+           static_cast<uint32_t>(static_cast<uint8_t>(data[3])) << 24;
+}
+
+} // namespace
+
+MessageSpill::MessageSpill(const std::string& path)
+    : m_path(path) {
+}
+
+MessageSpill::~MessageSpill() {
+    if (m_file) {
+        CloseHandle(m_file);    // Delete-on-close removes the file
+    }
+}
+
+bool MessageSpill::open() {
+    if (m_file) {
+        return true;
+    }
+    HANDLE file = CreateFileA(m_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("[MSG] Failed to create spill file %s\n", m_path.c_str());
+        return false;
+    }
+    m_file = file;
+    return true;
+}
+
+bool MessageSpill::Append(const Models::Message& msg, const std::string& senderName, uint64_t& offset) {
+    MessageLog::Record record;
+    record.message = msg;
+    record.senderName = senderName;
+    std::string encoded = MessageLog::EncodeRecord(record);
+    if (encoded.empty()) {
+        return false;
+    }
+
+    offset = m_size;
+    m_pending.append(encoded);
+    m_size += encoded.size();
+    if (m_pending.size() >= WRITE_CHUNK_SIZE) {
+        writePending();     // On failure the bytes stay buffered and readable
+    }
+    return true;
+}
+
+bool MessageSpill::writePending() {
+    if (m_pending.empty()) {
+        return true;
+    }
+    if (!open()) {
+        return false;
+    }
+
+    OVERLAPPED overlapped = OverlappedAt(m_written);
+    DWORD written = 0;
+    if (!WriteFile(m_file, m_pending.data(), static_cast<DWORD>(m_pending.size()), &written, &overlapped) ||
+        written != m_pending.size()) {
+        printf("[MSG] Failed to write spill file %s\n", m_path.c_str());
+        return false;
+    }
+    m_written += m_pending.size();
+    m_pending.clear();
+    return true;
+}
+
+bool MessageSpill::Read(uint64_t offset, Models::Message& msg, std::string& senderName) {
+    if (offset >= m_size) {
+        return false;
+    }
+
+    MessageLog::Record decoded;
+    if (offset >= m_written) {
+        // Still buffered
+        size_t start = static_cast<size_t>(offset - m_written);
+        if (MessageLog::DecodeRecord(m_pending.data() + start, m_pending.size() - start, decoded) == 0) {
+            return false;
+        }
+    } else {
+        char header[MessageLog::RECORD_HEADER_SIZE];
+        OVERLAPPED overlapped = OverlappedAt(offset);
+        DWORD read = 0;
+        if (!ReadFile(m_file, header, sizeof(header), &read, &overlapped) || read != sizeof(header)) {
+            return false;
+        }
+
+        uint32_t length = GetU32(header);
+        if (length > MessageLog::MAX_RECORD_SIZE) {
+            return false;
+        }
+
+        std::string bytes(header, sizeof(header));
+        bytes.resize(sizeof(header) + length);
+        overlapped = OverlappedAt(offset + sizeof(header));
+        if (!ReadFile(m_file, &bytes[sizeof(header)], length, &read, &overlapped) || read != length) {
+            return false;
+        }
+        if (MessageLog::DecodeRecord(bytes.data(), bytes.size(), decoded) == 0) {
+            return false;
+        }
+    }
+
+    msg = std::move(decoded.message);
+    senderName = std::move(decoded.senderName);
+    return true;
+}
+
+void MessageSpill::Clear() {
+    // Later records overwrite the old ones; the file keeps its size
+    m_pending.clear();
+    m_pending.shrink_to_fit();
+    m_written = 0;
+    m_size = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef MESSAGE_SPILL_H
+#define MESSAGE_SPILL_H
+
+/**
+ * @file MessageSpill.h
+ * @brief Scratch file for messages pushed out of a full in-memory channel
+ *
+ * PURPOSE:
+ * MessageService keeps each channel's newest messages in a fixed-size
+ * ring. When a ring is full, the oldest message moves here, so history
+ * beyond the ring can still be paged in until the next compaction folds
+ * it into the segment.
+ *
+ * DESIGN:
+ * - Records use the MessageLog record format, appended back to back
+ * - Appends are buffered and written out in large chunks or before a read
+ * - Clear() rewinds to the start; the file is never shared
+ *
+ * CRASH SAFETY:
+ * Nothing here is authoritative: every spilled message is also in the
+ * message log. The file is opened delete-on-close, so Windows removes it
+ * even if the process dies.
+ *
+ * THREADING:
+ * Not thread-safe; MessageService serializes access with its own mutex.
+ */
+
+#include <cstdint>
+#include <string>
+#include "Models.h"
+
+class MessageSpill {
+public:
+    /**
+     * @param path Scratch file; created on the first Append()
+     */
+    explicit MessageSpill(const std::string& path);
+    ~MessageSpill();
+
+    /**
+     * @brief Store a message
+     * @param offset Receives where to Read() it back
+     * @return False if the record is too large to encode
+     */
+    bool Append(const Models::Message& msg, const std::string& senderName, uint64_t& offset);
+
+    /**
+     * @brief Read back a message stored by Append()
+     */
+    bool Read(uint64_t offset, Models::Message& msg, std::string& senderName);
+
+    /**
+     * @brief Forget every record (offsets from before are invalid)
+     */
+    void Clear();
+
+    /** @brief Bytes stored since the last Clear() */
+    uint64_t SizeBytes() const { return m_size; }
+
+private:
+    std::string m_path;
+    void* m_file = nullptr;
+    std::string m_pending;      // Appended but not yet written, starts at m_written
+    uint64_t m_written = 0;
+    uint64_t m_size = 0;
+
+    // Pending bytes are written once they reach this size
+    static constexpr size_t WRITE_CHUNK_SIZE = 64 * 1024;
+
+    bool open();
+    bool writePending();
+
+    MessageSpill(const MessageSpill&) = delete;
+    MessageSpill& operator=(const MessageSpill&) = delete;
+};
+
+#endif // MESSAGE_SPILL_H
@@ -4,10 +4,22 @@
  */
 
 #include "Models.h"
+#include "TextValidation.h"
 #include <algorithm>
 #include <cctype>
+#include <atomic>
 #include <random>
 #include <chrono>
+#include <mutex>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
 
 namespace Models {
 
@@ -15,22 +27,170 @@ namespace Models {
 // ID GENERATION
 //=============================================================================
 
+namespace {
+
+// [42-bit Unix ms][4-bit node][6-bit thread slot][12-bit sequence]
+constexpr int ID_SEQUENCE_BITS = 12;
+constexpr int ID_SLOT_BITS = 6;
+constexpr int ID_NODE_BITS = 4;
+constexpr int ID_SLOT_SHIFT = ID_SEQUENCE_BITS;
+constexpr int ID_NODE_SHIFT = ID_SLOT_SHIFT + ID_SLOT_BITS;
+constexpr int ID_TIMESTAMP_SHIFT = ID_NODE_SHIFT + ID_NODE_BITS;
+constexpr uint64_t ID_SEQUENCE_MASK = (uint64_t(1) << ID_SEQUENCE_BITS) - 1;
+constexpr uint64_t ID_TIMESTAMP_MASK = (uint64_t(1) << (64 - ID_TIMESTAMP_SHIFT)) - 1;
+constexpr uint32_t ID_NODE_MASK = (1u << ID_NODE_BITS) - 1;
+constexpr uint32_t ID_SLOTS = 1u << ID_SLOT_BITS;
+
+// Threads beyond ID_SLOTS - 1 share the last slot through a CAS loop
+constexpr uint32_t SHARED_SLOT = ID_SLOTS - 1;
+
+std::atomic<uint64_t> claimedSlots(uint64_t(1) << SHARED_SLOT);
+std::atomic<uint64_t> releasedSlotMs[ID_SLOTS];     // Last millisecond a departed owner used
+std::atomic<uint64_t> sharedSlotState(0);           // (ms << ID_SEQUENCE_BITS) | sequence
+
+std::atomic<uint32_t>& NodeId() {
+    // Random until pinned or claimed; two random processes collide 1 time in 16
+    static std::atomic<uint32_t> node{ std::random_device{}() & ID_NODE_MASK };
+    return node;
+}
+
+/**
+ * @brief Lock a node's file for the rest of the process's life
+ * @return False if another process holds it (or it cannot be created)
+ */
+bool LockNodeFile(const std::string& path) {
+#ifdef _WIN32
+    // No sharing, so any other open fails while this handle lives; it is
+    // never closed, and the file goes with the process
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    return file != INVALID_HANDLE_VALUE;
+#else
+    int file = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (file < 0) {
+        return false;
+    }
+    if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+        close(file);
+        return false;
+    }
+    return true;     // Descriptor kept open; the lock goes with the process
+#endif
+}
+
+uint64_t NowMs() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) & ID_TIMESTAMP_MASK;
+}
+
+// Never step back: a clock that went backwards keeps the last millisecond,
+// and a full sequence borrows the next one instead of waiting for it
+void NextSequence(uint64_t& lastMs, uint64_t& sequence, uint64_t nowMs) {
+    if (nowMs > lastMs) {
+        lastMs = nowMs;
+        sequence = 0;
+    }
+    else if (sequence < ID_SEQUENCE_MASK) {
+        ++sequence;
+    }
+    else {
+        ++lastMs;
+        sequence = 0;
+    }
+}
+
+uint64_t ComposeId(uint64_t ms, uint32_t slot, uint64_t sequence) {
+    return (ms << ID_TIMESTAMP_SHIFT) |
+           (static_cast<uint64_t>(NodeId().load(std::memory_order_relaxed)) << ID_NODE_SHIFT) |
+           (static_cast<uint64_t>(slot) << ID_SLOT_SHIFT) |
+           sequence;
+}
+
+/**
+ * Each thread owns a slot, so its sequence needs no synchronization at
+ * all. A slot is returned when the thread exits; the next owner resumes
+ * after the last millisecond the previous one used.
+ */
+struct ThreadIdSlot {
+    uint32_t slot;
+    uint64_t lastMs;
+    uint64_t sequence;
+
+    ThreadIdSlot() : slot(SHARED_SLOT), lastMs(0), sequence(0) {
+        uint64_t claimed = claimedSlots.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t free = 0;
+            while (free < ID_SLOTS && (claimed & (uint64_t(1) << free))) {
+                ++free;
+            }
+            if (free == ID_SLOTS) {
+                return;
+            }
+            if (claimedSlots.compare_exchange_weak(claimed, claimed | (uint64_t(1) << free),
+                                                   std::memory_order_acquire, std::memory_order_relaxed)) {
+                slot = free;
+                break;
+            }
+        }
+        // Unknown how far the previous owner got in its last millisecond
+        lastMs = releasedSlotMs[slot].load(std::memory_order_relaxed);
+        sequence = ID_SEQUENCE_MASK;
+    }
+
+    ~ThreadIdSlot() {
+        if (slot == SHARED_SLOT) {
+            return;
+        }
+        releasedSlotMs[slot].store(lastMs, std::memory_order_relaxed);
+        claimedSlots.fetch_and(~(uint64_t(1) << slot), std::memory_order_release);
+    }
+};
+
+} // namespace
+
 uint64_t GenerateUniqueId() {
-    static std::random_device randomDevice;
-    static std::mt19937_64 generator(randomDevice());
-    static std::uniform_int_distribution<uint16_t> distribution(0, UINT16_MAX);
-    
-    // Get current timestamp in milliseconds
-    auto now = std::chrono::system_clock::now();
-    auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now.time_since_epoch()
-    ).count();
-    
-    // Combine: [48-bit timestamp][16-bit random]
-    uint64_t timestamp = static_cast<uint64_t>(milliseconds) & 0xFFFFFFFFFFFF;
-    uint64_t random = distribution(generator);
-    
-    return (timestamp << 16) | random;
+    thread_local ThreadIdSlot local;
+    uint64_t nowMs = NowMs();
+
+    if (local.slot != SHARED_SLOT) {
+        NextSequence(local.lastMs, local.sequence, nowMs);
+        return ComposeId(local.lastMs, local.slot, local.sequence);
+    }
+
+    uint64_t state = sharedSlotState.load(std::memory_order_relaxed);
+    for (;;) {
+        uint64_t lastMs = state >> ID_SEQUENCE_BITS;
+        uint64_t sequence = state & ID_SEQUENCE_MASK;
+        NextSequence(lastMs, sequence, nowMs);
+        if (sharedSlotState.compare_exchange_weak(state, (lastMs << ID_SEQUENCE_BITS) | sequence,
+                                                  std::memory_order_relaxed)) {
+            return ComposeId(lastMs, SHARED_SLOT, sequence);
+        }
+    }
+}
+
+void SetUniqueIdNode(uint32_t node) {
+    NodeId().store(node & ID_NODE_MASK, std::memory_order_relaxed);
+}
+
+bool ClaimUniqueIdNode(const std::string& directory) {
+    static std::mutex claimMutex;
+    static bool claimed = false;
+    static bool attempted = false;
+    std::lock_guard<std::mutex> lock(claimMutex);
+    if (attempted) {
+        return claimed;
+    }
+    attempted = true;
+
+    for (uint32_t node = 0; node <= ID_NODE_MASK; ++node) {
+        if (LockNodeFile(directory + "/id_node_" + std::to_string(node) + ".lock")) {
+            NodeId().store(node, std::memory_order_relaxed);
+            claimed = true;
+            break;
+        }
+    }
+    return claimed;
 }
 
 //=============================================================================
@@ -65,10 +225,8 @@ bool User::IsValidUsername(const std::string& username) {
     }
     
     // Allow only alphanumeric and underscores
-    for (char c : username) {
-        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') {
-            return false;
-        }
+    if (!TextValidation::IsValid(username, TextValidation::ACCOUNT_NAME)) {
+        return false;
     }
     
     // Reserved names (case-insensitive)
@@ -141,11 +299,8 @@ bool ChatServer::IsValidServerName(const std::string& name) {
     }
     
     // Allow letters, numbers, spaces, hyphens, underscores
-    for (char c : name) {
-        if (!std::isalnum(static_cast<unsigned char>(c)) && 
-            c != ' ' && c != '-' && c != '_') {
-            return false;
-        }
+    if (!TextValidation::IsValid(name, TextValidation::SERVER_NAME)) {
+        return false;
     }
     
     // No leading/trailing whitespace
@@ -162,7 +317,23 @@ bool ChatServer::IsOwner(uint64_t userId) const {
 }
 
 bool ChatServer::IsMember(uint64_t userId) const {
-    return std::find(memberIds.begin(), memberIds.end(), userId) != memberIds.end();
+    return memberSet.count(userId) != 0;
+}
+
+bool ChatServer::AddMember(uint64_t userId) {
+    if (!memberSet.insert(userId).second) {
+        return false;
+    }
+    memberIds.push_back(userId);
+    return true;
+}
+
+bool ChatServer::RemoveMember(uint64_t userId) {
+    if (memberSet.erase(userId) == 0) {
+        return false;
+    }
+    memberIds.erase(std::remove(memberIds.begin(), memberIds.end(), userId), memberIds.end());
+    return true;
 }
 
 //=============================================================================
@@ -189,12 +360,8 @@ bool Channel::IsValidChannelName(const std::string& name) {
     }
     
     // Channel names: lowercase, numbers, hyphens only (like Discord)
-    for (char c : name) {
-        if (!std::islower(static_cast<unsigned char>(c)) && 
-            !std::isdigit(static_cast<unsigned char>(c)) && 
-            c != '-') {
-            return false;
-        }
+    if (!TextValidation::IsValid(name, TextValidation::CHANNEL_NAME)) {
+        return false;
     }
     
     // No leading/trailing hyphens
@@ -265,14 +432,8 @@ bool Message::IsValidContent(const std::string& content) {
         return false;
     }
     
-    // Check for control characters (except newlines and tabs)
-    for (char c : content) {
-        if (std::iscntrl(static_cast<unsigned char>(c)) && c != '\n' && c != '\t' && c != '\r') {
-            return false;
-        }
-    }
-    
-    return true;
+    // No control characters (except newlines, tabs and carriage returns)
+    return TextValidation::IsValid(content, TextValidation::MESSAGE_TEXT);
 }
 
 //=============================================================================
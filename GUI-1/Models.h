@@ -18,6 +18,7 @@
 
 #include <string>
 #include <vector>
+#include <unordered_set>
 #include <cstdint>
 #include <ctime>
 
@@ -41,16 +42,42 @@ constexpr size_t MIN_PASSWORD_LENGTH = 8;
 //=============================================================================
 
 /**
- * @brief Generate a unique ID based on timestamp and random component
+ * @brief Generate a unique, roughly time-ordered ID (Snowflake layout)
  * 
- * Format: [48-bit timestamp][16-bit random]
+ * Format: [42-bit Unix ms][4-bit node][6-bit thread slot][12-bit sequence]
  * This provides:
- * - Chronological ordering (useful for messages)
- * - Collision resistance
- * - No need for central ID server
+ * - Chronological ordering (useful for messages); IDs from one thread
+ *   strictly increase, and every new ID sorts after the older
+ *   [48-bit ms][16-bit random] IDs already on disk
+ * - No collisions: each thread counts in its own slot, up to 4096 IDs
+ *   per millisecond before it borrows the next millisecond. Across
+ *   processes this holds only if each has its own node; see
+ *   ClaimUniqueIdNode()
+ * - Lock-free and safe from any thread; no central ID server
  */
 uint64_t GenerateUniqueId();
 
+/**
+ * @brief Pin the node field (low 4 bits used) when several processes mint IDs
+ * 
+ * Defaults to a random node chosen at start-up. Two processes left on
+ * random nodes share one 1 time in 16, and can then mint the same ID in
+ * the same millisecond, so anything sharing data files should pin or
+ * claim its node.
+ */
+void SetUniqueIdNode(uint32_t node);
+
+/**
+ * @brief Claim a node no other running process sharing the directory holds
+ * 
+ * Takes the first free lock file "id_node_<n>.lock" in the directory and
+ * holds it until the process exits, so up to 16 processes sharing data
+ * files always mint distinct IDs. Later calls return the first result.
+ * 
+ * @return False if all 16 are held (the node stays random)
+ */
+bool ClaimUniqueIdNode(const std::string& directory);
+
 //=============================================================================
 // USER MODEL
 //=============================================================================
@@ -137,7 +164,11 @@ struct ChatServer {
     
     // Relationships
     std::vector<uint64_t> channelIds;   // Channels in this server
-    std::vector<uint64_t> memberIds;    // Users who have joined
+    std::vector<uint64_t> memberIds;    // Users who have joined, oldest first
+    
+    // Same users as memberIds, for O(1) IsMember(); change membership
+    // through AddMember()/RemoveMember() so the two stay in step
+    std::unordered_set<uint64_t> memberSet;
     
     ChatServer();
     ChatServer(uint64_t id, const std::string& name, uint64_t owner);
@@ -149,6 +180,10 @@ struct ChatServer {
     bool IsOwner(uint64_t userId) const;
     bool IsMember(uint64_t userId) const;
     
+    // Membership changes
+    bool AddMember(uint64_t userId);       // False if already a member
+    bool RemoveMember(uint64_t userId);    // False if not a member
+    
     // Default port for chat servers
     static constexpr uint16_t DEFAULT_PORT = 54000;
 };
@@ -0,0 +1,103 @@
+#ifndef NET_PLATFORM_H
+#define NET_PLATFORM_H
+
+// Prevent Windows min/max macros from conflicting with std::min/std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+/**
+ * @file NetPlatform.h
+ * @brief The few socket calls that differ between Winsock and POSIX
+ *
+ * PURPOSE:
+ * The protocol and server code spell sockets the Winsock way: SOCKET,
+ * INVALID_SOCKET, SOCKET_ERROR, closesocket(), WSABUF. On other
+ * platforms this header supplies those names over BSD sockets, so that
+ * code compiles unchanged. Everything that really differs (error codes,
+ * non-blocking mode, polling, sleeping, library start-up) goes through
+ * the functions below instead of the Winsock calls.
+ *
+ * NOT HERE:
+ * Event engines differ too much to paper over; see IoBackend.h.
+ *
+ * NOT YET:
+ * NetProtocol, OutboundQueue, the IoBackend implementations and
+ * TrafficCapture build on POSIX. ServerSocket and ClientSocket do not:
+ * besides FLTK they still reach Win32-only modules (Connector,
+ * AttachmentServer, the BCrypt identity code) and use DWORD and
+ * GetTickCount64 directly. Headers they share with those modules
+ * (ShardBus.h, AttachmentTransfer.h) include this file rather than
+ * Winsock, so the port can proceed one .cpp at a time.
+ */
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <cstddef>
+#include <cstdint>
+
+#ifndef _WIN32
+using SOCKET = int;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+
+inline int closesocket(SOCKET socket) { return ::close(socket); }
+
+/** Scatter/gather descriptor with Winsock's field names (converted to iovec where sent) */
+struct WSABUF {
+    unsigned long len;
+    char* buf;
+};
+#endif
+
+namespace NetProtocol {
+
+#ifdef _WIN32
+using PollFd = WSAPOLLFD;
+#else
+using PollFd = pollfd;
+#endif
+
+/** @brief Start the socket library (WSAStartup on Windows); pair with StopNetworking() */
+bool StartNetworking();
+void StopNetworking();
+
+/** @brief Error code of the last failed socket call on this thread */
+int LastSocketError();
+
+/** @brief True for "try again later" (WSAEWOULDBLOCK / EAGAIN) */
+bool IsWouldBlock(int error);
+
+/** @brief True for a send or receive timeout (WSAETIMEDOUT / ETIMEDOUT) */
+bool IsTimeout(int error);
+
+/** @brief Put a socket in non-blocking mode */
+bool SetNonBlocking(SOCKET socket);
+
+/**
+ * @brief Scatter/gather send without waiting: WSASend() / sendmsg()
+ * @param sent Bytes the kernel took (may be fewer than offered)
+ * @return False on failure; see LastSocketError()
+ */
+bool SendBuffers(SOCKET socket, WSABUF* buffers, size_t count, size_t& sent);
+
+/** @brief WSAPoll() / poll(); returns SOCKET_ERROR on failure */
+int PollSockets(PollFd* sockets, size_t count, int timeoutMs);
+
+/** @brief Sleep the calling thread */
+void SleepMs(uint32_t milliseconds);
+
+} // namespace NetProtocol
+
+#endif // NET_PLATFORM_H
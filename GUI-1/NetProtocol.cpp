@@ -4,7 +4,7 @@
  * 
  * SECURITY IMPLEMENTATION NOTES:
  * 
- * 1. ALL network reads use RecvExact() to prevent partial read vulnerabilities
+ * 1. ALL network reads use RecvExact() or FrameDecoder to prevent partial read vulnerabilities
  * 2. ALL network writes use SendExact() to prevent partial write issues
  * 3. Length headers are validated BEFORE memory allocation
  * 4. Timeouts prevent indefinite blocking attacks
@@ -17,14 +17,122 @@
 #endif
 
 #include "NetProtocol.h"
-#include <ws2tcpip.h>
+#include "FrameBuffer.h"
+#include "FrameCompression.h"
 #include <algorithm>
+#include <climits>
 #include <cstring>
 
+#ifdef _WIN32
 #pragma comment(lib, "Ws2_32.lib")
+#else
+#include <csignal>
+#include <ctime>
+#include <sys/uio.h>
+#endif
 
 namespace NetProtocol {
 
+//=============================================================================
+// PLATFORM (NetPlatform.h)
+//=============================================================================
+
+bool StartNetworking() {
+#ifdef _WIN32
+    WSADATA wsaData;
+    return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+    // A send to a peer that has gone must fail with EPIPE, not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+    return true;
+#endif
+}
+
+void StopNetworking() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+int LastSocketError() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+bool IsWouldBlock(int error) {
+#ifdef _WIN32
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EWOULDBLOCK || error == EAGAIN;
+#endif
+}
+
+bool IsTimeout(int error) {
+#ifdef _WIN32
+    return error == WSAETIMEDOUT;
+#else
+    return error == ETIMEDOUT;
+#endif
+}
+
+bool SetNonBlocking(SOCKET socket) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) != SOCKET_ERROR;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+bool SendBuffers(SOCKET socket, WSABUF* buffers, size_t count, size_t& sent) {
+    sent = 0;
+#ifdef _WIN32
+    DWORD bytes = 0;
+    if (WSASend(socket, buffers, static_cast<DWORD>(count), &bytes, 0, nullptr, nullptr) == SOCKET_ERROR) {
+        return false;
+    }
+    sent = bytes;
+#else
+    // WSABUF is not laid out like iovec here; convert a bounded batch
+    iovec vectors[64];
+    size_t batch = (std::min)(count, sizeof(vectors) / sizeof(vectors[0]));
+    for (size_t i = 0; i < batch; ++i) {
+        vectors[i].iov_base = buffers[i].buf;
+        vectors[i].iov_len = buffers[i].len;
+    }
+    msghdr message = {};
+    message.msg_iov = vectors;
+    message.msg_iovlen = batch;
+    ssize_t bytes = sendmsg(socket, &message, MSG_NOSIGNAL);
+    if (bytes < 0) {
+        return false;
+    }
+    sent = static_cast<size_t>(bytes);
+#endif
+    return true;
+}
+
+int PollSockets(PollFd* sockets, size_t count, int timeoutMs) {
+#ifdef _WIN32
+    return WSAPoll(sockets, static_cast<ULONG>(count), timeoutMs);
+#else
+    return poll(sockets, static_cast<nfds_t>(count), timeoutMs);
+#endif
+}
+
+void SleepMs(uint32_t milliseconds) {
+#ifdef _WIN32
+    Sleep(milliseconds);
+#else
+    timespec delay = { static_cast<time_t>(milliseconds / 1000), static_cast<long>(milliseconds % 1000) * 1000000L };
+    nanosleep(&delay, nullptr);
+#endif
+}
+
 //=============================================================================
 // RESULT CONVERSION
 //=============================================================================
@@ -128,17 +236,17 @@ Result RecvExact(SOCKET socket, void* buffer, size_t length) {
         int received = recv(socket, ptr, toRead, 0);
         
         if (received == SOCKET_ERROR) {
-            int error = WSAGetLastError();
+            int error = LastSocketError();
             
             // Check for timeout
-            if (error == WSAETIMEDOUT) {
+            if (IsTimeout(error)) {
                 // SECURITY: Clear partial data on error
                 SecureClear(buffer, length - remaining);
                 return Result::Timeout;
             }
             
             // Check for would-block (non-blocking socket has no data ready)
-            if (error == WSAEWOULDBLOCK) {
+            if (IsWouldBlock(error)) {
                 // Return WouldBlock so GUI event loop can continue
                 // Caller should retry later
                 if (remaining == length) {
@@ -147,7 +255,7 @@ Result RecvExact(SOCKET socket, void* buffer, size_t length) {
                 }
                 // Partial data received - this is tricky for non-blocking
                 // For now, continue waiting (small messages should complete quickly)
-                Sleep(1);  // Yield to prevent busy-wait
+                SleepMs(1);  // Yield to prevent busy-wait
                 continue;
             }
             
@@ -195,16 +303,16 @@ Result SendExact(SOCKET socket, const void* buffer, size_t length) {
         int sent = send(socket, ptr, toSend, 0);
         
         if (sent == SOCKET_ERROR) {
-            int error = WSAGetLastError();
+            int error = LastSocketError();
             
-            if (error == WSAETIMEDOUT) {
+            if (IsTimeout(error)) {
                 return Result::Timeout;
             }
             
-            if (error == WSAEWOULDBLOCK) {
+            if (IsWouldBlock(error)) {
                 // Non-blocking socket can't send right now
                 // Small sleep to prevent busy-wait, then retry
-                Sleep(1);
+                SleepMs(1);
                 continue;
             }
             
@@ -269,6 +377,13 @@ Result SendMessage(SOCKET socket, const std::string& message) {
     return Result::Success;
 }
 
+Result SendFrame(SOCKET socket, const FrameBuffer& frame) {
+    if (!frame.framed()) {
+        return Result::MessageTooLarge;
+    }
+    return SendExact(socket, frame.data(), frame.size());
+}
+
 Result ReceiveMessage(SOCKET socket, std::string& message) {
     // Clear output parameter first (defense in depth)
     message.clear();
@@ -330,4 +445,417 @@ Result ReceiveMessage(SOCKET socket, std::string& message) {
     return Result::Success;
 }
 
+//=============================================================================
+// STREAMING FRAME DECODER
+//=============================================================================
+
+FrameDecoder::FrameDecoder()
+    : m_state(State::ReadingHeader)
+    , m_payloadLength(0)
+    , m_peerClosed(false)
+    , m_compression(false)
+    , m_payloadCompressed(false)
+    , m_head(0)
+    , m_size(0) {
+}
+
+FrameDecoder::~FrameDecoder() {
+    // SECURITY: Buffered frames may hold sensitive content
+    if (!m_ring.empty()) {
+        SecureClear(m_ring.data(), m_ring.size());
+    }
+    SecureClear(m_backlog);
+}
+
+void FrameDecoder::Reset() {
+    if (!m_ring.empty()) {
+        SecureClear(m_ring.data(), m_ring.size());
+    }
+    m_state = State::ReadingHeader;
+    m_payloadLength = 0;
+    m_peerClosed = false;
+    m_payloadCompressed = false;
+    m_head = 0;
+    m_size = 0;
+    SecureClear(m_backlog);
+}
+
+/**
+ * Make sure there is at least one free byte at the tail, growing the
+ * ring (and linearising its contents) if it is full and may still grow.
+ */
+bool FrameDecoder::ensureWritable() {
+    if (m_ring.empty()) {
+        m_ring.resize(INITIAL_CAPACITY);
+        m_head = 0;
+        return true;
+    }
+    
+    if (m_size < m_ring.size()) {
+        return true;
+    }
+    
+    if (m_ring.size() >= MAX_CAPACITY) {
+        return false;
+    }
+    
+    std::vector<char> grown;
+    try {
+        grown.resize((std::min)(m_ring.size() * 2, MAX_CAPACITY));
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+    copyOut(grown.data(), m_size);
+    SecureClear(m_ring.data(), m_ring.size());
+    m_ring.swap(grown);
+    m_head = 0;
+    return true;
+}
+
+void FrameDecoder::copyOut(char* destination, size_t length) const {
+    size_t capacity = m_ring.size();
+    size_t first = (std::min)(length, capacity - m_head);
+    std::memcpy(destination, m_ring.data() + m_head, first);
+    if (length > first) {
+        std::memcpy(destination + first, m_ring.data(), length - first);
+    }
+}
+
+void FrameDecoder::consume(size_t length) {
+    m_head = (m_head + length) % m_ring.size();
+    m_size -= length;
+    if (m_size == 0) {
+        m_head = 0;   // Keep future reads contiguous
+    }
+}
+
+Result FrameDecoder::ReadFrom(SOCKET socket) {
+    if (m_peerClosed) {
+        return Result::Disconnected;
+    }
+    if (m_externalInput) {
+        return Result::WouldBlock;     // The backend reads; see Feed()
+    }
+    
+    bool receivedAny = false;
+    
+    while (ensureWritable()) {
+        // Largest contiguous free region at the tail of the ring
+        size_t capacity = m_ring.size();
+        size_t tail = (m_head + m_size) % capacity;
+        size_t contiguous = (std::min)(capacity - m_size, capacity - tail);
+        
+        int toRead = static_cast<int>((std::min)(contiguous, static_cast<size_t>(INT_MAX)));
+        int received = recv(socket, m_ring.data() + tail, toRead, 0);
+        
+        if (received == SOCKET_ERROR) {
+            int error = LastSocketError();
+            if (IsWouldBlock(error)) {
+                break;
+            }
+            if (IsTimeout(error)) {
+                return receivedAny ? Result::Success : Result::Timeout;
+            }
+            return Result::NetworkError;
+        }
+        
+        if (received == 0) {
+            // Peer closed; frames already buffered can still be drained
+            m_peerClosed = true;
+            break;
+        }
+        
+        m_size += static_cast<size_t>(received);
+        receivedAny = true;
+    }
+    
+    if (receivedAny) {
+        return Result::Success;
+    }
+    return m_peerClosed ? Result::Disconnected : Result::WouldBlock;
+}
+
+Result FrameDecoder::Feed(const void* data, size_t length) {
+    const char* ptr = static_cast<const char*>(data);
+    
+    if (!m_externalInput) {
+        return fill(ptr, length) == length ? Result::Success : Result::BufferError;
+    }
+    
+    // Bytes must stay in order: nothing bypasses a non-empty backlog
+    size_t taken = m_backlog.empty() ? fill(ptr, length) : 0;
+    if (m_backlog.size() + (length - taken) > MAX_BACKLOG) {
+        return Result::BufferError;
+    }
+    m_backlog.append(ptr + taken, length - taken);
+    return Result::Success;
+}
+
+/**
+ * Copy as much as fits into the ring; returns the bytes taken.
+ */
+size_t FrameDecoder::fill(const char* data, size_t length) {
+    size_t taken = 0;
+    while (taken < length && ensureWritable()) {
+        size_t capacity = m_ring.size();
+        size_t tail = (m_head + m_size) % capacity;
+        size_t available = (std::min)(capacity - m_size, capacity - tail);
+        size_t chunk = (std::min)(length - taken, available);
+        
+        std::memcpy(m_ring.data() + tail, data + taken, chunk);
+        m_size += chunk;
+        taken += chunk;
+    }
+    return taken;
+}
+
+/**
+ * Move backlog bytes into the room frames have left in the ring.
+ */
+void FrameDecoder::refill() {
+    size_t taken = fill(m_backlog.data(), m_backlog.size());
+    if (taken > 0) {
+        SecureClear(&m_backlog[0], taken);
+        m_backlog.erase(0, taken);
+    }
+}
+
+/**
+ * Parse the header if one is due and check the whole payload is buffered.
+ * Success means a frame is ready for takePayload() or inflateFrame().
+ */
+Result FrameDecoder::awaitPayload() {
+    if (m_state == State::Failed) {
+        return Result::InvalidLength;
+    }
+    if (!m_backlog.empty()) {
+        refill();
+    }
+    
+    if (m_state == State::ReadingHeader) {
+        if (m_size < HEADER_SIZE) {
+            return m_peerClosed ? Result::Disconnected : Result::WouldBlock;
+        }
+        
+        uint32_t networkLength = 0;
+        copyOut(reinterpret_cast<char*>(&networkLength), HEADER_SIZE);
+        uint32_t length = ntohl(networkLength);
+        
+        // Only a connection that negotiated compression may set the flag;
+        // anywhere else it is just an impossible length
+        bool compressed = m_compression && (length & COMPRESSED_FLAG) != 0;
+        if (compressed) {
+            length &= ~COMPRESSED_FLAG;
+        }
+        
+        // SECURITY CHECK: Validate length BEFORE waiting for/allocating payload.
+        // A hostile header poisons the stream; the connection must be dropped.
+        if (length > MAX_MESSAGE_SIZE) {
+            m_state = State::Failed;
+            return Result::MessageTooLarge;
+        }
+        
+        consume(HEADER_SIZE);
+        m_payloadLength = length;
+        m_payloadCompressed = compressed;
+        m_state = State::ReadingPayload;
+    }
+    
+    if (m_size < m_payloadLength) {
+        return m_peerClosed ? Result::Disconnected : Result::WouldBlock;
+    }
+    return Result::Success;
+}
+
+/**
+ * Move the ready (uncompressed) payload to destination, which has room
+ * for m_payloadLength bytes, and get ready for the next header.
+ */
+void FrameDecoder::takePayload(char* destination) {
+    if (m_payloadLength > 0) {
+        copyOut(destination, m_payloadLength);
+        consume(m_payloadLength);
+    }
+    m_payloadLength = 0;
+    m_state = State::ReadingHeader;
+}
+
+Result FrameDecoder::NextFrame(std::string& message) {
+    message.clear();
+    
+    Result result = awaitPayload();
+    if (result != Result::Success) {
+        return result;
+    }
+    if (m_payloadCompressed) {
+        return inflateFrame(message);
+    }
+    
+    try {
+        message.resize(m_payloadLength);
+    } catch (const std::bad_alloc&) {
+        return Result::BufferError;
+    }
+    takePayload(&message[0]);
+    return Result::Success;
+}
+
+Result FrameDecoder::NextFrame(PooledFrame& frame) {
+    frame.clear();
+    
+    Result result = awaitPayload();
+    if (result != Result::Success) {
+        return result;
+    }
+    if (m_payloadCompressed) {
+        // Inflated into a string the decoder keeps, so its capacity is paid once
+        result = inflateFrame(m_inflated);
+        if (result == Result::Success && !frame.assign(m_inflated)) {
+            result = Result::BufferError;
+        }
+        SecureClear(m_inflated);
+        return result;
+    }
+    
+    char* destination = frame.prepare(m_payloadLength);
+    if (!destination) {
+        return Result::BufferError;
+    }
+    takePayload(destination);
+    return Result::Success;
+}
+
+/**
+ * Inflate the buffered compressed payload into message. A stream that
+ * does not inflate cleanly poisons the connection like a bad header.
+ */
+Result FrameDecoder::inflateFrame(std::string& message) {
+    try {
+        m_compressed.resize(m_payloadLength);
+        if (!m_inflater) {
+            m_inflater.reset(new Inflater());
+        }
+    } catch (const std::bad_alloc&) {
+        return Result::BufferError;
+    }
+    
+    if (m_payloadLength > 0) {
+        copyOut(&m_compressed[0], m_payloadLength);
+    }
+    consume(m_payloadLength);
+    m_payloadLength = 0;
+    m_payloadCompressed = false;
+    
+    bool inflated = m_inflater->Decompress(m_compressed, message);
+    SecureClear(m_compressed);
+    if (!inflated) {
+        m_state = State::Failed;
+        return Result::InvalidLength;
+    }
+    
+    m_state = State::ReadingHeader;
+    return Result::Success;
+}
+
+namespace {
+
+template <typename Output>
+Result ReceiveThrough(SOCKET socket, FrameDecoder& decoder, Output& message) {
+    // Serve frames already buffered from an earlier read first
+    Result result = decoder.NextFrame(message);
+    if (result != Result::WouldBlock) {
+        return result;
+    }
+    
+    result = decoder.ReadFrom(socket);
+    if (result == Result::NetworkError || result == Result::Timeout) {
+        return result;
+    }
+    
+    return decoder.NextFrame(message);
+}
+
+} // namespace
+
+Result ReceiveMessage(SOCKET socket, FrameDecoder& decoder, std::string& message) {
+    return ReceiveThrough(socket, decoder, message);
+}
+
+Result ReceiveMessage(SOCKET socket, FrameDecoder& decoder, PooledFrame& frame) {
+    return ReceiveThrough(socket, decoder, frame);
+}
+
+//=============================================================================
+// VERSION NEGOTIATION
+//=============================================================================
+
+namespace {
+
+const char HELLO_PREFIX[] = "HELLO ";
+const char WELCOME_PREFIX[] = "WELCOME ";
+
+/**
+ * Parse an unsigned decimal version number. Digits only, bounded to nine
+ * of them so the value cannot overflow uint32_t.
+ */
+bool ParseVersion(std::string_view text, size_t begin, size_t end, uint32_t& version) {
+    if (end <= begin || end - begin > 9) {
+        return false;
+    }
+    
+    uint32_t value = 0;
+    for (size_t i = begin; i < end; ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    
+    version = value;
+    return true;
+}
+
+} // namespace
+
+std::string BuildHello(uint32_t version, const std::string& username) {
+    return HELLO_PREFIX + std::to_string(version) + " " + username;
+}
+
+bool ParseHello(std::string_view payload, uint32_t& version, std::string& username) {
+    const size_t prefixLength = sizeof(HELLO_PREFIX) - 1;
+    if (payload.compare(0, prefixLength, HELLO_PREFIX) != 0) {
+        return false;
+    }
+    
+    size_t space = payload.find(' ', prefixLength);
+    if (space == std::string_view::npos) {
+        return false;
+    }
+    if (!ParseVersion(payload, prefixLength, space, version)) {
+        return false;
+    }
+    
+    // Username is validated by the caller; only its presence is checked here
+    username.assign(payload.substr(space + 1));
+    return !username.empty();
+}
+
+std::string BuildWelcome(uint32_t version) {
+    return WELCOME_PREFIX + std::to_string(version);
+}
+
+bool ParseWelcome(const std::string& payload, uint32_t& version) {
+    const size_t prefixLength = sizeof(WELCOME_PREFIX) - 1;
+    if (payload.compare(0, prefixLength, WELCOME_PREFIX) != 0) {
+        return false;
+    }
+    return ParseVersion(payload, prefixLength, payload.size(), version);
+}
+
+uint32_t NegotiateVersion(uint32_t peerVersion) {
+    uint32_t version = (std::min)(peerVersion, PROTOCOL_VERSION);
+    return (version >= MIN_PROTOCOL_VERSION) ? version : 0;
+}
+
 } // namespace NetProtocol
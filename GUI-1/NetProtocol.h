@@ -27,17 +27,24 @@
  * SOLUTION:
  * Length-prefixed framing with explicit bounds checking.
  * Format: [4-byte length (network byte order)][payload]
+ * From protocol v5 the top bit of the length may mark a deflated payload.
  * 
  * @author Security hardening by Phase 1 implementation
  */
 
-#include <winsock2.h>
+#include "NetPlatform.h"
+#include "BufferPool.h"
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace NetProtocol {
 
+class FrameBuffer;
+class Inflater;
+
 //=============================================================================
 // PROTOCOL CONSTANTS
 // These values define the wire protocol. Changing them breaks compatibility.
@@ -65,15 +72,134 @@ constexpr uint32_t MIN_MESSAGE_SIZE = 0;
  */
 constexpr size_t HEADER_SIZE = sizeof(uint32_t);
 
+/**
+ * @brief Length-header bit marking a deflated payload (protocol v5)
+ * 
+ * The remaining bits still hold the length on the wire, which is bounded
+ * by MAX_MESSAGE_SIZE as before. A decoder that has not enabled
+ * compression sees a flagged header as an oversized length and fails
+ * closed.
+ */
+constexpr uint32_t COMPRESSED_FLAG = 0x80000000u;
+
+/**
+ * @brief Smallest payload worth deflating
+ * 
+ * Below this, the saved bytes do not pay for the deflate call.
+ */
+constexpr size_t COMPRESSION_THRESHOLD = 128;
+
 /**
  * @brief Timeout for blocking operations in milliseconds
  * 
  * SECURITY RATIONALE:
  * - Prevents indefinite blocking on slow/malicious clients
  * - Allows server to detect and disconnect unresponsive clients
+ * 
+ * The server also drops a heartbeat-capable connection that has sent
+ * nothing for this long.
  */
 constexpr int RECV_TIMEOUT_MS = 30000;  // 30 seconds
 
+/**
+ * @brief Wire protocol version spoken by this build
+ * 
+ * Exchanged in the HELLO/WELCOME handshake that opens every connection.
+ * Bump when the meaning of frames changes.
+ */
+constexpr uint32_t PROTOCOL_VERSION = 10;
+
+/**
+ * @brief First version whose requests use the binary Protocol::Wire envelope
+ * 
+ * Version 1 peers send requests as text commands.
+ */
+constexpr uint32_t ENVELOPE_PROTOCOL_VERSION = 2;
+
+/**
+ * @brief First version whose clients send Heartbeat requests while idle
+ * 
+ * Only these connections are subject to the RECV_TIMEOUT_MS idle cutoff;
+ * an older client that goes quiet is indistinguishable from one that died.
+ */
+constexpr uint32_t HEARTBEAT_PROTOCOL_VERSION = 3;
+
+/**
+ * @brief How often an idle client sends a Heartbeat
+ * 
+ * A third of the idle cutoff, so two heartbeats can be lost before the
+ * server gives up on the connection.
+ */
+constexpr int HEARTBEAT_INTERVAL_MS = RECV_TIMEOUT_MS / 3;
+
+/**
+ * @brief First version whose server answers data requests with response envelopes
+ * 
+ * From here on a client may keep many requests in flight and match each
+ * response to its request by requestId.
+ */
+constexpr uint32_t PIPELINE_PROTOCOL_VERSION = 4;
+
+/**
+ * @brief First version that may send COMPRESSED_FLAG frames
+ * 
+ * Both ends accept compressed frames once the handshake settles on this
+ * version (the HELLO and WELCOME themselves are never compressed).
+ */
+constexpr uint32_t COMPRESSION_PROTOCOL_VERSION = 5;
+
+/**
+ * @brief First version whose server streams long lists as StreamChunk responses
+ * 
+ * Message history and member lists may then exceed MAX_MESSAGE_SIZE in
+ * total; the client sees the first chunk before the rest has arrived.
+ */
+constexpr uint32_t STREAMING_PROTOCOL_VERSION = 6;
+
+/**
+ * @brief First version whose server answers SyncHistory requests
+ * 
+ * A reconnecting client then asks only for the messages after the newest
+ * one in its local cache instead of refetching the whole scrollback.
+ */
+constexpr uint32_t HISTORY_SYNC_PROTOCOL_VERSION = 7;
+
+/**
+ * @brief First version whose server answers LocateServer and accepts ShardBus peers
+ * 
+ * A client can then ask any node of a sharded deployment which node
+ * serves a given server (ShardMap.h).
+ */
+constexpr uint32_t SHARDING_PROTOCOL_VERSION = 8;
+
+/**
+ * @brief First version whose clients get presence as UserOnline/UserOffline pushes
+ * 
+ * Older clients keep getting the "[SERVER]: X has joined the server."
+ * text lines. Either way only the user's friends and fellow members of
+ * the hosted server are told.
+ */
+constexpr uint32_t PRESENCE_PROTOCOL_VERSION = 9;
+
+/**
+ * @brief First version whose server hands out attachment tickets
+ * 
+ * The file bytes never travel in chat frames: RequestAttachment returns a
+ * ticket for a separate transfer connection (AttachmentServer.h), so a
+ * large upload cannot hold up chat traffic behind it.
+ */
+constexpr uint32_t ATTACHMENT_PROTOCOL_VERSION = 10;
+
+/**
+ * @brief Oldest protocol version this build still accepts from a peer
+ */
+constexpr uint32_t MIN_PROTOCOL_VERSION = 1;
+
+/**
+ * @brief How long a connecting client waits for the server's WELCOME
+ */
+constexpr int HANDSHAKE_TIMEOUT_MS = 5000;
+
 //=============================================================================
 // RESULT TYPES
 // Explicit error handling - no silent failures
@@ -92,7 +218,7 @@ enum class Result {
     Timeout,            ///< Operation timed out
     MessageTooLarge,    ///< Message exceeds MAX_MESSAGE_SIZE
     InvalidLength,      ///< Received length header is invalid/suspicious
-    NetworkError,       ///< Winsock error occurred (check WSAGetLastError)
+    NetworkError,       ///< Socket error occurred (check LastSocketError)
     BufferError         ///< Memory allocation or buffer operation failed
 };
 
@@ -123,6 +249,16 @@ const char* ResultToString(Result result);
  */
 Result SendMessage(SOCKET socket, const std::string& message);
 
+/**
+ * @brief Send a frame already encoded by FrameBuffer (e.g. compressed)
+ * 
+ * @param socket    The connected socket to send on
+ * @param frame     Framed bytes, length prefix included
+ * @return          Result::Success, or MessageTooLarge for an empty or
+ *                  unframed buffer
+ */
+Result SendFrame(SOCKET socket, const FrameBuffer& frame);
+
 /**
  * @brief Receive a complete message with length prefix
  * 
@@ -132,6 +268,9 @@ Result SendMessage(SOCKET socket, const std::string& message);
  * - Will not allocate more than MAX_MESSAGE_SIZE bytes
  * - Times out on slow/stalled connections
  * 
+ * NOTE: On non-blocking sockets a partially received frame makes this
+ * wait for the remainder. Use the FrameDecoder overload there.
+ * 
  * @param socket    The connected socket to receive from
  * @param message   Output: the received message (cleared on error)
  * @return          Result::Success or error code
@@ -141,6 +280,215 @@ Result SendMessage(SOCKET socket, const std::string& message);
  */
 Result ReceiveMessage(SOCKET socket, std::string& message);
 
+//=============================================================================
+// STREAMING FRAME DECODER
+// Incremental, non-blocking reassembly of length-prefixed frames
+//=============================================================================
+
+/**
+ * @brief Per-connection incremental frame decoder
+ * 
+ * PROBLEM:
+ * RecvExact() must wait for the rest of a frame once it has started one.
+ * On a non-blocking socket that means spinning, so a peer that sends
+ * 3 of the 4 header bytes and stops can stall the caller indefinitely
+ * (slowloris).
+ * 
+ * SOLUTION:
+ * Accept whatever recv() returns into a reusable ring buffer and emit
+ * frames only once they are complete. The decoder never sleeps and never
+ * blocks; partial frames simply stay buffered until more bytes arrive.
+ * 
+ * MEMORY:
+ * The ring starts at INITIAL_CAPACITY and doubles on demand up to
+ * MAX_CAPACITY, which always fits one maximum-size frame plus header.
+ * Idle connections therefore cost nothing until they send data.
+ * 
+ * USAGE:
+ *   decoder.ReadFrom(socket);
+ *   while (decoder.NextFrame(msg) == Result::Success) { handle(msg); }
+ * 
+ * EXTERNAL INPUT:
+ * When an I/O backend receives on the decoder's behalf (io_uring multishot
+ * receives), SetExternalInput() stops ReadFrom() from calling recv(): a
+ * second reader on the socket would reorder the stream. Bytes then come
+ * only from Feed(), and what does not fit in the ring waits in a backlog
+ * of up to MAX_BACKLOG bytes until frames are taken out.
+ * 
+ * ATTACKER-CONTROLLED: Every byte fed into the decoder.
+ */
+class FrameDecoder {
+public:
+    /** Initial ring size, allocated lazily on first data */
+    static constexpr size_t INITIAL_CAPACITY = 4096;
+    
+    /** Hard ceiling: smallest power of two holding header + MAX_MESSAGE_SIZE */
+    static constexpr size_t MAX_CAPACITY = 131072;
+    
+    static_assert(MAX_CAPACITY >= HEADER_SIZE + MAX_MESSAGE_SIZE,
+                  "Decoder ring must fit one maximum-size frame");
+    
+    /** External input only: bytes held beyond a full ring */
+    static constexpr size_t MAX_BACKLOG = 2 * MAX_CAPACITY;
+    
+    FrameDecoder();
+    ~FrameDecoder();
+    
+    /**
+     * @brief Pull everything currently readable from a non-blocking socket
+     * 
+     * Reads until recv() would block or the ring is full, whichever comes
+     * first. Never waits for more data.
+     * 
+     * @return Success if bytes were buffered, WouldBlock if none were
+     *         available, Disconnected if the peer closed before sending
+     *         anything new, NetworkError on socket failure
+     */
+    Result ReadFrom(SOCKET socket);
+    
+    /**
+     * @brief Append bytes obtained elsewhere (e.g. an overlapped receive)
+     * @return Success, or BufferError if the ring (and, with external
+     *         input, the backlog) cannot hold them
+     */
+    Result Feed(const void* data, size_t length);
+    
+    /** @brief The peer closed; NextFrame() reports Disconnected once buffered frames are out */
+    void FeedEnd() { m_peerClosed = true; }
+    
+    /** @brief Take bytes from Feed() only; ReadFrom() stops reading the socket */
+    void SetExternalInput() { m_externalInput = true; }
+    
+    /**
+     * @brief Extract the next complete frame, if any
+     * 
+     * @param message Output: payload of the frame
+     * @return Success if a frame was produced, WouldBlock if more bytes are
+     *         needed, Disconnected if the peer closed mid-stream,
+     *         MessageTooLarge if the header is hostile, InvalidLength if a
+     *         compressed payload does not inflate (drop the connection)
+     */
+    Result NextFrame(std::string& message);
+    
+    /**
+     * @brief NextFrame() into a pooled block instead of a string
+     * 
+     * The frame's block is kept when it is big enough, and otherwise
+     * swapped for one of the right size class, so a steady stream of
+     * frames costs no allocation. BufferError if no block can be had.
+     */
+    Result NextFrame(PooledFrame& frame);
+    
+    /**
+     * @brief Accept COMPRESSED_FLAG frames from now on
+     * 
+     * Call once the connection has negotiated COMPRESSION_PROTOCOL_VERSION.
+     * The inflater is created with the first compressed frame.
+     */
+    void EnableCompression() { m_compression = true; }
+    
+    /** @brief Bytes currently buffered (complete or partial frames) */
+    size_t Buffered() const { return m_size; }
+    
+    /** @brief Discard all buffered data and start over */
+    void Reset();
+
+private:
+    enum class State { ReadingHeader, ReadingPayload, Failed };
+    
+    State m_state;
+    uint32_t m_payloadLength;
+    bool m_peerClosed;
+    bool m_externalInput = false;
+    bool m_compression;
+    bool m_payloadCompressed;
+    std::unique_ptr<Inflater> m_inflater;
+    std::string m_compressed;   // Deflated payload being inflated
+    std::string m_inflated;     // Inflated payload on its way into a PooledFrame
+    
+    std::vector<char> m_ring;
+    size_t m_head;   // Index of first buffered byte
+    size_t m_size;   // Number of buffered bytes
+    std::string m_backlog;      // External input beyond a full ring
+    
+    bool ensureWritable();
+    size_t fill(const char* data, size_t length);
+    void refill();
+    void copyOut(char* destination, size_t length) const;
+    void consume(size_t length);
+    Result awaitPayload();
+    void takePayload(char* destination);
+    Result inflateFrame(std::string& message);
+};
+
+/**
+ * @brief Receive a complete message through a connection's frame decoder
+ * 
+ * Non-blocking replacement for ReceiveMessage(): returns any frame that is
+ * already buffered, otherwise reads what the socket has and tries again.
+ * A partially received frame yields WouldBlock instead of a busy-wait.
+ * 
+ * @param socket    The connected (non-blocking) socket
+ * @param decoder   The decoder that owns this connection's partial data
+ * @param message   Output: the received message (cleared on error)
+ * @return          Result::Success or error code
+ */
+Result ReceiveMessage(SOCKET socket, FrameDecoder& decoder, std::string& message);
+
+/**
+ * @brief ReceiveMessage() into a pooled block (see FrameDecoder::NextFrame)
+ */
+Result ReceiveMessage(SOCKET socket, FrameDecoder& decoder, PooledFrame& frame);
+
+//=============================================================================
+// VERSION NEGOTIATION
+// First frame in each direction on a new connection
+//=============================================================================
+
+/**
+ * Handshake:
+ *   client -> server   "HELLO <clientVersion> <username>"
+ *   server -> client   "WELCOME <negotiatedVersion>"   (or a [SERVER]: rejection)
+ * 
+ * The negotiated version is the lower of the two peers' versions; a
+ * connection is refused if that falls below either side's minimum.
+ * A legacy client that sends its username unframed never produces a
+ * valid length header and is dropped by the decoder.
+ */
+
+/**
+ * @brief Build the client's opening frame payload
+ */
+std::string BuildHello(uint32_t version, const std::string& username);
+
+/**
+ * @brief Parse a HELLO payload
+ * 
+ * @param payload   Received frame (ATTACKER-CONTROLLED)
+ * @param version   Output: version offered by the client
+ * @param username  Output: claimed username (still needs validation)
+ * @return          True if the payload is well-formed
+ */
+bool ParseHello(std::string_view payload, uint32_t& version, std::string& username);
+
+/**
+ * @brief Build the server's handshake acceptance payload
+ */
+std::string BuildWelcome(uint32_t version);
+
+/**
+ * @brief Parse a WELCOME payload
+ * @return True if the payload is well-formed
+ */
+bool ParseWelcome(const std::string& payload, uint32_t& version);
+
+/**
+ * @brief Pick the version to speak with a peer
+ * @param peerVersion Version the peer offered
+ * @return The negotiated version, or 0 if the peers are incompatible
+ */
+uint32_t NegotiateVersion(uint32_t peerVersion);
+
 //=============================================================================
 // LOW-LEVEL HELPERS
 // Used internally; exposed for testing and edge cases
@@ -0,0 +1,94 @@
+/**
+ * @file OutboundQueue.cpp
+ * @brief Implementation of the per-connection send queue
+ */
+
+#include "OutboundQueue.h"
+#include <algorithm>
+#include <climits>
+
+OutboundQueue::EnqueueResult OutboundQueue::Enqueue(Buffer bytes) {
+    if (!bytes || bytes.empty()) {
+        return EnqueueResult::Queued;
+    }
+
+    // How far behind the client is: what waits for it plus what it already missed
+    if (m_pendingBytes + m_droppedBytes + bytes.size() > m_limits.disconnectWatermark) {
+        return EnqueueResult::OverLimit;
+    }
+
+    if (m_pendingBytes + bytes.size() > m_limits.dropWatermark) {
+        ++m_droppedFrames;
+        m_droppedBytes += bytes.size();
+        return EnqueueResult::Dropped;
+    }
+
+    m_pendingBytes += bytes.size();
+    m_frames.push_back(std::move(bytes));
+    return EnqueueResult::Queued;
+}
+
+size_t OutboundQueue::PrepareBatch(std::vector<WSABUF>& outBuffers, std::vector<Buffer>& outKeepAlive) {
+    outBuffers.clear();
+    outKeepAlive.clear();
+
+    if (m_inFlight || m_frames.empty()) {
+        return 0;
+    }
+
+    size_t total = 0;
+    size_t count = (std::min)(m_frames.size(), MAX_BATCH_BUFFERS);
+
+    for (size_t i = 0; i < count; ++i) {
+        const Buffer& frame = m_frames[i];
+        size_t offset = (i == 0) ? m_headOffset : 0;
+        size_t length = frame.size() - offset;
+
+        // WSABUF lengths are ULONG; a frame never comes close, but stay safe
+        if (length > ULONG_MAX || total + length > static_cast<size_t>(INT_MAX)) {
+            break;
+        }
+
+        WSABUF buffer;
+        buffer.buf = const_cast<char*>(frame.data() + offset);   // WSABUF is non-const; never written
+        buffer.len = static_cast<decltype(buffer.len)>(length);
+        outBuffers.push_back(buffer);
+        outKeepAlive.push_back(frame);
+        total += length;
+    }
+
+    m_inFlight = total > 0;
+    return total;
+}
+
+void OutboundQueue::OnSent(size_t bytesSent) {
+    m_inFlight = false;
+    bytesSent = (std::min)(bytesSent, m_pendingBytes);
+    m_pendingBytes -= bytesSent;
+
+    // Pop fully written frames; a short write leaves an offset into the head
+    while (bytesSent > 0 && !m_frames.empty()) {
+        size_t remainingInHead = m_frames.front().size() - m_headOffset;
+        if (bytesSent >= remainingInHead) {
+            bytesSent -= remainingInHead;
+            m_frames.pop_front();
+            m_headOffset = 0;
+        } else {
+            m_headOffset += bytesSent;
+            bytesSent = 0;
+        }
+    }
+
+    // Caught up: earlier drops no longer count against it
+    if (m_pendingBytes == 0) {
+        m_droppedBytes = 0;
+    }
+}
+
+void OutboundQueue::Clear() {
+    m_frames.clear();
+    m_headOffset = 0;
+    m_pendingBytes = 0;
+    m_droppedBytes = 0;
+    m_inFlight = false;
+}
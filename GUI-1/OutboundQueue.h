@@ -0,0 +1,113 @@
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+// Prevent Windows min/max macros from conflicting with std::min/std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+/**
+ * @file OutboundQueue.h
+ * @brief Per-connection send queue with scatter/gather batching
+ *
+ * PURPOSE:
+ * Broadcasting used to call send() synchronously for every client, and a
+ * single client with a full TCP window stalled delivery to everyone after
+ * it. Each server-side connection now owns an OutboundQueue: broadcasts
+ * only append to it, and the server flushes it with one overlapped
+ * WSASend per batch once the previous batch has completed.
+ *
+ * BATCHING:
+ * PrepareBatch() gathers as many queued frames as fit in one WSABUF array,
+ * so a burst of N small messages usually leaves in a single system call.
+ *
+ * SLOW CONSUMERS:
+ * - Above dropWatermark, new frames are dropped (the client misses lines
+ *   but the server stays healthy)
+ * - Once queued plus dropped bytes pass disconnectWatermark, the caller is
+ *   told to disconnect the client. Dropped bytes count until the queue
+ *   next drains, so a client that stops reading is cut off after missing
+ *   that much, not left dropping every broadcast forever
+ *
+ * THREADING:
+ * Not thread-safe; owned by the server network thread.
+ */
+
+#include "NetPlatform.h"
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+#include "FrameBuffer.h"
+
+class OutboundQueue {
+public:
+    /** Shared, immutable bytes ready for the wire (encoded once per broadcast) */
+    using Buffer = NetProtocol::FrameBuffer;
+
+    /** Upper bound on WSABUF entries per WSASend call */
+    static constexpr size_t MAX_BATCH_BUFFERS = 64;
+
+    struct Limits {
+        size_t dropWatermark = 256 * 1024;        ///< Queue size above which new frames are dropped
+        size_t disconnectWatermark = 1024 * 1024; ///< Queued + dropped bytes above which the client is cut off
+    };
+
+    enum class EnqueueResult {
+        Queued,         ///< Frame accepted
+        Dropped,        ///< Consumer is slow; frame discarded
+        OverLimit       ///< Consumer is hopeless; caller should disconnect
+    };
+
+    OutboundQueue() = default;
+
+    void SetLimits(const Limits& limits) { m_limits = limits; }
+    const Limits& GetLimits() const { return m_limits; }
+
+    /**
+     * @brief Append bytes to the queue
+     * @param bytes Data to send; shared so broadcasts need not copy it
+     */
+    EnqueueResult Enqueue(Buffer bytes);
+
+    /**
+     * @brief Gather queued data for one scatter/gather send
+     *
+     * Does nothing if a batch is already in flight.
+     *
+     * @param outBuffers Filled with WSABUFs pointing into queued frames
+     * @param outKeepAlive Filled with the frames referenced by outBuffers;
+     *                     must stay alive until the send completes
+     * @return Number of bytes in the batch (0 = nothing to send)
+     */
+    size_t PrepareBatch(std::vector<WSABUF>& outBuffers, std::vector<Buffer>& outKeepAlive);
+
+    /**
+     * @brief Account for a completed send of the in-flight batch
+     * @param bytesSent Bytes the kernel reported as written
+     */
+    void OnSent(size_t bytesSent);
+
+    /** @brief Forget the in-flight batch (used when the send failed) */
+    void AbortInFlight() { m_inFlight = false; }
+
+    bool HasPending() const { return m_pendingBytes > 0; }
+    bool InFlight() const { return m_inFlight; }
+    size_t PendingBytes() const { return m_pendingBytes; }
+    size_t DroppedFrames() const { return m_droppedFrames; }
+    size_t DroppedBytesSinceDrained() const { return m_droppedBytes; }
+
+    /** @brief Discard everything (connection is going away) */
+    void Clear();
+
+private:
+    std::deque<Buffer> m_frames;
+    size_t m_headOffset = 0;     // Bytes of m_frames.front() already sent
+    size_t m_pendingBytes = 0;   // Unsent bytes across all frames
+    size_t m_droppedFrames = 0;
+    size_t m_droppedBytes = 0;   // Dropped since the queue was last empty
+    bool m_inFlight = false;
+    Limits m_limits;
+};
+
+#endif // OUTBOUND_QUEUE_H
@@ -0,0 +1,283 @@
+/**
+ * @file PasswordHasher.cpp
+ * @brief Implementation of the password hashing pool
+ */
+
+#include "PasswordHasher.h"
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <bcrypt.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#pragma comment(lib, "bcrypt.lib")
+
+namespace {
+
+const char* const PBKDF2_PREFIX = "pbkdf2-sha256$";
+const size_t DERIVED_KEY_SIZE = 32;
+const size_t MAX_DEFAULT_WORKERS = 4;
+
+bool Succeeded(NTSTATUS status) {
+    return status >= 0;
+}
+
+std::string ToHex(const unsigned char* data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(length * 2, '\0');
+    for (size_t i = 0; i < length; ++i) {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 0x0F];
+    }
+    return hex;
+}
+
+// Iterations of a "pbkdf2-sha256$<n>$<hex>" hash; 0 if not in that format
+uint32_t ParseIterations(const std::string& stored, size_t& digestStart) {
+    size_t prefixLength = std::strlen(PBKDF2_PREFIX);
+    if (stored.compare(0, prefixLength, PBKDF2_PREFIX) != 0) {
+        return 0;
+    }
+    size_t separator = stored.find('$', prefixLength);
+    if (separator == std::string::npos || separator == prefixLength) {
+        return 0;
+    }
+    unsigned long long rounds = 0;
+    for (size_t i = prefixLength; i < separator; ++i) {
+        if (stored[i] < '0' || stored[i] > '9' || rounds > UINT32_MAX / 10) {
+            return 0;
+        }
+        rounds = rounds * 10 + static_cast<unsigned>(stored[i] - '0');
+    }
+    if (rounds > UINT32_MAX) {
+        return 0;
+    }
+    digestStart = separator + 1;
+    return static_cast<uint32_t>(rounds);
+}
+
+bool ConstantTimeEquals(const char* a, const char* b, size_t length) {
+    volatile unsigned char difference = 0;
+    for (size_t i = 0; i < length; ++i) {
+        difference |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return difference == 0;
+}
+
+} // namespace
+
+//=============================================================================
+// TIMINGS
+//=============================================================================
+
+uint64_t PasswordHasher::Timings::PercentileMicros(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(fraction * static_cast<double>(count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen > target || seen == count) {
+            return (std::min)(uint64_t(1) << i, maxMicros);
+        }
+    }
+    return maxMicros;
+}
+
+//=============================================================================
+// CONSTRUCTION
+//=============================================================================
+
+PasswordHasher::PasswordHasher(size_t workerCount) {
+    BCRYPT_ALG_HANDLE handle = nullptr;
+    if (Succeeded(BCryptOpenAlgorithmProvider(&handle, BCRYPT_SHA256_ALGORITHM, nullptr,
+                                              BCRYPT_ALG_HANDLE_HMAC_FLAG))) {
+        hmacAlgorithm = handle;
+    } else {
+        printf("[AUTH] HMAC-SHA256 provider unavailable; password hashing disabled\n");
+    }
+    handle = nullptr;
+    if (Succeeded(BCryptOpenAlgorithmProvider(&handle, BCRYPT_SHA256_ALGORITHM, nullptr, 0))) {
+        shaAlgorithm = handle;
+    }
+
+    if (workerCount == 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        workerCount = (std::min)(MAX_DEFAULT_WORKERS, static_cast<size_t>(cores > 1 ? cores - 1 : 1));
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&PasswordHasher::Run, this);
+    }
+}
+
+PasswordHasher::~PasswordHasher() {
+    Stop();
+    if (hmacAlgorithm) {
+        BCryptCloseAlgorithmProvider(static_cast<BCRYPT_ALG_HANDLE>(hmacAlgorithm), 0);
+    }
+    if (shaAlgorithm) {
+        BCryptCloseAlgorithmProvider(static_cast<BCRYPT_ALG_HANDLE>(shaAlgorithm), 0);
+    }
+}
+
+void PasswordHasher::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping && workers.empty()) {
+            return;
+        }
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+void PasswordHasher::SetIterations(uint32_t rounds) {
+    iterations = (std::max)(rounds, MIN_ITERATIONS);
+}
+
+//=============================================================================
+// HASHING
+//=============================================================================
+
+std::string PasswordHasher::derive(const std::string& password, const std::string& salt, uint32_t rounds) const {
+    if (!hmacAlgorithm) {
+        return "";
+    }
+
+    unsigned char key[DERIVED_KEY_SIZE];
+    NTSTATUS status = BCryptDeriveKeyPBKDF2(
+        static_cast<BCRYPT_ALG_HANDLE>(hmacAlgorithm),
+        reinterpret_cast<PUCHAR>(const_cast<char*>(password.data())), static_cast<ULONG>(password.size()),
+        reinterpret_cast<PUCHAR>(const_cast<char*>(salt.data())), static_cast<ULONG>(salt.size()),
+        rounds, key, sizeof(key), 0);
+    if (!Succeeded(status)) {
+        return "";
+    }
+
+    std::string hex = ToHex(key, sizeof(key));
+    SecureZeroMemory(key, sizeof(key));
+    return hex;
+}
+
+std::string PasswordHasher::legacyHash(const std::string& password, const std::string& salt) const {
+    if (!shaAlgorithm) {
+        return "";
+    }
+
+    BCRYPT_HASH_HANDLE hash = nullptr;
+    if (!Succeeded(BCryptCreateHash(static_cast<BCRYPT_ALG_HANDLE>(shaAlgorithm), &hash,
+                                    nullptr, 0, nullptr, 0, 0))) {
+        return "";
+    }
+
+    unsigned char digest[DERIVED_KEY_SIZE];
+    bool ok = Succeeded(BCryptHashData(hash, reinterpret_cast<PUCHAR>(const_cast<char*>(salt.data())),
+                                       static_cast<ULONG>(salt.size()), 0)) &&
+              Succeeded(BCryptHashData(hash, reinterpret_cast<PUCHAR>(const_cast<char*>(password.data())),
+                                       static_cast<ULONG>(password.size()), 0)) &&
+              Succeeded(BCryptFinishHash(hash, digest, sizeof(digest), 0));
+    BCryptDestroyHash(hash);
+
+    return ok ? ToHex(digest, sizeof(digest)) : "";
+}
+
+std::string PasswordHasher::Hash(const std::string& password, const std::string& salt) const {
+    uint32_t rounds = iterations.load();
+    std::string digest = derive(password, salt, rounds);
+    if (digest.empty()) {
+        return "";
+    }
+    return PBKDF2_PREFIX + std::to_string(rounds) + "$" + digest;
+}
+
+bool PasswordHasher::Verify(const std::string& password, const std::string& salt, const std::string& stored) const {
+    size_t digestStart = 0;
+    uint32_t rounds = ParseIterations(stored, digestStart);
+
+    std::string expected;
+    std::string computed;
+    if (rounds != 0) {
+        expected = stored.substr(digestStart);
+        computed = derive(password, salt, rounds);
+    } else {
+        expected = stored;
+        computed = legacyHash(password, salt);
+    }
+
+    // SECURITY: constant-time comparison; lengths are not secret
+    return !computed.empty() && computed.size() == expected.size() &&
+           ConstantTimeEquals(computed.data(), expected.data(), computed.size());
+}
+
+bool PasswordHasher::NeedsRehash(const std::string& stored) const {
+    size_t digestStart = 0;
+    return ParseIterations(stored, digestStart) < iterations.load();
+}
+
+//=============================================================================
+// WORKER POOL
+//=============================================================================
+
+bool PasswordHasher::Submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping || workers.empty() || pending >= MAX_PENDING) {
+            return false;
+        }
+        queue.push_back({ std::move(job), Clock::now() });
+        ++pending;
+    }
+    jobAvailable.notify_one();
+    return true;
+}
+
+void PasswordHasher::Run() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            jobAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;     // Stopping, and everything queued has run
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        job.work();
+        recordTiming(Clock::now() - job.queuedAt);
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        --pending;
+    }
+}
+
+void PasswordHasher::recordTiming(Clock::duration elapsed) {
+    uint64_t micros = static_cast<uint64_t>(
+        (std::max)(static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()), 0LL));
+    size_t bucket = 0;
+    while (bucket + 1 < Timings::BUCKETS && (uint64_t(1) << bucket) <= micros) {
+        ++bucket;
+    }
+
+    std::lock_guard<std::mutex> lock(timingsMutex);
+    ++timings.count;
+    ++timings.buckets[bucket];
+    timings.maxMicros = (std::max)(timings.maxMicros, micros);
+}
+
+PasswordHasher::Timings PasswordHasher::GetTimings() const {
+    std::lock_guard<std::mutex> lock(timingsMutex);
+    return timings;
+}
@@ -0,0 +1,140 @@
+#ifndef PASSWORD_HASHER_H
+#define PASSWORD_HASHER_H
+
+/**
+ * @file PasswordHasher.h
+ * @brief Password key derivation with a tunable cost, run on a bounded worker pool
+ *
+ * PURPOSE:
+ * UserDatabase used to hash passwords inline: one unsalted-cost SHA-256,
+ * with a fresh CryptoAPI provider per call, on the calling (UI) thread and
+ * under databaseMutex. A login storm therefore froze the UI and blocked
+ * every other database read. Hashing now runs here, outside the database
+ * lock, and can be queued on worker threads.
+ *
+ * HASH FORMAT:
+ * - "pbkdf2-sha256$<iterations>$<hex>": PBKDF2-HMAC-SHA256 over the salt
+ * - 64 hex digits with no prefix: legacy SHA-256(salt + password). Still
+ *   accepted by Verify(); NeedsRehash() reports it so callers can upgrade
+ *   it after the next successful login
+ *
+ * DESIGN:
+ * - The CNG algorithm handles are opened once and shared by every thread
+ * - WorkerCount() threads take jobs from a queue capped at MAX_PENDING;
+ *   Submit() refuses work beyond that instead of queueing without bound
+ * - Each job's queue wait plus run time is recorded in a log2 histogram
+ *
+ * THREADING:
+ * Every method may be called from any thread. Jobs run on the workers.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class PasswordHasher {
+public:
+    /** PBKDF2 iterations for new hashes unless SetIterations() says otherwise */
+    static constexpr uint32_t DEFAULT_ITERATIONS = 100000;
+
+    /** Hashes are refused below this cost */
+    static constexpr uint32_t MIN_ITERATIONS = 10000;
+
+    /** Jobs waiting or running before Submit() starts refusing */
+    static constexpr size_t MAX_PENDING = 256;
+
+    /**
+     * @brief Job latency histogram (queue wait + run time)
+     */
+    struct Timings {
+        static constexpr size_t BUCKETS = 32;
+        uint64_t count = 0;
+        uint64_t buckets[BUCKETS] = {};     // Bucket i: under 2^i microseconds
+        uint64_t maxMicros = 0;
+
+        /** @brief Upper bound of the bucket holding the given fraction (0..1) of jobs */
+        uint64_t PercentileMicros(double fraction) const;
+    };
+
+    /**
+     * @param workers Worker threads (0 = one per spare core, at most 4)
+     */
+    explicit PasswordHasher(size_t workers = 0);
+
+    /** Same as Stop() */
+    ~PasswordHasher();
+
+    /**
+     * @brief Run the jobs already queued, then join the workers (idempotent)
+     *
+     * Call this before destroying anything the queued jobs use.
+     */
+    void Stop();
+
+    void SetIterations(uint32_t iterations);
+    uint32_t Iterations() const { return iterations.load(); }
+    size_t WorkerCount() const { return workers.size(); }
+
+    /**
+     * @brief Hash a password at the current cost
+     * @return Encoded hash, or an empty string if CNG is unavailable
+     */
+    std::string Hash(const std::string& password, const std::string& salt) const;
+
+    /**
+     * @brief Check a password against a stored hash in either format
+     */
+    bool Verify(const std::string& password, const std::string& salt, const std::string& stored) const;
+
+    /**
+     * @brief True if the stored hash is legacy or below the current cost
+     */
+    bool NeedsRehash(const std::string& stored) const;
+
+    /**
+     * @brief Queue work for a worker thread
+     * @return False if MAX_PENDING jobs are already queued or the pool is stopped
+     */
+    bool Submit(std::function<void()> job);
+
+    Timings GetTimings() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job {
+        std::function<void()> work;
+        Clock::time_point queuedAt;
+    };
+
+    void* hmacAlgorithm = nullptr;      // BCRYPT_ALG_HANDLE, HMAC-SHA256 (PBKDF2)
+    void* shaAlgorithm = nullptr;       // BCRYPT_ALG_HANDLE, SHA-256 (legacy hashes)
+    std::atomic<uint32_t> iterations{ DEFAULT_ITERATIONS };
+
+    mutable std::mutex queueMutex;
+    std::condition_variable jobAvailable;
+    std::deque<Job> queue;
+    size_t pending = 0;                 // Queued plus running
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    mutable std::mutex timingsMutex;
+    Timings timings;
+
+    std::string derive(const std::string& password, const std::string& salt, uint32_t rounds) const;
+    std::string legacyHash(const std::string& password, const std::string& salt) const;
+    void recordTiming(Clock::duration elapsed);
+    void Run();
+
+    PasswordHasher(const PasswordHasher&) = delete;
+    PasswordHasher& operator=(const PasswordHasher&) = delete;
+};
+
+#endif // PASSWORD_HASHER_H
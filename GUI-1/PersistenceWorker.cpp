@@ -0,0 +1,257 @@
+/**
+ * @file PersistenceWorker.cpp
+ * @brief Implementation of the background group-commit worker
+ */
+
+#include "PersistenceWorker.h"
+#include "Trace.h"
+#include "Log.h"
+#define NOMINMAX
+#include <Windows.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Store {
+        std::string name;
+        std::function<bool()> save;
+        bool dirty = false;             // Changed since the last save started
+        bool saving = false;            // save() is running on the worker
+        bool flushRequested = false;    // Write without waiting for the window
+        uint32_t changes = 0;           // MarkDirty() calls while dirty
+        Clock::time_point firstChange;
+        uint64_t completedSaves = 0;
+        bool lastSaveOk = true;
+    };
+
+    std::mutex workerMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable saveFinished;
+    std::map<uint64_t, Store> stores;
+    uint64_t nextStoreId = 1;
+
+    // A worker exits once the epoch moves past the one it was started with,
+    // so a thread being stopped never picks up a newly started worker's stores
+    std::thread workerThread;
+    uint64_t workerEpoch = 0;
+
+    // Recorded by the worker without workerMutex; read by metrics snapshots
+    LatencyHistogram saveTimings;
+
+    /**
+     * @brief completedSaves value at which everything unsaved now is on disk
+     */
+    uint64_t SaveTarget(const Store& store) {
+        return store.completedSaves + (store.saving ? 1 : 0) + (store.dirty ? 1 : 0);
+    }
+}
+
+//=============================================================================
+// HANDLE
+//=============================================================================
+
+PersistenceWorker::Handle::Handle(const std::string& name, std::function<bool()> save) {
+    std::lock_guard<std::mutex> lock(workerMutex);
+
+    id = nextStoreId++;
+    Store& store = stores[id];
+    store.name = name;
+    store.save = std::move(save);
+
+    if (!workerThread.joinable()) {
+        workerThread = std::thread(&PersistenceWorker::Run, workerEpoch);
+    }
+}
+
+PersistenceWorker::Handle::~Handle() {
+    Close();
+}
+
+void PersistenceWorker::Handle::MarkDirty() {
+    std::lock_guard<std::mutex> lock(workerMutex);
+
+    auto it = stores.find(id);
+    if (it == stores.end()) {
+        return;
+    }
+
+    Store& store = it->second;
+    if (!store.dirty) {
+        store.dirty = true;
+        store.changes = 0;
+        store.firstChange = Clock::now();
+        workAvailable.notify_one();     // Worker must schedule this store's window
+    }
+    if (++store.changes == MAX_BATCHED_CHANGES) {
+        workAvailable.notify_one();
+    }
+}
+
+bool PersistenceWorker::Handle::Flush() {
+    std::unique_lock<std::mutex> lock(workerMutex);
+
+    auto it = stores.find(id);
+    if (it == stores.end()) {
+        return true;
+    }
+
+    Store& store = it->second;
+    uint64_t target = SaveTarget(store);
+    if (store.dirty) {
+        store.flushRequested = true;
+        workAvailable.notify_one();
+    }
+    saveFinished.wait(lock, [&] { return store.completedSaves >= target; });
+    return store.lastSaveOk;
+}
+
+void PersistenceWorker::Handle::Close() {
+    if (id == 0) {
+        return;
+    }
+    Flush();
+
+    std::thread finished;
+    {
+        std::unique_lock<std::mutex> lock(workerMutex);
+
+        // A change marked after the flush may be saving right now
+        Store& store = stores[id];
+        saveFinished.wait(lock, [&] { return !store.saving; });
+        stores.erase(id);
+        id = 0;
+
+        if (stores.empty()) {
+            ++workerEpoch;
+            workAvailable.notify_all();
+            finished = std::move(workerThread);
+        }
+    }
+
+    if (finished.joinable()) {
+        finished.join();
+    }
+}
+
+//=============================================================================
+// WORKER
+//=============================================================================
+
+bool PersistenceWorker::FlushAll() {
+    std::unique_lock<std::mutex> lock(workerMutex);
+
+    std::map<uint64_t, uint64_t> targets;
+    for (auto& [storeId, store] : stores) {
+        targets[storeId] = SaveTarget(store);
+        if (store.dirty) {
+            store.flushRequested = true;
+        }
+    }
+    workAvailable.notify_one();
+
+    bool allOk = true;
+    for (const auto& [storeId, target] : targets) {
+        saveFinished.wait(lock, [&] {
+            auto it = stores.find(storeId);
+            return it == stores.end() || it->second.completedSaves >= target;
+        });
+        auto it = stores.find(storeId);
+        if (it != stores.end() && !it->second.lastSaveOk) {
+            allOk = false;
+        }
+    }
+    return allOk;
+}
+
+void PersistenceWorker::Run(uint64_t epoch) {
+    Trace::SetThreadName("persistence");
+    std::unique_lock<std::mutex> lock(workerMutex);
+
+    while (epoch == workerEpoch) {
+        Clock::time_point now = Clock::now();
+        Clock::time_point nextDue = Clock::time_point::max();
+        Store* due = nullptr;
+
+        for (auto& [storeId, store] : stores) {
+            if (!store.dirty || store.saving) {
+                continue;
+            }
+            Clock::time_point when = (store.flushRequested || store.changes >= MAX_BATCHED_CHANGES)
+                ? now
+                : store.firstChange + COMMIT_WINDOW;
+            if (when <= now) {
+                due = &store;
+                break;
+            }
+            nextDue = (std::min)(nextDue, when);
+        }
+
+        if (!due) {
+            if (nextDue == Clock::time_point::max()) {
+                workAvailable.wait(lock);
+            } else {
+                workAvailable.wait_until(lock, nextDue);
+            }
+            continue;
+        }
+
+        // Changes marked from here on belong to the next save
+        due->dirty = false;
+        due->flushRequested = false;
+        due->changes = 0;
+        due->saving = true;
+
+        // Close() waits for saving to clear, so the store outlives the call
+        lock.unlock();
+        Clock::time_point saveStart = Clock::now();
+        bool ok = true;
+        if (due->save) {
+            TRACE_ZONE("PersistenceWorker::save");
+            ok = due->save();
+        }
+        saveTimings.Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - saveStart).count()));
+        lock.lock();
+
+        due->saving = false;
+        due->lastSaveOk = ok;
+        ++due->completedSaves;
+        if (!ok) {
+            LOG_WARNING("[PERSIST] Failed to save %s, retrying", due->name.c_str());
+            if (!due->dirty) {
+                due->dirty = true;
+                due->firstChange = Clock::now();
+            }
+        }
+        saveFinished.notify_all();
+    }
+}
+
+const LatencyHistogram& PersistenceWorker::SaveTimings() {
+    return saveTimings;
+}
+
+//=============================================================================
+// FILE HELPERS
+//=============================================================================
+
+bool PersistenceWorker::WriteXmlAtomically(const pugi::xml_document& doc, const std::string& path) {
+    std::string tempPath = path + ".tmp";
+    if (!doc.save_file(tempPath.c_str())) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    if (!MoveFileExA(tempPath.c_str(), path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        LOG_WARNING("[PERSIST] Failed to replace %s", path.c_str());
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
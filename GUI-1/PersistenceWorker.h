@@ -0,0 +1,105 @@
+#ifndef PERSISTENCE_WORKER_H
+#define PERSISTENCE_WORKER_H
+
+/**
+ * @file PersistenceWorker.h
+ * @brief Background group commit of service state to disk
+ *
+ * PURPOSE:
+ * Services used to rewrite their whole XML file inside every mutating
+ * call, on the UI thread and usually while holding their own mutex. A
+ * mutating call now only calls MarkDirty(); this worker writes each dirty
+ * store once per commit window, so a burst of changes costs one write.
+ *
+ * DESIGN:
+ * - One process-wide worker thread, started with the first Handle and
+ *   stopped after the last one closes
+ * - A store is written COMMIT_WINDOW after its first unsaved change, or
+ *   as soon as MAX_BATCHED_CHANGES have piled up
+ * - The save function runs on the worker thread; it snapshots state under
+ *   the service mutex and does the file I/O after releasing it
+ * - WriteXmlAtomically() writes a temp file and renames it over the old
+ *   one, so a crash mid-write never leaves a half-written file
+ *
+ * THREADING:
+ * MarkDirty() may be called from any thread, with or without the service
+ * mutex held. Flush() and Close() wait for the worker, so they must not
+ * be called while holding a mutex the save function takes.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "pugixml.hpp"
+#include "LatencyHistogram.h"
+
+class PersistenceWorker {
+public:
+    /** Delay between a store's first unsaved change and its write */
+    static constexpr std::chrono::milliseconds COMMIT_WINDOW{ 50 };
+
+    /** Unsaved changes that trigger a write before the window ends */
+    static constexpr uint32_t MAX_BATCHED_CHANGES = 64;
+
+    /**
+     * @brief One store's registration with the worker (owned by the service)
+     */
+    class Handle {
+    public:
+        /**
+         * @param name Used in log output
+         * @param save Writes the store; returns false to retry next window
+         */
+        Handle(const std::string& name, std::function<bool()> save);
+
+        /** @brief Same as Close() */
+        ~Handle();
+
+        /**
+         * @brief Record one unsaved change (cheap; never touches the disk)
+         */
+        void MarkDirty();
+
+        /**
+         * @brief Write now if anything is unsaved and wait for it
+         * @return False if the write failed
+         */
+        bool Flush();
+
+        /**
+         * @brief Flush, then unregister so the save function is never called again
+         *
+         * Call this first thing in the owning service's destructor, while
+         * everything the save function touches is still alive.
+         */
+        void Close();
+
+    private:
+        uint64_t id;
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+    };
+
+    /**
+     * @brief Write every dirty store now and wait (call on shutdown)
+     * @return False if any write failed
+     */
+    static bool FlushAll();
+
+    /**
+     * @brief Save an XML document via a temp file and an atomic rename
+     */
+    static bool WriteXmlAtomically(const pugi::xml_document& doc, const std::string& path);
+
+    /**
+     * @brief Duration of every save function call so far, in microseconds
+     */
+    static const LatencyHistogram& SaveTimings();
+
+private:
+    static void Run(uint64_t epoch);
+};
+
+#endif // PERSISTENCE_WORKER_H
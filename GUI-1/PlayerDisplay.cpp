@@ -1,11 +1,16 @@
 #include "PlayerDisplay.hpp"
+#include "Trace.h"
+#include "Log.h"
+#include <FL/Fl.H>
 #include <FL/fl_draw.H>
-#include <cstdio> // For printf debugging
+#include <algorithm>
+
+const char* const PlayerDisplay::HEADER_ROW = "Players:";
 
 /**
  * @brief Constructor for the PlayerDisplay class.
  *
- * Sets up the player list display and initializes the text buffer to hold player names.
+ * Sets up the player list view, starting with just the header row.
  *
  * @param X The X position of the display.
  * @param Y The Y position of the display.
@@ -13,14 +18,13 @@
  * @param H The height of the display.
  */
 PlayerDisplay::PlayerDisplay(int X, int Y, int W, int H)
-    : Fl_Group(X, Y, W, H), disp(nullptr), tbuff(nullptr) {
+    : Fl_Group(X, Y, W, H), sidePanel(nullptr), disp(nullptr) {
     begin();
 
-    // Create the text display widget for the player list
-    disp = new Fl_Text_Display(X + W / 2, Y, W / 2, H - 40); // Adjusted position and width
-    tbuff = new Fl_Text_Buffer(); // Create the text buffer
-    disp->buffer(tbuff); // Assign the text buffer to the display widget
-    tbuff->text("Players:\n"); // Initialize the player list with the header text
+    // Create the list widget for the player list
+    disp = new PlayerListView(X + W / 2, Y, W / 2, H - 40); // Adjusted position and width
+    rows.push_back(HEADER_ROW);
+    disp->rows(&rows);
 
     end(); // Finalize the group
 }
@@ -28,55 +32,57 @@ PlayerDisplay::PlayerDisplay(int X, int Y, int W, int H)
 /**
  * @brief Destructor for the PlayerDisplay class.
  *
- * Cleans up allocated widgets and memory.
+ * The list view is a child and is deleted by Fl_Group.
  */
 PlayerDisplay::~PlayerDisplay() {
-    delete disp;  // Clean up the text display widget
-    delete tbuff; // Clean up the text buffer
 }
 
 /**
  * @brief Adds a new player to the display.
  *
- * This method appends the player's username to the displayed player list.
+ * The name is inserted at its sorted position; a name that is already
+ * listed only gains another connection.
  *
  * @param username The username to add to the display.
  */
 void PlayerDisplay::addPlayer(const std::string& username) {
     // Debugging output to track the addition of a player
-    printf("Adding player: %s\n", username.c_str());
+    LOG_DEBUG("Adding player: %s", username.c_str());
 
-    // Append the username to the text buffer, followed by a newline
-    tbuff->append((username + "\n").c_str());
-    redraw(); // Redraw the widget to reflect the new player
+    auto inserted = connectionsByName.emplace(username, 0);
+    if (inserted.first->second++ == 0) {
+        auto pos = std::lower_bound(rows.begin() + 1, rows.end(), username);
+        rows.insert(pos, username);
+        disp->rowsChanged();
+    }
 }
 
 /**
  * @brief Removes a player from the display.
  *
- * This method searches for the player's username in the text buffer and removes it.
+ * Only an exact name match is removed, and only once its last
+ * connection has left.
  *
  * @param username The username to remove from the display.
  */
 void PlayerDisplay::removePlayer(const std::string& username) {
     // Debugging output to track the removal of a player
-    printf("Removing player: %s\n", username.c_str());
-
-    // Retrieve the current text from the buffer
-    const char* text = tbuff->text();
-    std::string bufferText(text); // Convert to a string for easier manipulation
-    size_t pos = bufferText.find(username); // Find the position of the username
-
-    // If the username is found, remove it along with the newline character
-    if (pos != std::string::npos) {
-        size_t endPos = bufferText.find("\n", pos); // Find the end of the username line
-        if (endPos != std::string::npos) {
-            bufferText.erase(pos, endPos - pos + 1); // Remove the username and the newline
-            tbuff->text(bufferText.c_str()); // Update the text buffer with the modified text
-        }
+    LOG_DEBUG("Removing player: %s", username.c_str());
+
+    auto it = connectionsByName.find(username);
+    if (it == connectionsByName.end()) {
+        return;
+    }
+    if (--it->second > 0) {
+        return;
     }
+    connectionsByName.erase(it);
 
-    redraw(); // Redraw the widget after modifying the player list
+    auto pos = std::lower_bound(rows.begin() + 1, rows.end(), username);
+    if (pos != rows.end() && *pos == username) {
+        rows.erase(pos);
+    }
+    disp->rowsChanged();
 }
 
 /**
@@ -86,9 +92,10 @@ void PlayerDisplay::removePlayer(const std::string& username) {
  * disconnecting or starting a new session.
  */
 void PlayerDisplay::clearPlayers() {
-    printf("Clearing all players\n");
-    tbuff->text("Players:\n");  // Reset to header only
-    redraw();
+    LOG_DEBUG("Clearing all players");
+    connectionsByName.clear();
+    rows.resize(1);  // Reset to header only
+    disp->rowsChanged();
 }
 
 /**
@@ -101,3 +108,90 @@ void PlayerDisplay::updateLayout() {
     // Placeholder for future layout updates
     redraw(); // Redraw the widget
 }
+
+//=============================================================================
+// LIST VIEW
+//=============================================================================
+
+PlayerListView::PlayerListView(int X, int Y, int W, int H)
+    : Fl_Group(X, Y, W, H)
+    , rowSource(nullptr)
+    , scrollbar(nullptr)
+    , textColor(FL_FOREGROUND_COLOR)
+    , textFont(FL_HELVETICA)
+    , textSize(FL_NORMAL_SIZE)
+{
+    box(FL_DOWN_BOX);
+    color(FL_BACKGROUND2_COLOR);
+    scrollbar = new Fl_Scrollbar(X + W - Fl::scrollbar_size(), Y, Fl::scrollbar_size(), H);
+    scrollbar->callback(scrollbarCallback, this);
+    scrollbar->linesize(WHEEL_ROWS);
+    end();
+}
+
+void PlayerListView::rowsChanged() {
+    updateScrollbar();
+    redraw();
+}
+
+void PlayerListView::resize(int X, int Y, int W, int H) {
+    // Not Fl_Group::resize: the scrollbar is placed by hand
+    Fl_Widget::resize(X, Y, W, H);
+    scrollbar->resize(X + W - Fl::scrollbar_size(), Y, Fl::scrollbar_size(), H);
+    updateScrollbar();
+}
+
+int PlayerListView::rowHeight() const {
+    fl_font(textFont, textSize);
+    return (std::max)(1, fl_height());
+}
+
+int PlayerListView::visibleRows() const {
+    return (std::max)(1, (h() - 2 * MARGIN) / rowHeight());
+}
+
+void PlayerListView::updateScrollbar() {
+    int visible = visibleRows();
+    int total = (std::max)(static_cast<int>(rowCount()), visible);
+    int top = (std::min)((std::max)(scrollbar->value(), 0), total - visible);
+    scrollbar->value(top, visible, 0, total);
+}
+
+void PlayerListView::scrollbarCallback(Fl_Widget* widget, void* userdata) {
+    static_cast<PlayerListView*>(userdata)->redraw();
+}
+
+void PlayerListView::draw() {
+    TRACE_ZONE("PlayerListView::draw");
+    draw_box(box(), x(), y(), w(), h(), color());
+
+    int textAreaWidth = w() - scrollbar->w();
+    int textBottom = y() + h() - MARGIN;
+    fl_push_clip(x() + Fl::box_dx(box()), y() + Fl::box_dy(box()),
+                 textAreaWidth - Fl::box_dx(box()), h() - Fl::box_dh(box()));
+
+    int lineHeight = rowHeight();
+    int descent = fl_descent();
+    fl_color(active_r() ? textColor : fl_inactive(textColor));
+
+    // Only the rows that fit on screen are drawn
+    size_t row = static_cast<size_t>((std::max)(scrollbar->value(), 0));
+    for (int rowY = y() + MARGIN; row < rowCount() && rowY < textBottom; rowY += lineHeight, ++row) {
+        const std::string& text = (*rowSource)[row];
+        fl_draw(text.data(), static_cast<int>(text.size()), x() + MARGIN, rowY + lineHeight - descent);
+    }
+    fl_pop_clip();
+
+    draw_child(*scrollbar);
+}
+
+int PlayerListView::handle(int event) {
+    if (event == FL_MOUSEWHEEL && Fl::event_inside(this) && Fl::event_dy() != 0) {
+        int top = scrollbar->value() + Fl::event_dy() * WHEEL_ROWS;
+        scrollbar->value(top);
+        updateScrollbar();
+        redraw();
+        return 1;
+    }
+    return Fl_Group::handle(event);
+}
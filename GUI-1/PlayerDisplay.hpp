@@ -1,11 +1,73 @@
 #ifndef PLAYER_DISPLAY_HPP
 #define PLAYER_DISPLAY_HPP
 
+/**
+ * @file PlayerDisplay.hpp
+ * @brief Member list for the lobby
+ *
+ * PURPOSE:
+ * The list used to live in an Fl_Text_Buffer, so each leave copied the
+ * whole buffer, searched it for the name (matching "bob" inside "bobby")
+ * and rewrote it. Large servers with frequent joins and leaves spent most
+ * of their UI time there.
+ *
+ * DESIGN:
+ * - Names are kept in a sorted vector for display, plus a hash map from
+ *   name to how many connections use it (the same user may join twice)
+ * - Join and leave are exact-name lookups: O(1) in the map and O(log n)
+ *   to find the row; the row insert or erase only moves pointers
+ * - PlayerListView draws only the rows on screen
+ */
+
 #include <FL/Fl_Group.H>
 #include <FL/Fl_Box.H>
-#include <FL/Fl_Text_Display.H>
-#include <FL/Fl_Text_Buffer.H>
+#include <FL/Fl_Scrollbar.H>
+#include <cstdint>
 #include <string>
+#include <vector>
+#include "FlatHashMap.h"
+
+/**
+ * @brief Scrolling list that draws only its visible rows
+ */
+class PlayerListView : public Fl_Group {
+public:
+    PlayerListView(int X, int Y, int W, int H);
+
+    /** @brief Rows to show (owned by the caller; call rowsChanged() after edits) */
+    void rows(const std::vector<std::string>* rows) { rowSource = rows; rowsChanged(); }
+
+    /** @brief Refresh after rows were inserted or removed */
+    void rowsChanged();
+
+    void textcolor(Fl_Color color) { textColor = color; redraw(); }
+    Fl_Color textcolor() const { return textColor; }
+    void textfont(Fl_Font font) { textFont = font; rowsChanged(); }
+    void textsize(Fl_Fontsize size) { textSize = size; rowsChanged(); }
+
+    void resize(int X, int Y, int W, int H) override;
+    int handle(int event) override;
+
+protected:
+    void draw() override;
+
+private:
+    const std::vector<std::string>* rowSource;
+    Fl_Scrollbar* scrollbar;
+    Fl_Color textColor;
+    Fl_Font textFont;
+    Fl_Fontsize textSize;
+
+    static constexpr int MARGIN = 4;
+    static constexpr int WHEEL_ROWS = 3;
+
+    size_t rowCount() const { return rowSource ? rowSource->size() : 0; }
+    int rowHeight() const;
+    int visibleRows() const;
+    void updateScrollbar();
+
+    static void scrollbarCallback(Fl_Widget* widget, void* userdata);
+};
 
 class PlayerDisplay : public Fl_Group {
 public:
@@ -17,12 +79,16 @@ public:
     void clearPlayers();  // Clear all players from the list
     void updateLayout();
 
+    size_t playerCount() const { return connectionsByName.size(); }
+
     Fl_Box* sidePanel;
-    Fl_Text_Display* disp;
-    Fl_Text_Buffer* tbuff;
+    PlayerListView* disp;
 
 private:
+    std::vector<std::string> rows;                      // "Players:" then names, sorted
+    FlatHashMap<std::string, uint32_t> connectionsByName;
 
+    static const char* const HEADER_ROW;
 };
 
-#endif // PLAYER_DISPLAY_HPP
\ No newline at end of file
+#endif // PLAYER_DISPLAY_HPP
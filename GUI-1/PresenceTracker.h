@@ -0,0 +1,98 @@
+#ifndef PRESENCE_TRACKER_H
+#define PRESENCE_TRACKER_H
+
+/**
+ * @file PresenceTracker.h
+ * @brief Coalesces presence flaps before they are fanned out
+ *
+ * PURPOSE:
+ * A client on a poor link drops and reconnects every few seconds, and each
+ * cycle used to cost a "left" and a "joined" line to every connection on
+ * the server. The tracker holds a departure back for a grace period: a
+ * user who comes back within it produces no event at all, and one who
+ * does not produces a single offline event when the period runs out.
+ *
+ * DESIGN:
+ * - Keys are case-folded usernames; the name as last shown is kept for
+ *   the offline event
+ * - Pending departures sit in a TimingWheel, so arrivals and departures
+ *   are O(1) and Advance() only visits the ones that came due
+ *
+ * THREADING:
+ * Not thread-safe; the owner serializes access.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FlatHashMap.h"
+#include "TimingWheel.h"
+
+class PresenceTracker {
+public:
+    /**
+     * @param graceMs How long a departure waits for the user to come back
+     * @param tickMs Timer resolution; offline events fire up to one tick late
+     * @param nowMs Current time on the caller's clock
+     */
+    PresenceTracker(uint64_t graceMs, uint64_t tickMs, uint64_t nowMs)
+        : m_graceMs(graceMs)
+        , m_timers(tickMs, nowMs) {}
+
+    /**
+     * @brief A user connected
+     * @return True if the arrival should be announced; false if it only
+     *         cancelled a departure nobody has heard about yet
+     */
+    bool Arrive(const std::string& key) {
+        if (m_pending.erase(key) == 0) {
+            return true;
+        }
+        m_timers.Cancel(key);
+        return false;
+    }
+
+    /**
+     * @brief A user disconnected; announced by Advance() unless they return first
+     * @param displayName Name to announce, as the user last appeared
+     */
+    void Depart(const std::string& key, const std::string& displayName, uint64_t nowMs) {
+        m_pending[key] = displayName;
+        m_timers.Schedule(key, nowMs + m_graceMs);
+    }
+
+    /**
+     * @brief Collect the departures whose grace period ran out
+     * @param departed Appended with their display names
+     * @return Number of names appended
+     */
+    size_t Advance(uint64_t nowMs, std::vector<std::string>& departed) {
+        std::vector<std::string> due;
+        m_timers.Advance(nowMs, due);
+        size_t before = departed.size();
+        for (const std::string& key : due) {
+            auto found = m_pending.find(key);
+            if (found != m_pending.end()) {
+                departed.push_back(std::move(found->second));
+                m_pending.erase(found);
+            }
+        }
+        return departed.size() - before;
+    }
+
+    bool Empty() const { return m_pending.empty(); }
+
+    /** @brief Forget every pending departure without announcing it */
+    void Clear() {
+        m_pending.clear();
+        m_timers.Clear();
+    }
+
+private:
+    uint64_t m_graceMs;
+    FlatHashMap<std::string, std::string> m_pending;    ///< Folded name -> display name
+    TimingWheel<std::string> m_timers;
+};
+
+#endif // PRESENCE_TRACKER_H
@@ -40,6 +40,14 @@ const char* RequestTypeToString(RequestType type) {
         case RequestType::SendMessage:        return "SendMessage";
         case RequestType::SendDirectMessage:  return "SendDirectMessage";
         case RequestType::GetMessageHistory:  return "GetMessageHistory";
+        case RequestType::SyncHistory:        return "SyncHistory";
+        
+        // Sharding
+        case RequestType::LocateServer:       return "LocateServer";
+        case RequestType::BusPublish:         return "BusPublish";
+        
+        // Attachments
+        case RequestType::RequestAttachment:  return "RequestAttachment";
         
         // Friends
         case RequestType::SendFriendRequest:  return "SendFriendRequest";
@@ -57,6 +65,10 @@ const char* RequestTypeToString(RequestType type) {
         // Presence
         case RequestType::Heartbeat:          return "Heartbeat";
         
+        // Diagnostics
+        case RequestType::GetServerVersion:   return "GetServerVersion";
+        case RequestType::GetServerMetrics:   return "GetServerMetrics";
+        
         default:                              return "Unknown";
     }
 }
@@ -96,6 +108,16 @@ const char* ResponseTypeToString(ResponseType type) {
         case ResponseType::ChannelDeleted:    return "ChannelDeleted";
         case ResponseType::Kicked:            return "Kicked";
         
+        // Diagnostics
+        case ResponseType::ServerMetrics:     return "ServerMetrics";
+        case ResponseType::StreamChunk:       return "StreamChunk";
+        
+        // Sharding
+        case ResponseType::ServerLocation:    return "ServerLocation";
+        
+        // Attachments
+        case ResponseType::AttachmentTicket:  return "AttachmentTicket";
+        
         default:                              return "Unknown";
     }
 }
@@ -122,6 +144,8 @@ const char* ErrorCodeToMessage(ErrorCode code) {
         case ErrorCode::ChannelNotFound:      return "Channel not found";
         case ErrorCode::UserNotFound:         return "User not found";
         case ErrorCode::MessageNotFound:      return "Message not found";
+        case ErrorCode::AttachmentNotFound:   return "Attachment not found";
+        case ErrorCode::UserOffline:          return "User is offline";
         
         // Validation errors
         case ErrorCode::InvalidServerName:    return "Invalid server name";
@@ -130,6 +154,8 @@ const char* ErrorCodeToMessage(ErrorCode code) {
         case ErrorCode::TooManyServers:       return "You have reached the maximum number of servers";
         case ErrorCode::TooManyChannels:      return "This server has reached the maximum number of channels";
         case ErrorCode::TooManyFriends:       return "You have reached the maximum number of friends";
+        case ErrorCode::InvalidAttachment:    return "Invalid attachment";
+        case ErrorCode::AttachmentTooLarge:   return "Attachment is too large";
         
         // Friend errors
         case ErrorCode::AlreadyFriends:       return "You are already friends with this user";
@@ -141,6 +167,8 @@ const char* ErrorCodeToMessage(ErrorCode code) {
         case ErrorCode::InternalError:        return "An internal error occurred";
         case ErrorCode::RateLimited:          return "You are sending requests too quickly";
         case ErrorCode::ServerOverloaded:     return "Server is currently overloaded, please try again";
+        case ErrorCode::RequestTimedOut:      return "The server did not answer in time";
+        case ErrorCode::AttachmentsUnavailable: return "This server does not accept attachments";
         
         default:                              return "Unknown error";
     }
@@ -151,4 +179,91 @@ uint32_t GenerateRequestId() {
     return counter.fetch_add(1, std::memory_order_relaxed);
 }
 
+
+//=============================================================================
+// LEGACY TEXT COMMANDS
+//=============================================================================
+
+namespace {
+
+bool StartsWith(std::string_view text, const char* prefix) {
+    return text.rfind(prefix, 0) == 0;
+}
+
+std::string_view After(std::string_view text, const char* prefix) {
+    return text.substr(std::char_traits<char>::length(prefix));
+}
+
+} // namespace
+
+bool ParseChannelId(std::string_view text, uint64_t& outId) {
+    if (text.empty() || text.size() > 20) {
+        return false;
+    }
+
+    uint64_t value = 0;
+    for (unsigned char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        uint64_t digit = c - '0';
+        if (value > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+
+    if (value == 0) {
+        return false;
+    }
+    outId = value;
+    return true;
+}
+
+TextCommand ParseTextCommand(std::string_view line) {
+    TextCommand command;
+
+    if (StartsWith(line, WHISPER_COMMAND)) {
+        size_t space = line.find(' ', 2);
+        if (space == std::string_view::npos || space == 2) {
+            command.type = TextCommandType::BadWhisper;
+            return command;
+        }
+        command.type = TextCommandType::Whisper;
+        command.target = line.substr(2, space - 2);
+        command.content = line.substr(space + 1);
+        return command;
+    }
+    if (StartsWith(line, SERVER_VERSION_COMMAND)) {
+        command.type = TextCommandType::ServerVersion;
+        return command;
+    }
+    if (StartsWith(line, JOIN_CHANNEL_COMMAND) || StartsWith(line, LEAVE_CHANNEL_COMMAND)) {
+        bool joining = StartsWith(line, JOIN_CHANNEL_COMMAND);
+        std::string_view id = After(line, joining ? JOIN_CHANNEL_COMMAND : LEAVE_CHANNEL_COMMAND);
+        command.type = !ParseChannelId(id, command.channelId) ? TextCommandType::BadChannel
+                     : joining ? TextCommandType::JoinChannel : TextCommandType::LeaveChannel;
+        return command;
+    }
+    if (StartsWith(line, CHANGE_USERNAME_COMMAND)) {
+        command.type = TextCommandType::ChangeUsername;
+        command.target = After(line, CHANGE_USERNAME_COMMAND);
+        return command;
+    }
+
+    // Chat line, optionally tagged; a bad tag posts to the global channel
+    command.content = line;
+    if (StartsWith(line, CHANNEL_TAG_PREFIX)) {
+        size_t endBracket = line.find(']');
+        if (endBracket != std::string_view::npos) {
+            size_t tagLength = std::char_traits<char>::length(CHANNEL_TAG_PREFIX);
+            if (!ParseChannelId(line.substr(tagLength, endBracket - tagLength), command.channelId)) {
+                command.channelId = 0;
+            }
+            command.content = line.substr(endBracket + 1);
+        }
+    }
+    return command;
+}
+
 } // namespace Protocol
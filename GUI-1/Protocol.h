@@ -12,19 +12,19 @@
  * - All responses include a status code for error handling
  * 
  * WIRE FORMAT:
- * Each message is serialized as JSON for readability and debugging.
- * In production, consider binary format for efficiency.
+ * Requests travel in the compact binary envelope from ProtocolCodec.h
+ * (protocol version 2 and later):
  * 
- * Message structure:
- * {
- *   "type": "MESSAGE_TYPE",
- *   "requestId": 12345,        // For matching responses to requests
- *   "sessionToken": "...",     // For authenticated requests
- *   "payload": { ... }         // Type-specific data
- * }
+ *   [marker byte][type byte][varint requestId][payload fields...]
+ * 
+ * Payload fields follow the declaration order of the Payloads struct;
+ * integers are varints, strings are a varint length plus raw bytes.
+ * Version 1 peers still use the legacy text commands below.
  */
 
 #include <string>
+#include <string_view>
+#include <cstddef>
 #include <cstdint>
 
 namespace Protocol {
@@ -78,9 +78,26 @@ enum class RequestType {
     SearchUsers,        // Search for users by username
     
     // Presence
-    Heartbeat           // Keep connection alive, update presence
+    Heartbeat,          // Keep connection alive, update presence
+    
+    // Diagnostics
+    GetServerVersion,   // Server build and protocol version
+    GetServerMetrics,   // Live counters as JSON; loopback peers only
+    
+    // Messaging (protocol v7; new types go on the end so the wire values hold)
+    SyncHistory,        // Messages newer than a cursor
+    
+    // Sharding (protocol v8)
+    LocateServer,       // Which node serves a server
+    BusPublish,         // Node-to-node event on the ShardBus; peer nodes only
+    
+    // Attachments (protocol v10)
+    RequestAttachment   // Ticket for an upload or download on the transfer port (keep last)
 };
 
+/** Number of RequestType values; sizes the server's dispatch table */
+constexpr size_t REQUEST_TYPE_COUNT = static_cast<size_t>(RequestType::RequestAttachment) + 1;
+
 //=============================================================================
 // MESSAGE TYPES - Server to Client
 //=============================================================================
@@ -121,6 +138,18 @@ enum class ResponseType {
     ServerDeleted,      // Server was deleted
     ChannelDeleted,     // Channel was deleted
     Kicked,             // User was kicked from server
+    
+    // Diagnostics
+    ServerMetrics,      // JSON metrics snapshot (string payload)
+    
+    // Streaming (protocol v6)
+    StreamChunk,        // One part of a list response; see ProtocolCodec.h
+    
+    // Sharding (protocol v8)
+    ServerLocation,     // Node that serves a server
+    
+    // Attachments (protocol v10)
+    AttachmentTicket,   // Where and how to transfer an attachment
 };
 
 //=============================================================================
@@ -148,6 +177,8 @@ enum class ErrorCode {
     ChannelNotFound = 301,
     UserNotFound = 302,
     MessageNotFound = 303,
+    AttachmentNotFound = 304,
+    UserOffline = 305,      // Whispers are not held for offline users
     
     // Validation errors (4xx)
     InvalidServerName = 400,
@@ -156,6 +187,8 @@ enum class ErrorCode {
     TooManyServers = 403,
     TooManyChannels = 404,
     TooManyFriends = 405,
+    InvalidAttachment = 406,
+    AttachmentTooLarge = 407,
     
     // Friend errors (5xx)
     AlreadyFriends = 500,
@@ -166,7 +199,9 @@ enum class ErrorCode {
     // Server errors (9xx)
     InternalError = 900,
     RateLimited = 901,
-    ServerOverloaded = 902
+    ServerOverloaded = 902,
+    RequestTimedOut = 903,  // Client side: no response arrived in time
+    AttachmentsUnavailable = 904
 };
 
 //=============================================================================
@@ -193,13 +228,72 @@ const char* ErrorCodeToMessage(ErrorCode code);
  */
 uint32_t GenerateRequestId();
 
+//=============================================================================
+// LEGACY TEXT COMMANDS
+// Version 1 peers send requests as plain text. These prefixes carry the
+// matching RequestType; version 2 peers use the binary envelope instead.
+//=============================================================================
+
+/** RequestType::JoinChannel - "/join_channel <channelId>" */
+constexpr const char* JOIN_CHANNEL_COMMAND = "/join_channel ";
+
+/** RequestType::LeaveChannel - "/leave_channel <channelId>" */
+constexpr const char* LEAVE_CHANNEL_COMMAND = "/leave_channel ";
+
+/** RequestType::SendDirectMessage - "W/<username> <message>" */
+constexpr const char* WHISPER_COMMAND = "W/";
+
+/** RequestType::GetServerVersion - "SV/" */
+constexpr const char* SERVER_VERSION_COMMAND = "SV/";
+
+/** RequestType::ChangeUsername - "/change_username <username>" */
+constexpr const char* CHANGE_USERNAME_COMMAND = "/change_username ";
+
+/** RequestType::SendMessage to a channel - "[CH:<channelId>]<message>" */
+constexpr const char* CHANNEL_TAG_PREFIX = "[CH:";
+
+enum class TextCommandType {
+    Chat,               // content; channelId from the tag (0 = untagged)
+    Whisper,            // target, content
+    ServerVersion,
+    JoinChannel,        // channelId
+    LeaveChannel,       // channelId
+    ChangeUsername,     // target = the new name
+    BadWhisper,         // "W/" without both a name and a message
+    BadChannel          // Join/leave with an invalid channel id
+};
+
+/**
+ * @brief One text line split into its fields
+ *
+ * The views point into the parsed line; they are valid as long as it is.
+ */
+struct TextCommand {
+    TextCommandType type = TextCommandType::Chat;
+    std::string_view target;
+    std::string_view content;
+    uint64_t channelId = 0;
+};
+
+/**
+ * @brief Parse a decimal channel id: digits only, bounded, non-zero
+ *
+ * SECURITY: No sign or whitespace and no overflow. Channel 0 is the
+ * global (unscoped) channel and is never a valid subscription target.
+ */
+bool ParseChannelId(std::string_view text, uint64_t& outId);
+
+/**
+ * @brief Classify a text line and split out its fields without copying
+ */
+TextCommand ParseTextCommand(std::string_view line);
+
 //=============================================================================
 // MESSAGE STRUCTURES
 // These define the payload format for each message type
 //=============================================================================
 
-// Note: In a production system, these would be serialized to JSON or binary.
-// For now, we define the logical structure; serialization is in Protocol.cpp
+// Binary serialization of these structs lives in ProtocolCodec.cpp
 
 namespace Payloads {
 
@@ -259,6 +353,14 @@ struct ChannelInfo {
     std::string channelName;
 };
 
+struct ChannelSubscriptionRequest {
+    uint64_t channelId;     // JoinChannel / LeaveChannel target
+};
+
+struct GetChannelListRequest {
+    uint64_t serverId;
+};
+
 // ---- Messaging ----
 
 struct SendMessageRequest {
@@ -275,8 +377,21 @@ struct MessageInfo {
     int64_t timestamp;
 };
 
+struct GetMessageHistoryRequest {
+    uint64_t channelId;
+    uint64_t beforeMessageId;   // Page ends just before this message (0 = newest page)
+    uint32_t limit;
+};
+
+struct SyncHistoryRequest {
+    uint64_t channelId;
+    uint64_t afterMessageId;    // Newest message the client already has (0 = none)
+    uint32_t limit;
+};
+
 struct SendDirectMessageRequest {
     uint64_t recipientId;
+    std::string recipientName;  // Used when no account id is known (live chat)
     std::string content;
 };
 
@@ -297,6 +412,10 @@ struct FriendRequestInfo {
 
 // ---- User Info ----
 
+struct UpdateProfileRequest {
+    std::string username;
+};
+
 struct UserInfo {
     uint64_t userId;
     std::string username;
@@ -304,6 +423,64 @@ struct UserInfo {
     int64_t memberSince;
 };
 
+struct GetServerMembersRequest {
+    uint64_t serverId;
+};
+
+// ---- Sharding ----
+
+struct LocateServerRequest {
+    uint64_t serverId;
+};
+
+struct ServerLocation {
+    uint64_t serverId;
+    std::string nodeId;
+    std::string host;           // Numeric IPv4 address of the serving node
+    uint32_t port;
+};
+
+/** Pushed as UserOnline/UserOffline with requestId 0 (protocol v9) */
+struct PresenceUpdate {
+    std::string username;
+};
+
+/** What a BusPublish carries; unknown topics are ignored by the receiver */
+enum class BusTopic : uint32_t {
+    UserOnline = 1,     // key = username connected to the origin node
+    UserOffline = 2,    // key = username that left the origin node
+    Whisper = 3         // key = recipient username, body = line to deliver as is
+};
+
+struct BusPublishRequest {
+    uint32_t topic;             // BusTopic
+    std::string originNode;
+    std::string key;
+    std::string body;
+};
+
+// ---- Attachments ----
+
+enum class AttachmentDirection : uint32_t {
+    Upload = 0,
+    Download = 1
+};
+
+struct AttachmentRequest {
+    uint32_t direction;         // AttachmentDirection
+    std::string digest;         // SHA-256 of the file, 64 lowercase hex characters
+    uint64_t size;              // Upload: file size in bytes (unused for downloads)
+    uint64_t offset;            // Download: bytes the client already holds (unused for uploads)
+};
+
+struct AttachmentTicket {
+    std::string ticket;         // Presented on the transfer port; one use, short-lived
+    uint32_t port;              // Transfer port on the same host as the chat server
+    uint64_t offset;            // First byte to transfer (uploads resume here)
+    uint64_t size;              // Whole file size
+    bool complete;              // Nothing to transfer: already stored (upload) or held (download)
+};
+
 } // namespace Payloads
 
 } // namespace Protocol
@@ -0,0 +1,567 @@
+/**
+ * @file ProtocolCodec.cpp
+ * @brief Implementation of the binary request/response envelope
+ */
+
+#include "ProtocolCodec.h"
+
+namespace Protocol {
+namespace Wire {
+
+//=============================================================================
+// WRITER
+//=============================================================================
+
+void Writer::PutVarint(uint64_t value) {
+    while (value >= 0x80) {
+        m_out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    m_out.push_back(static_cast<char>(value));
+}
+
+void Writer::PutString(std::string_view value) {
+    PutVarint(value.size());
+    m_out.append(value.data(), value.size());
+}
+
+//=============================================================================
+// READER
+//=============================================================================
+
+bool Reader::GetByte(uint8_t& value) {
+    if (m_failed || m_pos >= m_data.size()) {
+        m_failed = true;
+        return false;
+    }
+    value = static_cast<uint8_t>(m_data[m_pos++]);
+    return true;
+}
+
+bool Reader::GetVarint(uint64_t& value) {
+    if (m_failed) {
+        return false;
+    }
+
+    uint64_t result = 0;
+    size_t pos = m_pos;
+    for (size_t i = 0; i < MAX_VARINT_BYTES; ++i) {
+        if (pos >= m_data.size()) {
+            break;
+        }
+        uint8_t byte = static_cast<uint8_t>(m_data[pos++]);
+
+        // SECURITY: The tenth byte may only contribute the top bit
+        if (i == MAX_VARINT_BYTES - 1 && byte > 0x01) {
+            break;
+        }
+
+        result |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            m_pos = pos;
+            value = result;
+            return true;
+        }
+    }
+
+    m_failed = true;
+    return false;
+}
+
+bool Reader::GetVarint32(uint32_t& value) {
+    uint64_t wide = 0;
+    if (!GetVarint(wide)) {
+        return false;
+    }
+    if (wide > UINT32_MAX) {
+        m_failed = true;
+        return false;
+    }
+    value = static_cast<uint32_t>(wide);
+    return true;
+}
+
+bool Reader::GetString(std::string_view& value) {
+    uint64_t length = 0;
+    if (!GetVarint(length)) {
+        return false;
+    }
+    // SECURITY: Length is checked against the bytes actually present
+    if (length > m_data.size() - m_pos) {
+        m_failed = true;
+        return false;
+    }
+    value = m_data.substr(m_pos, static_cast<size_t>(length));
+    m_pos += static_cast<size_t>(length);
+    return true;
+}
+
+//=============================================================================
+// ENVELOPE
+//=============================================================================
+
+bool DecodeEnvelope(std::string_view frame, EnvelopeView& out) {
+    Reader reader(frame);
+    EnvelopeView view;
+
+    if (!reader.GetByte(view.marker) ||
+        (view.marker != REQUEST_MARKER && view.marker != RESPONSE_MARKER)) {
+        return false;
+    }
+    if (!reader.GetByte(view.type) || !reader.GetVarint32(view.requestId)) {
+        return false;
+    }
+
+    view.payload = reader.Rest();
+
+    out = view;
+    return true;
+}
+
+std::string EncodeRequest(RequestType type, uint32_t requestId) {
+    std::string out;
+    out.reserve(16);
+    Writer writer(out);
+    writer.PutByte(REQUEST_MARKER);
+    writer.PutByte(static_cast<uint8_t>(type));
+    writer.PutVarint(requestId);
+    return out;
+}
+
+std::string EncodeResponse(ResponseType type, uint32_t requestId) {
+    std::string out;
+    out.reserve(16);
+    Writer writer(out);
+    writer.PutByte(RESPONSE_MARKER);
+    writer.PutByte(static_cast<uint8_t>(type));
+    writer.PutVarint(requestId);
+    return out;
+}
+
+std::string EncodeError(uint32_t requestId, ErrorCode code) {
+    std::string out = EncodeResponse(ResponseType::Error, requestId);
+    Writer writer(out);
+    writer.PutVarint(static_cast<uint64_t>(code));
+    return out;
+}
+
+std::string EncodeStreamChunk(ResponseType type, uint32_t requestId, uint32_t sequence, bool last, size_t count) {
+    std::string out = EncodeResponse(ResponseType::StreamChunk, requestId);
+    Writer writer(out);
+    writer.PutVarint(sequence);
+    writer.PutByte(last ? 1 : 0);
+    writer.PutByte(static_cast<uint8_t>(type));
+    writer.PutVarint(count);
+    return out;
+}
+
+//=============================================================================
+// PAYLOADS (field order matches the Payloads structs)
+//=============================================================================
+
+void WritePayload(Writer& writer, const Payloads::ChannelSubscriptionRequest& payload) {
+    writer.PutVarint(payload.channelId);
+}
+
+void WritePayload(Writer& writer, const Payloads::SendMessageRequest& payload) {
+    writer.PutVarint(payload.channelId);
+    writer.PutString(payload.content);
+}
+
+void WritePayload(Writer& writer, const Payloads::SendDirectMessageRequest& payload) {
+    writer.PutVarint(payload.recipientId);
+    writer.PutString(payload.recipientName);
+    writer.PutString(payload.content);
+}
+
+void WritePayload(Writer& writer, const Payloads::UpdateProfileRequest& payload) {
+    writer.PutString(payload.username);
+}
+
+void WritePayload(Writer& writer, const Payloads::GetChannelListRequest& payload) {
+    writer.PutVarint(payload.serverId);
+}
+
+void WritePayload(Writer& writer, const Payloads::GetMessageHistoryRequest& payload) {
+    writer.PutVarint(payload.channelId);
+    writer.PutVarint(payload.beforeMessageId);
+    writer.PutVarint(payload.limit);
+}
+
+void WritePayload(Writer& writer, const Payloads::GetServerMembersRequest& payload) {
+    writer.PutVarint(payload.serverId);
+}
+
+void WritePayload(Writer& writer, const Payloads::SyncHistoryRequest& payload) {
+    writer.PutVarint(payload.channelId);
+    writer.PutVarint(payload.afterMessageId);
+    writer.PutVarint(payload.limit);
+}
+
+void WritePayload(Writer& writer, const Payloads::LocateServerRequest& payload) {
+    writer.PutVarint(payload.serverId);
+}
+
+void WritePayload(Writer& writer, const Payloads::BusPublishRequest& payload) {
+    writer.PutVarint(payload.topic);
+    writer.PutString(payload.originNode);
+    writer.PutString(payload.key);
+    writer.PutString(payload.body);
+}
+
+void WritePayload(Writer& writer, const Payloads::AttachmentRequest& payload) {
+    writer.PutVarint(payload.direction);
+    writer.PutString(payload.digest);
+    writer.PutVarint(payload.size);
+    writer.PutVarint(payload.offset);
+}
+
+void WritePayload(Writer& writer, const Payloads::ServerLocation& payload) {
+    writer.PutVarint(payload.serverId);
+    writer.PutString(payload.nodeId);
+    writer.PutString(payload.host);
+    writer.PutVarint(payload.port);
+}
+
+void WritePayload(Writer& writer, const Payloads::PresenceUpdate& payload) {
+    writer.PutString(payload.username);
+}
+
+void WritePayload(Writer& writer, const Payloads::AttachmentTicket& payload) {
+    writer.PutString(payload.ticket);
+    writer.PutVarint(payload.port);
+    writer.PutVarint(payload.offset);
+    writer.PutVarint(payload.size);
+    writer.PutByte(payload.complete ? 1 : 0);
+}
+
+bool ReadPayload(std::string_view payload, ChannelSubscriptionView& out) {
+    Reader reader(payload);
+    ChannelSubscriptionView view;
+    if (!reader.GetVarint(view.channelId) || !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, SendMessageView& out) {
+    Reader reader(payload);
+    SendMessageView view;
+    if (!reader.GetVarint(view.channelId) ||
+        !reader.GetString(view.content) ||
+        !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, SendDirectMessageView& out) {
+    Reader reader(payload);
+    SendDirectMessageView view;
+    if (!reader.GetVarint(view.recipientId) ||
+        !reader.GetString(view.recipientName) ||
+        !reader.GetString(view.content) ||
+        !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, UpdateProfileView& out) {
+    Reader reader(payload);
+    UpdateProfileView view;
+    if (!reader.GetString(view.username) || !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, GetChannelListView& out) {
+    Reader reader(payload);
+    GetChannelListView view;
+    if (!reader.GetVarint(view.serverId) || !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, GetMessageHistoryView& out) {
+    Reader reader(payload);
+    GetMessageHistoryView view;
+    if (!reader.GetVarint(view.channelId) ||
+        !reader.GetVarint(view.beforeMessageId) ||
+        !reader.GetVarint32(view.limit) ||
+        !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, GetServerMembersView& out) {
+    Reader reader(payload);
+    GetServerMembersView view;
+    if (!reader.GetVarint(view.serverId) || !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, SyncHistoryView& out) {
+    Reader reader(payload);
+    SyncHistoryView view;
+    if (!reader.GetVarint(view.channelId) ||
+        !reader.GetVarint(view.afterMessageId) ||
+        !reader.GetVarint32(view.limit) ||
+        !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, LocateServerView& out) {
+    Reader reader(payload);
+    LocateServerView view;
+    if (!reader.GetVarint(view.serverId) || !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, BusPublishView& out) {
+    Reader reader(payload);
+    BusPublishView view;
+    if (!reader.GetVarint32(view.topic) ||
+        !reader.GetString(view.originNode) ||
+        !reader.GetString(view.key) ||
+        !reader.GetString(view.body) ||
+        !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, AttachmentRequestView& out) {
+    Reader reader(payload);
+    AttachmentRequestView view;
+    if (!reader.GetVarint32(view.direction) ||
+        !reader.GetString(view.digest) ||
+        !reader.GetVarint(view.size) ||
+        !reader.GetVarint(view.offset) ||
+        !reader.Finished()) {
+        return false;
+    }
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, Payloads::ServerLocation& out) {
+    Reader reader(payload);
+    uint64_t serverId = 0;
+    std::string_view nodeId;
+    std::string_view host;
+    uint32_t port = 0;
+    if (!reader.GetVarint(serverId) ||
+        !reader.GetString(nodeId) ||
+        !reader.GetString(host) ||
+        !reader.GetVarint32(port) ||
+        !reader.Finished()) {
+        return false;
+    }
+    out.serverId = serverId;
+    out.nodeId.assign(nodeId);
+    out.host.assign(host);
+    out.port = port;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, Payloads::PresenceUpdate& out) {
+    Reader reader(payload);
+    std::string_view username;
+    if (!reader.GetString(username) || !reader.Finished()) {
+        return false;
+    }
+    out.username.assign(username);
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, Payloads::AttachmentTicket& out) {
+    Reader reader(payload);
+    std::string_view ticket;
+    uint32_t port = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint8_t complete = 0;
+    if (!reader.GetString(ticket) ||
+        !reader.GetVarint32(port) ||
+        !reader.GetVarint(offset) ||
+        !reader.GetVarint(size) ||
+        !reader.GetByte(complete) ||
+        complete > 1 ||
+        !reader.Finished()) {
+        return false;
+    }
+    out.ticket.assign(ticket);
+    out.port = port;
+    out.offset = offset;
+    out.size = size;
+    out.complete = complete == 1;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, StreamChunkView& out) {
+    Reader reader(payload);
+    StreamChunkView view;
+    uint8_t last = 0;
+    if (!reader.GetVarint32(view.sequence) ||
+        !reader.GetByte(last) ||
+        last > 1 ||
+        !reader.GetByte(view.type) ||
+        view.type == static_cast<uint8_t>(ResponseType::StreamChunk)) {
+        return false;
+    }
+    view.last = last != 0;
+    view.list = reader.Rest();
+    out = view;
+    return true;
+}
+
+bool ReadPayload(std::string_view payload, ErrorCode& out) {
+    Reader reader(payload);
+    uint32_t code = 0;
+    if (!reader.GetVarint32(code) || !reader.Finished()) {
+        return false;
+    }
+    out = static_cast<ErrorCode>(code);
+    return true;
+}
+
+//=============================================================================
+// LIST ITEMS (field order matches the Payloads structs)
+//=============================================================================
+
+void WriteItem(Writer& writer, const Payloads::ServerInfo& item) {
+    writer.PutVarint(item.serverId);
+    writer.PutString(item.serverName);
+    writer.PutVarint(item.ownerId);
+    writer.PutString(item.ownerName);
+    writer.PutVarint(static_cast<uint32_t>(item.memberCount));
+    writer.PutVarint(static_cast<uint32_t>(item.channelCount));
+}
+
+void WriteItem(Writer& writer, const Payloads::ChannelInfo& item) {
+    writer.PutVarint(item.channelId);
+    writer.PutVarint(item.serverId);
+    writer.PutString(item.channelName);
+}
+
+void WriteItem(Writer& writer, const Payloads::MessageInfo& item) {
+    writer.PutVarint(item.messageId);
+    writer.PutVarint(item.senderId);
+    writer.PutString(item.senderName);
+    writer.PutVarint(item.channelId);
+    writer.PutString(item.content);
+    writer.PutVarint(static_cast<uint64_t>(item.timestamp));
+}
+
+void WriteItem(Writer& writer, const Payloads::FriendInfo& item) {
+    writer.PutVarint(item.userId);
+    writer.PutString(item.username);
+    writer.PutByte(item.isOnline ? 1 : 0);
+}
+
+void WriteItem(Writer& writer, const Payloads::UserInfo& item) {
+    writer.PutVarint(item.userId);
+    writer.PutString(item.username);
+    writer.PutByte(item.isOnline ? 1 : 0);
+    writer.PutVarint(static_cast<uint64_t>(item.memberSince));
+}
+
+bool ReadItem(Reader& reader, Payloads::ServerInfo& out) {
+    std::string_view serverName, ownerName;
+    uint32_t memberCount = 0, channelCount = 0;
+    if (!reader.GetVarint(out.serverId) ||
+        !reader.GetString(serverName) ||
+        !reader.GetVarint(out.ownerId) ||
+        !reader.GetString(ownerName) ||
+        !reader.GetVarint32(memberCount) ||
+        !reader.GetVarint32(channelCount)) {
+        return false;
+    }
+    out.serverName.assign(serverName);
+    out.ownerName.assign(ownerName);
+    out.memberCount = static_cast<int>(memberCount);
+    out.channelCount = static_cast<int>(channelCount);
+    return true;
+}
+
+bool ReadItem(Reader& reader, Payloads::ChannelInfo& out) {
+    std::string_view channelName;
+    if (!reader.GetVarint(out.channelId) ||
+        !reader.GetVarint(out.serverId) ||
+        !reader.GetString(channelName)) {
+        return false;
+    }
+    out.channelName.assign(channelName);
+    return true;
+}
+
+bool ReadItem(Reader& reader, Payloads::MessageInfo& out) {
+    std::string_view senderName, content;
+    uint64_t timestamp = 0;
+    if (!reader.GetVarint(out.messageId) ||
+        !reader.GetVarint(out.senderId) ||
+        !reader.GetString(senderName) ||
+        !reader.GetVarint(out.channelId) ||
+        !reader.GetString(content) ||
+        !reader.GetVarint(timestamp)) {
+        return false;
+    }
+    out.senderName.assign(senderName);
+    out.content.assign(content);
+    out.timestamp = static_cast<int64_t>(timestamp);
+    return true;
+}
+
+bool ReadItem(Reader& reader, Payloads::FriendInfo& out) {
+    std::string_view username;
+    uint8_t online = 0;
+    if (!reader.GetVarint(out.userId) ||
+        !reader.GetString(username) ||
+        !reader.GetByte(online) ||
+        online > 1) {
+        return false;
+    }
+    out.username.assign(username);
+    out.isOnline = online != 0;
+    return true;
+}
+
+bool ReadItem(Reader& reader, Payloads::UserInfo& out) {
+    std::string_view username;
+    uint8_t online = 0;
+    uint64_t memberSince = 0;
+    if (!reader.GetVarint(out.userId) ||
+        !reader.GetString(username) ||
+        !reader.GetByte(online) ||
+        online > 1 ||
+        !reader.GetVarint(memberSince)) {
+        return false;
+    }
+    out.username.assign(username);
+    out.isOnline = online != 0;
+    out.memberSince = static_cast<int64_t>(memberSince);
+    return true;
+}
+
+} // namespace Wire
+} // namespace Protocol
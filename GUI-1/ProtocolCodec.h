@@ -0,0 +1,512 @@
+#ifndef PROTOCOL_CODEC_H
+#define PROTOCOL_CODEC_H
+
+/**
+ * @file ProtocolCodec.h
+ * @brief Compact binary envelope for Protocol:: requests and responses
+ *
+ * PURPOSE:
+ * Requests used to be text commands ("W/", "SV/", "/change_username",
+ * "[CH:id]") recognised by a chain of rfind/substr/stoull calls. The
+ * envelope gives every request a type byte the server can index a
+ * dispatch table with, and payloads that parse without copying.
+ *
+ * LAYOUT (one NetProtocol frame):
+ *   [marker]     1 byte   REQUEST_MARKER or RESPONSE_MARKER
+ *   [type]       1 byte   RequestType / ResponseType
+ *   [requestId]  varint   echoed in the matching response
+ *   [payload]    fields of the Payloads struct, in declaration order
+ *
+ * FIELD ENCODING:
+ * - Integers: unsigned LEB128 varint (1 byte for values < 128)
+ * - Strings:  varint length, then the raw bytes
+ *
+ * Markers are control characters, so an envelope can never be mistaken for
+ * a printable text command from a version 1 peer.
+ *
+ * RESPONSES (protocol v4):
+ * A response echoes the requestId of the request it answers, so a client
+ * may have many requests in flight. ResponseType::Error carries one
+ * varint ErrorCode; list responses carry a varint count and the items.
+ *
+ * STREAMS (protocol v6):
+ * A list too long for one frame goes out as consecutive StreamChunk
+ * responses with the requestId of the request:
+ *   [sequence] varint   0, 1, 2 ... with no gaps
+ *   [last]     1 byte   1 on the final chunk
+ *   [type]     1 byte   ResponseType of the whole list (e.g. MessageHistory)
+ *   [list]     varint count and items, as in a list response
+ * RequestPipeline unwraps each chunk into an EnvelopeView of the list
+ * type, with more = true on every chunk but the last.
+ *
+ * HISTORY SYNC (protocol v7):
+ * SyncHistory carries a channel, the newest messageId the client already
+ * holds and a limit. The answer is a MessageHistory stream of the oldest
+ * messages after that cursor, so repeating the request with the newest
+ * id received walks forward until an empty list says the client is
+ * caught up.
+ *
+ * SHARDING (protocol v8):
+ * LocateServer carries a serverId and is answered by ServerLocation
+ * (serverId, nodeId, host, port). BusPublish is node-to-node only:
+ *   [topic] varint   Payloads::BusTopic
+ *   [originNode] [key] [body]   strings
+ *
+ * PRESENCE (protocol v9):
+ * UserOnline and UserOffline are pushed with requestId 0 and carry one
+ * string, the username. RequestPipeline never matches requestId 0, so
+ * ClientSocket picks these out before completing responses.
+ *
+ * ATTACHMENTS (protocol v10):
+ * RequestAttachment carries [direction] [digest] [size] [offset] and is
+ * answered by AttachmentTicket:
+ *   [ticket] string   [port] varint   [offset] varint   [size] varint
+ *   [complete] 1 byte
+ * The transfer itself runs on the ticket's port, outside these frames.
+ *
+ * ZERO-COPY PARSING:
+ * The *View structs hold std::string_view fields that point into the
+ * received frame. They are only valid while that frame is alive.
+ *
+ * SECURITY NOTES:
+ * - Every length is checked against the bytes actually present
+ * - Varints are capped at MAX_VARINT_BYTES and must fit their target type
+ * - Trailing bytes after the last field are rejected
+ * - Decoded strings are still ATTACKER-CONTROLLED and need validation
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Protocol.h"
+
+namespace Protocol {
+namespace Wire {
+
+//=============================================================================
+// ENVELOPE CONSTANTS
+//=============================================================================
+
+/** First byte of a client-to-server request envelope */
+constexpr uint8_t REQUEST_MARKER = 0x01;
+
+/** First byte of a server-to-client response/event envelope */
+constexpr uint8_t RESPONSE_MARKER = 0x02;
+
+/** A 64-bit varint never needs more than this many bytes */
+constexpr size_t MAX_VARINT_BYTES = 10;
+
+//=============================================================================
+// PARSED VIEWS
+// Non-owning counterparts of the Payloads structs
+//=============================================================================
+
+/**
+ * @brief Decoded envelope header; payload still points into the frame
+ */
+struct EnvelopeView {
+    uint8_t marker = 0;
+    uint8_t type = 0;
+    uint32_t requestId = 0;
+    std::string_view payload;
+    bool more = false;      // Unwrapped StreamChunk: later chunks follow
+
+    bool isRequest() const { return marker == REQUEST_MARKER; }
+};
+
+/**
+ * @brief Header of a StreamChunk payload; list points at its items
+ */
+struct StreamChunkView {
+    uint32_t sequence = 0;
+    bool last = false;
+    uint8_t type = 0;
+    std::string_view list;
+};
+
+struct ChannelSubscriptionView {
+    uint64_t channelId = 0;
+};
+
+struct SendMessageView {
+    uint64_t channelId = 0;
+    std::string_view content;
+};
+
+struct SendDirectMessageView {
+    uint64_t recipientId = 0;
+    std::string_view recipientName;
+    std::string_view content;
+};
+
+struct UpdateProfileView {
+    std::string_view username;
+};
+
+struct GetChannelListView {
+    uint64_t serverId = 0;
+};
+
+struct GetMessageHistoryView {
+    uint64_t channelId = 0;
+    uint64_t beforeMessageId = 0;
+    uint32_t limit = 0;
+};
+
+struct GetServerMembersView {
+    uint64_t serverId = 0;
+};
+
+struct SyncHistoryView {
+    uint64_t channelId = 0;
+    uint64_t afterMessageId = 0;
+    uint32_t limit = 0;
+};
+
+struct LocateServerView {
+    uint64_t serverId = 0;
+};
+
+struct AttachmentRequestView {
+    uint32_t direction = 0;
+    std::string_view digest;
+    uint64_t size = 0;
+    uint64_t offset = 0;
+};
+
+struct BusPublishView {
+    uint32_t topic = 0;
+    std::string_view originNode;
+    std::string_view key;
+    std::string_view body;
+};
+
+//=============================================================================
+// FIELD WRITER / READER
+//=============================================================================
+
+/**
+ * @brief Appends envelope fields to a string
+ */
+class Writer {
+public:
+    explicit Writer(std::string& out) : m_out(out) {}
+
+    void PutByte(uint8_t value) { m_out.push_back(static_cast<char>(value)); }
+    void PutVarint(uint64_t value);
+    void PutString(std::string_view value);
+
+private:
+    std::string& m_out;
+};
+
+/**
+ * @brief Bounds-checked cursor over received bytes
+ *
+ * Every getter fails (and leaves the output untouched) rather than read
+ * past the end; once one fails, all later calls fail too.
+ */
+class Reader {
+public:
+    explicit Reader(std::string_view data) : m_data(data), m_pos(0), m_failed(false) {}
+
+    bool GetByte(uint8_t& value);
+    bool GetVarint(uint64_t& value);
+    bool GetVarint32(uint32_t& value);
+    bool GetString(std::string_view& value);
+
+    /** @brief Bytes not consumed yet */
+    std::string_view Rest() const { return m_data.substr(m_pos); }
+
+    /** @brief True if every byte was consumed and nothing failed */
+    bool Finished() const { return !m_failed && m_pos == m_data.size(); }
+
+private:
+    std::string_view m_data;
+    size_t m_pos;
+    bool m_failed;
+};
+
+//=============================================================================
+// ENVELOPE ENCODING
+//=============================================================================
+
+/**
+ * @brief True if a frame carries a binary envelope rather than text
+ */
+inline bool IsEnvelope(std::string_view frame) {
+    return !frame.empty() &&
+           (static_cast<uint8_t>(frame[0]) == REQUEST_MARKER ||
+            static_cast<uint8_t>(frame[0]) == RESPONSE_MARKER);
+}
+
+/**
+ * @brief Split a frame into its envelope header and payload
+ * @param frame Received frame (ATTACKER-CONTROLLED)
+ * @param out Output header; out.payload points into frame
+ * @return False if the header is malformed
+ */
+bool DecodeEnvelope(std::string_view frame, EnvelopeView& out);
+
+void WritePayload(Writer& writer, const Payloads::ChannelSubscriptionRequest& payload);
+void WritePayload(Writer& writer, const Payloads::SendMessageRequest& payload);
+void WritePayload(Writer& writer, const Payloads::SendDirectMessageRequest& payload);
+void WritePayload(Writer& writer, const Payloads::UpdateProfileRequest& payload);
+void WritePayload(Writer& writer, const Payloads::GetChannelListRequest& payload);
+void WritePayload(Writer& writer, const Payloads::GetMessageHistoryRequest& payload);
+void WritePayload(Writer& writer, const Payloads::GetServerMembersRequest& payload);
+void WritePayload(Writer& writer, const Payloads::SyncHistoryRequest& payload);
+void WritePayload(Writer& writer, const Payloads::LocateServerRequest& payload);
+void WritePayload(Writer& writer, const Payloads::BusPublishRequest& payload);
+void WritePayload(Writer& writer, const Payloads::AttachmentRequest& payload);
+
+/** ServerLocation response body, appended after EncodeResponse() */
+void WritePayload(Writer& writer, const Payloads::ServerLocation& payload);
+
+/** UserOnline/UserOffline push body, appended after EncodeResponse() */
+void WritePayload(Writer& writer, const Payloads::PresenceUpdate& payload);
+
+/** AttachmentTicket response body, appended after EncodeResponse() */
+void WritePayload(Writer& writer, const Payloads::AttachmentTicket& payload);
+
+/**
+ * @brief Serialize a request with no payload
+ */
+std::string EncodeRequest(RequestType type, uint32_t requestId);
+
+/**
+ * @brief Serialize a request and its payload into one frame payload
+ */
+template <typename Payload>
+std::string EncodeRequest(RequestType type, uint32_t requestId, const Payload& payload) {
+    std::string out = EncodeRequest(type, requestId);
+    Writer writer(out);
+    WritePayload(writer, payload);
+    return out;
+}
+
+//=============================================================================
+// RESPONSE ENCODING
+//=============================================================================
+
+/**
+ * @brief Serialize a response header (payload appended by the caller)
+ */
+std::string EncodeResponse(ResponseType type, uint32_t requestId);
+
+/**
+ * @brief Serialize ResponseType::Error for a request
+ */
+std::string EncodeError(uint32_t requestId, ErrorCode code);
+
+void WriteItem(Writer& writer, const Payloads::ServerInfo& item);
+void WriteItem(Writer& writer, const Payloads::ChannelInfo& item);
+void WriteItem(Writer& writer, const Payloads::MessageInfo& item);
+void WriteItem(Writer& writer, const Payloads::FriendInfo& item);
+void WriteItem(Writer& writer, const Payloads::UserInfo& item);
+
+/**
+ * @brief Serialize a list response, keeping only what fits in maxBytes
+ *
+ * Items are taken in order until the next one would push the response
+ * past maxBytes, so the frame always fits NetProtocol::MAX_MESSAGE_SIZE.
+ *
+ * @param outCount Optional: number of items actually written
+ */
+template <typename Item>
+std::string EncodeListResponse(ResponseType type, uint32_t requestId, const std::vector<Item>& items,
+                               size_t maxBytes, size_t* outCount = nullptr) {
+    std::string body;
+    Writer bodyWriter(body);
+    size_t count = 0;
+    for (const Item& item : items) {
+        size_t before = body.size();
+        WriteItem(bodyWriter, item);
+        // Header and count prefix need at most 2 * MAX_VARINT_BYTES + 2
+        if (body.size() + 2 * MAX_VARINT_BYTES + 2 > maxBytes) {
+            body.resize(before);
+            break;
+        }
+        ++count;
+    }
+
+    std::string out = EncodeResponse(type, requestId);
+    Writer writer(out);
+    writer.PutVarint(count);
+    out += body;
+    if (outCount) {
+        *outCount = count;
+    }
+    return out;
+}
+
+/**
+ * @brief Serialize a StreamChunk header up to and including the item count
+ */
+std::string EncodeStreamChunk(ResponseType type, uint32_t requestId, uint32_t sequence, bool last, size_t count);
+
+/** Bytes a StreamChunk adds around its items, at most */
+constexpr size_t STREAM_CHUNK_OVERHEAD = 4 * MAX_VARINT_BYTES + 4;
+
+/**
+ * @brief Serialize a list of any length as StreamChunk frames
+ *
+ * The first chunk is kept within firstChunkBytes so it can be on screen
+ * while the rest are in flight; later chunks fill up to chunkBytes. Both
+ * must exceed STREAM_CHUNK_OVERHEAD. An item too large for a chunk of
+ * its own is left out.
+ *
+ * @param totalBytes Items past this many bytes, in send order, are left
+ *                   out, so the whole stream can be queued at once
+ * @param tailFirst Chunk 0 holds the end of the list and each later chunk
+ *                  the items just before it (newest history first);
+ *                  items inside a chunk always keep their list order
+ * @return At least one frame; the last has the last flag set
+ */
+template <typename Item>
+std::vector<std::string> EncodeListStream(ResponseType type, uint32_t requestId, const std::vector<Item>& items,
+                                          size_t firstChunkBytes, size_t chunkBytes, size_t totalBytes,
+                                          bool tailFirst = false) {
+    // Every item encoded once, back to back; item i is [offsets[i], offsets[i + 1])
+    std::string encoded;
+    Writer writer(encoded);
+    std::vector<size_t> offsets;
+    offsets.reserve(items.size() + 1);
+    for (const Item& item : items) {
+        offsets.push_back(encoded.size());
+        WriteItem(writer, item);
+    }
+    offsets.push_back(encoded.size());
+
+    // Split into contiguous [first, last) ranges, in the order they are sent
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t first = 0, last = 0, used = 0, total = 0;
+    bool open = false;
+    for (size_t k = 0; k < items.size(); ++k) {
+        size_t index = tailFirst ? items.size() - 1 - k : k;
+        size_t size = offsets[index + 1] - offsets[index];
+        if (total + size > totalBytes) {
+            break;
+        }
+        size_t budget = (ranges.empty() ? firstChunkBytes : chunkBytes) - STREAM_CHUNK_OVERHEAD;
+        if (size > chunkBytes - STREAM_CHUNK_OVERHEAD || (open && used + size > budget)) {
+            if (open) {
+                ranges.emplace_back(first, last);
+                open = false;
+            }
+            if (size > chunkBytes - STREAM_CHUNK_OVERHEAD) {
+                continue;
+            }
+        }
+        if (!open) {
+            first = index;
+            last = index + 1;
+            used = 0;
+            open = true;
+        }
+        else if (tailFirst) {
+            first = index;
+        }
+        else {
+            last = index + 1;
+        }
+        used += size;
+        total += size;
+    }
+    if (open || ranges.empty()) {
+        ranges.emplace_back(first, last);
+    }
+
+    std::vector<std::string> frames;
+    frames.reserve(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        size_t begin = ranges[i].first, end = ranges[i].second;
+        std::string frame = EncodeStreamChunk(type, requestId, static_cast<uint32_t>(i),
+                                              i + 1 == ranges.size(), end - begin);
+        frame.append(encoded, offsets[begin], offsets[end] - offsets[begin]);
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+//=============================================================================
+// PAYLOAD DECODING
+// Each returns false unless the payload is exactly one well-formed struct
+//=============================================================================
+
+bool ReadPayload(std::string_view payload, ChannelSubscriptionView& out);
+bool ReadPayload(std::string_view payload, SendMessageView& out);
+bool ReadPayload(std::string_view payload, SendDirectMessageView& out);
+bool ReadPayload(std::string_view payload, UpdateProfileView& out);
+bool ReadPayload(std::string_view payload, GetChannelListView& out);
+bool ReadPayload(std::string_view payload, GetMessageHistoryView& out);
+bool ReadPayload(std::string_view payload, GetServerMembersView& out);
+bool ReadPayload(std::string_view payload, SyncHistoryView& out);
+bool ReadPayload(std::string_view payload, LocateServerView& out);
+bool ReadPayload(std::string_view payload, BusPublishView& out);
+bool ReadPayload(std::string_view payload, AttachmentRequestView& out);
+
+/** ServerLocation decodes into an owning struct: the client keeps it */
+bool ReadPayload(std::string_view payload, Payloads::ServerLocation& out);
+
+/** So does a presence push */
+bool ReadPayload(std::string_view payload, Payloads::PresenceUpdate& out);
+
+/** And an attachment ticket */
+bool ReadPayload(std::string_view payload, Payloads::AttachmentTicket& out);
+
+/**
+ * @brief Decode a StreamChunk header; out.list is everything after it
+ */
+bool ReadPayload(std::string_view payload, StreamChunkView& out);
+
+/**
+ * @brief Decode the ErrorCode carried by ResponseType::Error
+ */
+bool ReadPayload(std::string_view payload, ErrorCode& out);
+
+// List items decode into owning structs: the client keeps them after the
+// frame is gone
+bool ReadItem(Reader& reader, Payloads::ServerInfo& out);
+bool ReadItem(Reader& reader, Payloads::ChannelInfo& out);
+bool ReadItem(Reader& reader, Payloads::MessageInfo& out);
+bool ReadItem(Reader& reader, Payloads::FriendInfo& out);
+bool ReadItem(Reader& reader, Payloads::UserInfo& out);
+
+/**
+ * @brief Decode a list response
+ *
+ * SECURITY: The item count is ATTACKER-CONTROLLED, so nothing is reserved
+ * from it; every item takes at least one byte, so a count larger than
+ * the payload fails on the first missing item.
+ */
+template <typename Item>
+bool ReadPayload(std::string_view payload, std::vector<Item>& out) {
+    Reader reader(payload);
+    uint64_t count = 0;
+    if (!reader.GetVarint(count) || count > payload.size()) {
+        return false;
+    }
+
+    std::vector<Item> items;
+    for (uint64_t i = 0; i < count; ++i) {
+        Item item{};
+        if (!ReadItem(reader, item)) {
+            return false;
+        }
+        items.push_back(std::move(item));
+    }
+    if (!reader.Finished()) {
+        return false;
+    }
+    out = std::move(items);
+    return true;
+}
+
+} // namespace Wire
+} // namespace Protocol
+
+#endif // PROTOCOL_CODEC_H
@@ -0,0 +1,131 @@
+/**
+ * @file RequestPipeline.cpp
+ * @brief Implementation of the client request/response table
+ */
+
+#include "RequestPipeline.h"
+#include "Log.h"
+#include <vector>
+
+RequestPipeline::RequestPipeline(uint64_t nowMs)
+    : m_deadlines(TIMEOUT_TICK_MS, nowMs) {
+}
+
+uint32_t RequestPipeline::Register(Completion done, uint64_t nowMs, uint64_t timeoutMs) {
+    uint32_t requestId = Protocol::GenerateRequestId();
+    // 0 means "no request" to callers; a wrapped counter must not hand it out
+    while (requestId == 0 || m_pending.count(requestId) != 0) {
+        requestId = Protocol::GenerateRequestId();
+    }
+
+    Pending& pending = m_pending[requestId];
+    pending.done = std::move(done);
+    pending.timeoutMs = timeoutMs;
+    pending.nextChunk = 0;
+    m_deadlines.Schedule(requestId, nowMs + timeoutMs);
+    return requestId;
+}
+
+void RequestPipeline::Cancel(uint32_t requestId) {
+    m_pending.erase(requestId);
+    m_deadlines.Cancel(requestId);
+}
+
+bool RequestPipeline::Complete(std::string_view frame, uint64_t nowMs) {
+    if (frame.empty() || static_cast<uint8_t>(frame[0]) != Protocol::Wire::RESPONSE_MARKER) {
+        return false;
+    }
+
+    Protocol::Wire::EnvelopeView response;
+    if (!Protocol::Wire::DecodeEnvelope(frame, response)) {
+        LOG_WARNING("[NET] Dropping malformed response envelope");
+        return true;
+    }
+    auto found = m_pending.find(response.requestId);
+    if (found == m_pending.end()) {
+        return true;
+    }
+
+    if (response.type == static_cast<uint8_t>(Protocol::ResponseType::StreamChunk)) {
+        Protocol::Wire::StreamChunkView chunk;
+        if (!Protocol::Wire::ReadPayload(response.payload, chunk) || chunk.sequence != found->second.nextChunk) {
+            LOG_WARNING("[NET] Stream for request %u is malformed or out of order", response.requestId);
+            finish(response.requestId, Protocol::ErrorCode::InternalError, Protocol::Wire::EnvelopeView());
+            return true;
+        }
+        Protocol::Wire::EnvelopeView unwrapped = response;
+        unwrapped.type = chunk.type;
+        unwrapped.payload = chunk.list;
+        unwrapped.more = !chunk.last;
+        if (chunk.last) {
+            finish(response.requestId, Protocol::ErrorCode::None, unwrapped);
+        }
+        else {
+            deliverChunk(response.requestId, unwrapped, nowMs);
+        }
+        return true;
+    }
+
+    Protocol::ErrorCode error = Protocol::ErrorCode::None;
+    if (response.type == static_cast<uint8_t>(Protocol::ResponseType::Error) &&
+        !Protocol::Wire::ReadPayload(response.payload, error)) {
+        error = Protocol::ErrorCode::InternalError;
+    }
+    finish(response.requestId, error, response);
+    return true;
+}
+
+size_t RequestPipeline::Expire(uint64_t nowMs) {
+    std::vector<uint64_t> expired;
+    m_deadlines.Advance(nowMs, expired);
+    for (uint64_t requestId : expired) {
+        finish(requestId, Protocol::ErrorCode::RequestTimedOut, Protocol::Wire::EnvelopeView());
+    }
+    return expired.size();
+}
+
+void RequestPipeline::FailAll(Protocol::ErrorCode error) {
+    std::vector<uint64_t> ids;
+    ids.reserve(m_pending.size());
+    for (const auto& pending : m_pending) {
+        ids.push_back(pending.first);
+    }
+    for (uint64_t requestId : ids) {
+        finish(requestId, error, Protocol::Wire::EnvelopeView());
+    }
+}
+
+void RequestPipeline::finish(uint64_t requestId, Protocol::ErrorCode error, const Protocol::Wire::EnvelopeView& response) {
+    auto found = m_pending.find(requestId);
+    if (found == m_pending.end()) {
+        return;
+    }
+    Completion done = std::move(found->second.done);
+    m_pending.erase(found);
+    m_deadlines.Cancel(requestId);
+
+    if (done) {
+        done(error, error == Protocol::ErrorCode::None ? response : Protocol::Wire::EnvelopeView());
+    }
+}
+
+void RequestPipeline::deliverChunk(uint64_t requestId, const Protocol::Wire::EnvelopeView& chunk, uint64_t nowMs) {
+    auto found = m_pending.find(requestId);
+    if (found == m_pending.end()) {
+        return;
+    }
+    ++found->second.nextChunk;
+    m_deadlines.Schedule(requestId, nowMs + found->second.timeoutMs);
+
+    // The completion may register requests (moving the table) or finish
+    // this one, so it runs outside the table and goes back only if the
+    // request is still waiting for its next chunk
+    Completion done = std::move(found->second.done);
+    if (done) {
+        done(Protocol::ErrorCode::None, chunk);
+    }
+    found = m_pending.find(requestId);
+    if (found != m_pending.end() && !found->second.done) {
+        found->second.done = std::move(done);
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef REQUEST_PIPELINE_H
+#define REQUEST_PIPELINE_H
+
+/**
+ * @file RequestPipeline.h
+ * @brief Client-side table of requests in flight, matched to responses by requestId
+ *
+ * PURPOSE:
+ * Every client operation used to be send-then-wait, so opening a server
+ * cost one round trip per list it needed. With a pipeline, the client
+ * sends all its requests back to back and each completion runs when its
+ * response arrives, in whatever order the server answers.
+ *
+ * DESIGN:
+ * - Register() hands out the requestId to put in the envelope and keeps
+ *   the completion until Complete() sees a response with that id
+ * - Deadlines live on a TimingWheel, so a response that never comes
+ *   completes with ErrorCode::RequestTimedOut without scanning anything
+ * - A completion is removed before it runs, so it may register new
+ *   requests (follow-up pages, dependent lists)
+ * - Responses nobody is waiting for (late, or already timed out) are
+ *   consumed and dropped
+ * - A streamed response (StreamChunk) runs the completion once per chunk,
+ *   in sequence order, with response.more set on all but the last; each
+ *   chunk restarts the request's timeout. A gap in the sequence fails
+ *   the request with InternalError
+ *
+ * THREADING:
+ * Not thread-safe; used on the thread that owns the ClientSocket.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include "FlatHashMap.h"
+#include "TimingWheel.h"
+#include "Protocol.h"
+#include "ProtocolCodec.h"
+
+class RequestPipeline {
+public:
+    /**
+     * @brief Runs once per request, or once per chunk of a streamed response
+     * @param error None if a response of any type other than Error arrived
+     * @param response The response envelope (empty unless error is None)
+     */
+    using Completion = std::function<void(Protocol::ErrorCode error, const Protocol::Wire::EnvelopeView& response)>;
+
+    /** How long a request may wait for its response */
+    static constexpr uint64_t DEFAULT_TIMEOUT_MS = 10000;
+
+    /** Resolution of the timeouts */
+    static constexpr uint64_t TIMEOUT_TICK_MS = 100;
+
+    explicit RequestPipeline(uint64_t nowMs);
+
+    /**
+     * @brief Track a new request
+     * @return The requestId to send it with
+     */
+    uint32_t Register(Completion done, uint64_t nowMs, uint64_t timeoutMs = DEFAULT_TIMEOUT_MS);
+
+    /** @brief Forget a request without completing it (e.g. its send failed) */
+    void Cancel(uint32_t requestId);
+
+    /**
+     * @brief Route one received frame
+     * @param nowMs Clock reading; a stream chunk's next deadline counts from it
+     * @return True if the frame was a response envelope (matched or not)
+     */
+    bool Complete(std::string_view frame, uint64_t nowMs);
+
+    /**
+     * @brief Complete every request whose deadline has passed with RequestTimedOut
+     * @return Number of requests that timed out
+     */
+    size_t Expire(uint64_t nowMs);
+
+    /** @brief Complete every outstanding request with an error (connection lost) */
+    void FailAll(Protocol::ErrorCode error);
+
+    size_t InFlight() const { return m_pending.size(); }
+
+private:
+    struct Pending {
+        Completion done;
+        uint64_t timeoutMs = DEFAULT_TIMEOUT_MS;
+        uint32_t nextChunk = 0;     // Sequence the next StreamChunk must carry
+    };
+
+    FlatHashMap<uint64_t, Pending> m_pending;
+    TimingWheel<uint64_t> m_deadlines;
+
+    // Remove first, then call, so the completion may re-enter Register()
+    void finish(uint64_t requestId, Protocol::ErrorCode error, const Protocol::Wire::EnvelopeView& response);
+
+    // Hand one non-final chunk to a request that stays pending
+    void deliverChunk(uint64_t requestId, const Protocol::Wire::EnvelopeView& chunk, uint64_t nowMs);
+
+    RequestPipeline(const RequestPipeline&) = delete;
+    RequestPipeline& operator=(const RequestPipeline&) = delete;
+};
+
+#endif // REQUEST_PIPELINE_H
@@ -0,0 +1,91 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+/**
+ * @file RingBuffer.h
+ * @brief Bounded FIFO with O(1) push at the back and pop at the front
+ *
+ * PURPOSE:
+ * Keeping "the newest N" in a std::vector means erasing from the front
+ * once it is full, which moves every remaining element. A ring moves
+ * nothing: the oldest slot is simply reused.
+ *
+ * DESIGN:
+ * - Storage starts empty and doubles up to the capacity, so the many
+ *   containers that never fill do not pay for their full capacity
+ * - Index 0 is the oldest element
+ * - PushBack on a full ring fails; the caller decides what to evict
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity = 0) : m_capacity(capacity) {}
+
+    size_t Size() const { return m_count; }
+    size_t Capacity() const { return m_capacity; }
+    bool Empty() const { return m_count == 0; }
+    bool Full() const { return m_count == m_capacity; }
+
+    T& operator[](size_t index) { return m_slots[(m_head + index) % m_slots.size()]; }
+    const T& operator[](size_t index) const { return m_slots[(m_head + index) % m_slots.size()]; }
+
+    T& Front() { return (*this)[0]; }
+    const T& Front() const { return (*this)[0]; }
+    T& Back() { return (*this)[m_count - 1]; }
+    const T& Back() const { return (*this)[m_count - 1]; }
+
+    /**
+     * @brief Append as the newest element
+     * @return False if the ring is full
+     */
+    bool PushBack(T value) {
+        if (Full()) {
+            return false;
+        }
+        if (m_count == m_slots.size()) {
+            grow();
+        }
+        m_slots[(m_head + m_count) % m_slots.size()] = std::move(value);
+        ++m_count;
+        return true;
+    }
+
+    /** @brief Remove the oldest element (the ring must not be empty) */
+    void PopFront() {
+        m_slots[m_head] = T();
+        m_head = (m_head + 1) % m_slots.size();
+        --m_count;
+    }
+
+    /** @brief Remove everything and release the storage */
+    void Clear() {
+        m_slots.clear();
+        m_slots.shrink_to_fit();
+        m_head = 0;
+        m_count = 0;
+    }
+
+private:
+    std::vector<T> m_slots;
+    size_t m_capacity;
+    size_t m_head = 0;      // Slot of the oldest element
+    size_t m_count = 0;
+
+    void grow() {
+        size_t size = (std::min)(m_capacity, (std::max)(size_t(8), m_slots.size() * 2));
+        std::vector<T> slots(size);
+        for (size_t i = 0; i < m_count; ++i) {
+            slots[i] = std::move((*this)[i]);
+        }
+        m_slots.swap(slots);
+        m_head = 0;
+    }
+};
+
+#endif // RING_BUFFER_H
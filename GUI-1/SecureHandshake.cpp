@@ -6,6 +6,8 @@
 #include "SecureHandshake.h"
 #include <cstring>
 #include <algorithm>
+#include <cstdlib>
+#include <ctime>
 
 namespace Security {
 
@@ -22,6 +24,7 @@ const char* JoinStatusToString(JoinStatus status) {
         case JoinStatus::InviteRevoked: return "Invite has been revoked";
         case JoinStatus::ServerFull: return "Server is full";
         case JoinStatus::Banned: return "You are banned from this server";
+        case JoinStatus::ResumeRejected: return "Session could not be resumed";
         case JoinStatus::VersionMismatch: return "Protocol version mismatch";
         case JoinStatus::InvalidMessage: return "Invalid message format";
         case JoinStatus::SignatureInvalid: return "Signature verification failed";
@@ -33,74 +36,74 @@ const char* JoinStatusToString(JoinStatus status) {
     }
 }
 
-// Helper to append bytes to a vector
-static void AppendBytes(std::vector<uint8_t>& vec, const uint8_t* data, size_t size) {
-    vec.insert(vec.end(), data, data + size);
+/** [u8 type][u32 payloadLength] */
+static constexpr size_t FRAME_HEADER_SIZE = 5;
+
+/**
+ * @brief Allocate a whole frame for a payload of known size and write its header
+ *
+ * The payload is then written straight into the frame, so a message is
+ * built with exactly one allocation.
+ */
+static std::vector<uint8_t> NewFrame(HandshakeMessageType type, size_t payloadSize) {
+    std::vector<uint8_t> frame(FRAME_HEADER_SIZE + payloadSize);
+    ByteWriter header(frame.data(), FRAME_HEADER_SIZE);
+    header.U8(static_cast<uint8_t>(type));
+    header.U32(static_cast<uint32_t>(payloadSize));
+    return frame;
 }
 
-// Helper to append a string with length prefix
-static void AppendString(std::vector<uint8_t>& vec, const std::string& str) {
-    uint16_t len = static_cast<uint16_t>(std::min(str.size(), size_t(65535)));
-    vec.push_back(static_cast<uint8_t>(len & 0xFF));
-    vec.push_back(static_cast<uint8_t>((len >> 8) & 0xFF));
-    AppendBytes(vec, reinterpret_cast<const uint8_t*>(str.data()), len);
+static ByteWriter PayloadWriter(std::vector<uint8_t>& frame) {
+    return ByteWriter(frame.data() + FRAME_HEADER_SIZE, frame.size() - FRAME_HEADER_SIZE);
 }
 
-// Helper to read a string with length prefix
-static bool ReadString(const std::vector<uint8_t>& data, size_t& offset, std::string& out) {
-    if (offset + 2 > data.size()) return false;
-    
-    uint16_t len = static_cast<uint16_t>(data[offset]) | 
-                   (static_cast<uint16_t>(data[offset + 1]) << 8);
-    offset += 2;
-    
-    if (offset + len > data.size()) return false;
-    
-    out.assign(reinterpret_cast<const char*>(data.data() + offset), len);
-    offset += len;
-    return true;
+// A size computed by hand must match what was written; don't send a half-filled frame
+static std::vector<uint8_t> FinishFrame(std::vector<uint8_t>& frame, const ByteWriter& writer) {
+    if (!writer.Complete()) {
+        printf("[HANDSHAKE] Internal error: message size mismatch\n");
+        return {};
+    }
+    return std::move(frame);
+}
+
+// Payload of a frame of the expected type, without copying it
+static std::optional<ByteView> PayloadOf(const std::vector<uint8_t>& data, HandshakeMessageType expected) {
+    auto unwrapped = UnwrapMessageView(data);
+    if (!unwrapped || unwrapped->first != expected) {
+        return std::nullopt;
+    }
+    return unwrapped->second;
 }
 
 std::vector<uint8_t> WrapMessage(HandshakeMessageType type, const std::vector<uint8_t>& payload) {
-    std::vector<uint8_t> result;
-    result.reserve(1 + 4 + payload.size());
-    
-    // Message type
-    result.push_back(static_cast<uint8_t>(type));
-    
-    // Payload length (4 bytes, little endian)
-    uint32_t len = static_cast<uint32_t>(payload.size());
-    result.push_back(static_cast<uint8_t>(len & 0xFF));
-    result.push_back(static_cast<uint8_t>((len >> 8) & 0xFF));
-    result.push_back(static_cast<uint8_t>((len >> 16) & 0xFF));
-    result.push_back(static_cast<uint8_t>((len >> 24) & 0xFF));
+    std::vector<uint8_t> frame = NewFrame(type, payload.size());
+    ByteWriter writer = PayloadWriter(frame);
+    writer.Bytes(payload);
+    return FinishFrame(frame, writer);
+}
+
+std::optional<std::pair<HandshakeMessageType, ByteView>>
+UnwrapMessageView(const std::vector<uint8_t>& data) {
+    ByteReader reader(data);
     
-    // Payload
-    AppendBytes(result, payload.data(), payload.size());
+    uint8_t type = 0;
+    uint32_t len = 0;
+    ByteView payload;
+    if (!reader.U8(type) || !reader.U32(len) || !reader.Bytes(len, payload)) {
+        return std::nullopt;
+    }
     
-    return result;
+    return std::make_pair(static_cast<HandshakeMessageType>(type), payload);
 }
 
 std::optional<std::pair<HandshakeMessageType, std::vector<uint8_t>>> 
 UnwrapMessage(const std::vector<uint8_t>& data) {
-    if (data.size() < 5) {
+    auto unwrapped = UnwrapMessageView(data);
+    if (!unwrapped) {
         return std::nullopt;
     }
     
-    HandshakeMessageType type = static_cast<HandshakeMessageType>(data[0]);
-    
-    uint32_t len = static_cast<uint32_t>(data[1]) |
-                   (static_cast<uint32_t>(data[2]) << 8) |
-                   (static_cast<uint32_t>(data[3]) << 16) |
-                   (static_cast<uint32_t>(data[4]) << 24);
-    
-    if (data.size() < 5 + len) {
-        return std::nullopt;
-    }
-    
-    std::vector<uint8_t> payload(data.begin() + 5, data.begin() + 5 + len);
-    
-    return std::make_pair(type, payload);
+    return std::make_pair(unwrapped->first, unwrapped->second.ToVector());
 }
 
 //=============================================================================
@@ -108,36 +111,27 @@ UnwrapMessage(const std::vector<uint8_t>& data) {
 //=============================================================================
 
 std::vector<uint8_t> ClientHello::Serialize() const {
-    std::vector<uint8_t> data;
-    data.reserve(2 + NONCE_SIZE);
+    std::vector<uint8_t> frame = NewFrame(HandshakeMessageType::ClientHello, 2 + NONCE_SIZE);
+    ByteWriter writer = PayloadWriter(frame);
     
-    // Protocol version (2 bytes)
-    data.push_back(static_cast<uint8_t>(protocolVersion & 0xFF));
-    data.push_back(static_cast<uint8_t>((protocolVersion >> 8) & 0xFF));
+    writer.U16(protocolVersion);
+    writer.Bytes(clientNonce);
     
-    // Client nonce
-    AppendBytes(data, clientNonce.data(), NONCE_SIZE);
-    
-    return WrapMessage(HandshakeMessageType::ClientHello, data);
+    return FinishFrame(frame, writer);
 }
 
 std::optional<ClientHello> ClientHello::Parse(const std::vector<uint8_t>& data) {
-    auto unwrapped = UnwrapMessage(data);
-    if (!unwrapped || unwrapped->first != HandshakeMessageType::ClientHello) {
+    auto payload = PayloadOf(data, HandshakeMessageType::ClientHello);
+    if (!payload) {
         return std::nullopt;
     }
     
-    const auto& payload = unwrapped->second;
-    if (payload.size() < 2 + NONCE_SIZE) {
+    ByteReader reader(*payload);
+    ClientHello hello;
+    if (!reader.U16(hello.protocolVersion) || !reader.Bytes(hello.clientNonce)) {
         return std::nullopt;
     }
     
-    ClientHello hello;
-    hello.protocolVersion = static_cast<uint16_t>(payload[0]) |
-                           (static_cast<uint16_t>(payload[1]) << 8);
-    
-    std::copy_n(payload.begin() + 2, NONCE_SIZE, hello.clientNonce.begin());
-    
     return hello;
 }
 
@@ -146,64 +140,51 @@ std::optional<ClientHello> ClientHello::Parse(const std::vector<uint8_t>& data)
 //=============================================================================
 
 std::vector<uint8_t> ServerHello::Serialize() const {
-    std::vector<uint8_t> data;
+    size_t payloadSize = SERVER_ID_SIZE + 2 + publicKey.size() + NONCE_SIZE + SIGNATURE_SIZE;
+    std::vector<uint8_t> frame = NewFrame(HandshakeMessageType::ServerHello, payloadSize);
+    ByteWriter writer = PayloadWriter(frame);
     
-    // Server ID
-    AppendBytes(data, serverId.data(), SERVER_ID_SIZE);
+    writer.Bytes(serverId);
+    writer.U16(static_cast<uint16_t>(publicKey.size()));
+    writer.Bytes(publicKey);
+    writer.Bytes(serverNonce);
+    writer.Bytes(signature);
     
-    // Public key with length prefix
-    uint16_t pkLen = static_cast<uint16_t>(publicKey.size());
-    data.push_back(static_cast<uint8_t>(pkLen & 0xFF));
-    data.push_back(static_cast<uint8_t>((pkLen >> 8) & 0xFF));
-    AppendBytes(data, publicKey.data(), publicKey.size());
-    
-    // Server nonce
-    AppendBytes(data, serverNonce.data(), NONCE_SIZE);
-    
-    // Signature
-    AppendBytes(data, signature.data(), SIGNATURE_SIZE);
-    
-    return WrapMessage(HandshakeMessageType::ServerHello, data);
+    return FinishFrame(frame, writer);
 }
 
 std::optional<ServerHello> ServerHello::Parse(const std::vector<uint8_t>& data) {
-    auto unwrapped = UnwrapMessage(data);
-    if (!unwrapped || unwrapped->first != HandshakeMessageType::ServerHello) {
+    auto payload = PayloadOf(data, HandshakeMessageType::ServerHello);
+    if (!payload) {
         return std::nullopt;
     }
     
-    const auto& payload = unwrapped->second;
-    size_t offset = 0;
-    
-    // Server ID
-    if (offset + SERVER_ID_SIZE > payload.size()) return std::nullopt;
+    ByteReader reader(*payload);
     ServerHello hello;
-    std::copy_n(payload.begin() + offset, SERVER_ID_SIZE, hello.serverId.begin());
-    offset += SERVER_ID_SIZE;
-    
-    // Public key length
-    if (offset + 2 > payload.size()) return std::nullopt;
-    uint16_t pkLen = static_cast<uint16_t>(payload[offset]) |
-                    (static_cast<uint16_t>(payload[offset + 1]) << 8);
-    offset += 2;
-    
-    // Public key
-    if (offset + pkLen > payload.size()) return std::nullopt;
-    hello.publicKey.assign(payload.begin() + offset, payload.begin() + offset + pkLen);
-    offset += pkLen;
-    
-    // Server nonce
-    if (offset + NONCE_SIZE > payload.size()) return std::nullopt;
-    std::copy_n(payload.begin() + offset, NONCE_SIZE, hello.serverNonce.begin());
-    offset += NONCE_SIZE;
-    
-    // Signature
-    if (offset + SIGNATURE_SIZE > payload.size()) return std::nullopt;
-    std::copy_n(payload.begin() + offset, SIGNATURE_SIZE, hello.signature.begin());
+    ByteView publicKey;
+    if (!reader.Bytes(hello.serverId) ||
+        !reader.Prefixed(2, publicKey) ||
+        !reader.Bytes(hello.serverNonce) ||
+        !reader.Bytes(hello.signature)) {
+        return std::nullopt;
+    }
+    hello.publicKey = publicKey.ToVector();
     
     return hello;
 }
 
+// Signed by the server: client_nonce || server_nonce
+static std::array<uint8_t, 2 * NONCE_SIZE> HelloSignedData(
+    const std::array<uint8_t, NONCE_SIZE>& clientNonce,
+    const std::array<uint8_t, NONCE_SIZE>& serverNonce) {
+    
+    std::array<uint8_t, 2 * NONCE_SIZE> data;
+    ByteWriter writer(data);
+    writer.Bytes(clientNonce);
+    writer.Bytes(serverNonce);
+    return data;
+}
+
 std::optional<ServerHello> ServerHello::Create(
     const ServerIdentity& serverIdentity,
     const std::array<uint8_t, NONCE_SIZE>& clientNonce) {
@@ -221,13 +202,9 @@ std::optional<ServerHello> ServerHello::Create(
         return std::nullopt;
     }
     
-    // Create data to sign: client_nonce || server_nonce
-    std::vector<uint8_t> dataToSign;
-    dataToSign.insert(dataToSign.end(), clientNonce.begin(), clientNonce.end());
-    dataToSign.insert(dataToSign.end(), hello.serverNonce.begin(), hello.serverNonce.end());
-    
     // Sign
-    if (serverIdentity.Sign(dataToSign, hello.signature) != CryptoResult::Success) {
+    if (serverIdentity.Sign(HelloSignedData(clientNonce, hello.serverNonce),
+                            hello.signature) != CryptoResult::Success) {
         return std::nullopt;
     }
     
@@ -256,11 +233,7 @@ bool ServerHello::Verify(const std::array<uint8_t, NONCE_SIZE>& clientNonce,
     }
     
     // Verify signature over client_nonce || server_nonce
-    std::vector<uint8_t> dataToVerify;
-    dataToVerify.insert(dataToVerify.end(), clientNonce.begin(), clientNonce.end());
-    dataToVerify.insert(dataToVerify.end(), serverNonce.begin(), serverNonce.end());
-    
-    CryptoResult result = identity->Verify(dataToVerify, signature);
+    CryptoResult result = identity->Verify(HelloSignedData(clientNonce, serverNonce), signature);
     if (result != CryptoResult::Success) {
         printf("[HANDSHAKE] Signature verification failed\n");
         return false;
@@ -274,60 +247,34 @@ bool ServerHello::Verify(const std::array<uint8_t, NONCE_SIZE>& clientNonce,
 //=============================================================================
 
 std::vector<uint8_t> JoinRequest::Serialize() const {
-    std::vector<uint8_t> data;
+    size_t payloadSize = 4 + inviteToken.size() + 8 + ByteWriter::StringSize(usernameHint);
+    std::vector<uint8_t> frame = NewFrame(HandshakeMessageType::JoinRequest, payloadSize);
+    ByteWriter writer = PayloadWriter(frame);
     
-    // Invite token length and data
-    uint32_t tokenLen = static_cast<uint32_t>(inviteToken.size());
-    data.push_back(static_cast<uint8_t>(tokenLen & 0xFF));
-    data.push_back(static_cast<uint8_t>((tokenLen >> 8) & 0xFF));
-    data.push_back(static_cast<uint8_t>((tokenLen >> 16) & 0xFF));
-    data.push_back(static_cast<uint8_t>((tokenLen >> 24) & 0xFF));
-    AppendBytes(data, inviteToken.data(), inviteToken.size());
+    writer.U32(static_cast<uint32_t>(inviteToken.size()));
+    writer.Bytes(inviteToken);
+    writer.I64(timestamp);
+    writer.String(usernameHint);
     
-    // Timestamp (8 bytes)
-    for (int i = 0; i < 8; ++i) {
-        data.push_back(static_cast<uint8_t>((timestamp >> (i * 8)) & 0xFF));
-    }
-    
-    // Username hint
-    AppendString(data, usernameHint);
-    
-    return WrapMessage(HandshakeMessageType::JoinRequest, data);
+    return FinishFrame(frame, writer);
 }
 
 std::optional<JoinRequest> JoinRequest::Parse(const std::vector<uint8_t>& data) {
-    auto unwrapped = UnwrapMessage(data);
-    if (!unwrapped || unwrapped->first != HandshakeMessageType::JoinRequest) {
+    auto payload = PayloadOf(data, HandshakeMessageType::JoinRequest);
+    if (!payload) {
         return std::nullopt;
     }
     
-    const auto& payload = unwrapped->second;
-    size_t offset = 0;
-    
-    // Token length
-    if (offset + 4 > payload.size()) return std::nullopt;
-    uint32_t tokenLen = static_cast<uint32_t>(payload[offset]) |
-                       (static_cast<uint32_t>(payload[offset + 1]) << 8) |
-                       (static_cast<uint32_t>(payload[offset + 2]) << 16) |
-                       (static_cast<uint32_t>(payload[offset + 3]) << 24);
-    offset += 4;
-    
-    // Token data
-    if (offset + tokenLen > payload.size()) return std::nullopt;
+    ByteReader reader(*payload);
     JoinRequest req;
-    req.inviteToken.assign(payload.begin() + offset, payload.begin() + offset + tokenLen);
-    offset += tokenLen;
-    
-    // Timestamp
-    if (offset + 8 > payload.size()) return std::nullopt;
-    req.timestamp = 0;
-    for (int i = 0; i < 8; ++i) {
-        req.timestamp |= static_cast<int64_t>(payload[offset + i]) << (i * 8);
+    ByteView inviteToken;
+    if (!reader.Prefixed(4, inviteToken) || !reader.I64(req.timestamp)) {
+        return std::nullopt;
     }
-    offset += 8;
+    req.inviteToken = inviteToken.ToVector();
     
-    // Username hint
-    if (!ReadString(payload, offset, req.usernameHint)) {
+    // Username hint is optional
+    if (!reader.String(req.usernameHint)) {
         req.usernameHint = "";
     }
     
@@ -339,91 +286,305 @@ std::optional<JoinRequest> JoinRequest::Parse(const std::vector<uint8_t>& data)
 //=============================================================================
 
 std::vector<uint8_t> JoinResponse::Serialize() const {
-    std::vector<uint8_t> data;
+    size_t payloadSize = 1;
+    if (status == JoinStatus::Success) {
+        payloadSize += 8 + ByteWriter::StringSize(assignedUsername) +
+                       2 + sessionToken.size() +
+                       8 +
+                       ByteWriter::StringSize(serverName) + ByteWriter::StringSize(serverDescription) +
+                       2 + resumptionTicket.size() +
+                       1 + serverProof.size();
+    }
     
-    // Status
-    data.push_back(static_cast<uint8_t>(status));
+    std::vector<uint8_t> frame = NewFrame(HandshakeMessageType::JoinResponse, payloadSize);
+    ByteWriter writer = PayloadWriter(frame);
+    
+    writer.U8(static_cast<uint8_t>(status));
     
     if (status == JoinStatus::Success) {
-        // User ID
-        for (int i = 0; i < 8; ++i) {
-            data.push_back(static_cast<uint8_t>((assignedUserId >> (i * 8)) & 0xFF));
-        }
-        
-        // Username
-        AppendString(data, assignedUsername);
-        
-        // Session token length and data
-        uint16_t tokenLen = static_cast<uint16_t>(sessionToken.size());
-        data.push_back(static_cast<uint8_t>(tokenLen & 0xFF));
-        data.push_back(static_cast<uint8_t>((tokenLen >> 8) & 0xFF));
-        AppendBytes(data, sessionToken.data(), sessionToken.size());
-        
-        // Permissions
-        for (int i = 0; i < 8; ++i) {
-            data.push_back(static_cast<uint8_t>((permissions >> (i * 8)) & 0xFF));
-        }
+        writer.U64(assignedUserId);
+        writer.String(assignedUsername);
+        writer.U16(static_cast<uint16_t>(sessionToken.size()));
+        writer.Bytes(sessionToken);
+        writer.U64(permissions);
         
         // Server info
-        AppendString(data, serverName);
-        AppendString(data, serverDescription);
+        writer.String(serverName);
+        writer.String(serverDescription);
+        
+        // Resumption
+        writer.U16(static_cast<uint16_t>(resumptionTicket.size()));
+        writer.Bytes(resumptionTicket);
+        writer.U8(static_cast<uint8_t>(serverProof.size()));
+        writer.Bytes(serverProof);
     }
     
-    return WrapMessage(HandshakeMessageType::JoinResponse, data);
+    return FinishFrame(frame, writer);
 }
 
 std::optional<JoinResponse> JoinResponse::Parse(const std::vector<uint8_t>& data) {
-    auto unwrapped = UnwrapMessage(data);
-    if (!unwrapped || unwrapped->first != HandshakeMessageType::JoinResponse) {
+    auto payload = PayloadOf(data, HandshakeMessageType::JoinResponse);
+    if (!payload) {
         return std::nullopt;
     }
     
-    const auto& payload = unwrapped->second;
-    if (payload.empty()) return std::nullopt;
-    
+    ByteReader reader(*payload);
     JoinResponse resp;
-    resp.status = static_cast<JoinStatus>(payload[0]);
+    uint8_t status = 0;
+    if (!reader.U8(status)) {
+        return std::nullopt;
+    }
+    resp.status = static_cast<JoinStatus>(status);
     
     if (resp.status == JoinStatus::Success) {
-        size_t offset = 1;
-        
-        // User ID
-        if (offset + 8 > payload.size()) return std::nullopt;
-        resp.assignedUserId = 0;
-        for (int i = 0; i < 8; ++i) {
-            resp.assignedUserId |= static_cast<uint64_t>(payload[offset + i]) << (i * 8);
+        ByteView sessionToken;
+        if (!reader.U64(resp.assignedUserId) ||
+            !reader.String(resp.assignedUsername) ||
+            !reader.Prefixed(2, sessionToken) ||
+            !reader.U64(resp.permissions)) {
+            return std::nullopt;
         }
-        offset += 8;
-        
-        // Username
-        if (!ReadString(payload, offset, resp.assignedUsername)) return std::nullopt;
-        
-        // Session token
-        if (offset + 2 > payload.size()) return std::nullopt;
-        uint16_t tokenLen = static_cast<uint16_t>(payload[offset]) |
-                          (static_cast<uint16_t>(payload[offset + 1]) << 8);
-        offset += 2;
+        resp.sessionToken = sessionToken.ToVector();
         
-        if (offset + tokenLen > payload.size()) return std::nullopt;
-        resp.sessionToken.assign(payload.begin() + offset, payload.begin() + offset + tokenLen);
-        offset += tokenLen;
+        // Server info
+        reader.String(resp.serverName);
+        reader.String(resp.serverDescription);
         
-        // Permissions
-        if (offset + 8 > payload.size()) return std::nullopt;
-        resp.permissions = 0;
-        for (int i = 0; i < 8; ++i) {
-            resp.permissions |= static_cast<uint64_t>(payload[offset + i]) << (i * 8);
+        // Resumption (absent from servers that don't issue tickets)
+        ByteView ticket;
+        if (reader.Prefixed(2, ticket)) {
+            resp.resumptionTicket = ticket.ToVector();
+            
+            ByteView proof;
+            if (reader.Prefixed(1, proof)) {
+                resp.serverProof = proof.ToVector();
+            }
         }
-        offset += 8;
-        
-        // Server info
-        ReadString(payload, offset, resp.serverName);
-        ReadString(payload, offset, resp.serverDescription);
     }
     
     return resp;
 }
 
+//=============================================================================
+// RESUME REQUEST
+//=============================================================================
+
+std::vector<uint8_t> ResumeRequest::Serialize() const {
+    size_t payloadSize = 2 + ticket.size() + NONCE_SIZE + 8 + proof.size();
+    std::vector<uint8_t> frame = NewFrame(HandshakeMessageType::ResumeRequest, payloadSize);
+    ByteWriter writer = PayloadWriter(frame);
+    
+    writer.U16(static_cast<uint16_t>(ticket.size()));
+    writer.Bytes(ticket);
+    writer.Bytes(clientNonce);
+    writer.I64(timestamp);
+    writer.Bytes(proof);
+    
+    return FinishFrame(frame, writer);
+}
+
+std::optional<ResumeRequest> ResumeRequest::Parse(const std::vector<uint8_t>& data) {
+    auto payload = PayloadOf(data, HandshakeMessageType::ResumeRequest);
+    if (!payload) {
+        return std::nullopt;
+    }
+    
+    ByteReader reader(*payload);
+    ResumeRequest req;
+    ByteView ticket;
+    if (!reader.Prefixed(2, ticket) ||
+        !reader.Bytes(req.clientNonce) ||
+        !reader.I64(req.timestamp) ||
+        !reader.Bytes(req.proof)) {
+        return std::nullopt;
+    }
+    req.ticket = ticket.ToVector();
+    
+    return req;
+}
+
+std::vector<uint8_t> ResumeRequest::ProofData() const {
+    static const char LABEL[] = "resume-client";
+    
+    std::vector<uint8_t> data(sizeof(LABEL) + ticket.size() + NONCE_SIZE + 8);
+    ByteWriter writer(data);
+    writer.Bytes(reinterpret_cast<const uint8_t*>(LABEL), sizeof(LABEL));
+    writer.Bytes(ticket);
+    writer.Bytes(clientNonce);
+    writer.I64(timestamp);
+    return data;
+}
+
+/**
+ * @brief MAC input for JoinResponse::serverProof on resume
+ */
+static std::vector<uint8_t> ServerProofData(const std::array<uint8_t, NONCE_SIZE>& clientNonce,
+                                            const std::vector<uint8_t>& newTicket) {
+    static const char LABEL[] = "resume-server";
+    
+    std::vector<uint8_t> data(sizeof(LABEL) + NONCE_SIZE + newTicket.size());
+    ByteWriter writer(data);
+    writer.Bytes(reinterpret_cast<const uint8_t*>(LABEL), sizeof(LABEL));
+    writer.Bytes(clientNonce);
+    writer.Bytes(newTicket);
+    return data;
+}
+
+//=============================================================================
+// RESUMPTION TICKETS
+//=============================================================================
+
+namespace {
+constexpr uint8_t TICKET_VERSION = 1;
+constexpr size_t TICKET_ID_SIZE = 16;
+constexpr size_t TICKET_MAC_SIZE = 32;
+}
+
+ResumptionTickets::ResumptionTickets()
+    : ready(GenerateRandomBytes(key.data(), key.size()) == CryptoResult::Success) {
+    if (!ready) {
+        printf("[HANDSHAKE] Failed to create a ticket key; resumption disabled\n");
+    }
+}
+
+ResumptionTickets::~ResumptionTickets() {
+    volatile uint8_t* ptr = key.data();
+    for (size_t i = 0; i < key.size(); ++i) {
+        ptr[i] = 0;
+    }
+}
+
+bool ResumptionTickets::keyedMac(const char* label, ByteView body,
+                                 std::array<uint8_t, 32>& mac) const {
+    size_t labelSize = std::strlen(label) + 1;
+    
+    std::vector<uint8_t> input(labelSize + body.size);
+    ByteWriter writer(input);
+    writer.Bytes(reinterpret_cast<const uint8_t*>(label), labelSize);
+    writer.Bytes(body);
+    return ComputeHMACSHA256(key.data(), key.size(), input, mac) == CryptoResult::Success;
+}
+
+std::optional<ResumptionTickets::Issued> ResumptionTickets::Issue(
+    uint64_t userId, const std::string& username, uint64_t permissions) {
+    
+    if (!ready) {
+        return std::nullopt;
+    }
+    
+    std::array<uint8_t, TICKET_ID_SIZE> ticketId;
+    if (GenerateRandomBytes(ticketId.data(), ticketId.size()) != CryptoResult::Success) {
+        return std::nullopt;
+    }
+    
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    
+    // body || MAC, written into the one buffer that becomes the ticket
+    size_t bodySize = 1 + TICKET_ID_SIZE + 8 + 8 + 8 + 8 + ByteWriter::StringSize(username);
+    Issued issued;
+    issued.ticket.resize(bodySize + TICKET_MAC_SIZE);
+    
+    ByteWriter writer(issued.ticket);
+    writer.U8(TICKET_VERSION);
+    writer.Bytes(ticketId);
+    writer.U64(userId);
+    writer.U64(permissions);
+    writer.I64(now);
+    writer.I64(now + TICKET_LIFETIME);
+    writer.String(username);
+    
+    ByteView body(issued.ticket.data(), bodySize);
+    std::array<uint8_t, 32> mac;
+    std::array<uint8_t, 32> sessionToken;
+    if (!keyedMac("ticket", body, mac) || !keyedMac("session", body, sessionToken)) {
+        return std::nullopt;
+    }
+    
+    writer.Bytes(mac);
+    if (!writer.Complete()) {
+        return std::nullopt;
+    }
+    
+    issued.sessionToken.assign(sessionToken.begin(), sessionToken.end());
+    return issued;
+}
+
+std::optional<ResumptionTickets::Session> ResumptionTickets::Redeem(const ResumeRequest& request) {
+    if (!ready || request.ticket.size() <= TICKET_MAC_SIZE) {
+        return std::nullopt;
+    }
+    
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    if (std::abs(now - request.timestamp) > MAX_CLOCK_SKEW) {
+        return std::nullopt;
+    }
+    
+    // The ticket must be one we issued
+    ByteView body(request.ticket.data(), request.ticket.size() - TICKET_MAC_SIZE);
+    std::array<uint8_t, 32> expectedMac;
+    if (!keyedMac("ticket", body, expectedMac) ||
+        !ConstantTimeEquals(expectedMac.data(), body.end(), TICKET_MAC_SIZE)) {
+        return std::nullopt;
+    }
+    
+    // Our own bytes from here on, so parsing only has to be careful, not suspicious
+    ByteReader reader(body);
+    uint8_t version = 0;
+    int64_t issuedAt = 0;
+    int64_t expiresAt = 0;
+    Session session;
+    if (!reader.U8(version) || version != TICKET_VERSION ||
+        !reader.Skip(TICKET_ID_SIZE) ||
+        !reader.U64(session.userId) || !reader.U64(session.permissions) ||
+        !reader.I64(issuedAt) || !reader.I64(expiresAt) ||
+        !reader.String(session.username)) {
+        return std::nullopt;
+    }
+    
+    if (now > expiresAt) {
+        return std::nullopt;
+    }
+    
+    // The client must hold the session token bound to this ticket
+    std::array<uint8_t, 32> sessionToken;
+    std::array<uint8_t, 32> expectedProof;
+    if (!keyedMac("session", body, sessionToken) ||
+        ComputeHMACSHA256(sessionToken.data(), sessionToken.size(), request.ProofData(),
+                          expectedProof) != CryptoResult::Success ||
+        !ConstantTimeEquals(expectedProof.data(), request.proof.data(), expectedProof.size())) {
+        return std::nullopt;
+    }
+    
+    // Checked last, so unauthenticated requests can't fill the replay cache
+    if (!acceptNonce(request.clientNonce, now)) {
+        return std::nullopt;
+    }
+    
+    session.sessionToken.assign(sessionToken.begin(), sessionToken.end());
+    return session;
+}
+
+bool ResumptionTickets::acceptNonce(const std::array<uint8_t, NONCE_SIZE>& nonce, int64_t now) {
+    std::lock_guard<std::mutex> lock(replayMutex);
+    
+    // Requests older than the skew window fail the timestamp check anyway
+    while (!seenOrder.empty() && seenOrder.front().first < now - 2 * MAX_CLOCK_SKEW) {
+        seenNonces.erase(seenOrder.front().second);
+        seenOrder.pop_front();
+    }
+    
+    if (seenOrder.size() >= MAX_REPLAY_ENTRIES) {
+        return false;
+    }
+    
+    std::string key(reinterpret_cast<const char*>(nonce.data()), nonce.size());
+    if (!seenNonces.emplace(key, now).second) {
+        return false;
+    }
+    seenOrder.emplace_back(now, std::move(key));
+    return true;
+}
+
 //=============================================================================
 // CLIENT HANDSHAKE STATE MACHINE
 //=============================================================================
@@ -504,8 +665,34 @@ std::vector<uint8_t> ClientHandshake::CreateJoinRequest(const InviteToken& invit
     return req.Serialize();
 }
 
+std::vector<uint8_t> ClientHandshake::CreateResumeRequest(const std::vector<uint8_t>& ticket,
+                                                          const std::vector<uint8_t>& sessionToken) {
+    if (state != State::Initial || ticket.empty() || sessionToken.empty()) {
+        lastError = JoinStatus::InvalidMessage;
+        return {};
+    }
+    
+    ResumeRequest req;
+    req.ticket = ticket;
+    req.timestamp = static_cast<int64_t>(std::time(nullptr));
+    
+    if (GenerateNonce(req.clientNonce) != CryptoResult::Success ||
+        ComputeHMACSHA256(sessionToken.data(), sessionToken.size(), req.ProofData(),
+                          req.proof) != CryptoResult::Success) {
+        state = State::Failed;
+        lastError = JoinStatus::ConnectionFailed;
+        return {};
+    }
+    
+    clientNonce = req.clientNonce;
+    resumeSessionToken = sessionToken;
+    
+    state = State::WaitingForResumeResponse;
+    return req.Serialize();
+}
+
 bool ClientHandshake::ProcessJoinResponse(const std::vector<uint8_t>& data) {
-    if (state != State::WaitingForJoinResponse) {
+    if (state != State::WaitingForJoinResponse && state != State::WaitingForResumeResponse) {
         lastError = JoinStatus::InvalidMessage;
         state = State::Failed;
         return false;
@@ -518,6 +705,21 @@ bool ClientHandshake::ProcessJoinResponse(const std::vector<uint8_t>& data) {
         return false;
     }
     
+    // A resumed session has no signature; the server proves itself with the old token
+    if (state == State::WaitingForResumeResponse && resp->status == JoinStatus::Success) {
+        std::array<uint8_t, 32> expectedProof;
+        if (resp->serverProof.size() != expectedProof.size() ||
+            ComputeHMACSHA256(resumeSessionToken.data(), resumeSessionToken.size(),
+                              ServerProofData(clientNonce, resp->resumptionTicket),
+                              expectedProof) != CryptoResult::Success ||
+            !ConstantTimeEquals(expectedProof.data(), resp->serverProof.data(), expectedProof.size())) {
+            printf("[HANDSHAKE] Resume response failed verification\n");
+            lastError = JoinStatus::SignatureInvalid;
+            state = State::Failed;
+            return false;
+        }
+    }
+    
     joinResult = *resp;
     lastError = resp->status;
     
@@ -538,11 +740,13 @@ bool ClientHandshake::ProcessJoinResponse(const std::vector<uint8_t>& data) {
 //=============================================================================
 
 ServerHandshake::ServerHandshake(const ServerIdentity& serverIdentity,
-                                 InviteManager& inviteManager)
+                                 InviteManager& inviteManager,
+                                 ResumptionTickets* resumptionTickets)
     : state(State::WaitingForClientHello)
     , lastError(JoinStatus::Success)
     , serverIdentity(serverIdentity)
-    , inviteManager(inviteManager) {
+    , inviteManager(inviteManager)
+    , resumptionTickets(resumptionTickets) {
 }
 
 std::vector<uint8_t> ServerHandshake::ProcessClientHello(const std::vector<uint8_t>& data) {
@@ -664,20 +868,31 @@ std::vector<uint8_t> ServerHandshake::ProcessJoinRequest(
     // Invite is valid - assign user
     InvitePermission perms = token->GetPermissions();
     uint64_t userId = assignUserCallback(req->usernameHint, perms);
+    std::string username = req->usernameHint.empty() ? "User" + std::to_string(userId) : req->usernameHint;
     
-    // Generate session token
-    std::vector<uint8_t> sessionToken(32);
-    if (GenerateRandomBytes(sessionToken.data(), 32) != CryptoResult::Success) {
-        resp.status = JoinStatus::InvalidMessage;
-        lastError = resp.status;
-        state = State::Failed;
-        return resp.Serialize();
+    // Generate session token (derived from the ticket when resumption is on)
+    std::vector<uint8_t> sessionToken;
+    std::optional<ResumptionTickets::Issued> issued;
+    if (resumptionTickets) {
+        issued = resumptionTickets->Issue(userId, username, static_cast<uint64_t>(perms));
+    }
+    if (issued) {
+        sessionToken = issued->sessionToken;
+        resp.resumptionTicket = issued->ticket;
+    } else {
+        sessionToken.resize(32);
+        if (GenerateRandomBytes(sessionToken.data(), 32) != CryptoResult::Success) {
+            resp.status = JoinStatus::InvalidMessage;
+            lastError = resp.status;
+            state = State::Failed;
+            return resp.Serialize();
+        }
     }
     
     // Build success response
     resp.status = JoinStatus::Success;
     resp.assignedUserId = userId;
-    resp.assignedUsername = req->usernameHint.empty() ? "User" + std::to_string(userId) : req->usernameHint;
+    resp.assignedUsername = username;
     resp.sessionToken = sessionToken;
     resp.permissions = static_cast<uint64_t>(perms);
     resp.serverName = "Secure Server"; // Would come from server config
@@ -692,4 +907,83 @@ std::vector<uint8_t> ServerHandshake::ProcessJoinRequest(
     return resp.Serialize();
 }
 
+std::vector<uint8_t> ServerHandshake::ProcessResumeRequest(
+    const std::vector<uint8_t>& data,
+    std::function<bool(uint64_t userId)> isStillAllowed) {
+    
+    JoinResponse resp;
+    
+    if (state != State::WaitingForClientHello) {
+        lastError = JoinStatus::InvalidMessage;
+        state = State::Failed;
+        resp.status = JoinStatus::InvalidMessage;
+        return resp.Serialize();
+    }
+    
+    auto req = ResumeRequest::Parse(data);
+    if (!req) {
+        lastError = JoinStatus::InvalidMessage;
+        state = State::Failed;
+        resp.status = JoinStatus::InvalidMessage;
+        return resp.Serialize();
+    }
+    
+    // MAC, expiry, proof of the session token and replay: symmetric checks only
+    std::optional<ResumptionTickets::Session> session;
+    if (resumptionTickets) {
+        session = resumptionTickets->Redeem(*req);
+    }
+    if (!session) {
+        lastError = JoinStatus::ResumeRejected;
+        state = State::Failed;
+        resp.status = JoinStatus::ResumeRejected;
+        return resp.Serialize();
+    }
+    
+    if (isStillAllowed && !isStillAllowed(session->userId)) {
+        lastError = JoinStatus::Banned;
+        state = State::Failed;
+        resp.status = JoinStatus::Banned;
+        return resp.Serialize();
+    }
+    
+    // Rotate: the next resume uses a fresh ticket and token
+    auto issued = resumptionTickets->Issue(session->userId, session->username, session->permissions);
+    if (!issued) {
+        lastError = JoinStatus::ResumeRejected;
+        state = State::Failed;
+        resp.status = JoinStatus::ResumeRejected;
+        return resp.Serialize();
+    }
+    
+    std::array<uint8_t, 32> serverProof;
+    if (ComputeHMACSHA256(session->sessionToken.data(), session->sessionToken.size(),
+                          ServerProofData(req->clientNonce, issued->ticket),
+                          serverProof) != CryptoResult::Success) {
+        lastError = JoinStatus::ResumeRejected;
+        state = State::Failed;
+        resp.status = JoinStatus::ResumeRejected;
+        return resp.Serialize();
+    }
+    
+    // Build success response
+    resp.status = JoinStatus::Success;
+    resp.assignedUserId = session->userId;
+    resp.assignedUsername = session->username;
+    resp.sessionToken = issued->sessionToken;
+    resp.permissions = session->permissions;
+    resp.serverName = "Secure Server"; // Would come from server config
+    resp.serverDescription = "";
+    resp.resumptionTicket = issued->ticket;
+    resp.serverProof.assign(serverProof.begin(), serverProof.end());
+    
+    state = State::Completed;
+    lastError = JoinStatus::Success;
+    
+    printf("[HANDSHAKE] User %llu (%s) resumed session\n",
+           resp.assignedUserId, resp.assignedUsername.c_str());
+    
+    return resp.Serialize();
+}
+
 } // namespace Security
@@ -23,9 +23,28 @@
  *      │   [Server validates invite]                   │
  *      │                                               │
  *      │<───────── JoinResponse ───────────────────────│
- *      │   { status, session_token, user_info }        │
+ *      │   { status, session_token, user_info,         │
+ *      │     resumption_ticket }                       │
  *      │                                               │
  * 
+ * RESUMPTION (one round trip, no signatures):
+ * 
+ *      │────────── ResumeRequest ─────────────────────>│
+ *      │   { ticket, client_nonce, timestamp,          │
+ *      │     HMAC(session_token, ticket || nonce ||    │
+ *      │          timestamp) }                         │
+ *      │                                               │
+ *      │<───────── JoinResponse ───────────────────────│
+ *      │   { ..., new session_token, new ticket,       │
+ *      │     HMAC(old session_token, nonce || ticket) }│
+ * 
+ * The ticket is opaque to the client: the server MACs it with a key only it
+ * holds, and derives the session token from it, so on resume it recovers
+ * the token without keeping per-session state. Proving knowledge of the
+ * token authenticates the client; the reply's MAC proves the server holds
+ * the ticket key. A rejected resume (ResumeRejected) falls back to the full
+ * handshake.
+ * 
  * SECURITY PROPERTIES:
  * - Server authentication: Client verifies server's signature
  * - Replay protection: Fresh nonces, timestamps with bounded skew
@@ -43,12 +62,15 @@
 
 #include "ServerIdentity.h"
 #include "InviteToken.h"
+#include "FlatHashMap.h"
 #include <string>
 #include <vector>
 #include <cstdint>
 #include <ctime>
 #include <optional>
 #include <functional>
+#include <deque>
+#include <mutex>
 
 namespace Security {
 
@@ -66,6 +88,7 @@ enum class HandshakeMessageType : uint8_t {
     ServerHello = 0x02,
     JoinRequest = 0x03,
     JoinResponse = 0x04,
+    ResumeRequest = 0x05,
     Error = 0xFF
 };
 
@@ -82,6 +105,7 @@ enum class JoinStatus : uint8_t {
     InviteRevoked = 0x04,
     ServerFull = 0x05,
     Banned = 0x06,
+    ResumeRejected = 0x07,  // Ticket unknown, expired or replayed: do a full handshake
     
     // Protocol errors
     VersionMismatch = 0x10,
@@ -190,10 +214,109 @@ struct JoinResponse {
     std::string serverName;
     std::string serverDescription;
     
+    // Present on success when the server issues tickets (appended fields;
+    // older peers neither send nor read them)
+    std::vector<uint8_t> resumptionTicket;  // Present in the next ResumeRequest
+    std::vector<uint8_t> serverProof;       // Resume only: HMAC proving the server holds the ticket key
+    
     std::vector<uint8_t> Serialize() const;
     static std::optional<JoinResponse> Parse(const std::vector<uint8_t>& data);
 };
 
+/**
+ * @brief ResumeRequest - Returning client's first and only message
+ * 
+ * Replaces ClientHello + JoinRequest when the client holds a ticket from
+ * an earlier JoinResponse.
+ */
+struct ResumeRequest {
+    std::vector<uint8_t> ticket;
+    std::array<uint8_t, NONCE_SIZE> clientNonce;
+    int64_t timestamp;                          // Unix timestamp
+    std::array<uint8_t, 32> proof;              // HMAC(session_token, ticket || nonce || timestamp)
+    
+    std::vector<uint8_t> Serialize() const;
+    static std::optional<ResumeRequest> Parse(const std::vector<uint8_t>& data);
+    
+    /**
+     * @brief The MAC input for proof
+     */
+    std::vector<uint8_t> ProofData() const;
+};
+
+//=============================================================================
+// RESUMPTION TICKETS
+//=============================================================================
+
+/**
+ * @brief Issues and redeems the server's session resumption tickets
+ * 
+ * TICKET LAYOUT:
+ *   body = [u8 version][16-byte ticket ID][u64 userId][u64 permissions]
+ *          [i64 issuedAt][i64 expiresAt][u16 len][username]
+ *   ticket = body || HMAC(key, "ticket" || body)
+ *   session token = HMAC(key, "session" || body)
+ * 
+ * Only a MAC check and two HMACs per resume; nothing is looked up or
+ * stored per session. The key is random per instance, so tickets do not
+ * survive a restart (clients fall back to the full handshake).
+ * 
+ * REPLAY:
+ * A request is only accepted within MAX_CLOCK_SKEW of its timestamp, and
+ * each client nonce is accepted once within that window.
+ * 
+ * THREADING:
+ * Thread-safe; one instance is shared by every ServerHandshake.
+ */
+class ResumptionTickets {
+public:
+    /** How long a ticket stays redeemable after it is issued */
+    static constexpr int64_t TICKET_LIFETIME = 24 * 60 * 60;
+    
+    /** Nonces remembered for replay detection before resumes are refused */
+    static constexpr size_t MAX_REPLAY_ENTRIES = 65536;
+    
+    struct Issued {
+        std::vector<uint8_t> ticket;
+        std::vector<uint8_t> sessionToken;
+    };
+    
+    struct Session {
+        uint64_t userId = 0;
+        std::string username;
+        uint64_t permissions = 0;
+        std::vector<uint8_t> sessionToken;  // Of the redeemed ticket
+    };
+    
+    ResumptionTickets();
+    ~ResumptionTickets();
+    
+    ResumptionTickets(const ResumptionTickets&) = delete;
+    ResumptionTickets& operator=(const ResumptionTickets&) = delete;
+    
+    /**
+     * @brief Issue a ticket and the session token bound to it
+     */
+    std::optional<Issued> Issue(uint64_t userId, const std::string& username, uint64_t permissions);
+    
+    /**
+     * @brief Check a ResumeRequest; nullopt if it must not be resumed
+     */
+    std::optional<Session> Redeem(const ResumeRequest& request);
+
+private:
+    std::array<uint8_t, 32> key;
+    bool ready;
+    
+    // Client nonces accepted recently, oldest first in seenOrder
+    std::mutex replayMutex;
+    FlatHashMap<std::string, int64_t> seenNonces;
+    std::deque<std::pair<int64_t, std::string>> seenOrder;
+    
+    bool keyedMac(const char* label, ByteView body, std::array<uint8_t, 32>& mac) const;
+    bool acceptNonce(const std::array<uint8_t, NONCE_SIZE>& nonce, int64_t now);
+};
+
 //=============================================================================
 // HANDSHAKE STATE MACHINES
 //=============================================================================
@@ -215,6 +338,7 @@ public:
         WaitingForServerHello,
         ServerVerified,
         WaitingForJoinResponse,
+        WaitingForResumeResponse,
         Completed,
         Failed
     };
@@ -245,7 +369,18 @@ public:
                                            const std::string& usernameHint = "");
     
     /**
-     * @brief Process received JoinResponse
+     * @brief Create a ResumeRequest instead of a ClientHello
+     * @param ticket JoinResponse::resumptionTicket from the last join
+     * @param sessionToken JoinResponse::sessionToken from the same response
+     * 
+     * The answer is a JoinResponse; on ResumeRejected, start over with a
+     * new ClientHandshake and CreateClientHello().
+     */
+    std::vector<uint8_t> CreateResumeRequest(const std::vector<uint8_t>& ticket,
+                                             const std::vector<uint8_t>& sessionToken);
+    
+    /**
+     * @brief Process received JoinResponse (after a JoinRequest or ResumeRequest)
      * @return true if join was successful
      */
     bool ProcessJoinResponse(const std::vector<uint8_t>& data);
@@ -271,6 +406,7 @@ private:
     std::array<uint8_t, NONCE_SIZE> clientNonce;
     std::array<uint8_t, NONCE_SIZE> serverNonce;
     std::optional<ServerIdentity> verifiedServer;
+    std::vector<uint8_t> resumeSessionToken;    // Checks the server's proof on resume
     
     // Result
     JoinResponse joinResult;
@@ -299,9 +435,11 @@ public:
      * @brief Create a server handshake handler
      * @param serverIdentity Server's cryptographic identity
      * @param inviteManager Manager for invite validation
+     * @param resumptionTickets Issues tickets on join (null = no resumption)
      */
     ServerHandshake(const ServerIdentity& serverIdentity,
-                    InviteManager& inviteManager);
+                    InviteManager& inviteManager,
+                    ResumptionTickets* resumptionTickets = nullptr);
     
     /**
      * @brief Process received ClientHello
@@ -321,6 +459,17 @@ public:
         std::function<uint64_t(const std::string& username, InvitePermission perms)> assignUserCallback
     );
     
+    /**
+     * @brief Process a ResumeRequest received instead of a ClientHello
+     * @param data Received message
+     * @param isStillAllowed Asked whether the ticket's user may still join
+     * @return JoinResponse to send
+     */
+    std::vector<uint8_t> ProcessResumeRequest(
+        const std::vector<uint8_t>& data,
+        std::function<bool(uint64_t userId)> isStillAllowed
+    );
+    
     // State accessors
     State GetState() const { return state; }
     JoinStatus GetLastError() const { return lastError; }
@@ -331,6 +480,7 @@ private:
     
     const ServerIdentity& serverIdentity;
     InviteManager& inviteManager;
+    ResumptionTickets* resumptionTickets;
     
     // Handshake state
     std::array<uint8_t, NONCE_SIZE> clientNonce;
@@ -353,6 +503,13 @@ std::vector<uint8_t> WrapMessage(HandshakeMessageType type, const std::vector<ui
 std::optional<std::pair<HandshakeMessageType, std::vector<uint8_t>>> 
 UnwrapMessage(const std::vector<uint8_t>& data);
 
+/**
+ * @brief Unwrap a handshake message without copying the payload
+ * @return Type and a view into data (valid while data is)
+ */
+std::optional<std::pair<HandshakeMessageType, ByteView>>
+UnwrapMessageView(const std::vector<uint8_t>& data);
+
 } // namespace Security
 
 #endif // SECURE_HANDSHAKE_H
@@ -7,6 +7,7 @@
 #include "ServerManager.h"
 #include "UserDatabase.h"
 #include "FriendService.h"
+#include <FL/Fl.H>
 #include <FL/fl_ask.H>
 #include <FL/Fl_Window.H>
 
@@ -39,14 +40,16 @@ ServerBrowser::ServerBrowser(int x, int y, int width, int height,
     , addServerButton(nullptr)
     , friendsButton(nullptr)
     , settingsButton(nullptr)
-    , logoutButton(nullptr) {
+    , logoutButton(nullptr)
+    , loadScheduled(false) {
     
     setupLayout();
     end();
 }
 
 ServerBrowser::~ServerBrowser() {
-    // FLTK handles cleanup
+    // FLTK handles the widgets; a pending load must not run on a dead page
+    Fl::remove_timeout(loadServerListCallback, this);
 }
 
 void ServerBrowser::setupLayout() {
@@ -109,6 +112,9 @@ void ServerBrowser::setupLayout() {
 }
 
 void ServerBrowser::setCurrentUser(uint64_t userId, const std::string& username) {
+    if (userId != currentUserId) {
+        cachedServers.clear();      // Another user's list must not linger
+    }
     currentUserId = userId;
     currentUsername = username;
     
@@ -117,18 +123,36 @@ void ServerBrowser::setCurrentUser(uint64_t userId, const std::string& username)
     userInfoBox->copy_label(displayText.c_str());
     
     refreshServerList();
-    updateFriendBadge();
 }
 
 void ServerBrowser::refreshServerList() {
+    if (currentUserId == 0 || !serverManager || loadScheduled) {
+        return;
+    }
+    
+    if (cachedServers.empty()) {
+        serverList->clear();
+        serverList->add("@i@- Loading servers -");
+    }
+    loadScheduled = true;
+    Fl::add_timeout(0.0, loadServerListCallback, this);
+}
+
+void ServerBrowser::loadServerListCallback(void* userdata) {
+    ServerBrowser* browser = static_cast<ServerBrowser*>(userdata);
+    browser->loadScheduled = false;
+    browser->loadServerList();
+}
+
+void ServerBrowser::loadServerList() {
     if (currentUserId == 0 || !serverManager) {
         return;
     }
     
     serverList->clear();
-    cachedServers = serverManager->GetUserServers(currentUserId);
+    cachedServers = serverManager->GetUserServerSummaries(currentUserId);
     
-    for (const Models::ChatServer& server : cachedServers) {
+    for (const ServerManager::ServerSummary& server : cachedServers) {
         std::string displayName = server.serverName;
         
         // Indicate if user is owner
@@ -142,6 +166,8 @@ void ServerBrowser::refreshServerList() {
     if (cachedServers.empty()) {
         serverList->add("@i@- No servers joined -");
     }
+    
+    updateFriendBadge();
 }
 
 void ServerBrowser::setOnServerSelected(ServerSelectedCallback callback) {
@@ -217,7 +243,7 @@ void ServerBrowser::showJoinServerDialog() {
     const char* searchTerm = fl_input("Search for a server to join:", "");
     
     if (searchTerm && strlen(searchTerm) > 0) {
-        std::vector<Models::ChatServer> results = serverManager->SearchServers(searchTerm, 10);
+        std::vector<Protocol::Payloads::ServerInfo> results = serverManager->SearchServers(searchTerm, 10);
         
         if (results.empty()) {
             fl_message("No servers found matching '%s'", searchTerm);
@@ -225,7 +251,7 @@ void ServerBrowser::showJoinServerDialog() {
         }
         
         // Show first result (simplified - in full version would show list)
-        const Models::ChatServer& server = results[0];
+        const Protocol::Payloads::ServerInfo& server = results[0];
         
         int choice = fl_choice("Found server: %s\n\nJoin this server?",
                                "Cancel", "Join", nullptr,
@@ -271,7 +297,7 @@ void ServerBrowser::onServerListSelected(Fl_Widget* widget, void* userdata) {
     }
     
     // Adjust for 1-based indexing
-    const Models::ChatServer& server = browser->cachedServers[selected - 1];
+    const ServerManager::ServerSummary& server = browser->cachedServers[selected - 1];
     
     if (browser->onServerSelectedCallback) {
         browser->onServerSelectedCallback(server.serverId, server.serverName);
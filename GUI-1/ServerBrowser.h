@@ -22,9 +22,9 @@
 #include <vector>
 #include <string>
 #include "Models.h"
+#include "ServerManager.h"
 
 // Forward declarations
-class ServerManager;
 class UserDatabase;
 class FriendService;
 
@@ -55,6 +55,9 @@ public:
     
     /**
      * @brief Refresh the server list
+     * 
+     * The list is read on the next turn of the event loop, so the page is
+     * drawn first (with a placeholder if nothing is cached yet).
      */
     void refreshServerList();
     
@@ -104,7 +107,8 @@ private:
     Fl_Button* logoutButton;       // Logout
     
     // Server data cache
-    std::vector<Models::ChatServer> cachedServers;
+    std::vector<ServerManager::ServerSummary> cachedServers;
+    bool loadScheduled;
     
     // Layout helpers
     void setupLayout();
@@ -115,6 +119,10 @@ private:
     static void onFriendsClicked(Fl_Widget* widget, void* userdata);
     static void onSettingsClicked(Fl_Widget* widget, void* userdata);
     static void onLogoutClicked(Fl_Widget* widget, void* userdata);
+    static void loadServerListCallback(void* userdata);
+    
+    // Fill the server list and friend badge from the services
+    void loadServerList();
     
     // Update friend notification badge
     void updateFriendBadge();
@@ -0,0 +1,19 @@
+/**
+ * @file ServerConfig.cpp
+ * @brief Loading of the shared server configuration
+ */
+
+#include "ServerConfig.h"
+#include <cstdio>
+
+std::shared_ptr<const ServerConfig> ServerConfig::Load(const std::string& path) {
+    std::shared_ptr<ServerConfig> config(new ServerConfig());
+    config->path = path;
+
+    pugi::xml_parse_result result = config->document.load_file(path.c_str());
+    if (!result) {
+        printf("[SERVER] No usable config at %s (%s); using defaults\n", path.c_str(), result.description());
+        config->document.reset();
+    }
+    return config;
+}
@@ -0,0 +1,44 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+/**
+ * @file ServerConfig.h
+ * @brief Read-only server configuration shared by every accepted connection
+ *
+ * PURPOSE:
+ * Each accepted ClientSocket used to build its own Settings from
+ * config.xml, so connection churn cost an XML parse (and a save) on the
+ * server's network thread. The server now parses the file once at start-up
+ * and hands every connection the same immutable copy.
+ *
+ * THREADING:
+ * Never modified after Load(), so any thread may read it without locking.
+ */
+
+#include <memory>
+#include <string>
+#include "pugixml.hpp"
+
+class ServerConfig {
+public:
+    /**
+     * @brief Parse a config file
+     * @param path Config XML; a missing or unreadable file gives an empty config
+     */
+    static std::shared_ptr<const ServerConfig> Load(const std::string& path);
+
+    const std::string& Path() const { return path; }
+
+    /** @brief Root element of the parsed file (empty node if none) */
+    pugi::xml_node Root() const { return document.document_element(); }
+
+private:
+    std::string path;
+    pugi::xml_document document;
+
+    ServerConfig() = default;
+    ServerConfig(const ServerConfig&) = delete;
+    ServerConfig& operator=(const ServerConfig&) = delete;
+};
+
+#endif // SERVER_CONFIG_H
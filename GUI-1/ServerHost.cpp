@@ -0,0 +1,105 @@
+/**
+ * @file ServerHost.cpp
+ * @brief Implementation of the threaded server host
+ */
+
+#include "ServerHost.h"
+#include "UiDispatcher.h"
+#include "Trace.h"
+#include "Log.h"
+
+ServerHost::ServerHost(int port, PlayerDisplay* playerDisplay, const std::string& settingsPath,
+                       const ServerSocket::DataServices& services)
+    : playerDisplay(playerDisplay)
+    , running(false)
+{
+    // No PlayerDisplay for the server itself: it lives on another thread.
+    server = std::make_unique<ServerSocket>(port, nullptr, settingsPath);
+    server->setDataServices(services);
+    server->setMetricsFile(METRICS_FILE);
+
+    if (std::shared_ptr<const ShardMap> shards = ShardMap::Load(ShardMap::DEFAULT_FILE)) {
+        if (services.hostedServerId != 0 && !shards->IsLocal(services.hostedServerId)) {
+            LOG_WARNING("[SHARD] Server %llu belongs to node '%s', not this one ('%s')",
+                        services.hostedServerId, shards->NodeFor(services.hostedServerId).id.c_str(),
+                        shards->Self().id.c_str());
+        }
+        bus = std::make_unique<ShardBus>(shards);
+        server->setShardBus(bus.get());
+    }
+
+    try {
+        attachments = std::make_unique<AttachmentServer>(port + AttachmentServer::PORT_OFFSET);
+        server->setAttachmentServer(attachments.get());
+    }
+    catch (const std::exception& e) {
+        LOG_WARNING("[SERVER] Attachments disabled: %s", e.what());
+    }
+
+    directMessages = std::make_unique<DirectMessageStore>();
+    server->setDirectMessageStore(directMessages.get());
+
+    // Roster changes are marshalled to the UI thread. Only the display
+    // pointer and the username are captured, never the host itself.
+    PlayerDisplay* display = playerDisplay;
+    server->onRosterChanged = [display](const std::string& username, bool joined) {
+        if (!display) {
+            return;
+        }
+        UiDispatcher::Post([display, username, joined]() {
+            if (joined) {
+                display->addPlayer(username);
+            } else {
+                display->removePlayer(username);
+            }
+        });
+    };
+
+    running = true;
+    networkThread = std::thread(&ServerHost::Run, this);
+    LOG_INFO("[SERVER] Network thread started on port %d", port);
+}
+
+ServerHost::~ServerHost() {
+    Stop();
+}
+
+void ServerHost::Stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+
+    server->wake();
+    if (networkThread.joinable()) {
+        networkThread.join();
+    }
+
+    // Thread has exited; safe to tear down on this thread
+    server.reset();
+    attachments.reset();
+    directMessages.reset();
+    bus.reset();
+    LOG_INFO("[SERVER] Network thread stopped");
+}
+
+bool ServerHost::StartCapture(const std::string& path) {
+    // The capture locks internally, so it is safe beside the network thread
+    return server && server->startCapture(path);
+}
+
+uint64_t ServerHost::StopCapture() {
+    return server ? server->stopCapture() : 0;
+}
+
+void ServerHost::Run() {
+    Trace::SetThreadName("network");
+    while (running.load()) {
+        try {
+            server->handleClientConnections(POLL_WAIT_MS);
+        }
+        catch (const std::exception& e) {
+            // A single bad connection must not take the whole server down
+            LOG_ERROR("[SERVER] Error in network loop: %s", e.what());
+        }
+    }
+}
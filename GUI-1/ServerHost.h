@@ -0,0 +1,101 @@
+#ifndef SERVER_HOST_H
+#define SERVER_HOST_H
+
+/**
+ * @file ServerHost.h
+ * @brief Runs a ServerSocket on its own network thread, away from the FLTK loop
+ *
+ * PURPOSE:
+ * The embedded server used to be pumped from the UI timer, so a redraw, a
+ * modal dialog or a slow text-buffer append stalled every connected client.
+ * ServerHost moves the whole server onto a dedicated thread that blocks on
+ * the IOCP engine, and only sends display updates back to the UI.
+ *
+ * THREADING:
+ * - The ServerSocket is created on the caller's thread (so constructor
+ *   errors propagate as exceptions) and is then used ONLY by the network
+ *   thread until Stop()
+ * - Roster changes are posted to the UI thread through UiDispatcher;
+ *   the server never touches FLTK widgets itself
+ * - Stop() wakes the engine, joins the thread and closes all clients
+ *
+ * SHARDING:
+ * If a shard map (ShardMap::DEFAULT_FILE) is present, the host joins that
+ * deployment: it starts a ShardBus to the other nodes and serves only the
+ * servers its node owns. Without the file it runs alone, as before.
+ *
+ * ATTACHMENTS:
+ * An AttachmentServer listens on the next port up with its own thread,
+ * so file transfers never share a thread or a connection with chat. If
+ * that port cannot be opened the host still runs, without attachments.
+ *
+ * DIRECT MESSAGES:
+ * Whispers are logged to a DirectMessageStore (DirectMessageStore::DEFAULT_PATH)
+ * owned by the host.
+ */
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include "ServerSocket.h"
+#include "ShardBus.h"
+#include "AttachmentServer.h"
+#include "DirectMessageStore.h"
+#include "PlayerDisplay.hpp"
+
+class ServerHost {
+public:
+    /** How long the network thread blocks in the engine per iteration */
+    static constexpr DWORD POLL_WAIT_MS = 250;
+
+    /** Metrics snapshot rewritten by the network thread, next to the data files */
+    static constexpr const char* METRICS_FILE = "server_metrics.json";
+
+    /**
+     * @brief Create the server and start its network thread
+     * @param port Port to listen on
+     * @param playerDisplay UI roster to update (touched on the UI thread only)
+     * @param settingsPath Path to the settings XML file
+     * @param services Stores that answer data requests (must outlive the host)
+     * @throws std::runtime_error if the server socket cannot be created
+     */
+    ServerHost(int port, PlayerDisplay* playerDisplay, const std::string& settingsPath,
+               const ServerSocket::DataServices& services = ServerSocket::DataServices());
+
+    /** Stops the network thread and closes the server */
+    ~ServerHost();
+
+    /**
+     * @brief Stop serving and join the network thread (idempotent)
+     */
+    void Stop();
+
+    bool IsRunning() const { return running.load(); }
+
+    /**
+     * @brief Record the server's inbound traffic for LoadGen --replay
+     * @return False if the file could not be created or the host has stopped
+     */
+    bool StartCapture(const std::string& path);
+
+    /** @brief Finish the capture; returns records written */
+    uint64_t StopCapture();
+
+private:
+    std::unique_ptr<ShardBus> bus;              ///< Null when unsharded; outlives server
+    std::unique_ptr<AttachmentServer> attachments;  ///< Null if its port was unavailable; outlives server
+    std::unique_ptr<DirectMessageStore> directMessages;     ///< Outlives server
+    std::unique_ptr<ServerSocket> server;
+    PlayerDisplay* playerDisplay;
+    std::atomic<bool> running;
+    std::thread networkThread;
+
+    void Run();
+
+    // Disable copying and assignment
+    ServerHost(const ServerHost&) = delete;
+    ServerHost& operator=(const ServerHost&) = delete;
+};
+
+#endif // SERVER_HOST_H
@@ -8,6 +8,13 @@
  * - SHA-256 for hashing (BCRYPT_SHA256_ALGORITHM)
  * - BCryptGenRandom for secure random generation
  * 
+ * HANDLE CACHING:
+ * - Algorithm providers are opened once per process and shared; CNG
+ *   allows one algorithm handle to be used from several threads
+ * - Each identity keeps its imported key handles in a KeyCache; a handle
+ *   is leased to one caller at a time and returned afterwards
+ * - ComputeSHA256 keeps one reusable hash object per thread
+ * 
  * SECURITY CONSIDERATIONS:
  * - Private keys are cleared from memory on destruction
  * - No logging of key material
@@ -25,6 +32,7 @@
 #include <sstream>
 #include <iomanip>
 #include <cstring>
+#include <mutex>
 
 #pragma comment(lib, "bcrypt.lib")
 
@@ -46,7 +54,7 @@ public:
     }
     
     BCRYPT_ALG_HANDLE* operator&() { return &handle; }
-    operator BCRYPT_ALG_HANDLE() { return handle; }
+    operator BCRYPT_ALG_HANDLE() const { return handle; }
     
 private:
     BCRYPT_ALG_HANDLE handle;
@@ -67,6 +75,13 @@ public:
     BCRYPT_KEY_HANDLE* operator&() { return &handle; }
     operator BCRYPT_KEY_HANDLE() { return handle; }
     
+    // Hand ownership to the caller
+    BCRYPT_KEY_HANDLE release() {
+        BCRYPT_KEY_HANDLE released = handle;
+        handle = nullptr;
+        return released;
+    }
+    
 private:
     BCRYPT_KEY_HANDLE handle;
 };
@@ -86,10 +101,66 @@ public:
     BCRYPT_HASH_HANDLE* operator&() { return &handle; }
     operator BCRYPT_HASH_HANDLE() { return handle; }
     
+    void reset() {
+        if (handle) {
+            BCryptDestroyHash(handle);
+            handle = nullptr;
+        }
+    }
+    
 private:
     BCRYPT_HASH_HANDLE handle;
 };
 
+/**
+ * @brief Algorithm providers shared by every identity and thread
+ * 
+ * Opening a provider costs far more than one hash or signature, so each
+ * is opened once, on first use, and closed at exit.
+ */
+struct Providers {
+    AlgorithmHandle ecdsa;
+    AlgorithmHandle sha256;
+    AlgorithmHandle hmacSha256;
+    
+    Providers() {
+        NTSTATUS status = BCryptOpenAlgorithmProvider(&ecdsa, BCRYPT_ECDSA_P256_ALGORITHM, nullptr, 0);
+        if (!NT_SUCCESS(status)) {
+            printf("[CRYPTO] Failed to open ECDSA algorithm provider: 0x%08X\n", status);
+        }
+        status = BCryptOpenAlgorithmProvider(&sha256, BCRYPT_SHA256_ALGORITHM, nullptr, 0);
+        if (!NT_SUCCESS(status)) {
+            printf("[CRYPTO] Failed to open SHA-256 algorithm provider: 0x%08X\n", status);
+        }
+        status = BCryptOpenAlgorithmProvider(&hmacSha256, BCRYPT_SHA256_ALGORITHM, nullptr,
+                                             BCRYPT_ALG_HANDLE_HMAC_FLAG);
+        if (!NT_SUCCESS(status)) {
+            printf("[CRYPTO] Failed to open HMAC-SHA256 algorithm provider: 0x%08X\n", status);
+        }
+    }
+};
+
+static const Providers& GetProviders() {
+    static Providers providers;
+    return providers;
+}
+
+static bool HashInto(BCRYPT_HASH_HANDLE hashHandle, ByteView data,
+                     std::array<uint8_t, 32>& hash) {
+    NTSTATUS status = BCryptHashData(
+        hashHandle,
+        const_cast<uint8_t*>(data.data),
+        static_cast<ULONG>(data.size),
+        0
+    );
+    
+    if (!NT_SUCCESS(status)) {
+        return false;
+    }
+    
+    return NT_SUCCESS(BCryptFinishHash(hashHandle, hash.data(), 32, 0));
+}
+
 //=============================================================================
 // UTILITY FUNCTIONS
 //=============================================================================
@@ -154,47 +225,207 @@ CryptoResult GenerateNonce(std::array<uint8_t, NONCE_SIZE>& nonce) {
     return GenerateRandomBytes(nonce.data(), NONCE_SIZE);
 }
 
-CryptoResult ComputeSHA256(const std::vector<uint8_t>& data,
+CryptoResult ComputeSHA256(ByteView data,
                            std::array<uint8_t, 32>& hash) {
-    AlgorithmHandle algorithm;
-    NTSTATUS status = BCryptOpenAlgorithmProvider(
-        &algorithm,
-        BCRYPT_SHA256_ALGORITHM,
-        nullptr,
-        0
-    );
+    const Providers& providers = GetProviders();
+    if (!providers.sha256) {
+        return CryptoResult::InvalidData;
+    }
     
-    if (!NT_SUCCESS(status)) {
+    // Reusable hash objects (Windows 8+) reset themselves in BCryptFinishHash,
+    // so each thread creates one and keeps it
+    thread_local HashHandle reusableHash;
+    thread_local bool reusableUnavailable = false;
+    
+    if (!reusableHash && !reusableUnavailable) {
+        NTSTATUS status = BCryptCreateHash(providers.sha256, &reusableHash, nullptr, 0,
+                                           nullptr, 0, BCRYPT_HASH_REUSABLE_FLAG);
+        reusableUnavailable = !NT_SUCCESS(status);
+    }
+    
+    if (reusableHash) {
+        if (HashInto(reusableHash, data, hash)) {
+            return CryptoResult::Success;
+        }
+        // Don't reuse an object left mid-hash; make a fresh one next time
+        reusableHash.reset();
         return CryptoResult::InvalidData;
     }
     
     HashHandle hashHandle;
-    status = BCryptCreateHash(algorithm, &hashHandle, nullptr, 0, nullptr, 0, 0);
+    NTSTATUS status = BCryptCreateHash(providers.sha256, &hashHandle, nullptr, 0, nullptr, 0, 0);
     
     if (!NT_SUCCESS(status)) {
         return CryptoResult::InvalidData;
     }
     
-    status = BCryptHashData(
-        hashHandle,
-        const_cast<uint8_t*>(data.data()),
-        static_cast<ULONG>(data.size()),
-        0
-    );
+    return HashInto(hashHandle, data, hash) ? CryptoResult::Success : CryptoResult::InvalidData;
+}
+
+CryptoResult ComputeFileSHA256(const std::string& path,
+                               std::array<uint8_t, 32>& hash) {
+    const Providers& providers = GetProviders();
+    if (!providers.sha256) {
+        return CryptoResult::InvalidData;
+    }
     
-    if (!NT_SUCCESS(status)) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return CryptoResult::InvalidData;
+    }
+    
+    // A fresh object: the per-thread reusable one may be mid-use by a caller
+    HashHandle hashHandle;
+    bool ok = NT_SUCCESS(BCryptCreateHash(providers.sha256, &hashHandle, nullptr, 0, nullptr, 0, 0));
+    std::vector<uint8_t> chunk(256 * 1024);
+    while (ok) {
+        DWORD bytesRead = 0;
+        if (!ReadFile(file, chunk.data(), static_cast<DWORD>(chunk.size()), &bytesRead, nullptr)) {
+            ok = false;
+        }
+        else if (bytesRead == 0) {
+            break;
+        }
+        else {
+            ok = NT_SUCCESS(BCryptHashData(hashHandle, chunk.data(), bytesRead, 0));
+        }
+    }
+    CloseHandle(file);
+    
+    if (!ok || !NT_SUCCESS(BCryptFinishHash(hashHandle, hash.data(), 32, 0))) {
         return CryptoResult::InvalidData;
     }
+    return CryptoResult::Success;
+}
+
+CryptoResult ComputeHMACSHA256(const uint8_t* key, size_t keySize,
+                               ByteView data,
+                               std::array<uint8_t, 32>& mac) {
+    const Providers& providers = GetProviders();
+    if (!providers.hmacSha256) {
+        return CryptoResult::InvalidData;
+    }
+    
+    // Keyed hash objects can't be shared across keys, so this one lives one call
+    HashHandle hashHandle;
+    NTSTATUS status = BCryptCreateHash(providers.hmacSha256, &hashHandle, nullptr, 0,
+                                       const_cast<uint8_t*>(key), static_cast<ULONG>(keySize), 0);
     
-    status = BCryptFinishHash(hashHandle, hash.data(), 32, 0);
+    if (!NT_SUCCESS(status)) {
+        return CryptoResult::InvalidKey;
+    }
     
-    return NT_SUCCESS(status) ? CryptoResult::Success : CryptoResult::InvalidData;
+    return HashInto(hashHandle, data, mac) ? CryptoResult::Success : CryptoResult::InvalidData;
 }
 
+bool ConstantTimeEquals(const uint8_t* a, const uint8_t* b, size_t size) {
+    volatile uint8_t diff = 0;
+    for (size_t i = 0; i < size; ++i) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+//=============================================================================
+// KEY HANDLE CACHE
+//=============================================================================
+
+/**
+ * @brief Imported key handles of one identity
+ * 
+ * Handles are not shared between threads while in use: a caller leases an
+ * idle one (importing a new one only if none is idle) and returns it when
+ * done, so the pool grows to the number of concurrent callers at most.
+ */
+struct ServerIdentity::KeyCache {
+    enum Kind { PublicKey = 0, PrivateKey = 1 };
+    
+    // Idle handles kept per kind; extras are destroyed on return
+    static constexpr size_t MAX_IDLE = 8;
+    
+    std::mutex mutex;
+    std::vector<BCRYPT_KEY_HANDLE> idle[2];
+    
+    ~KeyCache() {
+        for (auto& handles : idle) {
+            for (BCRYPT_KEY_HANDLE handle : handles) {
+                BCryptDestroyKey(handle);
+            }
+        }
+    }
+    
+    void Add(Kind kind, BCRYPT_KEY_HANDLE handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle[kind].size() < MAX_IDLE) {
+            idle[kind].push_back(handle);
+        } else {
+            BCryptDestroyKey(handle);
+        }
+    }
+    
+    /**
+     * @brief One key handle, returned to the cache on destruction
+     */
+    class Lease {
+    public:
+        Lease(KeyCache& cache, Kind kind, const std::vector<uint8_t>& blob)
+            : cache(cache), kind(kind), handle(nullptr) {
+            {
+                std::lock_guard<std::mutex> lock(cache.mutex);
+                if (!cache.idle[kind].empty()) {
+                    handle = cache.idle[kind].back();
+                    cache.idle[kind].pop_back();
+                    return;
+                }
+            }
+            
+            const Providers& providers = GetProviders();
+            if (!providers.ecdsa) {
+                return;
+            }
+            
+            NTSTATUS status = BCryptImportKeyPair(
+                providers.ecdsa,
+                nullptr,
+                kind == PrivateKey ? BCRYPT_ECCPRIVATE_BLOB : BCRYPT_ECCPUBLIC_BLOB,
+                &handle,
+                const_cast<uint8_t*>(blob.data()),
+                static_cast<ULONG>(blob.size()),
+                0
+            );
+            
+            if (!NT_SUCCESS(status)) {
+                handle = nullptr;
+            }
+        }
+        
+        ~Lease() {
+            if (handle) {
+                cache.Add(kind, handle);
+            }
+        }
+        
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        
+        BCRYPT_KEY_HANDLE get() const { return handle; }
+        
+    private:
+        KeyCache& cache;
+        Kind kind;
+        BCRYPT_KEY_HANDLE handle;
+    };
+};
+
 //=============================================================================
 // SERVER IDENTITY IMPLEMENTATION
 //=============================================================================
 
+ServerIdentity::ServerIdentity()
+    : keyCache(std::make_unique<KeyCache>()) {
+}
+
 ServerIdentity::~ServerIdentity() {
     SecureClearPrivateKey();
 }
@@ -203,7 +434,8 @@ ServerIdentity::ServerIdentity(ServerIdentity&& other) noexcept
     : serverId(std::move(other.serverId))
     , publicKey(std::move(other.publicKey))
     , privateKey(std::move(other.privateKey))
-    , hasPrivateKey(other.hasPrivateKey) {
+    , hasPrivateKey(other.hasPrivateKey)
+    , keyCache(std::move(other.keyCache)) {
     other.hasPrivateKey = false;
 }
 
@@ -215,6 +447,7 @@ ServerIdentity& ServerIdentity::operator=(ServerIdentity&& other) noexcept {
         publicKey = std::move(other.publicKey);
         privateKey = std::move(other.privateKey);
         hasPrivateKey = other.hasPrivateKey;
+        keyCache = std::move(other.keyCache);
         
         other.hasPrivateKey = false;
     }
@@ -240,23 +473,14 @@ void ServerIdentity::ComputeServerId() {
 std::optional<ServerIdentity> ServerIdentity::Generate() {
     ServerIdentity identity;
     
-    // Open ECDSA P-256 algorithm provider
-    AlgorithmHandle algorithm;
-    NTSTATUS status = BCryptOpenAlgorithmProvider(
-        &algorithm,
-        BCRYPT_ECDSA_P256_ALGORITHM,
-        nullptr,
-        0
-    );
-    
-    if (!NT_SUCCESS(status)) {
-        printf("[CRYPTO] Failed to open ECDSA algorithm provider: 0x%08X\n", status);
+    const Providers& providers = GetProviders();
+    if (!providers.ecdsa) {
         return std::nullopt;
     }
     
     // Generate key pair
     KeyHandle keyPair;
-    status = BCryptGenerateKeyPair(algorithm, &keyPair, 256, 0);
+    NTSTATUS status = BCryptGenerateKeyPair(providers.ecdsa, &keyPair, 256, 0);
     
     if (!NT_SUCCESS(status)) {
         printf("[CRYPTO] Failed to generate key pair: 0x%08X\n", status);
@@ -311,6 +535,9 @@ std::optional<ServerIdentity> ServerIdentity::Generate() {
     identity.hasPrivateKey = true;
     identity.ComputeServerId();
     
+    // The generated pair is already a signing handle; keep it for Sign()
+    identity.keyCache->Add(KeyCache::PrivateKey, keyPair.release());
+    
     printf("[CRYPTO] Generated new server identity: %s\n", 
            identity.GetServerIdHex(true).c_str());
     
@@ -403,38 +630,14 @@ CryptoResult ServerIdentity::SaveToFile(const std::string& filePath) const {
     return CryptoResult::Success;
 }
 
-CryptoResult ServerIdentity::Sign(const std::vector<uint8_t>& data,
+CryptoResult ServerIdentity::Sign(ByteView data,
                                   std::array<uint8_t, SIGNATURE_SIZE>& signature) const {
-    if (!hasPrivateKey || privateKey.empty()) {
+    if (!hasPrivateKey || privateKey.empty() || !keyCache) {
         return CryptoResult::NotInitialized;
     }
     
-    // Open algorithm provider
-    AlgorithmHandle algorithm;
-    NTSTATUS status = BCryptOpenAlgorithmProvider(
-        &algorithm,
-        BCRYPT_ECDSA_P256_ALGORITHM,
-        nullptr,
-        0
-    );
-    
-    if (!NT_SUCCESS(status)) {
-        return CryptoResult::SigningFailed;
-    }
-    
-    // Import private key
-    KeyHandle keyHandle;
-    status = BCryptImportKeyPair(
-        algorithm,
-        nullptr,
-        BCRYPT_ECCPRIVATE_BLOB,
-        &keyHandle,
-        const_cast<uint8_t*>(privateKey.data()),
-        static_cast<ULONG>(privateKey.size()),
-        0
-    );
-    
-    if (!NT_SUCCESS(status)) {
+    KeyCache::Lease keyHandle(*keyCache, KeyCache::PrivateKey, privateKey);
+    if (!keyHandle.get()) {
         return CryptoResult::InvalidKey;
     }
     
@@ -446,51 +649,26 @@ CryptoResult ServerIdentity::Sign(const std::vector<uint8_t>& data,
     }
     
     // Sign the hash
+    // P-256 signatures are always SIGNATURE_SIZE bytes, so no size query is needed
     ULONG signatureSize = 0;
-    status = BCryptSignHash(keyHandle, nullptr, hash.data(), 32, nullptr, 0, &signatureSize, 0);
+    NTSTATUS status = BCryptSignHash(keyHandle.get(), nullptr, hash.data(), 32,
+                                     signature.data(), SIGNATURE_SIZE, &signatureSize, 0);
     
-    if (!NT_SUCCESS(status) || signatureSize != SIGNATURE_SIZE) {
+    if (NT_SUCCESS(status) && signatureSize != SIGNATURE_SIZE) {
         return CryptoResult::SigningFailed;
     }
     
-    status = BCryptSignHash(keyHandle, nullptr, hash.data(), 32, 
-                           signature.data(), SIGNATURE_SIZE, &signatureSize, 0);
-    
     return NT_SUCCESS(status) ? CryptoResult::Success : CryptoResult::SigningFailed;
 }
 
-CryptoResult ServerIdentity::Verify(const std::vector<uint8_t>& data,
+CryptoResult ServerIdentity::Verify(ByteView data,
                                     const std::array<uint8_t, SIGNATURE_SIZE>& signature) const {
-    if (publicKey.empty()) {
+    if (publicKey.empty() || !keyCache) {
         return CryptoResult::NotInitialized;
     }
     
-    // Open algorithm provider
-    AlgorithmHandle algorithm;
-    NTSTATUS status = BCryptOpenAlgorithmProvider(
-        &algorithm,
-        BCRYPT_ECDSA_P256_ALGORITHM,
-        nullptr,
-        0
-    );
-    
-    if (!NT_SUCCESS(status)) {
-        return CryptoResult::VerificationFailed;
-    }
-    
-    // Import public key
-    KeyHandle keyHandle;
-    status = BCryptImportKeyPair(
-        algorithm,
-        nullptr,
-        BCRYPT_ECCPUBLIC_BLOB,
-        &keyHandle,
-        const_cast<uint8_t*>(publicKey.data()),
-        static_cast<ULONG>(publicKey.size()),
-        0
-    );
-    
-    if (!NT_SUCCESS(status)) {
+    KeyCache::Lease keyHandle(*keyCache, KeyCache::PublicKey, publicKey);
+    if (!keyHandle.get()) {
         return CryptoResult::InvalidKey;
     }
     
@@ -502,8 +680,8 @@ CryptoResult ServerIdentity::Verify(const std::vector<uint8_t>& data,
     }
     
     // Verify the signature
-    status = BCryptVerifySignature(
-        keyHandle,
+    NTSTATUS status = BCryptVerifySignature(
+        keyHandle.get(),
         nullptr,
         hash.data(),
         32,
@@ -519,16 +697,14 @@ CryptoResult ServerIdentity::SignChallenge(
     const std::array<uint8_t, NONCE_SIZE>& challenge,
     std::array<uint8_t, SIGNATURE_SIZE>& signature) const {
     
-    std::vector<uint8_t> data(challenge.begin(), challenge.end());
-    return Sign(data, signature);
+    return Sign(challenge, signature);
 }
 
 CryptoResult ServerIdentity::VerifyChallenge(
     const std::array<uint8_t, NONCE_SIZE>& challenge,
     const std::array<uint8_t, SIGNATURE_SIZE>& signature) const {
     
-    std::vector<uint8_t> data(challenge.begin(), challenge.end());
-    return Verify(data, signature);
+    return Verify(challenge, signature);
 }
 
 std::string ServerIdentity::GetServerIdHex(bool truncate) const {
@@ -548,12 +724,7 @@ bool ServerIdentity::VerifyServerIdMatchesKey(
     }
     
     // Constant-time comparison to prevent timing attacks
-    volatile uint8_t diff = 0;
-    for (size_t i = 0; i < SERVER_ID_SIZE; ++i) {
-        diff |= computedId[i] ^ serverId[i];
-    }
-    
-    return diff == 0;
+    return ConstantTimeEquals(computedId.data(), serverId.data(), SERVER_ID_SIZE);
 }
 
 } // namespace Security
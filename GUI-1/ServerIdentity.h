@@ -34,6 +34,7 @@
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include "ByteStream.h"
 
 namespace Security {
 
@@ -72,6 +73,13 @@ const char* CryptoResultToString(CryptoResult result);
  * - Private key is stored in memory and should be protected
  * - On destruction, private key memory is securely cleared
  * - Key pair should be saved to encrypted storage in production
+ * 
+ * PERFORMANCE:
+ * The key blobs are imported into CNG key handles on first use and the
+ * handles are kept for the life of the identity, so Sign() and Verify()
+ * cost one ECDSA operation instead of a provider open plus a key import.
+ * A handle is only ever used by one thread at a time; concurrent callers
+ * take separate handles from a small per-identity pool.
  */
 class ServerIdentity {
 public:
@@ -127,7 +135,7 @@ public:
      * 
      * SECURITY: Requires private key (will fail for public-key-only instances)
      */
-    CryptoResult Sign(const std::vector<uint8_t>& data,
+    CryptoResult Sign(ByteView data,
                       std::array<uint8_t, SIGNATURE_SIZE>& signature) const;
     
     /**
@@ -136,7 +144,7 @@ public:
      * @param signature Signature to verify (64 bytes)
      * @return Success if signature is valid, VerificationFailed otherwise
      */
-    CryptoResult Verify(const std::vector<uint8_t>& data,
+    CryptoResult Verify(ByteView data,
                         const std::array<uint8_t, SIGNATURE_SIZE>& signature) const;
     
     /**
@@ -179,12 +187,16 @@ public:
         const std::array<uint8_t, SERVER_ID_SIZE>& serverId);
 
 private:
-    ServerIdentity() = default;
+    ServerIdentity();
+    
+    // Imported CNG key handles (defined in ServerIdentity.cpp)
+    struct KeyCache;
     
     std::array<uint8_t, SERVER_ID_SIZE> serverId;   // SHA-256(publicKey)
     std::vector<uint8_t> publicKey;                  // ECDSA P-256 public key
     std::vector<uint8_t> privateKey;                 // ECDSA P-256 private key (if owned)
     bool hasPrivateKey = false;
+    std::unique_ptr<KeyCache> keyCache;
     
     // Compute Server ID from public key
     void ComputeServerId();
@@ -215,10 +227,38 @@ CryptoResult GenerateNonce(std::array<uint8_t, NONCE_SIZE>& nonce);
  * @param data Input data
  * @param hash Output hash (32 bytes)
  * @return Success or error code
+ * 
+ * Uses a reusable hash object kept per thread; safe to call concurrently.
  */
-CryptoResult ComputeSHA256(const std::vector<uint8_t>& data,
+CryptoResult ComputeSHA256(ByteView data,
                            std::array<uint8_t, 32>& hash);
 
+/**
+ * @brief Compute the SHA-256 of a whole file, reading it in chunks
+ * @param path File to hash
+ * @param hash Output hash (32 bytes)
+ * @return Success, or InvalidData if the file cannot be read
+ */
+CryptoResult ComputeFileSHA256(const std::string& path,
+                               std::array<uint8_t, 32>& hash);
+
+/**
+ * @brief Compute HMAC-SHA256
+ * @param key MAC key
+ * @param keySize Key length in bytes
+ * @param data Input data
+ * @param mac Output MAC (32 bytes)
+ * @return Success or error code
+ */
+CryptoResult ComputeHMACSHA256(const uint8_t* key, size_t keySize,
+                               ByteView data,
+                               std::array<uint8_t, 32>& mac);
+
+/**
+ * @brief Compare two buffers in time independent of where they differ
+ */
+bool ConstantTimeEquals(const uint8_t* a, const uint8_t* b, size_t size);
+
 /**
  * @brief Convert bytes to hex string
  */
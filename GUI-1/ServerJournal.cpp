@@ -0,0 +1,575 @@
+/**
+ * @file ServerJournal.cpp
+ * @brief Implementation of the server and channel change journal
+ */
+
+#include "ServerJournal.h"
+#include "MessageLog.h"
+#define NOMINMAX
+#include <Windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char JOURNAL_MAGIC[8] = { 'C', 'H', 'S', 'J', 'R', '0', '0', '1' };
+
+/** Magic + generation */
+constexpr size_t JOURNAL_HEADER_SIZE = 16;
+
+/** [u32 bodyLength][u32 crc32] */
+constexpr size_t RECORD_HEADER_SIZE = 8;
+
+constexpr size_t MAX_FIELD_LENGTH = 0xFFFF;
+
+/**
+ * High word of the byte the cross-process lock covers. Far past any real
+ * journal size, so holding it never blocks reads or appends of the data.
+ */
+constexpr DWORD LOCK_OFFSET_HIGH = 0x40000000;
+
+//=============================================================================
+// LITTLE-ENDIAN FIELD HELPERS
+//=============================================================================
+
+void PutU16(std::string& out, uint16_t value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+void PutU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void PutU64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void PutString(std::string& out, const std::string& value) {
+    PutU16(out, static_cast<uint16_t>(value.size()));
+    out.append(value);
+}
+
+uint64_t ReadLE(const char* data, size_t width) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < width; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief Bounds-checked reader over one record body
+ */
+class BodyReader {
+public:
+    BodyReader(const char* data, size_t size) : m_data(data), m_size(size), m_pos(0), m_ok(true) {}
+
+    uint64_t Get(size_t width) {
+        if (!m_ok || m_size - m_pos < width) {
+            m_ok = false;
+            return 0;
+        }
+        uint64_t value = ReadLE(m_data + m_pos, width);
+        m_pos += width;
+        return value;
+    }
+
+    std::string GetString() {
+        size_t length = static_cast<size_t>(Get(2));
+        if (!m_ok || m_size - m_pos < length) {
+            m_ok = false;
+            return {};
+        }
+        std::string value(m_data + m_pos, length);
+        m_pos += length;
+        return value;
+    }
+
+    bool Finished() const { return m_ok && m_pos == m_size; }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_pos;
+    bool m_ok;
+};
+
+/**
+ * @brief Append one framed record to out
+ * @return False if a string is too long to read back
+ */
+bool EncodeDelta(const ServerJournal::Delta& delta, std::string& out) {
+    using Type = ServerJournal::DeltaType;
+    if (delta.name.size() > MAX_FIELD_LENGTH || delta.channelName.size() > MAX_FIELD_LENGTH) {
+        return false;
+    }
+
+    // Body is built after a placeholder header, then the header is filled in
+    size_t start = out.size();
+    out.append(RECORD_HEADER_SIZE, '\0');
+    out.push_back(static_cast<char>(delta.type));
+    PutU64(out, delta.writerId);
+
+    switch (delta.type) {
+        case Type::ServerCreated:
+            PutU64(out, delta.serverId);
+            PutU64(out, delta.userId);
+            PutU64(out, static_cast<uint64_t>(static_cast<int64_t>(delta.createdAt)));
+            PutString(out, delta.name);
+            PutU64(out, delta.channelId);
+            PutString(out, delta.channelName);
+            break;
+        case Type::ServerDeleted:
+            PutU64(out, delta.serverId);
+            break;
+        case Type::ServerRenamed:
+            PutU64(out, delta.serverId);
+            PutString(out, delta.name);
+            break;
+        case Type::ServerNetworkInfo:
+            PutU64(out, delta.serverId);
+            PutString(out, delta.name);
+            PutU16(out, delta.port);
+            break;
+        case Type::ServerOnline:
+            PutU64(out, delta.serverId);
+            out.push_back(delta.online ? 1 : 0);
+            break;
+        case Type::MemberAdded:
+        case Type::MemberRemoved:
+        case Type::OwnerChanged:
+            PutU64(out, delta.serverId);
+            PutU64(out, delta.userId);
+            break;
+        case Type::ChannelCreated:
+            PutU64(out, delta.channelId);
+            PutU64(out, delta.serverId);
+            PutU64(out, static_cast<uint64_t>(static_cast<int64_t>(delta.createdAt)));
+            PutString(out, delta.name);
+            break;
+        case Type::ChannelDeleted:
+            PutU64(out, delta.channelId);
+            break;
+        case Type::ChannelRenamed:
+            PutU64(out, delta.channelId);
+            PutString(out, delta.name);
+            break;
+        default:
+            out.resize(start);
+            return false;
+    }
+
+    size_t bodyLength = out.size() - start - RECORD_HEADER_SIZE;
+    std::string header;
+    PutU32(header, static_cast<uint32_t>(bodyLength));
+    PutU32(header, MessageLog::Checksum(out.data() + start + RECORD_HEADER_SIZE, bodyLength));
+    out.replace(start, RECORD_HEADER_SIZE, header);
+    return true;
+}
+
+bool DecodeBody(const char* data, size_t size, ServerJournal::Delta& out) {
+    using Type = ServerJournal::DeltaType;
+    BodyReader reader(data, size);
+    ServerJournal::Delta delta;
+
+    delta.type = static_cast<Type>(reader.Get(1));
+    delta.writerId = reader.Get(8);
+
+    switch (delta.type) {
+        case Type::ServerCreated:
+            delta.serverId = reader.Get(8);
+            delta.userId = reader.Get(8);
+            delta.createdAt = static_cast<std::time_t>(static_cast<int64_t>(reader.Get(8)));
+            delta.name = reader.GetString();
+            delta.channelId = reader.Get(8);
+            delta.channelName = reader.GetString();
+            break;
+        case Type::ServerDeleted:
+            delta.serverId = reader.Get(8);
+            break;
+        case Type::ServerRenamed:
+            delta.serverId = reader.Get(8);
+            delta.name = reader.GetString();
+            break;
+        case Type::ServerNetworkInfo:
+            delta.serverId = reader.Get(8);
+            delta.name = reader.GetString();
+            delta.port = static_cast<uint16_t>(reader.Get(2));
+            break;
+        case Type::ServerOnline:
+            delta.serverId = reader.Get(8);
+            delta.online = reader.Get(1) != 0;
+            break;
+        case Type::MemberAdded:
+        case Type::MemberRemoved:
+        case Type::OwnerChanged:
+            delta.serverId = reader.Get(8);
+            delta.userId = reader.Get(8);
+            break;
+        case Type::ChannelCreated:
+            delta.channelId = reader.Get(8);
+            delta.serverId = reader.Get(8);
+            delta.createdAt = static_cast<std::time_t>(static_cast<int64_t>(reader.Get(8)));
+            delta.name = reader.GetString();
+            break;
+        case Type::ChannelDeleted:
+            delta.channelId = reader.Get(8);
+            break;
+        case Type::ChannelRenamed:
+            delta.channelId = reader.Get(8);
+            delta.name = reader.GetString();
+            break;
+        default:
+            return false;
+    }
+
+    if (!reader.Finished()) {
+        return false;
+    }
+    out = std::move(delta);
+    return true;
+}
+
+/**
+ * @return Bytes consumed, or 0 if the record is short or corrupt
+ */
+size_t DecodeDelta(const char* data, size_t available, ServerJournal::Delta& out) {
+    if (available < RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t length = static_cast<uint32_t>(ReadLE(data, 4));
+    uint32_t crc = static_cast<uint32_t>(ReadLE(data + 4, 4));
+    const char* body = data + RECORD_HEADER_SIZE;
+
+    if (length > ServerJournal::MAX_RECORD_SIZE || available - RECORD_HEADER_SIZE < length ||
+        MessageLog::Checksum(body, length) != crc) {
+        return 0;
+    }
+    if (!DecodeBody(body, length, out)) {
+        return 0;
+    }
+    return RECORD_HEADER_SIZE + length;
+}
+
+OVERLAPPED OverlappedAt(uint64_t offset) {
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    return overlapped;
+}
+
+/** @brief Read up to length bytes at offset; out holds what was read */
+void ReadAt(HANDLE file, uint64_t offset, size_t length, std::string& out) {
+    out.resize(length);
+    size_t done = 0;
+    while (done < length) {
+        OVERLAPPED overlapped = OverlappedAt(offset + done);
+        DWORD chunk = static_cast<DWORD>((std::min)(length - done, static_cast<size_t>(1) << 30));
+        DWORD read = 0;
+        if (!ReadFile(file, &out[done], chunk, &read, &overlapped) || read == 0) {
+            break;
+        }
+        done += read;
+    }
+    out.resize(done);
+}
+
+std::string MakeHeader(uint64_t generation) {
+    std::string header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    PutU64(header, generation);
+    return header;
+}
+
+} // namespace
+
+//=============================================================================
+// SERVER JOURNAL
+//=============================================================================
+
+ServerJournal::ServerJournal(const std::string& path, uint64_t writerId)
+    : m_path(path)
+    , m_writerId(writerId)
+    , m_generation(0)
+    , m_readOffset(0)
+    , m_records(0)
+    , m_bytes(0) {
+}
+
+ServerJournal::~ServerJournal() {
+    writePending();
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+}
+
+ServerJournal::Lock::Lock(ServerJournal& journal, bool exclusive)
+    : m_journal(journal)
+    , m_held(journal.lock(exclusive)) {
+}
+
+ServerJournal::Lock::~Lock() {
+    if (m_held) {
+        m_journal.unlock();
+    }
+}
+
+size_t ServerJournal::Replay(const std::function<void(const Delta&)>& apply, bool& tornTail) {
+    tornTail = false;
+    m_generation = 0;
+    m_readOffset = 0;
+    m_records = 0;
+    m_bytes = 0;
+
+    Lock hold(*this, false);
+    uint64_t size = 0;
+    if (!hold.Held() || !fileSize(size) || size == 0) {
+        return 0;
+    }
+    std::string data;
+    ReadAt(m_file, 0, static_cast<size_t>(size), data);
+
+    if (data.size() < JOURNAL_HEADER_SIZE || std::memcmp(data.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+        printf("[DB] Server journal %s has an unknown header, ignoring it\n", m_path.c_str());
+        tornTail = true;
+        return 0;
+    }
+    m_generation = ReadLE(data.data() + sizeof(JOURNAL_MAGIC), 8);
+
+    size_t pos = JOURNAL_HEADER_SIZE;
+    while (pos < data.size()) {
+        Delta delta;
+        size_t used = DecodeDelta(data.data() + pos, data.size() - pos, delta);
+        if (used == 0) {
+            tornTail = true;
+            break;
+        }
+
+        apply(delta);
+        ++m_records;
+        pos += used;
+    }
+
+    m_readOffset = pos;
+    m_bytes = pos - JOURNAL_HEADER_SIZE;
+
+    if (tornTail) {
+        printf("[DB] Server journal %s has a damaged tail after %zu records\n",
+               m_path.c_str(), m_records);
+    }
+    return m_records;
+}
+
+size_t ServerJournal::ReadNew(const std::function<void(const Delta&)>& apply, bool& checkpointed) {
+    checkpointed = false;
+
+    // Shared: a Reset() in another instance cannot run while we read
+    Lock hold(*this, false);
+    uint64_t size = 0;
+    if (!hold.Held() || !fileSize(size)) {
+        return 0;
+    }
+
+    std::string header;
+    ReadAt(m_file, 0, JOURNAL_HEADER_SIZE, header);
+    if (header.size() < JOURNAL_HEADER_SIZE) {
+        // Empty (not created yet): nothing new unless we had read before
+        checkpointed = m_readOffset != 0;
+        return 0;
+    }
+    if (std::memcmp(header.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        ReadLE(header.data() + sizeof(JOURNAL_MAGIC), 8) != m_generation) {
+        checkpointed = true;
+        return 0;
+    }
+
+    uint64_t start = (std::max)(m_readOffset, static_cast<uint64_t>(JOURNAL_HEADER_SIZE));
+    if (size < start) {
+        checkpointed = true;
+        return 0;
+    }
+    if (size == start) {
+        return 0;
+    }
+
+    std::string data;
+    ReadAt(m_file, start, static_cast<size_t>(size - start), data);
+
+    size_t pos = 0;
+    size_t applied = 0;
+    while (pos < data.size()) {
+        Delta delta;
+        size_t used = DecodeDelta(data.data() + pos, data.size() - pos, delta);
+        if (used == 0) {
+            break;      // Torn by a crashed writer; the next checkpoint drops it
+        }
+        pos += used;
+
+        if (delta.writerId == m_writerId) {
+            continue;   // Already applied (and counted) when we appended it
+        }
+        apply(delta);
+        ++applied;
+        ++m_records;
+        m_bytes += used;
+    }
+
+    m_readOffset = start + pos;
+    return applied;
+}
+
+bool ServerJournal::Append(std::vector<Delta> deltas) {
+    size_t before = m_pending.size();
+    for (Delta& delta : deltas) {
+        delta.writerId = m_writerId;
+        if (!EncodeDelta(delta, m_pending)) {
+            m_pending.resize(before);
+            return false;
+        }
+    }
+    if (m_pending.size() == before) {
+        return false;
+    }
+
+    m_records += deltas.size();
+    m_bytes += m_pending.size() - before;
+    if (m_pending.size() >= WRITE_CHUNK_SIZE) {
+        return writePending();
+    }
+    return true;
+}
+
+bool ServerJournal::Append(Delta delta) {
+    return Append(std::vector<Delta>{ std::move(delta) });
+}
+
+bool ServerJournal::Flush() {
+    return writePending();
+}
+
+bool ServerJournal::Reset(uint64_t generation) {
+    Lock hold(*this, true);
+    if (!hold.Held()) {
+        printf("[DB] Failed to reset server journal %s\n", m_path.c_str());
+        return false;
+    }
+
+    // Truncating needs write access, which the append-only handle lacks;
+    // the lock keeps every other instance out until the new header is down
+    HANDLE file = CreateFileA(m_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("[DB] Failed to reset server journal %s\n", m_path.c_str());
+        return false;
+    }
+    std::string header = MakeHeader(generation);
+    DWORD written = 0;
+    bool ok = SetEndOfFile(file) &&
+              WriteFile(file, header.data(), static_cast<DWORD>(header.size()), &written, nullptr) &&
+              written == header.size();
+    CloseHandle(file);
+    if (!ok) {
+        printf("[DB] Failed to reset server journal %s\n", m_path.c_str());
+        return false;
+    }
+
+    m_generation = generation;
+    m_readOffset = JOURNAL_HEADER_SIZE;
+    m_records = 0;
+    m_bytes = 0;
+    m_pending.clear();      // Already in the snapshot this reset follows
+    return true;
+}
+
+bool ServerJournal::openFile() {
+    if (m_file) {
+        return true;
+    }
+
+    // Every instance sharing the database keeps the journal open, so share
+    // everything; append-only access puts each write at the current end of
+    // file no matter who wrote or truncated last
+    HANDLE file = CreateFileA(m_path.c_str(), GENERIC_READ | FILE_APPEND_DATA,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                              OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("[DB] Failed to open server journal %s\n", m_path.c_str());
+        return false;
+    }
+    m_file = file;
+    return true;
+}
+
+bool ServerJournal::fileSize(uint64_t& size) {
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(m_file, &length)) {
+        return false;
+    }
+    size = static_cast<uint64_t>(length.QuadPart);
+    return true;
+}
+
+bool ServerJournal::lock(bool exclusive) {
+    // Nested holders ride on the outer lock (a shared lock is never upgraded)
+    if (m_lockDepth > 0) {
+        ++m_lockDepth;
+        return true;
+    }
+    if (!openFile()) {
+        return false;
+    }
+
+    OVERLAPPED overlapped = OverlappedAt(static_cast<uint64_t>(LOCK_OFFSET_HIGH) << 32);
+    if (!LockFileEx(m_file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0, &overlapped)) {
+        printf("[DB] Failed to lock server journal %s\n", m_path.c_str());
+        return false;
+    }
+    m_lockDepth = 1;
+    return true;
+}
+
+void ServerJournal::unlock() {
+    if (m_lockDepth == 0 || --m_lockDepth > 0) {
+        return;
+    }
+    OVERLAPPED overlapped = OverlappedAt(static_cast<uint64_t>(LOCK_OFFSET_HIGH) << 32);
+    UnlockFileEx(m_file, 0, 1, 0, &overlapped);
+}
+
+bool ServerJournal::writePending() {
+    if (m_pending.empty()) {
+        return true;
+    }
+
+    std::string out;
+    {
+        Lock hold(*this, true);
+        uint64_t size = 0;
+        if (hold.Held() && fileSize(size)) {
+            // A brand new file needs its header before the first record
+            if (size == 0) {
+                out = MakeHeader(m_generation);
+                m_readOffset = JOURNAL_HEADER_SIZE;
+            }
+            out.append(m_pending);
+
+            // Everything buffered goes out in one write so a crash can only tear the tail
+            DWORD written = 0;
+            if (WriteFile(m_file, out.data(), static_cast<DWORD>(out.size()), &written, nullptr) &&
+                written == out.size()) {
+                m_pending.clear();
+                return true;
+            }
+        }
+    }
+
+    // The records are still applied in memory; the caller's next checkpoint saves them
+    printf("[DB] Failed to append to server journal %s\n", m_path.c_str());
+    m_pending.clear();
+    return false;
+}
@@ -0,0 +1,204 @@
+#ifndef SERVER_JOURNAL_H
+#define SERVER_JOURNAL_H
+
+/**
+ * @file ServerJournal.h
+ * @brief Write-ahead journal of server and channel changes
+ *
+ * PURPOSE:
+ * ServerManager used to rewrite its whole snapshot - every server with
+ * every member ID - for each change, so one user joining a 10k-member
+ * server cost a rewrite of every server on disk. Each change now goes to
+ * this journal as one small typed delta; the snapshot is only rewritten
+ * (a checkpoint) once the journal has grown, after which the journal
+ * starts over.
+ *
+ * The journal doubles as the change feed between instances sharing one
+ * database: ReadNew() returns only the deltas appended since the last
+ * call, so a refresh costs O(new deltas) instead of a full reload.
+ *
+ * FILE LAYOUT:
+ *   [8-byte magic "CHSJR001"][u64 generation]
+ *   [record]*
+ *
+ * RECORD LAYOUT (little-endian, framed like MessageLog records):
+ *   [u32 bodyLength][u32 crc32(body)][body]
+ *   body = [u8 type][u64 writerId][type-specific fields]
+ *   Strings are [u16 length][bytes].
+ *
+ * GENERATIONS:
+ * Every Reset() starts a new generation, and the snapshot records which
+ * generation comes after it. A crash between writing the snapshot and
+ * resetting the journal leaves an older generation behind, which the
+ * next load recognises as already folded in.
+ *
+ * SHARING BETWEEN INSTANCES:
+ * Every instance keeps the file open with full sharing and append-only
+ * access, so each write lands at the current end of file. A lock on a
+ * byte far past the data (LockFileEx) orders them: writes and Reset()
+ * take it exclusively, reads take it shared, and a checkpoint holds it
+ * (see Lock) from its catch-up read until the reset so no other
+ * instance's records fall between the two.
+ *
+ * CRASH SAFETY:
+ * Append() buffers records in memory and Flush() writes everything
+ * buffered with one WriteFile per commit window. A record torn by a
+ * crash fails its CRC; replay stops there and reports a torn tail, and
+ * the caller checkpoints to drop it.
+ *
+ * THREADING:
+ * Not thread-safe; ServerManager serializes access with its own mutex.
+ */
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+class ServerJournal {
+public:
+    enum class DeltaType : uint8_t {
+        ServerCreated = 1,      ///< serverId, userId (owner), createdAt, name, channelId, channelName
+        ServerDeleted = 2,      ///< serverId
+        ServerRenamed = 3,      ///< serverId, name
+        ServerNetworkInfo = 4,  ///< serverId, name (host IP), port
+        ServerOnline = 5,       ///< serverId, online
+        MemberAdded = 6,        ///< serverId, userId
+        MemberRemoved = 7,      ///< serverId, userId
+        OwnerChanged = 8,       ///< serverId, userId (new owner)
+        ChannelCreated = 9,     ///< channelId, serverId, createdAt, name
+        ChannelDeleted = 10,    ///< channelId
+        ChannelRenamed = 11     ///< channelId, name
+    };
+
+    /**
+     * @brief One change; only the fields its type lists are stored
+     */
+    struct Delta {
+        DeltaType type = DeltaType::ServerCreated;
+        uint64_t writerId = 0;      ///< Instance that appended the record
+        uint64_t serverId = 0;
+        uint64_t channelId = 0;
+        uint64_t userId = 0;
+        std::time_t createdAt = 0;
+        std::string name;
+        std::string channelName;
+        uint16_t port = 0;
+        bool online = false;
+    };
+
+    /** Largest record body accepted on replay (guards against garbage lengths) */
+    static constexpr uint32_t MAX_RECORD_SIZE = 64 * 1024;
+
+    /** Buffered bytes that trigger a write before the next Flush() */
+    static constexpr size_t WRITE_CHUNK_SIZE = 64 * 1024;
+
+    /**
+     * @brief Holds the cross-process journal lock for a scope
+     *
+     * Nests on one journal: an inner holder rides on the outer lock, so
+     * Append(), Flush(), ReadNew() and Reset() can all be called under an
+     * exclusive Lock.
+     */
+    class Lock {
+    public:
+        explicit Lock(ServerJournal& journal, bool exclusive = true);
+        ~Lock();
+
+        /** @brief False if the file could not be opened or locked */
+        bool Held() const { return m_held; }
+
+    private:
+        ServerJournal& m_journal;
+        bool m_held;
+
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+    };
+
+    /**
+     * @param path Journal file; created on first append if missing
+     * @param writerId Tags this instance's records so ReadNew() skips them
+     */
+    ServerJournal(const std::string& path, uint64_t writerId);
+    ~ServerJournal();
+
+    /**
+     * @brief Read every intact record in order
+     *
+     * Also positions the journal for appending and for ReadNew() after
+     * the last intact record.
+     *
+     * @param apply Called once per record
+     * @param tornTail Set to true if trailing bytes were damaged
+     * @return Number of records replayed
+     */
+    size_t Replay(const std::function<void(const Delta&)>& apply, bool& tornTail);
+
+    /**
+     * @brief Read the records other instances appended since Replay() or
+     * the last ReadNew()
+     *
+     * Our own records are skipped. A record still being written by another
+     * instance is left for the next call.
+     *
+     * @param apply Called once per new record
+     * @param checkpointed Set to true if the journal was reset under us;
+     *        the caller must reload the snapshot and Replay()
+     * @return Number of new records
+     */
+    size_t ReadNew(const std::function<void(const Delta&)>& apply, bool& checkpointed);
+
+    /**
+     * @brief Buffer records to be written in one piece by Flush()
+     * @return False if they could not be encoded or written (they are dropped)
+     */
+    bool Append(std::vector<Delta> deltas);
+
+    /** @brief Append() for a single record */
+    bool Append(Delta delta);
+
+    /**
+     * @brief Write buffered records to the file so other instances see them
+     * @return False if the write failed (buffered records may be lost)
+     */
+    bool Flush();
+
+    /**
+     * @brief Discard every record, buffered ones included, and start a new
+     *        generation
+     */
+    bool Reset(uint64_t generation);
+
+    /** @brief Generation read by the last Replay() or set by Reset() */
+    uint64_t Generation() const { return m_generation; }
+
+    /** @brief Records appended, replayed or read since the last Reset() */
+    size_t RecordCount() const { return m_records; }
+
+    /** @brief Bytes of record data in the file */
+    uint64_t SizeBytes() const { return m_bytes; }
+
+private:
+    std::string m_path;
+    uint64_t m_writerId;
+    void* m_file = nullptr;     // HANDLE, opened for read and append
+    uint64_t m_generation;
+    uint64_t m_readOffset;      // End of the last record consumed by Replay/ReadNew
+    size_t m_records;
+    uint64_t m_bytes;
+    std::string m_pending;      // Appended records not yet written
+    int m_lockDepth = 0;
+
+    bool openFile();
+    bool fileSize(uint64_t& size);
+    bool lock(bool exclusive);
+    void unlock();
+    bool writePending();
+
+    ServerJournal(const ServerJournal&) = delete;
+    ServerJournal& operator=(const ServerJournal&) = delete;
+};
+
+#endif // SERVER_JOURNAL_H
@@ -6,19 +6,53 @@
 #include "ServerManager.h"
 #include "UserDatabase.h"
 #include <algorithm>
+#include <cstdio>
+
+using Delta = ServerJournal::Delta;
+using DeltaType = ServerJournal::DeltaType;
+
+namespace {
+
+/**
+ * @brief "server_data.xml" -> "server_data.journal"
+ */
+std::string JournalPathFor(const std::string& xmlPath) {
+    const std::string extension = ".xml";
+    if (xmlPath.size() > extension.size() &&
+        xmlPath.compare(xmlPath.size() - extension.size(), extension.size(), extension) == 0) {
+        return xmlPath.substr(0, xmlPath.size() - extension.size()) + ".journal";
+    }
+    return xmlPath + ".journal";
+}
+
+Delta MakeDelta(DeltaType type, uint64_t serverId, uint64_t channelId = 0) {
+    Delta delta;
+    delta.type = type;
+    delta.serverId = serverId;
+    delta.channelId = channelId;
+    return delta;
+}
+
+} // namespace
 
 //=============================================================================
 // CONSTRUCTOR / DESTRUCTOR
 //=============================================================================
 
-ServerManager::ServerManager(const std::string& databasePath, UserDatabase& userDb)
+ServerManager::ServerManager(const std::string& databasePath, UserDatabase& userDb, bool loadNow)
     : databaseFilePath(databasePath)
-    , userDatabase(userDb) {
-    LoadFromFile();
+    , snapshotFilePath(SnapshotPathFor(databasePath))
+    , userDatabase(userDb)
+    , journal(JournalPathFor(databasePath), Models::GenerateUniqueId())
+    , persistence("server database", [this] { return SaveToFile(); }) {
+    if (loadNow) {
+        LoadFromFile();
+        SyncMemberships();
+    }
 }
 
 ServerManager::~ServerManager() {
-    SaveToFile();
+    persistence.Close();
 }
 
 //=============================================================================
@@ -30,7 +64,7 @@ Protocol::ErrorCode ServerManager::CreateServer(
     uint64_t ownerId,
     Models::ChatServer& outServer
 ) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     // Validate server name
     if (!Models::ChatServer::IsValidServerName(serverName)) {
@@ -38,8 +72,7 @@ Protocol::ErrorCode ServerManager::CreateServer(
     }
     
     // Check user's server limit
-    std::vector<uint64_t> userServers = userDatabase.GetUserServers(ownerId);
-    if (userServers.size() >= Models::MAX_SERVERS_PER_USER) {
+    if (memberServerCount(ownerId) >= Models::MAX_SERVERS_PER_USER) {
         return Protocol::ErrorCode::TooManyServers;
     }
     
@@ -48,24 +81,33 @@ Protocol::ErrorCode ServerManager::CreateServer(
     Models::ChatServer server(serverId, serverName, ownerId);
     
     // Add owner as first member
-    server.memberIds.push_back(ownerId);
+    server.AddMember(ownerId);
     
     // Create default "general" channel
     uint64_t channelId = Models::GenerateUniqueId();
     Models::Channel defaultChannel(channelId, serverId, "general");
+    defaultChannel.createdAt = server.createdAt;
     
     server.channelIds.push_back(channelId);
     
     // Store
     serversById[serverId] = server;
     channelsById[channelId] = defaultChannel;
+    serverNameIndex.Insert(serverId, serverName);
+    serverIdsByMember[ownerId].push_back(serverId);
     
     // Update user's server list
     userDatabase.AddUserToServer(ownerId, serverId);
     
     outServer = server;
     
-    SaveToFile();
+    Delta created = MakeDelta(DeltaType::ServerCreated, serverId, channelId);
+    created.userId = ownerId;
+    created.createdAt = server.createdAt;
+    created.name = serverName;
+    created.channelName = defaultChannel.channelName;
+    record({ std::move(created) });
+    persistence.MarkDirty();
     
     printf("[SERVER] Created server '%s' (ID: %llu) by user %llu\n", 
            serverName.c_str(), serverId, ownerId);
@@ -74,7 +116,7 @@ Protocol::ErrorCode ServerManager::CreateServer(
 }
 
 Protocol::ErrorCode ServerManager::DeleteServer(uint64_t serverId, uint64_t requesterId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -95,6 +137,7 @@ Protocol::ErrorCode ServerManager::DeleteServer(uint64_t serverId, uint64_t requ
     
     // Remove server from all members' server lists
     for (uint64_t memberId : server.memberIds) {
+        unindexMembership(memberId, serverId);
         userDatabase.RemoveUserFromServer(memberId, serverId);
     }
     
@@ -103,100 +146,68 @@ Protocol::ErrorCode ServerManager::DeleteServer(uint64_t serverId, uint64_t requ
     
     // Delete server
     serversById.erase(it);
+    serverNameIndex.Erase(serverId);
     
-    SaveToFile();
+    record({ MakeDelta(DeltaType::ServerDeleted, serverId) });
+    persistence.MarkDirty();
     
     return Protocol::ErrorCode::None;
 }
 
 void ServerManager::SetServerNetworkInfo(uint64_t serverId, const std::string& ipAddress, uint16_t port) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it != serversById.end()) {
         it->second.hostIpAddress = ipAddress;
         it->second.hostPort = port;
-        SaveToFile();
+        
+        Delta network = MakeDelta(DeltaType::ServerNetworkInfo, serverId);
+        network.name = ipAddress;
+        network.port = port;
+        record({ std::move(network) });
+        persistence.MarkDirty();
         printf("[SERVER] Network info set for '%s': %s:%d\n", 
                it->second.serverName.c_str(), ipAddress.c_str(), port);
     }
 }
 
 void ServerManager::SetServerOnlineStatus(uint64_t serverId, bool isOnline) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it != serversById.end()) {
         it->second.isOnline = isOnline;
-        SaveToFile();
+        
+        Delta status = MakeDelta(DeltaType::ServerOnline, serverId);
+        status.online = isOnline;
+        record({ std::move(status) });
+        persistence.MarkDirty();
         printf("[SERVER] '%s' is now %s\n", 
                it->second.serverName.c_str(), isOnline ? "ONLINE" : "OFFLINE");
     }
 }
 
 void ServerManager::RefreshFromFile() {
-    std::lock_guard<std::mutex> lock(managerMutex);
-    
-    // Clear current data
-    serversById.clear();
-    channelsById.clear();
+    // Our buffered records must reach the journal before others' are read
+    persistence.Flush();
     
-    // Reload from file - match exact structure from LoadFromFile
-    pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_file(databaseFilePath.c_str());
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
-    if (!result) {
-        printf("[SERVER] Failed to refresh server data from file\n");
+    bool checkpointed = false;
+    size_t applied = journal.ReadNew([this](const Delta& delta) { applyDelta(delta, true); }, checkpointed);
+    if (!checkpointed) {
+        if (applied > 0) {
+            printf("[SERVER] Refreshed: %zu changes from other instances\n", applied);
+        }
         return;
     }
     
-    pugi::xml_node root = doc.child("ServerDatabase");
-    if (!root) {
-        printf("[SERVER] Invalid server database structure\n");
+    // Rare: another instance checkpointed, so the journal we were reading is gone
+    if (!reloadLocked()) {
+        printf("[SERVER] Failed to refresh server data from file\n");
         return;
     }
-    
-    // Load channels first (servers reference them)
-    pugi::xml_node channelsNode = root.child("Channels");
-    for (pugi::xml_node channelNode : channelsNode.children("Channel")) {
-        Models::Channel channel;
-        channel.channelId = channelNode.attribute("id").as_ullong();
-        channel.serverId = channelNode.attribute("serverId").as_ullong();
-        channel.channelName = channelNode.attribute("name").as_string();
-        channel.createdAt = channelNode.attribute("createdAt").as_llong();
-        
-        channelsById[channel.channelId] = channel;
-    }
-    
-    // Load servers
-    pugi::xml_node serversNode = root.child("Servers");
-    for (pugi::xml_node serverNode : serversNode.children("Server")) {
-        Models::ChatServer server;
-        server.serverId = serverNode.attribute("id").as_ullong();
-        server.serverName = serverNode.attribute("name").as_string();
-        server.ownerId = serverNode.attribute("ownerId").as_ullong();
-        server.createdAt = serverNode.attribute("createdAt").as_llong();
-        
-        // Load network info
-        server.hostIpAddress = serverNode.attribute("hostIp").as_string();
-        server.hostPort = static_cast<uint16_t>(serverNode.attribute("hostPort").as_uint());
-        server.isOnline = serverNode.attribute("isOnline").as_bool();
-        
-        // Load members
-        pugi::xml_node membersNode = serverNode.child("Members");
-        for (pugi::xml_node memberNode : membersNode.children("Member")) {
-            server.memberIds.push_back(memberNode.attribute("id").as_ullong());
-        }
-        
-        // Load channel references
-        pugi::xml_node channelRefsNode = serverNode.child("Channels");
-        for (pugi::xml_node channelRefNode : channelRefsNode.children("ChannelRef")) {
-            server.channelIds.push_back(channelRefNode.attribute("id").as_ullong());
-        }
-        
-        serversById[server.serverId] = server;
-    }
-    
     printf("[SERVER] Refreshed: %zu servers, %zu channels\n", serversById.size(), channelsById.size());
 }
 
@@ -205,7 +216,7 @@ Protocol::ErrorCode ServerManager::RenameServer(
     const std::string& newName,
     uint64_t requesterId
 ) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -224,8 +235,12 @@ Protocol::ErrorCode ServerManager::RenameServer(
     
     std::string oldName = it->second.serverName;
     it->second.serverName = newName;
+    serverNameIndex.Insert(serverId, newName);
     
-    SaveToFile();
+    Delta renamed = MakeDelta(DeltaType::ServerRenamed, serverId);
+    renamed.name = newName;
+    record({ std::move(renamed) });
+    persistence.MarkDirty();
     
     printf("[SERVER] Renamed server '%s' to '%s'\n", oldName.c_str(), newName.c_str());
     
@@ -233,7 +248,7 @@ Protocol::ErrorCode ServerManager::RenameServer(
 }
 
 Protocol::ErrorCode ServerManager::JoinServer(uint64_t serverId, uint64_t userId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -249,18 +264,22 @@ Protocol::ErrorCode ServerManager::JoinServer(uint64_t serverId, uint64_t userId
     }
     
     // Check user's server limit
-    std::vector<uint64_t> userServers = userDatabase.GetUserServers(userId);
-    if (userServers.size() >= Models::MAX_SERVERS_PER_USER) {
+    if (memberServerCount(userId) >= Models::MAX_SERVERS_PER_USER) {
         return Protocol::ErrorCode::TooManyServers;
     }
     
     // Add user to server
-    server.memberIds.push_back(userId);
+    server.AddMember(userId);
+    serverIdsByMember[userId].push_back(serverId);
     
     // Add server to user's list
     userDatabase.AddUserToServer(userId, serverId);
     
-    SaveToFile();
+    // One small record, however many members the server has
+    Delta joined = MakeDelta(DeltaType::MemberAdded, serverId);
+    joined.userId = userId;
+    record({ std::move(joined) });
+    persistence.MarkDirty();
     
     printf("[SERVER] User %llu joined server '%s'\n", userId, server.serverName.c_str());
     
@@ -268,7 +287,7 @@ Protocol::ErrorCode ServerManager::JoinServer(uint64_t serverId, uint64_t userId
 }
 
 Protocol::ErrorCode ServerManager::LeaveServer(uint64_t serverId, uint64_t userId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -283,14 +302,16 @@ Protocol::ErrorCode ServerManager::LeaveServer(uint64_t serverId, uint64_t userI
     }
     
     // Remove from member list
-    server.memberIds.erase(
-        std::remove(server.memberIds.begin(), server.memberIds.end(), userId),
-        server.memberIds.end()
-    );
+    server.RemoveMember(userId);
+    unindexMembership(userId, serverId);
     
     // Remove from user's server list
     userDatabase.RemoveUserFromServer(userId, serverId);
     
+    std::vector<Delta> deltas;
+    deltas.push_back(MakeDelta(DeltaType::MemberRemoved, serverId));
+    deltas.back().userId = userId;
+    
     printf("[SERVER] User %llu left server '%s'\n", userId, server.serverName.c_str());
     
     // Handle ownership transfer if owner left
@@ -306,21 +327,26 @@ Protocol::ErrorCode ServerManager::LeaveServer(uint64_t serverId, uint64_t userI
             }
             
             serversById.erase(it);
+            serverNameIndex.Erase(serverId);
+            deltas.push_back(MakeDelta(DeltaType::ServerDeleted, serverId));
         } else {
             // Transfer ownership to oldest member (first in list)
             uint64_t newOwner = server.memberIds.front();
             server.ownerId = newOwner;
+            deltas.push_back(MakeDelta(DeltaType::OwnerChanged, serverId));
+            deltas.back().userId = newOwner;
             printf("[SERVER] Ownership transferred to user %llu\n", newOwner);
         }
     }
     
-    SaveToFile();
+    record(std::move(deltas));
+    persistence.MarkDirty();
     
     return Protocol::ErrorCode::None;
 }
 
 bool ServerManager::GetServer(uint64_t serverId, Models::ChatServer& outServer) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -331,14 +357,59 @@ bool ServerManager::GetServer(uint64_t serverId, Models::ChatServer& outServer)
     return true;
 }
 
+bool ServerManager::GetServerSummary(uint64_t serverId, ServerSummary& outSummary) {
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
+    
+    auto it = serversById.find(serverId);
+    if (it == serversById.end()) {
+        return false;
+    }
+    
+    outSummary = summarize(it->second);
+    return true;
+}
+
+ServerManager::ServerSummary ServerManager::summarize(const Models::ChatServer& server) {
+    return { server.serverId, server.serverName, server.ownerId, server.hostIpAddress, server.hostPort,
+             server.isOnline, server.memberIds.size(), server.channelIds.size() };
+}
+
 std::vector<Models::ChatServer> ServerManager::GetUserServers(uint64_t userId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     std::vector<Models::ChatServer> result;
     
-    for (const auto& pair : serversById) {
-        if (pair.second.IsMember(userId)) {
-            result.push_back(pair.second);
+    auto indexIt = serverIdsByMember.find(userId);
+    if (indexIt == serverIdsByMember.end()) {
+        return result;
+    }
+    
+    result.reserve(indexIt->second.size());
+    for (uint64_t serverId : indexIt->second) {
+        auto it = serversById.find(serverId);
+        if (it != serversById.end()) {
+            result.push_back(it->second);
+        }
+    }
+    
+    return result;
+}
+
+std::vector<ServerManager::ServerSummary> ServerManager::GetUserServerSummaries(uint64_t userId) {
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
+    
+    std::vector<ServerSummary> result;
+    
+    auto indexIt = serverIdsByMember.find(userId);
+    if (indexIt == serverIdsByMember.end()) {
+        return result;
+    }
+    
+    result.reserve(indexIt->second.size());
+    for (uint64_t serverId : indexIt->second) {
+        auto it = serversById.find(serverId);
+        if (it != serversById.end()) {
+            result.push_back(summarize(it->second));
         }
     }
     
@@ -346,7 +417,7 @@ std::vector<Models::ChatServer> ServerManager::GetUserServers(uint64_t userId) {
 }
 
 std::vector<uint64_t> ServerManager::GetServerMembers(uint64_t serverId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -356,26 +427,50 @@ std::vector<uint64_t> ServerManager::GetServerMembers(uint64_t serverId) {
     return it->second.memberIds;
 }
 
-std::vector<Models::ChatServer> ServerManager::SearchServers(
+std::vector<Protocol::Payloads::ServerInfo> ServerManager::SearchServers(
     const std::string& searchTerm,
     size_t maxResults
 ) {
-    std::lock_guard<std::mutex> lock(managerMutex);
-    
-    std::vector<Models::ChatServer> results;
-    std::string lowerSearch = searchTerm;
-    std::transform(lowerSearch.begin(), lowerSearch.end(), 
-                   lowerSearch.begin(), ::tolower);
-    
-    for (const auto& pair : serversById) {
-        if (results.size() >= maxResults) break;
+    std::vector<Protocol::Payloads::ServerInfo> results;
+    {
+        std::shared_lock<std::shared_mutex> lock(managerMutex);
+        
+        std::vector<const Models::ChatServer*> matches;
+        for (uint64_t serverId : serverNameIndex.FindSubstring(searchTerm)) {
+            auto it = serversById.find(serverId);
+            if (it != serversById.end()) {
+                matches.push_back(&it->second);
+            }
+        }
         
-        std::string lowerName = pair.second.serverName;
-        std::transform(lowerName.begin(), lowerName.end(), 
-                       lowerName.begin(), ::tolower);
+        // Busiest servers first; ties keep ID order so results are stable
+        size_t keep = (std::min)(maxResults, matches.size());
+        std::partial_sort(matches.begin(), matches.begin() + keep, matches.end(),
+                          [](const Models::ChatServer* a, const Models::ChatServer* b) {
+                              if (a->memberIds.size() != b->memberIds.size()) {
+                                  return a->memberIds.size() > b->memberIds.size();
+                              }
+                              return a->serverId < b->serverId;
+                          });
         
-        if (lowerName.find(lowerSearch) != std::string::npos) {
-            results.push_back(pair.second);
+        results.reserve(keep);
+        for (size_t i = 0; i < keep; ++i) {
+            const Models::ChatServer& server = *matches[i];
+            Protocol::Payloads::ServerInfo info;
+            info.serverId = server.serverId;
+            info.serverName = server.serverName;
+            info.ownerId = server.ownerId;
+            info.memberCount = static_cast<int>(server.memberIds.size());
+            info.channelCount = static_cast<int>(server.channelIds.size());
+            results.push_back(std::move(info));
+        }
+    }
+    
+    // Owner names live in UserDatabase; fetch them without holding managerMutex
+    for (auto& info : results) {
+        Models::User owner;
+        if (userDatabase.GetUserById(info.ownerId, owner)) {
+            info.ownerName = owner.username;
         }
     }
     
@@ -392,7 +487,7 @@ Protocol::ErrorCode ServerManager::CreateChannel(
     uint64_t requesterId,
     Models::Channel& outChannel
 ) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -435,7 +530,11 @@ Protocol::ErrorCode ServerManager::CreateChannel(
     
     outChannel = channel;
     
-    SaveToFile();
+    Delta created = MakeDelta(DeltaType::ChannelCreated, serverId, channelId);
+    created.createdAt = channel.createdAt;
+    created.name = channelName;
+    record({ std::move(created) });
+    persistence.MarkDirty();
     
     printf("[CHANNEL] Created channel '#%s' in server '%s'\n", 
            channelName.c_str(), server.serverName.c_str());
@@ -444,7 +543,7 @@ Protocol::ErrorCode ServerManager::CreateChannel(
 }
 
 Protocol::ErrorCode ServerManager::DeleteChannel(uint64_t channelId, uint64_t requesterId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto channelIt = channelsById.find(channelId);
     if (channelIt == channelsById.end()) {
@@ -482,7 +581,8 @@ Protocol::ErrorCode ServerManager::DeleteChannel(uint64_t channelId, uint64_t re
     // Delete channel
     channelsById.erase(channelIt);
     
-    SaveToFile();
+    record({ MakeDelta(DeltaType::ChannelDeleted, 0, channelId) });
+    persistence.MarkDirty();
     
     return Protocol::ErrorCode::None;
 }
@@ -492,7 +592,7 @@ Protocol::ErrorCode ServerManager::RenameChannel(
     const std::string& newName,
     uint64_t requesterId
 ) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
     
     auto channelIt = channelsById.find(channelId);
     if (channelIt == channelsById.end()) {
@@ -519,7 +619,10 @@ Protocol::ErrorCode ServerManager::RenameChannel(
     std::string oldName = channel.channelName;
     channel.channelName = newName;
     
-    SaveToFile();
+    Delta renamed = MakeDelta(DeltaType::ChannelRenamed, 0, channelId);
+    renamed.name = newName;
+    record({ std::move(renamed) });
+    persistence.MarkDirty();
     
     printf("[CHANNEL] Renamed channel '#%s' to '#%s'\n", oldName.c_str(), newName.c_str());
     
@@ -527,7 +630,7 @@ Protocol::ErrorCode ServerManager::RenameChannel(
 }
 
 bool ServerManager::GetChannel(uint64_t channelId, Models::Channel& outChannel) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     auto it = channelsById.find(channelId);
     if (it == channelsById.end()) {
@@ -539,7 +642,7 @@ bool ServerManager::GetChannel(uint64_t channelId, Models::Channel& outChannel)
 }
 
 std::vector<Models::Channel> ServerManager::GetServerChannels(uint64_t serverId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     std::vector<Models::Channel> result;
     
@@ -558,8 +661,29 @@ std::vector<Models::Channel> ServerManager::GetServerChannels(uint64_t serverId)
     return result;
 }
 
+size_t ServerManager::ForEachServerChannel(uint64_t serverId,
+                                           const std::function<void(const Models::Channel&)>& visitor) {
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
+    
+    auto it = serversById.find(serverId);
+    if (it == serversById.end()) {
+        return 0;
+    }
+    
+    size_t visited = 0;
+    for (uint64_t channelId : it->second.channelIds) {
+        auto channelIt = channelsById.find(channelId);
+        if (channelIt != channelsById.end()) {
+            visitor(channelIt->second);
+            ++visited;
+        }
+    }
+    
+    return visited;
+}
+
 bool ServerManager::GetDefaultChannel(uint64_t serverId, Models::Channel& outChannel) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end() || it->second.channelIds.empty()) {
@@ -581,7 +705,7 @@ bool ServerManager::GetDefaultChannel(uint64_t serverId, Models::Channel& outCha
 //=============================================================================
 
 bool ServerManager::IsServerOwner(uint64_t serverId, uint64_t userId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -592,7 +716,7 @@ bool ServerManager::IsServerOwner(uint64_t serverId, uint64_t userId) {
 }
 
 bool ServerManager::IsServerMember(uint64_t serverId, uint64_t userId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     auto it = serversById.find(serverId);
     if (it == serversById.end()) {
@@ -603,7 +727,7 @@ bool ServerManager::IsServerMember(uint64_t serverId, uint64_t userId) {
 }
 
 bool ServerManager::CanAccessChannel(uint64_t channelId, uint64_t userId) {
-    std::lock_guard<std::mutex> lock(managerMutex);
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
     
     auto channelIt = channelsById.find(channelId);
     if (channelIt == channelsById.end()) {
@@ -637,7 +761,417 @@ bool ServerManager::GetServerByChannel(uint64_t channelId, Models::ChatServer& o
 // PERSISTENCE
 //=============================================================================
 
+namespace {
+
+const char SERVER_SNAPSHOT_MAGIC[] = "CHSRVRDB";
+constexpr uint32_t SERVER_SNAPSHOT_VERSION = 2;
+
+// id, serverId, name, createdAt
+constexpr size_t MIN_CHANNEL_RECORD_SIZE = 8 + 8 + 4 + 8;
+
+// id, name, ownerId, createdAt, hostIp, hostPort, isOnline, member and channel counts
+constexpr size_t MIN_SERVER_RECORD_SIZE = 8 + 4 + 8 + 8 + 4 + 2 + 1 + 4 + 4;
+
+} // namespace
+
 bool ServerManager::SaveToFile() {
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
+    
+    bool checkpoint = checkpointRequested ||
+        journal.RecordCount() >= CHECKPOINT_AFTER_RECORDS ||
+        journal.SizeBytes() >= CHECKPOINT_AFTER_BYTES;
+    if (!checkpoint && !journal.Flush()) {
+        checkpoint = true;      // Buffered records are gone; memory still has them
+    }
+    if (!checkpoint) {
+        return true;
+    }
+    
+    checkpointRequested = false;
+    if (!checkpointLocked()) {
+        checkpointRequested = true;
+        return false;
+    }
+    return true;
+}
+
+bool ServerManager::checkpointLocked(bool catchUp) {
+    // No other instance may journal between the catch-up and the reset, or
+    // its records would be truncated away without being in the snapshot
+    ServerJournal::Lock hold(journal);
+    if (!hold.Held()) {
+        return false;
+    }
+    
+    // Fold in what other instances journaled first, or the new snapshot would drop it
+    if (catchUp) {
+        bool checkpointed = false;
+        journal.ReadNew([this](const Delta& delta) { applyDelta(delta, true); }, checkpointed);
+        if (checkpointed) {
+            // Another instance just checkpointed; its snapshot already has our records
+            return reloadLocked();
+        }
+    }
+    
+    uint64_t nextGeneration = journal.Generation() + 1;
+    
+    // Snapshot payload (version 2; version 1 lacks the generation):
+    //   [u64 nextGeneration]  journal generation that follows this snapshot
+    //   [u32 count] per channel: [u64 id][u64 serverId][str name][i64 createdAt]
+    //   [u32 count] per server:  [u64 id][str name][u64 ownerId][i64 createdAt]
+    //                            [str hostIp][u16 hostPort][u8 isOnline]
+    //                            [u32 n][u64 memberId]*n [u32 n][u64 channelId]*n
+    SnapshotWriter snapshot;
+    snapshot.PutU64(nextGeneration);
+    snapshot.PutU32(static_cast<uint32_t>(channelsById.size()));
+    for (const auto& pair : channelsById) {
+        const Models::Channel& channel = pair.second;
+        snapshot.PutU64(channel.channelId);
+        snapshot.PutU64(channel.serverId);
+        snapshot.PutString(channel.channelName);
+        snapshot.PutI64(channel.createdAt);
+    }
+    
+    snapshot.PutU32(static_cast<uint32_t>(serversById.size()));
+    for (const auto& pair : serversById) {
+        const Models::ChatServer& server = pair.second;
+        snapshot.PutU64(server.serverId);
+        snapshot.PutString(server.serverName);
+        snapshot.PutU64(server.ownerId);
+        snapshot.PutI64(server.createdAt);
+        snapshot.PutString(server.hostIpAddress);
+        snapshot.PutU16(server.hostPort);
+        snapshot.PutU8(server.isOnline ? 1 : 0);
+        
+        snapshot.PutU32(static_cast<uint32_t>(server.memberIds.size()));
+        for (uint64_t memberId : server.memberIds) {
+            snapshot.PutU64(memberId);
+        }
+        snapshot.PutU32(static_cast<uint32_t>(server.channelIds.size()));
+        for (uint64_t channelId : server.channelIds) {
+            snapshot.PutU64(channelId);
+        }
+    }
+    
+    if (!snapshot.Commit(snapshotFilePath, SERVER_SNAPSHOT_MAGIC, SERVER_SNAPSHOT_VERSION)) {
+        return false;
+    }
+    
+    // A crash before this point leaves the old generation behind, which the
+    // next load recognises as already folded in
+    journal.Reset(nextGeneration);
+    printf("[DB] Checkpointed %zu servers and %zu channels\n", serversById.size(), channelsById.size());
+    return true;
+}
+
+void ServerManager::SyncMemberships() {
+    // Membership here is authoritative; bring User::serverIds in line with it
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
+    userDatabase.SyncServerMemberships(serverIdsByMember);
+}
+
+bool ServerManager::LoadFromFile() {
+    uint64_t nextGeneration = 0;
+    bool loaded = loadSnapshot(nextGeneration);
+    bool migrated = !loaded && importXml(databaseFilePath);
+    
+    size_t replayed = replayJournal(nextGeneration);
+    if (!loaded && !migrated && replayed == 0) {
+        printf("[DB] No existing server database found, starting fresh\n");
+        return false;
+    }
+    if (replayed > 0) {
+        printf("[DB] Replayed %zu server journal records\n", replayed);
+    }
+    
+    if (migrated) {
+        // Migrated from XML; write a snapshot so the next start skips the DOM
+        checkpointRequested = true;
+        persistence.MarkDirty();
+    }
+    return true;
+}
+
+bool ServerManager::reloadLocked() {
+    // Our buffered records must be in the journal, or the replay would drop them
+    journal.Flush();
+    
+    // A failed load leaves the current state in place
+    uint64_t nextGeneration = 0;
+    if (!loadSnapshot(nextGeneration)) {
+        return false;
+    }
+    replayJournal(nextGeneration);
+    userDatabase.SyncServerMemberships(serverIdsByMember);
+    return true;
+}
+
+size_t ServerManager::replayJournal(uint64_t nextGeneration) {
+    // Replay changes made after the snapshot; an older generation means the
+    // journal was already folded in but not reset (crash mid-checkpoint).
+    // Held across both so another instance cannot append in between.
+    ServerJournal::Lock hold(journal);
+    bool tornTail = false;
+    size_t replayed = journal.Replay([&](const Delta& delta) {
+        if (journal.Generation() >= nextGeneration) {
+            applyDelta(delta, false);
+        }
+    }, tornTail);
+    
+    if (journal.Generation() < nextGeneration) {
+        replayed = 0;
+        journal.Reset(nextGeneration);
+    }
+    
+    // Appending after damaged bytes would hide the new records on the next
+    // replay; a checkpoint writes the intact part out and starts a clean journal
+    if (tornTail) {
+        checkpointRequested = true;
+        persistence.MarkDirty();
+    }
+    return replayed;
+}
+
+bool ServerManager::loadSnapshot(uint64_t& nextGeneration) {
+    SnapshotReader snapshot;
+    if (!snapshot.Open(snapshotFilePath, SERVER_SNAPSHOT_MAGIC, SERVER_SNAPSHOT_VERSION)) {
+        return false;
+    }
+    
+    // Version 1 was written before the journal existed
+    uint64_t generation = snapshot.Version() >= 2 ? snapshot.ReadU64() : 0;
+    
+    FlatHashMap<uint64_t, Models::Channel> channels;
+    FlatHashMap<uint64_t, Models::ChatServer> servers;
+    
+    uint32_t channelCount = snapshot.ReadCount(MIN_CHANNEL_RECORD_SIZE);
+    channels.reserve(channelCount);
+    for (uint32_t i = 0; i < channelCount && snapshot.Ok(); ++i) {
+        Models::Channel channel;
+        channel.channelId = snapshot.ReadU64();
+        channel.serverId = snapshot.ReadU64();
+        channel.channelName = snapshot.ReadString();
+        channel.createdAt = static_cast<std::time_t>(snapshot.ReadI64());
+        channels.emplace(channel.channelId, std::move(channel));
+    }
+    
+    uint32_t serverCount = snapshot.ReadCount(MIN_SERVER_RECORD_SIZE);
+    servers.reserve(serverCount);
+    for (uint32_t i = 0; i < serverCount && snapshot.Ok(); ++i) {
+        Models::ChatServer server;
+        server.serverId = snapshot.ReadU64();
+        server.serverName = snapshot.ReadString();
+        server.ownerId = snapshot.ReadU64();
+        server.createdAt = static_cast<std::time_t>(snapshot.ReadI64());
+        server.hostIpAddress = snapshot.ReadString();
+        server.hostPort = snapshot.ReadU16();
+        server.isOnline = snapshot.ReadU8() != 0;
+        
+        uint32_t memberCount = snapshot.ReadCount(sizeof(uint64_t));
+        server.memberIds.reserve(memberCount);
+        server.memberSet.reserve(memberCount);
+        for (uint32_t m = 0; m < memberCount; ++m) {
+            server.AddMember(snapshot.ReadU64());
+        }
+        uint32_t channelRefCount = snapshot.ReadCount(sizeof(uint64_t));
+        server.channelIds.reserve(channelRefCount);
+        for (uint32_t c = 0; c < channelRefCount; ++c) {
+            server.channelIds.push_back(snapshot.ReadU64());
+        }
+        
+        servers.emplace(server.serverId, std::move(server));
+    }
+    
+    if (!snapshot.Ok() || !snapshot.AtEnd()) {
+        printf("[DB] Server snapshot %s is truncated\n", snapshotFilePath.c_str());
+        return false;
+    }
+    
+    channelsById = std::move(channels);
+    serversById = std::move(servers);
+    rebuildIndexes();
+    nextGeneration = generation;
+    
+    printf("[DB] Loaded %zu servers and %zu channels from snapshot\n",
+           serversById.size(), channelsById.size());
+    return true;
+}
+
+void ServerManager::rebuildIndexes() {
+    serverNameIndex.Clear();
+    serverIdsByMember.clear();
+    for (const auto& pair : serversById) {
+        serverNameIndex.Insert(pair.first, pair.second.serverName);
+        for (uint64_t memberId : pair.second.memberIds) {
+            serverIdsByMember[memberId].push_back(pair.first);
+        }
+    }
+    
+    // Join order is not stored; rebuilt lists fall back to ID order
+    for (auto& pair : serverIdsByMember) {
+        std::sort(pair.second.begin(), pair.second.end());
+    }
+}
+
+void ServerManager::unindexMembership(uint64_t userId, uint64_t serverId) {
+    auto it = serverIdsByMember.find(userId);
+    if (it == serverIdsByMember.end()) {
+        return;
+    }
+    auto& serverIds = it->second;
+    serverIds.erase(std::remove(serverIds.begin(), serverIds.end(), serverId), serverIds.end());
+    if (serverIds.empty()) {
+        serverIdsByMember.erase(it);
+    }
+}
+
+size_t ServerManager::memberServerCount(uint64_t userId) const {
+    auto it = serverIdsByMember.find(userId);
+    return it != serverIdsByMember.end() ? it->second.size() : 0;
+}
+
+void ServerManager::record(std::vector<Delta> deltas) {
+    if (!journal.Append(std::move(deltas))) {
+        // Memory has the change; the next save writes it out in a checkpoint
+        checkpointRequested = true;
+    }
+}
+
+/**
+ * Deltas are applied after the fact, so each one tolerates state that
+ * already reflects it (a record replayed on top of a snapshot that
+ * includes it) and skips one whose server or channel is gone.
+ */
+void ServerManager::applyDelta(const Delta& delta, bool syncUsers) {
+    auto serverIt = serversById.find(delta.serverId);
+    auto channelIt = channelsById.find(delta.channelId);
+    
+    switch (delta.type) {
+        case DeltaType::ServerCreated: {
+            if (serverIt != serversById.end()) {
+                break;
+            }
+            Models::ChatServer server(delta.serverId, delta.name, delta.userId);
+            server.createdAt = delta.createdAt;
+            server.AddMember(delta.userId);
+            server.channelIds.push_back(delta.channelId);
+            
+            Models::Channel channel(delta.channelId, delta.serverId, delta.channelName);
+            channel.createdAt = delta.createdAt;
+            
+            serversById[delta.serverId] = std::move(server);
+            channelsById[delta.channelId] = std::move(channel);
+            serverNameIndex.Insert(delta.serverId, delta.name);
+            serverIdsByMember[delta.userId].push_back(delta.serverId);
+            if (syncUsers) {
+                userDatabase.AddUserToServer(delta.userId, delta.serverId);
+            }
+            break;
+        }
+        case DeltaType::ServerDeleted:
+            if (serverIt == serversById.end()) {
+                break;
+            }
+            for (uint64_t channelId : serverIt->second.channelIds) {
+                channelsById.erase(channelId);
+            }
+            for (uint64_t memberId : serverIt->second.memberIds) {
+                unindexMembership(memberId, delta.serverId);
+                if (syncUsers) {
+                    userDatabase.RemoveUserFromServer(memberId, delta.serverId);
+                }
+            }
+            serversById.erase(serverIt);
+            serverNameIndex.Erase(delta.serverId);
+            break;
+        case DeltaType::ServerRenamed:
+            if (serverIt != serversById.end()) {
+                serverIt->second.serverName = delta.name;
+                serverNameIndex.Insert(delta.serverId, delta.name);
+            }
+            break;
+        case DeltaType::ServerNetworkInfo:
+            if (serverIt != serversById.end()) {
+                serverIt->second.hostIpAddress = delta.name;
+                serverIt->second.hostPort = delta.port;
+            }
+            break;
+        case DeltaType::ServerOnline:
+            if (serverIt != serversById.end()) {
+                serverIt->second.isOnline = delta.online;
+            }
+            break;
+        case DeltaType::MemberAdded:
+            if (serverIt != serversById.end() && !serverIt->second.IsMember(delta.userId)) {
+                serverIt->second.AddMember(delta.userId);
+                serverIdsByMember[delta.userId].push_back(delta.serverId);
+                if (syncUsers) {
+                    userDatabase.AddUserToServer(delta.userId, delta.serverId);
+                }
+            }
+            break;
+        case DeltaType::MemberRemoved:
+            if (serverIt != serversById.end() && serverIt->second.IsMember(delta.userId)) {
+                serverIt->second.RemoveMember(delta.userId);
+                unindexMembership(delta.userId, delta.serverId);
+                if (syncUsers) {
+                    userDatabase.RemoveUserFromServer(delta.userId, delta.serverId);
+                }
+            }
+            break;
+        case DeltaType::OwnerChanged:
+            if (serverIt != serversById.end()) {
+                serverIt->second.ownerId = delta.userId;
+            }
+            break;
+        case DeltaType::ChannelCreated:
+            if (serverIt != serversById.end() && channelIt == channelsById.end()) {
+                Models::Channel channel(delta.channelId, delta.serverId, delta.name);
+                channel.createdAt = delta.createdAt;
+                channelsById[delta.channelId] = std::move(channel);
+                serverIt->second.channelIds.push_back(delta.channelId);
+            }
+            break;
+        case DeltaType::ChannelDeleted:
+            if (channelIt != channelsById.end()) {
+                auto ownerIt = serversById.find(channelIt->second.serverId);
+                if (ownerIt != serversById.end()) {
+                    auto& channelIds = ownerIt->second.channelIds;
+                    channelIds.erase(std::remove(channelIds.begin(), channelIds.end(), delta.channelId),
+                                     channelIds.end());
+                }
+                channelsById.erase(channelIt);
+            }
+            break;
+        case DeltaType::ChannelRenamed:
+            if (channelIt != channelsById.end()) {
+                channelIt->second.channelName = delta.name;
+            }
+            break;
+    }
+}
+
+bool ServerManager::ImportXml(const std::string& xmlPath) {
+    std::lock_guard<std::shared_mutex> lock(managerMutex);
+    
+    serversById.clear();
+    channelsById.clear();
+    serverNameIndex.Clear();
+    serverIdsByMember.clear();
+    if (!importXml(xmlPath)) {
+        return false;
+    }
+    userDatabase.SyncServerMemberships(serverIdsByMember);
+    
+    // The import replaced everything; checkpoint it as the new base
+    checkpointRequested = true;
+    persistence.MarkDirty();
+    return true;
+}
+
+bool ServerManager::ExportXml(const std::string& xmlPath) const {
+    std::shared_lock<std::shared_mutex> lock(managerMutex);
+    
     pugi::xml_document doc;
     pugi::xml_node root = doc.append_child("ServerDatabase");
     
@@ -684,15 +1218,16 @@ bool ServerManager::SaveToFile() {
         channelNode.append_attribute("createdAt") = static_cast<long long>(channel.createdAt);
     }
     
-    return doc.save_file(databaseFilePath.c_str());
+    lock.unlock();
+    
+    return PersistenceWorker::WriteXmlAtomically(doc, xmlPath);
 }
 
-bool ServerManager::LoadFromFile() {
+bool ServerManager::importXml(const std::string& xmlPath) {
     pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_file(databaseFilePath.c_str());
+    pugi::xml_parse_result result = doc.load_file(xmlPath.c_str());
     
     if (!result) {
-        printf("[DB] No existing server database found, starting fresh\n");
         return false;
     }
     
@@ -728,7 +1263,7 @@ bool ServerManager::LoadFromFile() {
         // Load members
         pugi::xml_node membersNode = serverNode.child("Members");
         for (pugi::xml_node memberNode : membersNode.children("Member")) {
-            server.memberIds.push_back(memberNode.attribute("id").as_ullong());
+            server.AddMember(memberNode.attribute("id").as_ullong());
         }
         
         // Load channel references
@@ -739,9 +1274,10 @@ bool ServerManager::LoadFromFile() {
         
         serversById[server.serverId] = server;
     }
+    rebuildIndexes();
     
-    printf("[DB] Loaded %zu servers and %zu channels\n", 
-           serversById.size(), channelsById.size());
+    printf("[DB] Imported %zu servers and %zu channels from %s\n",
+           serversById.size(), channelsById.size(), xmlPath.c_str());
     
     return true;
 }
@@ -15,15 +15,37 @@
  * - All public methods validate permissions before acting
  * - User IDs are verified against sessions, never trusted from client
  * - Proper cleanup when servers/channels are deleted
+ *
+ * PERSISTENCE:
+ * The database is a binary snapshot ("<name>.bin") plus a ServerJournal
+ * ("<name>.journal") of typed deltas made after it, where <name> is the
+ * database path without its .xml extension. A change costs one small
+ * buffered journal record; the persistence worker flushes the journal
+ * once per commit window. Once it grows past CHECKPOINT_AFTER_RECORDS /
+ * CHECKPOINT_AFTER_BYTES, the worker checkpoints: it writes a new
+ * snapshot and starts a new journal generation.
+ *
+ * CHANGES FROM OTHER INSTANCES:
+ * Instances sharing one database all append to the same journal.
+ * RefreshFromFile() applies only the deltas others appended since the
+ * last refresh; the snapshot is reloaded only after another instance
+ * has checkpointed.
  */
 
+#include <functional>
 #include <string>
-#include <map>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include "Models.h"
 #include "Protocol.h"
+#include "PersistenceWorker.h"
+#include "BinarySnapshot.h"
+#include "ServerJournal.h"
+#include "TrigramIndex.h"
+#include "FlatHashMap.h"
 #include "pugixml.hpp"
 
 // Forward declaration
@@ -35,8 +57,10 @@ public:
      * @brief Initialize with database path and user database reference
      * @param databasePath Path to XML storage file
      * @param userDb Reference to user database for cross-referencing
+     * @param loadNow False to leave loading to LoadFromFile() followed by
+     *        SyncMemberships(), which must finish before any other method is used
      */
-    ServerManager(const std::string& databasePath, UserDatabase& userDb);
+    ServerManager(const std::string& databasePath, UserDatabase& userDb, bool loadNow = true);
     
     ~ServerManager();
     
@@ -89,7 +113,11 @@ public:
     void SetServerOnlineStatus(uint64_t serverId, bool isOnline);
     
     /**
-     * @brief Reload server data from file (to get updates from other instances)
+     * @brief Pick up changes other instances made to the shared database
+     *
+     * Replays only the journal records appended since the last refresh,
+     * so it is nearly free when nothing changed. Reloads the snapshot
+     * only if another instance checkpointed in the meantime.
      */
     void RefreshFromFile();
     
@@ -138,13 +166,47 @@ public:
      */
     bool GetServer(uint64_t serverId, Models::ChatServer& outServer);
     
+    /**
+     * @brief What a server list, a header or a connect needs about one server
+     */
+    struct ServerSummary {
+        uint64_t serverId;
+        std::string serverName;
+        uint64_t ownerId;
+        std::string hostIpAddress;
+        uint16_t hostPort;
+        bool isOnline;
+        size_t memberCount;
+        size_t channelCount;
+    };
+    
+    /**
+     * @brief Get a server's summary
+     *
+     * Copies two short strings instead of a full Models::ChatServer with
+     * its member and channel ID vectors.
+     *
+     * @param serverId Server ID
+     * @param outSummary Output: summary fields
+     * @return True if found
+     */
+    bool GetServerSummary(uint64_t serverId, ServerSummary& outSummary);
+    
     /**
      * @brief Get all servers a user is a member of
+     *
+     * Reads the membership index, so it costs O(servers joined).
+     *
      * @param userId User ID
-     * @return Vector of servers
+     * @return Vector of servers, in join order
      */
     std::vector<Models::ChatServer> GetUserServers(uint64_t userId);
     
+    /**
+     * @brief GetUserServers(), summary fields only (for the server browser)
+     */
+    std::vector<ServerSummary> GetUserServerSummaries(uint64_t userId);
+    
     /**
      * @brief Get all members of a server
      * @param serverId Server ID
@@ -153,12 +215,15 @@ public:
     std::vector<uint64_t> GetServerMembers(uint64_t serverId);
     
     /**
-     * @brief Search for public servers by name
+     * @brief Search for public servers whose name contains a term
+     *
+     * Served from a trigram index over server names (case-insensitive).
+     *
      * @param searchTerm Search string
      * @param maxResults Maximum results to return
-     * @return Vector of matching servers
+     * @return Matching servers, most members first, summary fields only
      */
-    std::vector<Models::ChatServer> SearchServers(
+    std::vector<Protocol::Payloads::ServerInfo> SearchServers(
         const std::string& searchTerm,
         size_t maxResults = 20
     );
@@ -218,6 +283,18 @@ public:
      */
     std::vector<Models::Channel> GetServerChannels(uint64_t serverId);
     
+    /**
+     * @brief Visit a server's channels in order without copying them
+     *
+     * Runs under the shared lock, so the visitor must not call back into
+     * ServerManager.
+     *
+     * @param serverId Server ID
+     * @param visitor Called once per channel
+     * @return Number of channels visited
+     */
+    size_t ForEachServerChannel(uint64_t serverId, const std::function<void(const Models::Channel&)>& visitor);
+    
     /**
      * @brief Get the default (first) channel of a server
      * @param serverId Server ID
@@ -250,19 +327,94 @@ public:
     // PERSISTENCE
     // =========================================================================
     
+    /**
+     * @brief Flush the journal, or checkpoint once it has grown (the
+     *        persistence worker calls this)
+     *
+     * Takes managerMutex, so never call it while holding it.
+     */
     bool SaveToFile();
+    
+    /**
+     * @brief Load the binary snapshot (else import the legacy XML file),
+     *        then replay the journal written after it
+     */
     bool LoadFromFile();
     
+    /**
+     * @brief Bring every User::serverIds in line with the loaded membership
+     *
+     * The user database must be loaded first. Only a deferred load needs
+     * to call this; the loading constructor does it.
+     */
+    void SyncMemberships();
+    
+    /**
+     * @brief Replace every server and channel with the contents of an XML database
+     */
+    bool ImportXml(const std::string& xmlPath);
+    
+    /**
+     * @brief Write every server and channel to an XML database
+     */
+    bool ExportXml(const std::string& xmlPath) const;
+    
+    /** Journal records that trigger a checkpoint */
+    static constexpr size_t CHECKPOINT_AFTER_RECORDS = 1000;
+    
+    /** Journal size that triggers a checkpoint */
+    static constexpr uint64_t CHECKPOINT_AFTER_BYTES = 1024 * 1024;
+    
 private:
+    // Legacy XML (import only) and the binary snapshot actually loaded and saved
     std::string databaseFilePath;
+    std::string snapshotFilePath;
     UserDatabase& userDatabase;
     
     // In-memory storage
-    std::map<uint64_t, Models::ChatServer> serversById;
-    std::map<uint64_t, Models::Channel> channelsById;
+    FlatHashMap<uint64_t, Models::ChatServer> serversById;
+    FlatHashMap<uint64_t, Models::Channel> channelsById;
+    
+    // Server names, for SearchServers
+    TrigramIndex serverNameIndex;
+    
+    // User ID -> servers they belong to, in join order. Authoritative;
+    // UserDatabase's User::serverIds is kept in step with it
+    std::unordered_map<uint64_t, std::vector<uint64_t>> serverIdsByMember;
+    
+    // Changes made since the snapshot
+    ServerJournal journal;
+    
+    // Set when the journal may be missing changes (failed append, torn tail,
+    // XML import); the next save checkpoints
+    bool checkpointRequested = false;
+    
+    // Thread safety: lookups share the lock, anything that writes takes it alone
+    mutable std::shared_mutex managerMutex;
+    
+    // Batches writes off the calling thread (declared last: its save reads the state above)
+    PersistenceWorker::Handle persistence;
+    
+    // Summary fields of one server (call with managerMutex held)
+    static ServerSummary summarize(const Models::ChatServer& server);
+    
+    // Loaders below expect managerMutex to be held (or the constructor to be running)
+    bool loadSnapshot(uint64_t& nextGeneration);
+    size_t replayJournal(uint64_t nextGeneration);
+    bool reloadLocked();
+    bool importXml(const std::string& xmlPath);
+    void rebuildIndexes();
+    void unindexMembership(uint64_t userId, uint64_t serverId);
+    size_t memberServerCount(uint64_t userId) const;
+    
+    // Journal a change already made in memory (call with managerMutex held)
+    void record(std::vector<ServerJournal::Delta> deltas);
+    
+    // Apply a journaled change; syncUsers also updates User::serverIds
+    void applyDelta(const ServerJournal::Delta& delta, bool syncUsers);
     
-    // Thread safety
-    mutable std::mutex managerMutex;
+    // Write a snapshot and start a new journal generation (managerMutex held)
+    bool checkpointLocked(bool catchUp = true);
     
     // Helper to get server by channel
     bool GetServerByChannel(uint64_t channelId, Models::ChatServer& outServer);
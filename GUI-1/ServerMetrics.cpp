@@ -0,0 +1,148 @@
+/**
+ * @file ServerMetrics.cpp
+ * @brief Implementation of the server's counters and their JSON snapshot
+ */
+
+#include "ServerMetrics.h"
+#include "PersistenceWorker.h"
+#include <Windows.h>
+#include <cstdio>
+
+namespace {
+
+void AppendHistogram(std::string& out, const char* name, const LatencyHistogram& histogram) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "\"%s\":{\"count\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+             name,
+             static_cast<unsigned long long>(histogram.Count()), histogram.Mean(),
+             static_cast<unsigned long long>(histogram.Percentile(0.50)),
+             static_cast<unsigned long long>(histogram.Percentile(0.99)),
+             static_cast<unsigned long long>(histogram.Percentile(0.999)),
+             static_cast<unsigned long long>(histogram.Max()));
+    out += buffer;
+}
+
+void AppendCounter(std::string& out, const char* name, uint64_t value) {
+    out += '"';
+    out += name;
+    out += "\":";
+    out += std::to_string(value);
+}
+
+} // namespace
+
+ServerMetrics::ServerMetrics(uint64_t nowMs)
+    : m_startMs(nowMs) {
+}
+
+void ServerMetrics::RecordAccept(uint64_t nowMs) {
+    ++m_accepts;
+    uint64_t second = nowMs / 1000;
+    size_t slot = static_cast<size_t>(second % RATE_WINDOW_SECONDS);
+    if (m_acceptSlotSecond[slot] != second) {
+        m_acceptSlotSecond[slot] = second;
+        m_acceptSlots[slot] = 0;
+    }
+    ++m_acceptSlots[slot];
+}
+
+void ServerMetrics::RecordBroadcast(size_t recipients) {
+    ++m_broadcasts;
+    m_deliveries += recipients;
+    m_fanOut.Record(recipients);
+}
+
+void ServerMetrics::RecordDisconnect(NetProtocol::Result reason) {
+    size_t index = static_cast<size_t>(reason);
+    if (index < DISCONNECT_REASON_COUNT) {
+        ++m_disconnects[index];
+    }
+}
+
+double ServerMetrics::AcceptsPerSecond(uint64_t nowMs) const {
+    uint64_t second = nowMs / 1000;
+    uint64_t accepts = 0;
+    for (size_t i = 0; i < RATE_WINDOW_SECONDS; ++i) {
+        if (m_acceptSlotSecond[i] + RATE_WINDOW_SECONDS > second) {
+            accepts += m_acceptSlots[i];
+        }
+    }
+    return static_cast<double>(accepts) / RATE_WINDOW_SECONDS;
+}
+
+std::string ServerMetrics::ToJson(const Gauges& gauges, uint64_t nowMs) const {
+    std::string out;
+    out.reserve(1024);
+    out += '{';
+    AppendCounter(out, "uptimeMs", nowMs - m_startMs);
+    out += ',';
+    AppendCounter(out, "connections", gauges.connections);
+    out += ',';
+    AppendCounter(out, "handshaking", gauges.handshaking);
+    out += ',';
+    AppendCounter(out, "readyClients", gauges.readyClients);
+    out += ',';
+    AppendCounter(out, "channels", gauges.channels);
+    out += ',';
+    AppendCounter(out, "accepts", m_accepts);
+
+    char rate[64];
+    snprintf(rate, sizeof(rate), ",\"acceptsPerSecond\":%.1f", AcceptsPerSecond(nowMs));
+    out += rate;
+
+    out += ',';
+    AppendCounter(out, "bytesIn", m_bytesIn);
+    out += ',';
+    AppendCounter(out, "bytesOut", m_bytesOut);
+    out += ',';
+    AppendCounter(out, "framesDecoded", m_framesDecoded);
+    out += ',';
+    AppendCounter(out, "framesShed", m_framesShed);
+    out += ',';
+    AppendCounter(out, "framesCompressed", m_framesCompressed);
+    out += ',';
+    AppendCounter(out, "compressionSavedBytes", m_compressionSavedBytes);
+    out += ',';
+    AppendCounter(out, "broadcasts", m_broadcasts);
+    out += ',';
+    AppendCounter(out, "deliveries", m_deliveries);
+    out += ',';
+    AppendCounter(out, "sendQueueBytes", gauges.queuedBytes);
+    out += ',';
+    AppendCounter(out, "sendQueueMaxBytes", gauges.maxQueuedBytes);
+
+    out += ",\"disconnects\":{";
+    for (size_t i = 0; i < DISCONNECT_REASON_COUNT; ++i) {
+        NetProtocol::Result reason = static_cast<NetProtocol::Result>(i);
+        if (i > 0) {
+            out += ',';
+        }
+        AppendCounter(out, reason == NetProtocol::Result::Success ? "Policy" : NetProtocol::ResultToString(reason),
+                      m_disconnects[i]);
+    }
+    out += "},";
+
+    AppendHistogram(out, "fanOut", m_fanOut);
+    out += ',';
+    AppendHistogram(out, "receiveToBroadcastUs", m_receiveToBroadcastUs);
+    out += ',';
+    AppendHistogram(out, "persistenceSaveUs", PersistenceWorker::SaveTimings());
+    out += '}';
+    return out;
+}
+
+bool ServerMetrics::WriteSnapshot(const std::string& json, const std::string& path) {
+    std::string tempPath = path + ".tmp";
+    FILE* file = nullptr;
+    if (fopen_s(&file, tempPath.c_str(), "wb") != 0 || !file) {
+        return false;
+    }
+    bool ok = fwrite(json.data(), 1, json.size(), file) == json.size() && fputc('\n', file) != EOF;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || !MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,121 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+/**
+ * @file ServerMetrics.h
+ * @brief Live counters and latency histograms for a ServerSocket
+ *
+ * PURPOSE:
+ * Scaling work needs numbers from the running server, not just from
+ * LoadGen on the other end: how many connections, how fast they arrive,
+ * how many bytes and frames move, how wide broadcasts fan out, how deep
+ * send queues get, why clients leave, and how long a chat line takes
+ * from its read completing to its broadcast being queued.
+ *
+ * DESIGN:
+ * - Counters are plain integers bumped by the network thread at the
+ *   points it already visits; nothing is scanned per event
+ * - Gauges (connection count, queued bytes) are collected by ServerSocket
+ *   only when a snapshot is taken
+ * - Distributions use LatencyHistogram; persistence save times come from
+ *   PersistenceWorker::SaveTimings()
+ * - ToJson() renders one snapshot; the same text answers the
+ *   GetServerMetrics request and goes into the periodic snapshot file
+ *
+ * THREADING:
+ * Not thread-safe; owned and used by the network thread, like the
+ * ServerSocket it belongs to.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "LatencyHistogram.h"
+#include "NetProtocol.h"
+
+class ServerMetrics {
+public:
+    /** Window the accept rate is averaged over */
+    static constexpr size_t RATE_WINDOW_SECONDS = 10;
+
+    /** NetProtocol::Result values; disconnects are counted per value */
+    static constexpr size_t DISCONNECT_REASON_COUNT = static_cast<size_t>(NetProtocol::Result::BufferError) + 1;
+
+    /**
+     * @brief Point-in-time values owned by ServerSocket, gathered per snapshot
+     */
+    struct Gauges {
+        size_t connections = 0;
+        size_t handshaking = 0;         ///< Connections that have not sent HELLO yet
+        size_t readyClients = 0;        ///< Waiting for another read turn
+        size_t channels = 0;            ///< Channels with at least one subscriber
+        size_t queuedBytes = 0;         ///< Outbound bytes over all connections
+        size_t maxQueuedBytes = 0;      ///< Deepest single send queue
+    };
+
+    explicit ServerMetrics(uint64_t nowMs);
+
+    void RecordAccept(uint64_t nowMs);
+    void RecordBytesIn(size_t bytes) { m_bytesIn += bytes; }
+    void RecordBytesOut(size_t bytes) { m_bytesOut += bytes; }
+    void RecordFrame() { ++m_framesDecoded; }
+    void RecordShedFrame() { ++m_framesShed; }
+
+    /** @brief One frame deflated from plainBytes to wireBytes */
+    void RecordCompressedFrame(size_t plainBytes, size_t wireBytes) {
+        ++m_framesCompressed;
+        m_compressionSavedBytes += plainBytes - wireBytes;
+    }
+
+    /** @brief One broadcast handed to this many outbound queues */
+    void RecordBroadcast(size_t recipients);
+
+    /** @brief Microseconds from the pass's read completions to a chat broadcast being queued */
+    void RecordReceiveToBroadcast(uint64_t micros) { m_receiveToBroadcastUs.Record(micros); }
+
+    /**
+     * @brief Count a connection leaving
+     * @param reason What ended it; Success means the server closed it by
+     *               policy (refused handshake, rate limit)
+     */
+    void RecordDisconnect(NetProtocol::Result reason);
+
+    /** @brief Mean accepts per second over the last RATE_WINDOW_SECONDS */
+    double AcceptsPerSecond(uint64_t nowMs) const;
+
+    /**
+     * @brief Render every counter, gauge and histogram as one JSON object
+     */
+    std::string ToJson(const Gauges& gauges, uint64_t nowMs) const;
+
+    /**
+     * @brief Replace a file's contents via a temp file and an atomic rename
+     */
+    static bool WriteSnapshot(const std::string& json, const std::string& path);
+
+private:
+    uint64_t m_startMs;
+    uint64_t m_accepts = 0;
+    uint64_t m_bytesIn = 0;
+    uint64_t m_bytesOut = 0;
+    uint64_t m_framesDecoded = 0;
+    uint64_t m_framesShed = 0;
+    uint64_t m_framesCompressed = 0;
+    uint64_t m_compressionSavedBytes = 0;
+    uint64_t m_broadcasts = 0;
+    uint64_t m_deliveries = 0;
+    uint64_t m_disconnects[DISCONNECT_REASON_COUNT] = {};
+
+    // Accepts per second for the last RATE_WINDOW_SECONDS, indexed by
+    // second modulo the window; a slot is reset when its second comes round
+    uint64_t m_acceptSlots[RATE_WINDOW_SECONDS] = {};
+    uint64_t m_acceptSlotSecond[RATE_WINDOW_SECONDS] = {};
+
+    LatencyHistogram m_fanOut;
+    LatencyHistogram m_receiveToBroadcastUs;
+
+    ServerMetrics(const ServerMetrics&) = delete;
+    ServerMetrics& operator=(const ServerMetrics&) = delete;
+};
+
+#endif // SERVER_METRICS_H
@@ -1,7 +1,23 @@
 #include "ServerSocket.h"
 #include "PlayerDisplay.hpp"
 #include "NetProtocol.h"
+#include "Protocol.h"
+#include "ProtocolCodec.h"
+#include "ServerManager.h"
+#include "MessageService.h"
+#include "UserDatabase.h"
+#include "ShardBus.h"
+#include "ServerIdentity.h"
+#include "AttachmentServer.h"
+#include "DirectMessageStore.h"
+#include "TextValidation.h"
+#include "Trace.h"
+#include "Log.h"
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <iterator>
 #include <cstdio>
 #include <cctype>
 #include <FL/fl_ask.H>
@@ -20,9 +36,78 @@ constexpr size_t MAX_USERNAME_LENGTH = 64;
 /** Minimum username length */
 constexpr size_t MIN_USERNAME_LENGTH = 1;
 
-/** Maximum allowed chat message length */
+/** Maximum allowed chat message length: the text a user typed, not the frame around it */
 constexpr size_t MAX_CHAT_MESSAGE_LENGTH = 4096;
 
+/** Maximum channels a single connection may subscribe to */
+constexpr size_t MAX_CHANNEL_SUBSCRIPTIONS = 256;
+
+/** Maximum departed users whose partly spent message budget is remembered */
+constexpr size_t MAX_SAVED_USER_BUDGETS = 4096;
+
+/**
+ * @brief Convert stored messages to their wire form, moving the bodies.
+ */
+static std::vector<Protocol::Payloads::MessageInfo> toMessageInfos(std::vector<Models::Message>& page) {
+    std::vector<Protocol::Payloads::MessageInfo> messages;
+    messages.reserve(page.size());
+    for (Models::Message& message : page) {
+        Protocol::Payloads::MessageInfo info;
+        info.messageId = message.messageId;
+        info.senderId = message.senderId;
+        info.channelId = message.channelId;
+        info.content = std::move(message.content);   // Stored as displayed, "name: text"
+        info.timestamp = static_cast<int64_t>(message.timestamp);
+        messages.push_back(std::move(info));
+    }
+    return messages;
+}
+
+/**
+ * @brief Key of the username index: ASCII lower case.
+ *
+ * Usernames are printable ASCII (isValidUsername), so folding ASCII is
+ * enough to make "Alice" and "alice" the same name.
+ */
+static std::string foldUsername(std::string_view username) {
+    std::string folded(username);
+    for (char& c : folded) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return folded;
+}
+
+/**
+ * @brief foldUsername() into a stack buffer, for lookups on the message path.
+ *
+ * A name longer than any valid one folds to "", which matches nothing.
+ */
+class FoldedName {
+public:
+    explicit FoldedName(std::string_view username) : m_length(0) {
+        if (username.size() > MAX_USERNAME_LENGTH) {
+            return;
+        }
+        for (char c : username) {
+            m_text[m_length++] = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+
+    std::string_view view() const { return std::string_view(m_text, m_length); }
+
+private:
+    char m_text[MAX_USERNAME_LENGTH];
+    size_t m_length;
+};
+
+/**
+ * @brief Microseconds on a monotonic clock, for the metrics latency samples.
+ */
+static uint64_t nowMicros() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
 /**
  * @brief Constructor for ServerSocket class, initializes Winsock and sets up the server socket.
  * 
@@ -36,11 +121,19 @@ constexpr size_t MAX_CHAT_MESSAGE_LENGTH = 4096;
  * @param settingsPath Path to the settings XML file.
  */
 ServerSocket::ServerSocket(int _port, PlayerDisplay* playerDisplay, const std::string& settingsPath)
-    : m_socket(INVALID_SOCKET), playerDisplay(playerDisplay), m_settings(settingsPath)
+    : playerDisplay(playerDisplay), m_config(ServerConfig::Load(settingsPath)), m_socket(INVALID_SOCKET)
+    , m_serverBudget(m_rateLimits.serverMessages, GetTickCount64())
+    , m_shedding(false)
+    , m_passStartMs(GetTickCount64())
+    , m_idleTimers(IDLE_TIMER_TICK_MS, m_passStartMs)
+    , m_presence(PRESENCE_GRACE_MS, IDLE_TIMER_TICK_MS, m_passStartMs)
+    , m_metrics(m_passStartMs)
+    , m_passStartUs(nowMicros())
+    , m_metricsIntervalMs(METRICS_FILE_INTERVAL_MS)
+    , m_nextMetricsWriteMs(0)
 {
     // Initialize Winsock
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+    if (!NetProtocol::StartNetworking()) {
         throw std::runtime_error("WSAStartup failed");
     }
 
@@ -79,10 +172,14 @@ ServerSocket::ServerSocket(int _port, PlayerDisplay* playerDisplay, const std::s
 
     // Set server socket to non-blocking for accept()
     // This allows us to poll for new connections without blocking
-    u_long mode = 1;
-    if (ioctlsocket(m_socket, FIONBIO, &mode) == SOCKET_ERROR) {
+    if (!NetProtocol::SetNonBlocking(m_socket)) {
         throw std::runtime_error("Failed to set non-blocking mode");
     }
+
+    // Hand accepts and reads to the platform's event backend. From here on
+    // the server only wakes up for sockets that actually have work.
+    m_engine = NetProtocol::IoBackend::Create(m_socket);
+    LOG_INFO("[INFO] Network events via %s", NetProtocol::IoBackend::KindName(m_engine->GetKind()));
 }
 
 /**
@@ -91,39 +188,38 @@ ServerSocket::ServerSocket(int _port, PlayerDisplay* playerDisplay, const std::s
 ServerSocket::~ServerSocket()
 {
     closeAllClients();
+    // Engine must go before the listener so it can cancel its pending accepts
+    m_engine.reset();
     closesocket(m_socket);
-    WSACleanup();
+    NetProtocol::StopNetworking();
 }
 
 /**
- * @brief Accepts a new client connection with security configuration.
+ * @brief Wraps a connection accepted by the event backend with security configuration.
  * 
  * SECURITY NOTES:
  * - New client sockets are configured with timeouts immediately
  * - This prevents slowloris-style connection exhaustion attacks
  * - Client is NOT authenticated at this point - just connected
  * 
- * @return A shared pointer to the ClientSocket for the accepted client, or nullptr if no connection.
+ * @param clientSocket Socket reported by the engine as Accepted.
+ * @return A shared pointer to the ClientSocket for the accepted client, or nullptr on failure.
  */
-std::shared_ptr<ClientSocket> ServerSocket::accept()
+std::shared_ptr<ClientSocket> ServerSocket::accept(SOCKET clientSocket)
 {
-    SOCKET clientSocket = ::accept(m_socket, NULL, NULL);
     if (clientSocket == INVALID_SOCKET) {
-        if (WSAGetLastError() != WSAEWOULDBLOCK) {
-            printf("[SECURITY] Failed to accept connection: %d\n", WSAGetLastError());
-        }
         return nullptr;
     }
 
     // SECURITY: Configure the new client socket with timeouts
     // This happens BEFORE any data exchange to protect against slow attacks
     try {
-        auto client = std::make_shared<ClientSocket>(clientSocket, playerDisplay, "config.xml");
+        auto client = std::make_shared<ClientSocket>(clientSocket, playerDisplay, m_config);
         // Note: ClientSocket constructor now configures security settings
         return client;
     }
     catch (const std::exception& e) {
-        printf("[SECURITY] Failed to initialize client socket: %s\n", e.what());
+        LOG_SECURITY("[SECURITY] Failed to initialize client socket: %s", e.what());
         closesocket(clientSocket);
         return nullptr;
     }
@@ -144,28 +240,33 @@ std::shared_ptr<ClientSocket> ServerSocket::accept()
 bool ServerSocket::isValidUsername(const std::string& username) {
     // Check length bounds
     if (username.size() < MIN_USERNAME_LENGTH || username.size() > MAX_USERNAME_LENGTH) {
-        printf("[SECURITY] Username rejected: invalid length (%zu)\n", username.size());
+        LOG_SECURITY("[SECURITY] Username rejected: invalid length (%zu)", username.size());
         return false;
     }
     
     // Check for leading/trailing whitespace
     if (std::isspace(static_cast<unsigned char>(username.front())) ||
         std::isspace(static_cast<unsigned char>(username.back()))) {
-        printf("[SECURITY] Username rejected: leading/trailing whitespace\n");
+        LOG_SECURITY("[SECURITY] Username rejected: leading/trailing whitespace");
         return false;
     }
     
-    // Validate each character
-    for (unsigned char c : username) {
-        // Allow only printable ASCII (0x20-0x7E)
-        // This prevents:
-        // - Control character injection (newlines in logs, etc.)
-        // - Unicode homograph attacks
-        // - Non-printable character confusion
-        if (c < 0x20 || c > 0x7E) {
-            printf("[SECURITY] Username rejected: invalid character (0x%02X)\n", c);
-            return false;
-        }
+    // Allow only printable ASCII (0x20-0x7E)
+    // This prevents:
+    // - Control character injection (newlines in logs, etc.)
+    // - Unicode homograph attacks
+    // - Non-printable character confusion
+    size_t invalid = TextValidation::FindInvalid(username, TextValidation::PRINTABLE_ASCII);
+    if (invalid != std::string_view::npos) {
+        LOG_SECURITY("[SECURITY] Username rejected: invalid character (0x%02X)",
+                     static_cast<unsigned char>(username[invalid]));
+        return false;
+    }
+    
+    // Bus connections from other nodes are admitted under this prefix only
+    if (username.rfind(ShardMap::PEER_NAME_PREFIX, 0) == 0) {
+        LOG_SECURITY("[SECURITY] Username rejected: reserved peer prefix");
+        return false;
     }
     
     // Reject usernames that look like system messages
@@ -173,7 +274,7 @@ bool ServerSocket::isValidUsername(const std::string& username) {
     if (username.find("[SERVER]") != std::string::npos ||
         username.find("[SYSTEM]") != std::string::npos ||
         username.find("[ADMIN]") != std::string::npos) {
-        printf("[SECURITY] Username rejected: contains reserved prefix\n");
+        LOG_SECURITY("[SECURITY] Username rejected: contains reserved prefix");
         return false;
     }
     
@@ -181,21 +282,70 @@ bool ServerSocket::isValidUsername(const std::string& username) {
 }
 
 /**
- * @brief Broadcasts a message to all connected clients (LEGACY).
- * @deprecated Use broadcastMessageSecure() for new code.
+ * @brief Broadcasts a message to all connected clients.
+ * 
+ * Every connection speaks the framed protocol now, so this is the same
+ * as broadcastMessageSecure(); kept for existing callers.
+ * 
  * @param message The message to send to all clients.
  */
 void ServerSocket::broadcastMessage(const std::string& message)
 {
-    for (const auto& client : clients) {
-        try {
-            client->send(message);
-        }
-        catch (const std::exception& e) {
-            printf("[WARNING] Failed to send to client %s: %s\n", 
-                   client->getUsername().c_str(), e.what());
+    broadcastMessageSecure(message);
+}
+
+/**
+ * @brief Hands one pre-encoded buffer to every client's outbound queue.
+ * 
+ * The buffer is reference-counted, so the cost per recipient is a
+ * refcount increment rather than an allocation and a copy. v5 clients
+ * share one compressed copy, deflated for the first of them.
+ * 
+ * @param frame Bytes to send, encoded once by the caller.
+ */
+void ServerSocket::broadcastFrame(const NetProtocol::FrameBuffer& frame)
+{
+    if (!frame) {
+        return;
+    }
+    NetProtocol::FrameBuffer compressed;
+    size_t recipients = 0;
+    for (const auto& client : m_clients) {
+        // Clients still in the handshake must see WELCOME before anything
+        // else, and peer nodes are not users
+        if (client->getUsername().empty() || client->m_isPeer) {
+            continue;
         }
+        queueSend(client, frameFor(client, frame, compressed));
+        ++recipients;
+    }
+    m_metrics.RecordBroadcast(recipients);
+}
+
+/**
+ * @brief Hands one pre-encoded buffer to the subscribers of a channel.
+ * 
+ * Only clients that joined the channel pay for the message, so the cost
+ * of a chat line scales with the channel rather than the whole server.
+ * 
+ * @param channelId Target channel.
+ * @param frame Bytes to send, encoded once by the caller.
+ */
+void ServerSocket::broadcastToChannel(uint64_t channelId, const NetProtocol::FrameBuffer& frame)
+{
+    if (!frame) {
+        return;
+    }
+    auto found = m_channelSubscribers.find(channelId);
+    if (found == m_channelSubscribers.end()) {
+        return;
+    }
+    // queueSend only schedules drops, so the subscriber list stays intact
+    NetProtocol::FrameBuffer compressed;
+    for (const auto& client : found->second) {
+        queueSend(client, frameFor(client, frame, compressed));
     }
+    m_metrics.RecordBroadcast(found->second.size());
 }
 
 /**
@@ -204,18 +354,20 @@ void ServerSocket::broadcastMessage(const std::string& message)
  * SECURITY: Uses length-prefixed messages to prevent framing issues.
  * Failed sends are logged but don't affect other clients.
  * 
+ * The frame is encoded once and shared by every recipient.
+ * 
  * @param message The message to broadcast.
  */
 void ServerSocket::broadcastMessageSecure(const std::string& message)
 {
-    for (const auto& client : clients) {
-        NetProtocol::Result result = client->sendSecure(message);
-        if (result != NetProtocol::Result::Success) {
-            printf("[WARNING] Failed to send to client %s: %s\n",
-                   client->getUsername().c_str(),
-                   NetProtocol::ResultToString(result));
-        }
+    // Serialize once: length prefix and payload share a single allocation
+    NetProtocol::FrameBuffer frame = NetProtocol::FrameBuffer::Encode(message);
+    if (!frame) {
+        LOG_WARNING("[WARNING] Broadcast rejected: %s",
+               NetProtocol::ResultToString(NetProtocol::Result::MessageTooLarge));
+        return;
     }
+    broadcastFrame(frame);
 }
 
 
@@ -224,213 +376,1901 @@ void ServerSocket::broadcastMessageSecure(const std::string& message)
  */
 void ServerSocket::closeAllClients()
 {
-    for (auto& client : clients) {
-        client->send("[SERVER]: Server is shutting down.");
-        client->closed();
+    for (auto& client : m_clients) {
+        // A synchronous write during an overlapped one would split a frame
+        if (!client->m_outbound.InFlight()) {
+            client->sendSecure("[SERVER]: Server is shutting down.");
+        }
+        if (m_engine) {
+            m_engine->Remove(client->getSocket());
+        }
+    }
+    m_pendingDrops.clear();
+    m_readyClients.clear();
+    m_channelSubscribers.clear();
+    m_channelsBySocket.clear();
+    m_idleTimers.Clear();
+    m_presence.Clear();
+    m_userBudgets.clear();
+    m_remoteUsers.clear();
+    m_clientsBySocket.clear();
+    m_clientsByName.clear();
+    m_clientsByUserId.clear();
+    m_clients.Clear();
+}
+
+/**
+ * @brief Registers an accepted client with the engine and the client lists.
+ *
+ * The username arrives in the HELLO handshake frame, so the
+ * client is tracked with an empty username until its first read completes.
+ *
+ * @param client The newly accepted client.
+ */
+void ServerSocket::registerClient(const std::shared_ptr<ClientSocket>& client)
+{
+    // The backend reads for us; the decoder must not recv() on its own
+    if (m_engine->DeliversData()) {
+        client->m_decoder.SetExternalInput();
+    }
+    if (!m_engine->Associate(client->getSocket())) {
+        LOG_WARNING("[WARNING] Failed to register client with the event backend");
+        return;
+    }
+
+    client->m_outbound.SetLimits(m_outboundLimits);
+    client->m_byteBudget.Reset(m_rateLimits.connectionBytes, m_passStartMs);
+
+    LOG_INFO("[INFO] Client connected, waiting for handshake...");
+    client->m_slot = m_clients.Insert(client);
+    m_clientsBySocket[static_cast<uint64_t>(client->getSocket())] = client->m_slot;
+    m_capture.RecordConnect(static_cast<uint64_t>(client->getSocket()));
+    
+    // A connection that never says HELLO would otherwise be held forever
+    m_idleTimers.Schedule(static_cast<uint64_t>(client->getSocket()),
+                          m_passStartMs + NetProtocol::HANDSHAKE_TIMEOUT_MS);
+}
+
+/**
+ * @brief Completes the HELLO/WELCOME handshake sent as a client's first frame.
+ *
+ * SECURITY: The handshake and username are ATTACKER-CONTROLLED and
+ * validated before the client is announced to anyone else. Rejections
+ * are written synchronously; nothing else has been sent to the client yet.
+ *
+ * @param client The client that sent its handshake.
+ * @param hello The received HELLO payload.
+ * @return True if the client was admitted, false if it must be dropped.
+ */
+bool ServerSocket::admitClient(const std::shared_ptr<ClientSocket>& client, std::string_view hello)
+{
+    uint32_t offeredVersion = 0;
+    std::string username;
+    if (!NetProtocol::ParseHello(hello, offeredVersion, username)) {
+        LOG_SECURITY("[SECURITY] Rejected connection: malformed handshake");
+        return false;
+    }
+
+    uint32_t version = NetProtocol::NegotiateVersion(offeredVersion);
+    if (version == 0) {
+        LOG_INFO("[INFO] Rejected connection: unsupported protocol version %u", offeredVersion);
+        client->sendSecure("[SERVER]: Unsupported protocol version. Please update your client.");
+        return false;
+    }
+
+    if (username.rfind(ShardMap::PEER_NAME_PREFIX, 0) == 0) {
+        return admitPeer(client, username, version);
+    }
+
+    // SECURITY CHECK: Validate username before accepting
+    if (!isValidUsername(username)) {
+        LOG_SECURITY("[SECURITY] Rejected connection: invalid username");
+        client->sendSecure("[SERVER]: Invalid username format. Disconnecting.");
+        return false;
+    }
+
+    if (isUsernameTaken(username)) {
+        LOG_INFO("[INFO] Rejected connection: username '%s' already taken", username.c_str());
+        client->sendSecure("[SERVER]: Username is already in use. Disconnecting.");
+        return false;
+    }
+
+    client->setUsername(username);
+    m_clientsByName[foldUsername(username)] = client->m_slot;
+    if (m_services.users) {
+        client->m_userId = m_services.users->GetUserIdByUsername(username);
+        if (client->m_userId != 0) {
+            m_clientsByUserId[client->m_userId] = client->m_slot;
+        }
+    }
+    client->m_protocolVersion = version;
+    if (client->supportsCompression()) {
+        client->m_decoder.EnableCompression();
+    }
+
+    // Reconnecting does not refill a budget the user already spent
+    auto saved = m_userBudgets.find(foldUsername(username));
+    if (saved != m_userBudgets.end()) {
+        client->m_messageBudget = saved->second;
+        m_userBudgets.erase(saved);
+    }
+    else {
+        client->m_messageBudget.Reset(m_rateLimits.userMessages, m_passStartMs);
+    }
+    LOG_INFO("[INFO] Client connected: %s (protocol v%u)", username.c_str(), version);
+
+    // Older clients never send heartbeats, so silence proves nothing
+    if (client->sendsHeartbeats()) {
+        touchClient(client);
+    }
+    else {
+        m_idleTimers.Cancel(static_cast<uint64_t>(client->getSocket()));
+    }
+
+    // WELCOME is queued first, so it precedes every broadcast on the wire
+    queueSend(client, NetProtocol::BuildWelcome(version));
+
+    notifyRoster(client, username, true);
+    if (m_presence.Arrive(foldUsername(username))) {
+        announcePresence(username, true);
+    }
+    publishPresence(username, true);
+    return true;
+}
+
+/**
+ * @brief Challenges another node's ShardBus connection.
+ *
+ * SECURITY: A HELLO name is only a claim, so the node id must be in the
+ * shard map and the connection must come from that node's address. Any
+ * process on that host (or behind the same NAT) passes both, so the
+ * connection is not a peer yet: it is sent a fresh nonce and admitted
+ * by completePeer() only if it answers with the shard secret's MAC.
+ *
+ * @param client The connecting peer.
+ * @param name HELLO username, ShardMap::PeerName(nodeId).
+ * @param version Negotiated protocol version.
+ * @return True if the challenge was sent.
+ */
+bool ServerSocket::admitPeer(const std::shared_ptr<ClientSocket>& client, const std::string& name, uint32_t version)
+{
+    std::string nodeId = name.substr(std::char_traits<char>::length(ShardMap::PEER_NAME_PREFIX));
+    const ShardMap::Node* node = m_bus ? m_bus->Shards().FindNode(nodeId) : nullptr;
+
+    sockaddr_in peer = {};
+    socklen_t peerLength = sizeof(peer);
+    if (!node || node == &m_bus->Shards().Self() ||
+        version < NetProtocol::SHARDING_PROTOCOL_VERSION ||
+        getpeername(client->getSocket(), reinterpret_cast<sockaddr*>(&peer), &peerLength) != 0 ||
+        peer.sin_family != AF_INET || peer.sin_addr.s_addr != node->address) {
+        LOG_SECURITY("[SECURITY] Rejected connection: unrecognised peer node claim");
+        return false;
+    }
+
+    std::vector<uint8_t> challenge(ShardMap::CHALLENGE_SIZE);
+    if (Security::GenerateRandomBytes(challenge.data(), challenge.size()) != Security::CryptoResult::Success) {
+        LOG_ERROR("[SHARD] No random nonce for peer '%s'; refusing it", nodeId.c_str());
+        return false;
+    }
+    client->m_protocolVersion = version;
+    client->m_peerNode = nodeId;
+    client->m_peerChallenge = challenge;
+    queueSend(client, ShardMap::BuildChallenge(challenge));
+    return true;
+}
+
+/**
+ * @brief Admits a challenged ShardBus connection that proved the shard secret.
+ *
+ * SECURITY: The proof is a MAC over this connection's nonce and both node
+ * ids, compared in constant time; a wrong or malformed one drops the
+ * connection. Only then may a newer link replace the node's old one,
+ * which is closed.
+ *
+ * @param client The challenged peer.
+ * @param frame Its PROOF frame.
+ * @return True if the peer was admitted.
+ */
+bool ServerSocket::completePeer(const std::shared_ptr<ClientSocket>& client, std::string_view frame)
+{
+    std::string nodeId = client->m_peerNode;
+    std::vector<uint8_t> expected = m_bus->Shards().PeerProof(nodeId, m_bus->Shards().Self().id,
+                                                              client->m_peerChallenge);
+    std::vector<uint8_t> proof;
+    client->m_peerChallenge.clear();
+    if (expected.empty() || !ShardMap::ParseProof(frame, proof) || proof.size() != expected.size() ||
+        !Security::ConstantTimeEquals(proof.data(), expected.data(), proof.size())) {
+        client->m_peerNode.clear();
+        LOG_SECURITY("[SECURITY] Rejected connection: peer node '%s' failed its challenge", nodeId.c_str());
+        return false;
+    }
+    uint32_t version = client->m_protocolVersion;
+    std::string name = ShardMap::PeerName(nodeId);
+
+    for (const auto& other : m_clients) {
+        if (other != client && other->m_isPeer && other->m_peerNode == nodeId) {
+            other->m_peerNode.clear();      // Its departure must not forget the new link's users
+            closeClient(other, NetProtocol::Result::Success);
+        }
+    }
+
+    client->setUsername(name);
+    client->m_isPeer = true;
+    if (client->supportsCompression()) {
+        client->m_decoder.EnableCompression();
+    }
+    touchClient(client);
+    queueSend(client, NetProtocol::BuildWelcome(version));
+    LOG_INFO("[SHARD] Peer node '%s' connected", nodeId.c_str());
+
+    // A new link means the peer (re)started: tell it who is connected here
+    Protocol::Payloads::BusPublishRequest online;
+    online.topic = static_cast<uint32_t>(Protocol::Payloads::BusTopic::UserOnline);
+    online.originNode = m_bus->Shards().Self().id;
+    for (const auto& user : m_clients) {
+        if (!user->m_isPeer && !user->getUsername().empty()) {
+            online.key = user->getUsername();
+            m_bus->Publish(nodeId, Protocol::Wire::EncodeRequest(Protocol::RequestType::BusPublish, 0, online));
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Publishes a local user's arrival or departure to every other node.
+ */
+void ServerSocket::publishPresence(const std::string& username, bool online)
+{
+    if (!m_bus) {
+        return;
+    }
+    Protocol::Payloads::BusPublishRequest event;
+    event.topic = static_cast<uint32_t>(online ? Protocol::Payloads::BusTopic::UserOnline
+                                               : Protocol::Payloads::BusTopic::UserOffline);
+    event.originNode = m_bus->Shards().Self().id;
+    event.key = username;
+    m_bus->PublishAll(Protocol::Wire::EncodeRequest(Protocol::RequestType::BusPublish, 0, event));
+}
+
+/**
+ * @brief Tells the users who care that a user came or went.
+ *
+ * Fellow members of the hosted server and the user's friends are looked
+ * up by ID in m_clientsByUserId; other connections are never visited.
+ * Without a user database nobody can be told apart, so everyone is. v9
+ * clients get a UserOnline/UserOffline push; older ones get the text line
+ * they always did.
+ *
+ * SECURITY: Member presence is no secret (GetServerMembers reports it to
+ * any connection), so a claimed HELLO name is enough to receive it.
+ * Friendship is private: only a connection whose identity was proven by
+ * a login is told about its friends, never one that merely claims a name.
+ *
+ * @param username The user, local or on another node.
+ * @param online True for an arrival.
+ */
+void ServerSocket::announcePresence(const std::string& username, bool online)
+{
+    UserDatabase* users = m_services.users;
+    uint64_t subjectId = users ? users->GetUserIdByUsername(username) : 0;
+    if (users && subjectId == 0) {
+        return;     // Not registered: nobody can be its friend or fellow member
+    }
+
+    Protocol::Payloads::PresenceUpdate update;
+    update.username = username;
+    std::string push = Protocol::Wire::EncodeResponse(online ? Protocol::ResponseType::UserOnline
+                                                             : Protocol::ResponseType::UserOffline, 0);
+    Protocol::Wire::Writer writer(push);
+    Protocol::Wire::WritePayload(writer, update);
+    NetProtocol::FrameBuffer pushFrame = NetProtocol::FrameBuffer::Encode(push);
+    NetProtocol::FrameBuffer textFrame = NetProtocol::FrameBuffer::Encode(
+        "[SERVER]: " + username + (online ? " has joined the server." : " has disconnected."));
+    NetProtocol::FrameBuffer pushCompressed;
+    NetProtocol::FrameBuffer textCompressed;
+
+    size_t recipients = 0;
+    auto tell = [&](const std::shared_ptr<ClientSocket>& client) {
+        if (client->supportsPresence()) {
+            queueSend(client, frameFor(client, pushFrame, pushCompressed));
+        }
+        else {
+            queueSend(client, frameFor(client, textFrame, textCompressed));
+        }
+        ++recipients;
+    };
+
+    if (!users) {
+        std::string subject = foldUsername(username);
+        for (const auto& client : m_clients) {
+            if (!client->getUsername().empty() && !client->m_isPeer && foldUsername(client->getUsername()) != subject) {
+                tell(client);
+            }
+        }
+        m_metrics.RecordBroadcast(recipients);
+        return;
+    }
+
+    ServerManager* servers = m_services.servers;
+    uint64_t hosted = m_services.hostedServerId;
+    bool member = servers && hosted != 0 && servers->IsServerMember(hosted, subjectId);
+    if (member) {
+        for (uint64_t memberId : servers->GetServerMembers(hosted)) {
+            std::shared_ptr<ClientSocket> client = memberId != subjectId ? findClientByUserId(memberId) : nullptr;
+            if (client) {
+                tell(client);
+            }
+        }
+    }
+    for (uint64_t friendId : users->GetFriendIds(subjectId)) {
+        std::shared_ptr<ClientSocket> client = findClientByUserId(friendId);
+        if (client && client->m_authenticated && !(member && servers->IsServerMember(hosted, friendId))) {
+            tell(client);
+        }
+    }
+    m_metrics.RecordBroadcast(recipients);
+}
+
+/**
+ * @brief Announces the departures whose grace period ran out this pass.
+ */
+void ServerSocket::flushPresence()
+{
+    if (m_presence.Empty()) {
+        return;
+    }
+    std::vector<std::string> departed;
+    m_presence.Advance(m_passStartMs, departed);
+    for (const std::string& username : departed) {
+        announcePresence(username, false);
+    }
+}
+
+/**
+ * @brief Removes a client from the engine and from the client lists.
+ *
+ * The ClientSocket (and its socket handle) is released once the last
+ * shared_ptr goes away; the engine frees its read and send contexts, and
+ * any buffers pinned by an in-flight send, when the resulting
+ * cancellations complete.
+ *
+ * @param client The client to drop.
+ */
+void ServerSocket::dropClient(const std::shared_ptr<ClientSocket>& client)
+{
+    m_engine->Remove(client->getSocket());
+    client->m_outbound.Clear();
+    unsubscribeAll(client);
+    m_idleTimers.Cancel(static_cast<uint64_t>(client->getSocket()));
+    m_metrics.RecordDisconnect(client->m_closeReason);
+
+    // Remember a budget that is still refilling; a full one is the default
+    const std::string& username = client->getUsername();
+    if (!username.empty() && !client->m_messageBudget.Full(m_passStartMs)) {
+        if (m_userBudgets.size() >= MAX_SAVED_USER_BUDGETS) {
+            for (auto it = m_userBudgets.begin(); it != m_userBudgets.end();) {
+                it = it->second.Full(m_passStartMs) ? m_userBudgets.erase(it) : std::next(it);
+            }
+        }
+        if (m_userBudgets.size() < MAX_SAVED_USER_BUDGETS) {
+            m_userBudgets[foldUsername(username)] = client->m_messageBudget;
+        }
+    }
+
+    m_readyClients.erase(std::remove(m_readyClients.begin(), m_readyClients.end(), client), m_readyClients.end());
+    m_clientsBySocket.erase(static_cast<uint64_t>(client->getSocket()));
+    m_capture.RecordDisconnect(static_cast<uint64_t>(client->getSocket()));
+    if (!client->m_isPeer && !username.empty()) {
+        auto named = m_clientsByName.find(foldUsername(username));
+        if (named != m_clientsByName.end() && named->second == client->m_slot) {
+            m_clientsByName.erase(named);
+        }
+        auto registered = m_clientsByUserId.find(client->m_userId);
+        if (registered != m_clientsByUserId.end() && registered->second == client->m_slot) {
+            m_clientsByUserId.erase(registered);
+        }
+    }
+    m_clients.Erase(client->m_slot);
+}
+
+/**
+ * @brief Adds a client to a channel's subscriber set.
+ *
+ * SECURITY: The number of subscriptions per connection is capped so a
+ * client cannot grow the index without bound.
+ *
+ * @param client The subscribing client.
+ * @param channelId Channel to join (non-zero).
+ * @return True if the client is subscribed, false if it hit the limit.
+ */
+bool ServerSocket::subscribeChannel(const std::shared_ptr<ClientSocket>& client, uint64_t channelId)
+{
+    std::vector<uint64_t>& joined = m_channelsBySocket[client->getSocket()];
+    if (std::find(joined.begin(), joined.end(), channelId) != joined.end()) {
+        return true;
+    }
+    if (joined.size() >= MAX_CHANNEL_SUBSCRIPTIONS) {
+        LOG_SECURITY("[SECURITY] %s exceeded the channel subscription limit", client->getUsername().c_str());
+        return false;
+    }
+
+    joined.push_back(channelId);
+    m_channelSubscribers[channelId].push_back(client);
+    return true;
+}
+
+/**
+ * @brief Removes a client from a channel's subscriber set.
+ *
+ * @param client The client leaving the channel.
+ * @param channelId Channel to leave.
+ */
+void ServerSocket::unsubscribeChannel(const std::shared_ptr<ClientSocket>& client, uint64_t channelId)
+{
+    auto joined = m_channelsBySocket.find(client->getSocket());
+    if (joined == m_channelsBySocket.end()) {
+        return;
+    }
+    auto& ids = joined->second;
+    ids.erase(std::remove(ids.begin(), ids.end(), channelId), ids.end());
+    if (ids.empty()) {
+        m_channelsBySocket.erase(joined);
+    }
+
+    auto subscribers = m_channelSubscribers.find(channelId);
+    if (subscribers != m_channelSubscribers.end()) {
+        auto& members = subscribers->second;
+        members.erase(std::remove(members.begin(), members.end(), client), members.end());
+        if (members.empty()) {
+            m_channelSubscribers.erase(subscribers);
+        }
+    }
+}
+
+/**
+ * @brief Removes a client from every channel it joined.
+ *
+ * @param client The departing client.
+ */
+void ServerSocket::unsubscribeAll(const std::shared_ptr<ClientSocket>& client)
+{
+    auto joined = m_channelsBySocket.find(client->getSocket());
+    if (joined == m_channelsBySocket.end()) {
+        return;
+    }
+    // Copy: unsubscribeChannel() erases the reverse entry when it empties
+    std::vector<uint64_t> ids = joined->second;
+    for (uint64_t channelId : ids) {
+        unsubscribeChannel(client, channelId);
     }
-    clients.clear();
 }
+
 /**
  * @brief Handles client connections and processes their messages.
- * 
+ *
  * SECURITY IMPLEMENTATION NOTES:
  * 1. New connections: Username is validated before acceptance
  * 2. All messages: Length and content validated before processing
  * 3. Commands: Parsed carefully to prevent injection
  * 4. Broadcasts: Use server-controlled format, not raw client input
- * 
+ *
  * TRUST BOUNDARY: All data from clients is ATTACKER-CONTROLLED.
+ *
+ * @param waitMs How long to block waiting for completions.
  */
-void ServerSocket::handleClientConnections() {
-    // =========================================================================
-    // STEP 1: Accept new connections
-    // =========================================================================
-    std::shared_ptr<ClientSocket> client = accept();
-
-    if (client) {
-        // Receive username (using legacy non-blocking receive)
-        std::string username;
-        if (client->receive(username)) {
-            // SECURITY CHECK: Validate username before accepting
-            if (!isValidUsername(username)) {
-                printf("[SECURITY] Rejected connection: invalid username\n");
-                return;
-            }
-            
-            if (isUsernameTaken(username)) {
-                printf("[INFO] Rejected connection: username '%s' already taken\n", username.c_str());
-                try {
-                    client->send("[SERVER]: Username is already in use. Disconnecting.");
-                } catch (...) {}
-                return;
+void ServerSocket::handleClientConnections(DWORD waitMs) {
+    // Clients with buffered input must not wait for the next completion,
+    // and armed timers must not wait longer than a tick
+    DWORD wait = m_readyClients.empty() ? waitMs : 0;
+    if (!m_idleTimers.Empty() || !m_presence.Empty()) {
+        wait = (std::min)(wait, IDLE_TIMER_TICK_MS);
+    }
+    // An idle server still refreshes its snapshot file on time
+    if (!m_metricsPath.empty()) {
+        ULONGLONG now = GetTickCount64();
+        wait = (std::min)(wait, now >= m_nextMetricsWriteMs ? DWORD(0) : static_cast<DWORD>(m_nextMetricsWriteMs - now));
+    }
+    std::vector<NetProtocol::IoBackend::Event> events;
+    m_engine->Poll(events, wait);
+    m_passStartMs = GetTickCount64();
+    m_passStartUs = nowMicros();
+    TRACE_ZONE("ServerSocket::handleClientConnections");
+
+    for (const auto& event : events) {
+        // =====================================================================
+        // New connections: every accept completed in this batch
+        // =====================================================================
+        if (event.type == NetProtocol::IoBackend::EventType::Accepted) {
+            std::shared_ptr<ClientSocket> client = accept(event.socket);
+            if (client) {
+                m_metrics.RecordAccept(m_passStartMs);
+                registerClient(client);
             }
-            
-            client->setUsername(username);
-            printf("[INFO] Client connected: %s\n", username.c_str());
-            
-            client->addingPlayer(username);
-            clients.push_back(client);
-            
-            broadcastMessage("[SERVER]: " + username + " has joined the server.");
+            continue;
         }
-        else {
-            // No username yet - add to list anyway, we'll get it on next poll
-            // This handles the case where username arrives in a separate packet
-            printf("[INFO] Client connected, waiting for username...\n");
-            clients.push_back(client);
-        }
-    }
-
-    // =========================================================================
-    // STEP 2: Process messages from connected clients
-    // =========================================================================
-    std::vector<std::string> disconnectedUsernames;
-
-    for (auto it = clients.begin(); it != clients.end(); /* no increment here */) {
-        std::shared_ptr<ClientSocket>& c = *it;
-        std::string message;
-        std::string username = c->getUsername();
-
-        // Use legacy non-blocking receive
-        bool received = c->receive(message);
-        
-        if (received) {
-            // SECURITY CHECK: Validate message length
-            if (message.size() > MAX_CHAT_MESSAGE_LENGTH) {
-                printf("[SECURITY] Message from %s rejected: too long\n", username.c_str());
-                try { c->send("[SERVER]: Message too long."); } catch (...) {}
-                ++it;
-                continue;
-            }
-            
-            // Handle whisper: W/targetUser message
-            if (message.rfind("W/", 0) == 0) {
-                size_t spacePos = message.find(' ', 2);
-                if (spacePos != std::string::npos && spacePos > 2) {
-                    std::string targetUsername = message.substr(2, spacePos - 2);
-                    std::string whisperMessage = message.substr(spacePos + 1);
-                    
-                    if (whisperMessage.empty()) {
-                        try { c->send("[SERVER]: Empty whisper message."); } catch (...) {}
-                        ++it;
-                        continue;
-                    }
 
-                    auto targetClient = std::find_if(clients.begin(), clients.end(),
-                        [&](const std::shared_ptr<ClientSocket>& client) {
-                            return client->getUsername() == targetUsername;
-                        });
+        if (event.type == NetProtocol::IoBackend::EventType::Wakeup) {
+            continue;
+        }
 
-                    if (targetClient != clients.end()) {
-                        try {
-                            (*targetClient)->send("[Whisper from " + username + "]: " + whisperMessage);
-                            c->send("[Whisper to " + targetUsername + "]: " + whisperMessage);
-                        } catch (...) {}
-                    }
-                    else {
-                        try { c->send("[SERVER]: User '" + targetUsername + "' not found."); } catch (...) {}
-                    }
-                }
-                else {
-                    try { c->send("[SERVER]: Invalid whisper format. Usage: W/username message"); } catch (...) {}
-                }
-                ++it;
+        std::shared_ptr<ClientSocket> c = findClientBySocket(event.socket);
+        if (!c) {
+            continue;
+        }
+
+        switch (event.type) {
+        // =====================================================================
+        // Ready clients only. One read may carry many frames, and frames
+        // left in the decoder would never trigger another notification:
+        // re-arm only once the input is exhausted, otherwise queue the
+        // client for another turn. Bytes the backend already read go into
+        // the decoder first; a client that outruns its decoder is flooding.
+        // =====================================================================
+        case NetProtocol::IoBackend::EventType::Received:
+            if (event.bytes == 0) {
+                c->m_decoder.FeedEnd();
             }
-            // Handle server version request
-            else if (message == "SV/" || message.rfind("SV/", 0) == 0) {
-                try { c->send("[SERVER]: Server Version: 1.0.0 (Security Phase 1)"); } catch (...) {}
-                ++it;
+            else if (c->m_decoder.Feed(event.data, event.bytes) != NetProtocol::Result::Success) {
+                LOG_SECURITY("[SECURITY] Dropping client whose unread input exceeds %zu bytes",
+                             NetProtocol::FrameDecoder::MAX_BACKLOG);
+                closeClient(c, NetProtocol::Result::NetworkError);
+                break;
             }
-            // Handle username change command
-            else if (message.rfind("/change_username ", 0) == 0) {
-                std::string newUsername = message.substr(17);
-                
-                // Validate new username
-                if (!isValidUsername(newUsername)) {
-                    try { c->send("[SERVER]: Invalid username format."); } catch (...) {}
-                    ++it;
-                    continue;
-                }
-
-                std::string oldUsername = c->getUsername();
-                if (handleUsernameChange(c, newUsername)) {
-                    broadcastMessage("[SERVER]: " + oldUsername + " is now known as " + newUsername);
-                }
-                else {
-                    try { c->send("[SERVER]: The username '" + newUsername + "' is already taken."); } catch (...) {}
+            [[fallthrough]];
+        case NetProtocol::IoBackend::EventType::Readable:
+            if (drainClient(c)) {
+                if (std::find(m_readyClients.begin(), m_readyClients.end(), c) == m_readyClients.end()) {
+                    m_readyClients.push_back(c);
                 }
-                ++it;
             }
-            // Regular chat message
-            else {
-                // SECURITY: Server formats the broadcast message
-                // The username comes from server-side storage, not from the message
-                
-                // Check for channel prefix [CH:id] and preserve it
-                std::string channelPrefix = "";
-                std::string actualMessage = message;
-                
-                if (message.rfind("[CH:", 0) == 0) {
-                    size_t endBracket = message.find(']');
-                    if (endBracket != std::string::npos) {
-                        channelPrefix = message.substr(0, endBracket + 1);
-                        actualMessage = message.substr(endBracket + 1);
-                    }
-                }
-                
-                broadcastMessage(channelPrefix + username + ": " + actualMessage);
-                ++it;
+            else if (!c->closed() && !m_engine->Rearm(event.socket)) {
+                closeClient(c, NetProtocol::Result::NetworkError);
             }
+            break;
+
+        // =====================================================================
+        // Outbound: account for the finished batch and start the next one
+        // =====================================================================
+        case NetProtocol::IoBackend::EventType::SendComplete:
+            c->m_outbound.OnSent(event.bytes);
+            m_metrics.RecordBytesOut(event.bytes);
+            flushClient(c);
+            break;
+
+        case NetProtocol::IoBackend::EventType::Closed:
+        case NetProtocol::IoBackend::EventType::SendFailed:
+        default:
+            c->m_outbound.AbortInFlight();
+            closeClient(c, event.type == NetProtocol::IoBackend::EventType::Closed ? NetProtocol::Result::Disconnected
+                                                                      : NetProtocol::Result::NetworkError);
+            break;
         }
-        else if (c->closed()) {
-            if (!username.empty()) {
-                disconnectedUsernames.push_back(username);
-                c->removingPlayer(username);
+
+        if (c->closed()) {
+            scheduleDrop(c);
+        }
+    }
+
+    expireIdleClients();
+    serviceReadyClients();
+    reapClients();
+    flushPresence();
+    writeMetricsFile();
+}
+
+/**
+ * @brief Handles up to one turn's worth of frames from a client.
+ *
+ * The budget bounds how long any one sender can hold the network thread;
+ * the caller decides whether the client re-arms or waits for another turn.
+ *
+ * @param c The client to read from.
+ * @return True if the budget was used up (more input may be buffered).
+ */
+bool ServerSocket::drainClient(const std::shared_ptr<ClientSocket>& c)
+{
+    NetProtocol::Result result = NetProtocol::Result::WouldBlock;
+    size_t frames = 0;
+    size_t bytes = 0;
+
+    while (!c->closed()) {
+        // Each frame borrows a block from this thread's BufferPool and gives
+        // it back once handled, broadcast included, so steady traffic never
+        // reaches the heap. Text commands are parsed as views into it.
+        NetProtocol::PooledFrame frame;
+        if ((result = c->receiveSecure(frame)) != NetProtocol::Result::Success) {
+            break;
+        }
+        std::string_view message = frame.view();
+
+        // Any frame shows the peer is alive, even one refused below
+        if (frames == 0) {
+            touchClient(c);
+        }
+        m_metrics.RecordFrame();
+        m_metrics.RecordBytesIn(NetProtocol::HEADER_SIZE + message.size());
+        m_capture.RecordFrame(static_cast<uint64_t>(c->getSocket()), message);
+
+        if (!admitFrame(c, message.size())) {
+            // Discarded unread
+        }
+        else if (c->getUsername().empty()) {
+            bool admitted = c->m_peerChallenge.empty() ? admitClient(c, message) : completePeer(c, message);
+            if (!admitted) {
+                closeClient(c, NetProtocol::Result::Success);
             }
-            it = clients.erase(it);
         }
         else {
-            // No message received (would-block), continue to next client
-            ++it;
+            processClientMessage(c, message);
+        }
+
+        ++frames;
+        bytes += message.size();
+        if (frames >= MAX_FRAMES_PER_TURN || bytes >= MAX_BYTES_PER_TURN) {
+            return !c->closed();
         }
     }
 
-    // Broadcast disconnection messages
-    for (const auto& uname : disconnectedUsernames) {
-        printf("[INFO] Client disconnected: %s\n", uname.c_str());
-        broadcastMessage("[SERVER]: " + uname + " has disconnected.");
+    if (result == NetProtocol::Result::MessageTooLarge ||
+        result == NetProtocol::Result::InvalidLength) {
+        // Also what an unframed legacy client looks like
+        LOG_SECURITY("[SECURITY] Dropping client with invalid framing (%s)",
+               NetProtocol::ResultToString(result));
     }
+    return false;
 }
 
-
 /**
- * @brief Checks if the given username is already taken.
- * @param username The username to check.
- * @return true if the username is already in use, false otherwise.
+ * @brief Charges one decoded frame to the connection, user and server budgets.
+ *
+ * Runs before the frame is looked at, so a refused frame costs a few
+ * integer operations: no parsing, no broadcast and (after the first) no
+ * reply. Handshakes skip the user budget, which is not known yet, and a
+ * connection whose handshake is refused is closed.
+ *
+ * @param c The sending client.
+ * @param bytes Frame payload size.
+ * @return True if the frame may be processed.
  */
-bool ServerSocket::isUsernameTaken(const std::string& username) {
-    return std::any_of(clients.begin(), clients.end(),
-        [&](const std::shared_ptr<ClientSocket>& client) {
-            return client->getUsername() == username;
-        });
-}
+bool ServerSocket::admitFrame(const std::shared_ptr<ClientSocket>& c, size_t bytes)
+{
+    // Peer nodes relay traffic their own users were already charged for
+    if (c->m_isPeer) {
+        return true;
+    }
 
-/**
- * @brief Handles username change for a client.
- * @param client The client requesting the change.
- * @param newUsername The new username.
+    bool handshake = c->getUsername().empty();
+    uint32_t cost = static_cast<uint32_t>((std::max)(bytes, size_t(1)));
+
+    if (!c->m_byteBudget.TryTake(m_passStartMs, cost) ||
+        (!handshake && !c->m_messageBudget.TryTake(m_passStartMs))) {
+        rejectFrame(c, Protocol::ErrorCode::RateLimited);
+        return false;
+    }
+
+    if (!m_serverBudget.TryTake(m_passStartMs)) {
+        m_metrics.RecordShedFrame();
+        if (!m_shedding) {
+            m_shedding = true;
+            LOG_WARNING("[WARNING] Server overloaded: shedding requests");
+        }
+        rejectFrame(c, Protocol::ErrorCode::ServerOverloaded);
+        return false;
+    }
+    if (m_shedding) {
+        m_shedding = false;
+        LOG_INFO("[INFO] Server load back under its limit");
+    }
+
+    c->m_rejectedFrames = 0;
+    return true;
+}
+
+/**
+ * @brief Tells a client its frame was refused, once per run of refusals.
+ *
+ * SECURITY: A client that ignores RateLimited and keeps sending is
+ * disconnected; overload is not the client's fault and never is.
+ *
+ * @param c The sending client.
+ * @param reason RateLimited or ServerOverloaded.
+ */
+void ServerSocket::rejectFrame(const std::shared_ptr<ClientSocket>& c, Protocol::ErrorCode reason)
+{
+    bool handshake = c->getUsername().empty();
+    if (c->m_rejectedFrames++ == 0) {
+        std::string notice = std::string("[SERVER]: ") + Protocol::ErrorCodeToMessage(reason);
+        // As in admitClient(): nothing has been queued for a connection
+        // that has not finished its handshake
+        if (handshake) {
+            c->sendSecure(notice);
+        }
+        else {
+            queueSend(c, notice);
+        }
+    }
+
+    if (handshake) {
+        closeClient(c, NetProtocol::Result::Success);
+    }
+    else if (reason == Protocol::ErrorCode::RateLimited &&
+             m_rateLimits.maxRejectedFrames > 0 &&
+             c->m_rejectedFrames > m_rateLimits.maxRejectedFrames) {
+        LOG_SECURITY("[SECURITY] Disconnecting %s: kept sending past its rate limit", c->getUsername().c_str());
+        closeClient(c, NetProtocol::Result::Success);
+    }
+}
+
+/**
+ * @brief Applies new inbound limits.
+ *
+ * The server budget restarts full; connected clients keep the budgets
+ * they were admitted with.
+ */
+void ServerSocket::setRateLimits(const RateLimits& limits)
+{
+    m_rateLimits = limits;
+    m_serverBudget.Reset(m_rateLimits.serverMessages, GetTickCount64());
+}
+
+/**
+ * @brief Enables (or, with an empty path, disables) the metrics snapshot file.
+ *
+ * The first snapshot is written on the next pass.
+ */
+void ServerSocket::setMetricsFile(const std::string& path, DWORD intervalMs)
+{
+    m_metricsPath = path;
+    m_metricsIntervalMs = (std::max)(intervalMs, IDLE_TIMER_TICK_MS);
+    m_nextMetricsWriteMs = 0;
+}
+
+/**
+ * @brief Starts recording inbound frames for replay.
+ *
+ * Connections already open are numbered when they next send a frame.
+ */
+bool ServerSocket::startCapture(const std::string& path)
+{
+    if (!m_capture.Start(path)) {
+        LOG_WARNING("[WARNING] Failed to create capture file %s", path.c_str());
+        return false;
+    }
+    LOG_INFO("[INFO] Capturing inbound traffic to %s", path.c_str());
+    return true;
+}
+
+/**
+ * @brief Stops recording and closes the capture file.
+ */
+uint64_t ServerSocket::stopCapture()
+{
+    uint64_t records = m_capture.Stop();
+    if (records > 0) {
+        LOG_INFO("[INFO] Traffic capture finished (%llu records)", static_cast<unsigned long long>(records));
+    }
+    return records;
+}
+
+/**
+ * @brief Collects the gauges and renders the metrics as JSON.
+ *
+ * Gauges need a walk over the client list, so they are only gathered
+ * here rather than kept up to date on every change.
+ */
+std::string ServerSocket::metricsSnapshot() const
+{
+    ServerMetrics::Gauges gauges;
+    gauges.connections = m_clients.Size();
+    gauges.readyClients = m_readyClients.size();
+    gauges.channels = m_channelSubscribers.size();
+    for (const auto& client : m_clients) {
+        if (client->getUsername().empty()) {
+            ++gauges.handshaking;
+        }
+        size_t pending = client->m_outbound.PendingBytes();
+        gauges.queuedBytes += pending;
+        gauges.maxQueuedBytes = (std::max)(gauges.maxQueuedBytes, pending);
+    }
+    return m_metrics.ToJson(gauges, m_passStartMs);
+}
+
+/**
+ * @brief Gives every queued client one more turn, in arrival order.
+ *
+ * Clients that still have input go to the back of the queue; the rest
+ * re-arm their zero-byte read and return to completion-driven service.
+ */
+void ServerSocket::serviceReadyClients()
+{
+    // One turn per queued client per call; anything re-queued here waits
+    // for the next pass so fresh completions are not starved
+    size_t turns = m_readyClients.size();
+    while (turns-- > 0 && !m_readyClients.empty()) {
+        std::shared_ptr<ClientSocket> c = m_readyClients.front();
+        m_readyClients.pop_front();
+
+        if (c->closed()) {
+            scheduleDrop(c);
+            continue;
+        }
+
+        if (drainClient(c)) {
+            m_readyClients.push_back(c);
+        }
+        else if (!c->closed() && !m_engine->Rearm(c->getSocket())) {
+            closeClient(c, NetProtocol::Result::NetworkError);
+        }
+
+        if (c->closed()) {
+            scheduleDrop(c);
+        }
+    }
+}
+
+/**
+ * @brief Pushes a heartbeat client's idle deadline RECV_TIMEOUT_MS into the future.
+ *
+ * Called at most once per turn, so a busy client costs one O(1) timer
+ * move per turn rather than one per frame.
+ *
+ * @param c The client that just sent something.
+ */
+void ServerSocket::touchClient(const std::shared_ptr<ClientSocket>& c)
+{
+    if (c->closed() || !c->sendsHeartbeats()) {
+        return;
+    }
+    m_idleTimers.Schedule(static_cast<uint64_t>(c->getSocket()),
+                          m_passStartMs + NetProtocol::RECV_TIMEOUT_MS);
+}
+
+/**
+ * @brief Drops every client whose handshake or idle deadline has passed.
+ *
+ * Only the timers that came due are visited; the rest of the client
+ * list is never scanned.
+ */
+void ServerSocket::expireIdleClients()
+{
+    std::vector<uint64_t> expired;
+    if (m_idleTimers.Advance(m_passStartMs, expired) == 0) {
+        return;
+    }
+
+    for (uint64_t key : expired) {
+        std::shared_ptr<ClientSocket> c = findClientBySocket(static_cast<SOCKET>(key));
+        if (!c) {
+            continue;
+        }
+        if (c->getUsername().empty()) {
+            LOG_SECURITY("[SECURITY] Dropping connection: no handshake within %d ms", NetProtocol::HANDSHAKE_TIMEOUT_MS);
+        }
+        else {
+            LOG_INFO("[INFO] Dropping %s: nothing received for %d ms", c->getUsername().c_str(), NetProtocol::RECV_TIMEOUT_MS);
+        }
+        closeClient(c, NetProtocol::Result::Timeout);
+        scheduleDrop(c);
+    }
+}
+
+/**
+ * @brief Rewrites the metrics snapshot file once its interval has passed.
+ *
+ * A few kilobytes every few seconds, so the write stays on the network
+ * thread; a failed write is logged once and retried next interval.
+ */
+void ServerSocket::writeMetricsFile()
+{
+    if (m_metricsPath.empty() || m_passStartMs < m_nextMetricsWriteMs) {
+        return;
+    }
+    bool firstAttempt = m_nextMetricsWriteMs == 0;
+    m_nextMetricsWriteMs = m_passStartMs + m_metricsIntervalMs;
+    if (!ServerMetrics::WriteSnapshot(metricsSnapshot(), m_metricsPath) && firstAttempt) {
+        LOG_WARNING("[WARNING] Could not write metrics snapshot to %s", m_metricsPath.c_str());
+    }
+}
+
+/**
+ * @brief Queues bytes for a client and starts a send if none is in flight.
+ *
+ * Clients beyond the disconnect watermark are scheduled for removal;
+ * clients beyond the drop watermark silently miss the frame.
+ *
+ * @param client Recipient.
+ * @param bytes Shared bytes to send (not copied).
+ */
+void ServerSocket::queueSend(const std::shared_ptr<ClientSocket>& client, const OutboundQueue::Buffer& bytes)
+{
+    if (client->closed()) {
+        return;
+    }
+
+    switch (client->m_outbound.Enqueue(bytes)) {
+    case OutboundQueue::EnqueueResult::Queued:
+        flushClient(client);
+        break;
+    case OutboundQueue::EnqueueResult::Dropped:
+        // Only log the first drop; a stuck client would flood the console
+        if (client->m_outbound.DroppedFrames() == 1) {
+            LOG_WARNING("[WARNING] Client %s is a slow consumer; dropping frames (%zu bytes queued)",
+                   client->getUsername().c_str(), client->m_outbound.PendingBytes());
+        }
+        break;
+    case OutboundQueue::EnqueueResult::OverLimit:
+        LOG_WARNING("[WARNING] Disconnecting slow consumer %s (%zu bytes queued, %zu dropped)",
+               client->getUsername().c_str(), client->m_outbound.PendingBytes(),
+               client->m_outbound.DroppedBytesSinceDrained());
+        closeClient(client, NetProtocol::Result::BufferError);
+        scheduleDrop(client);
+        break;
+    }
+}
+
+/**
+ * @brief Convenience overload for single-recipient text.
+ *
+ * History pages and lists go through here, so this is where v5 clients
+ * get their large responses deflated.
+ */
+void ServerSocket::queueSend(const std::shared_ptr<ClientSocket>& client, const std::string& message)
+{
+    if (!client->supportsCompression() || message.size() < NetProtocol::COMPRESSION_THRESHOLD) {
+        queueSend(client, NetProtocol::FrameBuffer::Encode(message));
+        return;
+    }
+    NetProtocol::FrameBuffer frame = m_deflater.Encode(message);
+    if (frame.compressed()) {
+        m_metrics.RecordCompressedFrame(NetProtocol::HEADER_SIZE + message.size(), frame.size());
+    }
+    queueSend(client, frame);
+}
+
+void ServerSocket::queueStream(const std::shared_ptr<ClientSocket>& client, const std::vector<std::string>& chunks)
+{
+    for (const std::string& chunk : chunks) {
+        queueSend(client, chunk);
+    }
+}
+
+size_t ServerSocket::streamBudget(const std::shared_ptr<ClientSocket>& client) const
+{
+    // Chunk framing for the longest stream: every chunk but the first and
+    // last is at least half full, or its successor would have fitted in it
+    constexpr size_t MAX_CHUNKS = STREAM_TOTAL_BYTES / (STREAM_CHUNK_BYTES / 2) + 2;
+    constexpr size_t FRAMING = MAX_CHUNKS * (NetProtocol::HEADER_SIZE + Protocol::Wire::STREAM_CHUNK_OVERHEAD);
+
+    // Chunks are queued back to back, so nothing else lands in between
+    size_t used = client->m_outbound.PendingBytes() + FRAMING;
+    size_t watermark = client->m_outbound.GetLimits().dropWatermark;
+    return used < watermark ? (std::min)(STREAM_TOTAL_BYTES, watermark - used) : 0;
+}
+
+const NetProtocol::FrameBuffer& ServerSocket::frameFor(const std::shared_ptr<ClientSocket>& client,
+                                                       const NetProtocol::FrameBuffer& frame,
+                                                       NetProtocol::FrameBuffer& compressed)
+{
+    if (!client->supportsCompression() || frame.payload().size() < NetProtocol::COMPRESSION_THRESHOLD) {
+        return frame;
+    }
+    if (!compressed) {
+        compressed = m_deflater.Compress(frame);
+        if (compressed.compressed()) {
+            m_metrics.RecordCompressedFrame(frame.size(), compressed.size());
+        }
+    }
+    return compressed;
+}
+
+/**
+ * @brief Posts one scatter/gather send covering as much of the queue as fits.
+ *
+ * @param client The client whose queue should be flushed.
+ */
+void ServerSocket::flushClient(const std::shared_ptr<ClientSocket>& client)
+{
+    std::vector<WSABUF> buffers;
+    std::vector<OutboundQueue::Buffer> keepAlive;
+    if (client->m_outbound.PrepareBatch(buffers, keepAlive) == 0) {
+        return;
+    }
+
+    if (!m_engine->PostSend(client->getSocket(), buffers, std::move(keepAlive))) {
+        client->m_outbound.AbortInFlight();
+        closeClient(client, NetProtocol::Result::NetworkError);
+        scheduleDrop(client);
+    }
+}
+
+/**
+ * @brief Marks a client closed; the first reason recorded is the one counted.
+ *
+ * @param client The client to close.
+ * @param reason What ended the connection (Success = server policy).
+ */
+void ServerSocket::closeClient(const std::shared_ptr<ClientSocket>& client, NetProtocol::Result reason)
+{
+    if (!client->m_closed) {
+        client->m_closed = true;
+        client->m_closeReason = reason;
+    }
+}
+
+/**
+ * @brief Marks a client for removal at the end of the current pass.
+ *
+ * Removal is deferred so broadcasts can safely iterate the client list.
+ */
+void ServerSocket::scheduleDrop(const std::shared_ptr<ClientSocket>& client)
+{
+    if (std::find(m_pendingDrops.begin(), m_pendingDrops.end(), client) == m_pendingDrops.end()) {
+        m_pendingDrops.push_back(client);
+    }
+}
+
+/**
+ * @brief Removes every scheduled client and holds back its departure.
+ *
+ * The departure is announced by flushPresence() once PRESENCE_GRACE_MS
+ * passes without the user reconnecting.
+ */
+void ServerSocket::reapClients()
+{
+    // Announcing a departure may push another slow consumer over its
+    // watermark, so keep going until nothing new is scheduled.
+    while (!m_pendingDrops.empty()) {
+        std::vector<std::shared_ptr<ClientSocket>> drops;
+        drops.swap(m_pendingDrops);
+
+        std::vector<std::string> disconnectedUsernames;
+        for (const auto& c : drops) {
+            if (!m_clients.Contains(c->m_slot)) {
+                continue;
+            }
+            std::string username = c->getUsername();
+            if (c->m_isPeer) {
+                // Its users are unreachable until the node reconnects
+                if (!c->m_peerNode.empty()) {
+                    LOG_WARNING("[SHARD] Peer node '%s' disconnected", c->m_peerNode.c_str());
+                    for (auto it = m_remoteUsers.begin(); it != m_remoteUsers.end();) {
+                        it = (it->second == c->m_peerNode) ? m_remoteUsers.erase(it) : std::next(it);
+                    }
+                }
+            }
+            else if (!username.empty()) {
+                disconnectedUsernames.push_back(username);
+                notifyRoster(c, username, false);
+                publishPresence(username, false);
+            }
+            dropClient(c);
+        }
+
+        for (const auto& uname : disconnectedUsernames) {
+            LOG_INFO("[INFO] Client disconnected: %s", uname.c_str());
+            m_presence.Depart(foldUsername(uname), uname, m_passStartMs);
+        }
+    }
+}
+
+/**
+ * @brief Processes one message from an admitted client.
+ *
+ * Binary envelopes (protocol v2) go straight to the dispatch table.
+ * Text commands from v1 clients are parsed here and routed to the same
+ * operations.
+ *
+ * @param c The sending client.
+ * @param message The received message (ATTACKER-CONTROLLED).
+ */
+void ServerSocket::processClientMessage(const std::shared_ptr<ClientSocket>& c, std::string_view message)
+{
+    // SECURITY CHECK: Validate frame length. Envelopes (a peer's BusPublish
+    // wraps a user's line in routing fields) are bounded by the frame limit;
+    // the chat limit applies to the user's text where it is posted
+    if (message.size() > NetProtocol::MAX_MESSAGE_SIZE) {
+        LOG_SECURITY("[SECURITY] Frame from %s rejected: too long", c->getUsername().c_str());
+        queueSend(c, "[SERVER]: Message too long.");
+        return;
+    }
+
+    // An empty frame is a v1 keepalive, not an empty chat line
+    if (message.empty()) {
+        return;
+    }
+
+    if (Protocol::Wire::IsEnvelope(message)) {
+        dispatchRequest(c, message);
+        return;
+    }
+
+    // Text commands (v1): fields are views into message, nothing is copied
+    Protocol::TextCommand command = Protocol::ParseTextCommand(message);
+    switch (command.type) {
+        case Protocol::TextCommandType::Whisper:
+            sendWhisper(c, command.target, command.content, 0);
+            break;
+        case Protocol::TextCommandType::BadWhisper:
+            queueSend(c, "[SERVER]: Invalid whisper format. Usage: W/username message");
+            break;
+        case Protocol::TextCommandType::ServerVersion:
+            sendServerVersion(c);
+            break;
+        case Protocol::TextCommandType::JoinChannel:
+        case Protocol::TextCommandType::LeaveChannel:
+            updateSubscription(c, command.channelId, command.type == Protocol::TextCommandType::JoinChannel);
+            break;
+        case Protocol::TextCommandType::BadChannel:
+            queueSend(c, "[SERVER]: Invalid channel id.");
+            break;
+        case Protocol::TextCommandType::ChangeUsername:
+            requestUsernameChange(c, std::string(command.target));
+            break;
+        case Protocol::TextCommandType::Chat:
+            postChatMessage(c, command.channelId, command.content);
+            break;
+    }
+}
+
+/**
+ * @brief Routes a binary request envelope through the dispatch table.
+ *
+ * The type byte indexes the table directly; unknown and unsupported
+ * types share one rejection path.
+ *
+ * @param c The sending client.
+ * @param frame The received frame (ATTACKER-CONTROLLED).
+ */
+void ServerSocket::dispatchRequest(const std::shared_ptr<ClientSocket>& c, std::string_view frame)
+{
+    static const std::array<RequestHandler, Protocol::REQUEST_TYPE_COUNT> handlers = [] {
+        using Protocol::RequestType;
+        std::array<RequestHandler, Protocol::REQUEST_TYPE_COUNT> table{};
+        auto slot = [&table](RequestType type) -> RequestHandler& {
+            return table[static_cast<size_t>(type)];
+        };
+        slot(RequestType::SendMessage)       = &ServerSocket::handleSendMessage;
+        slot(RequestType::SendDirectMessage) = &ServerSocket::handleSendDirectMessage;
+        slot(RequestType::JoinChannel)       = &ServerSocket::handleJoinChannel;
+        slot(RequestType::LeaveChannel)      = &ServerSocket::handleLeaveChannel;
+        slot(RequestType::UpdateProfile)     = &ServerSocket::handleUpdateProfile;
+        slot(RequestType::GetServerVersion)  = &ServerSocket::handleGetServerVersion;
+        slot(RequestType::Heartbeat)         = &ServerSocket::handleHeartbeat;
+        slot(RequestType::GetServerList)     = &ServerSocket::handleGetServerList;
+        slot(RequestType::GetChannelList)    = &ServerSocket::handleGetChannelList;
+        slot(RequestType::GetMessageHistory) = &ServerSocket::handleGetMessageHistory;
+        slot(RequestType::GetServerMembers)  = &ServerSocket::handleGetServerMembers;
+        slot(RequestType::GetFriendList)     = &ServerSocket::handleGetFriendList;
+        slot(RequestType::GetServerMetrics)  = &ServerSocket::handleGetServerMetrics;
+        slot(RequestType::SyncHistory)       = &ServerSocket::handleSyncHistory;
+        slot(RequestType::LocateServer)      = &ServerSocket::handleLocateServer;
+        slot(RequestType::BusPublish)        = &ServerSocket::handleBusPublish;
+        slot(RequestType::RequestAttachment) = &ServerSocket::handleRequestAttachment;
+        return table;
+    }();
+
+    Protocol::Wire::EnvelopeView envelope;
+    if (!Protocol::Wire::DecodeEnvelope(frame, envelope) || !envelope.isRequest()) {
+        LOG_SECURITY("[SECURITY] Malformed request envelope from %s", c->getUsername().c_str());
+        queueSend(c, "[SERVER]: Malformed request.");
+        return;
+    }
+
+    RequestHandler handler = (envelope.type < handlers.size()) ? handlers[envelope.type] : nullptr;
+    if (!handler) {
+        queueSend(c, "[SERVER]: Unsupported request.");
+        return;
+    }
+
+    (this->*handler)(c, envelope);
+}
+
+void ServerSocket::handleSendMessage(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::SendMessageView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request)) {
+        queueSend(c, "[SERVER]: Malformed request.");
+        return;
+    }
+    postChatMessage(c, request.channelId, request.content);
+}
+
+void ServerSocket::handleSendDirectMessage(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::SendDirectMessageView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request) || request.recipientName.empty()) {
+        queueSend(c, "[SERVER]: Malformed request.");
+        return;
+    }
+    sendWhisper(c, request.recipientName, request.content, envelope.requestId);
+}
+
+void ServerSocket::handleJoinChannel(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::ChannelSubscriptionView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request) || request.channelId == 0) {
+        queueSend(c, "[SERVER]: Invalid channel id.");
+        return;
+    }
+    updateSubscription(c, request.channelId, true);
+}
+
+void ServerSocket::handleLeaveChannel(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::ChannelSubscriptionView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request) || request.channelId == 0) {
+        queueSend(c, "[SERVER]: Invalid channel id.");
+        return;
+    }
+    updateSubscription(c, request.channelId, false);
+}
+
+void ServerSocket::handleUpdateProfile(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::UpdateProfileView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request)) {
+        queueSend(c, "[SERVER]: Malformed request.");
+        return;
+    }
+    requestUsernameChange(c, std::string(request.username));
+}
+
+void ServerSocket::handleGetServerVersion(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    if (!envelope.payload.empty()) {
+        queueSend(c, "[SERVER]: Malformed request.");
+        return;
+    }
+    sendServerVersion(c);
+}
+
+void ServerSocket::handleHeartbeat(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    // Receiving it already restarted the idle cutoff; there is no reply
+    if (!envelope.payload.empty()) {
+        queueSend(c, "[SERVER]: Malformed request.");
+    }
+}
+
+/**
+ * @brief Lists the servers this connection can see: the one being hosted.
+ */
+void ServerSocket::handleGetServerList(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    if (!envelope.payload.empty()) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::InternalError);
+        return;
+    }
+
+    std::vector<Protocol::Payloads::ServerInfo> servers;
+    ServerManager::ServerSummary server;
+    if (m_services.servers && m_services.servers->GetServerSummary(m_services.hostedServerId, server)) {
+        Protocol::Payloads::ServerInfo info;
+        info.serverId = server.serverId;
+        info.serverName = server.serverName;
+        info.ownerId = server.ownerId;
+        Models::User owner;
+        if (m_services.users && m_services.users->GetUserById(server.ownerId, owner)) {
+            info.ownerName = owner.username;
+        }
+        info.memberCount = static_cast<int>(server.memberCount);
+        info.channelCount = static_cast<int>(server.channelCount);
+        servers.push_back(std::move(info));
+    }
+
+    queueSend(c, Protocol::Wire::EncodeListResponse(Protocol::ResponseType::ServerList, envelope.requestId,
+                                                    servers, NetProtocol::MAX_MESSAGE_SIZE));
+}
+
+void ServerSocket::handleGetChannelList(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::GetChannelListView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::InternalError);
+        return;
+    }
+    if (!m_services.servers || !hostsServer(request.serverId)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::ServerNotFound);
+        return;
+    }
+
+    std::vector<Protocol::Payloads::ChannelInfo> channels;
+    for (const Models::Channel& channel : m_services.servers->GetServerChannels(request.serverId)) {
+        channels.push_back({ channel.channelId, channel.serverId, channel.channelName });
+    }
+
+    queueSend(c, Protocol::Wire::EncodeListResponse(Protocol::ResponseType::ChannelList, envelope.requestId,
+                                                    channels, NetProtocol::MAX_MESSAGE_SIZE));
+}
+
+/**
+ * @brief Returns one page of a hosted channel's history, oldest first.
+ *
+ * v6 clients get up to MAX_STREAMED_HISTORY messages as a stream whose
+ * first chunk holds the newest lines, so the channel fills in from the
+ * bottom while older messages are still arriving. Older clients get one
+ * MAX_HISTORY_PAGE frame.
+ *
+ * SECURITY: The limit is clamped and the channel must belong to the
+ * hosted server, so a client cannot page through unrelated channels or
+ * make one request read the whole store.
+ */
+void ServerSocket::handleGetMessageHistory(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::GetMessageHistoryView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::InternalError);
+        return;
+    }
+
+    if (!m_services.messages || !isHostedChannel(request.channelId)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::ChannelNotFound);
+        return;
+    }
+
+    uint32_t maxLimit = c->supportsStreaming() ? MAX_STREAMED_HISTORY : MAX_HISTORY_PAGE;
+    uint32_t limit = (std::min)((std::max)(request.limit, uint32_t(1)), maxLimit);
+    std::vector<Models::Message> page =
+        m_services.messages->GetMessagesBefore(request.channelId, request.beforeMessageId, limit);
+    std::vector<Protocol::Payloads::MessageInfo> messages = toMessageInfos(page);
+
+    if (c->supportsStreaming()) {
+        queueStream(c, Protocol::Wire::EncodeListStream(Protocol::ResponseType::MessageHistory, envelope.requestId,
+                                                        messages, STREAM_FIRST_CHUNK_BYTES, STREAM_CHUNK_BYTES,
+                                                        streamBudget(c), true));
+        return;
+    }
+
+    // Keep the newest messages if the page does not fit in one frame
+    size_t encoded = 0;
+    std::string response = Protocol::Wire::EncodeListResponse(Protocol::ResponseType::MessageHistory, envelope.requestId,
+                                                              messages, NetProtocol::MAX_MESSAGE_SIZE, &encoded);
+    if (encoded < messages.size()) {
+        messages.erase(messages.begin(), messages.begin() + (messages.size() - encoded));
+        response = Protocol::Wire::EncodeListResponse(Protocol::ResponseType::MessageHistory, envelope.requestId,
+                                                      messages, NetProtocol::MAX_MESSAGE_SIZE);
+    }
+    queueSend(c, response);
+}
+
+/**
+ * @brief Lists the hosted server's members, with who is connected right now.
+ *
+ * Streamed to v6 clients, so a large server's list is not cut off at
+ * one frame; older clients get as much as fits in one.
+ */
+void ServerSocket::handleGetServerMembers(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::GetServerMembersView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::InternalError);
+        return;
+    }
+    if (!m_services.servers || !m_services.users || !hostsServer(request.serverId)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::ServerNotFound);
+        return;
+    }
+
+    std::vector<Protocol::Payloads::UserInfo> members;
+    for (uint64_t memberId : m_services.servers->GetServerMembers(request.serverId)) {
+        Models::User user;
+        if (!m_services.users->GetUserById(memberId, user)) {
+            continue;
+        }
+        Protocol::Payloads::UserInfo info;
+        info.userId = user.userId;
+        std::string folded = foldUsername(user.username);
+        info.isOnline = m_clientsByName.count(folded) != 0 || m_remoteUsers.count(folded) != 0;
+        info.username = std::move(user.username);
+        info.memberSince = static_cast<int64_t>(user.createdAt);
+        members.push_back(std::move(info));
+    }
+
+    if (c->supportsStreaming()) {
+        queueStream(c, Protocol::Wire::EncodeListStream(Protocol::ResponseType::MemberList, envelope.requestId,
+                                                        members, STREAM_FIRST_CHUNK_BYTES, STREAM_CHUNK_BYTES,
+                                                        streamBudget(c)));
+        return;
+    }
+    queueSend(c, Protocol::Wire::EncodeListResponse(Protocol::ResponseType::MemberList, envelope.requestId,
+                                                    members, NetProtocol::MAX_MESSAGE_SIZE));
+}
+
+/**
+ * @brief Returns the messages after a client's sync cursor, oldest first.
+ *
+ * Only what the client missed crosses the wire, so reopening a cached
+ * channel costs a few bytes instead of its whole scrollback. A batch
+ * stops at MAX_SYNC_BATCH messages or the stream byte budget, whichever
+ * comes first; the client asks again from the newest id it received
+ * until a batch comes back empty.
+ *
+ * SECURITY: Same channel scoping and limit clamping as GetMessageHistory.
+ */
+void ServerSocket::handleSyncHistory(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::SyncHistoryView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::InternalError);
+        return;
+    }
+    if (!m_services.messages || !isHostedChannel(request.channelId)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::ChannelNotFound);
+        return;
+    }
+
+    uint32_t limit = (std::min)((std::max)(request.limit, uint32_t(1)), MAX_SYNC_BATCH);
+    std::vector<Models::Message> page =
+        m_services.messages->GetMessagesAfter(request.channelId, request.afterMessageId, limit);
+    std::vector<Protocol::Payloads::MessageInfo> messages = toMessageInfos(page);
+
+    // Oldest first, so anything over the byte budget is the newest end and
+    // the client's next cursor leaves no gap
+    queueStream(c, Protocol::Wire::EncodeListStream(Protocol::ResponseType::MessageHistory, envelope.requestId,
+                                                    messages, STREAM_FIRST_CHUNK_BYTES, STREAM_CHUNK_BYTES,
+                                                    streamBudget(c)));
+}
+
+/**
+ * @brief Refuses: a friend list belongs to an account, and live connections are not logged in.
+ */
+void ServerSocket::handleGetFriendList(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    sendError(c, envelope.requestId, Protocol::ErrorCode::NotAuthenticated);
+}
+
+/**
+ * @brief Answers GetServerMetrics with the JSON snapshot.
+ *
+ * SECURITY: Connection counts and traffic volumes help an attacker time
+ * a flood, and HELLO names prove nothing, so only peers on the loopback
+ * interface (an operator on the host machine) are answered.
+ */
+void ServerSocket::handleGetServerMetrics(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    sockaddr_in peer = {};
+    socklen_t peerLength = sizeof(peer);
+    bool loopback = getpeername(c->getSocket(), reinterpret_cast<sockaddr*>(&peer), &peerLength) == 0 &&
+                    peer.sin_family == AF_INET &&
+                    (ntohl(peer.sin_addr.s_addr) >> 24) == 127;
+    if (!loopback) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::NotAuthenticated);
+        return;
+    }
+    if (!envelope.payload.empty()) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::InternalError);
+        return;
+    }
+
+    std::string response = Protocol::Wire::EncodeResponse(Protocol::ResponseType::ServerMetrics, envelope.requestId);
+    Protocol::Wire::Writer writer(response);
+    writer.PutString(metricsSnapshot());
+    queueSend(c, response);
+}
+
+/**
+ * @brief Tells a client which node serves a server.
+ *
+ * Sharded, the answer comes from the shard map. Unsharded, it is the
+ * address the server's host recorded in ServerManager.
+ */
+void ServerSocket::handleLocateServer(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    Protocol::Wire::LocateServerView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::InternalError);
+        return;
+    }
+    ServerManager::ServerSummary server;
+    if (!m_services.servers || request.serverId == 0 ||
+        !m_services.servers->GetServerSummary(request.serverId, server)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::ServerNotFound);
+        return;
+    }
+
+    Protocol::Payloads::ServerLocation location;
+    location.serverId = server.serverId;
+    if (m_bus) {
+        const ShardMap::Node& node = m_bus->Shards().NodeFor(server.serverId);
+        location.nodeId = node.id;
+        location.host = node.host;
+        location.port = static_cast<uint32_t>(node.port);
+    }
+    else {
+        location.host = server.hostIpAddress;
+        location.port = server.hostPort;
+    }
+
+    std::string response = Protocol::Wire::EncodeResponse(Protocol::ResponseType::ServerLocation, envelope.requestId);
+    Protocol::Wire::Writer writer(response);
+    Protocol::Wire::WritePayload(writer, location);
+    queueSend(c, response);
+}
+
+/**
+ * @brief Applies an event another node published on the ShardBus.
+ *
+ * SECURITY: Only admitted peer links may publish, and only in their own
+ * node's name; a user connection gets NotAuthorized. Unknown topics are
+ * ignored so a newer node can add some without breaking older ones.
+ */
+void ServerSocket::handleBusPublish(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    if (!c->m_isPeer) {
+        LOG_SECURITY("[SECURITY] BusPublish from non-peer %s", c->getUsername().c_str());
+        sendError(c, envelope.requestId, Protocol::ErrorCode::NotAuthorized);
+        return;
+    }
+    Protocol::Wire::BusPublishView event;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, event) || event.originNode != c->m_peerNode ||
+        event.key.empty() || event.key.size() > MAX_USERNAME_LENGTH) {
+        LOG_WARNING("[SHARD] Malformed bus event from '%s'", c->m_peerNode.c_str());
+        return;
+    }
+
+    std::string key = foldUsername(event.key);
+    switch (static_cast<Protocol::Payloads::BusTopic>(event.topic)) {
+        case Protocol::Payloads::BusTopic::UserOnline:
+            m_remoteUsers[key] = c->m_peerNode;
+            if (m_presence.Arrive(key)) {
+                announcePresence(std::string(event.key), true);
+            }
+            break;
+        case Protocol::Payloads::BusTopic::UserOffline: {
+            auto found = m_remoteUsers.find(key);
+            if (found != m_remoteUsers.end() && found->second == c->m_peerNode) {
+                m_remoteUsers.erase(found);
+                m_presence.Depart(key, std::string(event.key), m_passStartMs);
+            }
+            break;
+        }
+        case Protocol::Payloads::BusTopic::Whisper:
+            if (std::shared_ptr<ClientSocket> recipient = findClientByName(key)) {
+                queueSend(recipient, std::string(event.body));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Hands out a ticket for uploading or downloading an attachment.
+ *
+ * Only the ticket crosses the chat connection; the client moves the bytes
+ * over the transfer port. An upload of bytes already stored is answered
+ * complete at once, and an interrupted one resumes where it stopped.
+ *
+ * SECURITY: Digest, size and offset are ATTACKER-CONTROLLED and checked
+ * by the AttachmentServer. Peer links are not users and get NotAuthorized.
+ */
+void ServerSocket::handleRequestAttachment(const std::shared_ptr<ClientSocket>& c, const Protocol::Wire::EnvelopeView& envelope)
+{
+    if (c->m_isPeer) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::NotAuthorized);
+        return;
+    }
+    if (!m_attachments) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::AttachmentsUnavailable);
+        return;
+    }
+    Protocol::Wire::AttachmentRequestView request;
+    if (!Protocol::Wire::ReadPayload(envelope.payload, request)) {
+        sendError(c, envelope.requestId, Protocol::ErrorCode::InvalidAttachment);
+        return;
+    }
+
+    Protocol::Payloads::AttachmentTicket ticket;
+    Protocol::ErrorCode result;
+    std::string digest(request.digest);
+    switch (static_cast<Protocol::Payloads::AttachmentDirection>(request.direction)) {
+        case Protocol::Payloads::AttachmentDirection::Upload:
+            result = m_attachments->GrantUpload(digest, request.size, ticket);
+            break;
+        case Protocol::Payloads::AttachmentDirection::Download:
+            result = m_attachments->GrantDownload(digest, request.offset, ticket);
+            break;
+        default:
+            result = Protocol::ErrorCode::InvalidAttachment;
+            break;
+    }
+    if (result != Protocol::ErrorCode::None) {
+        sendError(c, envelope.requestId, result);
+        return;
+    }
+
+    std::string response = Protocol::Wire::EncodeResponse(Protocol::ResponseType::AttachmentTicket, envelope.requestId);
+    Protocol::Wire::Writer writer(response);
+    Protocol::Wire::WritePayload(writer, ticket);
+    queueSend(c, response);
+}
+
+bool ServerSocket::hostsServer(uint64_t serverId) const
+{
+    if (serverId == 0) {
+        return false;
+    }
+    return m_bus ? m_bus->Shards().IsLocal(serverId) : serverId == m_services.hostedServerId;
+}
+
+std::shared_ptr<ClientSocket> ServerSocket::findClientBySocket(SOCKET socket) const
+{
+    auto found = m_clientsBySocket.find(static_cast<uint64_t>(socket));
+    if (found == m_clientsBySocket.end()) {
+        return nullptr;
+    }
+    const std::shared_ptr<ClientSocket>* client = m_clients.Find(found->second);
+    return client ? *client : nullptr;
+}
+
+std::shared_ptr<ClientSocket> ServerSocket::findClientByName(std::string_view username) const
+{
+    FoldedName key(username);
+    auto found = m_clientsByName.find(key.view());
+    if (found == m_clientsByName.end()) {
+        return nullptr;
+    }
+    const std::shared_ptr<ClientSocket>* client = m_clients.Find(found->second);
+    return client ? *client : nullptr;
+}
+
+std::shared_ptr<ClientSocket> ServerSocket::findClientByUserId(uint64_t userId) const
+{
+    auto found = m_clientsByUserId.find(userId);
+    if (found == m_clientsByUserId.end()) {
+        return nullptr;
+    }
+    const std::shared_ptr<ClientSocket>* client = m_clients.Find(found->second);
+    return client ? *client : nullptr;
+}
+
+bool ServerSocket::isHostedChannel(uint64_t channelId)
+{
+    Models::Channel channel;
+    return m_services.servers && channelId != 0 &&
+           m_services.servers->GetChannel(channelId, channel) &&
+           hostsServer(channel.serverId);
+}
+
+void ServerSocket::sendError(const std::shared_ptr<ClientSocket>& c, uint32_t requestId, Protocol::ErrorCode code)
+{
+    if (c->supportsPipelining()) {
+        queueSend(c, Protocol::Wire::EncodeError(requestId, code));
+    }
+    else {
+        queueSend(c, std::string("[SERVER]: ") + Protocol::ErrorCodeToMessage(code));
+    }
+}
+
+/**
+ * @brief Delivers a chat line to a channel, or to everyone for channel 0.
+ *
+ * SECURITY: Server formats the broadcast message. The username comes
+ * from server-side storage, not from the message.
+ *
+ * @param c The sending client.
+ * @param channelId Target channel (0 = global).
+ * @param content Message text (ATTACKER-CONTROLLED).
+ */
+void ServerSocket::postChatMessage(const std::shared_ptr<ClientSocket>& c, uint64_t channelId, std::string_view content)
+{
+    // SECURITY CHECK: Validate message length
+    if (content.size() > MAX_CHAT_MESSAGE_LENGTH) {
+        LOG_SECURITY("[SECURITY] Message from %s rejected: too long", c->getUsername().c_str());
+        queueSend(c, "[SERVER]: Message too long.");
+        return;
+    }
+
+    const std::string& username = c->getUsername();
+
+    if (channelId == 0) {
+        // Untagged or global: everyone sees it
+        broadcastFrame(NetProtocol::FrameBuffer::EncodeParts({ username, ": ", content }));
+        m_metrics.RecordReceiveToBroadcast(nowMicros() - m_passStartUs);
+        return;
+    }
+
+    // Assemble straight into the shared wire buffer; the tag is formatted on the stack
+    char idText[20];
+    std::to_chars_result id = std::to_chars(idText, idText + sizeof(idText), channelId);
+    NetProtocol::FrameBuffer frame = NetProtocol::FrameBuffer::EncodeParts(
+        { Protocol::CHANNEL_TAG_PREFIX, std::string_view(idText, id.ptr - idText), "]", username, ": ", content });
+
+    // Posting to a channel implies membership, so clients that never
+    // send JoinChannel still see the replies to their own messages
+    subscribeChannel(c, channelId);
+    broadcastToChannel(channelId, frame);
+    m_metrics.RecordReceiveToBroadcast(nowMicros() - m_passStartUs);
+}
+
+/**
+ * @brief Sends a private message to one user who is online here or on another node.
+ *
+ * SECURITY: A whisper to a registered user who is offline is refused with
+ * UserOffline rather than held. HELLO names are claims, not logins, so
+ * held whispers would go to whoever next connected under the name.
+ *
+ * @param c The sending client.
+ * @param targetUsername Recipient (ATTACKER-CONTROLLED).
+ * @param content Message text (ATTACKER-CONTROLLED).
+ * @param requestId Envelope request id to answer a refusal on (0 = text reply).
+ */
+void ServerSocket::sendWhisper(const std::shared_ptr<ClientSocket>& c, std::string_view targetUsername,
+                               std::string_view content, uint32_t requestId)
+{
+    if (content.empty()) {
+        queueSend(c, "[SERVER]: Empty whisper message.");
+        return;
+    }
+    if (content.size() > MAX_CHAT_MESSAGE_LENGTH) {
+        LOG_SECURITY("[SECURITY] Whisper from %s rejected: too long", c->getUsername().c_str());
+        queueSend(c, "[SERVER]: Message too long.");
+        return;
+    }
+
+    FoldedName senderKey(c->getUsername());
+    FoldedName recipientKey(targetUsername);
+    std::shared_ptr<ClientSocket> targetClient = findClientByName(targetUsername);
+    if (targetClient) {
+        queueSend(targetClient, NetProtocol::FrameBuffer::EncodeParts({ "[Whisper from ", c->getUsername(), "]: ", content }));
+        queueSend(c, NetProtocol::FrameBuffer::EncodeParts({ "[Whisper to ", targetUsername, "]: ", content }));
+        if (m_directMessages) {
+            m_directMessages->Record(c->getUsername(), senderKey.view(), recipientKey.view(), content);
+        }
+        return;
+    }
+
+    // Connected to another node: hand the formatted line to that node
+    auto remote = m_bus ? m_remoteUsers.find(recipientKey.view()) : m_remoteUsers.end();
+    if (remote != m_remoteUsers.end()) {
+        Protocol::Payloads::BusPublishRequest event;
+        event.topic = static_cast<uint32_t>(Protocol::Payloads::BusTopic::Whisper);
+        event.originNode = m_bus->Shards().Self().id;
+        event.key.assign(targetUsername);
+        event.body = "[Whisper from " + c->getUsername() + "]: ";
+        event.body.append(content);
+        m_bus->Publish(remote->second, Protocol::Wire::EncodeRequest(Protocol::RequestType::BusPublish, 0, event));
+        queueSend(c, NetProtocol::FrameBuffer::EncodeParts({ "[Whisper to ", targetUsername, "]: ", content }));
+        if (m_directMessages) {
+            m_directMessages->Record(c->getUsername(), senderKey.view(), recipientKey.view(), content);
+        }
+        return;
+    }
+
+    bool registered = m_services.users &&
+                      m_services.users->GetUserIdByUsername(std::string(targetUsername)) != 0;
+    if (!registered) {
+        queueSend(c, NetProtocol::FrameBuffer::EncodeParts({ "[SERVER]: User '", targetUsername, "' not found." }));
+    }
+    else if (requestId != 0) {
+        sendError(c, requestId, Protocol::ErrorCode::UserOffline);
+    }
+    else {
+        queueSend(c, NetProtocol::FrameBuffer::EncodeParts({ "[SERVER]: ", targetUsername, " is offline; whispers are not held." }));
+    }
+}
+
+/**
+ * @brief Replies with the server build and the connection's protocol version.
+ */
+void ServerSocket::sendServerVersion(const std::shared_ptr<ClientSocket>& c)
+{
+    queueSend(c, "[SERVER]: Server Version: 1.0.0 (Security Phase 1), protocol v" +
+                 std::to_string(c->protocolVersion()));
+}
+
+/**
+ * @brief Validates and applies a username change, announcing it on success.
+ *
+ * @param c The requesting client.
+ * @param newUsername Requested name (ATTACKER-CONTROLLED).
+ */
+void ServerSocket::requestUsernameChange(const std::shared_ptr<ClientSocket>& c, const std::string& newUsername)
+{
+    // Validate new username
+    if (!isValidUsername(newUsername)) {
+        queueSend(c, "[SERVER]: Invalid username format.");
+        return;
+    }
+
+    std::string oldUsername = c->getUsername();
+    if (handleUsernameChange(c, newUsername)) {
+        broadcastMessage("[SERVER]: " + oldUsername + " is now known as " + newUsername);
+    }
+    else {
+        queueSend(c, "[SERVER]: The username '" + newUsername + "' is already taken.");
+    }
+}
+
+/**
+ * @brief Applies a JoinChannel or LeaveChannel request.
+ */
+void ServerSocket::updateSubscription(const std::shared_ptr<ClientSocket>& c, uint64_t channelId, bool joining)
+{
+    if (!joining) {
+        unsubscribeChannel(c, channelId);
+    }
+    else if (!subscribeChannel(c, channelId)) {
+        queueSend(c, "[SERVER]: Too many channels joined.");
+    }
+}
+
+
+/**
+ * @brief Checks if the given username is already taken.
+ * @param username The username to check.
+ * @return true if the username is already in use, false otherwise.
+ */
+bool ServerSocket::isUsernameTaken(const std::string& username) {
+    // Sharded, a name is unique across every node
+    std::string folded = foldUsername(username);
+    return m_clientsByName.count(folded) != 0 || m_remoteUsers.count(folded) != 0;
+}
+
+/**
+ * @brief Handles username change for a client.
+ * @param client The client requesting the change.
+ * @param newUsername The new username.
  * @return true if the username change was successful, false if the new username is already taken.
  */
  // Handles username change for a client.
 bool ServerSocket::handleUsernameChange(std::shared_ptr<ClientSocket> client, const std::string& newUsername) {
-    // Check if the new username is already taken
-    if (isUsernameTaken(newUsername)) {
+    // Check if the new username is already taken; changing only the
+    // case of one's own name is allowed
+    std::string oldFolded = foldUsername(client->getUsername());
+    std::string newFolded = foldUsername(newUsername);
+    if (newFolded != oldFolded && isUsernameTaken(newUsername)) {
         return false;
     }
 
     // Proceed with the username change
-    client->removingPlayer(client->getUsername());
+    notifyRoster(client, client->getUsername(), false);
+    publishPresence(client->getUsername(), false);
+    m_clientsByName.erase(oldFolded);
     client->setUsername(newUsername);
-    client->addingPlayer(newUsername);
+    m_clientsByName[newFolded] = client->m_slot;
+    if (m_services.users) {
+        m_clientsByUserId.erase(client->m_userId);
+        client->m_userId = m_services.users->GetUserIdByUsername(newUsername);
+        if (client->m_userId != 0) {
+            m_clientsByUserId[client->m_userId] = client->m_slot;
+        }
+    }
+    notifyRoster(client, newUsername, true);
+    publishPresence(newUsername, true);
+    // The caller announces the rename itself; this only cancels a pending
+    // departure under the new name, which would now be false
+    m_presence.Arrive(newFolded);
     return true;
 }
+
+/**
+ * @brief Wakes the network loop if it is blocked waiting for completions.
+ */
+void ServerSocket::wake() {
+    if (m_engine) {
+        m_engine->Wake();
+    }
+}
+
+/**
+ * @brief Reports a roster change.
+ * 
+ * Prefers onRosterChanged so a server running off the UI thread never
+ * touches FLTK widgets; falls back to the client's PlayerDisplay.
+ * 
+ * @param client The client whose roster entry changed.
+ * @param username The affected username.
+ * @param joined True for an addition, false for a removal.
+ */
+void ServerSocket::notifyRoster(const std::shared_ptr<ClientSocket>& client, const std::string& username, bool joined) {
+    if (onRosterChanged) {
+        onRosterChanged(username, joined);
+    }
+    else if (joined) {
+        client->addingPlayer(username);
+    }
+    else {
+        client->removingPlayer(username);
+    }
+}
@@ -13,27 +13,170 @@
  * TRUST BOUNDARY:
  * Everything received from clients is ATTACKER-CONTROLLED.
  * The server must validate all input before processing.
+ *
+ * EVENT MODEL:
+ * Connections are driven by an IoBackend: IOCP on Windows, io_uring or
+ * epoll on Linux. Each call to handleClientConnections() only touches
+ * sockets the kernel reported as ready. Where the backend reads on the
+ * server's behalf (io_uring), the bytes are fed to the client's decoder
+ * and handled exactly like a Readable socket.
+ *
+ * READ FAIRNESS:
+ * A ready client gets one turn of at most MAX_FRAMES_PER_TURN frames or
+ * MAX_BYTES_PER_TURN bytes. A client with more input waits in a
+ * round-robin ready queue instead of re-arming, so one bursty sender
+ * cannot starve the others and nobody waits for a new notification.
+ *
+ * METRICS:
+ * Counters and histograms (ServerMetrics) are updated inline on the
+ * network thread. Loopback clients can fetch a JSON snapshot with
+ * GetServerMetrics, and setMetricsFile() rewrites one to disk every
+ * few seconds.
+ *
+ * CHANNEL FAN-OUT:
+ * Clients subscribe to channels with JoinChannel/LeaveChannel. A chat line
+ * tagged [CH:id] is delivered only to that channel's subscribers; server
+ * notices and untagged lines still reach everyone.
+ *
+ * CONNECTION TABLE:
+ * Connections live in a SlotMap and are found by socket or by username
+ * through hash indexes holding its handles, so lookups, renames and
+ * disconnects cost O(1) however many clients are connected. Usernames
+ * are compared case-folded: "Alice" and "alice" are the same user.
+ *
+ * SHARDING:
+ * With setShardBus() the server serves only the ChatServers its node owns
+ * in the ShardMap and answers LocateServer for the rest. Other nodes
+ * connect as peers (HELLO name ShardMap::PeerName) and publish presence
+ * and whispers with BusPublish; peers are not users and never appear in
+ * rosters or broadcasts.
+ *
+ * ATTACHMENTS:
+ * With setAttachmentServer() the server answers RequestAttachment with a
+ * ticket for the transfer port; file bytes never pass through here.
+ *
+ * DIRECT MESSAGES:
+ * Whispers go to the one connection holding the recipient's name, found
+ * through the name index, or over the bus to the node that has them;
+ * they never touch channel broadcast or channel history. With
+ * setDirectMessageStore() each one is also appended to that store. A
+ * whisper to a registered user who is offline is refused (UserOffline),
+ * not held: a HELLO name is a claim, so nothing proves the next
+ * connection under that name is the recipient.
+ *
+ * TRAFFIC CAPTURE:
+ * startCapture() records every connection's decoded inbound frames with
+ * their timing (TrafficCapture); LoadGen --replay sends a capture to any
+ * build. Off by default; while off it costs one flag check per frame.
  */
 
-#include <winsock2.h>
+#include "NetPlatform.h"
+#include <deque>
+#include <functional>
+#include <unordered_map>
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
 #include "ClientSocket.h"
+#include "IoBackend.h"
 #include "PlayerDisplay.hpp"
-#include "Settings.h"
+#include "ServerConfig.h"
 #include "NetProtocol.h"
+#include "FrameBuffer.h"
+#include "FrameCompression.h"
+#include "ProtocolCodec.h"
+#include "TimingWheel.h"
+#include "PresenceTracker.h"
+#include "TokenBucket.h"
+#include "FlatHashMap.h"
+#include "SlotMap.h"
+#include "ServerMetrics.h"
+#include "TrafficCapture.h"
+
+class ServerManager;
+class MessageService;
+class UserDatabase;
+class ShardBus;
+class AttachmentServer;
+class DirectMessageStore;
 
 struct ServerSocket
 {
 public:
+    /** Frames handled for one client before moving on to the next */
+    static constexpr size_t MAX_FRAMES_PER_TURN = 32;
+    
+    /** Payload bytes handled for one client before moving on to the next */
+    static constexpr size_t MAX_BYTES_PER_TURN = 64 * 1024;
+    
+    /** Resolution of the handshake and idle cutoffs */
+    static constexpr DWORD IDLE_TIMER_TICK_MS = 250;
+    
+    /**
+     * How long a departure is held back before it is announced; a user
+     * who reconnects within it is never reported as gone
+     */
+    static constexpr DWORD PRESENCE_GRACE_MS = 5000;
+    
+    /** Default period between metrics snapshot file writes */
+    static constexpr DWORD METRICS_FILE_INTERVAL_MS = 5000;
+    
     /**
-     * @brief List of connected clients
+     * @brief Stores that answer pipelined data requests (protocol v4)
      * 
-     * SECURITY NOTE: Each client in this list has passed initial connection
-     * but is NOT authenticated. Treat all client data as hostile.
+     * All optional; a request whose store is missing gets an Error
+     * response. The stores lock internally, so the network thread may
+     * call them directly. Answers are scoped to the hosted server: the
+     * HELLO username is a claim, not a login, so nothing private to a
+     * user account (such as a friend list) is served.
      */
-    std::vector<std::shared_ptr<ClientSocket>> clients;
+    struct DataServices {
+        uint64_t hostedServerId = 0;
+        ServerManager* servers = nullptr;
+        MessageService* messages = nullptr;
+        UserDatabase* users = nullptr;          ///< Owner and member names only
+    };
+    
+    /** Messages returned by one GetMessageHistory request at most */
+    static constexpr uint32_t MAX_HISTORY_PAGE = 100;
+    
+    /** The same limit for v6 clients, whose history is streamed in chunks */
+    static constexpr uint32_t MAX_STREAMED_HISTORY = 1000;
+    
+    /** Messages returned by one SyncHistory request at most; the client asks again for more */
+    static constexpr uint32_t MAX_SYNC_BATCH = 500;
+    
+    /**
+     * First chunk of a stream: small enough to cross a slow link in one
+     * round trip, so the newest lines are on screen almost at once
+     */
+    static constexpr size_t STREAM_FIRST_CHUNK_BYTES = 4096;
+    
+    /** Later chunks; well under MAX_MESSAGE_SIZE so live traffic interleaves */
+    static constexpr size_t STREAM_CHUNK_BYTES = 32768;
+    
+    /**
+     * Item bytes per stream at most. A stream is also held to the room left
+     * under the connection's drop watermark when it is sent (streamBudget()),
+     * so it ends early, with its last chunk, instead of losing chunks
+     */
+    static constexpr size_t STREAM_TOTAL_BYTES = 192 * 1024;
+    
+    /**
+     * @brief Inbound limits, checked on every frame before it is parsed
+     * 
+     * A frame over any limit is discarded unread. The first refusal in a
+     * run is answered once (RateLimited or ServerOverloaded); the rest are
+     * silent, and a client that keeps going past maxRejectedFrames is cut
+     * off. A rate of zero disables that limit.
+     */
+    struct RateLimits {
+        TokenBucket::Limits connectionBytes{ 64 * 1024, 128 * 1024 };  ///< Payload bytes per connection
+        TokenBucket::Limits userMessages{ 10, 30 };                   ///< Frames per user, kept across reconnects
+        TokenBucket::Limits serverMessages{ 20000, 20000 };           ///< Frames for the whole server; empty = shed load
+        uint32_t maxRejectedFrames = 256;                             ///< Consecutive rate-limited frames before disconnect
+    };
     
     /**
      * @brief Constructor that initializes the server socket.
@@ -47,17 +190,21 @@ public:
     ~ServerSocket();
 
     /**
-     * @brief Accepts a new client connection.
+     * @brief Wraps a connection accepted by the event backend.
      * 
      * SECURITY: New connections are configured with timeouts
      * to prevent slowloris-style resource exhaustion attacks.
      * 
-     * @return A shared pointer to the accepted ClientSocket, or nullptr if no connection.
+     * @param acceptedSocket Socket reported by the backend as Accepted (ownership taken).
+     * @return A shared pointer to the accepted ClientSocket, or nullptr on failure.
      */
-    std::shared_ptr<ClientSocket> accept();
+    std::shared_ptr<ClientSocket> accept(SOCKET acceptedSocket);
 
     /** Closes all client connections. */
     void closeAllClients();
+    
+    /** @brief Connections open right now, handshaking or admitted */
+    size_t clientCount() const { return m_clients.Size(); }
 
     /**
      * @brief Broadcasts a message to all connected clients using secure protocol.
@@ -71,6 +218,19 @@ public:
      */
     void broadcastMessageSecure(const std::string& message);
 
+    /**
+     * @brief Broadcasts an already-encoded buffer without copying it per client.
+     * @param frame Shared bytes produced by NetProtocol::FrameBuffer.
+     */
+    void broadcastFrame(const NetProtocol::FrameBuffer& frame);
+
+    /**
+     * @brief Delivers an already-encoded buffer to one channel's subscribers.
+     * @param channelId Target channel.
+     * @param frame Shared bytes produced by NetProtocol::FrameBuffer.
+     */
+    void broadcastToChannel(uint64_t channelId, const NetProtocol::FrameBuffer& frame);
+
     /**
      * @brief Check if a username is already in use.
      * 
@@ -94,16 +254,406 @@ public:
     /** 
      * @brief Handles all client connections and incoming messages.
      * 
+     * Dequeues events from the backend and processes only the
+     * connections that are ready.
+     * 
      * SECURITY: This is the main message processing loop.
      * All input validation should happen here before acting on messages.
+     * 
+     * @param waitMs How long to wait for network activity (0 = poll and return).
+     */
+    void handleClientConnections(DWORD waitMs = 0);
+
+    /**
+     * @brief Wake a handleClientConnections() call blocked on another thread.
+     */
+    void wake();
+
+    /**
+     * @brief Configure slow-consumer watermarks for subsequently accepted clients.
+     */
+    void setOutboundLimits(const OutboundQueue::Limits& limits) { m_outboundLimits = limits; }
+    
+    /**
+     * @brief Configure inbound rate limits (connection limits apply to subsequently accepted clients).
+     */
+    void setRateLimits(const RateLimits& limits);
+    
+    /**
+     * @brief Attach the stores behind GetServerList/GetChannelList/GetMessageHistory/GetFriendList.
+     * 
+     * Call before the network thread starts serving.
+     */
+    void setDataServices(const DataServices& services) { m_services = services; }
+    
+    /**
+     * @brief Join a sharded deployment: serve this node's servers and publish through bus.
+     * 
+     * Call before the network thread starts serving; bus must outlive the server.
+     */
+    void setShardBus(ShardBus* bus) { m_bus = bus; }
+    
+    /**
+     * @brief Hand out attachment tickets for this transfer port (null = attachments off).
+     * 
+     * Call before the network thread starts serving; attachments must outlive the server.
+     */
+    void setAttachmentServer(AttachmentServer* attachments) { m_attachments = attachments; }
+    
+    /**
+     * @brief Keep delivered whispers in store (null = not kept).
+     * 
+     * Call before the network thread starts serving; store must outlive the server.
+     */
+    void setDirectMessageStore(DirectMessageStore* store) { m_directMessages = store; }
+    
+    /**
+     * @brief Rewrite a JSON metrics snapshot to path every intervalMs (empty path = off).
+     * 
+     * The file is replaced atomically, so a reader never sees a partial
+     * snapshot. Call before the network thread starts serving.
+     */
+    void setMetricsFile(const std::string& path, DWORD intervalMs = METRICS_FILE_INTERVAL_MS);
+    
+    /**
+     * @brief Record inbound traffic to a capture file until stopCapture()
+     * 
+     * May be called from any thread, while another runs handleClientConnections().
+     * 
+     * @return False if the file could not be created.
+     */
+    bool startCapture(const std::string& path);
+    
+    /**
+     * @brief Finish the capture file.
+     * @return Records written (0 if no capture was running).
      */
-    void handleClientConnections();
+    uint64_t stopCapture();
+    
+    /**
+     * @brief Current counters, gauges and histograms as one JSON object (network thread only).
+     */
+    std::string metricsSnapshot() const;
+
+    /**
+     * @brief Optional roster hook.
+     * 
+     * When set, player list changes are reported here instead of being
+     * applied to PlayerDisplay directly. Used when the server runs on a
+     * network thread and must not touch FLTK widgets.
+     */
+    std::function<void(const std::string& username, bool joined)> onRosterChanged;
 
     PlayerDisplay* playerDisplay;
-    Settings m_settings;
+    
+    /** Parsed once at start-up; shared read-only with every accepted client */
+    std::shared_ptr<const ServerConfig> m_config;
 
 private:
     SOCKET m_socket;
+    std::unique_ptr<NetProtocol::IoBackend> m_engine;
+    
+    /**
+     * @brief Connected clients, addressed by the handle each ClientSocket keeps
+     * 
+     * SECURITY NOTE: Each client here has passed initial connection but is
+     * NOT authenticated. Treat all client data as hostile.
+     */
+    SlotMap<std::shared_ptr<ClientSocket>> m_clients;
+    
+    /** Lookup from socket handle to client, for dispatching engine events */
+    FlatHashMap<uint64_t, SlotHandle> m_clientsBySocket;
+    
+    /** Admitted users (not peers) by case-folded username */
+    FlatHashMap<std::string, SlotHandle> m_clientsByName;
+    
+    /** Admitted registered users by m_userId, for presence fan-out */
+    FlatHashMap<uint64_t, SlotHandle> m_clientsByUserId;
+    
+    /** Clients whose last turn ended with input still pending, in service order */
+    std::deque<std::shared_ptr<ClientSocket>> m_readyClients;
+    
+    /** Clients to remove once the current pass is done */
+    std::vector<std::shared_ptr<ClientSocket>> m_pendingDrops;
+    
+    /** Slow-consumer limits applied to each new client's outbound queue */
+    OutboundQueue::Limits m_outboundLimits;
+    
+    /** Inbound limits, the server-wide budget, and whether it ran dry */
+    RateLimits m_rateLimits;
+    TokenBucket m_serverBudget;
+    bool m_shedding;
+    
+    /** Stores behind the data requests */
+    DataServices m_services;
+    
+    /** Peer link to the other nodes; null when running unsharded */
+    ShardBus* m_bus = nullptr;
+    
+    /** Transfer port behind RequestAttachment; null when attachments are off */
+    AttachmentServer* m_attachments = nullptr;
+    
+    /** Whisper log; null when whispers are not kept */
+    DirectMessageStore* m_directMessages = nullptr;
+    
+    /** Users connected to other nodes, by case-folded username -> node id (from UserOnline/UserOffline) */
+    FlatHashMap<std::string, std::string> m_remoteUsers;
+    
+    /** Message budgets of departed users still refilling, by case-folded username */
+    FlatHashMap<std::string, TokenBucket> m_userBudgets;
+    
+    /** Clock reading taken once per handleClientConnections() pass */
+    ULONGLONG m_passStartMs;
+    
+    /** Fan-out index: channel id -> clients subscribed to it */
+    std::unordered_map<uint64_t, std::vector<std::shared_ptr<ClientSocket>>> m_channelSubscribers;
+    
+    /** Reverse index so a departing client is unsubscribed without a scan */
+    std::unordered_map<SOCKET, std::vector<uint64_t>> m_channelsBySocket;
+    
+    /**
+     * @brief Per-connection deadlines, keyed by socket
+     * 
+     * HANDSHAKE_TIMEOUT_MS until the HELLO arrives, then RECV_TIMEOUT_MS
+     * from the last frame for clients that send heartbeats. Pushed back on
+     * every turn with input, so a timer almost never actually fires.
+     */
+    TimingWheel<uint64_t> m_idleTimers;
+    
+    /** Departures waiting out PRESENCE_GRACE_MS before they are announced */
+    PresenceTracker m_presence;
+    
+    /** Live counters; m_passStartUs times chat lines read in this pass */
+    ServerMetrics m_metrics;
+    uint64_t m_passStartUs;
+    
+    /** Compresses frames for v5 clients; one stream reused for every frame */
+    NetProtocol::Deflater m_deflater;
+    
+    /** Inbound frames recorded for replay; idle unless startCapture() was called */
+    TrafficCapture m_capture;
+    
+    /** Periodic snapshot file, written from the network pass */
+    std::string m_metricsPath;
+    DWORD m_metricsIntervalMs;
+    ULONGLONG m_nextMetricsWriteMs;
+    
+    /**
+     * @brief Client on a socket, or nullptr once it has been dropped.
+     */
+    std::shared_ptr<ClientSocket> findClientBySocket(SOCKET socket) const;
+    
+    /**
+     * @brief Admitted user by name (any case), or nullptr.
+     */
+    std::shared_ptr<ClientSocket> findClientByName(std::string_view username) const;
+    
+    /**
+     * @brief Admitted user by user-database ID, or nullptr.
+     */
+    std::shared_ptr<ClientSocket> findClientByUserId(uint64_t userId) const;
+    
+    /**
+     * @brief Register a freshly accepted client with the engine and client lists.
+     */
+    void registerClient(const std::shared_ptr<ClientSocket>& client);
+    
+    /**
+     * @brief Handle a connection's first frame: the HELLO handshake with its username.
+     * @return False if the handshake was rejected and the client must be dropped.
+     */
+    bool admitClient(const std::shared_ptr<ClientSocket>& client, std::string_view hello);
+    
+    /**
+     * @brief Challenge a ShardBus connection from another node (HELLO name ShardMap::PeerName).
+     * @return False if the claim does not match a configured node and its address.
+     */
+    bool admitPeer(const std::shared_ptr<ClientSocket>& client, const std::string& name, uint32_t version);
+    
+    /**
+     * @brief Admit a challenged peer once its PROOF shows it holds the shard secret.
+     * @return False if the proof is missing or wrong and the peer must be dropped.
+     */
+    bool completePeer(const std::shared_ptr<ClientSocket>& client, std::string_view proof);
+    
+    /**
+     * @brief Tell the other nodes a local user came or went (no-op when unsharded).
+     */
+    void publishPresence(const std::string& username, bool online);
+    
+    /**
+     * @brief Tell fellow members of the hosted server, and logged-in friends, that a user came or went.
+     */
+    void announcePresence(const std::string& username, bool online);
+    
+    /**
+     * @brief Announce the departures whose grace period ran out.
+     */
+    void flushPresence();
+    
+    /**
+     * @brief Give a client one budgeted turn at its pending input.
+     * @return True if the budget ran out and the client may have more input.
+     */
+    bool drainClient(const std::shared_ptr<ClientSocket>& client);
+    
+    /**
+     * @brief Charge a decoded frame against every inbound limit.
+     * @return False if the frame must be discarded without being parsed.
+     */
+    bool admitFrame(const std::shared_ptr<ClientSocket>& client, size_t bytes);
+    
+    /**
+     * @brief Account for a refused frame: notify once, disconnect persistent offenders.
+     */
+    void rejectFrame(const std::shared_ptr<ClientSocket>& client, Protocol::ErrorCode reason);
+    
+    /**
+     * @brief Run one round-robin turn for every client in the ready queue.
+     */
+    void serviceReadyClients();
+    
+    /**
+     * @brief Restart a heartbeat client's idle cutoff after it sent something.
+     */
+    void touchClient(const std::shared_ptr<ClientSocket>& client);
+    
+    /**
+     * @brief Drop clients that missed the handshake or the idle cutoff.
+     */
+    void expireIdleClients();
+    
+    /**
+     * @brief Write the metrics snapshot file if its interval has passed.
+     */
+    void writeMetricsFile();
+    
+    /**
+     * @brief Mark a client closed, keeping the first reason for the metrics.
+     * @param reason What ended it; Success = closed by server policy.
+     */
+    void closeClient(const std::shared_ptr<ClientSocket>& client, NetProtocol::Result reason);
+    
+    /**
+     * @brief Dispatch one message from an admitted client (commands or chat).
+     */
+    void processClientMessage(const std::shared_ptr<ClientSocket>& client, std::string_view message);
+    
+    /** Handler for one RequestType; dispatchRequest() indexes a table of these */
+    using RequestHandler = void (ServerSocket::*)(const std::shared_ptr<ClientSocket>&, const Protocol::Wire::EnvelopeView&);
+    
+    /**
+     * @brief Decode a binary request envelope and jump to its handler.
+     */
+    void dispatchRequest(const std::shared_ptr<ClientSocket>& client, std::string_view frame);
+    
+    void handleSendMessage(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleSendDirectMessage(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleJoinChannel(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleLeaveChannel(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleUpdateProfile(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleGetServerVersion(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleHeartbeat(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleGetServerList(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleGetChannelList(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleGetMessageHistory(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleGetServerMembers(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleSyncHistory(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleGetFriendList(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleGetServerMetrics(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleLocateServer(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleBusPublish(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    void handleRequestAttachment(const std::shared_ptr<ClientSocket>& client, const Protocol::Wire::EnvelopeView& envelope);
+    
+    /**
+     * @brief True if this process serves a server: its node's share when sharded, else the hosted one
+     */
+    bool hostsServer(uint64_t serverId) const;
+    
+    /**
+     * @brief True if a channel exists and belongs to a server this process serves
+     */
+    bool isHostedChannel(uint64_t channelId);
+    
+    /**
+     * @brief Answer a request with ResponseType::Error (or a text notice for clients before v4).
+     */
+    void sendError(const std::shared_ptr<ClientSocket>& client, uint32_t requestId, Protocol::ErrorCode code);
+    
+    // Operations shared by the envelope handlers and the v1 text commands
+    void postChatMessage(const std::shared_ptr<ClientSocket>& client, uint64_t channelId, std::string_view content);
+    void sendWhisper(const std::shared_ptr<ClientSocket>& client, std::string_view targetUsername, std::string_view content,
+                     uint32_t requestId);
+    void sendServerVersion(const std::shared_ptr<ClientSocket>& client);
+
+    void requestUsernameChange(const std::shared_ptr<ClientSocket>& client, const std::string& newUsername);
+    void updateSubscription(const std::shared_ptr<ClientSocket>& client, uint64_t channelId, bool joining);
+    
+    /**
+     * @brief Report a roster change via onRosterChanged or the client's PlayerDisplay.
+     */
+    void notifyRoster(const std::shared_ptr<ClientSocket>& client, const std::string& username, bool joined);
+    
+    /**
+     * @brief Queue bytes for a client and start an overlapped send if idle.
+     */
+    void queueSend(const std::shared_ptr<ClientSocket>& client, const OutboundQueue::Buffer& bytes);
+    void queueSend(const std::shared_ptr<ClientSocket>& client, const std::string& message);
+    
+    /**
+     * @brief Queue every chunk of a streamed response, in order
+     */
+    void queueStream(const std::shared_ptr<ClientSocket>& client, const std::vector<std::string>& chunks);
+    
+    /**
+     * @brief Item bytes a stream to this client may carry now without any chunk being dropped
+     */
+    size_t streamBudget(const std::shared_ptr<ClientSocket>& client) const;
+    
+    /**
+     * @brief The variant of a broadcast frame this client should receive
+     * @param compressed Cache for the deflated variant, filled on first use
+     */
+    const NetProtocol::FrameBuffer& frameFor(const std::shared_ptr<ClientSocket>& client,
+                                             const NetProtocol::FrameBuffer& frame,
+                                             NetProtocol::FrameBuffer& compressed);
+    
+    /**
+     * @brief Post the next scatter/gather batch from a client's queue.
+     */
+    void flushClient(const std::shared_ptr<ClientSocket>& client);
+    
+    /**
+     * @brief Defer removal of a client until the end of the current pass.
+     */
+    void scheduleDrop(const std::shared_ptr<ClientSocket>& client);
+    
+    /**
+     * @brief Remove scheduled clients and start their departures' grace periods.
+     */
+    void reapClients();
+    
+    /**
+     * @brief Remove a client from the engine and client lists.
+     */
+    void dropClient(const std::shared_ptr<ClientSocket>& client);
+    
+    /**
+     * @brief Add a client to a channel's subscriber set.
+     * @return False if the client is already at its subscription limit.
+     */
+    bool subscribeChannel(const std::shared_ptr<ClientSocket>& client, uint64_t channelId);
+    
+    /**
+     * @brief Remove a client from a channel's subscriber set.
+     */
+    void unsubscribeChannel(const std::shared_ptr<ClientSocket>& client, uint64_t channelId);
+    
+    /**
+     * @brief Remove a client from every channel it joined.
+     */
+    void unsubscribeAll(const std::shared_ptr<ClientSocket>& client);
+    
     
     /**
      * @brief Validate a username for security requirements.
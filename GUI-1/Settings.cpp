@@ -1,83 +1,151 @@
 #include "Settings.h"
+#include "FlatHashMap.h"
+#include "PersistenceWorker.h"
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <tuple>
 
-// Constructor: Load the XML file
-Settings::Settings(const std::string& path) : m_path(path)
+// One parsed settings file, shared by every Settings for that path
+struct Settings::Store {
+    std::string path;
+    std::mutex mutex;
+    pugi::xml_document doc;
+    FlatHashMap<std::string, pugi::xml_node> clientsByUsername;
+    PersistenceWorker::Handle persistence;
+
+    explicit Store(const std::string& path);
+    ~Store() { persistence.Close(); }
+
+    pugi::xml_node findOrCreateClient(const std::string& username);
+    pugi::xml_node findClient(const std::string& username);
+    bool writeFile();
+};
+
+Settings::Store::Store(const std::string& path)
+    : path(path)
+    , persistence("settings " + path, [this] { return writeFile(); })
 {
-    pugi::xml_parse_result result = m_doc.load_file(m_path.c_str());
+    pugi::xml_parse_result result = doc.load_file(path.c_str());
     if (!result)
     {
         std::cerr << "Failed to load XML file: " << result.description() << std::endl;
-        m_doc.append_child("Clients");
-        save(); // Save initial structure
+        doc.reset();
+        doc.append_child("Clients");
+        persistence.MarkDirty(); // Save initial structure
     }
-}
 
-// Destructor: Save XML on destruction
-Settings::~Settings()
-{
-    save();
+    for (pugi::xml_node client : doc.child("Clients").children("Client"))
+    {
+        // First entry wins, as with the old linear scan
+        clientsByUsername.emplace(client.child("Username").text().as_string(), client);
+    }
 }
 
-// Find or create a client node by username
-pugi::xml_node Settings::findOrCreateClient(const std::string& username)
+pugi::xml_node Settings::Store::findOrCreateClient(const std::string& username)
 {
-    pugi::xml_node clientsNode = m_doc.child("Clients");
-    for (pugi::xml_node client : clientsNode.children("Client"))
-    {
-        std::string test = std::string(client.child("Username").text().as_string());
-        if (test == username) {
-            return client;
-        }
+    pugi::xml_node client = findClient(username);
+    if (client) {
+        return client;
     }
+
     // Create a new client if not found
-    pugi::xml_node newClient = clientsNode.append_child("Client");
+    pugi::xml_node newClient = doc.child("Clients").append_child("Client");
     newClient.append_child("Username").text() = username.c_str();
 
     newClient.append_child("Dark").text() = "false"; // Default to light mode
     pugi::xml_node resolution = newClient.append_child("Resolution");
     resolution.append_child("Width").text() = 800; // Default width
     resolution.append_child("Height").text() = 600; // Default height
-    save();
+    clientsByUsername.emplace(username, newClient);
+    persistence.MarkDirty();
     return newClient;
 }
 
-pugi::xml_node Settings::findClient(const std::string& username)
+pugi::xml_node Settings::Store::findClient(const std::string& username)
 {
-    pugi::xml_node clientsNode = m_doc.child("Clients");
-    for (pugi::xml_node client : clientsNode.children("Client"))
+    auto it = clientsByUsername.find(username);
+    return it != clientsByUsername.end() ? it->second : pugi::xml_node();
+}
+
+// Runs on the persistence worker: copy under the lock, write after it
+bool Settings::Store::writeFile()
+{
+    pugi::xml_document snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        snapshot.reset(doc);
+    }
+    if (!PersistenceWorker::WriteXmlAtomically(snapshot, path))
     {
-        std::string test = std::string(client.child("Username").text().as_string());
-        if (test == username) {
-            return client;
-        }
+        std::cerr << "Failed to save XML file: " << path << std::endl;
+        return false;
     }
-    return pugi::xml_node(); // Return an empty node if not found
+    return true;
+}
+
+std::shared_ptr<Settings::Store> Settings::storeFor(const std::string& path)
+{
+    static std::mutex registryMutex;
+    static std::map<std::string, std::shared_ptr<Store>> stores;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::shared_ptr<Store>& store = stores[path];
+    if (!store) {
+        store = std::make_shared<Store>(path);
+    }
+    return store;
+}
+
+// Constructor: Attach to the settings loaded from this file
+Settings::Settings(const std::string& path) : m_store(storeFor(path))
+{
+}
+
+// Destructor: Changes are already queued with the persistence worker
+Settings::~Settings()
+{
+}
+
+// Find or create a client node by username
+pugi::xml_node Settings::findOrCreateClient(const std::string& username)
+{
+    std::lock_guard<std::mutex> lock(m_store->mutex);
+    return m_store->findOrCreateClient(username);
+}
+
+pugi::xml_node Settings::findClient(const std::string& username)
+{
+    std::lock_guard<std::mutex> lock(m_store->mutex);
+    return m_store->findClient(username); // Empty node if not found
 }
 
 // Get mode
 std::string Settings::getMode(pugi::xml_node user)
 {
+    std::lock_guard<std::mutex> lock(m_store->mutex);
     return user.child("Dark").text().as_string();
 }
 
 // Set mode
 void Settings::setMode(const std::string& username, const std::string& mode)
 {
-    findOrCreateClient(username).child("Dark").text() = mode.c_str();
-    save();
+    std::lock_guard<std::mutex> lock(m_store->mutex);
+    m_store->findOrCreateClient(username).child("Dark").text() = mode.c_str();
+    m_store->persistence.MarkDirty();
 }
 
 void Settings::setUsername(const std::string& newUsername) {
-    pugi::xml_node user = findOrCreateClient(newUsername);
+    std::lock_guard<std::mutex> lock(m_store->mutex);
+    pugi::xml_node user = m_store->findOrCreateClient(newUsername);
     user.child("Username").text() = newUsername.c_str();
-    save();  // Make sure this saves the updated settings to the XML file
+    m_store->persistence.MarkDirty();
 }
 
 
 std::tuple<int, int> Settings::getRes(pugi::xml_node user)
 {
+    std::lock_guard<std::mutex> lock(m_store->mutex);
     pugi::xml_node res = user.child("Resolution");
     return std::make_tuple(res.child("Width").text().as_int(), res.child("Height").text().as_int());
 }
@@ -85,31 +153,47 @@ std::tuple<int, int> Settings::getRes(pugi::xml_node user)
 // Set height
 void Settings::setRes(const std::string& username, int height, int width)
 {
-    pugi::xml_node user = findOrCreateClient(username); // Retrieve or create the client node
-    user.child("Resolution").child("Width").text() = width;  // Set width
-    user.child("Resolution").child("Height").text() = height;  // Set height
-    save();  // Save the updated settings
+    std::lock_guard<std::mutex> lock(m_store->mutex);
+    pugi::xml_node user = m_store->findOrCreateClient(username); // Retrieve or create the client node
+    pugi::xml_node res = user.child("Resolution");
+    if (res.child("Width").text().as_int() == width && res.child("Height").text().as_int() == height) {
+        return;     // Unchanged; nothing to write
+    }
+    res.child("Width").text() = width;  // Set width
+    res.child("Height").text() = height;  // Set height
+    m_store->persistence.MarkDirty();  // Written by the persistence worker
 }
 
-// Save changes to the XML file
+// Get connect timeout
+int Settings::getConnectTimeout(pugi::xml_node user)
+{
+    std::lock_guard<std::mutex> lock(m_store->mutex);
+    return user.child("ConnectTimeoutMs").text().as_int();
+}
+
+int Settings::getHistoryIdleSeconds(pugi::xml_node user)
+{
+    std::lock_guard<std::mutex> lock(m_store->mutex);
+    return user.child("HistoryIdleEvictSeconds").text().as_int();
+}
+
+// Schedule a background save of the XML file
 void Settings::save()
 {
-    if (!m_doc.save_file(m_path.c_str()))
-    {
-        std::cerr << "Failed to save XML file: " << m_path << std::endl;
-    }
+    m_store->persistence.MarkDirty();
 }
 
 // Get the username from the settings
 std::string Settings::getUsername() {
+    std::lock_guard<std::mutex> lock(m_store->mutex);
     // Retrieve the first client's username as an example (you can modify this for your needs)
-    pugi::xml_node client = m_doc.child("Clients").child("Client");
+    pugi::xml_node client = m_store->doc.child("Clients").child("Client");
     return client.child("Username").text().as_string();
 }
 
 // Load settings (can be a placeholder for now)
 void Settings::loadSettings() {
-    // Load settings from the XML if needed (in this case it's done in the constructor)
+    // Load settings from the XML if needed (in this case it's done when the store is created)
 }
 
 // Save settings (already handled in the save method)
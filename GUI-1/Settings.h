@@ -1,6 +1,24 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+/**
+ * @file Settings.h
+ * @brief Per-user UI settings (theme, resolution) kept in an XML file
+ *
+ * DESIGN:
+ * - Each file is parsed once per process into a shared store; every
+ *   Settings object for the same path is a cheap handle onto it
+ * - Clients are indexed by username, so lookups do not scan the file
+ * - Changes only mark the store dirty; PersistenceWorker writes the file
+ *   in the background once per commit window, so resizing or toggling
+ *   dark mode never waits for the disk
+ *
+ * THREADING:
+ * All methods lock the shared store. Returned nodes stay valid for the
+ * life of the process (clients are never removed).
+ */
+
+#include <memory>
 #include <string>
 #include <tuple>
 #include "pugixml.hpp"
@@ -8,10 +26,10 @@
 
 class Settings {
 public:
-    // Constructor: Load the XML file
+    // Constructor: Attach to the settings loaded from this file
     Settings(const std::string& path);
 
-    // Destructor: Save XML on destruction
+    // Destructor: Nothing to save; the persistence worker writes changes
     ~Settings();
 
     // Find or create a client node by username
@@ -35,7 +53,13 @@ public:
     // Set resolution (width, height) for a specific user
     void setRes(const std::string& username, int height, int width);
 
-    // Save changes to the XML file
+    // Get the connect timeout in milliseconds for a specific user (0 if unset)
+    int getConnectTimeout(pugi::xml_node user);
+
+    // Get how long an unused channel's history stays in memory, in seconds (0 if unset)
+    int getHistoryIdleSeconds(pugi::xml_node user);
+
+    // Schedule a background save of the XML file
     void save();
 
     // Additional methods for `SettingsWindow` class
@@ -44,8 +68,11 @@ public:
     void saveSettings();          // Save settings to the file
 
 private:
-    pugi::xml_document m_doc;
-    std::string m_path;
+    struct Store;
+    std::shared_ptr<Store> m_store;
+
+    // Shared store for a path, loaded on first use and kept until exit
+    static std::shared_ptr<Store> storeFor(const std::string& path);
 };
 
 #endif // SETTINGS_H
@@ -0,0 +1,260 @@
+/**
+ * @file ShardBus.cpp
+ * @brief Implementation of the node-to-node publish channel
+ */
+
+#include "ShardBus.h"
+#include "NetProtocol.h"
+#include "ProtocolCodec.h"
+#include "Trace.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace {
+
+/** Longest the sender thread sleeps; bounds reconnect and heartbeat lateness */
+constexpr DWORD BUS_POLL_MS = 250;
+
+} // namespace
+
+ShardBus::ShardBus(std::shared_ptr<const ShardMap> shards)
+    : m_shards(std::move(shards))
+    , m_stopping(false)
+{
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        throw std::runtime_error("WSAStartup failed");
+    }
+    for (const ShardMap::Node& node : m_shards->Nodes()) {
+        if (node.id != m_shards->Self().id) {
+            Peer peer;
+            peer.node = node;
+            m_peers.push_back(std::move(peer));
+        }
+    }
+    m_thread = std::thread(&ShardBus::Run, this);
+    LOG_INFO("[SHARD] Bus started for %zu peer(s)", m_peers.size());
+}
+
+ShardBus::~ShardBus() {
+    Stop();
+}
+
+void ShardBus::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            return;
+        }
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    for (Peer& peer : m_peers) {
+        if (peer.socket != INVALID_SOCKET) {
+            closesocket(peer.socket);
+            peer.socket = INVALID_SOCKET;
+        }
+    }
+    WSACleanup();
+}
+
+void ShardBus::Publish(const std::string& nodeId, const std::string& frame) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Peer& peer : m_peers) {
+            if (peer.node.id == nodeId) {
+                enqueue(peer, frame);
+                break;
+            }
+        }
+    }
+    m_wake.notify_one();
+}
+
+void ShardBus::PublishAll(const std::string& frame) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Peer& peer : m_peers) {
+            enqueue(peer, frame);
+        }
+    }
+    m_wake.notify_one();
+}
+
+void ShardBus::enqueue(Peer& peer, const std::string& frame) {
+    if (peer.queue.size() >= MAX_QUEUED_FRAMES) {
+        peer.queue.pop_front();
+        if (peer.dropped++ == 0) {
+            LOG_WARNING("[SHARD] Peer '%s' is not keeping up; dropping its oldest events", peer.node.id.c_str());
+        }
+    }
+    peer.queue.push_back(frame);
+}
+
+void ShardBus::Run() {
+    Trace::SetThreadName("shard-bus");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        for (Peer& peer : m_peers) {
+            uint64_t now = GetTickCount64();
+            if (peer.socket == INVALID_SOCKET) {
+                if (now < peer.nextAttemptMs) {
+                    continue;
+                }
+                lock.unlock();
+                bool connected = connectPeer(peer, now);
+                lock.lock();
+                if (!connected) {
+                    continue;
+                }
+            }
+
+            // Send outside the lock so publishers never wait on a slow peer
+            std::deque<std::string> batch;
+            batch.swap(peer.queue);
+            lock.unlock();
+            bool sent = true;
+            while (!batch.empty()) {
+                if (NetProtocol::SendMessage(peer.socket, batch.front()) != NetProtocol::Result::Success) {
+                    sent = false;
+                    break;
+                }
+                batch.pop_front();
+                peer.lastSendMs = GetTickCount64();
+            }
+            if (sent) {
+                sent = sendHeartbeat(peer, GetTickCount64());
+            }
+            if (sent) {
+                discardInput(peer, GetTickCount64());
+            }
+            else {
+                disconnectPeer(peer, GetTickCount64());
+            }
+            lock.lock();
+
+            // Whatever did not go out is resent first once the peer is back
+            while (!batch.empty() && peer.queue.size() < MAX_QUEUED_FRAMES) {
+                peer.queue.push_front(std::move(batch.back()));
+                batch.pop_back();
+            }
+        }
+
+        m_wake.wait_for(lock, std::chrono::milliseconds(BUS_POLL_MS), [this] {
+            if (m_stopping) {
+                return true;
+            }
+            for (const Peer& peer : m_peers) {
+                if (peer.socket != INVALID_SOCKET && !peer.queue.empty()) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+}
+
+bool ShardBus::connectPeer(Peer& peer, uint64_t now) {
+    peer.nextAttemptMs = now + RECONNECT_DELAY_MS;
+
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET) {
+        return false;
+    }
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<u_short>(peer.node.port));
+    address.sin_addr.s_addr = peer.node.address;
+
+    // Bounded connect: a dead host must not hold up the other peers
+    u_long nonBlocking = 1;
+    ioctlsocket(s, FIONBIO, &nonBlocking);
+    bool connected = connect(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    if (!connected && WSAGetLastError() == WSAEWOULDBLOCK) {
+        fd_set writable;
+        fd_set failed;
+        FD_ZERO(&writable);
+        FD_ZERO(&failed);
+        FD_SET(s, &writable);
+        FD_SET(s, &failed);
+        timeval timeout = { static_cast<long>(CONNECT_TIMEOUT_MS / 1000),
+                            static_cast<long>((CONNECT_TIMEOUT_MS % 1000) * 1000) };
+        connected = select(0, nullptr, &writable, &failed, &timeout) == 1 && FD_ISSET(s, &writable);
+    }
+    u_long blocking = 0;
+    if (!connected || ioctlsocket(s, FIONBIO, &blocking) == SOCKET_ERROR) {
+        closesocket(s);
+        return false;
+    }
+
+    // Blocking from here on, but never for longer than the timeouts
+    NetProtocol::ConfigureSocket(s);
+    DWORD timeoutMs = CONNECT_TIMEOUT_MS;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeoutMs), sizeof(timeoutMs));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeoutMs), sizeof(timeoutMs));
+
+    // HELLO, then answer the peer's nonce with proof of the shared secret
+    std::string challengeFrame;
+    std::string welcome;
+    std::vector<uint8_t> challenge;
+    std::vector<uint8_t> proof;
+    uint32_t version = 0;
+    if (NetProtocol::SendMessage(s, NetProtocol::BuildHello(NetProtocol::PROTOCOL_VERSION,
+                                                            ShardMap::PeerName(m_shards->Self().id))) != NetProtocol::Result::Success ||
+        NetProtocol::ReceiveMessage(s, challengeFrame) != NetProtocol::Result::Success ||
+        !ShardMap::ParseChallenge(challengeFrame, challenge) ||
+        (proof = m_shards->PeerProof(m_shards->Self().id, peer.node.id, challenge)).empty() ||
+        NetProtocol::SendMessage(s, ShardMap::BuildProof(proof)) != NetProtocol::Result::Success ||
+        NetProtocol::ReceiveMessage(s, welcome) != NetProtocol::Result::Success ||
+        !NetProtocol::ParseWelcome(welcome, version) ||
+        version < NetProtocol::SHARDING_PROTOCOL_VERSION) {
+        LOG_WARNING("[SHARD] Peer '%s' at %s:%d refused the bus connection",
+                    peer.node.id.c_str(), peer.node.host.c_str(), peer.node.port);
+        closesocket(s);
+        return false;
+    }
+
+    peer.socket = s;
+    peer.lastSendMs = GetTickCount64();
+    LOG_INFO("[SHARD] Connected to peer '%s' at %s:%d", peer.node.id.c_str(), peer.node.host.c_str(), peer.node.port);
+    return true;
+}
+
+void ShardBus::disconnectPeer(Peer& peer, uint64_t now) {
+    LOG_WARNING("[SHARD] Lost peer '%s'; retrying in %u ms", peer.node.id.c_str(), RECONNECT_DELAY_MS);
+    closesocket(peer.socket);
+    peer.socket = INVALID_SOCKET;
+    peer.nextAttemptMs = now + RECONNECT_DELAY_MS;
+}
+
+bool ShardBus::sendHeartbeat(Peer& peer, uint64_t now) {
+    // The peer drops a v3+ connection that stays silent past its idle cutoff
+    if (now - peer.lastSendMs < static_cast<uint64_t>(NetProtocol::HEARTBEAT_INTERVAL_MS)) {
+        return true;
+    }
+    if (NetProtocol::SendMessage(peer.socket, Protocol::Wire::EncodeRequest(Protocol::RequestType::Heartbeat, 0)) !=
+        NetProtocol::Result::Success) {
+        return false;
+    }
+    peer.lastSendMs = now;
+    return true;
+}
+
+void ShardBus::discardInput(Peer& peer, uint64_t now) {
+    // Peers never answer bus traffic; read whatever arrives so their
+    // outbound queue for us cannot fill, and notice a closed connection
+    u_long available = 0;
+    char scratch[4096];
+    while (ioctlsocket(peer.socket, FIONREAD, &available) == 0 && available > 0) {
+        int received = recv(peer.socket, scratch, static_cast<int>((std::min)(available, u_long(sizeof(scratch)))), 0);
+        if (received <= 0) {
+            disconnectPeer(peer, now);
+            return;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef SHARD_BUS_H
+#define SHARD_BUS_H
+
+/**
+ * @file ShardBus.h
+ * @brief Node-to-node publish channel of a sharded deployment
+ *
+ * PURPOSE:
+ * With servers spread over several nodes (ShardMap.h), a whisper or a
+ * presence change may concern a user connected somewhere else. The bus
+ * carries those events: the network thread publishes a BusPublish frame
+ * for one peer or for all of them, and this class delivers it over an
+ * ordinary framed connection to that peer's ServerSocket.
+ *
+ * DESIGN:
+ * - One sender thread keeps one outbound connection per peer, opened with
+ *   the usual HELLO (username ShardMap::PeerName(self)) plus an answer to
+ *   the peer's challenge (see ShardMap.h) and kept alive with Heartbeat
+ *   requests
+ * - Frames for a peer wait in its own queue, in publish order; a peer
+ *   that is down gets a reconnect attempt every RECONNECT_DELAY_MS
+ * - A queue over MAX_QUEUED_FRAMES drops its oldest frames: the events
+ *   are advisory and a reconnect resends presence anyway
+ * - Nothing is read back except the CHALLENGE and WELCOME; anything else
+ *   the peer sends is discarded
+ *
+ * THREADING:
+ * Publish() and PublishAll() may be called from any thread and never
+ * block on the network.
+ */
+
+#include "NetPlatform.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ShardMap.h"
+
+class ShardBus {
+public:
+    /** Frames held per unreachable peer before the oldest are dropped */
+    static constexpr size_t MAX_QUEUED_FRAMES = 4096;
+
+    /** Delay between connection attempts to a peer that is down */
+    static constexpr uint32_t RECONNECT_DELAY_MS = 2000;
+
+    /** Longest a connection attempt or a WELCOME may take */
+    static constexpr uint32_t CONNECT_TIMEOUT_MS = 2000;
+
+    /**
+     * @brief Start the sender thread; it connects to every peer at once
+     * @param shards Map this node belongs to
+     */
+    explicit ShardBus(std::shared_ptr<const ShardMap> shards);
+
+    /** Same as Stop() */
+    ~ShardBus();
+
+    /**
+     * @brief Queue a frame for one peer (ignored for this node or an unknown id)
+     */
+    void Publish(const std::string& nodeId, const std::string& frame);
+
+    /**
+     * @brief Queue a frame for every peer
+     */
+    void PublishAll(const std::string& frame);
+
+    /**
+     * @brief Close every peer connection and join the thread (idempotent)
+     */
+    void Stop();
+
+    const ShardMap& Shards() const { return *m_shards; }
+
+private:
+    struct Peer {
+        ShardMap::Node node;
+        SOCKET socket = INVALID_SOCKET;
+        std::deque<std::string> queue;      ///< Guarded by m_mutex
+        uint64_t nextAttemptMs = 0;        ///< Sender thread only, as are the rest
+        uint64_t lastSendMs = 0;
+        uint64_t dropped = 0;
+    };
+
+    std::shared_ptr<const ShardMap> m_shards;
+    std::vector<Peer> m_peers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping;
+    std::thread m_thread;
+
+    void Run();
+    void enqueue(Peer& peer, const std::string& frame);
+    bool connectPeer(Peer& peer, uint64_t now);
+    void disconnectPeer(Peer& peer, uint64_t now);
+    bool sendHeartbeat(Peer& peer, uint64_t now);
+    void discardInput(Peer& peer, uint64_t now);
+
+    ShardBus(const ShardBus&) = delete;
+    ShardBus& operator=(const ShardBus&) = delete;
+};
+
+#endif // SHARD_BUS_H
@@ -0,0 +1,161 @@
+/**
+ * @file ShardMap.cpp
+ * @brief Loading and lookups of the shard map
+ */
+
+#include "ShardMap.h"
+#include "Log.h"
+#include "ServerIdentity.h"
+#include "pugixml.hpp"
+#include <cstring>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+namespace {
+
+/** FNV-1a of a node id; stable across runs and machines */
+uint64_t HashNodeId(const std::string& id) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : id) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+const char CHALLENGE_PREFIX[] = "CHALLENGE ";
+const char PROOF_PREFIX[] = "PROOF ";
+
+/** Parse "<prefix><hex>" carrying exactly `size` bytes */
+bool ParseHexFrame(std::string_view payload, const char* prefix, size_t size, std::vector<uint8_t>& out) {
+    size_t prefixLength = std::strlen(prefix);
+    if (payload.size() != prefixLength + 2 * size || payload.compare(0, prefixLength, prefix) != 0) {
+        return false;
+    }
+    out = Security::HexToBytes(std::string(payload.substr(prefixLength)));
+    return out.size() == size;
+}
+
+/** splitmix64 finalizer: spreads sequential server ids over the whole range */
+uint64_t Mix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+} // namespace
+
+std::shared_ptr<const ShardMap> ShardMap::Load(const std::string& path) {
+    pugi::xml_document document;
+    if (!document.load_file(path.c_str())) {
+        return nullptr;     // No shard map: one node serves everything
+    }
+    pugi::xml_node root = document.child("Shards");
+    std::string self = root.attribute("self").as_string();
+
+    std::shared_ptr<ShardMap> map(new ShardMap());
+    map->secret = Security::HexToBytes(root.attribute("secret").as_string());
+    if (map->secret.size() < MIN_SECRET_SIZE) {
+        LOG_ERROR("[SHARD] %s: secret must be at least %zu bytes of hex; running unsharded",
+                  path.c_str(), MIN_SECRET_SIZE);
+        return nullptr;
+    }
+    for (pugi::xml_node element : root.children("Node")) {
+        Node node;
+        node.id = element.attribute("id").as_string();
+        node.host = element.attribute("host").as_string();
+        node.port = element.attribute("port").as_int();
+        in_addr address = {};
+        if (node.id.empty() || node.port <= 0 || node.port > 65535 ||
+            inet_pton(AF_INET, node.host.c_str(), &address) != 1 || map->FindNode(node.id)) {
+            LOG_ERROR("[SHARD] %s: bad or duplicate node '%s'; running unsharded", path.c_str(), node.id.c_str());
+            return nullptr;
+        }
+        node.address = address.s_addr;
+        map->nodes.push_back(std::move(node));
+    }
+
+    const Node* selfNode = map->FindNode(self);
+    if (!selfNode) {
+        LOG_ERROR("[SHARD] %s: self node '%s' is not listed; running unsharded", path.c_str(), self.c_str());
+        return nullptr;
+    }
+    map->selfIndex = static_cast<size_t>(selfNode - map->nodes.data());
+
+    for (pugi::xml_node element : root.children("Range")) {
+        Range range;
+        range.first = element.attribute("first").as_ullong();
+        range.last = element.attribute("last").as_ullong();
+        const Node* node = map->FindNode(element.attribute("node").as_string());
+        if (!node || range.first > range.last) {
+            LOG_ERROR("[SHARD] %s: bad range %llu-%llu; running unsharded", path.c_str(), range.first, range.last);
+            return nullptr;
+        }
+        range.node = static_cast<size_t>(node - map->nodes.data());
+        map->ranges.push_back(range);
+    }
+
+    LOG_INFO("[SHARD] Node '%s' of %zu, %zu pinned range(s)", self.c_str(), map->nodes.size(), map->ranges.size());
+    return map;
+}
+
+const ShardMap::Node& ShardMap::NodeFor(uint64_t serverId) const {
+    for (const Range& range : ranges) {
+        if (serverId >= range.first && serverId <= range.last) {
+            return nodes[range.node];
+        }
+    }
+
+    size_t best = 0;
+    uint64_t bestWeight = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        uint64_t weight = Mix(HashNodeId(nodes[i].id) ^ Mix(serverId));
+        if (i == 0 || weight > bestWeight) {
+            best = i;
+            bestWeight = weight;
+        }
+    }
+    return nodes[best];
+}
+
+std::vector<uint8_t> ShardMap::PeerProof(const std::string& from, const std::string& to,
+                                         const std::vector<uint8_t>& challenge) const {
+    static const char label[] = "shard-peer";
+    std::vector<uint8_t> input(label, label + sizeof(label) - 1);
+    input.insert(input.end(), challenge.begin(), challenge.end());
+    input.insert(input.end(), from.begin(), from.end());
+    input.push_back(0);     // Node ids cannot be shifted between the two fields
+    input.insert(input.end(), to.begin(), to.end());
+
+    std::array<uint8_t, 32> mac;
+    if (Security::ComputeHMACSHA256(secret.data(), secret.size(), input, mac) != Security::CryptoResult::Success) {
+        return {};
+    }
+    return std::vector<uint8_t>(mac.begin(), mac.end());
+}
+
+std::string ShardMap::BuildChallenge(const std::vector<uint8_t>& challenge) {
+    return CHALLENGE_PREFIX + Security::BytesToHex(challenge.data(), challenge.size());
+}
+
+bool ShardMap::ParseChallenge(std::string_view payload, std::vector<uint8_t>& challenge) {
+    return ParseHexFrame(payload, CHALLENGE_PREFIX, CHALLENGE_SIZE, challenge);
+}
+
+std::string ShardMap::BuildProof(const std::vector<uint8_t>& proof) {
+    return PROOF_PREFIX + Security::BytesToHex(proof.data(), proof.size());
+}
+
+bool ShardMap::ParseProof(std::string_view payload, std::vector<uint8_t>& proof) {
+    return ParseHexFrame(payload, PROOF_PREFIX, 32, proof);
+}
+
+const ShardMap::Node* ShardMap::FindNode(const std::string& id) const {
+    for (const Node& node : nodes) {
+        if (node.id == id) {
+            return &node;
+        }
+    }
+    return nullptr;
+}
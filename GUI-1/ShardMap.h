@@ -0,0 +1,133 @@
+#ifndef SHARD_MAP_H
+#define SHARD_MAP_H
+
+/**
+ * @file ShardMap.h
+ * @brief Which host process (node) serves each ChatServer
+ *
+ * PURPOSE:
+ * One ServerSocket process used to be the only place a community could
+ * live, so a big one could grow only as far as one machine. A shard map
+ * spreads servers over several nodes: each node serves the servers that
+ * map to it, answers LocateServer for the rest, and talks to its peers
+ * over the ShardBus for anything that crosses nodes (whispers, presence).
+ *
+ * FILE FORMAT ("shards.xml", next to the other data files):
+ *   <Shards self="a" secret="64+ hex digits, the same on every node">
+ *     <Node id="a" host="10.0.0.1" port="12345"/>
+ *     <Node id="b" host="10.0.0.2" port="12345"/>
+ *     <Range first="1000" last="1999" node="b"/>   optional pins
+ *   </Shards>
+ *
+ * PLACEMENT:
+ * A serverId inside a Range goes to that range's node. Anything else is
+ * placed by rendezvous (highest random weight) hashing over the node ids,
+ * so adding a node moves only the servers that now hash to it.
+ *
+ * SHARED DIRECTORY:
+ * Server and channel metadata stay in ServerManager; every node points it
+ * at the same data file, so any node can resolve a channel to its server
+ * and the server to its node.
+ *
+ * SECURITY:
+ * Hosts must be numeric IPv4 addresses. A bus connection is accepted only
+ * from a configured node's address, and only that node's id may be
+ * claimed on it. An address is easy to share (another process on the
+ * host, a NAT), so the connecting node must also prove it knows the
+ * shared secret:
+ *   node -> peer   "HELLO <version> #node:<id>"
+ *   peer -> node   "CHALLENGE <hex nonce>"
+ *   node -> peer   "PROOF <hex PeerProof(id, peer id, nonce)>"
+ *   peer -> node   "WELCOME <version>"
+ * The secret never crosses the wire, and a fresh nonce per connection
+ * makes a recorded proof useless.
+ *
+ * THREADING:
+ * Never modified after Load(), so any thread may read it without locking.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ShardMap {
+public:
+    /** Default file name, next to the other data files */
+    static constexpr const char* DEFAULT_FILE = "shards.xml";
+
+    /** HELLO usernames of bus connections start with this; never valid for a user */
+    static constexpr const char* PEER_NAME_PREFIX = "#node:";
+
+    /** Shortest shared secret accepted, in bytes */
+    static constexpr size_t MIN_SECRET_SIZE = 32;
+
+    /** Bytes of the nonce a peer is challenged with */
+    static constexpr size_t CHALLENGE_SIZE = 32;
+
+    /** One host process */
+    struct Node {
+        std::string id;
+        std::string host;           ///< Numeric IPv4 address
+        int port = 0;
+        uint32_t address = 0;       ///< host in network byte order
+    };
+
+    /**
+     * @brief Parse a shard map
+     * @return nullptr if the file is missing or unusable (the process then runs unsharded)
+     */
+    static std::shared_ptr<const ShardMap> Load(const std::string& path);
+
+    /** @brief This process's node */
+    const Node& Self() const { return nodes[selfIndex]; }
+
+    const std::vector<Node>& Nodes() const { return nodes; }
+
+    /** @brief Node that serves a server (never null) */
+    const Node& NodeFor(uint64_t serverId) const;
+
+    /** @brief True if this node serves the server */
+    bool IsLocal(uint64_t serverId) const { return &NodeFor(serverId) == &Self(); }
+
+    /** @brief Configured node by id, or nullptr */
+    const Node* FindNode(const std::string& id) const;
+
+    /** @brief HELLO username a node uses on its bus connections */
+    static std::string PeerName(const std::string& nodeId) { return PEER_NAME_PREFIX + nodeId; }
+
+    /**
+     * @brief What node `from` answers a challenge from node `to` with
+     *
+     * HMAC-SHA256(secret, "shard-peer" || challenge || from || 0 || to)
+     *
+     * @return Empty if the MAC could not be computed
+     */
+    std::vector<uint8_t> PeerProof(const std::string& from, const std::string& to,
+                                   const std::vector<uint8_t>& challenge) const;
+
+    /** @brief "CHALLENGE <hex>" / "PROOF <hex>" frames of the bus handshake */
+    static std::string BuildChallenge(const std::vector<uint8_t>& challenge);
+    static bool ParseChallenge(std::string_view payload, std::vector<uint8_t>& challenge);
+    static std::string BuildProof(const std::vector<uint8_t>& proof);
+    static bool ParseProof(std::string_view payload, std::vector<uint8_t>& proof);
+
+private:
+    struct Range {
+        uint64_t first = 0;
+        uint64_t last = 0;
+        size_t node = 0;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Range> ranges;
+    size_t selfIndex = 0;
+    std::vector<uint8_t> secret;
+
+    ShardMap() = default;
+    ShardMap(const ShardMap&) = delete;
+    ShardMap& operator=(const ShardMap&) = delete;
+};
+
+#endif // SHARD_MAP_H
@@ -0,0 +1,144 @@
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+/**
+ * @file SlotMap.h
+ * @brief Dense container addressed by generational handles
+ *
+ * PURPOSE:
+ * The server kept its connections in a vector and removed one with
+ * erase(remove(...)), a scan and a shift of every later shared_ptr. A slot
+ * map gives each entry a handle that stays valid until the entry is
+ * erased, finds it in O(1), and erases in O(1) by moving the last entry
+ * into the hole.
+ *
+ * DESIGN:
+ * - Values live packed in one vector, so iteration touches no gaps
+ * - A slot array maps a handle's index to the value's current position;
+ *   freed slots are reused through an intrusive free list
+ * - Each slot carries a generation bumped on erase, so a handle to an
+ *   erased entry never resolves to whatever reuses the slot
+ *
+ * DIFFERENCES FROM std::vector:
+ * - Erase moves the last value into the hole: iteration order is
+ *   unspecified and erasing invalidates iterators and pointers to values
+ *   (handles stay valid)
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Address of a SlotMap entry; default-constructed handles are null
+ */
+struct SlotHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    explicit operator bool() const { return index != UINT32_MAX; }
+    bool operator==(const SlotHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+};
+
+template <typename T>
+class SlotMap {
+public:
+    using iterator = typename std::vector<T>::iterator;
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    /**
+     * @brief Add a value
+     * @return Its handle, valid until Erase()
+     */
+    SlotHandle Insert(T value) {
+        uint32_t slotIndex;
+        if (m_freeHead != NONE) {
+            slotIndex = m_freeHead;
+            m_freeHead = m_slots[slotIndex].position;
+        }
+        else {
+            slotIndex = static_cast<uint32_t>(m_slots.size());
+            m_slots.push_back(Slot());
+        }
+        Slot& slot = m_slots[slotIndex];
+        slot.position = static_cast<uint32_t>(m_values.size());
+        m_values.push_back(std::move(value));
+        m_owners.push_back(slotIndex);
+        return { slotIndex, slot.generation };
+    }
+
+    /**
+     * @brief Remove a value; stale and null handles are ignored
+     * @return True if something was removed
+     */
+    bool Erase(SlotHandle handle) {
+        if (!Contains(handle)) {
+            return false;
+        }
+        Slot& slot = m_slots[handle.index];
+        uint32_t hole = slot.position;
+        uint32_t last = static_cast<uint32_t>(m_values.size() - 1);
+        if (hole != last) {
+            m_values[hole] = std::move(m_values[last]);
+            m_owners[hole] = m_owners[last];
+            m_slots[m_owners[hole]].position = hole;
+        }
+        m_values.pop_back();
+        m_owners.pop_back();
+
+        ++slot.generation;
+        slot.position = m_freeHead;
+        m_freeHead = handle.index;
+        return true;
+    }
+
+    /** @brief Value for a handle, or nullptr if it was erased */
+    T* Find(SlotHandle handle) {
+        return Contains(handle) ? &m_values[m_slots[handle.index].position] : nullptr;
+    }
+
+    const T* Find(SlotHandle handle) const {
+        return Contains(handle) ? &m_values[m_slots[handle.index].position] : nullptr;
+    }
+
+    bool Contains(SlotHandle handle) const {
+        return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation;
+    }
+
+    size_t Size() const { return m_values.size(); }
+    bool Empty() const { return m_values.empty(); }
+
+    /** @brief Remove everything; outstanding handles all go stale */
+    void Clear() {
+        for (uint32_t owner : m_owners) {
+            Slot& slot = m_slots[owner];
+            ++slot.generation;
+            slot.position = m_freeHead;
+            m_freeHead = owner;
+        }
+        m_values.clear();
+        m_owners.clear();
+    }
+
+    iterator begin() { return m_values.begin(); }
+    iterator end() { return m_values.end(); }
+    const_iterator begin() const { return m_values.begin(); }
+    const_iterator end() const { return m_values.end(); }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Slot {
+        uint32_t generation = 1;    ///< Never 0, so a zeroed handle never matches
+        uint32_t position = NONE;   ///< Index into m_values, or the next free slot
+    };
+
+    std::vector<T> m_values;
+    std::vector<uint32_t> m_owners;     ///< Slot of each value, parallel to m_values
+    std::vector<Slot> m_slots;
+    uint32_t m_freeHead = NONE;
+};
+
+#endif // SLOT_MAP_H
@@ -0,0 +1,83 @@
+/**
+ * @file SocketWatcher.cpp
+ * @brief Implementation of the event-driven socket watcher
+ */
+
+#include "SocketWatcher.h"
+#include "UiDispatcher.h"
+#include "Log.h"
+#include <stdexcept>
+#include <string>
+
+SocketWatcher::State::~State() {
+    if (handledEvent) {
+        CloseHandle(handledEvent);
+    }
+}
+
+SocketWatcher::SocketWatcher(SOCKET socket, std::function<void()> onReady)
+    : socket(socket)
+    , state(std::make_shared<State>())
+    , readableEvent(WSACreateEvent())
+    , stopEvent(CreateEventA(nullptr, TRUE, FALSE, nullptr))
+{
+    state->onReady = std::move(onReady);
+    state->handledEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+
+    if (readableEvent == WSA_INVALID_EVENT || !stopEvent || !state->handledEvent ||
+        WSAEventSelect(socket, readableEvent, FD_READ | FD_WRITE | FD_CLOSE) == SOCKET_ERROR) {
+        int error = WSAGetLastError();
+        if (readableEvent != WSA_INVALID_EVENT) {
+            WSACloseEvent(readableEvent);
+        }
+        if (stopEvent) {
+            CloseHandle(stopEvent);
+        }
+        throw std::runtime_error("Failed to watch socket: " + std::to_string(error));
+    }
+
+    watchThread = std::thread(&SocketWatcher::Run, this);
+}
+
+SocketWatcher::~SocketWatcher() {
+    state->alive = false;
+    SetEvent(stopEvent);
+    if (watchThread.joinable()) {
+        watchThread.join();
+    }
+
+    // Drop the association; the socket stays non-blocking as before
+    WSAEventSelect(socket, nullptr, 0);
+    WSACloseEvent(readableEvent);
+    CloseHandle(stopEvent);
+}
+
+void SocketWatcher::Run() {
+    for (;;) {
+        HANDLE readable[] = { stopEvent, readableEvent };
+        if (WaitForMultipleObjects(2, readable, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+            return;     // Stopped (or the wait itself failed)
+        }
+
+        // Resets readableEvent; FD_READ is signalled again after the next recv(),
+        // FD_WRITE after the next send that would block
+        WSANETWORKEVENTS events;
+        if (WSAEnumNetworkEvents(socket, readableEvent, &events) == SOCKET_ERROR) {
+            LOG_WARNING("[CLIENT] Socket watcher failed: %d", WSAGetLastError());
+            return;
+        }
+
+        std::shared_ptr<State> shared = state;
+        UiDispatcher::Post([shared]() {
+            if (shared->alive) {
+                shared->onReady();
+            }
+            SetEvent(shared->handledEvent);
+        });
+
+        HANDLE handled[] = { stopEvent, state->handledEvent };
+        if (WaitForMultipleObjects(2, handled, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+            return;
+        }
+    }
+}
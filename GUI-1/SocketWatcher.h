@@ -0,0 +1,69 @@
+#ifndef SOCKET_WATCHER_H
+#define SOCKET_WATCHER_H
+
+/**
+ * @file SocketWatcher.h
+ * @brief Runs a UI-thread callback whenever a client socket becomes readable or writable
+ *
+ * PURPOSE:
+ * The lobby used to poll its connection from a 100 ms FLTK timer, which
+ * added up to one tick of latency to every message and woke the process
+ * ten times a second even while idle. A watcher sleeps until Winsock
+ * reports the socket readable or closed and hands that to the UI thread.
+ *
+ * DESIGN:
+ * - WSAEventSelect(FD_READ | FD_WRITE | FD_CLOSE) signals an event; a
+ *   small thread waits on it and posts the callback through UiDispatcher
+ * - FD_WRITE fires once at the start and then only after a send would
+ *   have blocked and room frees up, which is when queued sends can go
+ * - At most one callback is outstanding: the thread waits until it has
+ *   run before watching again, so a burst costs one wake-up. Winsock
+ *   re-signals FD_READ after each recv() that leaves data behind, so
+ *   nothing that arrives meanwhile is missed
+ * - The callback should read until the socket would block (or reschedule
+ *   itself when it stops early) and retry any sends still queued
+ *
+ * THREADING:
+ * Construct and destroy on the UI thread, before closing the socket. A
+ * callback still queued when the watcher is destroyed is dropped.
+ */
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <winsock2.h>
+
+class SocketWatcher {
+public:
+    /**
+     * @param socket Connected, non-blocking socket to watch
+     * @param onReady Run on the UI thread when data, room to send or a close is pending
+     * @throws std::runtime_error if the socket cannot be watched
+     */
+    SocketWatcher(SOCKET socket, std::function<void()> onReady);
+
+    /** Stops watching; the socket stays open and non-blocking */
+    ~SocketWatcher();
+
+private:
+    // Shared with queued callbacks, which may outlive the watcher
+    struct State {
+        std::function<void()> onReady;
+        HANDLE handledEvent = nullptr;      // Set once a posted callback has run
+        bool alive = true;                  // Touched on the UI thread only
+        ~State();
+    };
+
+    SOCKET socket;
+    std::shared_ptr<State> state;
+    HANDLE readableEvent;
+    HANDLE stopEvent;
+    std::thread watchThread;
+
+    void Run();
+
+    SocketWatcher(const SocketWatcher&) = delete;
+    SocketWatcher& operator=(const SocketWatcher&) = delete;
+};
+
+#endif // SOCKET_WATCHER_H
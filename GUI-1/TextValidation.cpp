@@ -0,0 +1,177 @@
+/**
+ * @file TextValidation.cpp
+ * @brief Scalar, SSE2 and AVX2 byte-class kernels
+ */
+
+#include "TextValidation.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEXT_VALIDATION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TEXT_VALIDATION_AVX2_TARGET
+#else
+#include <cpuid.h>
+#define TEXT_VALIDATION_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace TextValidation {
+
+const CharClass PRINTABLE_ASCII = { { { 0x20, 0x7E } }, 1 };
+
+const CharClass MESSAGE_TEXT = { { { '\t', '\n' }, { '\r', '\r' }, { 0x20, 0x7E }, { 0x80, 0xFF } }, 4 };
+
+const CharClass ACCOUNT_NAME = { { { '0', '9' }, { 'A', 'Z' }, { '_', '_' }, { 'a', 'z' } }, 4 };
+
+const CharClass SERVER_NAME = { { { ' ', ' ' }, { '-', '-' }, { '0', '9' }, { 'A', 'Z' }, { '_', '_' }, { 'a', 'z' } }, 6 };
+
+const CharClass CHANNEL_NAME = { { { '-', '-' }, { '0', '9' }, { 'a', 'z' } }, 3 };
+
+namespace {
+
+bool InClass(uint8_t byte, const CharClass& allowed) {
+    for (size_t r = 0; r < allowed.count; ++r) {
+        // Unsigned wrap-around turns the two-sided test into one compare
+        if (static_cast<uint8_t>(byte - allowed.ranges[r].lo) <= allowed.ranges[r].hi - allowed.ranges[r].lo) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t FindInvalidScalar(const uint8_t* data, size_t length, size_t start, const CharClass& allowed) {
+    for (size_t i = start; i < length; ++i) {
+        if (!InClass(data[i], allowed)) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+#if defined(TEXT_VALIDATION_X86)
+
+unsigned LowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+size_t FindInvalidSse2(const uint8_t* data, size_t length, const CharClass& allowed) {
+    __m128i lo[CharClass::MAX_RANGES];
+    __m128i span[CharClass::MAX_RANGES];
+    for (size_t r = 0; r < allowed.count; ++r) {
+        lo[r] = _mm_set1_epi8(static_cast<char>(allowed.ranges[r].lo));
+        span[r] = _mm_set1_epi8(static_cast<char>(allowed.ranges[r].hi - allowed.ranges[r].lo));
+    }
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i ok = _mm_setzero_si128();
+        for (size_t r = 0; r < allowed.count; ++r) {
+            __m128i offset = _mm_sub_epi8(bytes, lo[r]);
+            ok = _mm_or_si128(ok, _mm_cmpeq_epi8(_mm_min_epu8(offset, span[r]), offset));
+        }
+        uint32_t bad = ~static_cast<uint32_t>(_mm_movemask_epi8(ok)) & 0xFFFFu;
+        if (bad != 0) {
+            return i + LowestBit(bad);
+        }
+    }
+    return FindInvalidScalar(data, length, i, allowed);
+}
+
+TEXT_VALIDATION_AVX2_TARGET
+size_t FindInvalidAvx2(const uint8_t* data, size_t length, const CharClass& allowed) {
+    __m256i lo[CharClass::MAX_RANGES];
+    __m256i span[CharClass::MAX_RANGES];
+    for (size_t r = 0; r < allowed.count; ++r) {
+        lo[r] = _mm256_set1_epi8(static_cast<char>(allowed.ranges[r].lo));
+        span[r] = _mm256_set1_epi8(static_cast<char>(allowed.ranges[r].hi - allowed.ranges[r].lo));
+    }
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i ok = _mm256_setzero_si256();
+        for (size_t r = 0; r < allowed.count; ++r) {
+            __m256i offset = _mm256_sub_epi8(bytes, lo[r]);
+            ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(_mm256_min_epu8(offset, span[r]), offset));
+        }
+        uint32_t bad = ~static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+        if (bad != 0) {
+            return i + LowestBit(bad);
+        }
+    }
+    // Under 32 bytes left: one SSE2 block may still apply before the scalar tail
+    size_t rest = FindInvalidSse2(data + i, length - i, allowed);
+    return rest == std::string_view::npos ? rest : i + rest;
+}
+
+bool CpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;       // The OS does not save the YMM registers
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // TEXT_VALIDATION_X86
+
+} // namespace
+
+Kernel BestKernel() {
+#if defined(TEXT_VALIDATION_X86)
+    static const Kernel best = CpuHasAvx2() ? Kernel::Avx2 : Kernel::Sse2;
+    return best;
+#else
+    return Kernel::Scalar;
+#endif
+}
+
+const char* KernelName(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Sse2: return "sse2";
+        case Kernel::Avx2: return "avx2";
+        default:           return "scalar";
+    }
+}
+
+size_t FindInvalidWith(Kernel kernel, std::string_view text, const CharClass& allowed) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(text.data());
+#if defined(TEXT_VALIDATION_X86)
+    // Short names gain nothing from the setup of a vector kernel
+    if (kernel == Kernel::Avx2 && text.size() >= 32 && BestKernel() == Kernel::Avx2) {
+        return FindInvalidAvx2(data, text.size(), allowed);
+    }
+    if (kernel != Kernel::Scalar && text.size() >= 16) {
+        return FindInvalidSse2(data, text.size(), allowed);
+    }
+#else
+    (void)kernel;
+#endif
+    return FindInvalidScalar(data, text.size(), 0, allowed);
+}
+
+size_t FindInvalid(std::string_view text, const CharClass& allowed) {
+    return FindInvalidWith(BestKernel(), text, allowed);
+}
+
+} // namespace TextValidation
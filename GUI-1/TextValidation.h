@@ -0,0 +1,91 @@
+#ifndef TEXT_VALIDATION_H
+#define TEXT_VALIDATION_H
+
+/**
+ * @file TextValidation.h
+ * @brief Byte-class checks for names and message text, vectorized
+ *
+ * PURPOSE:
+ * Usernames, server and channel names and message bodies are all checked
+ * the same way: every byte must fall in a small set of allowed ranges.
+ * The network layer (ServerSocket) and the models (Models.cpp) used to
+ * each loop over the bytes with <cctype> calls; they now share the
+ * classes and the kernel here, so the rules cannot drift apart.
+ *
+ * KERNELS:
+ * A byte is in [lo, hi] exactly when (byte - lo) <= (hi - lo) unsigned,
+ * which SSE2 and AVX2 evaluate 16 or 32 bytes at a time with a subtract
+ * and an unsigned min. Each range costs three instructions per block and
+ * a class has at most CharClass::MAX_RANGES of them. The widest kernel
+ * the CPU supports is picked once; tails and non-x86 builds use the
+ * scalar loop. All kernels return the same answer (Bench cross-checks
+ * them on random input before timing them).
+ *
+ * LOCALE:
+ * The classes are ASCII only, so results never depend on the C locale
+ * the way isalnum() and iscntrl() do.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace TextValidation {
+
+/** Inclusive byte range */
+struct ByteRange {
+    uint8_t lo;
+    uint8_t hi;
+};
+
+/** Set of allowed bytes, as a few inclusive ranges */
+struct CharClass {
+    static constexpr size_t MAX_RANGES = 8;
+    ByteRange ranges[MAX_RANGES];
+    size_t count;
+};
+
+/** 0x20-0x7E: what the server accepts in a connection's username */
+extern const CharClass PRINTABLE_ASCII;
+
+/** Anything but control characters; tab, newline and carriage return are allowed */
+extern const CharClass MESSAGE_TEXT;
+
+/** Letters, digits and '_' (account usernames) */
+extern const CharClass ACCOUNT_NAME;
+
+/** Letters, digits, space, '-' and '_' */
+extern const CharClass SERVER_NAME;
+
+/** Lower-case letters, digits and '-' */
+extern const CharClass CHANNEL_NAME;
+
+enum class Kernel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+/** @brief Widest kernel this CPU supports (detected once) */
+Kernel BestKernel();
+
+/** @brief Name for logs and benchmark output */
+const char* KernelName(Kernel kernel);
+
+/**
+ * @brief Position of the first byte outside the class
+ * @return std::string_view::npos if every byte is allowed
+ */
+size_t FindInvalid(std::string_view text, const CharClass& allowed);
+
+/** @brief FindInvalid() with a given kernel (falls back to scalar if unsupported) */
+size_t FindInvalidWith(Kernel kernel, std::string_view text, const CharClass& allowed);
+
+/** @brief True if every byte of text is in the class */
+inline bool IsValid(std::string_view text, const CharClass& allowed) {
+    return FindInvalid(text, allowed) == std::string_view::npos;
+}
+
+} // namespace TextValidation
+
+#endif // TEXT_VALIDATION_H
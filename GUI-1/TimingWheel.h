@@ -0,0 +1,259 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+/**
+ * @file TimingWheel.h
+ * @brief Hierarchical timing wheel for large numbers of resettable timeouts
+ *
+ * PURPOSE:
+ * Idle connections, missed heartbeats and expired sessions were either
+ * never detected or found by scanning everything. Each of those deadlines
+ * is pushed back on every bit of activity and almost never fires, so what
+ * has to be cheap is moving a timer, not finding the earliest one. Here
+ * scheduling, moving and cancelling are O(1), and each tick only touches
+ * the timers that are due (plus an occasional cascade).
+ *
+ * DESIGN:
+ * - Time is counted in ticks of a fixed length; a timer fires on the
+ *   first Advance() that reaches its tick, never earlier
+ * - LEVELS wheels of SLOTS slots each. Level 0 holds timers due within
+ *   SLOTS ticks, level 1 within SLOTS^2, and so on; when a level-0 lap
+ *   completes, the next level-1 slot is spread back over level 0
+ * - Deadlines further out than MAX_DELAY_TICKS fire at MAX_DELAY_TICKS
+ * - Timers live in one node vector linked into slots by index, with a
+ *   free list; a key -> node map makes rescheduling by key O(1)
+ * - Advance() reports expired keys instead of calling back, so callers may
+ *   reschedule or cancel freely while handling them
+ *
+ * THREADING:
+ * Not thread-safe; the owner serializes access.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "FlatHashMap.h"
+
+template <typename Key>
+class TimingWheel {
+public:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr size_t SLOTS = size_t(1) << SLOT_BITS;
+    static constexpr int LEVELS = 4;
+
+    /** Furthest a timer can sit from the current tick (about 16.7M ticks) */
+    static constexpr uint64_t MAX_DELAY_TICKS = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+
+    /**
+     * @param tickMs Resolution; timers fire up to one tick late
+     * @param nowMs Current time on the caller's clock
+     */
+    TimingWheel(uint64_t tickMs, uint64_t nowMs)
+        : m_tickMs(tickMs > 0 ? tickMs : 1)
+        , m_tick(nowMs / m_tickMs)
+        , m_freeList(NIL) {
+        for (uint32_t& head : m_heads) {
+            head = NIL;
+        }
+    }
+
+    size_t Size() const { return m_index.size(); }
+    bool Empty() const { return m_index.empty(); }
+    bool Contains(const Key& key) const { return m_index.count(key) != 0; }
+
+    /**
+     * @brief Arm a timer, or move it if the key is already armed (O(1))
+     * @param deadlineMs When to fire; a past deadline fires on the next tick
+     */
+    void Schedule(const Key& key, uint64_t deadlineMs) {
+        uint64_t tick = (deadlineMs + m_tickMs - 1) / m_tickMs;
+        if (tick <= m_tick) {
+            tick = m_tick + 1;
+        }
+
+        auto found = m_index.find(key);
+        uint32_t node;
+        if (found != m_index.end()) {
+            node = found->second;
+            unlink(node);
+        }
+        else {
+            node = allocate(key);
+            m_index.emplace(key, node);
+        }
+
+        m_nodes[node].tick = tick;
+        link(node);
+    }
+
+    /**
+     * @brief Disarm a timer
+     * @return False if the key was not armed
+     */
+    bool Cancel(const Key& key) {
+        auto found = m_index.find(key);
+        if (found == m_index.end()) {
+            return false;
+        }
+        uint32_t node = found->second;
+        m_index.erase(found);
+        unlink(node);
+        release(node);
+        return true;
+    }
+
+    /** @brief Disarm every timer */
+    void Clear() {
+        m_index.clear();
+        m_nodes.clear();
+        m_freeList = NIL;
+        for (uint32_t& head : m_heads) {
+            head = NIL;
+        }
+    }
+
+    /**
+     * @brief Move time forward and collect every timer that came due
+     * @param nowMs Current time on the caller's clock (earlier times are ignored)
+     * @param expired Appended with the keys that fired; they are disarmed
+     * @return Number of keys appended
+     */
+    size_t Advance(uint64_t nowMs, std::vector<Key>& expired) {
+        uint64_t target = nowMs / m_tickMs;
+        size_t before = expired.size();
+
+        // Nothing armed: no slot can need a visit, however long we slept
+        if (m_index.empty() && target > m_tick) {
+            m_tick = target;
+        }
+
+        while (m_tick < target) {
+            ++m_tick;
+            cascade();
+
+            uint32_t& head = m_heads[slotOf(0, m_tick)];
+            while (head != NIL) {
+                uint32_t node = head;
+                unlink(node);
+                expired.push_back(m_nodes[node].key);
+                m_index.erase(m_nodes[node].key);
+                release(node);
+            }
+
+            if (m_index.empty()) {
+                m_tick = target;
+            }
+        }
+        return expired.size() - before;
+    }
+
+private:
+    static constexpr uint32_t NIL = 0xFFFFFFFFu;
+
+    struct Node {
+        Key key{};
+        uint64_t tick = 0;
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        uint32_t slot = NIL;    // Index into m_heads, NIL while unlinked
+    };
+
+    uint64_t m_tickMs;
+    uint64_t m_tick;
+    uint32_t m_freeList;
+    std::vector<Node> m_nodes;
+    uint32_t m_heads[LEVELS * SLOTS];
+    FlatHashMap<Key, uint32_t> m_index;
+
+    static size_t slotOf(int level, uint64_t tick) {
+        return level * SLOTS + ((tick >> (SLOT_BITS * level)) & (SLOTS - 1));
+    }
+
+    uint32_t allocate(const Key& key) {
+        uint32_t node;
+        if (m_freeList != NIL) {
+            node = m_freeList;
+            m_freeList = m_nodes[node].next;
+            m_nodes[node] = Node();
+        }
+        else {
+            node = static_cast<uint32_t>(m_nodes.size());
+            m_nodes.emplace_back();
+        }
+        m_nodes[node].key = key;
+        return node;
+    }
+
+    void release(uint32_t node) {
+        m_nodes[node].key = Key{};
+        m_nodes[node].next = m_freeList;
+        m_freeList = node;
+    }
+
+    // Place a node by its distance from the current tick (a node due now
+    // goes into the level-0 slot about to be expired)
+    void link(uint32_t node) {
+        Node& n = m_nodes[node];
+        if (n.tick - m_tick > MAX_DELAY_TICKS) {
+            n.tick = m_tick + MAX_DELAY_TICKS;
+        }
+
+        uint64_t delay = n.tick - m_tick;
+        int level = 0;
+        while (level < LEVELS - 1 && delay >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+            ++level;
+        }
+
+        size_t slot = slotOf(level, n.tick);
+        n.slot = static_cast<uint32_t>(slot);
+        n.prev = NIL;
+        n.next = m_heads[slot];
+        if (n.next != NIL) {
+            m_nodes[n.next].prev = node;
+        }
+        m_heads[slot] = node;
+    }
+
+    void unlink(uint32_t node) {
+        Node& n = m_nodes[node];
+        if (n.slot == NIL) {
+            return;
+        }
+        if (n.prev != NIL) {
+            m_nodes[n.prev].next = n.next;
+        }
+        else {
+            m_heads[n.slot] = n.next;
+        }
+        if (n.next != NIL) {
+            m_nodes[n.next].prev = n.prev;
+        }
+        n.prev = NIL;
+        n.next = NIL;
+        n.slot = NIL;
+    }
+
+    // Each time a lower level completes a lap, redistribute the next slot
+    // of the level above it
+    void cascade() {
+        for (int level = 1; level < LEVELS; ++level) {
+            if ((m_tick & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            uint32_t& head = m_heads[slotOf(level, m_tick)];
+            uint32_t node = head;
+            head = NIL;
+            while (node != NIL) {
+                uint32_t next = m_nodes[node].next;
+                m_nodes[node].slot = NIL;
+                link(node);
+                node = next;
+            }
+        }
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+};
+
+#endif // TIMING_WHEEL_H
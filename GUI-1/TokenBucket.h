@@ -0,0 +1,102 @@
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+/**
+ * @file TokenBucket.h
+ * @brief Integer token bucket for rate limiting on the network thread
+ *
+ * PURPOSE:
+ * Every frame a client sent was decoded, parsed and (for chat) fanned out
+ * to every other client, however fast it arrived. A bucket per connection,
+ * per user and for the whole server lets the server refuse excess frames
+ * before doing any work on them.
+ *
+ * DESIGN:
+ * - Tokens are kept in thousandths, so refill is exact integer arithmetic:
+ *   `ratePerSecond` tokens per second is `ratePerSecond` milli-tokens per ms
+ * - The bucket refills lazily from the caller's clock when it is checked;
+ *   an idle bucket costs nothing
+ * - A rate of zero disables the bucket (every take succeeds)
+ * - Starts full, so a new client gets its whole burst
+ *
+ * THREADING:
+ * Not thread-safe; the owner serializes access.
+ */
+
+#include <algorithm>
+#include <cstdint>
+
+class TokenBucket {
+public:
+    struct Limits {
+        uint32_t ratePerSecond = 0;   ///< Sustained rate (0 = unlimited)
+        uint32_t burst = 0;           ///< Largest amount that can be taken at once
+    };
+
+    TokenBucket() : m_tokens(0), m_lastMs(0) {}
+
+    TokenBucket(const Limits& limits, uint64_t nowMs) { Reset(limits, nowMs); }
+
+    /** @brief Apply limits and refill to the full burst */
+    void Reset(const Limits& limits, uint64_t nowMs) {
+        m_limits = limits;
+        m_tokens = Capacity();
+        m_lastMs = nowMs;
+    }
+
+    bool Unlimited() const { return m_limits.ratePerSecond == 0; }
+
+    /**
+     * @brief Take `cost` tokens if they are available
+     * @return False (and nothing taken) if the bucket is too low
+     */
+    bool TryTake(uint64_t nowMs, uint32_t cost = 1) {
+        if (Unlimited()) {
+            return true;
+        }
+        refill(nowMs);
+        uint64_t needed = static_cast<uint64_t>(cost) * SCALE;
+        if (m_tokens < needed) {
+            return false;
+        }
+        m_tokens -= needed;
+        return true;
+    }
+
+    /** @brief True once the bucket has refilled completely (nothing to remember) */
+    bool Full(uint64_t nowMs) {
+        if (Unlimited()) {
+            return true;
+        }
+        refill(nowMs);
+        return m_tokens == Capacity();
+    }
+
+private:
+    static constexpr uint64_t SCALE = 1000;
+
+    Limits m_limits;
+    uint64_t m_tokens;
+    uint64_t m_lastMs;
+
+    uint64_t Capacity() const {
+        return static_cast<uint64_t>((std::max)(m_limits.burst, uint32_t(1))) * SCALE;
+    }
+
+    void refill(uint64_t nowMs) {
+        if (nowMs <= m_lastMs) {
+            return;
+        }
+        uint64_t elapsed = nowMs - m_lastMs;
+        m_lastMs = nowMs;
+        uint64_t capacity = Capacity();
+        // Saturate before multiplying: a long-idle bucket is simply full
+        if (elapsed >= capacity / m_limits.ratePerSecond + 1) {
+            m_tokens = capacity;
+            return;
+        }
+        m_tokens = (std::min)(capacity, m_tokens + elapsed * m_limits.ratePerSecond);
+    }
+};
+
+#endif // TOKEN_BUCKET_H
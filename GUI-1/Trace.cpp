@@ -0,0 +1,217 @@
+/**
+ * @file Trace.cpp
+ * @brief Implementation of the per-thread trace rings and the Chrome JSON export
+ */
+
+#include "Trace.h"
+#include "Log.h"
+#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Event {
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> startUs;
+    std::atomic<uint64_t> endUs;
+};
+
+// Written only by its thread. Buffers are never freed: a thread may
+// record right up to process exit, and a restarted worker gets a new one
+// only while MAX_THREADS allows.
+struct ThreadBuffer {
+    DWORD threadId = 0;
+    std::atomic<const char*> threadName{ nullptr };
+    std::atomic<uint64_t> written{ 0 };     // Events ever recorded; slot = index % EVENTS_PER_THREAD
+    Event events[Trace::EVENTS_PER_THREAD];
+};
+
+std::mutex registryMutex;
+ThreadBuffer* registry[Trace::MAX_THREADS] = {};
+size_t registeredThreads = 0;
+
+thread_local ThreadBuffer* threadBuffer = nullptr;
+thread_local const char* threadName = nullptr;
+thread_local bool threadRejected = false;
+
+ThreadBuffer* AcquireBuffer() {
+    if (threadRejected) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    if (registeredThreads == Trace::MAX_THREADS) {
+        threadRejected = true;
+        return nullptr;
+    }
+    // Value-initialised, so every slot starts zeroed
+    ThreadBuffer* buffer = new ThreadBuffer();
+    buffer->threadId = GetCurrentThreadId();
+    buffer->threadName.store(threadName, std::memory_order_relaxed);
+    registry[registeredThreads++] = buffer;
+    threadBuffer = buffer;
+    return buffer;
+}
+
+struct Copied {
+    const char* name;
+    uint64_t startUs;
+    uint64_t endUs;
+    DWORD threadId;
+};
+
+// Copies the buffered events of one thread that ended at or after cutoffUs
+void CopyEvents(const ThreadBuffer& buffer, uint64_t cutoffUs, std::vector<Copied>& out) {
+    const uint64_t capacity = Trace::EVENTS_PER_THREAD;
+    uint64_t before = buffer.written.load(std::memory_order_acquire);
+    uint64_t first = before > capacity ? before - capacity : 0;
+
+    size_t copiedFrom = out.size();
+    std::vector<uint64_t> indices;
+    for (uint64_t i = first; i < before; ++i) {
+        const Event& event = buffer.events[i % capacity];
+        Copied copy{ event.name.load(std::memory_order_relaxed),
+                     event.startUs.load(std::memory_order_relaxed),
+                     event.endUs.load(std::memory_order_relaxed),
+                     buffer.threadId };
+        if (copy.name && copy.endUs >= copy.startUs && copy.endUs >= cutoffUs) {
+            out.push_back(copy);
+            indices.push_back(i);
+        }
+    }
+
+    // The owner may have lapped the oldest slots while they were copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = buffer.written.load(std::memory_order_relaxed);
+    if (after >= capacity) {
+        uint64_t firstIntact = after - capacity + 1;
+        size_t keep = 0;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (indices[i] >= firstIntact) {
+                out[copiedFrom + keep++] = out[copiedFrom + i];
+            }
+        }
+        out.resize(copiedFrom + keep);
+    }
+}
+
+void AppendJsonString(std::string& out, const char* text) {
+    out += '"';
+    for (const char* p = text; *p; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        }
+        else if (c >= 0x20) {
+            out += static_cast<char>(c);
+        }
+    }
+    out += '"';
+}
+
+} // namespace
+
+namespace Trace {
+
+namespace Detail {
+
+std::atomic<bool> enabled{ false };
+
+uint64_t NowUs() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Record(const char* name, uint64_t startUs, uint64_t endUs) {
+    ThreadBuffer* buffer = threadBuffer ? threadBuffer : AcquireBuffer();
+    if (!buffer) {
+        return;
+    }
+    uint64_t index = buffer->written.load(std::memory_order_relaxed);
+    Event& event = buffer->events[index % EVENTS_PER_THREAD];
+    event.name.store(name, std::memory_order_relaxed);
+    event.startUs.store(startUs, std::memory_order_relaxed);
+    event.endUs.store(endUs, std::memory_order_relaxed);
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+} // namespace Detail
+
+void SetEnabled(bool enabled) {
+    Detail::enabled.store(enabled, std::memory_order_relaxed);
+    LOG_INFO("[INFO] Tracing %s", enabled ? "enabled" : "disabled");
+}
+
+void SetThreadName(const char* name) {
+    threadName = name;
+    if (threadBuffer) {
+        threadBuffer->threadName.store(name, std::memory_order_relaxed);
+    }
+}
+
+bool WriteChromeJson(const std::string& path, uint64_t windowMs) {
+    uint64_t nowUs = Detail::NowUs();
+    uint64_t cutoffUs = (windowMs == 0 || windowMs * 1000 > nowUs) ? 0 : nowUs - windowMs * 1000;
+
+    std::vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffers.assign(registry, registry + registeredThreads);
+    }
+
+    std::vector<Copied> events;
+    for (const ThreadBuffer* buffer : buffers) {
+        CopyEvents(*buffer, cutoffUs, events);
+    }
+    std::sort(events.begin(), events.end(), [](const Copied& a, const Copied& b) {
+        return a.startUs < b.startUs;
+    });
+
+    std::string out;
+    out.reserve(128 + events.size() * 96);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    char number[96];
+    for (const ThreadBuffer* buffer : buffers) {
+        const char* name = buffer->threadName.load(std::memory_order_relaxed);
+        if (!name) {
+            continue;
+        }
+        out += first ? "" : ",";
+        first = false;
+        snprintf(number, sizeof(number), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":",
+                 static_cast<unsigned long>(buffer->threadId));
+        out += number;
+        AppendJsonString(out, name);
+        out += "}}";
+    }
+    for (const Copied& event : events) {
+        out += first ? "{\"name\":" : ",{\"name\":";
+        first = false;
+        AppendJsonString(out, event.name);
+        snprintf(number, sizeof(number), ",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%llu,\"dur\":%llu}",
+                 static_cast<unsigned long>(event.threadId),
+                 static_cast<unsigned long long>(event.startUs),
+                 static_cast<unsigned long long>(event.endUs - event.startUs));
+        out += number;
+    }
+    out += "]}\n";
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), "wb") != 0 || !file) {
+        LOG_WARNING("[WARNING] Could not write trace to %s", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = fclose(file) == 0 && ok;
+    if (ok) {
+        LOG_INFO("[INFO] Wrote %zu trace events to %s", events.size(), path.c_str());
+    }
+    return ok;
+}
+
+} // namespace Trace
@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * @file Trace.h
+ * @brief Scoped trace zones with per-thread ring buffers and Chrome trace export
+ *
+ * PURPOSE:
+ * When the client stutters, the question is where the frame went: the
+ * network pass, receiveMessages(), a message save or reload, or FLTK
+ * drawing. TRACE_ZONE("name") marks a scope; WriteChromeJson() dumps the
+ * recorded zones in the Trace Event format that chrome://tracing and
+ * ui.perfetto.dev open directly.
+ *
+ * DESIGN:
+ * - Disabled (the default), a zone is one relaxed atomic load and a
+ *   branch; nothing is timed or stored
+ * - Enabled, a zone reads the clock twice and writes one event into its
+ *   thread's ring buffer: no lock, no allocation after the first event
+ * - Each ring keeps the newest EVENTS_PER_THREAD events; older ones are
+ *   overwritten, so a long session costs constant memory
+ * - Zone names must be string literals (only the pointer is stored)
+ *
+ * THREADING:
+ * Zones may be used on any thread. WriteChromeJson() may run while other
+ * threads keep recording; events overwritten during the copy are left
+ * out rather than reported torn.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Trace {
+
+/** Newest events kept per thread */
+constexpr size_t EVENTS_PER_THREAD = 16384;
+
+/** Threads that can record; later threads' zones are ignored */
+constexpr size_t MAX_THREADS = 64;
+
+namespace Detail {
+    extern std::atomic<bool> enabled;
+    uint64_t NowUs();
+    void Record(const char* name, uint64_t startUs, uint64_t endUs);
+}
+
+/** @brief True while zones are being recorded */
+inline bool IsEnabled() { return Detail::enabled.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Start or stop recording (events already recorded are kept)
+ */
+void SetEnabled(bool enabled);
+
+/**
+ * @brief Label the calling thread in exported traces (literal or static string)
+ */
+void SetThreadName(const char* name);
+
+/**
+ * @brief Write every recorded zone that ended in the last windowMs
+ * @param path Output file (replaced)
+ * @param windowMs How far back to go; 0 = everything still buffered
+ * @return False if the file could not be written
+ */
+bool WriteChromeJson(const std::string& path, uint64_t windowMs = 0);
+
+/**
+ * @brief Times the enclosing scope when tracing is enabled
+ */
+class Zone {
+public:
+    explicit Zone(const char* name)
+        : m_name(IsEnabled() ? name : nullptr)
+        , m_startUs(m_name ? Detail::NowUs() : 0) {}
+
+    ~Zone() {
+        if (m_name) {
+            Detail::Record(m_name, m_startUs, Detail::NowUs());
+        }
+    }
+
+private:
+    const char* m_name;
+    uint64_t m_startUs;
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+};
+
+} // namespace Trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+/** Trace the rest of the enclosing scope as one zone */
+#define TRACE_ZONE(name) ::Trace::Zone TRACE_CONCAT(traceZone_, __LINE__)(name)
+
+#endif // TRACE_H
@@ -0,0 +1,221 @@
+/**
+ * @file TrafficCapture.cpp
+ * @brief Implementation of the inbound traffic recorder and its reader
+ */
+
+#include "TrafficCapture.h"
+#include "NetProtocol.h"
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+const char CAPTURE_MAGIC[8] = { 'C', 'H', 'C', 'A', 'P', '0', '0', '1' };
+constexpr size_t HEADER_SIZE = sizeof(CAPTURE_MAGIC) + 8;
+
+uint64_t NowUs() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void PutVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+std::FILE* OpenFile(const std::string& path, const char* mode) {
+#ifdef _WIN32
+    std::FILE* file = nullptr;
+    return fopen_s(&file, path.c_str(), mode) == 0 ? file : nullptr;
+#else
+    return std::fopen(path.c_str(), mode);
+#endif
+}
+
+} // namespace
+
+//=============================================================================
+// RECORDING
+//=============================================================================
+
+TrafficCapture::~TrafficCapture() {
+    Stop();
+}
+
+bool TrafficCapture::Start(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    closeLocked();
+
+    m_file = OpenFile(path, "wb");
+    if (!m_file) {
+        return false;
+    }
+    int64_t startMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    m_pending.assign(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    for (int i = 0; i < 8; ++i) {
+        m_pending.push_back(static_cast<char>((static_cast<uint64_t>(startMs) >> (8 * i)) & 0xFF));
+    }
+    m_fileSize = 0;
+    m_records = 0;
+    m_lastUs = NowUs();
+    m_connections.clear();
+    m_nextConnection = 1;
+    m_active.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+uint64_t TrafficCapture::Stop() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t records = m_file ? m_records : 0;
+    closeLocked();
+    return records;
+}
+
+void TrafficCapture::closeLocked() {
+    m_active.store(false, std::memory_order_relaxed);
+    if (m_file) {
+        writePending();
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+    m_pending.clear();
+    m_connections.clear();
+}
+
+void TrafficCapture::record(Kind kind, uint64_t key, std::string_view payload) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file) {
+        return;     // Stopped between the check and the lock
+    }
+
+    // Connections already open when the capture started get a number on first sight
+    auto found = m_connections.find(key);
+    uint32_t connection = 0;
+    if (found != m_connections.end()) {
+        if (kind == Kind::Connect) {
+            found->second = m_nextConnection++;     // Socket reused; a new connection
+        }
+        connection = found->second;
+    } else if (kind == Kind::Disconnect) {
+        return;     // Never seen; nothing to replay for it
+    } else {
+        connection = m_nextConnection++;
+        m_connections.emplace(key, connection);
+    }
+    if (kind == Kind::Disconnect) {
+        m_connections.erase(key);
+    }
+
+    uint64_t nowUs = NowUs();
+    m_pending.push_back(static_cast<char>(kind));
+    PutVarint(m_pending, nowUs - m_lastUs);
+    PutVarint(m_pending, connection);
+    if (kind == Kind::Frame) {
+        PutVarint(m_pending, payload.size());
+        m_pending.append(payload.data(), payload.size());
+    }
+    m_lastUs = nowUs;
+    ++m_records;
+
+    if (m_pending.size() >= WRITE_CHUNK_SIZE && !writePending()) {
+        closeLocked();
+    }
+}
+
+bool TrafficCapture::writePending() {
+    if (m_pending.empty()) {
+        return true;
+    }
+    if (m_fileSize + m_pending.size() > MAX_FILE_SIZE ||
+        std::fwrite(m_pending.data(), 1, m_pending.size(), m_file) != m_pending.size()) {
+        m_pending.clear();
+        return false;
+    }
+    m_fileSize += m_pending.size();
+    m_pending.clear();
+    return true;
+}
+
+//=============================================================================
+// READING
+//=============================================================================
+
+TrafficCapture::Reader::~Reader() {
+    if (m_file) {
+        std::fclose(m_file);
+    }
+}
+
+bool TrafficCapture::Reader::Open(const std::string& path) {
+    if (m_file) {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+    m_file = OpenFile(path, "rb");
+    if (!m_file) {
+        return false;
+    }
+    unsigned char header[HEADER_SIZE];
+    if (std::fread(header, 1, sizeof(header), m_file) != sizeof(header) ||
+        std::memcmp(header, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    uint64_t startMs = 0;
+    for (int i = 0; i < 8; ++i) {
+        startMs |= static_cast<uint64_t>(header[sizeof(CAPTURE_MAGIC) + i]) << (8 * i);
+    }
+    m_startTimeMs = static_cast<int64_t>(startMs);
+    m_timeUs = 0;
+    return true;
+}
+
+bool TrafficCapture::Reader::readVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = std::fgetc(m_file);
+        if (byte == EOF) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TrafficCapture::Reader::Next(Event& event) {
+    if (!m_file) {
+        return false;
+    }
+    int kind = std::fgetc(m_file);
+    uint64_t deltaUs = 0;
+    uint64_t connection = 0;
+    if (kind < static_cast<int>(Kind::Connect) || kind > static_cast<int>(Kind::Disconnect) ||
+        !readVarint(deltaUs) || !readVarint(connection) || connection == 0 || connection > UINT32_MAX) {
+        return false;
+    }
+
+    event.kind = static_cast<Kind>(kind);
+    m_timeUs += deltaUs;
+    event.timeUs = m_timeUs;
+    event.connection = static_cast<uint32_t>(connection);
+    event.payload.clear();
+    if (event.kind == Kind::Frame) {
+        uint64_t length = 0;
+        if (!readVarint(length) || length > NetProtocol::MAX_MESSAGE_SIZE) {
+            return false;
+        }
+        event.payload.resize(static_cast<size_t>(length));
+        if (length > 0 && std::fread(&event.payload[0], 1, event.payload.size(), m_file) != event.payload.size()) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,141 @@
+#ifndef TRAFFIC_CAPTURE_H
+#define TRAFFIC_CAPTURE_H
+
+/**
+ * @file TrafficCapture.h
+ * @brief Records a server's decoded inbound frames for later replay
+ *
+ * PURPOSE:
+ * Slowdowns in ServerSocket::handleClientConnections() depend on the real
+ * mix and timing of joins, whispers, renames and floods, which a synthetic
+ * load does not reproduce. A capture records exactly what each connection
+ * sent and when, so LoadGen --replay can send the same traffic to any
+ * build, either on the original schedule or as fast as the server takes it.
+ *
+ * FILE LAYOUT (little-endian, varints are LEB128):
+ *   [8-byte magic "CHCAP001"][i64 capture start, Unix ms]
+ *   [record]*
+ *   record = [u8 kind][varint µs since the previous record]
+ *            [varint connection]
+ *            Frame only: [varint length][payload]
+ *
+ * Connections are numbered from 1 in the order the capture first sees
+ * them, not by socket, so a replay opens one connection per number.
+ * Payloads are frames as ServerSocket decoded them (after decompression),
+ * chat content included: treat a capture like the message history.
+ *
+ * COST:
+ * When no capture is running each hook is one relaxed atomic load.
+ * While one runs, records are appended to a buffer and written in
+ * WRITE_CHUNK_SIZE pieces; a capture stops on its own at MAX_FILE_SIZE.
+ *
+ * THREADING:
+ * Start() and Stop() may be called from any thread while the network
+ * thread records; a mutex (uncontended in practice) serializes them.
+ * Reader is not thread-safe.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "FlatHashMap.h"
+
+class TrafficCapture {
+public:
+    enum class Kind : uint8_t {
+        Connect = 1,        ///< Connection accepted
+        Frame = 2,          ///< One decoded inbound frame
+        Disconnect = 3,     ///< Connection dropped
+    };
+
+    /** Buffered bytes written to the file at once */
+    static constexpr size_t WRITE_CHUNK_SIZE = 64 * 1024;
+
+    /** A capture stops when its file reaches this size */
+    static constexpr uint64_t MAX_FILE_SIZE = 1024ull * 1024 * 1024;
+
+    TrafficCapture() = default;
+    ~TrafficCapture();
+
+    /**
+     * @brief Start recording to a new file (replacing one being recorded)
+     * @return False if the file could not be created
+     */
+    bool Start(const std::string& path);
+
+    /**
+     * @brief Finish the file
+     * @return Records written, or 0 if nothing was recording
+     */
+    uint64_t Stop();
+
+    bool IsActive() const { return m_active.load(std::memory_order_relaxed); }
+
+    /** @brief Hooks for ServerSocket; the key is anything unique per live connection */
+    void RecordConnect(uint64_t key) { if (IsActive()) record(Kind::Connect, key, {}); }
+    void RecordFrame(uint64_t key, std::string_view payload) { if (IsActive()) record(Kind::Frame, key, payload); }
+    void RecordDisconnect(uint64_t key) { if (IsActive()) record(Kind::Disconnect, key, {}); }
+
+    /**
+     * @brief Reads a capture back, one record at a time
+     */
+    class Reader {
+    public:
+        struct Event {
+            Kind kind = Kind::Frame;
+            uint64_t timeUs = 0;        ///< Since the capture started
+            uint32_t connection = 0;
+            std::string payload;        ///< Frame only
+        };
+
+        Reader() = default;
+        ~Reader();
+
+        /** @return False if the file is missing or not a capture */
+        bool Open(const std::string& path);
+
+        /**
+         * @brief Next record
+         * @return False at the end; a record torn by a crash ends the capture there
+         */
+        bool Next(Event& event);
+
+        /** Unix ms at which the capture started */
+        int64_t StartTimeMs() const { return m_startTimeMs; }
+
+    private:
+        std::FILE* m_file = nullptr;
+        int64_t m_startTimeMs = 0;
+        uint64_t m_timeUs = 0;
+
+        bool readVarint(uint64_t& value);
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+    };
+
+private:
+    std::atomic<bool> m_active{ false };
+    std::mutex m_mutex;
+    std::FILE* m_file = nullptr;
+    std::string m_pending;
+    uint64_t m_fileSize = 0;
+    uint64_t m_records = 0;
+    uint64_t m_lastUs = 0;
+
+    // Live connection key -> capture connection number
+    FlatHashMap<uint64_t, uint32_t> m_connections;
+    uint32_t m_nextConnection = 1;
+
+    void record(Kind kind, uint64_t key, std::string_view payload);
+    bool writePending();
+    void closeLocked();
+
+    TrafficCapture(const TrafficCapture&) = delete;
+    TrafficCapture& operator=(const TrafficCapture&) = delete;
+};
+
+#endif // TRAFFIC_CAPTURE_H
@@ -0,0 +1,118 @@
+/**
+ * @file TrigramIndex.cpp
+ * @brief Implementation of the trigram substring index
+ */
+
+#include "TrigramIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+void TrigramIndex::Insert(uint64_t id, const std::string& text) {
+    Erase(id);
+
+    std::string folded = Fold(text);
+    for (uint32_t trigram : Trigrams(folded)) {
+        std::vector<uint64_t>& ids = m_postings[trigram];
+        ids.insert(std::lower_bound(ids.begin(), ids.end(), id), id);
+    }
+    m_folded.emplace(id, std::move(folded));
+}
+
+void TrigramIndex::Erase(uint64_t id) {
+    auto it = m_folded.find(id);
+    if (it == m_folded.end()) {
+        return;
+    }
+
+    for (uint32_t trigram : Trigrams(it->second)) {
+        auto postingIt = m_postings.find(trigram);
+        if (postingIt == m_postings.end()) {
+            continue;
+        }
+        std::vector<uint64_t>& ids = postingIt->second;
+        auto idIt = std::lower_bound(ids.begin(), ids.end(), id);
+        if (idIt != ids.end() && *idIt == id) {
+            ids.erase(idIt);
+        }
+        if (ids.empty()) {
+            m_postings.erase(postingIt);
+        }
+    }
+    m_folded.erase(it);
+}
+
+void TrigramIndex::Clear() {
+    m_folded.clear();
+    m_postings.clear();
+}
+
+std::vector<uint64_t> TrigramIndex::FindSubstring(const std::string& query) const {
+    std::string folded = Fold(query);
+    std::vector<uint64_t> matches;
+
+    if (folded.size() < 3) {
+        for (const auto& [id, text] : m_folded) {
+            if (text.find(folded) != std::string::npos) {
+                matches.push_back(id);
+            }
+        }
+        std::sort(matches.begin(), matches.end());
+        return matches;
+    }
+
+    // Intersect posting lists, rarest trigram first
+    std::vector<const std::vector<uint64_t>*> lists;
+    for (uint32_t trigram : Trigrams(folded)) {
+        auto it = m_postings.find(trigram);
+        if (it == m_postings.end()) {
+            return matches;
+        }
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const auto* a, const auto* b) { return a->size() < b->size(); });
+
+    std::vector<uint64_t> candidates = *lists.front();
+    std::vector<uint64_t> narrowed;
+    for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+        narrowed.clear();
+        std::set_intersection(candidates.begin(), candidates.end(),
+                              lists[i]->begin(), lists[i]->end(),
+                              std::back_inserter(narrowed));
+        candidates.swap(narrowed);
+    }
+
+    // Sharing every trigram does not mean they are adjacent; confirm
+    for (uint64_t id : candidates) {
+        auto it = m_folded.find(id);
+        if (it != m_folded.end() && it->second.find(folded) != std::string::npos) {
+            matches.push_back(id);
+        }
+    }
+    return matches;
+}
+
+std::string TrigramIndex::Fold(const std::string& text) {
+    std::string folded = text;
+    std::transform(folded.begin(), folded.end(), folded.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return folded;
+}
+
+std::vector<uint32_t> TrigramIndex::Trigrams(const std::string& folded) {
+    std::vector<uint32_t> trigrams;
+    if (folded.size() < 3) {
+        return trigrams;
+    }
+
+    trigrams.reserve(folded.size() - 2);
+    for (size_t i = 0; i + 3 <= folded.size(); ++i) {
+        trigrams.push_back(static_cast<uint32_t>(static_cast<uint8_t>(folded[i])) << 16 |
+                           static_cast<uint32_t>(static_cast<uint8_t>(folded[i + 1])) << 8 |
+                           static_cast<uint32_t>(static_cast<uint8_t>(folded[i + 2])));
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
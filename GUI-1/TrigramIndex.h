@@ -0,0 +1,65 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+/**
+ * @file TrigramIndex.h
+ * @brief Inverted trigram index for case-insensitive substring search
+ *
+ * PURPOSE:
+ * Finding names that contain a search term used to mean lowercasing and
+ * scanning every name. Here each name is split into its overlapping
+ * three-character windows; a query only looks at the names that share
+ * all of its trigrams, then confirms each candidate with one find().
+ *
+ * DESIGN:
+ * - Trigram (three ASCII-folded bytes packed into a u32) -> sorted IDs
+ * - Candidates are the intersection of the query's posting lists,
+ *   smallest list first, so cost tracks the rarest trigram
+ * - Queries shorter than three characters have no trigram; they fall
+ *   back to scanning the stored folded names (no per-call lowercasing)
+ *
+ * THREADING:
+ * Not thread-safe; the owner serializes access with its own mutex.
+ */
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TrigramIndex {
+public:
+    /**
+     * @brief Index text under an ID, replacing any text it had before
+     */
+    void Insert(uint64_t id, const std::string& text);
+
+    /**
+     * @brief Remove an ID and its text
+     */
+    void Erase(uint64_t id);
+
+    void Clear();
+
+    /**
+     * @brief IDs whose text contains query, ignoring ASCII case
+     * @return Matching IDs in ascending order (every ID for an empty query)
+     */
+    std::vector<uint64_t> FindSubstring(const std::string& query) const;
+
+    size_t Size() const { return m_folded.size(); }
+
+private:
+    // ID -> folded text, for confirming candidates and for short queries
+    std::unordered_map<uint64_t, std::string> m_folded;
+
+    // Trigram -> IDs containing it, ascending
+    std::unordered_map<uint32_t, std::vector<uint64_t>> m_postings;
+
+    static std::string Fold(const std::string& text);
+
+    /** @brief Distinct trigrams of folded text, ascending */
+    static std::vector<uint32_t> Trigrams(const std::string& folded);
+};
+
+#endif // TRIGRAM_INDEX_H
@@ -0,0 +1,56 @@
+/**
+ * @file UiDispatcher.cpp
+ * @brief Implementation of the background-to-UI work queue
+ */
+
+#include "UiDispatcher.h"
+#include <FL/Fl.H>
+#include <deque>
+#include <mutex>
+
+namespace {
+    std::mutex queueMutex;
+    std::deque<std::function<void()>> pendingWork;
+    bool awakePending = false;
+}
+
+void UiDispatcher::Post(std::function<void()> work) {
+    if (!work) {
+        return;
+    }
+
+    bool needsWake = false;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pendingWork.push_back(std::move(work));
+        if (!awakePending) {
+            awakePending = true;
+            needsWake = true;
+        }
+    }
+
+    if (needsWake && Fl::awake(&UiDispatcher::AwakeCallback, nullptr) != 0) {
+        // FLTK's awake ring is full; the next Post() will retry.
+        std::lock_guard<std::mutex> lock(queueMutex);
+        awakePending = false;
+    }
+}
+
+size_t UiDispatcher::Drain() {
+    std::deque<std::function<void()>> batch;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        batch.swap(pendingWork);
+        awakePending = false;
+    }
+
+    // Run outside the lock so handlers may Post() again
+    for (auto& work : batch) {
+        work();
+    }
+    return batch.size();
+}
+
+void UiDispatcher::AwakeCallback(void* /*userdata*/) {
+    Drain();
+}
@@ -0,0 +1,45 @@
+#ifndef UI_DISPATCHER_H
+#define UI_DISPATCHER_H
+
+/**
+ * @file UiDispatcher.h
+ * @brief Thread-safe hand-off of work from background threads to the FLTK thread
+ *
+ * PURPOSE:
+ * FLTK widgets may only be touched from the thread running Fl::run().
+ * Background threads (e.g. the server network thread) post closures here;
+ * they are executed on the UI thread in FIFO order.
+ *
+ * DESIGN:
+ * - A single process-wide queue guarded by a mutex
+ * - Fl::awake() is called only when the queue goes from empty to non-empty,
+ *   so a burst of events costs one wake-up and one drain
+ * - Storage is static, so a queued wake-up can never outlive the queue
+ *
+ * REQUIREMENT:
+ * Fl::lock() must be called once on the UI thread before Fl::run() so
+ * FLTK's awake mechanism is enabled.
+ */
+
+#include <functional>
+
+class UiDispatcher {
+public:
+    /**
+     * @brief Queue work to run on the UI thread (callable from any thread)
+     * @param work Closure to execute; must not capture objects that may be
+     *             destroyed before the UI thread gets to it
+     */
+    static void Post(std::function<void()> work);
+
+    /**
+     * @brief Run everything queued so far (UI thread only)
+     * @return Number of closures executed
+     */
+    static size_t Drain();
+
+private:
+    static void AwakeCallback(void* userdata);
+};
+
+#endif // UI_DISPATCHER_H
@@ -3,14 +3,9 @@
  * @brief Implementation of secure user storage and authentication
  * 
  * SECURITY NOTE:
- * This implementation uses SHA-256 for password hashing, which is NOT
- * ideal for passwords (no work factor). For a production system, use:
- * - bcrypt (recommended)
- * - Argon2 (newer, memory-hard)
- * - PBKDF2 (widely available)
- * 
- * SHA-256 is used here to avoid external dependencies while still
- * demonstrating proper security patterns (salt, constant-time comparison).
+ * Passwords are hashed with PBKDF2-HMAC-SHA256 by PasswordHasher. The
+ * original SHA-256(salt + password) hashes had no work factor; they still
+ * verify, and each is replaced with a PBKDF2 hash on its next login.
  */
 
 #include "UserDatabase.h"
@@ -19,24 +14,48 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <cctype>
 #include <fstream>
 
-// Windows crypto API for secure random and hashing
+// CNG system RNG for salts and session tokens
 #include <windows.h>
-#include <wincrypt.h>
-#pragma comment(lib, "advapi32.lib")
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+
+/** Clock for the session expiry wheel: Session::expiresAt in milliseconds */
+static uint64_t SessionClockMs() {
+    return static_cast<uint64_t>(std::time(nullptr)) * 1000;
+}
 
 //=============================================================================
 // CONSTRUCTOR / DESTRUCTOR
 //=============================================================================
 
-UserDatabase::UserDatabase(const std::string& databasePath)
-    : databaseFilePath(databasePath) {
-    LoadFromFile();
+UserDatabase::UserDatabase(const std::string& databasePath, bool loadNow)
+    : databaseFilePath(databasePath)
+    , snapshotFilePath(SnapshotPathFor(databasePath))
+    , sessionExpiry(SESSION_EXPIRY_TICK_MS, SessionClockMs())
+    , persistence("user database", [this] { return SaveToFile(); }) {
+    rebuildDummyPassword();
+    if (loadNow) {
+        LoadFromFile();
+    }
 }
 
 UserDatabase::~UserDatabase() {
-    SaveToFile();
+    // Queued registrations and logins still write to the maps below
+    passwordHasher.Stop();
+    
+    PasswordHasher::Timings timings = passwordHasher.GetTimings();
+    if (timings.count > 0) {
+        printf("[AUTH] %llu password jobs: p50 <= %llu us, p99 <= %llu us, max %llu us\n",
+               static_cast<unsigned long long>(timings.count),
+               static_cast<unsigned long long>(timings.PercentileMicros(0.50)),
+               static_cast<unsigned long long>(timings.PercentileMicros(0.99)),
+               static_cast<unsigned long long>(timings.maxMicros));
+    }
+    
+    persistence.Close();
     
     // Securely clear all password data from memory
     for (auto& pair : passwordsByUserId) {
@@ -54,25 +73,54 @@ Protocol::ErrorCode UserDatabase::RegisterUser(
     const std::string& password,
     uint64_t& outUserId
 ) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::string passwordCopy = password;
+    return runRegistration(username, passwordCopy, outUserId);
+}
+
+void UserDatabase::RegisterUserAsync(const std::string& username, const std::string& password,
+                                     RegisterCallback done) {
+    bool queued = passwordHasher.Submit([this, username, password = std::string(password), done]() mutable {
+        uint64_t userId = 0;
+        Protocol::ErrorCode result = runRegistration(username, password, userId);
+        if (done) {
+            done(result, userId);
+        }
+    });
+    if (!queued && done) {
+        done(Protocol::ErrorCode::RateLimited, 0);
+    }
+}
+
+Protocol::ErrorCode UserDatabase::runRegistration(const std::string& username, std::string& password,
+                                                  uint64_t& outUserId) {
+    Protocol::ErrorCode result = checkRegistration(username, password);
+    if (result != Protocol::ErrorCode::None) {
+        SecureClearString(password);
+        return result;
+    }
+    
+    // Generate salt and hash password (slow; no lock held)
+    std::string salt = GenerateSalt();
+    std::string passwordHash = passwordHasher.Hash(password, salt);
+    SecureClearString(password);
+    if (passwordHash.empty()) {
+        return Protocol::ErrorCode::InternalError;
+    }
     
+    return completeRegistration(username, salt, passwordHash, outUserId);
+}
+
+Protocol::ErrorCode UserDatabase::checkRegistration(const std::string& username, const std::string& password) {
     // Validate username format
     if (!Models::User::IsValidUsername(username)) {
         return Protocol::ErrorCode::InvalidUsername;
     }
     
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    
     // Check if username already exists (case-insensitive)
-    std::string lowerUsername = username;
-    std::transform(lowerUsername.begin(), lowerUsername.end(), 
-                   lowerUsername.begin(), ::tolower);
-    
-    for (const auto& pair : userIdByUsername) {
-        std::string existingLower = pair.first;
-        std::transform(existingLower.begin(), existingLower.end(),
-                       existingLower.begin(), ::tolower);
-        if (existingLower == lowerUsername) {
-            return Protocol::ErrorCode::UsernameAlreadyExists;
-        }
+    if (usernameIndex.find(FoldUsername(username)) != usernameIndex.end()) {
+        return Protocol::ErrorCode::UsernameAlreadyExists;
     }
     
     // Validate password (minimum requirements)
@@ -80,30 +128,38 @@ Protocol::ErrorCode UserDatabase::RegisterUser(
         return Protocol::ErrorCode::InvalidPassword;
     }
     
+    return Protocol::ErrorCode::None;
+}
+
+Protocol::ErrorCode UserDatabase::completeRegistration(const std::string& username, const std::string& salt,
+                                                       const std::string& hash, uint64_t& outUserId) {
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
+    
+    // Checked again: another registration may have taken the name while hashing
+    if (usernameIndex.find(FoldUsername(username)) != usernameIndex.end()) {
+        return Protocol::ErrorCode::UsernameAlreadyExists;
+    }
+    
     // Generate unique user ID
     uint64_t userId = Models::GenerateUniqueId();
     
-    // Generate salt and hash password
-    std::string salt = GenerateSalt();
-    std::string passwordHash = HashPassword(password, salt);
-    
     // Create user
     Models::User newUser(userId, username);
     
     // Store user
     usersById[userId] = newUser;
-    userIdByUsername[username] = userId;
+    indexUsername(userId, username);
     
     // Store password data separately
     PasswordData passwordData;
     passwordData.salt = salt;
-    passwordData.hash = passwordHash;
+    passwordData.hash = hash;
     passwordsByUserId[userId] = passwordData;
     
     outUserId = userId;
     
     // Persist to disk
-    SaveToFile();
+    persistence.MarkDirty();
     
     printf("[AUTH] User registered: %s (ID: %llu)\n", username.c_str(), userId);
     
@@ -115,7 +171,87 @@ Protocol::ErrorCode UserDatabase::AuthenticateUser(
     const std::string& password,
     Models::Session& outSession
 ) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::string passwordCopy = password;
+    return runAuthentication(username, passwordCopy, outSession);
+}
+
+void UserDatabase::AuthenticateUserAsync(const std::string& username, const std::string& password,
+                                         AuthenticateCallback done) {
+    bool queued = passwordHasher.Submit([this, username, password = std::string(password), done]() mutable {
+        Models::Session session;
+        Protocol::ErrorCode result = runAuthentication(username, password, session);
+        if (done) {
+            done(result, session);
+        }
+    });
+    if (!queued && done) {
+        done(Protocol::ErrorCode::RateLimited, Models::Session());
+    }
+}
+
+Protocol::ErrorCode UserDatabase::runAuthentication(const std::string& username, std::string& password,
+                                                    Models::Session& outSession) {
+    uint64_t userId = 0;
+    PasswordData stored;
+    Protocol::ErrorCode result = beginAuthentication(username, userId, stored);
+    if (result == Protocol::ErrorCode::InvalidCredentials) {
+        // SECURITY: unknown username; spend the same hashing work as a wrong
+        // password so response time does not reveal which usernames exist
+        PasswordData dummy;
+        {
+            std::lock_guard<std::mutex> lock(dummyPasswordMutex);
+            dummy = dummyPasswordData;
+        }
+        passwordHasher.Verify(password, dummy.salt, dummy.hash);
+        SecureClearString(password);
+        printf("[AUTH] Failed login attempt for user: %s\n", username.c_str());
+        return result;
+    }
+    if (result != Protocol::ErrorCode::None) {
+        SecureClearString(password);
+        return result;
+    }
+    
+    // SECURITY: Verify() compares in constant time (slow; no lock held)
+    bool verified = passwordHasher.Verify(password, stored.salt, stored.hash);
+    std::string upgradedHash;
+    if (verified && passwordHasher.NeedsRehash(stored.hash)) {
+        upgradedHash = passwordHasher.Hash(password, stored.salt);
+    }
+    SecureClearString(password);
+    
+    if (!verified) {
+        SecureClearString(stored.salt);
+        SecureClearString(stored.hash);
+        printf("[AUTH] Failed login attempt for user: %s\n", username.c_str());
+        return Protocol::ErrorCode::InvalidCredentials;
+    }
+    
+    result = completeAuthentication(username, userId, stored.hash, upgradedHash, outSession);
+    SecureClearString(stored.salt);
+    SecureClearString(stored.hash);
+    return result;
+}
+
+void UserDatabase::SetPasswordWorkFactor(uint32_t iterations) {
+    passwordHasher.SetIterations(iterations);
+    rebuildDummyPassword();
+}
+
+void UserDatabase::rebuildDummyPassword() {
+    // Hashed at the current work factor, so verifying against it costs what
+    // a real user's current hash costs; done here so no login pays for it
+    PasswordData dummy;
+    dummy.salt = GenerateSalt();
+    dummy.hash = passwordHasher.Hash(GenerateSecureRandom(16), dummy.salt);
+    
+    std::lock_guard<std::mutex> lock(dummyPasswordMutex);
+    dummyPasswordData = std::move(dummy);
+}
+
+Protocol::ErrorCode UserDatabase::beginAuthentication(const std::string& username, uint64_t& outUserId,
+                                                      PasswordData& outStored) {
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
     
     // Find user by username
     auto usernameIt = userIdByUsername.find(username);
@@ -133,28 +269,40 @@ Protocol::ErrorCode UserDatabase::AuthenticateUser(
         return Protocol::ErrorCode::InternalError;
     }
     
-    const PasswordData& storedPassword = passwordIt->second;
-    
-    // Hash the provided password with stored salt
-    std::string providedHash = HashPassword(password, storedPassword.salt);
+    outUserId = userId;
+    outStored = passwordIt->second;
+    return Protocol::ErrorCode::None;
+}
+
+Protocol::ErrorCode UserDatabase::completeAuthentication(const std::string& username, uint64_t userId,
+                                                         const std::string& verifiedHash,
+                                                         const std::string& upgradedHash,
+                                                         Models::Session& outSession) {
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
     
-    // SECURITY: Constant-time comparison to prevent timing attacks
-    if (!ConstantTimeCompare(providedHash, storedPassword.hash)) {
-        printf("[AUTH] Failed login attempt for user: %s\n", username.c_str());
+    // The password may have changed (or the user gone) while verifying
+    auto passwordIt = passwordsByUserId.find(userId);
+    if (passwordIt == passwordsByUserId.end() || passwordIt->second.hash != verifiedHash) {
         return Protocol::ErrorCode::InvalidCredentials;
     }
     
+    if (!upgradedHash.empty()) {
+        SecureClearString(passwordIt->second.hash);
+        passwordIt->second.hash = upgradedHash;
+        persistence.MarkDirty();
+    }
+    
     // Authentication successful - create session
     std::string sessionToken = GenerateSessionToken();
     
     Models::Session session(userId, sessionToken);
-    sessionsByToken[sessionToken] = session;
+    expireSessions();
+    addSession(session);
     
     // Update user's last login time
     auto userIt = usersById.find(userId);
     if (userIt != usersById.end()) {
         userIt->second.lastLoginAt = std::time(nullptr);
-        userIt->second.isOnline = true;
     }
     
     outSession = session;
@@ -166,69 +314,99 @@ Protocol::ErrorCode UserDatabase::AuthenticateUser(
 }
 
 bool UserDatabase::ValidateSession(const std::string& sessionToken, uint64_t& outUserId) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
+    expireSessions();
     
     auto it = sessionsByToken.find(sessionToken);
     if (it == sessionsByToken.end()) {
         return false;
     }
     
-    Models::Session& session = it->second;
-    
-    // Check if expired
-    if (session.IsExpired()) {
-        sessionsByToken.erase(it);
+    // The wheel rounds up to a whole tick, so check the exact time too
+    if (it->second.IsExpired()) {
+        removeSession(sessionToken);
         return false;
     }
     
-    outUserId = session.userId;
+    outUserId = it->second.userId;
     return true;
 }
 
 void UserDatabase::InvalidateSession(const std::string& sessionToken) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
     
-    auto it = sessionsByToken.find(sessionToken);
-    if (it != sessionsByToken.end()) {
-        uint64_t userId = it->second.userId;
-        sessionsByToken.erase(it);
-        
-        // Check if user has any other active sessions
-        bool hasOtherSessions = false;
-        for (const auto& pair : sessionsByToken) {
-            if (pair.second.userId == userId) {
-                hasOtherSessions = true;
-                break;
-            }
-        }
-        
-        // If no other sessions, mark user as offline
-        if (!hasOtherSessions) {
-            auto userIt = usersById.find(userId);
-            if (userIt != usersById.end()) {
-                userIt->second.isOnline = false;
-            }
-        }
-        
+    if (sessionsByToken.count(sessionToken) != 0) {
+        removeSession(sessionToken);
         printf("[AUTH] Session invalidated\n");
     }
 }
 
 void UserDatabase::UpdateSessionActivity(const std::string& sessionToken) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
+    expireSessions();
     
     auto it = sessionsByToken.find(sessionToken);
     if (it != sessionsByToken.end()) {
         it->second.UpdateActivity();
+        sessionExpiry.Schedule(sessionToken, static_cast<uint64_t>(it->second.expiresAt) * 1000);
+    }
+}
+
+size_t UserDatabase::ExpireSessions() {
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
+    return expireSessions();
+}
+
+void UserDatabase::addSession(const Models::Session& session) {
+    sessionsByToken[session.sessionToken] = session;
+    sessionExpiry.Schedule(session.sessionToken, static_cast<uint64_t>(session.expiresAt) * 1000);
+    
+    ++sessionCountByUserId[session.userId];
+    auto userIt = usersById.find(session.userId);
+    if (userIt != usersById.end()) {
+        userIt->second.isOnline = true;
     }
 }
 
+void UserDatabase::removeSession(const std::string& sessionToken) {
+    auto it = sessionsByToken.find(sessionToken);
+    if (it == sessionsByToken.end()) {
+        return;
+    }
+    uint64_t userId = it->second.userId;
+    sessionsByToken.erase(it);
+    sessionExpiry.Cancel(sessionToken);
+    
+    // Last session gone: the user is offline
+    auto count = sessionCountByUserId.find(userId);
+    if (count != sessionCountByUserId.end() && --count->second == 0) {
+        sessionCountByUserId.erase(count);
+        auto userIt = usersById.find(userId);
+        if (userIt != usersById.end()) {
+            userIt->second.isOnline = false;
+        }
+    }
+}
+
+size_t UserDatabase::expireSessions() {
+    std::vector<std::string> expired;
+    if (sessionExpiry.Advance(SessionClockMs(), expired) == 0) {
+        return 0;
+    }
+    
+    for (const std::string& token : expired) {
+        removeSession(token);
+    }
+    printf("[AUTH] %zu session(s) expired\n", expired.size());
+    return expired.size();
+}
+
 //=============================================================================
 // USER QUERIES
 //=============================================================================
 
 bool UserDatabase::GetUserById(uint64_t userId, Models::User& outUser) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
     
     auto it = usersById.find(userId);
     if (it == usersById.end()) {
@@ -239,8 +417,24 @@ bool UserDatabase::GetUserById(uint64_t userId, Models::User& outUser) {
     return true;
 }
 
+std::vector<UserDatabase::UserSummary> UserDatabase::GetUsersByIds(const uint64_t* userIds, size_t count) {
+    std::vector<UserSummary> results;
+    results.reserve(count);
+    
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    
+    for (size_t i = 0; i < count; ++i) {
+        auto it = usersById.find(userIds[i]);
+        if (it != usersById.end()) {
+            results.push_back({ it->first, it->second.username, it->second.isOnline });
+        }
+    }
+    
+    return results;
+}
+
 bool UserDatabase::GetUserByUsername(const std::string& username, Models::User& outUser) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
     
     auto usernameIt = userIdByUsername.find(username);
     if (usernameIt == userIdByUsername.end()) {
@@ -257,30 +451,69 @@ bool UserDatabase::GetUserByUsername(const std::string& username, Models::User&
 }
 
 bool UserDatabase::UsernameExists(const std::string& username) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
     return userIdByUsername.find(username) != userIdByUsername.end();
 }
 
-std::vector<Models::User> UserDatabase::SearchUsers(const std::string& prefix, size_t maxResults) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+uint64_t UserDatabase::GetUserIdByUsername(const std::string& username) {
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    auto usernameIt = userIdByUsername.find(username);
+    return usernameIt != userIdByUsername.end() ? usernameIt->second : 0;
+}
+
+std::vector<UserDatabase::UserMatch> UserDatabase::SearchUsers(const std::string& prefix,
+                                                               size_t maxResults) {
+    std::string foldedPrefix = FoldUsername(prefix);
+    std::vector<UserMatch> results;
+    
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    
+    // Every name starting with the prefix sorts in one run from lower_bound
+    for (auto it = usernameIndex.lower_bound(foldedPrefix);
+         it != usernameIndex.end() && results.size() < maxResults; ++it) {
+        if (it->first.compare(0, foldedPrefix.size(), foldedPrefix) != 0) {
+            break;
+        }
+        results.push_back(it->second);
+    }
     
-    std::vector<Models::User> results;
-    std::string lowerPrefix = prefix;
-    std::transform(lowerPrefix.begin(), lowerPrefix.end(), lowerPrefix.begin(), ::tolower);
+    return results;
+}
+
+void UserDatabase::indexUsername(uint64_t userId, const std::string& username) {
+    userIdByUsername[username] = userId;
+    usernameIndex.emplace(FoldUsername(username), UserMatch{ userId, username });
+}
+
+void UserDatabase::unindexUsername(uint64_t userId, const std::string& username) {
+    auto nameIt = userIdByUsername.find(username);
+    if (nameIt != userIdByUsername.end() && nameIt->second == userId) {
+        userIdByUsername.erase(nameIt);
+    }
     
+    auto range = usernameIndex.equal_range(FoldUsername(username));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.userId == userId) {
+            usernameIndex.erase(it);
+            break;
+        }
+    }
+}
+
+void UserDatabase::rebuildFriendPairs() {
+    friendPairs.clear();
     for (const auto& pair : usersById) {
-        if (results.size() >= maxResults) break;
-        
-        std::string lowerUsername = pair.second.username;
-        std::transform(lowerUsername.begin(), lowerUsername.end(), 
-                       lowerUsername.begin(), ::tolower);
-        
-        if (lowerUsername.find(lowerPrefix) == 0) {
-            results.push_back(pair.second);
+        for (uint64_t friendId : pair.second.friendIds) {
+            friendPairs.emplace(std::make_pair(pair.first, friendId), true);
         }
     }
-    
-    return results;
+}
+
+std::string UserDatabase::FoldUsername(const std::string& username) {
+    std::string folded = username;
+    std::transform(folded.begin(), folded.end(), folded.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return folded;
 }
 
 //=============================================================================
@@ -288,7 +521,7 @@ std::vector<Models::User> UserDatabase::SearchUsers(const std::string& prefix, s
 //=============================================================================
 
 void UserDatabase::SetUserOnlineStatus(uint64_t userId, bool isOnline) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
     
     auto it = usersById.find(userId);
     if (it != usersById.end()) {
@@ -296,8 +529,36 @@ void UserDatabase::SetUserOnlineStatus(uint64_t userId, bool isOnline) {
     }
 }
 
+Protocol::ErrorCode UserDatabase::RenameUser(uint64_t userId, const std::string& newUsername) {
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
+    
+    if (!Models::User::IsValidUsername(newUsername)) {
+        return Protocol::ErrorCode::InvalidUsername;
+    }
+    
+    auto userIt = usersById.find(userId);
+    if (userIt == usersById.end()) {
+        return Protocol::ErrorCode::UserNotFound;
+    }
+    
+    // A change of case only is allowed; anyone else's name is not
+    auto range = usernameIndex.equal_range(FoldUsername(newUsername));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.userId != userId) {
+            return Protocol::ErrorCode::UsernameAlreadyExists;
+        }
+    }
+    
+    unindexUsername(userId, userIt->second.username);
+    userIt->second.username = newUsername;
+    indexUsername(userId, newUsername);
+    
+    persistence.MarkDirty();
+    return Protocol::ErrorCode::None;
+}
+
 void UserDatabase::AddUserToServer(uint64_t userId, uint64_t serverId) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
     
     auto it = usersById.find(userId);
     if (it != usersById.end()) {
@@ -309,7 +570,7 @@ void UserDatabase::AddUserToServer(uint64_t userId, uint64_t serverId) {
 }
 
 void UserDatabase::RemoveUserFromServer(uint64_t userId, uint64_t serverId) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
     
     auto it = usersById.find(userId);
     if (it != usersById.end()) {
@@ -322,7 +583,7 @@ void UserDatabase::RemoveUserFromServer(uint64_t userId, uint64_t serverId) {
 }
 
 std::vector<uint64_t> UserDatabase::GetUserServers(uint64_t userId) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
     
     auto it = usersById.find(userId);
     if (it != usersById.end()) {
@@ -331,12 +592,40 @@ std::vector<uint64_t> UserDatabase::GetUserServers(uint64_t userId) {
     return {};
 }
 
+void UserDatabase::SyncServerMemberships(
+    const std::unordered_map<uint64_t, std::vector<uint64_t>>& serverIdsByMember) {
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
+    
+    size_t repaired = 0;
+    for (auto& pair : usersById) {
+        auto indexIt = serverIdsByMember.find(pair.first);
+        std::vector<uint64_t> expected;
+        if (indexIt != serverIdsByMember.end()) {
+            expected = indexIt->second;
+        }
+        
+        std::vector<uint64_t> current = pair.second.serverIds;
+        std::sort(current.begin(), current.end());
+        std::vector<uint64_t> sortedExpected = expected;
+        std::sort(sortedExpected.begin(), sortedExpected.end());
+        if (current != sortedExpected) {
+            pair.second.serverIds = std::move(expected);
+            ++repaired;
+        }
+    }
+    
+    if (repaired > 0) {
+        printf("[DB] Repaired server lists of %zu users\n", repaired);
+        persistence.MarkDirty();
+    }
+}
+
 //=============================================================================
 // FRIEND MANAGEMENT
 //=============================================================================
 
 void UserDatabase::AddFriendship(uint64_t userId1, uint64_t userId2) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
     
     // Add bidirectional friendship
     auto it1 = usersById.find(userId1);
@@ -346,19 +635,19 @@ void UserDatabase::AddFriendship(uint64_t userId1, uint64_t userId2) {
         auto& friends1 = it1->second.friendIds;
         auto& friends2 = it2->second.friendIds;
         
-        if (std::find(friends1.begin(), friends1.end(), userId2) == friends1.end()) {
+        if (friendPairs.emplace(std::make_pair(userId1, userId2), true).second) {
             friends1.push_back(userId2);
         }
-        if (std::find(friends2.begin(), friends2.end(), userId1) == friends2.end()) {
+        if (friendPairs.emplace(std::make_pair(userId2, userId1), true).second) {
             friends2.push_back(userId1);
         }
         
-        SaveToFile();
+        persistence.MarkDirty();
     }
 }
 
 void UserDatabase::RemoveFriendship(uint64_t userId1, uint64_t userId2) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
     
     auto it1 = usersById.find(userId1);
     auto it2 = usersById.find(userId2);
@@ -373,21 +662,25 @@ void UserDatabase::RemoveFriendship(uint64_t userId1, uint64_t userId2) {
         friends.erase(std::remove(friends.begin(), friends.end(), userId1), friends.end());
     }
     
-    SaveToFile();
+    friendPairs.erase(std::make_pair(userId1, userId2));
+    friendPairs.erase(std::make_pair(userId2, userId1));
+    persistence.MarkDirty();
 }
 
 bool UserDatabase::AreFriends(uint64_t userId1, uint64_t userId2) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
-    
-    auto it = usersById.find(userId1);
-    if (it == usersById.end()) return false;
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    return friendPairs.count(std::make_pair(userId1, userId2)) != 0;
+}
+
+size_t UserDatabase::GetFriendCount(uint64_t userId) {
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
     
-    const auto& friends = it->second.friendIds;
-    return std::find(friends.begin(), friends.end(), userId2) != friends.end();
+    auto it = usersById.find(userId);
+    return it != usersById.end() ? it->second.friendIds.size() : 0;
 }
 
 std::vector<Models::User> UserDatabase::GetFriends(uint64_t userId) {
-    std::lock_guard<std::mutex> lock(databaseMutex);
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
     
     std::vector<Models::User> friends;
     
@@ -404,6 +697,35 @@ std::vector<Models::User> UserDatabase::GetFriends(uint64_t userId) {
     return friends;
 }
 
+std::vector<uint64_t> UserDatabase::GetFriendIds(uint64_t userId) {
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    
+    auto it = usersById.find(userId);
+    if (it != usersById.end()) {
+        return it->second.friendIds;
+    }
+    return {};
+}
+
+std::vector<UserDatabase::UserSummary> UserDatabase::GetFriendSummaries(uint64_t userId) {
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    
+    std::vector<UserSummary> friends;
+    
+    auto it = usersById.find(userId);
+    if (it != usersById.end()) {
+        friends.reserve(it->second.friendIds.size());
+        for (uint64_t friendId : it->second.friendIds) {
+            auto friendIt = usersById.find(friendId);
+            if (friendIt != usersById.end()) {
+                friends.push_back({ friendIt->first, friendIt->second.username, friendIt->second.isOnline });
+            }
+        }
+    }
+    
+    return friends;
+}
+
 //=============================================================================
 // CRYPTOGRAPHIC HELPERS
 //=============================================================================
@@ -411,9 +733,9 @@ std::vector<Models::User> UserDatabase::GetFriends(uint64_t userId) {
 std::string UserDatabase::GenerateSecureRandom(size_t length) {
     std::vector<BYTE> buffer(length);
     
-    HCRYPTPROV hProvider = 0;
-    if (!CryptAcquireContextW(&hProvider, NULL, NULL, PROV_RSA_AES, 
-                               CRYPT_VERIFYCONTEXT)) {
+    // System RNG: no provider handle to acquire per call
+    if (BCryptGenRandom(nullptr, buffer.data(), static_cast<ULONG>(length),
+                        BCRYPT_USE_SYSTEM_PREFERRED_RNG) < 0) {
         // Fallback to less secure random if crypto provider unavailable
         std::random_device rd;
         std::mt19937 gen(rd());
@@ -421,9 +743,6 @@ std::string UserDatabase::GenerateSecureRandom(size_t length) {
         for (size_t i = 0; i < length; i++) {
             buffer[i] = static_cast<BYTE>(dis(gen));
         }
-    } else {
-        CryptGenRandom(hProvider, static_cast<DWORD>(length), buffer.data());
-        CryptReleaseContext(hProvider, 0);
     }
     
     // Convert to hex string
@@ -444,56 +763,6 @@ std::string UserDatabase::GenerateSessionToken() {
     return GenerateSecureRandom(32);  // 256-bit token
 }
 
-std::string UserDatabase::HashPassword(const std::string& password, const std::string& salt) {
-    // Combine salt and password
-    std::string combined = salt + password;
-    
-    HCRYPTPROV hProvider = 0;
-    HCRYPTHASH hHash = 0;
-    std::string result;
-    
-    if (!CryptAcquireContextW(&hProvider, NULL, NULL, PROV_RSA_AES, 
-                               CRYPT_VERIFYCONTEXT)) {
-        return "";
-    }
-    
-    if (!CryptCreateHash(hProvider, CALG_SHA_256, 0, 0, &hHash)) {
-        CryptReleaseContext(hProvider, 0);
-        return "";
-    }
-    
-    if (!CryptHashData(hHash, reinterpret_cast<const BYTE*>(combined.c_str()),
-                       static_cast<DWORD>(combined.length()), 0)) {
-        CryptDestroyHash(hHash);
-        CryptReleaseContext(hProvider, 0);
-        return "";
-    }
-    
-    DWORD hashLen = 32;  // SHA-256 = 32 bytes
-    std::vector<BYTE> hashBuffer(hashLen);
-    
-    if (!CryptGetHashParam(hHash, HP_HASHVAL, hashBuffer.data(), &hashLen, 0)) {
-        CryptDestroyHash(hHash);
-        CryptReleaseContext(hProvider, 0);
-        return "";
-    }
-    
-    CryptDestroyHash(hHash);
-    CryptReleaseContext(hProvider, 0);
-    
-    // Convert to hex string
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0');
-    for (BYTE b : hashBuffer) {
-        ss << std::setw(2) << static_cast<int>(b);
-    }
-    
-    // SECURITY: Clear the combined string from memory
-    SecureClearString(combined);
-    
-    return ss.str();
-}
-
 bool UserDatabase::ConstantTimeCompare(const std::string& a, const std::string& b) {
     if (a.length() != b.length()) {
         return false;
@@ -522,7 +791,149 @@ void UserDatabase::SecureClearString(std::string& str) {
 // PERSISTENCE
 //=============================================================================
 
+namespace {
+
+const char USER_SNAPSHOT_MAGIC[] = "CHUSERDB";
+constexpr uint32_t USER_SNAPSHOT_VERSION = 1;
+
+// id, username, createdAt, lastLoginAt, salt, hash, server and friend counts
+constexpr size_t MIN_USER_RECORD_SIZE = 8 + 4 + 8 + 8 + 4 + 4 + 4 + 4;
+
+} // namespace
+
 bool UserDatabase::SaveToFile() {
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    
+    // Snapshot payload (version 1):
+    //   [u32 count] then per user:
+    //   [u64 id][str username][i64 createdAt][i64 lastLoginAt][str salt][str hash]
+    //   [u32 n][u64 serverId]*n [u32 n][u64 friendId]*n
+    SnapshotWriter snapshot;
+    snapshot.PutU32(static_cast<uint32_t>(usersById.size()));
+    for (const auto& pair : usersById) {
+        const Models::User& user = pair.second;
+        snapshot.PutU64(user.userId);
+        snapshot.PutString(user.username);
+        snapshot.PutI64(user.createdAt);
+        snapshot.PutI64(user.lastLoginAt);
+        
+        auto passIt = passwordsByUserId.find(user.userId);
+        if (passIt != passwordsByUserId.end()) {
+            snapshot.PutString(passIt->second.salt);
+            snapshot.PutString(passIt->second.hash);
+        } else {
+            snapshot.PutString(std::string());
+            snapshot.PutString(std::string());
+        }
+        
+        snapshot.PutU32(static_cast<uint32_t>(user.serverIds.size()));
+        for (uint64_t serverId : user.serverIds) {
+            snapshot.PutU64(serverId);
+        }
+        snapshot.PutU32(static_cast<uint32_t>(user.friendIds.size()));
+        for (uint64_t friendId : user.friendIds) {
+            snapshot.PutU64(friendId);
+        }
+    }
+    
+    lock.unlock();
+    
+    // Write outside the lock so logins and lookups never wait on the disk
+    return snapshot.Commit(snapshotFilePath, USER_SNAPSHOT_MAGIC, USER_SNAPSHOT_VERSION);
+}
+
+bool UserDatabase::LoadFromFile() {
+    if (loadSnapshot()) {
+        return true;
+    }
+    
+    if (!importXml(databaseFilePath)) {
+        printf("[DB] No existing database found, starting fresh\n");
+        return false;
+    }
+    
+    // Migrated from XML; write a snapshot so the next start skips the DOM
+    persistence.MarkDirty();
+    return true;
+}
+
+bool UserDatabase::loadSnapshot() {
+    SnapshotReader snapshot;
+    if (!snapshot.Open(snapshotFilePath, USER_SNAPSHOT_MAGIC, USER_SNAPSHOT_VERSION)) {
+        return false;
+    }
+    
+    FlatHashMap<uint64_t, Models::User> users;
+    FlatHashMap<uint64_t, PasswordData> passwords;
+    
+    uint32_t userCount = snapshot.ReadCount(MIN_USER_RECORD_SIZE);
+    users.reserve(userCount);
+    passwords.reserve(userCount);
+    for (uint32_t i = 0; i < userCount && snapshot.Ok(); ++i) {
+        Models::User user;
+        user.userId = snapshot.ReadU64();
+        user.username = snapshot.ReadString();
+        user.createdAt = static_cast<std::time_t>(snapshot.ReadI64());
+        user.lastLoginAt = static_cast<std::time_t>(snapshot.ReadI64());
+        user.isOnline = false;  // Always start offline
+        
+        PasswordData passwordData;
+        passwordData.salt = snapshot.ReadString();
+        passwordData.hash = snapshot.ReadString();
+        
+        uint32_t serverCount = snapshot.ReadCount(sizeof(uint64_t));
+        user.serverIds.reserve(serverCount);
+        for (uint32_t s = 0; s < serverCount; ++s) {
+            user.serverIds.push_back(snapshot.ReadU64());
+        }
+        uint32_t friendCount = snapshot.ReadCount(sizeof(uint64_t));
+        user.friendIds.reserve(friendCount);
+        for (uint32_t f = 0; f < friendCount; ++f) {
+            user.friendIds.push_back(snapshot.ReadU64());
+        }
+        
+        if (!passwordData.salt.empty() && !passwordData.hash.empty()) {
+            passwords.emplace(user.userId, std::move(passwordData));
+        }
+        users.emplace(user.userId, std::move(user));
+    }
+    
+    if (!snapshot.Ok() || !snapshot.AtEnd()) {
+        printf("[DB] User snapshot %s is truncated, falling back to XML\n", snapshotFilePath.c_str());
+        return false;
+    }
+    
+    usersById = std::move(users);
+    passwordsByUserId = std::move(passwords);
+    userIdByUsername.clear();
+    usernameIndex.clear();
+    for (const auto& pair : usersById) {
+        indexUsername(pair.first, pair.second.username);
+    }
+    rebuildFriendPairs();
+    
+    printf("[DB] Loaded %zu users from snapshot\n", usersById.size());
+    return true;
+}
+
+bool UserDatabase::ImportXml(const std::string& xmlPath) {
+    std::lock_guard<std::shared_mutex> lock(databaseMutex);
+    
+    usersById.clear();
+    userIdByUsername.clear();
+    usernameIndex.clear();
+    passwordsByUserId.clear();
+    friendPairs.clear();
+    if (!importXml(xmlPath)) {
+        return false;
+    }
+    persistence.MarkDirty();
+    return true;
+}
+
+bool UserDatabase::ExportXml(const std::string& xmlPath) const {
+    std::shared_lock<std::shared_mutex> lock(databaseMutex);
+    
     pugi::xml_document doc;
     pugi::xml_node root = doc.append_child("UserDatabase");
     
@@ -559,15 +970,16 @@ bool UserDatabase::SaveToFile() {
         }
     }
     
-    return doc.save_file(databaseFilePath.c_str());
+    lock.unlock();
+    
+    return PersistenceWorker::WriteXmlAtomically(doc, xmlPath);
 }
 
-bool UserDatabase::LoadFromFile() {
+bool UserDatabase::importXml(const std::string& xmlPath) {
     pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_file(databaseFilePath.c_str());
+    pugi::xml_parse_result result = doc.load_file(xmlPath.c_str());
     
     if (!result) {
-        printf("[DB] No existing database found, starting fresh\n");
         return false;
     }
     
@@ -606,9 +1018,10 @@ bool UserDatabase::LoadFromFile() {
         }
         
         usersById[user.userId] = user;
-        userIdByUsername[user.username] = user.userId;
+        indexUsername(user.userId, user.username);
     }
+    rebuildFriendPairs();
     
-    printf("[DB] Loaded %zu users from database\n", usersById.size());
+    printf("[DB] Imported %zu users from %s\n", usersById.size(), xmlPath.c_str());
     return true;
 }
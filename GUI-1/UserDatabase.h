@@ -8,10 +8,13 @@
  * SECURITY IMPLEMENTATION:
  * 
  * 1. PASSWORD HASHING:
- *    - Passwords are hashed using SHA-256 with per-user salt
+ *    - PBKDF2-HMAC-SHA256 with a per-user salt and a tunable iteration
+ *      count (see PasswordHasher.h)
  *    - Salt is 32 random bytes, generated securely
- *    - Hash = SHA256(salt + password)
- *    - In production: Use bcrypt/Argon2 instead (requires external lib)
+ *    - Legacy SHA256(salt + password) hashes are still accepted and are
+ *      upgraded on the next successful login
+ *    - Hashing never runs under databaseMutex; the *Async calls run it on
+ *      a bounded worker pool so the UI thread never waits for it
  * 
  * 2. CONSTANT-TIME COMPARISON:
  *    - Password verification uses constant-time comparison
@@ -25,19 +28,31 @@
  *    - Generated using cryptographically secure random
  *    - 256 bits of entropy
  *    - Tokens are hashed before storage (optional)
+ *    - Expiry runs on a timing wheel, so an expired session is removed
+ *      (and its user marked offline) without scanning the session table
  * 
  * STORAGE:
- *    Uses XML for simplicity (pugixml already in project)
+ *    A binary snapshot ("<name>.bin", see BinarySnapshot.h) loaded without
+ *    building a DOM. XML stays as the import/export format; a legacy XML
+ *    database is imported once on first start.
  *    In production: Use encrypted SQLite or similar
  */
 
+#include <functional>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include "Models.h"
 #include "Protocol.h"
+#include "PersistenceWorker.h"
+#include "BinarySnapshot.h"
+#include "FlatHashMap.h"
+#include "TimingWheel.h"
+#include "PasswordHasher.h"
 #include "pugixml.hpp"
 
 class UserDatabase {
@@ -45,8 +60,10 @@ public:
     /**
      * @brief Initialize the database with the given file path
      * @param databasePath Path to the XML database file
+     * @param loadNow False to leave loading to a LoadFromFile() call, which
+     *        must finish before any other method is used
      */
-    explicit UserDatabase(const std::string& databasePath);
+    explicit UserDatabase(const std::string& databasePath, bool loadNow = true);
     
     ~UserDatabase();
     
@@ -92,6 +109,40 @@ public:
         Models::Session& outSession
     );
     
+    /** @brief Completion of RegisterUserAsync() */
+    using RegisterCallback = std::function<void(Protocol::ErrorCode result, uint64_t userId)>;
+    
+    /** @brief Completion of AuthenticateUserAsync() */
+    using AuthenticateCallback = std::function<void(Protocol::ErrorCode result, const Models::Session& session)>;
+    
+    /**
+     * @brief RegisterUser() with the password hashed on the worker pool
+     *
+     * Returns at once. done runs on a hashing thread, so post UI work to
+     * the UI thread. If the pool is saturated, done runs immediately on
+     * this thread with RateLimited.
+     */
+    void RegisterUserAsync(const std::string& username, const std::string& password, RegisterCallback done);
+    
+    /**
+     * @brief AuthenticateUser() with the password checked on the worker pool
+     *
+     * Same threading as RegisterUserAsync().
+     */
+    void AuthenticateUserAsync(const std::string& username, const std::string& password, AuthenticateCallback done);
+    
+    /**
+     * @brief Set the PBKDF2 iteration count for new and upgraded hashes
+     *
+     * Rebuilds the unknown-user dummy hash at the new cost before returning.
+     */
+    void SetPasswordWorkFactor(uint32_t iterations);
+    
+    /**
+     * @brief Latency histogram of password jobs (queue wait + hashing)
+     */
+    PasswordHasher::Timings GetLoginTimings() const { return passwordHasher.GetTimings(); }
+    
     /**
      * @brief Validate a session token
      * 
@@ -113,6 +164,17 @@ public:
      */
     void UpdateSessionActivity(const std::string& sessionToken);
     
+    /**
+     * @brief Remove every session past its expiry time
+     * 
+     * Users left without a session are marked offline. The session calls
+     * above already do this lazily; a host with a periodic tick may call
+     * it directly. Costs O(1) per tick plus the sessions that expired.
+     * 
+     * @return Number of sessions removed
+     */
+    size_t ExpireSessions();
+    
     // =========================================================================
     // USER QUERIES
     // =========================================================================
@@ -133,6 +195,31 @@ public:
      */
     bool GetUserByUsername(const std::string& username, Models::User& outUser);
     
+    /**
+     * @brief What a member list shows about one user
+     */
+    struct UserSummary {
+        uint64_t userId;
+        std::string username;
+        bool isOnline;
+    };
+    
+    /**
+     * @brief Look up several users under one lock
+     *
+     * Copies only the fields a member list needs instead of a full
+     * Models::User (with its ID vectors) per user.
+     *
+     * @param userIds IDs to look up
+     * @param count Number of IDs
+     * @return One entry per ID found, in input order
+     */
+    std::vector<UserSummary> GetUsersByIds(const uint64_t* userIds, size_t count);
+    
+    std::vector<UserSummary> GetUsersByIds(const std::vector<uint64_t>& userIds) {
+        return GetUsersByIds(userIds.data(), userIds.size());
+    }
+    
     /**
      * @brief Check if a username exists
      * @param username The username to check
@@ -141,12 +228,31 @@ public:
     bool UsernameExists(const std::string& username);
     
     /**
-     * @brief Search for users by username prefix
+     * @brief Get the ID registered under a username
+     * @param username Username to look up (exact case)
+     * @return The user's ID, or 0 if no such user
+     */
+    uint64_t GetUserIdByUsername(const std::string& username);
+    
+    /**
+     * @brief One SearchUsers() hit
+     */
+    struct UserMatch {
+        uint64_t userId;
+        std::string username;
+    };
+    
+    /**
+     * @brief Search for users by case-insensitive username prefix
+     *
+     * Walks a sorted index, so it costs O(log n + results) no matter how
+     * many users exist.
+     *
      * @param prefix The search prefix
      * @param maxResults Maximum results to return
-     * @return List of matching users
+     * @return Matches in case-insensitive alphabetical order
      */
-    std::vector<Models::User> SearchUsers(const std::string& prefix, size_t maxResults = 20);
+    std::vector<UserMatch> SearchUsers(const std::string& prefix, size_t maxResults = 20);
     
     // =========================================================================
     // USER UPDATES
@@ -159,6 +265,14 @@ public:
      */
     void SetUserOnlineStatus(uint64_t userId, bool isOnline);
     
+    /**
+     * @brief Change a user's username
+     * @param userId The user ID
+     * @param newUsername The new username (case-insensitively unique)
+     * @return ErrorCode::None on success
+     */
+    Protocol::ErrorCode RenameUser(uint64_t userId, const std::string& newUsername);
+    
     /**
      * @brief Add a server to user's server list
      * @param userId The user ID
@@ -180,6 +294,13 @@ public:
      */
     std::vector<uint64_t> GetUserServers(uint64_t userId);
     
+    /**
+     * @brief Make every user's server list match ServerManager's index
+     * @param serverIdsByMember User ID -> server IDs; users not listed belong to none
+     */
+    void SyncServerMemberships(
+        const std::unordered_map<uint64_t, std::vector<uint64_t>>& serverIdsByMember);
+    
     // =========================================================================
     // FRIEND MANAGEMENT
     // =========================================================================
@@ -200,12 +321,20 @@ public:
     
     /**
      * @brief Check if two users are friends
+     *
+     * One hash lookup in the friendship index, whatever the friend counts.
+     *
      * @param userId1 First user
      * @param userId2 Second user
      * @return True if they are friends
      */
     bool AreFriends(uint64_t userId1, uint64_t userId2);
     
+    /**
+     * @brief Number of friends a user has (for the friend limit)
+     */
+    size_t GetFriendCount(uint64_t userId);
+    
     /**
      * @brief Get user's friend list
      * @param userId The user ID
@@ -213,40 +342,125 @@ public:
      */
     std::vector<Models::User> GetFriends(uint64_t userId);
     
+    /**
+     * @brief Get a user's friend IDs, without copying any friend's record
+     * @param userId The user ID
+     * @return Friend IDs, in the order the friendships were made
+     */
+    std::vector<uint64_t> GetFriendIds(uint64_t userId);
+    
+    /**
+     * @brief Get the fields a friend list shows, under one lock
+     * @param userId The user ID
+     * @return One summary per friend
+     */
+    std::vector<UserSummary> GetFriendSummaries(uint64_t userId);
+    
     // =========================================================================
     // PERSISTENCE
     // =========================================================================
     
     /**
-     * @brief Save all data to disk
+     * @brief Save all data to disk now
+     *
+     * Mutating calls only mark the database dirty; the persistence worker
+     * calls this. Takes databaseMutex, so never call it while holding it.
+     *
      * @return True on success
      */
     bool SaveToFile();
     
     /**
-     * @brief Load data from disk
+     * @brief Load data from disk (the snapshot, else the legacy XML file)
      * @return True on success
      */
     bool LoadFromFile();
     
+    /**
+     * @brief Replace every user with the contents of an XML database
+     * @return True on success
+     */
+    bool ImportXml(const std::string& xmlPath);
+    
+    /**
+     * @brief Write every user to an XML database
+     * @return True on success
+     */
+    bool ExportXml(const std::string& xmlPath) const;
+    
 private:
-    // Database file path
+    // Database file paths: legacy XML (import only) and the binary snapshot
     std::string databaseFilePath;
+    std::string snapshotFilePath;
     
     // In-memory data
-    std::map<uint64_t, Models::User> usersById;
-    std::map<std::string, uint64_t> userIdByUsername;
-    std::map<std::string, Models::Session> sessionsByToken;
+    FlatHashMap<uint64_t, Models::User> usersById;
+    FlatHashMap<std::string, uint64_t> userIdByUsername;
+    
+    // Case-folded username -> match, for prefix search and duplicate checks
+    std::multimap<std::string, UserMatch> usernameIndex;
+    
+    // (user, friend) for every entry of every friendIds, for AreFriends
+    FlatHashMap<std::pair<uint64_t, uint64_t>, bool> friendPairs;
+    FlatHashMap<std::string, Models::Session> sessionsByToken;
+    
+    // Session token -> expiresAt, and live sessions per user, so expiry and
+    // logout never scan sessionsByToken
+    TimingWheel<std::string> sessionExpiry;
+    FlatHashMap<uint64_t, uint32_t> sessionCountByUserId;
+    static constexpr uint64_t SESSION_EXPIRY_TICK_MS = 1000;
     
     // Password hashes stored separately for isolation
     struct PasswordData {
         std::string salt;        // Base64 encoded
-        std::string hash;        // Base64 encoded
+        std::string hash;        // PasswordHasher format (PBKDF2 or legacy SHA-256)
     };
-    std::map<uint64_t, PasswordData> passwordsByUserId;
+    FlatHashMap<uint64_t, PasswordData> passwordsByUserId;
+    
+    // Verified against when the username is unknown, so that answer costs
+    // the same PBKDF2 run as a wrong password. Built whenever the work
+    // factor is set (see rebuildDummyPassword()), never during a login
+    PasswordData dummyPasswordData;
+    std::mutex dummyPasswordMutex;
+    
+    // Thread safety: lookups share the lock, anything that writes takes it alone
+    mutable std::shared_mutex databaseMutex;
+    
+    // Password hashing, outside databaseMutex (stopped before persistence closes)
+    PasswordHasher passwordHasher;
+    
+    // Batches writes off the calling thread (declared last: its save reads the state above)
+    PersistenceWorker::Handle persistence;
+    
+    // Registration and login in three steps, so the password work between
+    // them runs without databaseMutex. Each step takes the lock itself.
+    Protocol::ErrorCode checkRegistration(const std::string& username, const std::string& password);
+    Protocol::ErrorCode completeRegistration(const std::string& username, const std::string& salt,
+                                             const std::string& hash, uint64_t& outUserId);
+    Protocol::ErrorCode beginAuthentication(const std::string& username, uint64_t& outUserId,
+                                            PasswordData& outStored);
+    Protocol::ErrorCode completeAuthentication(const std::string& username, uint64_t userId,
+                                               const std::string& verifiedHash, const std::string& upgradedHash,
+                                               Models::Session& outSession);
+    Protocol::ErrorCode runRegistration(const std::string& username, std::string& password, uint64_t& outUserId);
+    Protocol::ErrorCode runAuthentication(const std::string& username, std::string& password,
+                                          Models::Session& outSession);
+    void rebuildDummyPassword();
+    
+    // Helpers below expect databaseMutex to be held (or the constructor to be running)
+    bool loadSnapshot();
+    bool importXml(const std::string& xmlPath);
+    void indexUsername(uint64_t userId, const std::string& username);
+    void unindexUsername(uint64_t userId, const std::string& username);
+    void rebuildFriendPairs();
+    void addSession(const Models::Session& session);
+    void removeSession(const std::string& sessionToken);
+    size_t expireSessions();
     
-    // Thread safety
-    mutable std::mutex databaseMutex;
+    /**
+     * @brief Lowercase a username for case-insensitive comparison
+     */
+    static std::string FoldUsername(const std::string& username);
     
     // =========================================================================
     // CRYPTOGRAPHIC HELPERS (Private)
@@ -271,17 +485,6 @@ private:
      */
     static std::string GenerateSessionToken();
     
-    /**
-     * @brief Hash a password with salt
-     * 
-     * NOTE: Uses SHA-256 for simplicity. In production, use bcrypt/Argon2.
-     * 
-     * @param password The plaintext password
-     * @param salt The salt to use
-     * @return Hex-encoded hash
-     */
-    static std::string HashPassword(const std::string& password, const std::string& salt);
-    
     /**
      * @brief Constant-time string comparison
      * 
@@ -32,6 +32,8 @@ For any inquiries, please contact: **Thomas Isherwood**
 #include <winsock2.h>
 #include "MainWindow.h"
 #include "pugixml.hpp"
+#include "Trace.h"
+#include "Log.h"
 
 /*! \brief Entry point for the application
  *
@@ -48,6 +50,11 @@ For any inquiries, please contact: **Thomas Isherwood**
         return 1;
     }
 
+    // Enable FLTK thread support so the server network thread can
+    // hand display updates back via Fl::awake()
+    Fl::lock();
+    Trace::SetThreadName("ui");
+
     // Create the main window
     MainWindow* mainWindow = new MainWindow(1100, 800);
 
@@ -57,6 +64,9 @@ For any inquiries, please contact: **Thomas Isherwood**
     // Run the FLTK event loop
     int result = Fl::run();
 
+    // Write out anything still queued for the console
+    Log::Shutdown();
+
     // Clean up Winsock before exiting
     WSACleanup();
 
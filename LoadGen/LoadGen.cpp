@@ -0,0 +1,787 @@
+/**
+ * @file LoadGen.cpp
+ * @brief Load generator for a ServerSocket host
+ *
+ * PURPOSE:
+ * Gives every scaling change a repeatable baseline: opens N connections
+ * to a running host, joins them all to one channel, has each send chat
+ * messages at a fixed rate, and reports throughput plus connect time and
+ * end-to-end latency percentiles.
+ *
+ * DESIGN:
+ * - Speaks the real protocol: NetProtocol framing, HELLO/WELCOME, then
+ *   JoinChannel/SendMessage/Heartbeat request envelopes
+ * - Each message carries "LG <client> <seq> <sentUs>"; every copy the
+ *   server fans back out is timed against the same process clock, so a
+ *   sample is one delivery (send -> server -> subscriber)
+ * - One thread drives every socket through WSAPoll (poll() elsewhere);
+ *   sends are buffered per connection so a full socket never stalls the
+ *   others
+ * - Builds on Windows and Linux (NetPlatform.h), so each server backend
+ *   can be measured from the same tool
+ * - Latencies go into a log-bucketed histogram (under 1% error), so a
+ *   long run costs constant memory
+ *
+ * REPLAY:
+ * --replay sends a TrafficCapture recorded by a host (/capture) instead
+ * of synthetic chat: one connection per captured connection, each frame
+ * verbatim, at the recorded pace times --speed, or as fast as the server
+ * reads them with --speed 0. Connections captured mid-session get a
+ * generated HELLO first. Reported latencies are request -> response
+ * (matched by requestId) and chat line -> the sender's own fanned-out
+ * copy; "lag" is how far the driver fell behind the recorded schedule.
+ *
+ * USAGE:
+ *   LoadGen --host 127.0.0.1 --port 54000 --clients 100 --rate 5
+ *           --duration 30 --channel <channelId> [--size 64] [--name lg]
+ *   LoadGen --host 127.0.0.1 --port 54000 --replay capture.cap [--speed 1]
+ *
+ * NOTE: The server limits each user to ServerSocket::RateLimits::
+ * userMessages (10/s by default); rates above that measure the limiter.
+ */
+
+#include "NetProtocol.h"
+#include "FrameBuffer.h"
+#include "Protocol.h"
+#include "ProtocolCodec.h"
+#include "LatencyHistogram.h"
+#include "TrafficCapture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+//=============================================================================
+// OPTIONS
+//=============================================================================
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 54000;
+    int clients = 10;
+    double rate = 1.0;          // Messages per second per client (0 = connect only)
+    int durationSeconds = 10;
+    uint64_t channelId = 1;
+    size_t messageSize = 64;    // Bytes of content per message, at least the stamp
+    std::string name = "lg";    // Username prefix; client i is "<name>_<i>"
+    std::string replayPath;     // Capture to replay instead of synthetic load
+    double speed = 1.0;         // Replay pace relative to the capture (0 = as fast as possible)
+};
+
+void PrintUsage() {
+    printf("Usage: LoadGen [--host ip] [--port n] [--clients n] [--rate msgs/s/client]\n"
+           "               [--duration s] [--channel id] [--size bytes] [--name prefix]\n"
+           "       LoadGen [--host ip] [--port n] --replay capture.cap [--speed x] [--name prefix]\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        if (key == "--help" || key == "-h") {
+            return false;
+        }
+        if (i + 1 >= argc) {
+            printf("[LOADGEN] Missing value for %s\n", key.c_str());
+            return false;
+        }
+        const char* value = argv[++i];
+        if (key == "--host")          options.host = value;
+        else if (key == "--port")     options.port = std::atoi(value);
+        else if (key == "--clients")  options.clients = std::atoi(value);
+        else if (key == "--rate")     options.rate = std::atof(value);
+        else if (key == "--duration") options.durationSeconds = std::atoi(value);
+        else if (key == "--channel")  options.channelId = std::strtoull(value, nullptr, 10);
+        else if (key == "--size")     options.messageSize = static_cast<size_t>(std::atoi(value));
+        else if (key == "--name")     options.name = value;
+        else if (key == "--replay")   options.replayPath = value;
+        else if (key == "--speed")    options.speed = std::atof(value);
+        else {
+            printf("[LOADGEN] Unknown option %s\n", key.c_str());
+            return false;
+        }
+    }
+    if (options.port <= 0 || options.port > 65535 || options.clients <= 0 ||
+        options.rate < 0 || options.durationSeconds <= 0 || options.channelId == 0 || options.speed < 0) {
+        printf("[LOADGEN] Invalid option value\n");
+        return false;
+    }
+    return true;
+}
+
+//=============================================================================
+// CLOCK
+//=============================================================================
+
+uint64_t NowUs() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+//=============================================================================
+// CONNECTIONS
+//=============================================================================
+
+enum class State { Handshaking, Running, Closed };
+
+struct Connection {
+    SOCKET socket = INVALID_SOCKET;
+    State state = State::Closed;
+    int index = 0;
+    uint32_t version = 0;
+    uint64_t connectStartUs = 0;
+    uint64_t nextSendUs = 0;
+    uint64_t lastSendUs = 0;
+    uint64_t sequence = 0;
+    NetProtocol::FrameDecoder decoder;
+    std::string outbound;           // Framed bytes not yet accepted by send()
+    size_t outboundOffset = 0;
+};
+
+struct Totals {
+    uint64_t connectFailures = 0;
+    uint64_t handshakeFailures = 0;
+    uint64_t disconnects = 0;
+    uint64_t sent = 0;
+    uint64_t delivered = 0;
+    uint64_t serverNotices = 0;
+    LatencyHistogram connectUs;
+    LatencyHistogram latencyUs;
+};
+
+void CloseConnection(Connection& c, Totals& totals) {
+    if (c.socket != INVALID_SOCKET) {
+        closesocket(c.socket);
+        c.socket = INVALID_SOCKET;
+    }
+    if (c.state == State::Handshaking) {
+        ++totals.handshakeFailures;
+    }
+    else if (c.state == State::Running) {
+        ++totals.disconnects;
+    }
+    c.state = State::Closed;
+}
+
+template <typename Conn>
+void QueueFrame(Conn& c, const std::string& payload) {
+    NetProtocol::FrameBuffer frame = NetProtocol::FrameBuffer::Encode(payload);
+    c.outbound.append(frame.data(), frame.size());
+}
+
+/** @brief Push buffered bytes until the socket would block */
+template <typename Conn>
+bool FlushOutbound(Conn& c) {
+    while (c.outboundOffset < c.outbound.size()) {
+        int length = static_cast<int>((std::min)(c.outbound.size() - c.outboundOffset, size_t(1) << 20));
+        int sent = send(c.socket, c.outbound.data() + c.outboundOffset, length, 0);
+        if (sent == SOCKET_ERROR) {
+            return NetProtocol::IsWouldBlock(NetProtocol::LastSocketError());
+        }
+        c.outboundOffset += static_cast<size_t>(sent);
+    }
+    c.outbound.clear();
+    c.outboundOffset = 0;
+    return true;
+}
+
+bool OpenConnection(const Options& options, const sockaddr_in& address, Connection& c) {
+    c.connectStartUs = NowUs();
+    c.socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (c.socket == INVALID_SOCKET) {
+        return false;
+    }
+    if (connect(c.socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR) {
+        closesocket(c.socket);
+        c.socket = INVALID_SOCKET;
+        return false;
+    }
+    NetProtocol::ConfigureSocket(c.socket);
+    NetProtocol::SetNonBlocking(c.socket);
+
+    c.state = State::Handshaking;
+    QueueFrame(c, NetProtocol::BuildHello(NetProtocol::PROTOCOL_VERSION,
+                                          options.name + "_" + std::to_string(c.index)));
+    return true;
+}
+
+std::string BuildContent(const Options& options, Connection& c, uint64_t nowUs) {
+    std::string content = "LG " + std::to_string(c.index) + " " + std::to_string(c.sequence++) +
+                          " " + std::to_string(nowUs) + " ";
+    if (content.size() < options.messageSize) {
+        content.append(options.messageSize - content.size(), 'x');
+    }
+    return content;
+}
+
+/** @brief Time one delivered copy of a load-generator message */
+bool RecordDelivery(const std::string& frame, uint64_t nowUs, Totals& totals, bool measuring) {
+    size_t stamp = frame.find(": LG ");
+    if (stamp == std::string::npos) {
+        return false;
+    }
+    const char* cursor = frame.c_str() + stamp + 5;
+    char* end = nullptr;
+    std::strtoull(cursor, &end, 10);            // Sender index
+    std::strtoull(end, &end, 10);               // Sequence
+    uint64_t sentUs = std::strtoull(end, &end, 10);
+    if (sentUs == 0 || sentUs > nowUs) {
+        return false;
+    }
+    ++totals.delivered;
+    if (measuring) {
+        totals.latencyUs.Record(nowUs - sentUs);
+    }
+    return true;
+}
+
+void HandleFrame(const Options& options, Connection& c, const std::string& frame, uint64_t nowUs,
+                 Totals& totals, bool measuring) {
+    if (c.state == State::Handshaking) {
+        if (!NetProtocol::ParseWelcome(frame, c.version)) {
+            printf("[LOADGEN] Client %d rejected: %s\n", c.index, frame.c_str());
+            CloseConnection(c, totals);
+            return;
+        }
+        if (c.version < NetProtocol::ENVELOPE_PROTOCOL_VERSION) {
+            printf("[LOADGEN] Client %d: server speaks protocol %u, envelopes need %u\n",
+                   c.index, c.version, NetProtocol::ENVELOPE_PROTOCOL_VERSION);
+            CloseConnection(c, totals);
+            return;
+        }
+        if (c.version >= NetProtocol::COMPRESSION_PROTOCOL_VERSION) {
+            c.decoder.EnableCompression();
+        }
+        totals.connectUs.Record(nowUs - c.connectStartUs);
+
+        Protocol::Payloads::ChannelSubscriptionRequest join;
+        join.channelId = options.channelId;
+        QueueFrame(c, Protocol::Wire::EncodeRequest(Protocol::RequestType::JoinChannel,
+                                                    Protocol::GenerateRequestId(), join));
+        c.state = State::Running;
+        c.lastSendUs = nowUs;
+        return;
+    }
+
+    if (RecordDelivery(frame, nowUs, totals, measuring)) {
+        return;
+    }
+    if (frame.rfind("[SERVER]:", 0) == 0) {
+        ++totals.serverNotices;
+    }
+}
+
+//=============================================================================
+// RUN
+//=============================================================================
+
+void PrintLatency(const char* label, const LatencyHistogram& histogram) {
+    printf("%-12s n=%llu  p50=%.3f ms  p99=%.3f ms  p999=%.3f ms  max=%.3f ms\n", label,
+           static_cast<unsigned long long>(histogram.Count()),
+           histogram.Percentile(0.50) / 1000.0, histogram.Percentile(0.99) / 1000.0,
+           histogram.Percentile(0.999) / 1000.0, histogram.Max() / 1000.0);
+}
+
+bool ResolveAddress(const Options& options, sockaddr_in& address) {
+    address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<u_short>(options.port));
+    if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) <= 0) {
+        printf("[LOADGEN] Invalid address %s\n", options.host.c_str());
+        return false;
+    }
+    return true;
+}
+
+int Run(const Options& options) {
+    sockaddr_in address;
+    if (!ResolveAddress(options, address)) {
+        return 1;
+    }
+
+    Totals totals;
+    std::vector<Connection> connections(static_cast<size_t>(options.clients));
+    std::vector<NetProtocol::PollFd> pollSet;
+    std::vector<size_t> pollOwner;
+
+    printf("[LOADGEN] Opening %d connections to %s:%d\n", options.clients, options.host.c_str(), options.port);
+    for (size_t i = 0; i < connections.size(); ++i) {
+        connections[i].index = static_cast<int>(i);
+        if (!OpenConnection(options, address, connections[i])) {
+            ++totals.connectFailures;
+        }
+    }
+
+    const uint64_t intervalUs = options.rate > 0 ? static_cast<uint64_t>(1000000.0 / options.rate) : 0;
+    const uint64_t heartbeatUs = static_cast<uint64_t>(NetProtocol::HEARTBEAT_INTERVAL_MS) * 1000;
+    const uint64_t handshakeDeadlineUs = NowUs() + static_cast<uint64_t>(NetProtocol::HANDSHAKE_TIMEOUT_MS) * 1000;
+    const uint64_t drainUs = 2000000;       // Collect deliveries still in flight after the last send
+
+    uint64_t startUs = 0;                   // Set once every handshake has finished
+    uint64_t stopSendingUs = 0;
+    std::string frame;
+
+    for (;;) {
+        uint64_t nowUs = NowUs();
+
+        // Start measuring when no connection is still negotiating
+        if (startUs == 0) {
+            bool pending = false;
+            for (Connection& c : connections) {
+                if (c.state == State::Handshaking) {
+                    if (nowUs >= handshakeDeadlineUs) {
+                        printf("[LOADGEN] Client %d: handshake timed out\n", c.index);
+                        CloseConnection(c, totals);
+                    }
+                    else {
+                        pending = true;
+                    }
+                }
+            }
+            if (!pending) {
+                startUs = nowUs;
+                stopSendingUs = startUs + static_cast<uint64_t>(options.durationSeconds) * 1000000;
+                // Spread first sends over one interval so they do not arrive in lockstep
+                for (Connection& c : connections) {
+                    c.nextSendUs = startUs + (intervalUs * c.index) / connections.size();
+                }
+                printf("[LOADGEN] Running for %d s\n", options.durationSeconds);
+            }
+        }
+
+        bool sending = startUs != 0 && nowUs < stopSendingUs;
+        if (startUs != 0 && nowUs >= stopSendingUs + drainUs) {
+            break;
+        }
+
+        size_t open = 0;
+        for (Connection& c : connections) {
+            if (c.state != State::Running) {
+                continue;
+            }
+            if (sending && intervalUs != 0) {
+                while (c.nextSendUs <= nowUs) {
+                    Protocol::Payloads::SendMessageRequest message;
+                    message.channelId = options.channelId;
+                    message.content = BuildContent(options, c, nowUs);
+                    QueueFrame(c, Protocol::Wire::EncodeRequest(Protocol::RequestType::SendMessage,
+                                                                Protocol::GenerateRequestId(), message));
+                    c.nextSendUs += intervalUs;
+                    c.lastSendUs = nowUs;
+                    ++totals.sent;
+                }
+            }
+            if (c.version >= NetProtocol::HEARTBEAT_PROTOCOL_VERSION && nowUs - c.lastSendUs >= heartbeatUs) {
+                QueueFrame(c, Protocol::Wire::EncodeRequest(Protocol::RequestType::Heartbeat,
+                                                            Protocol::GenerateRequestId()));
+                c.lastSendUs = nowUs;
+            }
+        }
+
+        pollSet.clear();
+        pollOwner.clear();
+        for (size_t i = 0; i < connections.size(); ++i) {
+            Connection& c = connections[i];
+            if (c.state == State::Closed) {
+                continue;
+            }
+            if (!FlushOutbound(c)) {
+                CloseConnection(c, totals);
+                continue;
+            }
+            NetProtocol::PollFd entry = {};
+            entry.fd = c.socket;
+            entry.events = POLLRDNORM | (c.outbound.empty() ? 0 : POLLWRNORM);
+            pollSet.push_back(entry);
+            pollOwner.push_back(i);
+            ++open;
+        }
+        if (open == 0 && startUs != 0) {
+            printf("[LOADGEN] No connections left\n");
+            break;
+        }
+
+        // Short waits keep the send schedule within about a millisecond
+        if (!pollSet.empty() && NetProtocol::PollSockets(pollSet.data(), pollSet.size(), 1) == SOCKET_ERROR) {
+            printf("[LOADGEN] Poll failed: %d\n", NetProtocol::LastSocketError());
+            break;
+        }
+
+        nowUs = NowUs();
+        bool measuring = startUs != 0;
+        for (size_t p = 0; p < pollSet.size(); ++p) {
+            Connection& c = connections[pollOwner[p]];
+            if ((pollSet[p].revents & (POLLRDNORM | POLLERR | POLLHUP)) == 0) {
+                continue;
+            }
+            NetProtocol::Result result;
+            while ((result = NetProtocol::ReceiveMessage(c.socket, c.decoder, frame)) == NetProtocol::Result::Success) {
+                HandleFrame(options, c, frame, nowUs, totals, measuring);
+                if (c.state == State::Closed) {
+                    break;
+                }
+            }
+            if (c.state != State::Closed && result != NetProtocol::Result::WouldBlock) {
+                printf("[LOADGEN] Client %d: %s\n", c.index, NetProtocol::ResultToString(result));
+                CloseConnection(c, totals);
+            }
+        }
+    }
+
+    double seconds = options.durationSeconds;
+    size_t connected = static_cast<size_t>(totals.connectUs.Count());
+    printf("\n=== LoadGen results ===\n");
+    printf("clients      %d requested, %zu connected, %llu connect failures, %llu handshake failures, %llu dropped\n",
+           options.clients, connected,
+           static_cast<unsigned long long>(totals.connectFailures),
+           static_cast<unsigned long long>(totals.handshakeFailures),
+           static_cast<unsigned long long>(totals.disconnects));
+    printf("sent         %llu messages (%.1f msg/s)\n",
+           static_cast<unsigned long long>(totals.sent), totals.sent / seconds);
+    printf("delivered    %llu copies (%.1f msg/s), %llu server notices\n",
+           static_cast<unsigned long long>(totals.delivered), totals.delivered / seconds,
+           static_cast<unsigned long long>(totals.serverNotices));
+    PrintLatency("connect", totals.connectUs);
+    PrintLatency("latency", totals.latencyUs);
+
+    for (Connection& c : connections) {
+        if (c.socket != INVALID_SOCKET) {
+            closesocket(c.socket);
+        }
+    }
+    return 0;
+}
+
+//=============================================================================
+// REPLAY
+//=============================================================================
+
+/** Chat lines or requests awaiting an answer per connection; past this they are forgotten */
+constexpr size_t MAX_PENDING_REPLIES = 4096;
+
+/** Unsent bytes over all connections at which --speed 0 stops reading the capture */
+constexpr size_t MAX_REPLAY_BACKLOG = 8 * 1024 * 1024;
+
+/** Capture records applied between two polls, so replies keep being read */
+constexpr size_t MAX_EVENTS_PER_PASS = 4096;
+
+struct ReplayConnection {
+    SOCKET socket = INVALID_SOCKET;
+    bool closing = false;           // Disconnect captured; close once the bytes are out
+    NetProtocol::FrameDecoder decoder;
+    std::string outbound;
+    size_t outboundOffset = 0;
+    std::unordered_map<uint32_t, uint64_t> requests;            // requestId -> sent at
+    std::unordered_map<size_t, std::deque<uint64_t>> lines;     // Hash of chat content -> sent at
+    size_t pendingLines = 0;
+};
+
+struct ReplayTotals {
+    uint64_t events = 0;
+    uint64_t opened = 0;
+    uint64_t connectFailures = 0;
+    uint64_t disconnects = 0;       // Closed by the server, not by the capture
+    uint64_t framesSent = 0;
+    uint64_t framesReceived = 0;
+    LatencyHistogram lagUs;
+    LatencyHistogram responseUs;
+    LatencyHistogram echoUs;
+};
+
+size_t LineHash(std::string_view content) {
+    return std::hash<std::string_view>()(content);
+}
+
+bool OpenReplayConnection(const sockaddr_in& address, ReplayConnection& c, ReplayTotals& totals) {
+    c.socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (c.socket != INVALID_SOCKET &&
+        connect(c.socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR) {
+        closesocket(c.socket);
+        c.socket = INVALID_SOCKET;
+    }
+    if (c.socket == INVALID_SOCKET) {
+        ++totals.connectFailures;
+        return false;
+    }
+    NetProtocol::ConfigureSocket(c.socket);
+    NetProtocol::SetNonBlocking(c.socket);
+    ++totals.opened;
+    return true;
+}
+
+/** @brief Remember what a replayed frame should bring back */
+void TrackSent(ReplayConnection& c, const std::string& frame, uint64_t nowUs) {
+    std::string_view line;
+    if (Protocol::Wire::IsEnvelope(frame)) {
+        Protocol::Wire::EnvelopeView envelope;
+        if (!Protocol::Wire::DecodeEnvelope(frame, envelope) || !envelope.isRequest()) {
+            return;
+        }
+        if (envelope.requestId != 0) {
+            if (c.requests.size() >= MAX_PENDING_REPLIES) {
+                c.requests.clear();
+            }
+            c.requests[envelope.requestId] = nowUs;
+        }
+        Protocol::Wire::SendMessageView message;
+        if (envelope.type != static_cast<uint8_t>(Protocol::RequestType::SendMessage) ||
+            !Protocol::Wire::ReadPayload(envelope.payload, message)) {
+            return;
+        }
+        line = message.content;
+    }
+    else {
+        uint32_t version = 0;
+        std::string username;
+        if (frame.empty() || frame[0] == '/' || NetProtocol::ParseHello(frame, version, username)) {
+            return;     // Commands answer in their own words
+        }
+        line = frame;
+    }
+
+    if (c.pendingLines >= MAX_PENDING_REPLIES) {
+        c.lines.clear();
+        c.pendingLines = 0;
+    }
+    c.lines[LineHash(line)].push_back(nowUs);
+    ++c.pendingLines;
+}
+
+void HandleReplayFrame(ReplayConnection& c, const std::string& frame, uint64_t nowUs, ReplayTotals& totals) {
+    ++totals.framesReceived;
+
+    uint32_t version = 0;
+    if (NetProtocol::ParseWelcome(frame, version)) {
+        if (version >= NetProtocol::COMPRESSION_PROTOCOL_VERSION) {
+            c.decoder.EnableCompression();
+        }
+        return;
+    }
+
+    if (Protocol::Wire::IsEnvelope(frame)) {
+        Protocol::Wire::EnvelopeView envelope;
+        if (Protocol::Wire::DecodeEnvelope(frame, envelope) && !envelope.isRequest()) {
+            auto request = c.requests.find(envelope.requestId);
+            if (request != c.requests.end()) {
+                totals.responseUs.Record(nowUs - request->second);
+                c.requests.erase(request);
+            }
+        }
+        return;
+    }
+
+    // Fanned-out chat is "<name>: <content>", possibly behind a channel tag
+    size_t separator = frame.find(": ");
+    if (separator == std::string::npos) {
+        return;
+    }
+    auto line = c.lines.find(LineHash(std::string_view(frame).substr(separator + 2)));
+    if (line != c.lines.end()) {
+        totals.echoUs.Record(nowUs - line->second.front());
+        line->second.pop_front();
+        if (line->second.empty()) {
+            c.lines.erase(line);
+        }
+        --c.pendingLines;
+    }
+}
+
+/** @brief Apply one capture record; returns the bytes it queued */
+size_t ApplyEvent(const Options& options, const sockaddr_in& address,
+                  std::unordered_map<uint32_t, ReplayConnection>& connections,
+                  const TrafficCapture::Reader::Event& event, uint64_t nowUs, ReplayTotals& totals) {
+    auto found = connections.find(event.connection);
+    if (event.kind == TrafficCapture::Kind::Disconnect) {
+        if (found != connections.end()) {
+            found->second.closing = true;
+        }
+        return 0;
+    }
+
+    bool opened = false;
+    if (found == connections.end()) {
+        found = connections.try_emplace(event.connection).first;
+        OpenReplayConnection(address, found->second, totals);
+        opened = true;
+    }
+    ReplayConnection& c = found->second;
+    if (c.socket == INVALID_SOCKET || event.kind != TrafficCapture::Kind::Frame) {
+        return 0;
+    }
+
+    size_t before = c.outbound.size();
+    uint32_t version = 0;
+    std::string username;
+    if (opened && !NetProtocol::ParseHello(event.payload, version, username)) {
+        // Connected before the capture started; its own HELLO was not recorded
+        QueueFrame(c, NetProtocol::BuildHello(NetProtocol::PROTOCOL_VERSION,
+                                              options.name + "_" + std::to_string(event.connection)));
+    }
+    QueueFrame(c, event.payload);
+    TrackSent(c, event.payload, nowUs);
+    ++totals.framesSent;
+    return c.outbound.size() - before;
+}
+
+int RunReplay(const Options& options) {
+    sockaddr_in address;
+    if (!ResolveAddress(options, address)) {
+        return 1;
+    }
+    TrafficCapture::Reader reader;
+    if (!reader.Open(options.replayPath)) {
+        printf("[LOADGEN] %s is not a traffic capture\n", options.replayPath.c_str());
+        return 1;
+    }
+
+    ReplayTotals totals;
+    std::unordered_map<uint32_t, ReplayConnection> connections;
+    std::vector<NetProtocol::PollFd> pollSet;
+    std::vector<uint32_t> pollOwner;
+    std::string frame;
+
+    TrafficCapture::Reader::Event event;
+    bool haveEvent = reader.Next(event);
+    uint64_t capturedUs = 0;
+    const uint64_t drainUs = 2000000;       // Collect replies still in flight after the last record
+    const uint64_t startUs = NowUs();
+    uint64_t lastEventUs = startUs;
+
+    if (options.speed > 0) {
+        printf("[LOADGEN] Replaying %s at %.2fx\n", options.replayPath.c_str(), options.speed);
+    } else {
+        printf("[LOADGEN] Replaying %s as fast as possible\n", options.replayPath.c_str());
+    }
+
+    for (;;) {
+        uint64_t nowUs = NowUs();
+        size_t backlog = 0;
+        for (auto& [number, c] : connections) {
+            backlog += c.outbound.size() - c.outboundOffset;
+        }
+
+        // Everything due by now, on the capture's clock scaled by --speed
+        for (size_t applied = 0; haveEvent && applied < MAX_EVENTS_PER_PASS; ++applied) {
+            if (options.speed > 0) {
+                uint64_t dueUs = startUs + static_cast<uint64_t>(event.timeUs / options.speed);
+                if (dueUs > nowUs) {
+                    break;
+                }
+                totals.lagUs.Record(nowUs - dueUs);
+            }
+            else if (backlog >= MAX_REPLAY_BACKLOG) {
+                break;
+            }
+            backlog += ApplyEvent(options, address, connections, event, nowUs, totals);
+            ++totals.events;
+            capturedUs = event.timeUs;
+            lastEventUs = nowUs;
+            haveEvent = reader.Next(event);
+        }
+        if (!haveEvent && nowUs >= lastEventUs + drainUs) {
+            break;
+        }
+
+        pollSet.clear();
+        pollOwner.clear();
+        for (auto it = connections.begin(); it != connections.end();) {
+            ReplayConnection& c = it->second;
+            bool flushed = c.socket != INVALID_SOCKET && FlushOutbound(c);
+            if (!flushed || (c.closing && c.outbound.empty())) {
+                if (c.socket != INVALID_SOCKET) {
+                    closesocket(c.socket);
+                    totals.disconnects += c.closing ? 0 : 1;
+                }
+                it = connections.erase(it);
+                continue;
+            }
+            NetProtocol::PollFd entry = {};
+            entry.fd = c.socket;
+            entry.events = POLLRDNORM | (c.outbound.empty() ? 0 : POLLWRNORM);
+            pollSet.push_back(entry);
+            pollOwner.push_back(it->first);
+            ++it;
+        }
+
+        if (pollSet.empty()) {
+            if (!haveEvent) {
+                break;
+            }
+            continue;
+        }
+        if (NetProtocol::PollSockets(pollSet.data(), pollSet.size(), 1) == SOCKET_ERROR) {
+            printf("[LOADGEN] Poll failed: %d\n", NetProtocol::LastSocketError());
+            break;
+        }
+
+        nowUs = NowUs();
+        for (size_t p = 0; p < pollSet.size(); ++p) {
+            if ((pollSet[p].revents & (POLLRDNORM | POLLERR | POLLHUP)) == 0) {
+                continue;
+            }
+            ReplayConnection& c = connections[pollOwner[p]];
+            NetProtocol::Result result;
+            while ((result = NetProtocol::ReceiveMessage(c.socket, c.decoder, frame)) == NetProtocol::Result::Success) {
+                HandleReplayFrame(c, frame, nowUs, totals);
+            }
+            if (result != NetProtocol::Result::WouldBlock) {
+                closesocket(c.socket);
+                c.socket = INVALID_SOCKET;
+                totals.disconnects += c.closing ? 0 : 1;
+            }
+        }
+    }
+
+    double seconds = (std::max)(lastEventUs - startUs, uint64_t(1)) / 1000000.0;
+    printf("\n=== Replay results ===\n");
+    printf("capture      %llu records over %.1f s\n",
+           static_cast<unsigned long long>(totals.events), capturedUs / 1000000.0);
+    printf("replayed in  %.1f s\n", seconds);
+    printf("connections  %llu opened, %llu connect failures, %llu dropped by the server\n",
+           static_cast<unsigned long long>(totals.opened),
+           static_cast<unsigned long long>(totals.connectFailures),
+           static_cast<unsigned long long>(totals.disconnects));
+    printf("sent         %llu frames (%.1f frames/s)\n",
+           static_cast<unsigned long long>(totals.framesSent), totals.framesSent / seconds);
+    printf("received     %llu frames (%.1f frames/s)\n",
+           static_cast<unsigned long long>(totals.framesReceived), totals.framesReceived / seconds);
+    if (options.speed > 0) {
+        PrintLatency("lag", totals.lagUs);
+    }
+    PrintLatency("response", totals.responseUs);
+    PrintLatency("echo", totals.echoUs);
+
+    for (auto& [number, c] : connections) {
+        if (c.socket != INVALID_SOCKET) {
+            closesocket(c.socket);
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (!NetProtocol::StartNetworking()) {
+        printf("[LOADGEN] Socket library failed to start\n");
+        return 1;
+    }
+    int status = options.replayPath.empty() ? Run(options) : RunReplay(options);
+    NetProtocol::StopNetworking();
+    return status;
+}